@@ -141,6 +141,7 @@ to exclude the API function. */
 #define INCLUDE_uxTaskGetStackHighWaterMark			1
 #define INCLUDE_eTaskGetState						1
 #define INCLUDE_xTimerPendFunctionCall				1
+#define INCLUDE_xSemaphoreGetMutexHolder			1
 
 /* Cortex-M specific definitions. */
 #ifdef __NVIC_PRIO_BITS
@@ -0,0 +1,124 @@
+/*
+ * backup.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __BACKUP_H__
+#define __BACKUP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ARC_VERSION			1					///< the version of the archive contents written by this firmware
+#define ARC_MAGIC			"070702"			///< cpio "new ASCII" format with checksum
+#define ARC_HDRSIZE			110					///< the size of a cpio header (without the name)
+#define ARC_NAMELEN			128					///< the maximum length of a member name including the null byte
+#define ARC_MANIFEST		"backup.inf"		///< the name of the first member that describes the archive
+#define ARC_MANIFEST_MAX	512					///< the maximum size of the manifest
+#define ARC_TRAILER			"TRAILER!!!"		///< the name of the last member
+
+#define ARC_IFMT			0170000				///< file type mask of the mode
+#define ARC_IFDIR			0040000				///< a directory
+#define ARC_IFREG			0100000				///< a regular file
+
+/**
+ * The contents of the manifest
+ */
+struct arc_info {
+	int				version;					///< the version of the archive contents
+	uint32_t		serial;						///< the serial number of the station that wrote the archive
+	char			firmware[32];				///< the firmware version of the station that wrote the archive
+	uint32_t		areas;						///< a bitmask of the areas (directories) contained in the archive
+};
+
+enum arc_error {
+	ARC_OK = 0,									///< no error
+	ARC_EFORMAT,								///< not a cpio archive with checksums or a corrupted header
+	ARC_EMANIFEST,								///< the manifest is missing or invalid
+	ARC_EVERSION,								///< the archive was written by a newer firmware
+	ARC_EPATH,									///< a member is outside of the areas of the archive
+	ARC_ETYPE,									///< a member is neither a file nor a directory
+	ARC_ECHECKSUM,								///< the contents of a member don't match its checksum
+	ARC_ETRUNCATED,								///< the archive ends before the trailer
+	ARC_EWRITE,									///< the handler could not store a member
+	ARC_ERRORS									///< the number of error codes
+};
+
+/**
+ * The callbacks of the reader for the members following the manifest.
+ * A callback returns a negative value to abort the reading (ARC_EWRITE).
+ */
+struct arc_handler {
+	int (*begin)(void *priv, const char *name, uint32_t mode, uint32_t size);	///< a new member starts
+	int (*data)(void *priv, const uint8_t *buf, int len);						///< the next part of the member's contents
+	int (*end)(void *priv);														///< the member is complete and its checksum is correct
+};
+
+/**
+ * The state of a reader that gets the archive in chunks of arbitrary size
+ */
+struct arc_reader {
+	int				state;						///< the part of the archive that is currently read
+	enum arc_error	err;						///< the first error that occurred
+	const struct arc_handler *h;				///< the callbacks for the members
+	void			*priv;						///< a private argument for the callbacks
+	uint8_t			hdr[ARC_HDRSIZE];			///< the header of the current member
+	char			name[ARC_NAMELEN];			///< the name of the current member
+	char			manifest[ARC_MANIFEST_MAX];	///< the contents of the manifest
+	uint32_t		fill;						///< the number of bytes already read of the current part
+	uint32_t		namesize;					///< the size of the name including the null byte
+	uint32_t		mode;						///< the mode of the current member
+	uint32_t		size;						///< the size of the current member
+	uint32_t		check;						///< the checksum of the current member from the header
+	uint32_t		sum;						///< the checksum of the contents read so far
+	int				members;					///< the number of members read so far (including the manifest)
+	struct arc_info	info;						///< the contents of the manifest
+};
+
+/*
+ * Prototypes Utilities/archive.c
+ */
+const char *arc_area (int idx);
+uint32_t arc_checksum (uint32_t sum, const uint8_t *buf, int len);
+int arc_padding (uint32_t size);
+int arc_header (char *buf, int size, uint32_t ino, const char *name, uint32_t mode, uint32_t fsize, uint32_t mtime, uint32_t check);
+int arc_manifest (char *buf, int size, const struct arc_info *info);
+bool arc_parseManifest (const char *buf, int len, struct arc_info *info);
+bool arc_pathAllowed (const char *name, uint32_t areas);
+void arc_readerInit (struct arc_reader *r, const struct arc_handler *h, void *priv);
+enum arc_error arc_feed (struct arc_reader *r, const uint8_t *buf, int len);
+enum arc_error arc_finish (struct arc_reader *r);
+const char *arc_strerror (enum arc_error err);
+
+/*
+ * Prototypes System/backup.c
+ */
+struct bak_restore;
+int bak_backup (int sock);
+struct bak_restore *bak_restoreStart (void);
+int bak_restoreData (void *arg, uint8_t *buf, int len);
+enum arc_error bak_restoreFinish (struct bak_restore *rs);
+void bak_recover (void);
+
+#endif /* __BACKUP_H__ */
@@ -32,6 +32,9 @@
 
 #include "bidib_messages.h"
 #include "decoder.h"			// include this to have "enum fmt", includes "bidib.h" itself to have "BIDIB_UID_LEN" defined ... (!)
+#include "bidibdispatch.h"
+#include "bidibfwu.h"
+#include "bidibocc.h"
 
 #define BIDIB_PORT				62875				///< netBiDiB port for the UDP-announcer (fixed!), TCP gets it's port from configuration
 #define BIDIB_SIGNATURE_TAMS	"BiDiB-mc2"			///< a signature identifyer which _must_ start with "BiDiB"
@@ -52,6 +55,7 @@
 #define BIDIB_HUB_S88			1					///< the fixed serial suffix of the HUB node UID for s88 modules
 #define BIDIB_HUB_MCAN			2					///< the fixed serial suffix of the HUB node UID for mcan modules
 #define BIDIB_HUB_LNET			3					///< the fixed serial suffix of the HUB node UID for loconet modules
+#define BIDIB_VFB_MODULES		(FB_MCAN_OFFSET / 16 + MAX_CANMODULES)	///< the (s88-)modules that may be represented by virtual feedback nodes
 
 #define BIDIB_CLASS_SWITCH		0x01				///< contains switchable accessory functions
 #define BIDIB_CLASS_BOOSTER		0x02				///< contains a booster
@@ -64,6 +68,9 @@
 
 #define MAX_PRODUCT_STRING		24					///< according to documentation, the PRODUCT string must not be longer than 24 characters (plus null byte)
 #define MAX_USER_STRING			24					///< according to documentation, the USER string must not be longer than 24 characters (plus null byte)
+#define BIDIB_MAX_FWJOBS		64					///< the maximum number of firmware update jobs reported to the user interface
+#define BDBBM_EVT_BLOCK			0					///< EVENT_BLOCKOCC parameter: src is a struct occ_change
+#define BDBBM_EVT_RAILCOM		1					///< EVENT_BLOCKOCC parameter: src is a struct occ_rcdata
 
 #define BIDIBUS_MAX_NODEADR		63					///< the maxmimum node address in BiDiBus protocol (6 bits) - virtual nodes get addresses beyond this
 #define LOCAL_NODE()			BDBnode_lookupNode(0)
@@ -118,8 +125,7 @@ struct bidibnode {
 	struct bidibnode	*children;		///< a list of subnodes, if this bidibnode is a HUB
 	struct bidibnode	*parent;		///< the parent node if not root node
 	struct nodefeature	*features;		///< the list of available features on the bidibnode
-	const struct msgdecoder	*downstream;	///< handler table for downstream messages
-	const struct msgdecoder	*upstream;	///< handler table for upstream messages to sniff operation when on external control
+	struct bdbd_table	*downstream;	///< dispatch table for downstream messages
 	struct ntab_report	*ntab_rep;		///< a copy of the actual node table to report upstream
 	uint16_t			 pversion;		///< the supported protocol version from other side
 	uint8_t				 uid[BIDIB_UID_LEN];		///< the UID of the bidibnode
@@ -177,13 +183,26 @@ struct feedback_map {
 };
 
 /**
- * A strcuture to hold interpreter information used for handling the received messages
+ * The state of a firmware update job as reported to the user interface
  */
-struct msgdecoder {
-	uint8_t		msg;					///< the message byte
-	void (*handler)(struct bidibnode *n, bidibmsg_t *msg);	///< a function that handles the contents of the message data
+struct bdbfw_info {
+	uint8_t				uid[BIDIB_UID_LEN];	///< the UID of the node
+	enum fwu_state		state;				///< the state of the update
+	enum fwu_error		error;				///< the reason for a failed update
+	uint8_t				nodeerr;			///< the error code reported by the node
+	int					progress;			///< the progress in percent
+	bool				resume;				///< the job is waiting to be resumed
 };
 
+/**
+ * The dispatch tables used for handling the received messages (see bidibdispatch.h)
+ */
+extern struct bdbd_table BDBctrl_upstream;		///< upstream messages when we are the controller (bidibctrl.c)
+extern struct bdbd_table BDBsrv_sniffing;		///< upstream messages sniffed when on external control (bidibserver.c)
+extern struct bdbd_table BDBsrv_downstream;		///< downstream messages to our local node (bidibserver.c)
+extern struct bdbd_table BDBvn_bridgeDown;		///< downstream messages to the virtual bridge nodes (virtualnode.c)
+extern struct bdbd_table BDBvn_feedbackDown;	///< downstream messages to the virtual feedback nodes (virtualnode.c)
+
 enum opmode {
 	BIDIB_CONTROLLER,					///< we control the BiDiB system ourself
 	BIDIB_SERVER						///< we have the server role and are controlled by an upstream instance
@@ -203,6 +222,20 @@ uint16_t bidib_getSysTime (void);
 void bidib_identify (bool on);
 void bidib_identifyToggle (void);
 
+/*
+ * Prototypes Interfaces/BiDiB/bidibbm.c
+ */
+void BDBbm_occupy (struct bidibnode *n, uint8_t port, bool occupied);
+void BDBbm_multiple (struct bidibnode *n, uint8_t base, int bits, const uint8_t *data);
+void BDBbm_address (struct bidibnode *n, bidibmsg_t *m);
+int BDBbm_transponder (int fbidx, uint16_t adr, bool present);
+void BDBbm_speed (struct bidibnode *n, bidibmsg_t *m);
+void BDBbm_dynState (struct bidibnode *n, bidibmsg_t *m);
+void BDBbm_nodeLost (struct bidibnode *n);
+int BDBbm_getBlocks (struct occ_block *blk, int max);
+bool BDBbm_getFeedback (int fbidx, struct occ_block *blk);
+bool BDBbm_getRailcom (int adr, struct occ_rcdata *rc);
+
 /*
  * Prototypes Interfaces/BiDiB/bidibctrl.c
  */
@@ -226,6 +259,19 @@ void BDBus_resetBus (bidibmsg_t *msg);
 void BDBus_sendMessage (bidibmsg_t *bm);
 void BDBus (void *pvParameter);
 
+/*
+ * Prototypes Interfaces/BiDiB/bidibfw.c
+ */
+uint8_t BDBfw_findImages (uint8_t *uid, char names[FWU_DESTS][64], uint32_t sizes[FWU_DESTS]);
+int BDBfw_start (uint8_t *uid, bool par);
+void BDBfw_resume (uint8_t *uid);
+void BDBfw_cancel (uint8_t *uid);
+void BDBfw_clear (void);
+void BDBfw_poll (void);
+void BDBfw_status (struct bidibnode *n, bidibmsg_t *m);
+void BDBfw_nodeLost (struct bidibnode *n);
+int BDBfw_getJobs (struct bdbfw_info *info, int max);
+
 /*
  * Prototypes Interfaces/BiDiB/bidibnode.c
  */
@@ -255,6 +301,8 @@ void BDBnode_uplink (struct bidibnode *n, bidibmsg_t *m);
  */
 //void BDBsrv_handleMessage (bidibmsg_t *m);
 void BDBsrv_upstream (bidibmsg_t *bm);
+bool BDBsrv_locoReportPending (void);
+void BDBsrv_locoReportService (void);
 void BDBsrv_readControls (bidibmsg_t *msgs);
 void BDBsrv_updateFeatures (void);
 struct bidibnode *BDBsrv_genLocalNode (void);
@@ -269,6 +317,8 @@ int bidib_readAdrStack (uint8_t *p, uint32_t *adr);
 void bidib_debugSingleMessage (const char *caller, struct bidibmsg *msg, bool up);
 void bidib_debugMessages (const char *caller, struct bidibmsg *msg, bool up);
 void bidib_debugError (const char *caller, struct bidibmsg *msg);
+const char *bidib_msgName (uint8_t msg);
+struct bdbd_table *bidib_dispatchTable (int idx);
 //adrstack_t bidib_genSubAdr (adrstack_t nodeadr, uint8_t subadr);
 adrstack_t bidib_num2stack (uint32_t adr);
 adrstack_t bidib_getAddress (struct bidibnode *n);
@@ -340,6 +390,11 @@ struct bidibnode *BDBvn_newMCAN (struct bidibnode *parent, int serial);
 struct bidibnode *BDBvn_newLNET (struct bidibnode *parent, int serial);
 int BDBvn_feedbackModules (int oldcount, int count, int maxcount, int hubSerial);
 void BDBvn_clearFbMappings (void);
+void BDBvn_nodeFreed (struct bidibnode *n);
+struct bidibnode *BDBvn_feedbackNode (int module);
+bool BDBvn_feedbackUID (int module, uint8_t *uid);
+uint8_t BDBvn_feedbackUpdate (int module, uint16_t status);
+bidibmsg_t *BDBvn_feedbackReport (int module, uint8_t bytes);
 //void BDBvn_feedbackStatus (struct bidibnode *n, uint16_t newstate);
 //struct bidibnode *BDBvn_getFeebackNode (int pid, int idx);
 
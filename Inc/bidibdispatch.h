@@ -0,0 +1,84 @@
+/*
+ * bidibdispatch.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __BIDIBDISPATCH_H__
+#define __BIDIBDISPATCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BDBD_OPCODES		256			///< BiDiB message types are 8 bit, so a table has 256 entries
+
+struct bidibnode;
+struct bidibmsg;
+
+/**
+ * A function that handles the contents of a message
+ */
+typedef void (*bdbd_handler)(struct bidibnode *n, struct bidibmsg *m);
+
+/**
+ * The statistics for a single message type
+ */
+struct bdbd_counter {
+	uint32_t		rx;					///< number of messages dispatched
+	uint32_t		handled;			///< number of messages that were passed to a handler
+	uint32_t		unknown;			///< number of messages without a handler
+	uint32_t		error;				///< number of messages that were rejected (i.e. sequence errors, unknown node)
+};
+
+/**
+ * A direct indexed dispatch table for one role (controller, server, virtual nodes, ...).
+ * The handler array is a constant array initialised with designated initialisers
+ * (i.e. <code>[MSG_SYS_MAGIC] = handler</code>).
+ */
+struct bdbd_table {
+	const char				*name;				///< the name of the role for the statistics
+	const bdbd_handler		*handler;			///< the handlers indexed by the message type (BDBD_OPCODES entries)
+	struct bdbd_counter		 cnt[BDBD_OPCODES];	///< the statistics indexed by the message type
+};
+
+/**
+ * A single message inside a BiDiB packet, still pointing into the packet data
+ */
+struct bdbp_view {
+	uint32_t		adrstack;			///< the address stack with the first level in the most significant byte
+	uint8_t			adrlen;				///< the number of bytes the address stack occupies (including the terminating zero)
+	uint8_t			seq;				///< the message sequence number
+	uint8_t			msg;				///< the message type
+	uint8_t			datalen;			///< number of data bytes
+	const uint8_t	*data;				///< the message data
+};
+
+/*
+ * Prototypes Interfaces/BiDiB/bidibdispatch.c
+ */
+bool bdbd_dispatch (struct bdbd_table *t, struct bidibnode *n, struct bidibmsg *m, uint8_t msg);
+void bdbd_error (struct bdbd_table *t, uint8_t msg);
+void bdbd_clear (struct bdbd_table *t);
+int bdbp_next (const uint8_t *pkt, int len, int *pos, struct bdbp_view *v);
+
+#endif /* __BIDIBDISPATCH_H__ */
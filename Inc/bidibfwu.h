@@ -0,0 +1,147 @@
+/*
+ * bidibfwu.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __BIDIBFWU_H__
+#define __BIDIBFWU_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FWU_UIDLEN			7			///< the length of a BiDiB UID (same as BIDIB_UID_LEN)
+#define FWU_DESTS			2			///< number of destinations (0 = flash, 1 = EEPROM)
+#define FWU_MAXRECORD		64			///< maximum length of a hex record in characters (a message must hold it)
+#define FWU_RETRIES			3			///< number of retransmissions if the node does not answer in time
+#define FWU_ENTERTIMEOUT	1000		///< the time in ms to wait for the answer to MSG_FW_UPDATE_OP ENTER
+#define FWU_MINTIMEOUT		200			///< the minimum time in ms to wait for an answer
+
+/* these are the same as the BIDIB_MSG_FW_UPDATE_OP_xxx and BIDIB_MSG_FW_UPDATE_STAT_xxx codes from bidib_messages.h */
+#define FWU_OP_ENTER		0x00		///< node should enter update mode (followed by the UID)
+#define FWU_OP_EXIT			0x01		///< node should leave update mode
+#define FWU_OP_SETDEST		0x02		///< set destination memory
+#define FWU_OP_DATA			0x03		///< a hex record
+#define FWU_OP_DONE			0x04		///< end of data for the current destination
+#define FWU_STAT_READY		0			///< node is ready
+#define FWU_STAT_EXIT		1			///< exit acknowledged
+#define FWU_STAT_DATA		2			///< node waits for data
+#define FWU_STAT_ERROR		255			///< the node reported an error
+
+/**
+ * The states of a node update
+ */
+enum fwu_state {
+	FWU_IDLE = 0,						///< not started yet
+	FWU_ENTER,							///< ENTER was sent, waiting for STAT_READY
+	FWU_SETDEST,						///< SETDEST was sent, waiting for STAT_DATA
+	FWU_DATA,							///< a hex record was sent, waiting for STAT_DATA
+	FWU_DONE,							///< DONE was sent, waiting for STAT_READY
+	FWU_EXIT,							///< EXIT was sent, waiting for STAT_EXIT
+	FWU_FINISHED,						///< the update completed successfully
+	FWU_FAILED,							///< the update failed (see error code)
+};
+
+/**
+ * The reasons for a failed update
+ */
+enum fwu_error {
+	FWU_ERR_NONE = 0,					///< no error
+	FWU_ERR_NODE,						///< the node reported an error (see nodeerr)
+	FWU_ERR_TIMEOUT,					///< the node did not answer
+	FWU_ERR_IMAGE,						///< the image could not be read
+	FWU_ERR_SEND,						///< the message could not be sent (node is gone)
+	FWU_ERR_LOST,						///< the node was lost during the update
+	FWU_ERR_CANCELLED,					///< the update was cancelled by the user
+};
+
+/**
+ * The environment of an update job
+ */
+struct fwu_ops {
+	/**
+	 * Read the hex record at the given position of the image for the destination.
+	 * Empty lines must be skipped. The record is returned without line endings.
+	 * \return the length of the record, 0 at the end of the image or a negative value on error
+	 */
+	int (*read)(void *priv, uint8_t dest, uint32_t pos, uint32_t *next, char *rec, int size);
+	/**
+	 * Send a MSG_FW_UPDATE_OP to the node.
+	 * \return false, if the message could not be sent
+	 */
+	bool (*send)(void *priv, uint8_t op, const uint8_t *data, int len);
+};
+
+/**
+ * The state of the update of a single node
+ */
+struct fwu_job {
+	const struct fwu_ops	*ops;			///< the access to image and node
+	void			*priv;					///< private data for the ops
+	uint8_t			 uid[FWU_UIDLEN];		///< the UID of the node
+	enum fwu_state	 state;					///< the current state
+	enum fwu_error	 error;					///< the reason when the state is FWU_FAILED
+	uint8_t			 nodeerr;				///< the error code reported by the node (BIDIB_FW_UPDATE_ERROR_xxx)
+	uint8_t			 dests;					///< a bitmap of destinations that still must be transferred
+	uint8_t			 dest;					///< the current destination
+	uint8_t			 lastop;				///< the last operation sent (for retransmissions)
+	int				 retry;					///< retransmissions of the current operation
+	uint32_t		 pos;					///< the position of the current record in the image
+	uint32_t		 next;					///< the position of the following record
+	uint32_t		 size[FWU_DESTS];		///< the sizes of the images (for the progress)
+	uint32_t		 base;					///< the bytes of destinations that are already completed
+	uint32_t		 timeout;				///< the time to wait for an answer in ms
+	uint32_t		 deadline;				///< the time stamp when the answer is overdue
+	int				 reclen;				///< the length of the current record
+	char			 rec[FWU_MAXRECORD];	///< the current record
+};
+
+/**
+ * The target of an image file name
+ */
+struct fwu_image {
+	bool			 byuid;					///< the image is for the node with the given UID only
+	uint8_t			 uid[FWU_UIDLEN];		///< the UID if byuid is set
+	uint8_t			 vid;					///< the vendor ID
+	uint16_t		 pid;					///< the product ID
+	uint8_t			 dest;					///< the destination (0 = flash, 1 = EEPROM)
+};
+
+/*
+ * Prototypes Interfaces/BiDiB/bidibfwu.c
+ */
+void fwu_init (struct fwu_job *j, const uint8_t *uid, uint8_t dests, const struct fwu_ops *ops, void *priv);
+bool fwu_start (struct fwu_job *j, uint32_t now);
+bool fwu_resume (struct fwu_job *j, uint32_t now);
+void fwu_status (struct fwu_job *j, uint8_t stat, uint8_t detail, uint32_t now);
+void fwu_poll (struct fwu_job *j, uint32_t now);
+void fwu_lost (struct fwu_job *j);
+void fwu_cancel (struct fwu_job *j);
+bool fwu_isActive (const struct fwu_job *j);
+int fwu_progress (const struct fwu_job *j);
+const char *fwu_stateName (enum fwu_state st);
+const char *fwu_errorName (enum fwu_error err);
+bool fwu_parseName (const char *name, struct fwu_image *img);
+bool fwu_matches (const struct fwu_image *img, const uint8_t *uid);
+
+#endif /* __BIDIBFWU_H__ */
@@ -0,0 +1,124 @@
+/*
+ * bidibocc.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __BIDIBOCC_H__
+#define __BIDIBOCC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define OCC_UIDLEN			7			///< the length of a BiDiB UID (same as BIDIB_UID_LEN)
+#define OCC_MAXBLOCKS		128			///< the maximum number of detector ports (blocks) that are tracked
+#define OCC_LOCOS			4			///< the maximum number of addresses reported per block
+#define OCC_RCDATA			32			///< the number of addresses with RailCom data (speed, QoS, ...) that are kept
+
+/* the two upper bits of ADDR_H in MSG_BM_ADDRESS, MSG_BM_SPEED, MSG_BM_CV and MSG_BM_DYN_STATE */
+#define OCC_ADR_MASK		0x3FFF		///< the address itself
+#define OCC_ADR_ACCESSORY	0x4000		///< the address is an accessory (with OCC_ADR_REVERSE: an extended accessory)
+#define OCC_ADR_REVERSE		0x8000		///< a loco was detected in reverse orientation
+
+/* BiDiB DYN_NUM values (MSG_BM_DYN_STATE) */
+#define OCC_DYN_QOS			1			///< receive statistics (lost RailCom messages in percent)
+#define OCC_DYN_TEMP		2			///< decoder temperature (signed byte -30°C .. +127°C)
+#define OCC_DYN_CONTAINER1	3			///< fill level of container 1 (3 .. 5 for the first three containers)
+
+/**
+ * An address detected in a block
+ */
+struct occ_loco {
+	uint16_t		adr;					///< the address (without the flags)
+	bool			accessory;				///< the address belongs to an accessory decoder
+	bool			reverse;				///< the loco was detected in reverse orientation
+};
+
+/**
+ * A single detector port and the addresses that it currently reports
+ */
+struct occ_block {
+	uint8_t			uid[OCC_UIDLEN];		///< the UID of the detector node
+	uint8_t			port;					///< the detector port (MNUM) on the node
+	int				fbidx;					///< the zero based feedback input this port is mapped to (-1 = not mapped)
+	bool			occupied;				///< the block is occupied
+	int				nlocos;					///< the number of detected addresses
+	struct occ_loco	loco[OCC_LOCOS];		///< the detected addresses
+	uint32_t		stamp;					///< the time stamp of the last change
+};
+
+/**
+ * The dynamic data reported for a loco address by the detectors
+ */
+struct occ_rcdata {
+	uint16_t		adr;					///< the address (0 = unused entry)
+	uint16_t		speed;					///< the speed in km/h as reported by the decoder
+	uint8_t			qos;					///< the receive statistics (lost messages in percent)
+	int8_t			temp;					///< the decoder temperature in °C
+	uint8_t			valid;					///< a bitmap of OCC_RCVALID_xxx for the fields that were ever reported
+	uint32_t		rxcount;				///< the number of reports for this address
+	uint32_t		stamp;					///< the time stamp of the last report
+};
+
+#define OCC_RCVALID_SPEED	0x01			///< speed was reported
+#define OCC_RCVALID_QOS		0x02			///< receive statistics were reported
+#define OCC_RCVALID_TEMP	0x04			///< temperature was reported
+
+/**
+ * The change of a block resulting from a single message
+ */
+struct occ_change {
+	struct occ_block	blk;					///< the block after the change
+	bool				occchg;					///< the occupied state changed
+	int					nentered;				///< the number of addresses that entered the block
+	struct occ_loco		entered[OCC_LOCOS];		///< the addresses that entered the block
+	int					nleft;					///< the number of addresses that left the block
+	struct occ_loco		left[OCC_LOCOS];		///< the addresses that left the block
+};
+
+/**
+ * All blocks and RailCom data
+ */
+struct occ_model {
+	int					nblocks;				///< the number of used block entries
+	struct occ_block	blk[OCC_MAXBLOCKS];		///< the blocks in the order they were first reported
+	struct occ_rcdata	rc[OCC_RCDATA];			///< RailCom data per address
+};
+
+/*
+ * Prototypes Interfaces/BiDiB/bidibocc.c
+ */
+void occ_init (struct occ_model *m);
+void occ_decodeAddress (uint8_t lo, uint8_t hi, struct occ_loco *l);
+struct occ_block *occ_lookup (struct occ_model *m, const uint8_t *uid, uint8_t port);
+struct occ_block *occ_lookupFeedback (struct occ_model *m, int fbidx);
+bool occ_occupy (struct occ_model *m, const uint8_t *uid, uint8_t port, int fbidx, bool occupied, uint32_t now, struct occ_change *chg);
+bool occ_address (struct occ_model *m, const uint8_t *uid, uint8_t port, int fbidx, const uint8_t *data, int len, uint32_t now, struct occ_change *chg);
+bool occ_transponder (struct occ_model *m, const uint8_t *uid, uint8_t port, int fbidx, uint16_t adr, bool present, uint32_t now, struct occ_change *chg);
+struct occ_rcdata *occ_speed (struct occ_model *m, uint16_t adr, uint16_t speed, uint32_t now);
+struct occ_rcdata *occ_dynState (struct occ_model *m, uint16_t adr, uint8_t dynnum, uint8_t value, uint32_t now);
+struct occ_rcdata *occ_rcLookup (struct occ_model *m, uint16_t adr);
+int occ_dropNode (struct occ_model *m, const uint8_t *uid);
+int occ_findLoco (const struct occ_model *m, uint16_t adr, int start);
+
+#endif /* __BIDIBOCC_H__ */
@@ -0,0 +1,128 @@
+/*
+ * bstsupervisor.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __BSTSUPERVISOR_H__
+#define __BSTSUPERVISOR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BSV_RINGSIZE		1024		///< number of current samples kept in the history ring (must be a power of 2)
+#define BSV_MAXPRE			256			///< maximum number of samples before the trigger
+#define BSV_MAXPOST			256			///< maximum number of samples after the trigger
+#define BSV_CAPTURES		4			///< number of captures that are kept (the oldest one is overwritten)
+
+/**
+ * The sources of short circuit reports
+ */
+enum bsv_source {
+	BSV_SRC_INTERNAL = 0,				///< the internal booster (overcurrent detected by current measurement)
+	BSV_SRC_MAERKLIN,					///< the Märklin booster interface reported a short
+	BSV_SRC_DCC,						///< the DCC (CDE) booster interface reported a short
+	BSV_SRC_SUPPLY,						///< the supply voltage broke down
+	BSV_SRC_OVERCURRENT,				///< the current crossed the trigger level (no short reported, yet)
+	BSV_SRC_COUNT
+};
+
+/**
+ * The restart strategy after a short
+ */
+enum bsv_restart {
+	BSV_RESTART_MANUAL = 0,				///< stay in SHORT until the user switches on again
+	BSV_RESTART_AUTO,					///< automatic restart with an exponential backoff
+};
+
+/**
+ * The configuration of the supervisor. It is part of the system configuration.
+ */
+struct bsv_config {
+	uint16_t		trigger;			///< current in mA that triggers a capture (0 = capture on shorts only)
+	uint16_t		pre;				///< number of samples (ms) to keep before the trigger
+	uint16_t		post;				///< number of samples (ms) to record after the trigger
+	uint8_t			restart;			///< the restart strategy (enum bsv_restart)
+	uint8_t			retries;			///< maximum number of consecutive automatic restarts
+	uint16_t		delay;				///< the delay in ms before the first automatic restart
+	uint16_t		maxdelay;			///< the maximum delay in ms (the delay is doubled with every retry)
+	uint16_t		stable;				///< after this time in ms without short, the retry counter is reset
+};
+
+/**
+ * A captured current waveform
+ */
+struct bsv_capture {
+	uint32_t		seq;				///< sequence number of this capture (starting with 1, 0 = unused)
+	uint32_t		ts;					///< time stamp of the trigger (ms since system start)
+	uint8_t			source;				///< the trigger source (enum bsv_source)
+	uint16_t		pre;				///< number of samples before the trigger
+	uint16_t		count;				///< total number of samples
+	uint16_t		peak;				///< the peak current in the capture (mA)
+	uint16_t		samples[BSV_MAXPRE + BSV_MAXPOST];	///< the current samples in mA (1ms apart)
+};
+
+/**
+ * Statistics about the short circuits
+ */
+struct bsv_stats {
+	uint32_t		shorts[BSV_SRC_COUNT];	///< number of events per source
+	uint32_t		first;				///< time stamp of the first short (ms)
+	uint32_t		last;				///< time stamp of the last short (ms)
+	uint32_t		overcurrent;		///< accumulated time with current above the trigger level (ms)
+	uint32_t		longest;			///< longest single period of overcurrent (ms)
+	uint32_t		restarts;			///< number of automatic restarts
+	uint32_t		giveups;			///< number of times the automatic restart gave up
+};
+
+/**
+ * The runtime state of the supervisor.
+ */
+struct bsv {
+	const struct bsv_config	*cnf;		///< the configuration
+	uint16_t		ring[BSV_RINGSIZE];	///< the history of current samples
+	uint32_t		count;				///< total number of samples written to the ring
+	uint32_t		trigpos;			///< sample count at the time of the active trigger
+	int				post;				///< number of samples to record after the trigger for the active capture
+	uint32_t		seq;				///< the sequence number of the last capture
+	struct bsv_capture	cap[BSV_CAPTURES];	///< the completed captures
+	struct bsv_capture	*active;		///< the capture that is currently recorded
+	uint32_t		overstart;			///< time when the current crossed the trigger level
+	bool			over;				///< the current is above the trigger level
+	int				retry;				///< number of consecutive automatic restarts
+	struct bsv_stats	stats;			///< the statistics
+};
+
+/*
+ * Prototypes HW/bstsupervisor.c
+ */
+void bsv_defaults (struct bsv_config *cnf);
+void bsv_init (struct bsv *b, const struct bsv_config *cnf);
+bool bsv_sample (struct bsv *b, uint32_t now, int ma);
+bool bsv_trigger (struct bsv *b, uint32_t now, enum bsv_source src);
+int bsv_short (struct bsv *b, uint32_t now, enum bsv_source src);
+void bsv_restarted (struct bsv *b);
+const struct bsv_capture *bsv_getCapture (const struct bsv *b, int idx);
+void bsv_clearStats (struct bsv *b);
+
+#endif /* __BSTSUPERVISOR_H__ */
@@ -27,9 +27,13 @@
 #ifndef __CONFIG_H__
 #define __CONFIG_H__
 
+#include "s88filter.h"
+#include "bstsupervisor.h"
+
 #define CONFIG_DIR		"/config/"					///< the directory where all our configuration files should lie
 #define FIRMWARE_DIR	"/uploads/"					///< the directory where all our firmware update files should lie
 #define MANUALS_DIR		"/manuals/"					///< the directory where all our PDF manuals go
+#define BIDIBFW_DIR		"/bidibfw/"					///< the directory for firmware images of BiDiB nodes
 #define CONFIG_LOCO		CONFIG_DIR"loco.ini"		///< the ini file that holds the settings for all known locos
 #define CONFIG_SYSTEM	CONFIG_DIR"config.ini"		///< system settings like IP-configuration, track voltage and so on
 #define CONFIG_BIDIB	CONFIG_DIR"bidib.ini"		///< known and trusted netBiDiB clients and node configurations
@@ -51,6 +55,8 @@
 #define SYSFLAG_STARTSTATE			0x1000	///< After Power on -> Stop or Go
 #define SYSFLAG_GLOBAL_BIDIB_SHORT	0x2000	///< a SHORT on a BiDiB-Booster will set the whole system to SHORT status (controller mode only)
 #define SYSFLAG_BIDIB_ONOFF			0x4000	///< if set, BiDiB Booster's STOP and GO keys are functional and work system wide
+#define SYSFLAG_REPORTTARGET		0x8000	///< report the target speed of locos with momentum instead of the speed currently on the track
+#define SYSFLAG_WLAN				0x10000	///< use the ESP-01 module as WLAN network interface (takes effect with the next start)
 
 // format flags
 #define SIGFLAG_RAILCOM				0x0001	///< generate railcom cutout
@@ -117,6 +123,9 @@ struct sysconf {
     int					canModules;		///< No of can modules
     int					lnetModules;	///< No of loconet modules
     int					s88Frequency;	///< speed of s88 bus in Hz
+    struct s88f_config	s88filter;		///< the debounce filter settings for the s88 inputs
+    struct bsv_config	bstsv;			///< the booster supervisor settings (current capture and restart strategy)
+    int					ownpolicy;		///< what happens if a client commands a loco owned by another client (enum own_policy)
     struct {
         uint16_t			port;		///< Port to use for netBiDiB TCP in host byte order
         char				user[32];	///< a user configurable name of this device (up to 24 characters + null byte)
@@ -156,6 +165,7 @@ struct sysconf *cnf_getconfig (void);
 char *cnf_getBoosterLimits (void);
 struct fmtconfig *cnf_getFMTconfig (void);
 struct sysconf *cnf_readConfig (void);
+void cnf_flushStore (void);
 void cnf_triggerStore (const char *caller);
 
 
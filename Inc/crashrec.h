@@ -0,0 +1,107 @@
+/*
+ * crashrec.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __CRASHREC_H__
+#define __CRASHREC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CRASH_MAGIC			0x48535243		///< "CRSH" in little endian byte order
+#define CRASH_VERSION		1				///< the version of the record layout (Tools/crashdecode.py must know it)
+#define CRASH_NAMELEN		16				///< the length of task names (same as configMAX_TASK_NAME_LEN)
+#define CRASH_INFOLEN		96				///< the length of the textual information (i.e. the failed assertion)
+#define CRASH_MAXTASKS		32				///< the maximum number of tasks in the snapshot
+#define CRASH_FRAMES		20				///< the maximum depth of the backtrace
+#define CRASH_LOGSIZE		1536			///< the size of the log tail
+#define CRASH_KEEP			8				///< the number of crash records kept in the file system
+#define CRASH_DIR			"/crash/"		///< the directory where the crash records are persisted
+
+enum crash_reason {
+	CRASH_NONE = 0,							///< no crash recorded
+	CRASH_FAULT,							///< a fault (MemManage, BusFault, UsageFault, HardFault) in a task
+	CRASH_FAULT_ISR,						///< a fault in an exception handler (direct reset, no task snapshot)
+	CRASH_ASSERT,							///< a failed assertion
+	CRASH_STACKOVERFLOW,					///< the stack overflow hook was called
+	CRASH_WATCHDOG,							///< a supervised task starved (no heartbeat)
+};
+
+/**
+ * The state of a task at the time of the crash
+ */
+struct __attribute__((packed)) crash_task {
+	char			name[CRASH_NAMELEN];	///< the name of the task
+	uint8_t			state;					///< the state (eTaskState: 0 = running, 1 = ready, 2 = blocked, 3 = suspended, 4 = deleted)
+	uint8_t			prio;					///< the current priority
+	uint16_t		hwm;					///< the stack high water mark (the minimum free stack in words)
+	uint32_t		stack;					///< the base address of the stack
+};
+
+/**
+ * The crash record. It is written to the backup SRAM that survives a reset and
+ * copied to the file system on the next boot. All values are little endian.
+ */
+struct __attribute__((packed)) crash_record {
+	uint32_t			magic;						///< CRASH_MAGIC
+	uint16_t			version;					///< CRASH_VERSION
+	uint16_t			size;						///< sizeof(struct crash_record)
+	uint32_t			crc;						///< CRC-32 over the whole record with this field set to 0
+	uint32_t			reason;						///< the reason for the record (enum crash_reason)
+	uint32_t			uptime;						///< the time since boot in ms
+	uint32_t			pc;							///< the address where the fault occured (or the caller of the assertion)
+	uint32_t			lr;							///< the link register at the time of the fault
+	uint32_t			sp;							///< the stack pointer at the time of the fault
+	uint32_t			xpsr;						///< the program status register at the time of the fault
+	uint32_t			r[5];						///< r0 - r3 and r12 at the time of the fault
+	uint32_t			cfsr;						///< configurable fault status register
+	uint32_t			hfsr;						///< hard fault status register
+	uint32_t			mmfar;						///< MemManage fault address register
+	uint32_t			bfar;						///< BusFault address register
+	char				task[CRASH_NAMELEN];		///< the name of the task that crashed
+	char				info[CRASH_INFOLEN];		///< textual information (assertion, task name of stack overflow)
+	uint16_t			ntasks;						///< the number of valid entries in tasks[]
+	uint16_t			nframes;					///< the number of valid entries in frames[]
+	uint16_t			loglen;						///< the number of valid characters in log[]
+	uint16_t			fill;						///< unused, keeps the following arrays aligned
+	struct crash_task	tasks[CRASH_MAXTASKS];		///< the snapshot of all tasks
+	uint32_t			frames[CRASH_FRAMES];		///< the backtrace (return addresses, innermost first)
+	char				log[CRASH_LOGSIZE];			///< the last lines of the debug log
+};
+
+/*
+ * Prototypes System/crashrec.c
+ */
+void crash_init (void);
+void crash_fault (const uint32_t *frame, bool isr);
+void crash_faultTask (void);
+void crash_assert (const char *file, unsigned long line, const char *func, const char *expr, void *caller);
+void crash_stackOverflow (const char *name);
+void crash_watchdog (const char *task, const char *info);
+void crash_persist (void);
+int crash_list (int *idx, int max);
+int crash_read (int idx, uint8_t *buf, int size);
+
+#endif /* __CRASHREC_H__ */
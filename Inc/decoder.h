@@ -25,6 +25,9 @@
  */
 
 #include "bidib.h"
+#include "snifferrec.h"
+#include "ramp.h"
+#include "owner.h"
 
 /**
  * @ingroup Track
@@ -401,21 +404,49 @@ struct loco {
 	uint32_t		 flags;						///< decoder and format relevant flags (DEC_...)
 	funcT			*funcs;						///< a list of function properties, unlisted functions are standard switching without icon
 	struct dccaInfo	*dcca;						///< optional information gathered thru DCC-A commands
+	struct ramp_profile ramp;					///< the momentum simulated by the command station (acceleration and braking)
 	char			 name[LOCO_NAME_LEN];		///< a name given to this loco (must be null terminated)
 };
 
 typedef struct ldata ldataT;
 struct ldata {
 	ldataT			*next;						///< linked list of live loco data
+	ldataT			*hnext;						///< the next entry in the same bucket of the address index
+	uint32_t		 gen;						///< the generation (sequence number) when this entry was added to the refresh list
 	locoT			*loco;						///< the connection to the base information of this loco
 	ldataT			*consist;					///< a list of linked locos (multitraction / consist) organized as a ring
 	TickType_t		 purgeTime;					///< time left until the loco leave the refresh (ms)
 	uint32_t		 flags;						///< operational flags LOCO_...
-	int				 speed;						///< current speed as positive integer value including the direction bit (bit 7) as for DCC
+	int				 speed;						///< reported speed as positive integer value including the direction bit (bit 7) as for DCC (the target or current speed, see SYSFLAG_REPORTTARGET)
+	int				 target;					///< the speed requested by the controls (same notation as speed)
+	int				 current;					///< the speed that is sent to the track (differs from target while the momentum ramp is running)
+	uint32_t		 rampacc;					///< the time in ms accumulated for the next step of the momentum ramp
+	struct own_entry own;						///< the client that controls this loco (see owner.c)
 	uint32_t		 funcs[MAX_FUNC_WORDS];		///< a bit array holding the state of all functions
 	int				 age;						///< a count for successive refresh cycles, may be used to outdate unused locos
 };
 
+/**
+ * A cursor to iterate over the refresh list with loco_iterate(). The cursor stays
+ * valid even if the loco it points to is removed between the calls.
+ */
+struct loco_cursor {
+	int				 adr;						///< the address of the loco returned last (0 = start at the beginning)
+	uint32_t		 gen;						///< the generation of this entry to detect a removed and re-added loco
+};
+
+/**
+ * The information sent with EVENT_LOCO_OWNER
+ */
+struct own_change {
+	struct own_change	*next;					///< the changes are collected under the loco lock and fired after it is released
+	int				 adr;						///< the loco
+	uint16_t		 from;						///< the previous owner (OWN_ANONYMOUS if the loco was free or dispatched)
+	uint16_t		 to;						///< the new owner (OWN_ANONYMOUS if the loco was released or dispatched)
+	bool			 taken;						///< the previous owner lost the loco against its will and must be informed
+	bool			 dispatched;				///< the loco is dispatched and waits for the next client
+};
+
 typedef struct turnout turnoutT;
 struct turnout {
 	turnoutT		*next;						///< linked list of turnout definitions
@@ -610,6 +641,7 @@ void dccpt_cvWriteBitBG (int cv, int bit, uint8_t data, void (*cb)(int, void *),
  * Prototypes Decoder/decoderdb.c
  */
 void db_triggerStore (const char *caller);
+void db_flushStore (void);
 void db_freeLocos (void);
 void db_freeTurnouts (void);
 int db_indexSorted_next (int idx);
@@ -629,6 +661,7 @@ void db_setLocoVID (int adr, uint32_t vid);
 void db_setLocoUID (int adr, uint32_t uid);
 void db_setLocoName (int adr, char *name);
 void db_setLocoMaxfunc (int adr, int maxfunc);
+void db_setLocoMomentum (int adr, int accel, int decel, enum ramp_curve curve);
 void db_locoFuncIcon (locoT *l, int func, int icon);
 void db_locoFuncTiming (locoT *l, int func, int tim);
 locoT *db_newLoco (int adr, enum fmt fmt, int maxfunc, char *name, char *uid);
@@ -654,20 +687,31 @@ bool loco_lock(const char *caller);
 void loco_unlock (void);
 TickType_t loco_purgetime (void);
 void _loco_remove (ldataT *l);
+void _loco_reindex (locoT *l, int oldadr);
 ldataT *_loco_getRefreshLink (locoT *l);
 void loco_remove (ldataT *l);
 ldataT *loco_call (int adr, bool add);
 int loco_setFuncMasked (int adr, uint32_t newfuncs, uint32_t mask);
 int loco_setFunc (int adr, int f, bool on);
+int loco_setFuncGroup (int adr, int first, int count, uint32_t funcs);
 int loco_setBinState (int adr, int state, bool on);
 int loco_getSpeeds (locoT *l);
 int loco_setSpeed (int adr, int speed);
 int loco_emergencyStop (int adr);
+void loco_setClient (uint16_t who);
+uint16_t loco_getClient (void);
+bool loco_checkOwner (int adr);
+int loco_acquire (int adr, uint16_t who, enum own_mode mode);
+int loco_release (int adr, uint16_t who);
+void loco_releaseAll (uint16_t who);
+int loco_dispatch (int adr, uint16_t who);
+uint16_t loco_getOwner (int adr);
 bool m3_inRefresh (void);
 //int m3pom_writeCV(int adr, cvadrT cva, uint8_t val, int repeat);
 void loco_freeRefreshList(void);
 ldataT *loco_refresh(void);
-ldataT *loco_iterateNext (ldataT *cur);
+uint16_t *loco_snapshot (int *count);
+ldataT *loco_iterate (struct loco_cursor *cur);
 
 /*
  * Prototypes Decoder/m3_config.c
@@ -684,6 +728,7 @@ int m3pom_writeCV (int adr, cvadrT cva, uint8_t val, int repeat, reply_handler h
 int m3pom_writeCVar (int adr, cvadrT cva, uint8_t *val, int bytes, int repeat, reply_handler handler, flexval priv);
 //int m3_scan (uint32_t uid, int len);
 int m3_setAddress (uint32_t uid, int adr);
+int m3_discover (uint32_t *uids, int max);
 
 /*
  * Prototypes Decoder/m3_pt.c
@@ -713,6 +758,7 @@ void reply_callback (struct bitbuffer *bb, dec_msgtype mt, int len, uint8_t *dat
  * Prototypes Decoder/request.c
  */
 int rq_setFuncMasked (int adr, uint32_t newfuncs, uint32_t mask);
+int rq_setFuncGroup (int adr, int first, int count, uint32_t funcs);
 int rq_setSpeed (int adr, int speed);
 int rq_emergencyStop (int adr);
 
@@ -736,6 +782,7 @@ int xacc_aspect (int adr, int aspect);
 /*
  * Prototypes Track/signal.c
  */
+int sig_scanM3Locos (uint32_t *uids, int max, void (*found)(uint32_t uid));
 int sig_searchM3Loco (uint32_t *id);
 enum trackmode sig_setMode (enum trackmode mode);
 enum trackmode sig_getMode (void);
@@ -807,6 +854,14 @@ bool sigq_isIdle (void);
 void m3reply_enable (dec_type dt, int adr, rdbk_type rdt, cvadrT cva, flexval fv);
 void m3reply_disable (struct bitbuffer *bb);
 
+/*
+ * Prototypes Track/sniffer_stream.c
+ */
+void sniffer_publish (const struct srec *r);
+void sniffer_capture (bool on);
+bool sniffer_isCapturing (void);
+int sniffer_streamStart (void);
+
 /*
  * Prototypes Track/railcom.c
  *
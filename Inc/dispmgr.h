@@ -0,0 +1,138 @@
+/*
+ * dispmgr.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __DISPMGR_H__
+#define __DISPMGR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DM_DIGITS			2			///< number of digits on the display
+#define DM_MAXTEXT			32			///< maximum number of digits in a (scrolling) text
+#define DM_SCROLLSTEP		400			///< default time in ms for one scroll step
+#define DM_FOREVER			UINT32_MAX	///< returned as next update time if nothing changes by itself
+#define DM_MENU_TIMEOUT		10000		///< the menu is left after this time in ms without a key
+
+#define DM_SEG_DP			0x80		///< the decimal point
+
+/**
+ * The message layers in ascending priority. The highest active layer is displayed.
+ */
+enum dm_layer {
+	DM_LAYER_IDLE = 0,					///< the background, i.e. the track current in GO mode
+	DM_LAYER_STATUS,					///< the system status (St., Pr, td, ...)
+	DM_LAYER_OVERLAY,					///< short timed messages (acknowledges, values)
+	DM_LAYER_MENU,						///< the service menu and its output
+	DM_LAYER_PAIRING,					///< a pending (BiDiB-)pairing request (PA)
+	DM_LAYER_ALERT,						///< conditions that need attention (SH, ot, PF, ...)
+	DM_LAYERS
+};
+
+/**
+ * One message layer
+ */
+struct dm_msg {
+	bool			active;				///< this layer has something to show
+	uint8_t			len;				///< number of digits in seg[] (longer than DM_DIGITS scrolls)
+	uint16_t		blink;				///< blink period in ms (0 = steady)
+	uint16_t		step;				///< time per scroll step in ms
+	uint32_t		start;				///< time stamp when the message was set
+	uint32_t		timeout;			///< lifetime in ms (0 = until cleared)
+	uint8_t			seg[DM_MAXTEXT];	///< the segment patterns
+};
+
+/**
+ * The display manager. All times are given in ms and may wrap around.
+ * Locking must be done by the caller.
+ */
+struct dispmgr {
+	struct dm_msg	layer[DM_LAYERS];	///< the message layers
+};
+
+/**
+ * The items of the service menu
+ */
+enum dm_item {
+	DM_ITEM_IP = 0,						///< show the IP address
+	DM_ITEM_BOOSTER,					///< switch the track power on or off
+	DM_ITEM_PROG,						///< enter or leave the programming mode
+	DM_ITEM_IPRESET,					///< reset network configuration to DHCP (needs confirmation)
+	DM_ITEM_SPEED,						///< step the model time speed
+	DM_ITEM_EXIT,						///< leave the menu
+	DM_ITEMS
+};
+
+/**
+ * The keys that drive the service menu
+ */
+enum dm_key {
+	DM_KEY_NEXT = 0,					///< select the next item (short press of GO)
+	DM_KEY_SELECT,						///< execute the current item (long press of GO)
+	DM_KEY_LEAVE,						///< leave the menu (STOP, which keeps its usual function)
+};
+
+/**
+ * The actions that result from the menu operation and must be executed by the caller
+ */
+enum dm_action {
+	DM_ACT_NONE = 0,					///< nothing to do
+	DM_ACT_EXIT,						///< the menu was left
+	DM_ACT_SHOWIP,						///< show the IP address
+	DM_ACT_BOOSTER,						///< toggle the track power
+	DM_ACT_PROG,						///< toggle the programming mode
+	DM_ACT_IPRESET,						///< reset the network configuration
+	DM_ACT_SPEED,						///< select the next model time speed
+};
+
+/**
+ * The state of the service menu
+ */
+struct dm_menu {
+	bool			active;				///< the menu is shown
+	bool			armed;				///< the current item waits for its confirmation
+	uint8_t			item;				///< the current item (enum dm_item)
+	uint32_t		last;				///< time stamp of the last key
+};
+
+/*
+ * Prototypes HW/dispmgr.c
+ */
+uint8_t dm_charSegments (char c);
+int dm_encode (const char *s, uint8_t *seg, int max);
+void dm_init (struct dispmgr *d);
+void dm_setSegments (struct dispmgr *d, enum dm_layer l, uint8_t left, uint8_t right, int blink, uint32_t timeout, uint32_t now);
+void dm_setText (struct dispmgr *d, enum dm_layer l, const char *s, int blink, uint32_t timeout, uint32_t now);
+void dm_setDecimal (struct dispmgr *d, enum dm_layer l, int n, bool dp, uint32_t timeout, uint32_t now);
+void dm_clear (struct dispmgr *d, enum dm_layer l);
+bool dm_isActive (const struct dispmgr *d, enum dm_layer l);
+uint32_t dm_render (struct dispmgr *d, uint32_t now, uint8_t seg[DM_DIGITS]);
+int dm_toAscii (const uint8_t *seg, int n, char *buf, int size);
+void dm_menuEnter (struct dm_menu *m, uint32_t now);
+enum dm_action dm_menuKey (struct dm_menu *m, enum dm_key k, uint32_t now);
+bool dm_menuTimeout (struct dm_menu *m, uint32_t now);
+const char *dm_menuLabel (const struct dm_menu *m);
+
+#endif /* __DISPMGR_H__ */
@@ -0,0 +1,98 @@
+/*
+ * dnssd.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __DNSSD_H__
+#define __DNSSD_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DNSSD_HOSTNAME		"mc2"			///< the host name (.local) of the station without conflicts
+#define DNSSD_DEFNAME		"(default)"		///< a user name that is not used as instance name (see CNF_DEF_BIDIB_user)
+#define DNSSD_NAMELEN		64				///< the maximum length of a host or instance name including the null byte (DNS label: 63)
+#define DNSSD_MAXCONFLICTS	16				///< stop renaming after this number of name conflicts
+
+/**
+ * The services that are advertised
+ */
+enum dnssd_svc {
+	DNSSD_HTTP = 0,							///< the WEB user interface
+	DNSSD_FTP,								///< the FTP server for the file system
+	DNSSD_Z21,								///< the Z21 LAN protocol (UDP)
+	DNSSD_P50X,								///< P50x over TCP
+	DNSSD_BIDIB,							///< netBiDiB
+	DNSSD_SERVICES							///< the number of services
+};
+
+/**
+ * What should be published - taken from the configuration
+ */
+struct dnssd_config {
+	char			name[DNSSD_NAMELEN];	///< the configured name of the station (empty or DNSSD_DEFNAME = use the serial number)
+	uint32_t		serial;					///< the serial number of the station
+	const char		*firmware;				///< the firmware version
+	uint16_t		port[DNSSD_SERVICES];	///< the port of each service (0 = service is not offered)
+};
+
+/**
+ * What is currently published
+ */
+struct dnssd_state {
+	struct dnssd_config	cfg;				///< the configuration that was last published
+	int				conflicts;				///< the number of name conflicts reported so far (selects the suffix of the names)
+	char			host[DNSSD_NAMELEN];	///< the published host name
+	char			instance[DNSSD_NAMELEN];	///< the published instance name of all services
+	int8_t			slot[DNSSD_SERVICES];	///< the slot of each service in the mDNS responder (-1 = not registered)
+	bool			started;				///< the host name is registered at the responder
+};
+
+/**
+ * The changes needed to get from the published state to a new configuration
+ */
+struct dnssd_plan {
+	uint8_t			del;					///< bitmask (1 << enum dnssd_svc) of services to remove
+	uint8_t			add;					///< bitmask (1 << enum dnssd_svc) of services to register
+	bool			rename;					///< the host name changed
+};
+
+/*
+ * Prototypes Utilities/dnssd.c
+ */
+void dnssd_init (struct dnssd_state *s);
+const char *dnssd_service (enum dnssd_svc svc, bool *udp);
+void dnssd_names (const struct dnssd_config *c, int conflicts, char *host, char *instance);
+int dnssd_txt (const struct dnssd_config *c, enum dnssd_svc svc, int idx, char *buf, int size);
+bool dnssd_plan (struct dnssd_state *s, const struct dnssd_config *c, struct dnssd_plan *p);
+bool dnssd_conflict (struct dnssd_state *s);
+
+/*
+ * Prototypes WEB/zeroconf.c
+ */
+struct netif;
+void zc_start (struct netif *netif);
+void zc_update (void);
+
+#endif /* __DNSSD_H__ */
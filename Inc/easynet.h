@@ -67,6 +67,10 @@ typedef union {
 struct en_bootProgress {
 	int			total;					///< total number of blocks to download to node
 	int			current;				///< current block number that is downloading to node
+	int			pass;					///< the current update pass (starting with 1)
+	int			units;					///< the number of units that were registered on the bus when the update started
+	int			done;					///< the number of units that registered again after an update pass
+	int			failed;					///< the number of units that did not come back after all passes
 };
 
 // Messages can range from 0x00 to 0x7F (they must not use the topmost bit)
@@ -0,0 +1,99 @@
+/*
+ * enboot.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __ENBOOT_H__
+#define __ENBOOT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ENB_CHUNKSIZE		64				///< the granularity of the image (the smallest block size of the boot protocol)
+#define ENB_MAXIMAGE		(256 * 1024)	///< the maximum address range an image may cover
+#define ENB_CRCSTART		0xFFFF			///< the start value of the block CRC
+#define ENB_MAXUNITS		64				///< the maximum number of units in an update session
+#define ENB_RETRIES			3				///< the number of passes a unit gets to report back with the new firmware
+
+/**
+ * A firmware image in a single flat buffer. Areas without data read as 0xFF.
+ * The buffer grows with the data and covers the range from the lowest to the
+ * highest address seen.
+ */
+struct enb_image {
+	uint8_t			*mem;					///< the image data
+	uint8_t			*used;					///< a flag for each chunk that received data
+	uint16_t		*before;				///< the number of used chunks in front of each chunk (valid after enb_finish())
+	uint32_t		 base;					///< the address of mem[0] (aligned to ENB_CHUNKSIZE)
+	uint32_t		 size;					///< the size of the buffer (a multiple of ENB_CHUNKSIZE)
+	uint32_t		 end;					///< the address behind the last used chunk
+	int				 chunks;				///< the number of used chunks (valid after enb_finish())
+};
+
+enum enb_unitstate {
+	ENB_UNIT_PENDING = 0,					///< the unit is not yet updated
+	ENB_UNIT_DONE,							///< the unit reported back after an update pass
+	ENB_UNIT_FAILED,						///< the unit did not report back after ENB_RETRIES passes
+};
+
+/**
+ * A unit that takes part in an update session
+ */
+struct enb_unit {
+	uint32_t			serno;				///< the serial number of the unit
+	uint32_t			oldver;				///< the firmware version before the update
+	uint32_t			version;			///< the firmware version reported after the last pass (0 = not yet reported)
+	enum enb_unitstate	state;				///< the state of the update
+	int					passes;				///< the number of passes this unit took part in
+};
+
+/**
+ * An update session. All units receive the blocks at the same time, because
+ * the boot protocol does not address the units. After each pass, the units
+ * that report back on the bus with the new firmware version are done, the
+ * others take part in the next pass.
+ */
+struct enb_session {
+	struct enb_unit		unit[ENB_MAXUNITS];	///< the units
+	int					count;				///< the number of units
+	int					pass;				///< the current pass (starting with 1)
+	uint32_t			version;			///< the version of the new firmware (0 = not yet known)
+};
+
+/*
+ * Prototypes Interfaces/enboot.c
+ */
+uint16_t enb_crc16 (uint16_t crc, const uint8_t *p, int len);
+void enb_init (struct enb_image *img);
+void enb_free (struct enb_image *img);
+int enb_addData (struct enb_image *img, uint32_t adr, const uint8_t *data, int len);
+int enb_finish (struct enb_image *img);
+bool enb_getBlock (const struct enb_image *img, uint32_t adr, int size, uint8_t *mem, int *current);
+void enb_sessionStart (struct enb_session *s, const uint32_t *serno, const uint32_t *version, int count);
+void enb_sessionSeen (struct enb_session *s, uint32_t serno, uint32_t version);
+bool enb_sessionPending (const struct enb_session *s, uint32_t serno);
+bool enb_sessionNextPass (struct enb_session *s);
+int enb_sessionCount (const struct enb_session *s, enum enb_unitstate state);
+
+#endif /* __ENBOOT_H__ */
@@ -0,0 +1,156 @@
+/*
+ * espnet.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __ESPNET_H__
+#define __ESPNET_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EF_MTU				1514				///< the maximum size of an ethernet frame (without FCS) carried in a data frame
+#define EF_MAXFRAME			(1 + EF_MTU + 2)	///< type + payload + CRC
+#define EF_ENCODED_MAX		(2 + 2 * EF_MAXFRAME)	///< worst case size of an encoded frame on the line (every byte escaped)
+#define EF_TEXTLEN			128					///< the maximum length of a log line from the module including the null byte
+
+#define EF_LINK_TIMEOUT		3000				///< the link is considered down if nothing was received for this time (ms)
+#define EF_FLOW_REFRESH		500					///< resend our flow state (and so signal that we are alive) after this time (ms)
+#define EF_BUSY_TIME		20					///< keep the peer paused for this time after a frame could not be delivered (ms)
+
+/**
+ * The frame types on the serial line
+ */
+enum ef_type {
+	EF_DATA = 1,								///< an ethernet frame
+	EF_LINK,									///< the WLAN state of the module: state (1 byte, 0 = down, 1 = up) + MAC (6 bytes)
+	EF_FLOW,									///< flow control: 0 = resume, 1 = pause sending data frames
+	EF_TEXT,									///< a log line of the module (not null terminated)
+};
+
+#define EF_FLOW_RESUME		0					///< the receiver can take data frames
+#define EF_FLOW_PAUSE		1					///< the receiver is busy - only send control frames
+
+/**
+ * An incremental encoder that writes a single frame to a buffer
+ */
+struct ef_encoder {
+	uint8_t			*buf;						///< the output buffer
+	int				size;						///< the size of the output buffer
+	int				len;						///< the number of bytes already written
+	uint16_t		crc;						///< the CRC over the unescaped bytes written so far
+	bool			overflow;					///< the frame did not fit into the buffer
+};
+
+/**
+ * The decoder for the byte stream received from the peer
+ */
+struct ef_decoder {
+	uint8_t			buf[EF_MAXFRAME];			///< the unescaped contents of the current frame
+	int				len;						///< the number of bytes in buf
+	bool			esc;						///< the last byte was an escape character
+	bool			discard;					///< the current frame is invalid and is skipped until the next frame boundary
+};
+
+/**
+ * The callbacks from the link layer
+ */
+struct ef_ops {
+	bool (*frame)(void *priv, const uint8_t *data, int len);			///< an ethernet frame was received (return false if it could not be taken)
+	void (*link)(void *priv, bool up, const uint8_t *mac);				///< the state of the WLAN link changed
+	void (*text)(void *priv, const char *line);							///< the module sent a log line
+};
+
+/**
+ * Counters for the diagnosis of the serial line
+ */
+struct ef_stats {
+	uint32_t		rxFrames;					///< the number of valid frames received
+	uint32_t		crcErrors;					///< frames with a bad CRC or an invalid escape sequence
+	uint32_t		overruns;					///< frames that were too long
+	uint32_t		drops;						///< received ethernet frames that could not be delivered
+	uint32_t		pauses;						///< how often we paused the peer
+	uint32_t		resyncs;					///< how often received bytes were lost (i.e. the receive ring overflowed)
+};
+
+/**
+ * The state of one end of the serial link
+ */
+struct ef_link {
+	struct ef_decoder	dec;					///< the receive decoder
+	const struct ef_ops	*ops;					///< the callbacks
+	void			*priv;						///< a private argument for the callbacks
+	int				highwater;					///< pause the peer if this many received bytes are not yet processed
+	int				lowwater;					///< resume the peer if the backlog drops to this level
+	bool			alive;						///< the peer sent a valid frame within EF_LINK_TIMEOUT
+	bool			up;							///< the WLAN link of the module is up
+	uint8_t			mac[6];						///< the MAC address of the module
+	bool			peerPaused;					///< the peer asked us to stop sending data frames
+	bool			paused;						///< we asked the peer to stop sending data frames
+	bool			flowSent;					///< our flow state was sent at least once
+	bool			busy;						///< a received frame could not be delivered (see busyUntil)
+	uint32_t		lastRx;						///< the time of the last valid frame
+	uint32_t		lastFlow;					///< the time our flow state was last sent
+	uint32_t		busyUntil;					///< keep the peer paused until this time because a frame could not be delivered
+	struct ef_stats	stats;						///< the statistics
+};
+
+/**
+ * The receive ring buffer that is written by a DMA in circular mode
+ */
+struct ef_ring {
+	uint8_t			*buf;						///< the ring buffer
+	int				size;						///< the size of the ring (a power of two)
+	uint32_t		read;						///< the number of bytes read from the ring (the read position is read % size)
+	uint32_t (*written)(void *priv);			///< the number of bytes the DMA has written to the ring so far (see ef_ringWritten())
+	void (*invalidate)(void *priv, const uint8_t *data, int len);	///< make the data written by the DMA visible to the CPU (may be NULL)
+	void			*priv;						///< a private argument for the callbacks
+};
+
+/*
+ * Prototypes Utilities/espframe.c
+ */
+uint16_t ef_crc (uint16_t crc, const uint8_t *data, int len);
+void ef_encBegin (struct ef_encoder *e, uint8_t *buf, int size, enum ef_type type);
+bool ef_encData (struct ef_encoder *e, const uint8_t *data, int len);
+bool ef_encDataSkip (struct ef_encoder *e, const uint8_t *data, int len, int *skip);
+int ef_encEnd (struct ef_encoder *e);
+int ef_encode (uint8_t *buf, int size, enum ef_type type, const uint8_t *data, int len);
+void ef_linkInit (struct ef_link *l, const struct ef_ops *ops, void *priv, int ringsize);
+void ef_input (struct ef_link *l, const uint8_t *data, int len, uint32_t now);
+void ef_resync (struct ef_link *l);
+uint32_t ef_ringWritten (uint32_t halves, int ndtr, int size);
+void ef_ringInit (struct ef_ring *r, uint8_t *buf, int size, uint32_t (*written)(void *), void (*invalidate)(void *, const uint8_t *, int), void *priv);
+int ef_ringReceive (struct ef_link *l, struct ef_ring *r, uint32_t now);
+int ef_poll (struct ef_link *l, int backlog, uint32_t now, uint8_t *buf, int size);
+bool ef_mayTransmit (struct ef_link *l);
+
+/*
+ * Prototypes HW/espnet.c
+ */
+bool espnet_start (void);
+void espnet_stop (void);
+void espnet_uartIRQ (void);
+
+#endif /* __ESPNET_H__ */
@@ -58,6 +58,8 @@ enum event {
 	EVENT_CONSIST,								///< a consist changed, inform the WEB client
 	EVENT_FBNEW,			///< TODO: temporary dummy event to replace EVENT_FEEDBACK!
 	EVENT_FBPARAM,								///< some configuration in s88 system changed
+	EVENT_BLOCKOCC,								///< a BiDiB detector block changed or reported RailCom data (see bidibbm.c)
+	EVENT_LOCO_OWNER,							///< the owner of a loco changed (param is the loco, src a struct own_change)
 
 	EVENT_MAX_EVENT,							///< a marker for the highest defined event type
 	EVENT_DEREGISTER_ALL = 255					///< a pseudo event to deregister all events at once for a handler
@@ -102,6 +102,7 @@ json_itmT *json_addUintItem (json_stackT *stack, const char *item, unsigned n);
 json_itmT *json_addStringItem (json_stackT *stack, const char *item, const char *s);
 json_itmT *json_addFormatStringItem (json_stackT *stack, const char *item, const char *fmt, ...) __attribute((format(printf, 3, 4)));
 void json_free (json_valT *root);
+char *json_toString (json_valT *root);
 void json_debug (json_valT *root);
 
 /**
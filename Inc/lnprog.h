@@ -0,0 +1,149 @@
+/*
+ * lnprog.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __LNPROG_H__
+#define __LNPROG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LNP_PROGSLOT		124			///< the slot used for programming on main or programming track
+#define LNP_MAXSLOT			119			///< the highest slot number for a loco
+#define LNP_SLOTLEN			14			///< the length of OPC_WR_SL_DATA and OPC_SL_RD_DATA blocks
+#define LNP_PEERLEN			15			///< the length of OPC_PEER_XFER and OPC_IMM_PACKET blocks used for LNCV
+
+/* STAT1 byte of a loco slot */
+#define LNP_STAT_MASK		0x30		///< the slot status bits (free, common, idle, in use)
+#define LNP_STAT_SHIFT		4			///< the position of the slot status bits
+#define LNP_PURGE_TIME		200000		///< a slot in use that was not accessed for this time (ms) is purged to common (FRED unplugged)
+
+/* PCMD byte of the programming slot */
+#define LNP_PCMD_WRITE		0x40		///< write (else read or verify)
+#define LNP_PCMD_BYTE		0x20		///< byte mode (else bit mode)
+#define LNP_PCMD_TY1		0x10		///< service mode: register mode
+#define LNP_PCMD_TY0		0x08		///< service mode: direct mode / ops mode: with feedback
+#define LNP_PCMD_OPS		0x04		///< operations mode (POM on the main track)
+
+/* PSTAT byte of the programming slot (reply) */
+#define LNP_PSTAT_OK		0x00		///< the task was successful
+#define LNP_PSTAT_NODECODER	0x01		///< no decoder detected
+#define LNP_PSTAT_WRITEFAIL	0x02		///< no acknowledge on write
+#define LNP_PSTAT_READFAIL	0x04		///< failed to detect the acknowledge on read
+#define LNP_PSTAT_ABORTED	0x08		///< user aborted
+
+/* LONG_ACK codes for the programming slot */
+#define LNP_ACK_BUSY		0x00		///< the programmer is busy, task rejected
+#define LNP_ACK_ACCEPTED	0x01		///< task accepted, the result will follow as OPC_SL_RD_DATA
+#define LNP_ACK_BLIND		0x40		///< task accepted, there will be no result (ops mode without feedback)
+#define LNP_ACK_NOTIMPL		0x7F		///< function not implemented
+
+/* LNCV (Uhlenbrock module configuration using OPC_IMM_PACKET and OPC_PEER_XFER) */
+#define LNCV_SRC_MASTER		0x01		///< source of requests from the LNCV programmer
+#define LNCV_SRC_MODULE		0x05		///< source of replies from a module (and destination of requests)
+#define LNCV_DST_IK			0x4B49		///< the destination of replies ('I', 'K')
+#define LNCV_CMD_WRITE		0x20		///< write a LNCV
+#define LNCV_CMD_READ		0x21		///< read a LNCV (also used to start and stop a session)
+#define LNCV_CMD_READREPLY	0x1F		///< the reply to a read request
+#define LNCV_FLAG_PRON		0x80		///< start programming session
+#define LNCV_FLAG_PROFF		0x40		///< stop programming session
+#define LNCV_WRITE_OK		0x7F		///< the code in the LONG_ACK to a successful write
+
+/* OPC_MULTI_SENSE */
+#define LNP_MS_TYPEMASK		0xE0		///< the message type bits in the first data byte
+#define LNP_MS_ABSENT		0x00		///< transponder left the zone
+#define LNP_MS_PRESENT		0x20		///< transponder entered the zone
+#define LNP_MS_SHORTADR		0x7D		///< the high address byte of a short address
+
+enum lnp_progmode {
+	LNP_MODE_PAGED = 0,					///< service mode, paged
+	LNP_MODE_DIRECT,					///< service mode, direct
+	LNP_MODE_REGISTER,					///< service mode, physical register
+	LNP_MODE_OPS,						///< operations mode without feedback
+	LNP_MODE_OPSFEEDBACK,				///< operations mode with feedback (RailCom)
+};
+
+/**
+ * The content of a loco slot written by a throttle (i.e. a FRED setting its ID)
+ */
+struct lnp_slotdata {
+	uint8_t			slot;				///< the slot number (1 .. LNP_MAXSLOT)
+	uint8_t			status;				///< the slot status (0 = free, 1 = common, 2 = idle, 3 = in use)
+	uint8_t			stat1;				///< the complete STAT1 byte (including the speed step coding)
+	uint16_t		adr;				///< the loco address
+	uint8_t			spd;				///< the speed (0 = stop, 1 = emergency stop)
+	uint8_t			dirf;				///< direction and F0 - F4 as in OPC_LOCO_DIRF
+	uint8_t			snd;				///< F5 - F8 as in OPC_LOCO_SND
+	uint16_t		id;					///< the throttle ID (ID1 + ID2, 14 bits)
+};
+
+/**
+ * The content of the programming slot
+ */
+struct lnp_progslot {
+	uint8_t			pcmd;				///< the programming command (LNP_PCMD_xxx)
+	uint8_t			pstat;				///< the programming status (LNP_PSTAT_xxx, reply only)
+	uint16_t		adr;				///< the decoder address for operations mode
+	uint8_t			trk;				///< the track status byte
+	int				cv;					///< the zero based CV number (0 .. 1023)
+	uint8_t			data;				///< the data byte (in bit mode: 111KDBBB as in the DCC bit manipulation)
+};
+
+/**
+ * A LNCV request or reply
+ */
+struct lnp_lncv {
+	uint8_t			src;				///< the source of the message
+	uint16_t		dst;				///< the destination of the message
+	uint8_t			cmd;				///< the command (LNCV_CMD_xxx)
+	uint16_t		article;			///< the article number of the module
+	uint16_t		cv;					///< the LNCV number
+	uint16_t		value;				///< the value of the LNCV
+	uint8_t			flags;				///< session flags (LNCV_FLAG_xxx)
+};
+
+/**
+ * A transponder report from OPC_MULTI_SENSE
+ */
+struct lnp_transponder {
+	uint16_t		section;			///< the zero based detector input number
+	uint16_t		adr;				///< the loco address
+	bool			present;			///< the loco entered (true) or left (false) the section
+};
+
+/*
+ * Prototypes Interfaces/lnprog.c
+ */
+void lnp_bin2msg (const uint8_t *bin, uint8_t *msg, int len);
+void lnp_msg2bin (uint8_t *bin, const uint8_t *msg, int len);
+enum lnp_progmode lnp_progMode (uint8_t pcmd);
+bool lnp_decodeSlotData (const uint8_t *blk, struct lnp_slotdata *sd);
+bool lnp_decodeProgSlot (const uint8_t *blk, struct lnp_progslot *ps);
+void lnp_encodeProgSlot (uint8_t opc, const struct lnp_progslot *ps, uint8_t *blk);
+bool lnp_decodeLNCV (const uint8_t *blk, struct lnp_lncv *cv);
+void lnp_encodeLNCV (uint8_t opc, const struct lnp_lncv *cv, uint8_t *blk);
+bool lnp_decodeMultiSense (const uint8_t *blk, struct lnp_transponder *tp);
+
+#endif /* __LNPROG_H__ */
@@ -10,6 +10,7 @@
 #include "arch/sys_arch.h"
 
 #define LWIP_MDNS_RESPONDER				1
+#define MDNS_MAX_SERVICES				5				// HTTP, FTP, Z21, P50x and netBiDiB (see dnssd.c)
 #define lwip_strnicmp					strncasecmp		// described in lwIP2.0.2 to be needed - but not used in 2.1.2 (?)
 
 /**
@@ -0,0 +1,102 @@
+/*
+ * m3scan.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __M3SCAN_H__
+#define __M3SCAN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define M3S_INFLIGHT		4				///< the number of search packets kept in flight (one per standard slot of the signal generator)
+#define M3S_STACK			64				///< the number of prefixes that wait to be explored
+#define M3S_MAXFOUND		32				///< the maximum number of decoders found in a single scan
+#define M3S_RETRIES			1				///< how often a prefix is asked again, if none of its sub prefixes answered
+#define M3S_PASSES			4				///< the maximum number of passes over the whole tree
+
+enum m3s_qstate {
+	M3S_QFREE = 0,							///< the query slot is free
+	M3S_QTOSEND,							///< the query waits to be sent
+	M3S_QSENT,								///< the query is on its way to the track
+};
+
+/**
+ * A prefix of a UID that is known to match at least one decoder
+ */
+struct m3s_node {
+	uint32_t		uid;					///< the prefix (the bits below the prefix are zero)
+	uint8_t			len;					///< the length of the prefix in bits (0 .. 31)
+	uint8_t			retry;					///< how often this prefix was asked again
+};
+
+/**
+ * The queries for the sub prefixes of an explored node
+ */
+struct m3s_group {
+	struct m3s_node	node;					///< the node that is explored
+	uint8_t			pending;				///< the number of queries without an answer (0 = group is free)
+	bool			hit;					///< at least one query was acknowledged
+	bool			root;					///< this is the initial query for the empty prefix
+};
+
+/**
+ * A single search packet
+ */
+struct m3s_query {
+	uint32_t		uid;					///< the UID to compare
+	uint8_t			len;					///< the number of bits to compare (1 .. 32, 0 for the root query)
+	uint8_t			state;					///< the state of the query (enum m3s_qstate)
+	uint8_t			grp;					///< the group this query belongs to
+};
+
+/**
+ * The state of a scan for unregistered decoders
+ */
+struct m3s_scan {
+	struct m3s_node		stack[M3S_STACK];		///< the prefixes to explore (LIFO, so the search goes down first)
+	int					sp;						///< the number of entries on the stack
+	struct m3s_group	grp[M3S_INFLIGHT];		///< the groups of queries in flight
+	struct m3s_query	q[M3S_INFLIGHT];		///< the queries in flight
+	uint32_t			found[M3S_MAXFOUND];	///< the UIDs found so far
+	int					nfound;					///< the number of decoders found
+	int					maxfound;				///< stop after this number of decoders
+	int					passes;					///< the number of passes started
+	bool				again;					///< the root query of the current pass was acknowledged, so another pass is needed
+	int					queries;				///< statistics: the number of queries sent
+	int					lost;					///< statistics: groups where no query was answered although the prefix matched
+	bool				overflow;				///< the stack overflowed, the scan may be incomplete
+};
+
+/*
+ * Prototypes Decoder/m3scan.c
+ */
+void m3s_init (struct m3s_scan *s, int maxfound);
+int m3s_next (struct m3s_scan *s, uint32_t *uid, int *len);
+int m3s_answer (struct m3s_scan *s, int tag, bool ack, uint32_t *uid);
+int m3s_pending (const struct m3s_scan *s);
+void m3s_abort (struct m3s_scan *s);
+bool m3s_done (const struct m3s_scan *s);
+
+#endif /* __M3SCAN_H__ */
@@ -0,0 +1,156 @@
+/*
+ * mcancfg.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MCANCFG_H__
+#define __MCANCFG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* the parts of the 29 bit extended CAN ID */
+#define MCC_ID(prio, cmd, resp, hash)	((((prio) & 0x0F) << 25) | (((cmd) & 0xFF) << 17) | ((resp) ? (1 << 16) : 0) | ((hash) & 0xFFFF))
+#define MCC_ID_CMD(id)			(((id) >> 17) & 0xFF)		///< the command of a frame
+#define MCC_ID_RESP(id)			(((id) >> 16) & 0x01)		///< the response bit of a frame
+#define MCC_ID_HASH(id)			((id) & 0xFFFF)				///< the hash of a frame
+#define MCC_ISHASH(h)			(((h) & 0x0380) == 0x0300)	///< a real hash (other values are packet numbers of a data stream)
+
+/* commands */
+#define MCC_CMD_SYSTEM			0x00		///< system commands
+#define MCC_CMD_S88EVENT		0x11		///< S88 event (single contact or range of contacts)
+#define MCC_CMD_PING			0x18		///< ping / software version
+#define MCC_CMD_CFGDATA			0x20		///< config data request (CS2 files by name)
+#define MCC_CMD_CFGSTREAM		0x21		///< config data stream (CS2 files)
+#define MCC_CMD_STATUSCFG		0x3A		///< status data configuration (device and channel descriptions)
+
+#define MCC_SYS_STATUS			0x0B		///< system sub command: read a measurement value or write a config channel
+
+/* device IDs reported in the ping reply */
+#define MCC_DEV_GLEISBOX		0x0010		///< Gleisbox 60112
+#define MCC_DEV_GLEISBOX2		0x0011		///< Gleisbox 60113
+#define MCC_DEV_LINKS88			0x0040		///< Link S88 60883
+
+/* type of a config channel */
+#define MCC_CHTYPE_LIST			1			///< a selection from a list of choices
+#define MCC_CHTYPE_VALUE		2			///< a numerical value with a range
+
+/* the config channels of the Link S88 */
+#define MCC_LS88_NODE			1			///< the node number (device ID in the S88 events)
+#define MCC_LS88_BUS1			2			///< the number of modules on bus 1
+#define MCC_LS88_BUS2			3			///< the number of modules on bus 2
+#define MCC_LS88_BUS3			4			///< the number of modules on bus 3
+#define MCC_LS88_CYCLE1			5			///< the polling cycle of bus 1 in ms
+#define MCC_LS88_CYCLE2			6			///< the polling cycle of bus 2 in ms
+#define MCC_LS88_CYCLE3			7			///< the polling cycle of bus 3 in ms
+
+#define MCC_LS88_BUSSES			3			///< the number of s88 busses on a Link S88
+#define MCC_LS88_CONTACTS		1000		///< the contacts of bus n start at n * 1000 + 1 (the internal inputs are 1 .. 16)
+
+#define MCC_STREAM_MAX			256			///< the maximum size of a status data configuration block
+#define MCC_STREAM_FRAMES		(MCC_STREAM_MAX / 8)	///< the maximum number of data frames of a block
+#define MCC_MAXCHANNELS			16			///< the maximum number of config channels kept per device
+#define MCC_MAXDEVICES			8			///< the maximum number of devices with config channels
+#define MCC_NAMELEN				32			///< the maximum length of names in the descriptions (including the terminating NUL)
+#define MCC_UNITLEN				12			///< the maximum length of a unit (including the terminating NUL)
+
+enum mcc_streamstat {
+	MCC_STREAM_ERROR = -1,					///< the stream is incomplete or does not fit into the buffer
+	MCC_STREAM_MORE = 0,					///< more frames are expected
+	MCC_STREAM_DONE,						///< the block is complete
+};
+
+/**
+ * The description and the current value of a config channel
+ */
+struct mcc_channel {
+	uint8_t			index;					///< the channel number (1 .. n)
+	uint8_t			type;					///< the type of the channel (MCC_CHTYPE_xxx)
+	uint8_t			choices;				///< the number of choices (MCC_CHTYPE_LIST)
+	uint16_t		min;					///< the minimum value (MCC_CHTYPE_VALUE)
+	uint16_t		max;					///< the maximum value (MCC_CHTYPE_VALUE, for lists: choices - 1)
+	uint16_t		value;					///< the current value or the selected choice
+	char			name[MCC_NAMELEN];		///< the description of the channel
+	char			unit[MCC_UNITLEN];		///< the unit of the value (MCC_CHTYPE_VALUE)
+};
+
+/**
+ * A device with config channels
+ */
+struct mcc_device {
+	uint32_t			uid;					///< the UID of the device
+	uint16_t			devid;					///< the device type from the ping reply
+	uint8_t				measures;				///< the number of measurement channels
+	uint8_t				channels;				///< the number of config channels
+	uint32_t			serial;					///< the serial number
+	char				article[9];				///< the article number
+	char				name[MCC_NAMELEN];		///< the device name
+	int					nch;					///< the number of channel descriptions read so far
+	struct mcc_channel	ch[MCC_MAXCHANNELS];	///< the config channels
+};
+
+/**
+ * A status data configuration block reassembled from the data frames
+ */
+struct mcc_stream {
+	uint32_t		uid;					///< the UID of the device that was asked
+	uint8_t			index;					///< the requested block (0 = device, 1 .. n = channel)
+	uint32_t		frames;					///< a bitmap of the received data frames
+	uint8_t			buf[MCC_STREAM_MAX];	///< the data
+	int				len;					///< the length of the data (valid with MCC_STREAM_DONE)
+};
+
+/**
+ * The placement of the contacts of a Link S88 in the feedback inputs
+ */
+struct mcc_link {
+	uint16_t		node;					///< the node number (device ID in the S88 events)
+	uint8_t			bus[MCC_LS88_BUSSES];	///< the number of modules on the busses
+	int				base;					///< the first module assigned to this device
+	int				modules;				///< the number of assigned modules (including the internal inputs)
+};
+
+/*
+ * Prototypes Interfaces/mcancfg.c
+ */
+int mcc_encodeStatusRequest (uint32_t uid, uint8_t index, uint8_t *data);
+int mcc_encodeChannelWrite (uint32_t uid, uint8_t ch, uint16_t value, uint8_t *data);
+bool mcc_decodeChannelWrite (int dlc, const uint8_t *data, uint32_t *uid, uint8_t *ch, bool *ok);
+int mcc_encodeS88Range (uint16_t node, uint16_t first, uint16_t last, uint8_t *data);
+bool mcc_decodeS88Event (int dlc, const uint8_t *data, uint16_t *node, uint16_t *contact, bool *state);
+void mcc_streamStart (struct mcc_stream *s, uint32_t uid, uint8_t index);
+enum mcc_streamstat mcc_streamFrame (struct mcc_stream *s, uint16_t hash, int dlc, const uint8_t *data);
+bool mcc_parseDevice (const uint8_t *buf, int len, struct mcc_device *dev);
+bool mcc_parseChannel (const uint8_t *buf, int len, struct mcc_channel *ch);
+int mcc_layout (struct mcc_link *links, int cnt);
+int mcc_mapContact (const struct mcc_link *links, int cnt, uint16_t node, uint16_t contact);
+
+/*
+ * Prototypes Interfaces/mcan.c (the parts using the definitions above)
+ */
+int mcan_cfgWrite (uint32_t uid, int ch, int value);
+int mcan_ls88SetCycle (uint32_t uid, int ms);
+int mcan_getConfigDevices (struct mcc_device *devs, int max);
+
+#endif /* __MCANCFG_H__ */
@@ -0,0 +1,102 @@
+/*
+ * owner.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __OWNER_H__
+#define __OWNER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define OWN_TLS_INDEX		1				///< the thread local storage pointer that holds the client a task is currently serving
+#define OWN_LEASE			300000			///< an owner that sent no command for this time (ms) may be replaced without being asked
+
+#define OWN_TOKEN(ifc, client)	((uint16_t) (((ifc) << 8) | ((client) & 0xFF)))	///< build the identity of a client of an interface
+#define OWN_IFC(who)			(((who) >> 8) & 0xFF)								///< the interface of a client (enum own_ifc)
+#define OWN_CLIENT(who)			((who) & 0xFF)										///< the number of the client inside its interface
+#define OWN_ANONYMOUS			0													///< internal callers that are not subject to ownership
+
+enum own_ifc {
+	OWN_NONE = 0,							///< no interface (internal functions like automation)
+	OWN_WEB,								///< the WEB user interface
+	OWN_Z21,								///< a Z21 app (client = the client number)
+	OWN_P50X,								///< P50x (client = the TCP socket or 0x80 | the UDP client index)
+	OWN_LOCONET,							///< the LocoNet (all throttles share the slot protocol, so client = 0)
+	OWN_XPRESSNET,							///< an XpressNet device (client = the bus address)
+	OWN_EASYNET,							///< an EasyNet device (client = the unit)
+	OWN_MCAN,								///< the Märklin CAN bus
+	OWN_BIDIB,								///< a BiDiB host controlling locos via the command station
+	OWN_SNIFFER,							///< commands of a foreign command station read by the sniffer
+};
+
+/**
+ * The global policy that decides what happens when a client commands a loco
+ * that is owned by another client.
+ */
+enum own_policy {
+	OWN_POLICY_STEAL = 0,					///< the command is executed and the client becomes the new owner (the old one is informed)
+	OWN_POLICY_EXCLUSIVE,					///< the command is rejected until the owner releases or dispatches the loco (or the lease expires)
+	OWN_POLICY_SHARE,						///< the command is executed, the owner keeps the loco and nobody is informed
+};
+
+/**
+ * The way a client asks for a loco
+ */
+enum own_mode {
+	OWN_ACQUIRE = 0,						///< get the loco if it is free, dispatched, shared or the lease of the owner expired
+	OWN_STEAL,								///< take the loco from the current owner in any case
+	OWN_SHARE,								///< control the loco together with others (the loco may be shared with later clients)
+};
+
+enum own_result {
+	OWN_DENIED = -1,						///< the loco is owned by someone else
+	OWN_OK = 0,								///< the client may control the loco, no other client lost it
+	OWN_TAKEN = 1,							///< the client is the new owner and the previous owner must be informed
+};
+
+/**
+ * The ownership information embedded in every entry of the refresh list
+ */
+struct own_entry {
+	uint16_t		owner;					///< the current owner (OWN_ANONYMOUS = no owner)
+	uint16_t		prev;					///< the owner before the last change (the one to inform)
+	uint32_t		last;					///< the time of the last command of the owner in ms
+	bool			shared;					///< the owner allows other clients to control the loco as well
+	bool			dispatched;				///< the loco was dispatched and is given to the next client that asks for it
+};
+
+/*
+ * Prototypes Decoder/owner.c
+ */
+bool own_expired (const struct own_entry *e, uint32_t now);
+enum own_result own_acquire (struct own_entry *e, uint16_t who, enum own_mode mode, uint32_t now);
+enum own_result own_command (struct own_entry *e, uint16_t who, enum own_policy policy, uint32_t now);
+enum own_result own_release (struct own_entry *e, uint16_t who);
+enum own_result own_put (struct own_entry *e, uint16_t who);
+int own_describe (uint16_t who, char *buf, int size);
+const char *own_policy2string (enum own_policy policy);
+enum own_policy own_string2policy (const char *s);
+
+#endif /* __OWNER_H__ */
@@ -0,0 +1,92 @@
+/*
+ * p50xudp.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __P50XUDP_H__
+#define __P50XUDP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PXU_MAXCLIENTS		8				///< the maximum number of UDP clients that are remembered
+#define PXU_IDLE_MS			(60 * 1000)		///< clients without a request for this time are forgotten
+#define PXU_REPLYMAX		128				///< replies up to this length are kept for repeated requests
+#define PXU_FBMODULES		255				///< the number of feedback modules that can be reported via P50x
+
+enum pxu_match {
+	PXU_NEW = 0,							///< a new request that must be executed
+	PXU_REPEAT,								///< a repeated request, the cached reply is sent again
+	PXU_REEXEC,								///< a repeated request with an uncached (long) reply, execute it again
+};
+
+/**
+ * A UDP client
+ */
+struct pxu_client {
+	bool			used;					///< this entry is in use
+	uint32_t		addr;					///< the IPv4 address of the client (network byte order)
+	uint16_t		port;					///< the UDP port of the client (network byte order)
+	uint32_t		lastseen;				///< the time of the last request in ms
+	bool			seqvalid;				///< a request was executed and seq is valid
+	uint8_t			seq;					///< the sequence number of the last request
+	int				rlen;					///< the length of the cached reply (-1 = reply was too long to be cached)
+	uint8_t			reply[PXU_REPLYMAX];	///< the cached reply to the last request
+	uint32_t		fbcursor;				///< the feedback generation this client has seen
+	bool			fball;					///< report all modules with set inputs on the next feedback poll
+};
+
+/**
+ * The table of UDP clients
+ */
+struct pxu_table {
+	struct pxu_client	cl[PXU_MAXCLIENTS];		///< the clients
+	void (*drop)(struct pxu_client *c);		///< called when a client is forgotten (may be NULL)
+};
+
+/**
+ * The feedback state shared by all UDP clients. Every module carries the
+ * generation of its last change. Set inputs are latched until every client
+ * has seen them, so no client misses a short activation.
+ */
+struct pxu_fbsnap {
+	uint32_t		gen;						///< the current generation (incremented on every change)
+	uint32_t		modgen[PXU_FBMODULES];		///< the generation of the last change per module
+	uint16_t		latch[PXU_FBMODULES];		///< the inputs that were set since all clients have seen the module
+};
+
+/*
+ * Prototypes Interfaces/p50xudp.c
+ */
+int pxu_expire (struct pxu_table *t, uint32_t now);
+bool pxu_isActive (const struct pxu_client *c, uint32_t now);
+struct pxu_client *pxu_lookup (struct pxu_table *t, uint32_t addr, uint16_t port, uint32_t now);
+enum pxu_match pxu_match (struct pxu_client *c, uint8_t seq);
+void pxu_store (struct pxu_client *c, uint8_t seq, const uint8_t *reply, int len);
+void pxu_fbUpdate (struct pxu_fbsnap *s, int module, uint16_t bits);
+void pxu_fbReset (struct pxu_client *c);
+bool pxu_fbPending (const struct pxu_fbsnap *s, const struct pxu_client *c, const uint16_t *state, int modules);
+int pxu_fbReport (struct pxu_fbsnap *s, struct pxu_table *t, struct pxu_client *c, const uint16_t *state, int modules, uint8_t *buf, uint32_t now);
+
+#endif /* __P50XUDP_H__ */
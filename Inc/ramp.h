@@ -0,0 +1,60 @@
+/*
+ * ramp.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __RAMP_H__
+#define __RAMP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RAMP_MAXTIME		60000			///< the maximum time for a ramp from stop to full speed (or back) in ms
+
+enum ramp_curve {
+	RAMP_LINEAR = 0,						///< every speed step takes the same time
+	RAMP_SOFT,								///< the low speed steps take longer (gentle start and stop)
+	RAMP_EXPRESS,							///< the high speed steps take longer (fast start, slowly reaching top speed)
+};
+
+/**
+ * The momentum profile of a loco. A time of zero means that the new speed
+ * is sent to the decoder immediately.
+ */
+struct ramp_profile {
+	uint16_t		accel;					///< the time in ms to accelerate from stop to full speed
+	uint16_t		decel;					///< the time in ms to brake from full speed to stop
+	uint8_t			curve;					///< the shape of the ramp (enum ramp_curve)
+};
+
+/*
+ * Prototypes Decoder/ramp.c
+ */
+bool ramp_active (const struct ramp_profile *p);
+uint32_t ramp_stepTime (const struct ramp_profile *p, int maxspeed, int speed, bool accel);
+bool ramp_advance (const struct ramp_profile *p, int maxspeed, int *current, int target, uint32_t *acc, uint32_t dt);
+const char *ramp_curve2string (enum ramp_curve curve);
+enum ramp_curve ramp_string2curve (const char *s);
+
+#endif /* __RAMP_H__ */
@@ -39,6 +39,8 @@
 #include "lwip/netif.h"
 #include "lwip/netifapi.h"
 #include "logging.h"
+#include "bstsupervisor.h"
+#include "dispmgr.h"
 
 #define USE_CACHE
 #define SYSCLK_FREQ				400000000uL		///< CPU frequency (in Hz)
@@ -422,7 +424,7 @@ void can_handler (void *pvParameter);
 /*
  * Prototypes HW/esp01.c
  */
-void esp_testthread (void *pvParameter);
+void esp_thread (void *pvParameter);
 void esp_triggerUpdate (void);
 
 /*
@@ -473,9 +475,10 @@ void hw_setup (void);
  * Prototypes HW/seven_segment.c
  */
 void seg_timer (void);
+void seg_message (enum dm_layer l, const char *text, int blink, uint32_t timeout);
+void seg_number (enum dm_layer l, int n, bool dp, uint32_t timeout);
+void seg_clear (enum dm_layer l);
 void seg_decimal (int n, bool dp);
-void seg_display (uint8_t left, uint8_t right);
-uint8_t seg_getHexDigit (int v);
 void seg_stop (void);
 void seg_pause (void);
 void seg_short (void);
@@ -516,6 +519,10 @@ void ts_boosteron (bool pt);
 void ts_boosteroff (void);
 void ts_init (void);
 void ts_handler (void);
+void ts_reportShort (enum bsv_source src);
+bool ts_getCapture (int idx, struct bsv_capture *cap);
+void ts_getShortStats (struct bsv_stats *st);
+void ts_clearShortStats (void);
 
 /*
  * Prototypes Interfaces/BiDiB/bidib.c
@@ -544,6 +551,10 @@ void fb_rangeInput (int offset, int len, uint8_t *data);
 void vLocoNet (void *pvParameter);
 int ln_dispatchLoco( int adr );
 void lnet_setModules (int count);
+int ln_lncvStart (int article, int module);
+int ln_lncvRead (int article, int cv);
+int ln_lncvWrite (int article, int cv, int value);
+void ln_lncvEnd (int article, int module);
 
 /*
  * Prototypes Interfaces/mcan.c
@@ -569,6 +580,8 @@ void s88_setModules (int count);
 int s88_getModules(void);
 void s88_setFrequency (int hz);
 int s88_getFrequency(void);
+int s88_setFilterProfile (int idx, int onN, int onM, int offN, int offM);
+int s88_setInputFilter (int first, int last, int profile);
 #ifndef CENTRAL_FEEDBACK
 void s88_triggerUpdate (void);
 int s88_getCanModules(void);
@@ -600,6 +613,7 @@ void irqdbg_printf (const char *fmt, ...) __attribute__((format(printf, 1, 2)));
 void dbg_puts (const char *str);
 void dbg_write (const char *s, int len);
 void dbg_putc (const char c);
+int dbg_getTail (char *buf, int size);
 void dbg_link_cb (struct netif *netif);
 void dbg_status_cb (struct netif *netif);
 
@@ -626,6 +640,7 @@ bool key_pairing (void);
  */
 void mt_init (void);
 void mt_speedup (int factor);
+int mt_getSpeedup (void);
 void mt_setdatetime (int year, int mon, int mday, int hour, int min);
 void mt_report (void);
 
@@ -784,6 +799,7 @@ int httpd_start (void);
 /*
  * Prototypes WEB/webupdate.c
  */
+int webup_removeDirectory (const char *path);
 int webup_manuals (void);
 int webup_update (const char *cpio);
 
@@ -0,0 +1,79 @@
+/*
+ * s88filter.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __S88FILTER_H__
+#define __S88FILTER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define S88F_MODULES		64			///< number of s88 modules handled by the filter (same as MAX_S88MODULES)
+#define S88F_PROFILES		4			///< number of filter profiles, profile 0 is the unfiltered pass thru
+#define S88F_MAXSAMPLES		16			///< the maximum window size M (we keep the history in an uint16_t)
+
+/**
+ * A filter profile defines the N-of-M rules for switching an input ON
+ * (occupied) and OFF (free). An input that is currently OFF is switched
+ * ON if at least onN of the last onM samples were read as occupied.
+ * An input that is currently ON is switched OFF if at least offN of the
+ * last offM samples were read as free.
+ */
+struct s88f_profile {
+	uint8_t		onN;					///< number of occupied samples needed to switch ON
+	uint8_t		onM;					///< window size (in samples) for the ON decision
+	uint8_t		offN;					///< number of free samples needed to switch OFF
+	uint8_t		offM;					///< window size (in samples) for the OFF decision
+};
+
+/**
+ * The configuration part of the filter. It is part of the system configuration
+ * and can be stored and read from the config.ini file.
+ */
+struct s88f_config {
+	struct s88f_profile	profile[S88F_PROFILES];	///< the profile definitions (profile[0] should always stay at 1/1 1/1)
+	uint32_t			map[S88F_MODULES];		///< two bits per input selecting the profile (MSB pair is input #1 like in the s88 data)
+};
+
+/**
+ * The runtime part of the filter.
+ */
+struct s88filter {
+	const struct s88f_config	*cnf;						///< the configuration to use
+	uint16_t					 hist[S88F_MODULES][16];	///< the sample history of each input (bit 0 = newest sample)
+	uint16_t					 state[S88F_MODULES];		///< the filtered state of each module
+};
+
+/*
+ * Prototypes Interfaces/s88filter.c
+ */
+void s88f_defaults (struct s88f_config *cnf);
+bool s88f_setProfile (struct s88f_config *cnf, int idx, int onN, int onM, int offN, int offM);
+bool s88f_setInputProfile (struct s88f_config *cnf, int input, int profile);
+int s88f_getInputProfile (const struct s88f_config *cnf, int input);
+void s88f_init (struct s88filter *f, const struct s88f_config *cnf);
+void s88f_apply (struct s88filter *f, int modules, const uint16_t *raw, uint16_t *out);
+
+#endif /* __S88FILTER_H__ */
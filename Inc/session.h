@@ -0,0 +1,104 @@
+/*
+ * session.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __SESSION_H__
+#define __SESSION_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SESS_SYNC			0x5A		///< the first byte of each encoded record
+#define SESS_HEADER			11			///< size of the encoded record header
+#define SESS_MAXSIZE		(SESS_HEADER + 8)	///< the maximum size of an encoded record
+#define SESS_VERSION		1			///< the version of the file format (in the address field of SESS_START)
+#define SESS_TRIGGER_POLL	20			///< time in ms between two checks of a feedback trigger during playback
+#define SESS_MAXTIME		0xFFFF		///< the longest turnout time that can be recorded (the field has 2 bytes)
+
+/**
+ * The type of a recorded command or event
+ */
+enum sess_type {
+	SESS_START = 0,						///< the first record of each file (adr = SESS_VERSION, v1 = uptime in ms)
+	SESS_SPEED,							///< rq_setSpeed() (v1 = speed incl. direction bit)
+	SESS_FUNC,							///< rq_setFuncMasked() (v1 = new functions, v2 = mask)
+	SESS_ESTOP,							///< rq_emergencyStop()
+	SESS_TURNOUT,						///< trnt_switch() or trnt_switchTimed() (v1 = bit 0 thrown, bit 1 on, v2 = time in ms or 0, saturated to SESS_MAXTIME)
+	SESS_TRACKMODE,						///< sig_setMode() (v1 = the requested enum trackmode)
+	SESS_FEEDBACK,						///< a feedback change (adr = s88 module, v1 = new status, v2 = changed bits)
+	SESS_LOST,							///< records were dropped because the recorder was too slow (v1 = number of records)
+	SESS_TYPES							///< the number of defined types
+};
+
+/**
+ * One recorded command or event in a decoded form
+ */
+struct sess_rec {
+	uint32_t		ts;					///< time in ms since the start of the recording
+	uint8_t			type;				///< the type as enum sess_type
+	uint16_t		src;				///< the client that sent the command (see OWN_TOKEN() in owner.h)
+	uint16_t		adr;				///< the address of the loco, turnout or feedback module
+	uint32_t		v1;					///< the first value (see enum sess_type)
+	uint32_t		v2;					///< the second value (see enum sess_type)
+};
+
+/**
+ * What to do next with a record during playback
+ */
+enum sess_action {
+	SESS_EXEC = 0,						///< the record is due and should be executed now
+	SESS_WAIT,							///< the record is not due yet, wait for the reported time and ask again
+	SESS_SKIP,							///< the record is not executed (information only or a trigger that fired)
+};
+
+/**
+ * The timing state of a running playback
+ */
+struct sess_player {
+	uint32_t		base;				///< the time that corresponds to the time stamp 0 of the recording
+	bool			triggers;			///< recorded feedback changes must happen again before the playback continues
+};
+
+/*
+ * Prototypes System/sessrec.c
+ */
+int sess_encode (const struct sess_rec *r, uint8_t *buf, int size);
+int sess_decode (const uint8_t *buf, int len, struct sess_rec *r);
+void sess_playerStart (struct sess_player *p, uint32_t now, bool triggers);
+enum sess_action sess_schedule (struct sess_player *p, const struct sess_rec *r, uint32_t now, uint16_t fbstate, uint32_t *wait);
+
+/*
+ * Prototypes System/session.c
+ */
+void sess_record (enum sess_type type, int adr, uint32_t v1, uint32_t v2);
+int sess_startRecording (void);
+void sess_stopRecording (void);
+bool sess_isRecording (void);
+int sess_play (int idx, bool loop, bool triggers);
+void sess_stopPlayback (void);
+bool sess_isPlaying (void);
+int sess_list (int *idx, int *size, int max);
+
+#endif /* __SESSION_H__ */
@@ -0,0 +1,114 @@
+/*
+ * snifferrec.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __SNIFFERREC_H__
+#define __SNIFFERREC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SREC_SYNC			0xA5		///< the first byte of each encoded record
+#define SREC_HEADER			10			///< size of the encoded record header
+#define SREC_MAXDATA		20			///< the maximum payload (same as DCC_PACKET_MAXLEN in the sniffer)
+#define SREC_MAXSIZE		(SREC_HEADER + SREC_MAXDATA)	///< the maximum size of an encoded record
+#define SREC_RINGSIZE		256			///< number of records in the ring buffer (must be a power of 2)
+
+#define SREC_FLAG_VALID		0x10		///< the packet passed all checks (XOR, repetition, ...)
+
+/**
+ * The track format of a sniffed packet
+ */
+enum srec_fmt {
+	SREC_FMT_NONE = 0,					///< not a track packet (i.e. an overrun marker)
+	SREC_FMT_DCC,						///< a DCC packet
+	SREC_FMT_MM,						///< a MM1/MM2 packet (slow or fast)
+	SREC_FMT_M3,						///< a M3 (mfx) packet
+};
+
+/**
+ * A coarse classification of the packet content
+ */
+enum srec_cmd {
+	SREC_CMD_OTHER = 0,					///< anything that is not classified
+	SREC_CMD_IDLE,						///< an idle packet
+	SREC_CMD_BROADCAST,					///< a broadcast to all mobile decoders (reset, stop, ...)
+	SREC_CMD_SPEED,						///< speed and direction for a mobile decoder
+	SREC_CMD_FUNC,						///< function settings for a mobile decoder
+	SREC_CMD_ACC,						///< a basic accessory command
+	SREC_CMD_EXTACC,					///< an extended accessory command
+	SREC_CMD_POM,						///< a programming on main or other CV access
+	SREC_CMD_LOST,						///< the overrun marker, address carries the number of lost records
+};
+
+/**
+ * One sniffed packet in a decoded form.
+ */
+struct srec {
+	uint32_t		ts;					///< time stamp in µs (from the sum of the captured edges, wraps around)
+	uint8_t			fmt;				///< the format as enum srec_fmt
+	uint8_t			cmd;				///< the classification as enum srec_cmd
+	uint8_t			flags;				///< SREC_FLAG_xxx
+	uint8_t			len;				///< number of payload bytes
+	uint16_t		adr;				///< the decoder address (0 if not applicable)
+	uint8_t			data[SREC_MAXDATA];	///< the raw packet bytes
+};
+
+/**
+ * A filter that is applied to each record before it is handed out to a
+ * client. All conditions must be met for a record to pass.
+ */
+struct srec_filter {
+	uint8_t			fmtmask;			///< bitmask of (1 << enum srec_fmt) that are passed
+	uint16_t		cmdmask;			///< bitmask of (1 << enum srec_cmd) that are passed
+	uint16_t		adrmin;				///< the lowest address to pass
+	uint16_t		adrmax;				///< the highest address to pass
+	bool			validonly;			///< only pass records that have SREC_FLAG_VALID set
+};
+
+/**
+ * A ring buffer with a single writer and any number of readers. Each reader
+ * keeps its own sequence number and so can detect when it was overrun.
+ * Locking must be done by the caller.
+ */
+struct srec_ring {
+	uint32_t		head;				///< the sequence number of the next record to write
+	struct srec		rec[SREC_RINGSIZE];	///< the records
+};
+
+/*
+ * Prototypes Track/snifferrec.c
+ */
+int srec_encode (const struct srec *r, uint8_t *buf, int size);
+int srec_decode (const uint8_t *buf, int len, struct srec *r);
+int srec_dccClassify (const uint8_t *data, int len, uint16_t *adr);
+void srec_filterAll (struct srec_filter *f);
+bool srec_parseFilter (struct srec_filter *f, const char *line);
+bool srec_match (const struct srec_filter *f, const struct srec *r);
+void srec_ringInit (struct srec_ring *ring);
+void srec_ringPut (struct srec_ring *ring, const struct srec *r);
+int srec_ringGet (const struct srec_ring *ring, uint32_t *seq, struct srec *r);
+
+#endif /* __SNIFFERREC_H__ */
@@ -0,0 +1,98 @@
+/*
+ * swdog.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __SWDOG_H__
+#define __SWDOG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SWD_MAXTASKS		16				///< the maximum number of supervised tasks
+#define SWD_NAMELEN			16				///< the maximum length of a task name (including the terminating NUL)
+#define SWD_SHUTDOWN_MS		10000			///< after a shutdown was requested, the hardware watchdog is served for this time
+
+#define SWD_HEALTHY			-1				///< swd_check(): all tasks are fine
+#define SWD_EXPIRED			-2				///< swd_check(): the shutdown took too long
+
+enum swd_state {
+	SWD_FREE = 0,							///< the entry is not used
+	SWD_IDLE,								///< the task waits for work and is not supervised
+	SWD_BUSY,								///< the task works and must send a heartbeat within its timeout
+};
+
+/**
+ * A supervised task. The task updates its entry, the supervisor only reads it.
+ */
+struct swd_task {
+	volatile uint8_t		state;				///< the state of the entry (enum swd_state)
+	char					name[SWD_NAMELEN];	///< the name of the task
+	void					*handle;			///< the OS handle of the task
+	uint32_t				timeout;			///< the maximum time between two heartbeats in ms
+	volatile uint32_t		last;				///< the time of the last heartbeat in ms
+	const void * volatile	waitobj;			///< the mutex the task is currently waiting for (NULL = none)
+	const char * volatile	waitfn;				///< the function that waits for the mutex
+	volatile uint32_t		waitsince;			///< the time the task started to wait for the mutex
+};
+
+/**
+ * The table of supervised tasks
+ */
+struct swd_table {
+	struct swd_task		t[SWD_MAXTASKS];		///< the tasks
+	bool				shutdown;				///< a shutdown is in progress, the tasks are not supervised any more
+	uint32_t			deadline;				///< the end of the shutdown grace period
+};
+
+/*
+ * Prototypes System/swdog.c
+ */
+struct swd_task *swd_register (struct swd_table *tbl, const char *name, void *handle, uint32_t timeout, uint32_t now);
+void swd_unregister (struct swd_task *t);
+struct swd_task *swd_find (struct swd_table *tbl, void *handle);
+void swd_kick (struct swd_task *t, uint32_t now);
+void swd_idle (struct swd_task *t);
+void swd_setTimeout (struct swd_task *t, uint32_t timeout, uint32_t now);
+void swd_waitFor (struct swd_task *t, const void *obj, const char *fn, uint32_t now);
+void swd_shutdown (struct swd_table *tbl, uint32_t now);
+int swd_check (const struct swd_table *tbl, uint32_t now);
+int swd_describe (const struct swd_table *tbl, int idx, uint32_t now, const char *holder, char *buf, int size);
+
+/*
+ * Prototypes System/watchdog.c
+ */
+#define WDOG_TLS_INDEX		0				///< the thread local storage pointer that links a task to its entry
+
+int wdog_register (const char *name, uint32_t timeout);
+void wdog_unregister (void);
+void wdog_kick (void);
+void wdog_idle (void);
+void wdog_setTimeout (uint32_t timeout);
+void wdog_mutexWait (const void *mutex, const char *fn);
+void wdog_mutexDone (void);
+void wdog_shutdown (void);
+bool wdog_check (void);
+
+#endif /* __SWDOG_H__ */
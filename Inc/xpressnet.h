@@ -43,6 +43,23 @@
 #define CMD_FG4			0x23	///< function group 1: F13 .. F20
 #define CMD_FG4R		0xF3	///< function group 1: F13 .. F20	ATTENTION -> ROCO MultiMouse
 #define CMD_FG5			0x28	///< function group 1: F21 .. F28
+#define CMD_FG6			0x29	///< function group 6: F29 .. F36
+#define CMD_FG7			0x2A	///< function group 7: F37 .. F44
+#define CMD_FG8			0x2B	///< function group 8: F45 .. F52
+#define CMD_FG9			0x50	///< function group 9: F53 .. F60
+#define CMD_FG10		0x51	///< function group 10: F61 .. F68
+
+#define CMD_FS1			0x24	///< switch / momentary attributes of function group 1: F0 .. F4
+#define CMD_FS2			0x25	///< switch / momentary attributes of function group 2: F5 .. F8
+#define CMD_FS3			0x26	///< switch / momentary attributes of function group 3: F9 .. F12
+#define CMD_FS4			0x27	///< switch / momentary attributes of function group 4: F13 .. F20
+#define CMD_FS5			0x2C	///< switch / momentary attributes of function group 5: F21 .. F28
+
+#define CMD_FSTAT_F0_F12	0x07	///< request switch / momentary attributes of F0 .. F12
+#define CMD_FSTAT_F13_F28	0x08	///< request switch / momentary attributes of F13 .. F28
+#define CMD_FINFO_F13_F28	0x09	///< request the state of F13 .. F28
+#define CMD_FSTAT_F29_F68	0x0A	///< request switch / momentary attributes of F29 .. F68
+#define CMD_FINFO_F29_F68	0x0B	///< request the state of F29 .. F68
 
 #define CMD_POM			0x30	///< programming on main
 #define CMD_PTREAD		0x18	///< programming on programming track
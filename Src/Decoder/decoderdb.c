@@ -90,6 +90,7 @@ static void db_rdUID (void *p, struct key_value *kv);
 static void db_rdIcon (void *p, struct key_value *kv);
 static void db_rdFlags (void *p, struct key_value *kv);
 static void db_rdFtime (void *p, struct key_value *kv);
+static void db_rdMomentum (void *p, struct key_value *kv);
 static void db_rdTrntFmt (void *p, struct key_value *kv);
 static void db_rdTrntUID (void *p, struct key_value *kv);
 static void db_rdTrntAspect (void *p, struct key_value *kv);
@@ -114,6 +115,7 @@ static struct key_value *db_wrUID (void *p, struct key_value *kv, const char *ke
 static struct key_value *db_wrIcon (void *p, struct key_value *kv, const char *key);
 static struct key_value *db_wrFlags (void *p, struct key_value *kv, const char *key);
 static struct key_value *db_wrFtime (void *p, struct key_value *kv, const char *key);
+static struct key_value *db_wrMomentum (void *p, struct key_value *kv, const char *key);
 static struct key_value *db_wrTrntFmt (void *p, struct key_value *kv, const char *key);
 static struct key_value *db_wrTrntUID (void *p, struct key_value *kv, const char *key);
 static struct key_value *db_wrTrntAspect (void *p, struct key_value *kv, const char *key);
@@ -136,6 +138,7 @@ static const struct keyhandler loco_entries[] = {
 	{ "AdrReq",		db_rdAdrReq,		db_wrAdrReq },
 	{ "flags",		db_rdFlags,			db_wrFlags },
 	{ "ftime",		db_rdFtime,			db_wrFtime },
+	{ "momentum",	db_rdMomentum,		db_wrMomentum },
 	{ NULL,			NULL,				NULL }
 };
 
@@ -679,9 +682,20 @@ locoT *db_findLocoUID (uint32_t vid, uint32_t uid)
 	return l;
 }
 
+/**
+ * Give the loco with the given decoder IDs a new address (i.e. after a DCC-A
+ * or m3 decoder was assigned a new address). If the loco is active, its
+ * entry in the refresh list follows the new address.
+ *
+ * \param adr		the new address
+ * \param vid		the vendor ID of the decoder
+ * \param uid		the UID of the decoder
+ * \return			the loco definition or NULL, if no loco has these IDs or the address is used by another loco
+ */
 locoT *db_changeAdr (int adr, uint32_t vid, uint32_t uid)
 {
 	locoT *l, **lpp;
+	int oldadr;
 
 	loco_lock(__func__);
 	if ((l = db_lookupLoco(adr)) != NULL) {
@@ -695,8 +709,10 @@ locoT *db_changeAdr (int adr, uint32_t vid, uint32_t uid)
 		if (*lpp) {		// take loco out of list and re-insert at the right position
 			(*lpp) = l->next;
 			l->next = NULL;
+			oldadr = l->adr;
 			l->adr = adr;
 			_db_addLoco(l);
+			_loco_reindex(l, oldadr);
 		}
 	}
 	loco_unlock();
@@ -771,6 +787,36 @@ void db_setLocoMaxfunc (int adr, int maxfunc)
 	loco_unlock();
 }
 
+/**
+ * Set the momentum that the command station simulates for a loco.
+ *
+ * \param adr		the loco address
+ * \param accel		the time in ms to accelerate from stop to full speed (0 = no momentum)
+ * \param decel		the time in ms to brake from full speed to stop (0 = no momentum)
+ * \param curve		the shape of the ramp
+ */
+void db_setLocoMomentum (int adr, int accel, int decel, enum ramp_curve curve)
+{
+	locoT *l;
+
+	if (accel < 0) accel = 0;
+	if (accel > RAMP_MAXTIME) accel = RAMP_MAXTIME;
+	if (decel < 0) decel = 0;
+	if (decel > RAMP_MAXTIME) decel = RAMP_MAXTIME;
+
+	loco_lock(__func__);
+	if ((l = db_lookupLoco(adr)) != NULL) {
+		if (l->ramp.accel != accel || l->ramp.decel != decel || l->ramp.curve != curve) {
+			l->ramp.accel = accel;
+			l->ramp.decel = decel;
+			l->ramp.curve = curve;
+			db_triggerStore(__func__);
+			event_fire(EVENT_LOCO_PARAMETER, adr, l);
+		}
+	}
+	loco_unlock();
+}
+
 /**
  * Setting the name of a loco.
  *
@@ -1597,6 +1643,37 @@ static struct key_value *db_wrFtime (void *p, struct key_value *kv, const char *
 	return kv;
 }
 
+/*
+ * The momentum is stored as "<accel> <decel> <curve>" with the times in ms,
+ * i.e. "momentum = 4000 2500 soft". No entry means no momentum.
+ */
+static void db_rdMomentum (void *p, struct key_value *kv)
+{
+	locoT *l = (locoT *) p;
+	char *s;
+	long accel, decel;
+
+	memset (&l->ramp, 0, sizeof(l->ramp));
+	if ((s = kv->value) == NULL) return;
+	accel = strtol(s, &s, 10);
+	decel = strtol(s, &s, 10);
+	while (*s && isspace((int) *s)) s++;
+	if (accel < 0 || accel > RAMP_MAXTIME || decel < 0 || decel > RAMP_MAXTIME) return;
+	l->ramp.accel = accel;
+	l->ramp.decel = decel;
+	l->ramp.curve = ramp_string2curve(s);
+}
+
+static struct key_value *db_wrMomentum (void *p, struct key_value *kv, const char *key)
+{
+	locoT *l = (locoT *) p;
+	char tmp[48];
+
+	if (!ramp_active(&l->ramp)) return kv;
+	sprintf (tmp, "%u %u %s", l->ramp.accel, l->ramp.decel, ramp_curve2string(l->ramp.curve));
+	return kv_add(kv, key, tmp);
+}
+
 static void db_rdTrntFmt (void *p, struct key_value *kv)
 {
 	turnoutT *t = (turnoutT *) p;
@@ -1986,6 +2063,26 @@ static void db_store (TimerHandle_t t)
 	log_msg (LOG_INFO, "%s() Storage finished\n", __func__);
 }
 
+static void db_flush (void *pvParameter1, uint32_t ulParameter2)
+{
+	(void) ulParameter2;
+
+	if (xTimerIsTimerActive(storage_timer)) db_store(storage_timer);
+	xTaskNotifyGive((TaskHandle_t) pvParameter1);
+}
+
+/**
+ * Write a pending change of the loco and accessory database to the file
+ * system now and wait for it to finish (see cnf_flushStore()).
+ */
+void db_flushStore (void)
+{
+	if (!storage_timer) return;
+	if (xTimerPendFunctionCall(db_flush, xTaskGetCurrentTaskHandle(), 0, 100) == pdPASS) {
+		ulTaskNotifyTake(pdTRUE, 5000);
+	}
+}
+
 void db_iterateLoco (bool (*func)(locoT *, void *), void *priv)
 {
 	locoT *l;
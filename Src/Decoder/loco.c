@@ -25,11 +25,27 @@
 #include "decoder.h"
 #include "config.h"
 #include "events.h"
+#include "swdog.h"
 
 #define LOCO_FNAME		"/loco.db"		///< the file where the loco definition is stored
 #define LOCO_TMP		"/loco.tmp"		///< a transient file to keep old definitions intact while storing new ones
 
+#define LOCO_HASHSIZE	64				///< the number of buckets in the address index of the refresh list (must be a power of 2)
+#define LOCO_HASH(adr)	((adr) & (LOCO_HASHSIZE - 1))
+
+#define RAMP_MAX		32				///< the maximum number of locos that change their speed with momentum at the same time
+#define RAMP_TICK		50				///< the tick of the momentum ramps in ms
+#define RAMP_STACK		512				///< the stack size of the ramp task
+#define RAMP_WDOG_TIMEOUT	2000		///< the ramp task must step the ramps within this time
+
 static ldataT *locolist;				///< the locos that are actually active - entries reference the locodb @see loco.h
+static ldataT *locotail;				///< the last entry in the refresh list (new locos are appended here)
+static ldataT *locoidx[LOCO_HASHSIZE];	///< the address index of the refresh list
+static ldataT *refresh;					///< a refresh pointer that circulates over all active locos
+static uint32_t locogen;				///< the generation counter for new entries in the refresh list
+static int lococount;					///< the number of entries in the refresh list
+static struct loco_cursor ramps[RAMP_MAX];	///< the locos with a running momentum ramp (address and generation, adr = 0 means free)
+static TaskHandle_t ramptask;			///< the task that steps the momentum ramps
 //static volatile bool dirty;				///< the list of loco definitions is dirty and should be written to stable storage
 
 static SemaphoreHandle_t mutex;			///< a mutex to control access to the list of locos
@@ -53,6 +69,23 @@ TickType_t loco_purgetime (void)
 	return tim_timeout(sc->locopurge * 60 * configTICK_RATE_HZ);
 }
 
+/**
+ * Find a loco in the refresh list using the address index.
+ * This is an internal function and should only be called, if the lock is held.
+ *
+ * \param adr	the address of the loco
+ * \return		the entry in the refresh list or NULL, if the loco is not active
+ */
+static ldataT *_loco_find (int adr)
+{
+	ldataT *l;
+
+	for (l = locoidx[LOCO_HASH(adr)]; l; l = l->hnext) {
+		if (l->loco && l->loco->adr == adr) return l;
+	}
+	return NULL;
+}
+
 /**
  * Remove a given loco from the refresh list.
  * This is an internal function and should only be called, if the lock is held.
@@ -64,20 +97,58 @@ TickType_t loco_purgetime (void)
  */
 void _loco_remove (ldataT *l)
 {
-	ldataT **ldpp;
+	ldataT **ldpp, *prev;
 
 	if (!l) return;
 
 	// TODO: remove this loco from consist chain!
+	ldpp = &locoidx[LOCO_HASH(l->loco->adr)];
+	while (*ldpp && *ldpp != l) ldpp = &(*ldpp)->hnext;
+	if (*ldpp == l) *ldpp = l->hnext;
+
 	ldpp = &locolist;
-	while (*ldpp != l) ldpp = &(*ldpp)->next;
+	prev = NULL;
+	while (*ldpp && *ldpp != l) {
+		prev = *ldpp;
+		ldpp = &prev->next;
+	}
 	if (*ldpp == l) {
 		*ldpp = l->next;
+		if (locotail == l) locotail = prev;
+		if (refresh == l) refresh = prev;		// the refresh continues with the entry following the removed one
+		lococount--;
 		event_fire(EVENT_NEWLOCO, -(l->loco->adr), NULL);
 		free (l);
 	}
 }
 
+/**
+ * Move the entry of a loco in the address index after the address of its
+ * loco definition was changed. Running momentum ramps follow the loco.
+ * This is an internal function and should only be called, if the lock is held.
+ *
+ * \param l			the loco definition (already carrying the new address)
+ * \param oldadr	the address the loco had before
+ */
+void _loco_reindex (locoT *l, int oldadr)
+{
+	ldataT **ldpp, *ld;
+	int i;
+
+	if (!l || l->adr == oldadr) return;
+
+	ldpp = &locoidx[LOCO_HASH(oldadr)];
+	while (*ldpp && (*ldpp)->loco != l) ldpp = &(*ldpp)->hnext;
+	if ((ld = *ldpp) == NULL) return;			// the loco is not in the refresh list
+	*ldpp = ld->hnext;
+	ld->hnext = locoidx[LOCO_HASH(l->adr)];
+	locoidx[LOCO_HASH(l->adr)] = ld;
+
+	for (i = 0; i < RAMP_MAX; i++) {
+		if (ramps[i].adr == oldadr && ramps[i].gen == ld->gen) ramps[i].adr = l->adr;
+	}
+}
+
 /**
  * Find a link from the refresh list to the given loco definition.
  * This is an internal function and should only be called, if the lock is held.
@@ -87,13 +158,11 @@ void _loco_remove (ldataT *l)
  */
 ldataT *_loco_getRefreshLink (locoT *l)
 {
-	ldataT **ldpp;
+	ldataT *ld;
 
 	if (!l) return NULL;
-	ldpp = &locolist;
-
-	while (*ldpp != NULL && (*ldpp)->loco != l) ldpp = &(*ldpp)->next;
-	return *ldpp;
+	if ((ld = _loco_find(l->adr)) != NULL && ld->loco == l) return ld;
+	return NULL;
 }
 
 /**
@@ -122,20 +191,24 @@ void loco_remove (ldataT *l)
  */
 static ldataT *_loco_callLocked (int adr, bool add)
 {
-	ldataT *l, **lpp;
+	ldataT *l;
 	locoT *loco;
 
 	if (adr <= 0 || adr > MAX_LOCO_ADR) return NULL;
-	lpp = &locolist;
-	while ((l = *lpp) != NULL && l->loco && l->loco->adr != adr) lpp = &l->next;
-	if (!l && add) {
+	if ((l = _loco_find(adr)) == NULL && add) {
 		log_msg (LOG_INFO, "%s() adding loco %d\n", __func__, adr);
 		if ((loco = _db_getLoco(adr, add)) == NULL) return NULL;	// loco not found and could not be created (add is always true here)
 		if ((l = calloc (1, sizeof(*l))) == NULL) return NULL;		// no refresh list entry could be allocted
 		l->loco = loco;		// reference the loco dictionary entry
-		l->speed = 0x80;	// standard speed: forward 0 (i.e. stopped)
+		l->speed = l->target = l->current = 0x80;	// standard speed: forward 0 (i.e. stopped)
 		l->purgeTime = loco_purgetime();
-		*lpp = l;			// append to end of the list
+		l->gen = ++locogen;
+		if (locotail) locotail->next = l;		// append to end of the list
+		else locolist = l;
+		locotail = l;
+		l->hnext = locoidx[LOCO_HASH(adr)];
+		locoidx[LOCO_HASH(adr)] = l;
+		lococount++;
 		event_fire(EVENT_NEWLOCO, adr, NULL);
 	}
 
@@ -162,9 +235,9 @@ static ldataT *loco_callLocked (int adr, bool add)
 	struct consist *c;
 	int i;
 
-	if ((c = consist_findConsist(adr)) == NULL) return _loco_callLocked(adr, add);
-	if ((l = _loco_callLocked(adr, add)) == NULL) return NULL;		// could not get the loco - stop here
-	if (l->consist) return l;										// consist already established nothing else to do
+	if ((l = _loco_find(adr)) != NULL && l->consist) return l;		// consist already established nothing else to do
+	if ((c = consist_findConsist(adr)) == NULL) return (l) ? l : _loco_callLocked(adr, add);
+	if (!l && (l = _loco_callLocked(adr, add)) == NULL) return NULL;	// could not get the loco - stop here
 
 	pp = &l->consist;
 	l->flags &= ~LOCO_CONSIST_REVERSE;
@@ -249,7 +322,7 @@ int loco_setFuncMasked (int adr, uint32_t newfuncs, uint32_t mask)
 			switch (l->loco->fmt) {
 				case FMT_MM1_14:
 					if (changemask & FUNC_LIGHT) {
-						p = sigq_speedPacket(l, l->speed);
+						p = sigq_speedPacket(l, l->current);
 						changemask &= ~FUNC_LIGHT;
 					} else if (changemask & FUNC_F1_F4) {
 						p = sigq_genPacket(l, 0, QCMD_MM_FDFUNCS);
@@ -260,23 +333,23 @@ int loco_setFuncMasked (int adr, uint32_t newfuncs, uint32_t mask)
 				case FMT_MM2_27A:
 				case FMT_MM2_27B:
 					if (changemask & FUNC_LIGHT) {
-						p = sigq_speedPacket(l, l->speed);
+						p = sigq_speedPacket(l, l->current);
 						changemask &= ~FUNC_LIGHT;
 					} else if (changemask & FUNC(1)) {
 						p = sigq_genPacket(l, 0, QCMD_MM_SETF1);
-						if (p) p->value.i32 = l->speed & 0xFF;	// the function packets for MM2 also need the speed - else 0 would be transmitted!
+						if (p) p->value.i32 = l->current & 0xFF;	// the function packets for MM2 also need the speed - else 0 would be transmitted!
 						changemask &= ~FUNC(1);
 					} else if (changemask & FUNC(2)) {
 						p = sigq_genPacket(l, 0, QCMD_MM_SETF2);
-						if (p) p->value.i32 = l->speed & 0xFF;	// see above ...
+						if (p) p->value.i32 = l->current & 0xFF;	// see above ...
 						changemask &= ~FUNC(2);
 					} else if (changemask & FUNC(3)) {
 						p = sigq_genPacket(l, 0, QCMD_MM_SETF3);
-						if (p) p->value.i32 = l->speed & 0xFF;	// see above ...
+						if (p) p->value.i32 = l->current & 0xFF;	// see above ...
 						changemask &= ~FUNC(3);
 					} else if (changemask & FUNC(4)) {
 						p = sigq_genPacket(l, 0, QCMD_MM_SETF4);
-						if (p) p->value.i32 = l->speed & 0xFF;	// see above ...
+						if (p) p->value.i32 = l->current & 0xFF;	// see above ...
 						changemask &= ~FUNC(4);
 					} else changemask = 0;
 					break;
@@ -285,7 +358,7 @@ int loco_setFuncMasked (int adr, uint32_t newfuncs, uint32_t mask)
 				case FMT_DCC_126:
 				case FMT_DCC_SDF:
 					if (l->loco->fmt == FMT_DCC_14 && (changemask & FUNC_LIGHT)) {	// F0 is included in speed packet for the 14 speed decoders only
-						p = sigq_speedPacket(l, l->speed);
+						p = sigq_speedPacket(l, l->current);
 						changemask &= ~FUNC_LIGHT;
 					} else if (l->loco->fmt == FMT_DCC_14 && (changemask & FUNC_F1_F4)) {
 						p = sigq_genPacket(l, 0, QCMD_DCC_SETF1_4);
@@ -344,6 +417,87 @@ int loco_setFunc (int adr, int f, bool on)
 	return loco_setFuncMasked(adr, (on) ? (1 << f) : 0, 1 << f);
 }
 
+/**
+ * Setting a group of consecutive functions. Other than loco_setFuncMasked()
+ * this function can reach all functions up to F68 (DCC) or F127 (M3). The
+ * functions below F29 are handed over to loco_setFuncMasked(), because they
+ * are transmitted in other function groups.
+ *
+ * @param adr		the loco address
+ * @param first		the number of the first function in this group
+ * @param count		the number of functions in this group (1 .. 32)
+ * @param funcs		the new status of the functions with bit 0 representing the function 'first'
+ * @return			0 if everything is OK or the functions results in a NOP, an errorcode otherwise
+ */
+int loco_setFuncGroup (int adr, int first, int count, uint32_t funcs)
+{
+	ldataT *l;
+	struct packet *p;
+	uint32_t changed[MAX_FUNC_WORDS], bit;
+	uint8_t groups;
+	bool changes;
+	int f, low;
+
+	if (adr <= 0 || adr > MAX_LOCO_ADR || first < 0 || count <= 0 || count > 32) return -1;
+	if (first + count > LOCO_MAX_FUNCS) count = LOCO_MAX_FUNCS - first;
+
+	if (first < 29) {						// the lower functions are handled by the standard function
+		low = (first + count > 29) ? 29 - first : count;
+		bit = (1 << low) - 1;
+		loco_setFuncMasked(adr, (funcs & bit) << first, bit << first);
+		funcs >>= low;
+		first += low;
+		count -= low;
+		if (count <= 0) return 0;
+	}
+
+	if (!loco_lock(__func__)) return -1;
+	if ((l = loco_callLocked(adr, true)) == NULL) {
+		loco_unlock();
+		return -1;
+	}
+
+	memset (changed, 0, sizeof(changed));
+	changes = false;
+	for (f = first; f < first + count; f++, funcs >>= 1) {
+		bit = 1 << (f % 32);
+		if (!!(l->funcs[f / 32] & bit) != !!(funcs & 1)) {
+			l->funcs[f / 32] ^= bit;
+			changed[f / 32] |= bit;
+			changes = true;
+		}
+	}
+	if (!changes) {
+		loco_unlock();
+		return 0;
+	}
+	l->purgeTime = loco_purgetime();
+
+	if (FMT_IS_DCC(l->loco->fmt)) {
+		groups = 0;									// a bit for each of the groups F29 - F36 .. F61 - F68
+		for (f = 29; f < 69; f++) {
+			if (changed[f / 32] & (1 << (f % 32))) groups |= 1 << ((f - 29) / 8);
+		}
+		for (f = 0; f < 5; f++) {
+			if (groups & (1 << f)) {
+				if ((p = sigq_genPacket(l, 0, QCMD_DCC_SETF29_36 + f)) != NULL) sigq_queuePacket(p);
+			}
+		}
+	} else if (FMT_IS_M3(l->loco->fmt)) {
+		for (f = first; f < first + count; f++) {
+			if (changed[f / 32] & (1 << (f % 32))) {
+				if ((p = sigq_genPacket(l, 0, QCMD_M3_SINGLEFUNC)) != NULL) {
+					p->param.i32 = f;
+					sigq_queuePacket(p);
+				}
+			}
+		}
+	}
+	loco_unlock();
+	event_fire(EVENT_LOCO_FUNCTION, adr, l);
+	return 0;
+}
+
 int loco_setBinState (int adr, int state, bool on)
 {
 	ldataT *l;
@@ -390,6 +544,27 @@ static int loco_clipSpeed (locoT *l, int speed)
 	return (rev) ? speed : 0x80 | speed;
 }
 
+static bool loco_reportTarget (void)
+{
+	return (cnf_getconfig()->sysflags & SYSFLAG_REPORTTARGET) != 0;
+}
+
+/**
+ * Set the speed that is sent to the track. If the current speed is reported
+ * to the controls, the reported speed follows.
+ *
+ * \param l			the loco data structure
+ * \param speed		the new speed on the track
+ * \return			true, if the reported speed changed and an event must be fired
+ */
+static bool loco_setCurrent (ldataT *l, int speed)
+{
+	l->current = speed;
+	if (loco_reportTarget() || l->speed == speed) return false;
+	l->speed = speed;
+	return true;
+}
+
 /**
  * Special handling for MM27a locos. We probably must send two different
  * speed steps to get to the intermediate speed step. The intermediate
@@ -415,63 +590,182 @@ static int loco_clipSpeed (locoT *l, int speed)
 static void loco_MM27aSpeed (ldataT *l, int speed)
 {
 	struct packet *p, *r, *s;
+	bool report;
 
 	s = r = NULL;
-	if ((l->speed & 0x7F) && (l->speed & 0x80) != (speed & 0x80)) {	// direction change when running: send emergency stop
-		l->speed &= 0x80;
+	if ((l->current & 0x7F) && (l->current & 0x80) != (speed & 0x80)) {	// direction change when running: send emergency stop
+		l->current &= 0x80;
 		s = sigq_emergencyStopPacket(l);
 	}
 	if ((speed & 0x7F) != 0) {					// we have a non-null speed
 		if ((speed & 1) == 0) {					// we have an intermediate speed inbetween two real speeds
 			r = sigq_speedPacket(l, speed + 1);
-		} else if (speed == l->speed - 1) {		// we go down from half step to the lower full step
+		} else if (speed == l->current - 1) {	// we go down from half step to the lower full step
 			r = sigq_speedPacket(l, speed - 1);
 		}
 	}
-	l->speed = speed;
-	p = sigq_speedPacket(l, l->speed);
+	report = loco_setCurrent(l, speed);
+	p = sigq_speedPacket(l, l->current);
 	loco_unlock();
-	event_fire(EVENT_LOCO_SPEED, l->loco->adr, l);
+	if (report) event_fire(EVENT_LOCO_SPEED, l->loco->adr, l);
 	if (s) sigq_queuePacket(s);					// output HALT packet (speed = 0)
 	if (r) sigq_queuePacket(r);					// for intermediate speeds: output temporary speed packet
 	sigq_queuePacket(p);						// for all: send new speed
 }
 
-static int _loco_setSpeed (ldataT *l, int speed)
+/**
+ * Send a new speed to the track. This function is called with the lock held
+ * and releases it before the packets are queued.
+ *
+ * \param l			the loco data structure with the actual settings
+ * \param speed		the new speed on the track
+ */
+static void loco_trackSpeed (ldataT *l, int speed)
 {
 	struct packet *p, *r, *s;
+	bool report;
+
+	if (l->loco->fmt == FMT_MM2_27A) {		// needs special handling
+		loco_MM27aSpeed(l, speed);
+		return;
+	}
+
+	s = r = NULL;
+	if ((l->current & 0x7F) && (l->current & 0x80) != (speed & 0x80)) {		// direction change when running: send emergency stop
+		s = sigq_emergencyStopPacket(l);
+//	} else if (l->loco->fmt == FMT_MM1_14 && (l->current & 0x80) != (speed & 0x80)) {	// direction change on MM1
+	} else if (FMT_IS_MM(l->loco->fmt) && (l->current & 0x80) != (speed & 0x80)) {	// direction change on MM1
+		r = sigq_genPacket(l, 0, QCMD_MM_REVERSE);	// send a REVERSE packet (which in the end is the same as the emergency stop)
+		if (r) {
+			r->repeat = 10;
+			r->value.i32 = l->current & 0x80;
+		}
+	}
+	report = loco_setCurrent(l, speed);
+	p = sigq_speedPacket(l, l->current);
+	loco_unlock();
+	if (report) event_fire(EVENT_LOCO_SPEED, l->loco->adr, l);
+	if (s) sigq_queuePacket(s);					// output EMERGENCY STOP packet (speed = 0, old direction)
+	if (r) sigq_queuePacket(r);					// for MM1: output REVERSE packet
+	sigq_queuePacket(p);						// for all: send new speed
+}
+
+/**
+ * Step all running momentum ramps. Each loco gets at most one speed packet
+ * per tick, even if the ramp advanced more than one speed step.
+ *
+ * \param dt		the time in ms since the last call
+ * \return			true, if there are still ramps running
+ */
+static bool loco_rampStep (uint32_t dt)
+{
+	ldataT *l;
+	bool active;
+	int i, speed;
+
+	active = false;
+	for (i = 0; i < RAMP_MAX; i++) {
+		if (!ramps[i].adr) continue;
+		if (!loco_lock(__func__)) {
+			active = true;		// try again with the next tick
+			continue;
+		}
+		if ((l = _loco_find(ramps[i].adr)) == NULL || l->gen != ramps[i].gen) {	// the loco left the refresh list
+			ramps[i].adr = 0;
+			loco_unlock();
+			continue;
+		}
+		speed = l->current;
+		if (ramp_advance(&l->loco->ramp, loco_getSpeeds(l->loco), &speed, l->target, &l->rampacc, dt)) active = true;
+		else ramps[i].adr = 0;
+		if (speed != l->current) loco_trackSpeed(l, speed);		// releases the lock
+		else loco_unlock();
+	}
+	return active;
+}
+
+/**
+ * The task that steps the momentum ramps with a fixed tick. It sleeps as
+ * long as no loco changes its speed with momentum.
+ *
+ * \param pvParameter	ignored
+ */
+static void loco_rampTask (void *pvParameter)
+{
+	TickType_t last;
+
+	(void) pvParameter;
+
+	wdog_register(NULL, RAMP_WDOG_TIMEOUT);
+	for (;;) {
+		wdog_idle();
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		wdog_kick();
+		last = xTaskGetTickCount();
+		do {
+			vTaskDelayUntil(&last, pdMS_TO_TICKS(RAMP_TICK));
+			wdog_kick();
+		} while (loco_rampStep(RAMP_TICK));
+	}
+}
+
+/**
+ * Start the momentum ramp for a loco, if it is not already running.
+ * This function must be called with the lock held.
+ *
+ * \param l			the loco data structure with the new target speed
+ * \return			true, if the ramp is running or false, if there is no free slot
+ */
+static bool _loco_startRamp (ldataT *l)
+{
+	int i, slot;
+
+	for (i = 0, slot = -1; i < RAMP_MAX; i++) {
+		if (ramps[i].adr == l->loco->adr && ramps[i].gen == l->gen) return true;	// the ramp is running and heads for the new target now
+		if (!ramps[i].adr && slot < 0) slot = i;
+	}
+	if (slot < 0) return false;
+
+	l->rampacc = 0;
+	ramps[slot].adr = l->loco->adr;
+	ramps[slot].gen = l->gen;
+	if (!ramptask && xTaskCreate(loco_rampTask, "RAMP", RAMP_STACK, NULL, 2, &ramptask) != pdPASS) {
+		ramps[slot].adr = 0;
+		return false;
+	}
+	xTaskNotifyGive(ramptask);
+	return true;
+}
+
+/**
+ * Set the target speed of a single loco. Without momentum, the new speed is
+ * sent to the track immediately, else the ramp task takes the loco to the new
+ * speed step by step.
+ *
+ * \param l			the loco data structure
+ * \param speed		the new target speed
+ * \return			0 if everything is OK, an errorcode otherwise
+ */
+static int _loco_setSpeed (ldataT *l, int speed)
+{
+	bool report;
 
 	if (!l || !loco_lock(__func__)) return -1;
 
 //	log_msg (LOG_INFO, "%s(%d) Speed %c%d\n", __func__, l->loco->adr, (speed & 0x80) ? 'F' : 'R', speed & 0x7F);
 	l->purgeTime = loco_purgetime();
 	speed = loco_clipSpeed(l->loco, speed);
-	if (speed != l->speed) {
-		if (l->loco->fmt == FMT_MM2_27A) {		// needs special handling
-			loco_MM27aSpeed(l, speed);
-		} else {
-			s = r = NULL;
-			if ((l->speed & 0x7F) && (l->speed & 0x80) != (speed & 0x80)) {		// direction change when running: send emergency stop
-				s = sigq_emergencyStopPacket(l);
-//				} else if (l->loco->fmt == FMT_MM1_14 && (l->speed & 0x80) != (speed & 0x80)) {	// direction change on MM1
-			} else if (FMT_IS_MM(l->loco->fmt) && (l->speed & 0x80) != (speed & 0x80)) {	// direction change on MM1
-				r = sigq_genPacket(l, 0, QCMD_MM_REVERSE);	// send a REVERSE packet (which in the end is the same as the emergency stop)
-				if (r) {
-					r->repeat = 10;
-					r->value.i32 = l->speed & 0x80;
-				}
-			}
-			l->speed = speed;
-			p = sigq_speedPacket(l, l->speed);
-			loco_unlock();
-			event_fire(EVENT_LOCO_SPEED, l->loco->adr, l);
-			if (s) sigq_queuePacket(s);					// output EMERGENCY STOP packet (speed = 0, old direction)
-			if (r) sigq_queuePacket(r);					// for MM1: output REVERSE packet
-			sigq_queuePacket(p);						// for all: send new speed
-		}
-	} else {
+	l->target = speed;
+	report = loco_reportTarget() && l->speed != speed;
+	if (report) l->speed = speed;
+	if (speed == l->current) {
 		loco_unlock();
+	} else if (ramp_active(&l->loco->ramp) && _loco_startRamp(l)) {
+		loco_unlock();
+	} else {
+		loco_trackSpeed(l, speed);		// releases the lock
 	}
+	if (report) event_fire(EVENT_LOCO_SPEED, l->loco->adr, l);
 	return 0;
 }
 
@@ -504,8 +798,9 @@ int loco_emergencyStop (int adr)
 	if (!loco_lock(__func__)) return -1;
 
 	if ((l = loco_callLocked(adr, true)) != NULL) {
-//		if (l->speed & 0x7F) {
-			l->speed &= 0x80;
+//		if (l->current & 0x7F) {
+			l->current &= 0x80;				// an emergency stop is never delayed by the momentum
+			l->speed = l->target = l->current;	// the ramp (if any) ends with the next tick
 			p = sigq_emergencyStopPacket(l);
 			loco_unlock();
 			event_fire(EVENT_LOCO_SPEED, adr, l);
@@ -519,6 +814,229 @@ int loco_emergencyStop (int adr)
 	return 0;
 }
 
+/**
+ * Set the client the calling task is serving right now. All commands of the
+ * task are checked against the owner of the loco (see request.c). Tasks that
+ * serve several clients call this for every message they receive, tasks that
+ * serve a single client once at startup. Tasks that never call this function
+ * are anonymous and not subject to the ownership.
+ *
+ * \param who		the client (see OWN_TOKEN())
+ */
+void loco_setClient (uint16_t who)
+{
+	vTaskSetThreadLocalStoragePointer(NULL, OWN_TLS_INDEX, (void *) ((uint32_t) who));
+}
+
+/**
+ * Get the client the calling task is serving right now.
+ *
+ * \return			the client or OWN_ANONYMOUS
+ */
+uint16_t loco_getClient (void)
+{
+	return (uint16_t) ((uint32_t) pvTaskGetThreadLocalStoragePointer(NULL, OWN_TLS_INDEX));
+}
+
+static enum own_policy loco_ownPolicy (void)
+{
+	return (enum own_policy) cnf_getconfig()->ownpolicy;
+}
+
+/**
+ * Fire the events for the changes of the owner collected by _loco_ownerResult().
+ * This must be called after the lock is released, because the event may wait
+ * for room in the queue and the listeners look up the loco themselves.
+ *
+ * \param changes	the list of changes (may be NULL)
+ */
+static void loco_ownerEvents (struct own_change *changes)
+{
+	struct own_change *oc;
+	char old[16], new[16];
+
+	while ((oc = changes) != NULL) {
+		changes = oc->next;
+		oc->next = NULL;
+		if (oc->taken) {
+			own_describe(oc->from, old, sizeof(old));
+			own_describe(oc->to, new, sizeof(new));
+			log_msg (LOG_INFO, "%s(): loco %d taken over from %s by %s\n", __func__, oc->adr, old, new);
+		}
+		event_fireEx(EVENT_LOCO_OWNER, oc->adr, oc, EVTFLAG_FREE_SRC, QUEUE_WAIT_TIME);
+	}
+}
+
+/**
+ * Report the result of an ownership operation. A change of the owner is
+ * appended to the list of changes, that is fired with loco_ownerEvents()
+ * after the lock is released.
+ * This is an internal function and should only be called, if the lock is held.
+ *
+ * \param l		the loco
+ * \param before	the owner before the operation
+ * \param rc		the result of the operation
+ * \param changes	the list of changes to append to
+ * \return			0 if the operation was successful, -1 if it was denied
+ */
+static int _loco_ownerResult (ldataT *l, uint16_t before, enum own_result rc, struct own_change **changes)
+{
+	struct own_change *oc;
+
+	if (rc == OWN_DENIED) return -1;
+	if (rc != OWN_TAKEN && l->own.owner == before) return 0;
+	if ((oc = malloc (sizeof(*oc))) == NULL) return 0;
+	oc->next = NULL;
+	oc->adr = l->loco->adr;
+	oc->from = before;
+	oc->to = l->own.owner;
+	oc->taken = (rc == OWN_TAKEN);
+	oc->dispatched = l->own.dispatched;
+	while (*changes) changes = &(*changes)->next;
+	*changes = oc;
+	return 0;
+}
+
+/**
+ * Check if the client served by the calling task may command the given loco.
+ * This is the check on the command path: the global policy decides, if the
+ * loco is taken from its current owner, shared with it or the command is
+ * rejected.
+ *
+ * \param adr		the loco that should be commanded
+ * \return			true, if the command may be executed
+ */
+bool loco_checkOwner (int adr)
+{
+	struct own_change *changes = NULL;
+	ldataT *l;
+	uint16_t who, before;
+	int rc;
+
+	if ((who = loco_getClient()) == OWN_ANONYMOUS) return true;
+	if (!loco_lock(__func__)) return true;		// let the command itself fail
+	rc = 0;
+	if ((l = loco_callLocked(adr, true)) != NULL) {
+		before = l->own.owner;
+		rc = _loco_ownerResult(l, before, own_command(&l->own, who, loco_ownPolicy(), xTaskGetTickCount()), &changes);
+	}
+	loco_unlock();
+	loco_ownerEvents(changes);
+	return rc == 0;
+}
+
+/**
+ * Ask for the control of a loco (i.e. when a throttle selects a loco).
+ *
+ * \param adr		the loco
+ * \param who		the client asking for the loco
+ * \param mode		how the loco is requested
+ * \return			0 if the client controls the loco now, -1 if it belongs to another client
+ */
+int loco_acquire (int adr, uint16_t who, enum own_mode mode)
+{
+	struct own_change *changes = NULL;
+	ldataT *l;
+	uint16_t before;
+	int rc;
+
+	if (!loco_lock(__func__)) return -1;
+	rc = -1;
+	if ((l = loco_callLocked(adr, true)) != NULL) {
+		before = l->own.owner;
+		rc = _loco_ownerResult(l, before, own_acquire(&l->own, who, mode, xTaskGetTickCount()), &changes);
+	}
+	loco_unlock();
+	loco_ownerEvents(changes);
+	return rc;
+}
+
+/**
+ * Give up the control of a loco.
+ *
+ * \param adr		the loco
+ * \param who		the client releasing the loco (OWN_ANONYMOUS to release it for any owner)
+ * \return			0 if the loco is free now, -1 if it belongs to another client
+ */
+int loco_release (int adr, uint16_t who)
+{
+	struct own_change *changes = NULL;
+	ldataT *l;
+	uint16_t before;
+	int rc;
+
+	if (!loco_lock(__func__)) return -1;
+	rc = 0;
+	if ((l = _loco_find(adr)) != NULL) {
+		before = l->own.owner;
+		rc = _loco_ownerResult(l, before, own_release(&l->own, who), &changes);
+	}
+	loco_unlock();
+	loco_ownerEvents(changes);
+	return rc;
+}
+
+/**
+ * Release all locos of a client (i.e. when the client disconnects).
+ *
+ * \param who		the client
+ */
+void loco_releaseAll (uint16_t who)
+{
+	struct own_change *changes = NULL;
+	ldataT *l;
+
+	if (who == OWN_ANONYMOUS || !loco_lock(__func__)) return;
+	for (l = locolist; l; l = l->next) {
+		if (l->own.owner == who) _loco_ownerResult(l, who, own_release(&l->own, who), &changes);
+	}
+	loco_unlock();
+	loco_ownerEvents(changes);
+}
+
+/**
+ * Dispatch a loco (LocoNet DISPATCH PUT). The loco has no owner afterwards and
+ * is given to the next client that asks for it.
+ *
+ * \param adr		the loco
+ * \param who		the client dispatching the loco
+ * \return			0 if the loco is dispatched, -1 if it belongs to another client
+ */
+int loco_dispatch (int adr, uint16_t who)
+{
+	struct own_change *changes = NULL;
+	ldataT *l;
+	uint16_t before;
+	int rc;
+
+	if (!loco_lock(__func__)) return -1;
+	rc = -1;
+	if ((l = loco_callLocked(adr, true)) != NULL) {
+		before = l->own.owner;
+		rc = _loco_ownerResult(l, before, own_put(&l->own, who), &changes);
+	}
+	loco_unlock();
+	loco_ownerEvents(changes);
+	return rc;
+}
+
+/**
+ * Get the owner of a loco.
+ *
+ * \param adr		the loco
+ * \return			the owner or OWN_ANONYMOUS, if the loco is free, dispatched or not in the refresh list
+ */
+uint16_t loco_getOwner (int adr)
+{
+	ldataT *l;
+	uint16_t who;
+
+	if (!loco_lock(__func__)) return OWN_ANONYMOUS;
+	who = ((l = _loco_find(adr)) != NULL) ? l->own.owner : OWN_ANONYMOUS;
+	loco_unlock();
+	return who;
+}
+
 /**
  * Scans the refresh list for an m3 loco. If not found, we need not send the
  * m3 beacon and can operate mfx(R) decoders in DCC format without explicitly
@@ -548,60 +1066,93 @@ void loco_freeRefreshList(void)
 		locolist = l->next;
 		free (l);
 	}
+	memset (locoidx, 0, sizeof(locoidx));
+	locotail = refresh = NULL;
+	lococount = 0;
 }
 
 ldataT *loco_refresh(void)
 {
-	static ldataT *refresh;					///< a refresh pointer that circulates over all active locos
+	struct sysconf *sc;
+	ldataT *l;
 
 	if (!loco_lock(__func__)) return NULL;
 	if (!refresh || (refresh = refresh->next) == NULL) refresh = locolist;
 
-	struct sysconf *sc;
 	sc = cnf_getconfig();
-	if (refresh) {
-		if (sc->locopurge) {
-			if (tim_isover(refresh->purgeTime)) {	// purge time is over ...
-				_loco_remove(refresh);
-				refresh = NULL;
-			} else {
-				refresh->age++;
-			}
+	l = refresh;
+	if (l) {
+		if (sc->locopurge && tim_isover(l->purgeTime)) {	// purge time is over ...
+			_loco_remove(l);
+			l = NULL;
 		} else {
-			refresh->age++;
+			l->age++;
 		}
 	}
 
 	loco_unlock();
-	return refresh;
+	return l;
 }
 
 /**
- * Iterate over the list of locos that are in the refresh list.
- * The current position in the refreshlist is given as a parameter.
- * We must check out, that this loco really still exists. If not,
- * a derefence of the next-pointer will direct us into garbage.
- * Remember that the list could be modified in between calls to this
- * function and we cannot lock the whole thing for the duration of
- * this enumeration.
+ * Take a snapshot of the addresses of all locos in the refresh list.
+ * The list is walked with the lock held, so the result is consistent
+ * even if the list is modified later on. The caller must free() the
+ * returned array.
  *
- * This way, we should keep in mind, that we possibly reach a premature
- * end of the list. The only other way to overcome this problem would
- * be a complete list copy, that would have to be freed afterwards
- * (something like a hypothecial function locoT *loco_cloneList()).
- *
- * \param cur		the current position in the loco list or NULL if we want to start from the beginning
- * \return			the next loco in the list, if it exists.
+ * \param count	where to store the number of addresses in the snapshot
+ * \return			an allocated array of loco addresses or NULL if the list is empty
+ * 					or memory is exhausted
  */
-ldataT *loco_iterateNext (ldataT *cur)
+uint16_t *loco_snapshot (int *count)
 {
 	ldataT *l;
+	uint16_t *adrs;
+	int n;
 
-	if (!cur) return locolist;
+	if (count) *count = 0;
 	if (!loco_lock(__func__)) return NULL;
-	l = locolist;
-	while (l && l != cur) l = l->next;
-	if (l) l = l->next;
+	n = lococount;
+	if (n > 0 && (adrs = malloc (n * sizeof(*adrs))) != NULL) {
+		for (l = locolist, n = 0; l; l = l->next) adrs[n++] = l->loco->adr;
+		if (count) *count = n;
+	} else {
+		adrs = NULL;
+	}
+	loco_unlock();
+	return adrs;
+}
+
+/**
+ * Iterate over the list of locos that are in the refresh list in the order
+ * of the refresh. The cursor remembers the address and the generation of the
+ * loco returned last, so the list may be modified in between calls to this
+ * function. If that loco was removed in the meantime, the iteration continues
+ * with the next younger entry (the list is ordered by the generation, because
+ * new entries are always appended).
+ *
+ * Initialise the cursor with zeros to start from the beginning of the list.
+ *
+ * \param cur		the cursor that is updated to the returned loco
+ * \return			the next loco in the list or NULL at the end of the list
+ */
+ldataT *loco_iterate (struct loco_cursor *cur)
+{
+	ldataT *l;
+
+	if (!cur || !loco_lock(__func__)) return NULL;
+	if (!cur->adr) {
+		l = locolist;
+	} else if ((l = _loco_find(cur->adr)) != NULL && l->gen == cur->gen) {
+		l = l->next;
+	} else {
+		l = locolist;
+		while (l && (int32_t) (l->gen - cur->gen) <= 0) l = l->next;
+	}
+	if (l) {
+		cur->adr = l->loco->adr;
+		cur->gen = l->gen;
+	}
 	loco_unlock();
 	return l;
 }
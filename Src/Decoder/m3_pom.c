@@ -28,6 +28,8 @@
 #include "config.h"
 #include "decoder.h"
 
+#define M3_DYN_ADR			1000	///< the address where we start to supply addresses to discovered decoders
+
 int m3pom_readCV (int adr, cvadrT cva, int bytes, reply_handler handler, flexval priv)
 {
 	struct packet *p;
@@ -105,3 +107,40 @@ int m3_setAddress (uint32_t uid, int adr)
 	return 0;
 }
 
+/**
+ * Give a discovered decoder its loco address. A decoder that is already known
+ * by its UID gets its old address back, a new decoder gets the next free
+ * address starting at M3_DYN_ADR.
+ *
+ * \param uid	the UID of the decoder that was found
+ */
+static void m3_assign (uint32_t uid)
+{
+	locoT *l;
+	int adr;
+
+	if ((l = db_findLocoUID(0, uid)) == NULL && (l = db_addFreeAdr(M3_DYN_ADR)) == NULL) {
+		log_error("%s(): no address available for UID 0x%08lx\n", __func__, uid);
+		return;
+	}
+	adr = l->adr;
+	if (!FMT_IS_M3(l->fmt)) db_setLocoFmt(adr, FMT_M3_126);
+	db_setLocoUID(adr, uid);
+	m3_setAddress(uid, adr);
+	loco_call(adr, true);	// take the new loco into the refresh list
+	log_msg(LOG_INFO, "%s(): UID 0x%08lx -> ADR %d\n", __func__, uid, adr);
+}
+
+/**
+ * Find all m3 decoders on the main track that have no loco address yet and
+ * assign an address to each of them. The addresses are sent as soon as a
+ * decoder is found, so it does not take part in the rest of the search.
+ *
+ * \param uids	an array that receives the UIDs of the decoders found (may be NULL)
+ * \param max	the maximum number of decoders to find (and the size of the array)
+ * \return		the number of decoders found or a negative error code
+ */
+int m3_discover (uint32_t *uids, int max)
+{
+	return sig_scanM3Locos(uids, max, m3_assign);
+}
@@ -0,0 +1,269 @@
+/*
+ * m3scan.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Enumeration of all unregistered m3 decoders with a binary tree search
+ *
+ * A search packet asks all decoders without a track address, if the first
+ * \e len bits of their UID match the given UID. Every matching decoder
+ * answers in the same reply window, so we only learn if there is at least one
+ * decoder with this prefix.
+ *
+ * The search keeps a stack of prefixes that are known to match. A prefix is
+ * explored by asking for all its sub prefixes at once (two for one more bit
+ * or four for two more bits, if the query slots are available). Every sub
+ * prefix that is acknowledged is pushed to the stack, so both branches of the
+ * tree are covered. A prefix of 32 bits is a complete UID.
+ *
+ * The queries are independent of each other and so can be kept in flight
+ * together. This way the signal generator always has the next search packet
+ * ready and the tree is descended by one or two bits per round trip.
+ *
+ * If none of the sub prefixes is acknowledged although the prefix matched, an
+ * answer was lost (or the decoder was just registered) and the prefix is asked
+ * again up to M3S_RETRIES times. A lost answer in a group where another sub
+ * prefix was acknowledged cannot be detected. Therefor a new pass is started
+ * with the empty prefix as long as the previous pass found any decoder.
+ *
+ * The search only works on the query slots and the replies that signal.c
+ * hands over, it never touches the track itself. Tests/m3scan_test.c uses
+ * this to run it against decoders simulated in a FIFO.
+ */
+
+#include <string.h>
+#include "m3scan.h"
+
+static uint32_t m3s_mask (int len)
+{
+	return (len <= 0) ? 0 : (0xFFFFFFFFu << (32 - len));
+}
+
+/**
+ * Check if a prefix covers a decoder that was already found. Such a decoder
+ * got its track address and does not answer any more.
+ */
+static bool m3s_covered (const struct m3s_scan *s, uint32_t uid, int len)
+{
+	int i;
+
+	for (i = 0; i < s->nfound; i++) {
+		if (((s->found[i] ^ uid) & m3s_mask(len)) == 0) return true;
+	}
+	return false;
+}
+
+static void m3s_push (struct m3s_scan *s, uint32_t uid, int len, int retry)
+{
+	if (s->sp >= M3S_STACK) {
+		s->overflow = true;
+		return;
+	}
+	s->stack[s->sp].uid = uid & m3s_mask(len);
+	s->stack[s->sp].len = len;
+	s->stack[s->sp].retry = retry;
+	s->sp++;
+}
+
+static void m3s_pass (struct m3s_scan *s)
+{
+	s->passes++;
+	s->again = false;
+	s->grp[0].pending = 1;
+	s->grp[0].hit = false;
+	s->grp[0].root = true;
+	s->q[0].uid = 0;
+	s->q[0].len = 0;
+	s->q[0].state = M3S_QTOSEND;
+	s->q[0].grp = 0;
+}
+
+static bool m3s_idle (const struct m3s_scan *s)
+{
+	int i;
+
+	for (i = 0; i < M3S_INFLIGHT; i++) {
+		if (s->q[i].state != M3S_QFREE) return false;
+	}
+	return s->sp == 0;
+}
+
+/**
+ * Prepare a scan. The first query asks if there is any unregistered decoder
+ * at all.
+ *
+ * \param s			the scan
+ * \param maxfound	stop after this number of decoders (0 or more than M3S_MAXFOUND = M3S_MAXFOUND)
+ */
+void m3s_init (struct m3s_scan *s, int maxfound)
+{
+	memset (s, 0, sizeof(*s));
+	s->maxfound = (maxfound <= 0 || maxfound > M3S_MAXFOUND) ? M3S_MAXFOUND : maxfound;
+	m3s_pass(s);
+}
+
+/**
+ * Get the next query to send. Call this function until it returns -1 and
+ * queue a search packet for every query.
+ *
+ * \param s			the scan
+ * \param uid		where to store the UID to compare
+ * \param len		where to store the number of bits to compare
+ * \return			the tag of the query for m3s_answer() or -1 if there is nothing to send now
+ */
+int m3s_next (struct m3s_scan *s, uint32_t *uid, int *len)
+{
+	struct m3s_node n;
+	struct m3s_group *g;
+	int i, k, free, grp, cnt;
+
+	if (s->nfound >= s->maxfound) return -1;
+	if (s->again && s->passes < M3S_PASSES && m3s_idle(s)) m3s_pass(s);
+
+	for (;;) {
+		for (i = 0, free = 0; i < M3S_INFLIGHT; i++) {
+			if (s->q[i].state == M3S_QTOSEND) {
+				s->q[i].state = M3S_QSENT;
+				s->queries++;
+				*uid = s->q[i].uid;
+				*len = s->q[i].len;
+				return i;
+			}
+			if (s->q[i].state == M3S_QFREE) free++;
+		}
+
+		for (grp = 0; grp < M3S_INFLIGHT && s->grp[grp].pending; grp++) ;
+		if (s->sp == 0 || free < 2 || grp >= M3S_INFLIGHT) return -1;
+
+		// explore the topmost prefix - if it is the only one, try to descend more than one bit
+		n = s->stack[--s->sp];
+		k = 1;
+		if (s->sp == 0) {
+			while ((2 << k) <= free && n.len + k < 32) k++;
+		}
+		g = &s->grp[grp];
+		g->node = n;
+		g->pending = 1 << k;
+		g->hit = false;
+		g->root = false;
+		for (i = 0, cnt = 0; i < M3S_INFLIGHT && cnt < g->pending; i++) {
+			if (s->q[i].state != M3S_QFREE) continue;
+			s->q[i].uid = n.uid | ((uint32_t) cnt << (32 - n.len - k));
+			s->q[i].len = n.len + k;
+			s->q[i].grp = grp;
+			s->q[i].state = M3S_QTOSEND;
+			cnt++;
+		}
+	}
+}
+
+/**
+ * Process the answer to a query. A timeout counts as a negative answer.
+ *
+ * \param s			the scan
+ * \param tag		the tag of the query as returned by m3s_next()
+ * \param ack		true, if at least one decoder acknowledged the query
+ * \param uid		where to store the UID of a new decoder (may be NULL)
+ * \return			1 if a new decoder was found, 0 if not and -1 if the tag is invalid
+ */
+int m3s_answer (struct m3s_scan *s, int tag, bool ack, uint32_t *uid)
+{
+	struct m3s_query *q;
+	struct m3s_group *g;
+	int rc = 0, i;
+
+	if (tag < 0 || tag >= M3S_INFLIGHT || s->q[tag].state != M3S_QSENT) return -1;
+	q = &s->q[tag];
+	g = &s->grp[q->grp];
+	q->state = M3S_QFREE;
+
+	if (ack) {
+		g->hit = true;
+		if (g->root) s->again = true;
+		if (q->len < 32) {
+			m3s_push(s, q->uid, q->len, 0);
+		} else if (s->nfound < s->maxfound) {
+			for (i = 0; i < s->nfound && s->found[i] != q->uid; i++) ;
+			if (i >= s->nfound) {			// not a duplicate (i.e. after a repeated query)
+				s->found[s->nfound++] = q->uid;
+				if (uid) *uid = q->uid;
+				rc = 1;
+			}
+		}
+	}
+
+	if (g->pending > 0 && --g->pending == 0 && !g->hit && !g->root) {
+		// the prefix matched, but none of the sub prefixes - an answer got lost or the decoder was just registered
+		if (!m3s_covered(s, g->node.uid, g->node.len)) {
+			s->lost++;
+			if (g->node.retry < M3S_RETRIES) m3s_push(s, g->node.uid, g->node.len, g->node.retry + 1);
+		}
+	}
+	return rc;
+}
+
+/**
+ * Count the queries that wait for an answer.
+ *
+ * \param s			the scan
+ * \return			the number of queries sent but not answered
+ */
+int m3s_pending (const struct m3s_scan *s)
+{
+	int i, cnt;
+
+	for (i = cnt = 0; i < M3S_INFLIGHT; i++) {
+		if (s->q[i].state == M3S_QSENT) cnt++;
+	}
+	return cnt;
+}
+
+/**
+ * Give up waiting for the answers of all queries in flight (i.e. after
+ * a timeout). They are handled as negative answers.
+ *
+ * \param s			the scan
+ */
+void m3s_abort (struct m3s_scan *s)
+{
+	int i;
+
+	for (i = 0; i < M3S_INFLIGHT; i++) {
+		if (s->q[i].state == M3S_QSENT) m3s_answer(s, i, false, NULL);
+	}
+}
+
+/**
+ * Check if the scan is complete.
+ *
+ * \param s			the scan
+ * \return			true, if the last pass found nothing, all passes are done or enough decoders were found
+ */
+bool m3s_done (const struct m3s_scan *s)
+{
+	if (s->nfound >= s->maxfound) return true;
+	return m3s_idle(s) && (!s->again || s->passes >= M3S_PASSES);
+}
@@ -0,0 +1,229 @@
+/*
+ * owner.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief The ownership of locos by the clients of the throttle interfaces
+ *
+ * A client is identified by a 16 bit token with the interface in the upper
+ * and the number of the client inside this interface in the lower byte.
+ * Internal callers (automation, consists, ...) use OWN_ANONYMOUS and are never
+ * checked.
+ *
+ * The ownership state is embedded in the entry of the refresh list, so the
+ * check on the command path costs nothing but the lookup of the loco.
+ *
+ * A loco can be taken over by another client in three ways:
+ *   - the owner released or dispatched the loco or did not send a command
+ *     for OWN_LEASE ms (no one is informed, except after an expired lease)
+ *   - the owner acquired the loco in share mode (the owner stays the same)
+ *   - the loco is stolen (the previous owner is reported with OWN_TAKEN)
+ *
+ * A dispatched loco (LocoNet DISPATCH PUT or the Z21 LAN_LOCONET_DISPATCH_ADDR)
+ * has no owner and is given to the next client that acquires or commands it.
+ *
+ * The table is kept by loco.c under the loco lock and owner.c does no
+ * locking of its own. The competing throttles in Tests/locoowner_test.c
+ * drive it through loco.c for that reason.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "owner.h"
+
+/**
+ * Check if the owner did not send any command for OWN_LEASE ms.
+ *
+ * \param e			the ownership state of the loco
+ * \param now		the current time in ms
+ * \return			true, if the loco may be taken over without asking
+ */
+bool own_expired (const struct own_entry *e, uint32_t now)
+{
+	return (int32_t) (now - e->last) >= OWN_LEASE;
+}
+
+static enum own_result own_take (struct own_entry *e, uint16_t who, bool shared, uint32_t now)
+{
+	enum own_result rc;
+
+	rc = (e->owner != OWN_ANONYMOUS && !e->dispatched) ? OWN_TAKEN : OWN_OK;
+	e->prev = e->owner;
+	e->owner = who;
+	e->shared = shared;
+	e->dispatched = false;
+	e->last = now;
+	return rc;
+}
+
+/**
+ * Ask for the control of a loco.
+ *
+ * \param e			the ownership state of the loco
+ * \param who		the client asking for the loco
+ * \param mode		how the loco is requested
+ * \param now		the current time in ms
+ * \return			OWN_OK or OWN_TAKEN (e->prev is the client that lost the loco) if the client
+ * 					may control the loco, OWN_DENIED if the loco belongs to someone else
+ */
+enum own_result own_acquire (struct own_entry *e, uint16_t who, enum own_mode mode, uint32_t now)
+{
+	if (!e || who == OWN_ANONYMOUS) return OWN_OK;
+
+	if (e->owner == who) {
+		if (mode == OWN_SHARE) e->shared = true;
+		else if (mode == OWN_STEAL) e->shared = false;
+		e->last = now;
+		return OWN_OK;
+	}
+	if (e->owner == OWN_ANONYMOUS || e->dispatched) return own_take(e, who, mode == OWN_SHARE, now);
+
+	switch (mode) {
+		case OWN_STEAL:
+			return own_take(e, who, false, now);
+		case OWN_SHARE:
+			if (own_expired(e, now)) return own_take(e, who, true, now);
+			e->shared = true;
+			return OWN_OK;
+		case OWN_ACQUIRE:
+		default:
+			if (own_expired(e, now)) return own_take(e, who, false, now);
+			return (e->shared) ? OWN_OK : OWN_DENIED;
+	}
+}
+
+/**
+ * Check a command of a client on the command path. The policy decides
+ * what happens if the loco belongs to someone else.
+ *
+ * \param e			the ownership state of the loco
+ * \param who		the client sending the command
+ * \param policy	the global ownership policy
+ * \param now		the current time in ms
+ * \return			OWN_OK or OWN_TAKEN if the command may be executed, OWN_DENIED if not
+ */
+enum own_result own_command (struct own_entry *e, uint16_t who, enum own_policy policy, uint32_t now)
+{
+	switch (policy) {
+		case OWN_POLICY_EXCLUSIVE:	return own_acquire(e, who, OWN_ACQUIRE, now);
+		case OWN_POLICY_SHARE:		return own_acquire(e, who, OWN_SHARE, now);
+		case OWN_POLICY_STEAL:
+		default:					return own_acquire(e, who, OWN_STEAL, now);
+	}
+}
+
+/**
+ * Give up the control of a loco. Only the owner (or an internal caller)
+ * can release a loco.
+ *
+ * \param e			the ownership state of the loco
+ * \param who		the client releasing the loco
+ * \return			OWN_OK if the loco is free now, OWN_DENIED if it belongs to someone else
+ */
+enum own_result own_release (struct own_entry *e, uint16_t who)
+{
+	if (!e) return OWN_OK;
+	if (who != OWN_ANONYMOUS && e->owner != who) return OWN_DENIED;
+	e->prev = e->owner;
+	e->owner = OWN_ANONYMOUS;
+	e->shared = false;
+	e->dispatched = false;
+	return OWN_OK;
+}
+
+/**
+ * Dispatch a loco (put it to the dispatch stack). The loco has no owner
+ * afterwards and is given to the next client that asks for it.
+ *
+ * \param e			the ownership state of the loco
+ * \param who		the client dispatching the loco
+ * \return			OWN_OK if the loco is dispatched, OWN_DENIED if it belongs to someone else
+ */
+enum own_result own_put (struct own_entry *e, uint16_t who)
+{
+	if (!e) return OWN_OK;
+	if (who != OWN_ANONYMOUS && e->owner != who && e->owner != OWN_ANONYMOUS && !e->dispatched) return OWN_DENIED;
+	if (!e->dispatched) e->prev = e->owner;
+	e->owner = OWN_ANONYMOUS;
+	e->shared = false;
+	e->dispatched = true;
+	return OWN_OK;
+}
+
+static const char *ifcnames[] = { "none", "WEB", "Z21", "P50x", "LocoNet", "XpressNet", "EasyNet", "MCAN", "BiDiB", "Sniffer" };
+
+/**
+ * Describe a client for logging and the WEB interface.
+ *
+ * \param who		the client
+ * \param buf		where to store the description
+ * \param size		the size of the buffer
+ * \return			the length of the description
+ */
+int own_describe (uint16_t who, char *buf, int size)
+{
+	unsigned ifc;
+	int len;
+
+	if (!buf || size <= 0) return 0;
+	ifc = OWN_IFC(who);
+	if (ifc >= sizeof(ifcnames) / sizeof(ifcnames[0])) len = snprintf (buf, size, "IF%u#%u", ifc, OWN_CLIENT(who));
+	else if (who == OWN_ANONYMOUS) len = snprintf (buf, size, "%s", ifcnames[0]);
+	else len = snprintf (buf, size, "%s#%u", ifcnames[ifc], OWN_CLIENT(who));
+	return (len < size) ? len : size - 1;
+}
+
+static const char *policies[] = { "steal", "exclusive", "share" };
+
+/**
+ * Translate a policy to the string stored in the configuration.
+ *
+ * \param policy	the policy
+ * \return			a string describing the policy
+ */
+const char *own_policy2string (enum own_policy policy)
+{
+	if ((unsigned) policy >= sizeof(policies) / sizeof(policies[0])) policy = OWN_POLICY_STEAL;
+	return policies[policy];
+}
+
+/**
+ * Translate a string from the configuration to a policy.
+ *
+ * \param s			the string
+ * \return			the policy, OWN_POLICY_STEAL if the string is unknown
+ */
+enum own_policy own_string2policy (const char *s)
+{
+	unsigned i;
+
+	if (!s) return OWN_POLICY_STEAL;
+	for (i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+		if (!strcasecmp(s, policies[i])) return (enum own_policy) i;
+	}
+	return OWN_POLICY_STEAL;
+}
@@ -0,0 +1,167 @@
+/*
+ * ramp.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Acceleration and braking curves (momentum) simulated by the command station
+ *
+ * The speed of a loco is given in the same notation as in the refresh list:
+ * the speed step in bits 0 .. 6 and the direction in bit 7 (set = forward).
+ *
+ * A ramp moves the current speed one step at a time towards the target speed.
+ * The time for a step is taken from the acceleration or deceleration time of
+ * the profile, which covers the whole range from stop to full speed. The curve
+ * distributes this time over the speed steps. A change of direction always
+ * brakes down to zero first and then accelerates in the new direction.
+ *
+ * The elapsed time is accumulated, so the result does not depend on the tick
+ * of the caller and no time is lost, if a step is shorter than the tick.
+ *
+ * The caller passes the elapsed time in ms, so no timer or tick count is
+ * read here. Tests/ramp_test.c steps the curves with varying tick lengths
+ * and compares the totals.
+ */
+
+#include <string.h>
+#include <strings.h>
+#include "ramp.h"
+
+/**
+ * Check if a profile has any momentum at all.
+ *
+ * \param p			the momentum profile
+ * \return			true, if speed changes must be ramped
+ */
+bool ramp_active (const struct ramp_profile *p)
+{
+	return p && (p->accel || p->decel);
+}
+
+/**
+ * The weight of all speed steps from 0 up to (but not including) the given
+ * speed. The weight of a single step is 1 for a linear ramp, (2 * maxspeed - speed)
+ * for a soft ramp and (maxspeed + speed) for an express ramp.
+ */
+static uint32_t ramp_weight (enum ramp_curve curve, int maxspeed, int speed)
+{
+	switch (curve) {
+		case RAMP_SOFT:		return 2 * maxspeed * speed - speed * (speed - 1) / 2;
+		case RAMP_EXPRESS:	return maxspeed * speed + speed * (speed - 1) / 2;
+		default:			return speed;
+	}
+}
+
+/**
+ * Calculate the time of a single speed step.
+ *
+ * \param p			the momentum profile
+ * \param maxspeed	the number of speed steps of the decoder (14, 27, 28, 126)
+ * \param speed		the lower speed step of the transition (0 .. maxspeed - 1), i.e. 4 for 4 -> 5 and 5 -> 4
+ * \param accel		true for an acceleration, false for braking
+ * \return			the time for this step in ms
+ */
+uint32_t ramp_stepTime (const struct ramp_profile *p, int maxspeed, int speed, bool accel)
+{
+	uint32_t t, w;
+
+	if (!p || maxspeed <= 0) return 0;
+	t = accel ? p->accel : p->decel;
+	if (t > RAMP_MAXTIME) t = RAMP_MAXTIME;
+	if (speed < 0) speed = 0;
+	if (speed >= maxspeed) speed = maxspeed - 1;
+	w = ramp_weight(p->curve, maxspeed, maxspeed);
+	// the difference of the accumulated times, so the steps add up to exactly the time of the whole ramp
+	return t * ramp_weight(p->curve, maxspeed, speed + 1) / w - t * ramp_weight(p->curve, maxspeed, speed) / w;
+}
+
+/**
+ * Move the current speed towards the target speed for the time that elapsed
+ * since the last call.
+ *
+ * \param p			the momentum profile
+ * \param maxspeed	the number of speed steps of the decoder
+ * \param current	the current speed, updated by this function
+ * \param target	the target speed
+ * \param acc		the accumulated time in ms that was not yet used for a step (zero when starting a new ramp)
+ * \param dt		the time in ms that elapsed since the last call
+ * \return			true, if the target speed is not yet reached
+ */
+bool ramp_advance (const struct ramp_profile *p, int maxspeed, int *current, int target, uint32_t *acc, uint32_t dt)
+{
+	int cur, speed, tspeed;
+	bool up;
+	uint32_t t;
+
+	cur = *current;
+	*acc += dt;
+	while (cur != target) {
+		if ((cur & 0x7F) == 0 && ((cur ^ target) & 0x80)) {		// standing still - a change of direction costs no time
+			cur = target & 0x80;
+			continue;
+		}
+		speed = cur & 0x7F;
+		tspeed = ((cur ^ target) & 0x80) ? 0 : target & 0x7F;	// brake to zero before the direction can be changed
+		up = tspeed > speed;
+		t = ramp_stepTime(p, maxspeed, up ? speed : speed - 1, up);
+		if (*acc < t) break;
+		*acc -= t;
+		cur = (cur & 0x80) | (up ? speed + 1 : speed - 1);
+	}
+	if (cur == target) *acc = 0;
+	*current = cur;
+	return cur != target;
+}
+
+static const char *curves[] = { "linear", "soft", "express" };
+
+/**
+ * Translate a curve to the string stored in the loco database.
+ *
+ * \param curve		the curve
+ * \return			a string describing the curve
+ */
+const char *ramp_curve2string (enum ramp_curve curve)
+{
+	if ((unsigned) curve >= sizeof(curves) / sizeof(curves[0])) curve = RAMP_LINEAR;
+	return curves[curve];
+}
+
+/**
+ * Translate a string from the loco database to a curve.
+ *
+ * \param s			the string
+ * \return			the curve, RAMP_LINEAR if the string is unknown
+ */
+enum ramp_curve ramp_string2curve (const char *s)
+{
+	unsigned i;
+
+	if (!s) return RAMP_LINEAR;
+	for (i = 0; i < sizeof(curves) / sizeof(curves[0]); i++) {
+		if (!strcasecmp(s, curves[i])) return (enum ramp_curve) i;
+	}
+	return RAMP_LINEAR;
+}
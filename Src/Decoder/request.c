@@ -43,10 +43,18 @@
  *   - MCan
  *   - Sniffer
  *   - HTML client
+ *
+ * Before a speed or function request is forwarded, the client that sent it
+ * (see loco_setClient()) is checked against the owner of the loco. An
+ * emergency stop is always executed, whoever owns the loco.
+ *
+ * All requests are reported to the session recorder (see session.c) as they
+ * come in, regardless if they are executed or not.
  */
 
 #include "rb2.h"
 #include "bidib.h"
+#include "session.h"
 
 #define FILTER		1	/* deactive the filter for now (WDP) */
 
@@ -93,13 +101,15 @@ static int rq_csDriveManual (ldataT *l, uint8_t active, int speed, uint32_t newf
  * \param adr		the loco address we wish to control
  * \param newfuncs	the new function bits for F0 to F31 max.
  * \param mask		a mask that defines which functions to set
- * \return			0 if everything is OK, an errorcode otherwise
+ * \return			0 if everything is OK, an errorcode otherwise (-2 if the loco is owned by another client)
  */
 int rq_setFuncMasked (int adr, uint32_t newfuncs, uint32_t mask)
 {
 	ldataT *l;
 	uint8_t active;
 
+	sess_record(SESS_FUNC, adr, newfuncs, mask);
+	if (!loco_checkOwner(adr)) return -2;
 	if (FILTER && bidib_opmode() == BIDIB_SERVER) {
 		if ((l = loco_call(adr, true)) == NULL) return -1;
 		if ((l->funcs[0] & mask) == (newfuncs & mask)) return 0;
@@ -116,18 +126,46 @@ int rq_setFuncMasked (int adr, uint32_t newfuncs, uint32_t mask)
 	return 0;
 }
 
+/**
+ * Request the setting of a group of consecutive functions from external
+ * control. Groups that lie within F0 to F31 are handled by rq_setFuncMasked().
+ * Higher functions are always sent directly by loco_setFuncGroup() and are
+ * not reported to the session recorder, because a record only covers F0 to
+ * F31.
+ *
+ * \param adr		the loco address we wish to control
+ * \param first		the number of the first function in this group
+ * \param count		the number of functions in this group (1 .. 32)
+ * \param funcs		the new status of the functions with bit 0 representing the function 'first'
+ * \return			0 if everything is OK, an errorcode otherwise (-2 if the loco is owned by another client)
+ */
+int rq_setFuncGroup (int adr, int first, int count, uint32_t funcs)
+{
+	uint32_t mask;
+
+	if (first < 0 || count <= 0 || count > 32) return -1;
+	if (first + count <= 32) {
+		mask = (count < 32) ? (1u << count) - 1 : 0xFFFFFFFF;
+		return rq_setFuncMasked(adr, (funcs & mask) << first, mask << first);
+	}
+	if (!loco_checkOwner(adr)) return -2;
+	return loco_setFuncGroup(adr, first, count, funcs);
+}
+
 /**
  * Request a speed change from external control and forward it either
  * to BiDiB or directly to the system function.
  *
  * \param adr		the loco address we wish to control
  * \param speed		the new speed that should be set
- * \return			0 if everything is OK, an errorcode otherwise
+ * \return			0 if everything is OK, an errorcode otherwise (-2 if the loco is owned by another client)
  */
 int rq_setSpeed (int adr, int speed)
 {
 	ldataT *l;
 
+	sess_record(SESS_SPEED, adr, speed, 0);
+	if (!loco_checkOwner(adr)) return -2;
 	if (FILTER && bidib_opmode() == BIDIB_SERVER) {
 		if ((l = loco_call(adr, true)) == NULL) return -1;
 		if (l->speed == speed) return 0;
@@ -149,6 +187,7 @@ int rq_emergencyStop (int adr)
 {
 	ldataT *l;
 
+	sess_record(SESS_ESTOP, adr, 0, 0);
 	if (FILTER && bidib_opmode() == BIDIB_SERVER) {
 		if ((l = loco_call(adr, true)) == NULL) return -1;
 		return rq_csDriveManual(l, BIDIB_CS_DRIVE_SPEED_BIT, (l->speed & 0x80) | 1, l->funcs[0]);
@@ -29,6 +29,7 @@
 #include "config.h"
 #include "decoder.h"
 #include "events.h"
+#include "session.h"
 
 #define TURNOUTS_PER_GROUP		4		///< a decoder controls four turnouts as a group
 #define TURNOUT_MIN_TIME		100		///< minimum switching time in ms
@@ -341,6 +342,7 @@ static int _trnt_switch (int adr, bool thrown, bool on, TickType_t tim)
 	struct trnt_command tc;
 	turnoutT *t;
 
+	sess_record(SESS_TURNOUT, adr, (thrown ? 1 : 0) | (on ? 2 : 0), tim);
 	if ((t = db_lookupTurnout(adr)) != NULL && t->fmt== TFMT_BIDIB) return _trnt_BiDiB(t, thrown);
 	if (adr <= 0 || adr > MAX_TURNOUT) return -1;
 	if (rt.tm != TM_HALT && rt.tm != TM_GO) return -3;	// track not supplied - ignore call
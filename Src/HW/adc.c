@@ -382,7 +382,7 @@ void vAnalog (void *pvParameter)
 //					log_msg (LOG_WARNING, "Uin = %d.%03d\n", uin_unfiltered / 1000, uin_unfiltered % 1000);
 					if(pwr == 0) power_state = MAINBST_ISON();
 					pwr++;
-					if (pwr == 3) sig_setMode(TM_SHORT);
+					if (pwr == 3) ts_reportShort(BSV_SRC_SUPPLY);
 					if (pwr >= 40) pwrfail();
 //					pwr_ok = false;
 				} else {
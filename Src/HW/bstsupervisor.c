@@ -0,0 +1,256 @@
+/*
+ * bstsupervisor.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Booster supervision: current capture, short statistics and restart strategy
+ *
+ * The track current is sampled every millisecond and kept in a history ring.
+ * When the current crosses the configured trigger level or a short is reported
+ * by any source, a capture is started. It contains the samples before the trigger
+ * (pre-trigger) that are taken from the history ring and the samples after the
+ * trigger (post-trigger) that are recorded as they come in.
+ *
+ * Shorts are counted per source and time stamped. If an automatic restart is
+ * configured, each short yields a delay after which the booster should be
+ * switched on again. The delay is doubled with every consecutive retry up
+ * to a maximum. After the configured number of retries the supervisor gives
+ * up and the user has to switch on manually. If no short occured for the
+ * configured stable time, the retry counter starts over.
+ *
+ * The booster state and the current samples are handed in by tracksupply.c,
+ * which also switches the output. That leaves a pure state machine that
+ * Tests/bstsupervisor_test.c feeds with made up short circuits.
+ */
+
+#include <string.h>
+#include "bstsupervisor.h"
+
+/**
+ * Setup a configuration with default values.
+ *
+ * \param cnf		the configuration to initialise
+ */
+void bsv_defaults (struct bsv_config *cnf)
+{
+	if (!cnf) return;
+
+	memset (cnf, 0, sizeof(*cnf));
+	cnf->trigger = 0;					// capture only on shorts
+	cnf->pre = 100;
+	cnf->post = 50;
+	cnf->restart = BSV_RESTART_MANUAL;
+	cnf->retries = 3;
+	cnf->delay = 1000;
+	cnf->maxdelay = 10000;
+	cnf->stable = 30000;
+}
+
+/**
+ * Initialise the runtime state of the supervisor.
+ *
+ * \param b			the supervisor to initialise
+ * \param cnf		the configuration to use (must stay valid as long as the supervisor is used)
+ */
+void bsv_init (struct bsv *b, const struct bsv_config *cnf)
+{
+	if (!b) return;
+
+	memset (b, 0, sizeof(*b));
+	b->cnf = cnf;
+}
+
+static void bsv_finishCapture (struct bsv *b)
+{
+	struct bsv_capture *c;
+	uint32_t start;
+	int i;
+
+	if ((c = b->active) == NULL) return;
+	start = b->trigpos - c->pre;
+	c->peak = 0;
+	for (i = 0; i < c->count; i++) {
+		c->samples[i] = b->ring[(start + i) & (BSV_RINGSIZE - 1)];
+		if (c->samples[i] > c->peak) c->peak = c->samples[i];
+	}
+	b->active = NULL;
+}
+
+/**
+ * Start a new capture. If a capture is already running, no new capture
+ * is started. If the running capture was started by an overcurrent and
+ * now a real short is reported, the capture is attributed to the short.
+ *
+ * \param b			the supervisor
+ * \param now		the current time in ms
+ * \param src		the source of the trigger
+ * \return			true, if a new capture was started
+ */
+bool bsv_trigger (struct bsv *b, uint32_t now, enum bsv_source src)
+{
+	struct bsv_capture *c;
+	uint32_t pre;
+	int post;
+
+	if (!b || !b->cnf) return false;
+	if (b->active) {
+		if (b->active->source == BSV_SRC_OVERCURRENT) b->active->source = src;
+		return false;
+	}
+
+	pre = b->cnf->pre;
+	if (pre > BSV_MAXPRE) pre = BSV_MAXPRE;
+	if (pre > b->count) pre = b->count;
+	post = b->cnf->post;
+	if (post > BSV_MAXPOST) post = BSV_MAXPOST;
+	if (post < 1) post = 1;
+
+	c = &b->cap[b->seq % BSV_CAPTURES];
+	memset (c, 0, sizeof(*c));
+	c->seq = ++b->seq;
+	c->ts = now;
+	c->source = src;
+	c->pre = pre;
+	c->count = pre + post;
+	b->trigpos = b->count;
+	b->post = post;
+	b->active = c;
+	return true;
+}
+
+/**
+ * Feed a new current sample to the supervisor. This should be called every
+ * millisecond.
+ *
+ * \param b			the supervisor
+ * \param now		the current time in ms
+ * \param ma		the measured current in mA
+ * \return			true, if a capture was completed with this sample
+ */
+bool bsv_sample (struct bsv *b, uint32_t now, int ma)
+{
+	uint32_t dur;
+
+	if (!b || !b->cnf) return false;
+	if (ma < 0) ma = 0;
+	if (ma > 0xFFFF) ma = 0xFFFF;
+
+	b->ring[b->count & (BSV_RINGSIZE - 1)] = ma;
+	b->count++;
+
+	if (b->cnf->trigger) {
+		if (!b->over && ma > b->cnf->trigger) {
+			b->over = true;
+			b->overstart = now;
+			bsv_trigger(b, now, BSV_SRC_OVERCURRENT);
+		} else if (b->over && ma <= b->cnf->trigger) {
+			b->over = false;
+			dur = now - b->overstart;
+			b->stats.overcurrent += dur;
+			if (dur > b->stats.longest) b->stats.longest = dur;
+		}
+	}
+
+	if (b->active && (int) (b->count - b->trigpos) >= b->post) {
+		bsv_finishCapture(b);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Report a short. The short is counted, a capture is started and the
+ * restart strategy is applied.
+ *
+ * \param b			the supervisor
+ * \param now		the current time in ms
+ * \param src		the source of the short
+ * \return			the delay in ms after which the booster should be restarted or
+ * 					-1 if no automatic restart should be done
+ */
+int bsv_short (struct bsv *b, uint32_t now, enum bsv_source src)
+{
+	uint32_t delay, prev;
+	bool first;
+	int i;
+
+	if (!b || !b->cnf || src >= BSV_SRC_COUNT) return -1;
+
+	for (i = 0, first = true; i < BSV_SRC_COUNT; i++) {
+		if (b->stats.shorts[i]) first = false;
+	}
+	prev = b->stats.last;
+	b->stats.shorts[src]++;
+	if (first) b->stats.first = now;
+	b->stats.last = now;
+	bsv_trigger(b, now, src);
+
+	if (b->cnf->restart != BSV_RESTART_AUTO) return -1;
+	if (!first && (now - prev) >= b->cnf->stable) b->retry = 0;
+	if (b->retry >= b->cnf->retries) {
+		b->stats.giveups++;
+		b->retry = 0;					// next manual GO starts a new series of retries
+		return -1;
+	}
+	delay = (uint32_t) b->cnf->delay << b->retry;
+	if (delay > b->cnf->maxdelay) delay = b->cnf->maxdelay;
+	b->retry++;
+	return delay;
+}
+
+/**
+ * Account for an automatic restart that was really executed.
+ *
+ * \param b			the supervisor
+ */
+void bsv_restarted (struct bsv *b)
+{
+	if (b) b->stats.restarts++;
+}
+
+/**
+ * Get one of the completed captures.
+ *
+ * \param b			the supervisor
+ * \param idx		the index of the capture (0 = the newest one)
+ * \return			the capture or NULL if there is no such capture
+ */
+const struct bsv_capture *bsv_getCapture (const struct bsv *b, int idx)
+{
+	uint32_t seq;
+
+	if (!b || idx < 0 || idx >= BSV_CAPTURES) return NULL;
+	seq = b->seq;
+	if (b->active) seq--;				// the active capture is not complete yet
+	if ((uint32_t) idx >= seq) return NULL;
+	if (b->active && idx >= BSV_CAPTURES - 1) return NULL;	// the oldest slot is already reused by the active capture
+	return &b->cap[(seq - 1 - idx) % BSV_CAPTURES];
+}
+
+void bsv_clearStats (struct bsv *b)
+{
+	if (b) memset (&b->stats, 0, sizeof(b->stats));
+}
@@ -0,0 +1,439 @@
+/*
+ * dispmgr.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Display manager for the two digit seven-segment display
+ *
+ * All parties that want to show something on the display post their messages
+ * to one of the layers (see enum dm_layer). Only the highest active layer is
+ * shown, so a SHORT alert cannot be overwritten by the track current and the
+ * service menu is not disturbed by status changes. When a layer is cleared
+ * or its timeout expires, the next lower active layer becomes visible again.
+ *
+ * Messages with more than two digits are scrolled through the display,
+ * messages may blink. dm_render() calculates the segments to show and the
+ * time when the display changes by itself (blinking, scrolling, timeouts),
+ * so there is no need to poll.
+ *
+ * The service menu is a small state machine that turns key presses into
+ * actions. Executing these actions is left to the caller.
+ *
+ * Segment patterns use bit 0 for segment 'a' up to bit 6 for segment 'g'
+ * and bit 7 for the decimal point.
+ *
+ * The segment patterns are only computed here, seven_segment.c shifts them
+ * out to the display. dm_toAscii() renders a pattern as text, so
+ * Tests/dispmgr_test.c can compare what the user would see.
+ */
+
+#include <string.h>
+#include "dispmgr.h"
+
+static const uint8_t digits[] = {
+	0b0111111,		// 0
+	0b0000110,		// 1
+	0b1011011,		// 2
+	0b1001111,		// 3
+	0b1100110,		// 4
+	0b1101101,		// 5
+	0b1111101,		// 6
+	0b0000111,		// 7
+	0b1111111,		// 8
+	0b1101111,		// 9
+};
+
+static const uint8_t letters[] = {
+	0b1110111,		// A
+	0b1111100,		// b
+	0b0111001,		// C
+	0b1011110,		// d
+	0b1111001,		// E
+	0b1110001,		// F
+	0b0111101,		// G
+	0b1110110,		// H
+	0b0110000,		// I
+	0b0011110,		// J
+	0b1110110,		// K (same as H)
+	0b0111000,		// L
+	0b0110111,		// M (same as N)
+	0b1010100,		// n
+	0b1011100,		// o
+	0b1110011,		// P
+	0b1100111,		// q
+	0b1010000,		// r
+	0b1101101,		// S
+	0b1111000,		// t
+	0b0111110,		// U
+	0b0011100,		// v
+	0b0111110,		// W (same as U)
+	0b1110110,		// X (same as H)
+	0b1101110,		// y
+	0b1011011,		// Z (same as 2)
+};
+
+/**
+ * Get the segment pattern for a character. Letters are shown in the
+ * form that is best readable on a seven-segment display, regardless
+ * of upper or lower case. Unknown characters are shown as blank.
+ *
+ * \param c		the character to convert
+ * \return		the segment pattern
+ */
+uint8_t dm_charSegments (char c)
+{
+	if (c >= '0' && c <= '9') return digits[c - '0'];
+	if (c >= 'A' && c <= 'Z') return letters[c - 'A'];
+	if (c >= 'a' && c <= 'z') return letters[c - 'a'];
+	switch (c) {
+		case '-':	return 0b1000000;
+		case '_':	return 0b0001000;
+		case '=':	return 0b1001000;
+		case '?':	return 0b1010011;
+		case '|':	return 0b0110000;
+	}
+	return 0;
+}
+
+/**
+ * Convert a string to segment patterns. A dot is merged into the preceding
+ * character as decimal point.
+ *
+ * \param s		the string to convert
+ * \param seg	where to store the segment patterns
+ * \param max	the maximum number of patterns to store
+ * \return		the number of patterns stored
+ */
+int dm_encode (const char *s, uint8_t *seg, int max)
+{
+	int n = 0;
+
+	if (!s || !seg) return 0;
+	while (*s && n < max) {
+		if (*s == '.' && n > 0 && !(seg[n - 1] & DM_SEG_DP)) {
+			seg[n - 1] |= DM_SEG_DP;
+		} else if (*s == '.') {
+			seg[n++] = DM_SEG_DP;
+		} else {
+			seg[n++] = dm_charSegments(*s);
+		}
+		s++;
+	}
+	return n;
+}
+
+void dm_init (struct dispmgr *d)
+{
+	if (d) memset (d, 0, sizeof(*d));
+}
+
+static struct dm_msg *dm_prepare (struct dispmgr *d, enum dm_layer l, int blink, uint32_t timeout, uint32_t now)
+{
+	struct dm_msg *m;
+
+	if (!d || l >= DM_LAYERS) return NULL;
+	m = &d->layer[l];
+	memset (m, 0, sizeof(*m));
+	m->active = true;
+	m->blink = (blink > 0) ? blink : 0;
+	m->step = DM_SCROLLSTEP;
+	m->start = now;
+	m->timeout = timeout;
+	return m;
+}
+
+/**
+ * Show raw segment patterns on a layer.
+ *
+ * \param d			the display manager
+ * \param l			the layer
+ * \param left		the pattern for the left digit
+ * \param right		the pattern for the right digit
+ * \param blink		the blink period in ms (0 = steady)
+ * \param timeout	the time in ms after which the message is removed (0 = never)
+ * \param now		the current time in ms
+ */
+void dm_setSegments (struct dispmgr *d, enum dm_layer l, uint8_t left, uint8_t right, int blink, uint32_t timeout, uint32_t now)
+{
+	struct dm_msg *m;
+
+	if ((m = dm_prepare(d, l, blink, timeout, now)) == NULL) return;
+	m->seg[0] = left;
+	m->seg[1] = right;
+	m->len = DM_DIGITS;
+}
+
+/**
+ * Show a text on a layer. Texts that are longer than the display are scrolled.
+ *
+ * \param d			the display manager
+ * \param l			the layer
+ * \param s			the text (see dm_encode())
+ * \param blink		the blink period in ms (0 = steady)
+ * \param timeout	the time in ms after which the message is removed (0 = never)
+ * \param now		the current time in ms
+ */
+void dm_setText (struct dispmgr *d, enum dm_layer l, const char *s, int blink, uint32_t timeout, uint32_t now)
+{
+	struct dm_msg *m;
+
+	if ((m = dm_prepare(d, l, blink, timeout, now)) == NULL) return;
+	m->len = dm_encode(s, m->seg, DM_MAXTEXT);
+	if (m->len < DM_DIGITS) m->len = DM_DIGITS;		// pad with blanks
+}
+
+/**
+ * Show a decimal number (0 .. 99) on a layer. A leading zero is suppressed
+ * unless the decimal point is requested.
+ *
+ * \param d			the display manager
+ * \param l			the layer
+ * \param n			the number to show (clipped to 0 .. 99)
+ * \param dp		if set, the decimal point is shown after the first digit
+ * \param timeout	the time in ms after which the message is removed (0 = never)
+ * \param now		the current time in ms
+ */
+void dm_setDecimal (struct dispmgr *d, enum dm_layer l, int n, bool dp, uint32_t timeout, uint32_t now)
+{
+	uint8_t left;
+
+	if (n >= 100) n = 99;
+	if (n < 0) n = 0;
+
+	if (n / 10 == 0 && !dp) {
+		left = 0;		// display as blank
+	} else {
+		left = digits[n / 10];
+		if (dp) left |= DM_SEG_DP;
+	}
+	dm_setSegments(d, l, left, digits[n % 10], 0, timeout, now);
+}
+
+void dm_clear (struct dispmgr *d, enum dm_layer l)
+{
+	if (d && l < DM_LAYERS) d->layer[l].active = false;
+}
+
+bool dm_isActive (const struct dispmgr *d, enum dm_layer l)
+{
+	if (!d || l >= DM_LAYERS) return false;
+	return d->layer[l].active;
+}
+
+/**
+ * Calculate the segments that should be shown on the display now.
+ * Expired messages are removed.
+ *
+ * \param d			the display manager
+ * \param now		the current time in ms
+ * \param seg		where to store the segment patterns for the display
+ * \return			the time in ms after which the display changes by itself
+ * 					or DM_FOREVER if the display stays as it is
+ */
+uint32_t dm_render (struct dispmgr *d, uint32_t now, uint8_t seg[DM_DIGITS])
+{
+	struct dm_msg *m;
+	uint32_t elapsed, next, t;
+	int l, i, pos;
+
+	memset (seg, 0, DM_DIGITS);
+	if (!d) return DM_FOREVER;
+
+	for (l = DM_LAYERS - 1; l >= 0; l--) {
+		m = &d->layer[l];
+		if (!m->active) continue;
+		elapsed = now - m->start;
+		if (m->timeout && elapsed >= m->timeout) {
+			m->active = false;
+			continue;
+		}
+		break;
+	}
+	if (l < 0) return DM_FOREVER;
+
+	next = (m->timeout) ? m->timeout - elapsed : DM_FOREVER;
+
+	pos = 0;
+	if (m->len > DM_DIGITS && m->step) {
+		pos = (elapsed / m->step) % (m->len + 1);		// scroll out completely before starting over
+		t = m->step - (elapsed % m->step);
+		if (t < next) next = t;
+	}
+	for (i = 0; i < DM_DIGITS; i++) {
+		seg[i] = (pos + i < m->len) ? m->seg[pos + i] : 0;
+	}
+
+	if (m->blink >= 2) {
+		t = elapsed % m->blink;
+		if (t >= m->blink / 2u) {
+			memset (seg, 0, DM_DIGITS);
+			t = m->blink - t;
+		} else {
+			t = m->blink / 2u - t;
+		}
+		if (t < next) next = t;
+	}
+	return next;
+}
+
+/**
+ * Draw segment patterns as ASCII art with three lines, i.e.
+ * <pre>
+ *  _  _
+ * |_  _|
+ *  _||_ .
+ * </pre>
+ *
+ * \param seg		the segment patterns
+ * \param n			the number of digits
+ * \param buf		where to store the (null terminated) text
+ * \param size		the size of the buffer (should be at least 3 * (4 * n + 1) + 1)
+ * \return			the length of the text or -1 if the buffer is too small
+ */
+int dm_toAscii (const uint8_t *seg, int n, char *buf, int size)
+{
+	char *p;
+	int line, i;
+
+	if (!seg || !buf || n < 0 || size < 3 * (4 * n + 1) + 1) return -1;
+	p = buf;
+	for (line = 0; line < 3; line++) {
+		for (i = 0; i < n; i++) {
+			switch (line) {
+				case 0:
+					*p++ = ' ';
+					*p++ = (seg[i] & 0x01) ? '_' : ' ';		// a
+					*p++ = ' ';
+					*p++ = ' ';
+					break;
+				case 1:
+					*p++ = (seg[i] & 0x20) ? '|' : ' ';		// f
+					*p++ = (seg[i] & 0x40) ? '_' : ' ';		// g
+					*p++ = (seg[i] & 0x02) ? '|' : ' ';		// b
+					*p++ = ' ';
+					break;
+				case 2:
+					*p++ = (seg[i] & 0x10) ? '|' : ' ';		// e
+					*p++ = (seg[i] & 0x08) ? '_' : ' ';		// d
+					*p++ = (seg[i] & 0x04) ? '|' : ' ';		// c
+					*p++ = (seg[i] & DM_SEG_DP) ? '.' : ' ';
+					break;
+			}
+		}
+		*p++ = '\n';
+	}
+	*p = 0;
+	return p - buf;
+}
+
+// ==============================================================================================
+// === the service menu =========================================================================
+// ==============================================================================================
+
+void dm_menuEnter (struct dm_menu *m, uint32_t now)
+{
+	if (!m) return;
+	m->active = true;
+	m->armed = false;
+	m->item = DM_ITEM_IP;
+	m->last = now;
+}
+
+/**
+ * Handle a key while the menu is active.
+ *
+ * \param m			the menu state
+ * \param k			the key that was pressed
+ * \param now		the current time in ms
+ * \return			the action that the caller should execute
+ */
+enum dm_action dm_menuKey (struct dm_menu *m, enum dm_key k, uint32_t now)
+{
+	if (!m || !m->active) return DM_ACT_NONE;
+	m->last = now;
+
+	switch (k) {
+		case DM_KEY_NEXT:
+			m->item = (m->item + 1) % DM_ITEMS;
+			m->armed = false;
+			return DM_ACT_NONE;
+		case DM_KEY_LEAVE:
+			m->active = false;
+			return DM_ACT_EXIT;
+		case DM_KEY_SELECT:
+			switch (m->item) {
+				case DM_ITEM_IP:		return DM_ACT_SHOWIP;
+				case DM_ITEM_BOOSTER:	return DM_ACT_BOOSTER;
+				case DM_ITEM_PROG:		return DM_ACT_PROG;
+				case DM_ITEM_SPEED:		return DM_ACT_SPEED;
+				case DM_ITEM_IPRESET:
+					if (!m->armed) {		// the first select only asks for confirmation
+						m->armed = true;
+						return DM_ACT_NONE;
+					}
+					m->armed = false;
+					return DM_ACT_IPRESET;
+				default:
+					m->active = false;
+					return DM_ACT_EXIT;
+			}
+	}
+	return DM_ACT_NONE;
+}
+
+/**
+ * Check if the menu should be left because no key was pressed for some time.
+ *
+ * \param m			the menu state
+ * \param now		the current time in ms
+ * \return			true, if the menu was active and is left now
+ */
+bool dm_menuTimeout (struct dm_menu *m, uint32_t now)
+{
+	if (!m || !m->active) return false;
+	if (now - m->last < DM_MENU_TIMEOUT) return false;
+	m->active = false;
+	return true;
+}
+
+/**
+ * Get the label of the current menu item.
+ *
+ * \param m			the menu state
+ * \return			the label to show on the display
+ */
+const char *dm_menuLabel (const struct dm_menu *m)
+{
+	if (!m) return "";
+	switch (m->item) {
+		case DM_ITEM_IP:		return "IP";
+		case DM_ITEM_BOOSTER:	return "bo";
+		case DM_ITEM_PROG:		return "Pr";
+		case DM_ITEM_IPRESET:	return (m->armed) ? "r?" : "rS";
+		case DM_ITEM_SPEED:		return "tS";
+	}
+	return "--";
+}
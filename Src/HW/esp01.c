@@ -30,6 +30,7 @@
 #include "rb2.h"
 #include "yaffsfs.h"
 #include "esp.h"
+#include "espnet.h"
 
 #define USART_BASE_CLOCK	100000000u				///< the base clock after the prescaler (DIV-1 -> 100MHz)
 #define BAUDRATE			230400
@@ -38,6 +39,7 @@
 static struct bootpacket rx;
 static struct bootpacket tx;
 static volatile bool do_update;
+static volatile bool netmode;						///< the application runs and the UART is used by espnet.c
 static enum slipstat rxst;
 static enum slipstat txst;
 
@@ -286,7 +288,13 @@ static void esp_update (void)
 	esp_resetApplication();
 }
 
-void esp_testthread (void *pvParameter)
+/**
+ * The thread that controls the ESP-01 module. After a reset of the module,
+ * the UART is handed over to the network interface (see espnet.c). For an
+ * update of the module, the network is stopped and the UART is used for the
+ * bootloader protocol.
+ */
+void esp_thread (void *pvParameter)
 {
 	uint8_t buf[128], *s, *end, c;
 	unsigned long rc;
@@ -301,6 +309,7 @@ void esp_testthread (void *pvParameter)
 	rxbuf = esp_allocbuffer(1024);
 	esp_inituart (BAUDRATE);
 	esp_resetApplication();
+	netmode = espnet_start();
 
 	log_msg(LOG_INFO, "%s() Started\n", __func__);
 
@@ -308,9 +317,15 @@ void esp_testthread (void *pvParameter)
 		rc = ulTaskNotifyTake(pdTRUE, 5000);
 		if (rc > 0) {
 			if (do_update) {
+				if (netmode) {
+					espnet_stop();
+					netmode = false;
+					esp_inituart (BAUDRATE);
+				}
 				esp_resetBootloader();
 				esp_update();
 				booting = false;
+				netmode = espnet_start();
 			} else if (booting) {
 				log_msg (LOG_INFO, "%s(): got packet from ESP-01 CMD=0x%02X len=%d %s ERRCode 0x%02x\n", __func__, rx.cmd,
 						rx.size, rx.data[rx.size - 2] ? "FAILURE" : "SUCCESS", rx.data[rx.size - 1]);
@@ -353,6 +368,11 @@ void USART6_IRQHandler (void)
 
 	BaseType_t xHigherPriorityTaskWoken = 0;
 
+	if (netmode) {
+		espnet_uartIRQ();
+		return;
+	}
+
 	// Step 1: receive characters from RX-FIFO (until FIFO is empty)
 	while ((USART6->CR3 & USART_CR3_RXFTIE) && (USART6->ISR & USART_ISR_RXNE_RXFNE)) {
 		c = USART6->RDR;
@@ -0,0 +1,480 @@
+/*
+ * espnet.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief The ESP-01 WLAN module as a second network interface
+ *
+ * The module runs the mc2wlan application, which bridges the ethernet
+ * frames between its WLAN station interface and the serial line. On our
+ * side, the serial line is a network interface "wl" of lwIP, so all
+ * services (WEB, Z21, P50x, netBiDiB, FTP) are reachable over WLAN, too.
+ * The framing and the flow control are found in espframe.c.
+ *
+ * USART6 runs at ESPNET_BAUDRATE and both directions are handled by DMA:
+ *   - DMA1 Stream5 (request usart6_rx) receives into a ring buffer in
+ *     circular mode. The half transfer and transfer complete interrupts
+ *     and the IDLE interrupt of the UART wake up the task, so a frame
+ *     is processed as soon as the line gets quiet. The interrupt counts
+ *     the half transfer and transfer complete events, so the task can tell
+ *     if the DMA has lapped the read position (see ef_ringWritten()). The
+ *     ring itself is read by ef_ringReceive(), which skips the lost data
+ *     and resynchronises the framer.
+ *   - DMA1 Stream4 (request usart6_tx) sends the encoded frames from a
+ *     transmit buffer. Frames from lwIP are queued and encoded one by one
+ *     whenever the previous transfer is complete.
+ *
+ * The interface is added to lwIP when the module reports its MAC address
+ * for the first time and always uses DHCP. The link state follows the
+ * WLAN state reported by the module.
+ *
+ * The USART6 interrupt is shared with the bootloader communication in
+ * esp01.c, which calls espnet_uartIRQ() as long as the network is running.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rb2.h"
+#include "espnet.h"
+#include "lwip/etharp.h"
+
+#define USART_BASE_CLOCK	100000000u				///< the base clock after the prescaler (DIV-1 -> 100MHz)
+#define ESPNET_BAUDRATE		2000000					///< the baudrate of the mc2wlan application on the module
+#define RXRING_SIZE			4096					///< the size of the receive ring buffer (must be a multiple of 32)
+#define TXBUF_SIZE			((EF_ENCODED_MAX + 64 + 31) & ~31)	///< room for a data frame with all bytes escaped and some control frames
+#define TXQUEUE_LEN			16						///< the number of frames from lwIP that may wait for transmission
+#define POLL_TIME			50						///< check the link and the flow control at least this often (ms)
+#define MIN_HEAP_FREE		(1024 * 1024)			///< minimum free heap for receiving further packets from the module
+
+#define DMAREQ_USART6_RX	71						///< DMAMUX1 request input for USART6 RX
+#define DMAREQ_USART6_TX	72						///< DMAMUX1 request input for USART6 TX
+
+static uint8_t rxring[RXRING_SIZE] __attribute__((aligned(32)));	///< the receive ring buffer for DMA
+static uint8_t txbuf[TXBUF_SIZE] __attribute__((aligned(32)));		///< the transmit buffer for DMA
+
+static struct ef_link wlan;				///< the state of the serial link to the module
+static TaskHandle_t task;
+static TaskHandle_t waiter;					///< the task that waits for the stop to be complete
+static QueueHandle_t txqueue;
+static volatile bool do_start;
+static volatile bool do_stop;
+static volatile bool running;
+static volatile bool txbusy;
+static struct ef_ring ring;					///< the receive ring and its read position
+static volatile uint32_t rxhalves;			///< the number of half transfer and transfer complete events of the receive DMA
+static uint8_t hwaddr[6];					///< the MAC address reported by the module
+
+/**
+ * Get the number of bytes the DMA has written to the receive ring so far.
+ */
+static uint32_t espnet_written (void *priv)
+{
+	uint32_t halves, written;
+
+	(void) priv;
+
+	do {
+		halves = rxhalves;
+		written = ef_ringWritten(halves, DMA1_Stream5->NDTR, RXRING_SIZE);
+	} while (halves != rxhalves);
+	return written;
+}
+
+static void espnet_invalidate (void *priv, const uint8_t *data, int len)
+{
+	(void) priv;
+
+	cache_invalidate((uint32_t) data, len);
+}
+
+static void espnet_hwInit (void)
+{
+	USART6->CR1 = 0;										// disable USART6
+	USART6->CR2 = 0;										// use 1 stop bit
+	USART6->CR3 = USART_CR3_DMAR | USART_CR3_DMAT | USART_CR3_OVRDIS;	// DMA in both directions, a lost byte is detected by the CRC
+	USART6->PRESC = 0b0000;									// prescaler = 1 -> 100MHz kernel clock
+	USART6->BRR = (USART_BASE_CLOCK + ESPNET_BAUDRATE / 2) / ESPNET_BAUDRATE;
+
+	/*
+	 * DMA1 Stream5: peripheral to memory (RDR -> rxring), 8 bit, circular, half and complete interrupts
+	 * DMA1 Stream4: memory to peripheral (txbuf -> TDR), 8 bit, transfer complete interrupt
+	 */
+	DMA1_Stream4->CR = 0;
+	DMA1_Stream5->CR = 0;
+	while ((DMA1_Stream4->CR | DMA1_Stream5->CR) & DMA_SxCR_EN) ;		// wait until the DMA is really disabled (just in case ...)
+	DMAMUX1_Channel4->CCR = (DMAREQ_USART6_TX << DMAMUX_CxCR_DMAREQ_ID_Pos);
+	DMAMUX1_Channel5->CCR = (DMAREQ_USART6_RX << DMAMUX_CxCR_DMAREQ_ID_Pos);
+	DMA1->HIFCR = DMA_HIFCR_CTCIF4 | DMA_HIFCR_CHTIF4 | DMA_HIFCR_CTEIF4 | DMA_HIFCR_CDMEIF4 | DMA_HIFCR_CFEIF4
+				| DMA_HIFCR_CTCIF5 | DMA_HIFCR_CHTIF5 | DMA_HIFCR_CTEIF5 | DMA_HIFCR_CDMEIF5 | DMA_HIFCR_CFEIF5;
+
+	DMA1_Stream5->CR = DMA_SxCR_MINC | DMA_SxCR_CIRC | (0b00 << DMA_SxCR_DIR_Pos) | (0b10 << DMA_SxCR_PL_Pos) | DMA_SxCR_HTIE | DMA_SxCR_TCIE;
+	DMA1_Stream5->NDTR = RXRING_SIZE;
+	DMA1_Stream5->PAR = (uint32_t) &USART6->RDR;
+	DMA1_Stream5->M0AR = (uint32_t) rxring;
+	DMA1_Stream5->FCR = 0;				// direct mode
+	cache_invalidate((uint32_t) rxring, sizeof(rxring));
+	ef_ringInit(&ring, rxring, RXRING_SIZE, espnet_written, espnet_invalidate, NULL);
+	rxhalves = 0;
+
+	DMA1_Stream4->CR = DMA_SxCR_MINC | (0b01 << DMA_SxCR_DIR_Pos) | DMA_SxCR_TCIE;
+	DMA1_Stream4->PAR = (uint32_t) &USART6->TDR;
+	DMA1_Stream4->FCR = 0;				// direct mode
+	txbusy = false;
+
+	NVIC_SetPriority(DMA1_Stream4_IRQn, 8);
+	NVIC_ClearPendingIRQ(DMA1_Stream4_IRQn);
+	NVIC_EnableIRQ(DMA1_Stream4_IRQn);
+	NVIC_SetPriority(DMA1_Stream5_IRQn, 8);
+	NVIC_ClearPendingIRQ(DMA1_Stream5_IRQn);
+	NVIC_EnableIRQ(DMA1_Stream5_IRQn);
+
+	SET_BIT(DMA1_Stream5->CR, DMA_SxCR_EN);
+	USART6->ICR = 0xFFFFFFFF;								// clear all interrupt flags
+	USART6->CR1 = USART_CR1_FIFOEN | USART_CR1_TE | USART_CR1_RE | USART_CR1_IDLEIE | USART_CR1_UE;
+}
+
+static void espnet_hwStop (void)
+{
+	USART6->CR1 = 0;										// disable USART6
+	USART6->CR3 = 0;
+	CLEAR_BIT(DMA1_Stream4->CR, DMA_SxCR_EN);
+	CLEAR_BIT(DMA1_Stream5->CR, DMA_SxCR_EN);
+	while ((DMA1_Stream4->CR | DMA1_Stream5->CR) & DMA_SxCR_EN) ;
+	NVIC_DisableIRQ(DMA1_Stream4_IRQn);
+	NVIC_DisableIRQ(DMA1_Stream5_IRQn);
+	DMA1->HIFCR = DMA_HIFCR_CTCIF4 | DMA_HIFCR_CHTIF4 | DMA_HIFCR_CTEIF4 | DMA_HIFCR_CDMEIF4 | DMA_HIFCR_CFEIF4
+				| DMA_HIFCR_CTCIF5 | DMA_HIFCR_CHTIF5 | DMA_HIFCR_CTEIF5 | DMA_HIFCR_CDMEIF5 | DMA_HIFCR_CFEIF5;
+	txbusy = false;
+}
+
+static void espnet_startTx (int len)
+{
+	cache_flush((uint32_t) txbuf, len);
+	txbusy = true;
+	DMA1->HIFCR = DMA_HIFCR_CTCIF4 | DMA_HIFCR_CHTIF4 | DMA_HIFCR_CTEIF4 | DMA_HIFCR_CDMEIF4 | DMA_HIFCR_CFEIF4;
+	DMA1_Stream4->M0AR = (uint32_t) txbuf;
+	DMA1_Stream4->NDTR = len;
+	SET_BIT(DMA1_Stream4->CR, DMA_SxCR_EN);
+}
+
+static void espnet_flushTx (void)
+{
+	struct pbuf *p;
+
+	while (txqueue && xQueueReceive(txqueue, &p, 0) == pdPASS) pbuf_free(p);
+}
+
+/**
+ * Called from the TCP/IP thread to send a frame. The frame is only queued
+ * here and later encoded by our task.
+ */
+static err_t espnet_output (struct netif *netif, struct pbuf *p)
+{
+	(void) netif;
+
+	if (!p) return ERR_OK;
+	if (!running || !wlan.up) return ERR_IF;
+	if (p->tot_len - ETH_PAD_SIZE > EF_MTU) return ERR_BUF;
+
+	pbuf_ref(p);								// keep it until it is encoded
+	if (xQueueSend(txqueue, &p, 0) != pdPASS) {
+		pbuf_free(p);
+		LINK_STATS_INC(link.drop);
+		return ERR_MEM;
+	}
+	xTaskNotifyGive(task);
+	return ERR_OK;
+}
+
+static err_t espnet_netifInit (struct netif *netif)
+{
+	memcpy (netif->hwaddr, hwaddr, sizeof(hwaddr));
+	netif->mtu = 1500;
+	netif->name[0] = 'w';
+	netif->name[1] = 'l';
+	netif->hwaddr_len = 6;
+	netif->output = etharp_output;
+	netif->linkoutput = espnet_output;
+	netif->flags |= NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_IGMP;
+
+	netif->link_callback = dbg_link_cb;
+	netif->status_callback = dbg_status_cb;
+	return ERR_OK;
+}
+
+static void espnet_addNetif (const uint8_t *mac)
+{
+	struct netif *netif;
+
+	if ((netif = malloc(sizeof(*netif))) == NULL) {
+		log_error ("%s(): no memory for the network interface\n", __func__);
+		return;
+	}
+	memset (netif, 0, sizeof(*netif));
+	memcpy (hwaddr, mac, sizeof(hwaddr));
+	if (netifapi_netif_add(netif, NULL, NULL, NULL, NULL, espnet_netifInit, tcpip_input) != ERR_OK) {
+		log_error ("%s(): cannot add the network interface\n", __func__);
+		free (netif);
+		return;
+	}
+	netifapi_netif_set_link_down(netif);
+	netifapi_netif_set_up(netif);
+	netifapi_dhcp_start(netif);
+	rt.wlan = netif;
+	log_msg (LOG_INFO, "%s(): WLAN MAC %02x:%02x:%02x:%02x:%02x:%02x\n", __func__,
+			mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+/**
+ * Deliver a frame from the module to lwIP.
+ *
+ * \return		false, if no network buffer was available (the module is paused for a short time)
+ */
+static bool espnet_frame (void *priv, const uint8_t *data, int len)
+{
+	struct netif *netif = rt.wlan;
+	struct pbuf *p;
+
+	(void) priv;
+
+	if (!netif || !netif_is_up(netif)) return true;		// nobody to deliver to - just forget about it
+	if (xPortGetFreeHeapSize() < MIN_HEAP_FREE) return false;
+#if ETH_PAD_SIZE
+	if ((p = pbuf_alloc(PBUF_RAW, len + ETH_PAD_SIZE, PBUF_RAM)) == NULL) return false;
+	pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
+#else
+	if ((p = pbuf_alloc(PBUF_RAW, len, PBUF_RAM)) == NULL) return false;
+#endif
+	memcpy (p->payload, data, len);
+#if ETH_PAD_SIZE
+	pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+#endif
+	if (netif->input(p, netif) != ERR_OK) {
+		pbuf_free (p);
+		return false;
+	}
+	return true;
+}
+
+static void espnet_link (void *priv, bool up, const uint8_t *mac)
+{
+	(void) priv;
+
+	if (up && !rt.wlan) espnet_addNetif(mac);
+	if (!rt.wlan) return;
+
+	if (memcmp(mac, rt.wlan->hwaddr, sizeof(hwaddr))) {
+		log_msg (LOG_WARNING, "%s(): module reports a different MAC %02x:%02x:%02x:%02x:%02x:%02x\n", __func__,
+				mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+	}
+	log_msg (LOG_INFO, "%s(): WLAN link %s\n", __func__, (up) ? "up" : "down");
+	if (up) {
+		netifapi_netif_set_link_up(rt.wlan);
+	} else {
+		netifapi_netif_set_link_down(rt.wlan);
+		espnet_flushTx();
+	}
+}
+
+static void espnet_text (void *priv, const char *line)
+{
+	(void) priv;
+
+	log_msg (LOG_INFO, "ESP: %s\n", line);
+}
+
+static const struct ef_ops ops = {
+	.frame = espnet_frame,
+	.link = espnet_link,
+	.text = espnet_text,
+};
+
+/**
+ * If the transmitter is idle, send the pending control frames and the next
+ * queued frame from lwIP (if the module takes data frames).
+ *
+ * \param now		the current time in ms
+ * \param backlog	the number of received bytes that were waiting for processing
+ */
+static void espnet_transmit (uint32_t now, int backlog)
+{
+	struct ef_encoder e;
+	struct pbuf *p, *q;
+	int len, skip, rc;
+
+	if (txbusy) return;
+
+	len = ef_poll(&wlan, backlog, now, txbuf, sizeof(txbuf));
+	if (ef_mayTransmit(&wlan) && xQueueReceive(txqueue, &p, 0) == pdPASS) {
+		ef_encBegin(&e, &txbuf[len], sizeof(txbuf) - len, EF_DATA);
+		skip = ETH_PAD_SIZE;					// the pbuf still contains the padding word
+		for (q = p; q; q = q->next) {
+			ef_encDataSkip(&e, q->payload, q->len, &skip);
+		}
+		pbuf_free(p);
+		if ((rc = ef_encEnd(&e)) > 0) {
+			len += rc;
+			LINK_STATS_INC(link.xmit);
+		} else {
+			LINK_STATS_INC(link.drop);
+		}
+	}
+	if (len > 0) espnet_startTx(len);
+}
+
+static void espnet_thread (void *pvParameter)
+{
+	uint32_t now;
+	int backlog;
+
+	(void) pvParameter;
+
+	for (;;) {
+		ulTaskNotifyTake(pdTRUE, (running) ? POLL_TIME : portMAX_DELAY);
+		if (do_stop) {
+			do_stop = false;
+			if (running) {
+				running = false;
+				espnet_hwStop();
+				if (wlan.up) espnet_link(NULL, false, wlan.mac);
+				espnet_flushTx();
+				log_msg (LOG_INFO, "%s(): stopped (%lu frames, %lu CRC errors, %lu overruns, %lu drops, %lu pauses, %lu resyncs)\n", __func__,
+						wlan.stats.rxFrames, wlan.stats.crcErrors, wlan.stats.overruns, wlan.stats.drops, wlan.stats.pauses, wlan.stats.resyncs);
+			}
+			if (waiter) xTaskNotifyGive(waiter);
+			continue;
+		}
+		if (do_start) {
+			do_start = false;
+			if (!running) {
+				ef_linkInit(&wlan, &ops, NULL, RXRING_SIZE);
+				espnet_hwInit();
+				running = true;
+				log_msg (LOG_INFO, "%s(): started with %d baud\n", __func__, ESPNET_BAUDRATE);
+			}
+		}
+		if (!running) continue;
+
+		now = xTaskGetTickCount();
+		backlog = ef_ringReceive(&wlan, &ring, now);
+		espnet_transmit(now, backlog);
+	}
+}
+
+/**
+ * Switch the UART to the network mode. The module must run its application
+ * (see esp_resetApplication() in esp01.c).
+ *
+ * \return		true, if the network task is running
+ */
+bool espnet_start (void)
+{
+	if (!txqueue && (txqueue = xQueueCreate(TXQUEUE_LEN, sizeof(struct pbuf *))) == NULL) {
+		log_error ("%s(): cannot create TX queue\n", __func__);
+		return false;
+	}
+	if (!task && xTaskCreate(espnet_thread, "ESPNET", 1024, NULL, 2, &task) != pdPASS) {
+		log_error ("%s(): cannot create task\n", __func__);
+		return false;
+	}
+	do_start = true;
+	xTaskNotifyGive(task);
+	return true;
+}
+
+/**
+ * Stop the network mode and wait until the UART and the DMA are released
+ * (i.e. to talk to the bootloader of the module).
+ */
+void espnet_stop (void)
+{
+	if (!task) return;
+
+	waiter = xTaskGetCurrentTaskHandle();
+	do_stop = true;
+	xTaskNotifyGive(task);
+	ulTaskNotifyTake(pdTRUE, 1000);
+	waiter = NULL;
+}
+
+/**
+ * The USART6 interrupt while the network is running. Called from
+ * USART6_IRQHandler() in esp01.c. The data is moved by DMA, we only
+ * care for the IDLE condition that marks the end of a burst.
+ */
+void espnet_uartIRQ (void)
+{
+	BaseType_t xHigherPriorityTaskWoken = 0;
+
+	if (USART6->ISR & USART_ISR_IDLE) {
+		if (task) vTaskNotifyGiveFromISR(task, &xHigherPriorityTaskWoken);
+	}
+	if (!(USART6->CR3 & USART_CR3_DMAR)) {					// not yet switched to DMA - drop the remaining characters
+		CLEAR_BIT(USART6->CR3, USART_CR3_RXFTIE | USART_CR3_TXFTIE);
+		while (USART6->ISR & USART_ISR_RXNE_RXFNE) (void) USART6->RDR;
+	}
+	USART6->ICR = USART_ICR_IDLECF | USART_ICR_ORECF | USART_ICR_FECF | USART_ICR_NECF | USART_ICR_PECF | USART_ICR_RTOCF;
+
+	NVIC_ClearPendingIRQ(USART6_IRQn);
+    portEND_SWITCHING_ISR (xHigherPriorityTaskWoken);
+}
+
+/**
+ * The transmission of the TX buffer is complete.
+ */
+void DMA_STR4_IRQHandler (void)
+{
+	BaseType_t xHigherPriorityTaskWoken = 0;
+
+	if (DMA1->HISR & (DMA_HISR_TCIF4 | DMA_HISR_TEIF4)) {
+		txbusy = false;
+		if (task) vTaskNotifyGiveFromISR(task, &xHigherPriorityTaskWoken);
+	}
+	// clear all DMA1 Stream4 interrupt flags
+	DMA1->HIFCR = DMA_HIFCR_CTCIF4 | DMA_HIFCR_CHTIF4 | DMA_HIFCR_CTEIF4 | DMA_HIFCR_CDMEIF4 | DMA_HIFCR_CFEIF4;
+	portEND_SWITCHING_ISR (xHigherPriorityTaskWoken);
+}
+
+/**
+ * The receive ring is half or completely filled - count the event for
+ * espnet_written() and process the data even if the line does not get idle.
+ */
+void DMA_STR5_IRQHandler (void)
+{
+	BaseType_t xHigherPriorityTaskWoken = 0;
+	uint32_t isr;
+
+	isr = DMA1->HISR;
+	if (isr & DMA_HISR_HTIF5) rxhalves++;
+	if (isr & DMA_HISR_TCIF5) rxhalves++;
+	if (isr & (DMA_HISR_HTIF5 | DMA_HISR_TCIF5)) {
+		if (task) vTaskNotifyGiveFromISR(task, &xHigherPriorityTaskWoken);
+	}
+	// clear all DMA1 Stream5 interrupt flags
+	DMA1->HIFCR = DMA_HIFCR_CTCIF5 | DMA_HIFCR_CHTIF5 | DMA_HIFCR_CTEIF5 | DMA_HIFCR_CDMEIF5 | DMA_HIFCR_CFEIF5;
+	portEND_SWITCHING_ISR (xHigherPriorityTaskWoken);
+}
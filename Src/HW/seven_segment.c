@@ -17,31 +17,27 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+/**
+ * \file
+ * \brief The 7-segment display
+ *
+ * The contents of the display are managed by a display manager with prioritized
+ * message layers (see dispmgr.c). All seg_xxx() functions post their messages
+ * to the appropriate layer and render the result immediately. A small task
+ * takes care of all changes that happen by themselves (blinking, scrolling
+ * and timeouts). The tick interrupt only multiplexes the two digits.
+ */
+
 #include "rb2.h"
 #include "events.h"
+#include "dispmgr.h"
+
+#define DISPLAY_STACK		256			///< stack size of the display task
+#define DISPLAY_PRIO		1			///< priority of the display task
 
-static volatile uint8_t segdata[2];
-static bool show_current;
-static unsigned blink;
-
-static const uint8_t digits[] = {
-	0b0111111,		// 0
-	0b0000110,		// 1
-	0b1011011,		// 2
-	0b1001111,		// 3
-	0b1100110,		// 4
-	0b1101101,		// 5
-	0b1111101,		// 6
-	0b0000111,		// 7
-	0b1111111,		// 8
-	0b1101111,		// 9
-	0b1110111,		// A
-	0b1111100,		// b
-	0b0111001,		// C
-	0b1011110,		// d
-	0b1111001,		// E
-	0b1110001,		// F
-};
+static volatile uint8_t segdata[DM_DIGITS];
+static struct dispmgr dm;
+static TaskHandle_t display_task;
 
 /**
  * This function controls the 7-segment display. It is
@@ -56,66 +52,128 @@ void seg_timer (void)
 
 	timer = xTaskGetTickCountFromISR();
 
-#if 0
-	if (timer % 1000 >= 500) {
-		segdata[0] &= ~0x40;
-		segdata[1] |= 0x40;
-	} else {
-		segdata[0] |= 0x40;
-		segdata[1] &= ~0x40;
-	}
-#endif
-
-	if ((blink > 0) && (timer % blink) < (blink / 2)) {
-		SEG_OFF();
-	} else {
-		switch (timer % 8) {
-			case 0:
-				SEG_OFF();
-				break;
-			case 1:
-			case 2:
-			case 3:
-				GPIOC->ODR = (GPIOC->ODR & ~0xFF00) | (segdata[0] << 8);
-				SEG_A1();
-				break;
-			case 4:
-				SEG_OFF();
-				break;
-			case 5:
-			case 6:
-			case 7:
-				SEG_A2();
-				GPIOC->ODR = (GPIOC->ODR & ~0xFF00) | (segdata[1] << 8);
-				break;
-		}
+	switch (timer % 8) {
+		case 0:
+			SEG_OFF();
+			break;
+		case 1:
+		case 2:
+		case 3:
+			GPIOC->ODR = (GPIOC->ODR & ~0xFF00) | (segdata[0] << 8);
+			SEG_A1();
+			break;
+		case 4:
+			SEG_OFF();
+			break;
+		case 5:
+		case 6:
+		case 7:
+			SEG_A2();
+			GPIOC->ODR = (GPIOC->ODR & ~0xFF00) | (segdata[1] << 8);
+			break;
 	}
 }
 
-void seg_decimal (int n, bool dp)
+/**
+ * Render the display manager to the display data.
+ *
+ * \return		the time in ms when the display changes by itself (DM_FOREVER for never)
+ */
+static uint32_t seg_render (void)
+{
+	uint8_t seg[DM_DIGITS];
+	uint32_t next;
+
+	taskENTER_CRITICAL();
+	next = dm_render(&dm, xTaskGetTickCount(), seg);
+	segdata[0] = seg[0];
+	segdata[1] = seg[1];
+	taskEXIT_CRITICAL();
+	return next;
+}
+
+/**
+ * Show the new contents immediately (the caller may block afterwards, i.e. on
+ * power fail) and wake up the display task to recalculate its timing.
+ */
+static void seg_update (void)
+{
+	seg_render();
+	if (display_task) xTaskNotifyGive(display_task);
+}
+
+static void seg_displayTask (void *pvParameter)
 {
-	if (n >= 100) n = 99;
-	if (n < 0) n = 0;
-
-	if (n / 10 == 0 && !dp) {
-		segdata[0] = 0;		// display as blank
-	} else {
-		segdata[0] = digits[n / 10];
-		if (dp) segdata[0] |= 0x80;
+	uint32_t next;
+
+	(void) pvParameter;
+
+	for (;;) {
+		next = seg_render();
+		ulTaskNotifyTake(pdTRUE, (next == DM_FOREVER) ? portMAX_DELAY : pdMS_TO_TICKS(next));
 	}
-	segdata[1] = digits[n % 10];
 }
 
-void seg_display (uint8_t left, uint8_t right)
+/**
+ * Show a text on one of the display layers. Texts longer than two digits are scrolled.
+ *
+ * \param l			the layer
+ * \param text		the text to show (dots are merged into the preceeding digit)
+ * \param blink		the blink period in ms (0 = steady)
+ * \param timeout	the time in ms after which the message is removed (0 = never)
+ */
+void seg_message (enum dm_layer l, const char *text, int blink, uint32_t timeout)
+{
+	taskENTER_CRITICAL();
+	dm_setText(&dm, l, text, blink, timeout, xTaskGetTickCount());
+	taskEXIT_CRITICAL();
+	seg_update();
+}
+
+/**
+ * Show a decimal number (0 .. 99) on one of the display layers.
+ *
+ * \param l			the layer
+ * \param n			the number to show
+ * \param dp		if set, a decimal point is shown after the first digit
+ * \param timeout	the time in ms after which the message is removed (0 = never)
+ */
+void seg_number (enum dm_layer l, int n, bool dp, uint32_t timeout)
 {
-	segdata[0] = left;
-	segdata[1] = right;
+	taskENTER_CRITICAL();
+	dm_setDecimal(&dm, l, n, dp, timeout, xTaskGetTickCount());
+	taskEXIT_CRITICAL();
+	seg_update();
 }
 
-uint8_t seg_getHexDigit (int v)
+void seg_clear (enum dm_layer l)
 {
-	if (v < 0 || v > 15) return 0;
-	return digits[v];
+	taskENTER_CRITICAL();
+	dm_clear(&dm, l);
+	taskEXIT_CRITICAL();
+	seg_update();
+}
+
+void seg_decimal (int n, bool dp)
+{
+	seg_number(DM_LAYER_IDLE, n, dp, 0);
+}
+
+/**
+ * A new system status replaces the previous one and ends the
+ * alert conditions (SHORT, over temperature). A pending pairing
+ * request has its own layer and so is not affected.
+ *
+ * \param text		the status text or NULL to show the background layer
+ */
+static void seg_status (const char *text)
+{
+	taskENTER_CRITICAL();
+	if (text) dm_setText(&dm, DM_LAYER_STATUS, text, 0, 0, xTaskGetTickCount());
+	else dm_clear(&dm, DM_LAYER_STATUS);
+	dm_clear(&dm, DM_LAYER_ALERT);
+	taskEXIT_CRITICAL();
+	seg_update();
 }
 
 /**
@@ -123,8 +181,7 @@ uint8_t seg_getHexDigit (int v)
  */
 void seg_stop (void)
 {
-	segdata[0] = 0b01101101;		// the 'S'
-	segdata[1] = 0b11111000;		// the 't' + '.'
+	seg_status("St.");
 }
 
 /**
@@ -132,8 +189,7 @@ void seg_stop (void)
  */
 void seg_pause (void)
 {
-	segdata[0] = 0b00000110;		// the ' |'
-	segdata[1] = 0b00110000;		// the '| '
+	seg_status("1|");		// two bars in the middle
 }
 
 /**
@@ -141,17 +197,16 @@ void seg_pause (void)
  */
 void seg_short (void)
 {
-	segdata[0] = 0b01101101;		// the 'S'
-	segdata[1] = 0b01110110;		// the 'H'
+	seg_message(DM_LAYER_ALERT, "SH", 0, 0);
 }
 
 /**
- * Track Power on: Show "Go" on the display
+ * Track Power on: Show "Go" on the display for a second, then the track current
  */
 void seg_go (void)
 {
-	segdata[0] = 0b00111101;		// the 'G'
-	segdata[1] = 0b01011100;		// the 'o'
+	seg_status(NULL);
+	seg_message(DM_LAYER_OVERLAY, "Go", 0, 1000);
 }
 
 /**
@@ -159,8 +214,7 @@ void seg_go (void)
  */
 void seg_reboot (void)
 {
-	segdata[0] = 0b01010000;		// the 'r'
-	segdata[1] = 0b01111001;		// the 'E'
+	seg_message(DM_LAYER_ALERT, "rE", 0, 0);
 }
 
 /**
@@ -168,8 +222,7 @@ void seg_reboot (void)
  */
 void seg_progmode (void)
 {
-	segdata[0] = 0b01110011;		// the 'P'
-	segdata[1] = 0b01010000;		// the 'r'
+	seg_status("Pr");
 }
 
 /**
@@ -177,8 +230,7 @@ void seg_progmode (void)
  */
 void seg_testdrive (void)
 {
-	segdata[0] = 0b01111000;		// the 't'
-	segdata[1] = 0b01011110;		// the 'd'
+	seg_status("td");
 }
 
 /**
@@ -186,8 +238,7 @@ void seg_testdrive (void)
  */
 void seg_factoryReset (void)
 {
-	segdata[0] = 0b01110001;		// the 'F'
-	segdata[1] = 0b01010000;		// the 'r'
+	seg_message(DM_LAYER_ALERT, "Fr", 0, 0);
 }
 
 /**
@@ -195,8 +246,7 @@ void seg_factoryReset (void)
  */
 void seg_powerfail (void)
 {
-	segdata[0] = 0b01110011;		// the 'P'
-	segdata[1] = 0b01110001;		// the 'F'
+	seg_message(DM_LAYER_ALERT, "PF", 0, 0);
 }
 
 /**
@@ -204,24 +254,17 @@ void seg_powerfail (void)
  */
 void seg_overtemp (void)
 {
-	segdata[0] = 0b01011100;		// the 'o'
-	segdata[1] = 0b01111000;		// the 't'
+	seg_message(DM_LAYER_ALERT, "ot", 0, 0);
 }
 
 /**
- * (BiDiB-)Pairing: Show "PA" on the display
+ * (BiDiB-)Pairing: Show a blinking "PA" on the display. Alerts (i.e. a SHORT)
+ * are shown on top of it and stay visible when the pairing ends.
  */
 void seg_pairing (bool on)
 {
-	if (on) {
-		show_current = false;
-		blink = 600;
-		segdata[0] = 0b01110011;		// the 'P'
-		segdata[1] = 0b01110111;		// the 'A'
-	} else {
-		show_current = (rt.tm == TM_GO);
-		blink = 0;
-	}
+	if (on) seg_message(DM_LAYER_PAIRING, "PA", 600, 0);
+	else seg_clear(DM_LAYER_PAIRING);
 }
 
 static bool seg_current (eventT *e, void *arg)
@@ -230,12 +273,9 @@ static bool seg_current (eventT *e, void *arg)
 
 	if (e) switch (e->ev) {
 		case EVENT_CURRENT:
-			if (show_current) {
-				seg_decimal(e->param, true);
-			}
+			seg_decimal(e->param, true);	// only visible, if no status is shown (i.e. in GO mode)
 			break;
 		case EVENT_SYS_STATUS:
-			show_current = false;			// for most states don't disturb display content
 			switch (e->param) {
 				case SYSEVENT_STOP:
 					seg_stop();
@@ -244,7 +284,7 @@ static bool seg_current (eventT *e, void *arg)
 					seg_pause();
 					break;
 				case SYSEVENT_GO:
-					show_current = true;	// the only state where we show track current on display
+					seg_go();
 					break;
 				case SYSEVENT_SHORT:
 					seg_short();
@@ -268,6 +308,7 @@ static bool seg_current (eventT *e, void *arg)
 
 void seg_registerEvents (void)
 {
+	if (!display_task) xTaskCreate(seg_displayTask, "Display", DISPLAY_STACK, NULL, DISPLAY_PRIO, &display_task);
 	event_register(EVENT_CURRENT, seg_current, NULL, 0);
 	event_register(EVENT_SYS_STATUS, seg_current, NULL, 0);
 }
@@ -25,11 +25,14 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "rb2.h"
+#include "timers.h"
 #include "events.h"
 #include "config.h"
 #include "decoder.h"
+#include "bstsupervisor.h"
 
 #define FB_VOLTAGE					12		///< the feedback voltage of the regulator is 1,2V nominal
 #define REF_VOLTAGE					33		///< the reference voltage of the D/A converter is 3,3V nominal
@@ -37,6 +40,7 @@
 #define DA_PASSIVE					(FB_VOLTAGE * DA_STEPS / REF_VOLTAGE)	///< the D/A-ticks to make output control passive
 #define PASSIVE_VOLTAGE				132		///< the output voltage if no additional current flows into the feedback (i.e.DAC = FB_VOLTAGE, in 0,1V)
 #define DACSTEPS_PER_MS				20		///< how much DAC steps we do per call of ts_handler() (i.e. per 1ms)
+#define TIMER_WAIT					100		///< ticks to wait when sending messages to the timer task
 
 static struct {
 	volatile int		target_voltage;		///< the desired track voltage
@@ -57,6 +61,9 @@ static struct {
 	volatile bool		prog_track;			///< if set, the booster should be switched on for the programming track
 } boosterstatus;
 
+static struct bsv *supervisor;				///< current capture, short statistics and restart strategy (see bstsupervisor.c)
+static TimerHandle_t restart_timer;			///< the one-shot timer for an automatic restart after a short
+
 static bool ts_currentMonitor (eventT *e, void *arg)
 {
 	(void) arg;
@@ -64,14 +71,19 @@ static bool ts_currentMonitor (eventT *e, void *arg)
 	// this event should reach us every ms
 	if (e->ev == EVENT_INSTANEOUS_CURRENT) {
 		boosterstatus.actual_current = e->param;	// current in events is reported in mA
+		if (supervisor) {
+			taskENTER_CRITICAL();
+			bsv_sample(supervisor, xTaskGetTickCount(), e->param);
+			taskEXIT_CRITICAL();
+		}
 		if (MAINBST_ISON()) {
 			if (boosterstatus.inrush_time > 0) boosterstatus.inrush_time--;
 			if (boosterstatus.inrush_time <= 0) {	// from now on, we monitor the current for overcurrent conditions
 				if (boosterstatus.actual_current > boosterconfig.max_current) boosterstatus.short_time += 2;
 				else if (boosterstatus.short_time > 0) boosterstatus.short_time--;
 				if (boosterstatus.short_time > (boosterconfig.short_time * 2)) {
-					sig_setMode(TM_SHORT);
 					fprintf (stderr, "%s(): SHORT @%dmA\n", __func__, boosterstatus.actual_current);
+					ts_reportShort(BSV_SRC_INTERNAL);
 				}
 			}
 		}
@@ -79,6 +91,100 @@ static bool ts_currentMonitor (eventT *e, void *arg)
 	return true;		// we continue to listen for events!
 }
 
+static void ts_restartTimer (TimerHandle_t t)
+{
+	(void) t;
+
+	if (rt.tm != TM_SHORT) return;		// the user already switched on again or stopped the system
+	log_msg (LOG_INFO, "%s() automatic restart after short\n", __func__);
+	sig_setMode(TM_GO);
+	if (rt.tm == TM_GO && supervisor) {
+		taskENTER_CRITICAL();
+		bsv_restarted(supervisor);
+		taskEXIT_CRITICAL();
+	}
+}
+
+/**
+ * Report a short from any source. The system is switched to TM_SHORT, the short is
+ * accounted in the statistics and a current capture is started. If an automatic
+ * restart is configured, a timer is started to switch the track on again later.
+ *
+ * Shorts that are reported while the system is already in SHORT mode (i.e. by
+ * a second booster) are ignored, as are shorts in STOP mode.
+ *
+ * \param src		the source of the short
+ */
+void ts_reportShort (enum bsv_source src)
+{
+	enum trackmode prev;
+	int delay;
+
+	prev = rt.tm;
+	if (prev == TM_SHORT) return;
+	sig_setMode(TM_SHORT);
+	if (rt.tm != TM_SHORT || !supervisor) return;
+
+	taskENTER_CRITICAL();
+	delay = bsv_short(supervisor, xTaskGetTickCount(), src);
+	taskEXIT_CRITICAL();
+
+	if (delay < 0) {
+		if (supervisor->cnf->restart == BSV_RESTART_AUTO) log_msg (LOG_WARNING, "%s() too many shorts - no automatic restart\n", __func__);
+		return;
+	}
+	if (prev != TM_GO && prev != TM_HALT) return;		// only restart normal operation (not programming or test drive)
+	if (!restart_timer) restart_timer = xTimerCreate("BST-Restart", 1000, pdFALSE, NULL, ts_restartTimer);
+	if (restart_timer) {
+		if (delay < 1) delay = 1;
+		xTimerChangePeriod(restart_timer, pdMS_TO_TICKS(delay), TIMER_WAIT);	// will also start the timer
+		log_msg (LOG_INFO, "%s() automatic restart in %dms\n", __func__, delay);
+	}
+}
+
+/**
+ * Get a copy of one of the captured current waveforms.
+ *
+ * \param idx		the index of the capture (0 = the newest one)
+ * \param cap		where to store the copy
+ * \return			true, if the capture exists and was copied
+ */
+bool ts_getCapture (int idx, struct bsv_capture *cap)
+{
+	const struct bsv_capture *c;
+
+	if (!supervisor || !cap) return false;
+	taskENTER_CRITICAL();
+	if ((c = bsv_getCapture(supervisor, idx)) != NULL) *cap = *c;
+	taskEXIT_CRITICAL();
+	return (c != NULL);
+}
+
+/**
+ * Get a copy of the short circuit statistics.
+ *
+ * \param st		where to store the copy
+ */
+void ts_getShortStats (struct bsv_stats *st)
+{
+	if (!st) return;
+	if (!supervisor) {
+		memset (st, 0, sizeof(*st));
+		return;
+	}
+	taskENTER_CRITICAL();
+	*st = supervisor->stats;
+	taskEXIT_CRITICAL();
+}
+
+void ts_clearShortStats (void)
+{
+	if (!supervisor) return;
+	taskENTER_CRITICAL();
+	bsv_clearStats(supervisor);
+	taskEXIT_CRITICAL();
+}
+
 /**
  * Calculate the D/A output value for the desired out voltage (in 0,1V)
  *
@@ -400,6 +506,9 @@ void ts_init (void)
 	boosterconfig.max_current = MIN_CURRENT;
 	boosterconfig.short_time = MIN_SENSITIVITY;
 	boosterconfig.inrush_time = MIN_INRUSH;
+	if (!supervisor && (supervisor = malloc(sizeof(*supervisor))) != NULL) {
+		bsv_init(supervisor, &cnf_getconfig()->bstsv);
+	}
 	event_register(EVENT_INSTANEOUS_CURRENT, ts_currentMonitor, NULL, 0);
 }
 
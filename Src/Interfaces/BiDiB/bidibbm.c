@@ -0,0 +1,317 @@
+/*
+ * bidibbm.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Block occupancy and RailCom data from BiDiB detectors
+ *
+ * The feedback messages of the detectors are fed into the block model
+ * (see bidibocc.c). Every real change is fired as EVENT_BLOCKOCC, so that the
+ * web interface and the Z21 clients learn which loco is in which block. The
+ * event carries a temporary copy of the change or the RailCom data, so the
+ * listeners never need to lock the model. Transponder reports from LocoNet
+ * are fed into the same model using the virtual feedback nodes.
+ *
+ * The speed and dynamic state of the decoders is additionally delivered to
+ * the reply system as DECODERMSG_DYN using the RailCom DV numbering, so that
+ * everybody listening to RailCom replies sees the data from BiDiB detectors
+ * the same way as from our own RailCom detector.
+ */
+
+#include <string.h>
+#include "rb2.h"
+#include "bidib.h"
+#include "decoder.h"
+#include "events.h"
+
+static struct occ_model model;						///< the blocks and the RailCom data
+static SemaphoreHandle_t mutex;						///< protects the model
+
+static uint32_t BDBbm_now (void)
+{
+	return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+static int BDBbm_feedbackIndex (struct bidibnode *n, uint8_t port)
+{
+	struct feedback_map *fbm;
+
+	if ((fbm = n->private) == NULL) return -1;
+	return fbm->base + port;
+}
+
+static void BDBbm_blockEvent (struct occ_change *chg)
+{
+	struct occ_change *evt;
+	int i;
+
+	for (i = 0; i < chg->nentered; i++) {
+		log_msg (LOG_BIDIB, "%s() %s:%d ADR %d enters (%s)\n", __func__, bidib_formatUID(chg->blk.uid), chg->blk.port,
+				chg->entered[i].adr, chg->entered[i].reverse ? "reverse" : "forward");
+	}
+	for (i = 0; i < chg->nleft; i++) {
+		log_msg (LOG_BIDIB, "%s() %s:%d ADR %d left\n", __func__, bidib_formatUID(chg->blk.uid), chg->blk.port, chg->left[i].adr);
+	}
+	if ((evt = tmpbuf(sizeof(*evt))) != NULL) {
+		*evt = *chg;
+		event_fireEx(EVENT_BLOCKOCC, BDBBM_EVT_BLOCK, evt, 0, 20);
+	}
+}
+
+static void BDBbm_railcomEvent (struct occ_rcdata *rc)
+{
+	struct occ_rcdata *evt;
+
+	if ((evt = tmpbuf(sizeof(*evt))) != NULL) {
+		*evt = *rc;
+		event_fireEx(EVENT_BLOCKOCC, BDBBM_EVT_RAILCOM, evt, 0, 20);
+	}
+}
+
+static void BDBbm_deliverDyn (uint16_t adr, uint8_t value, uint8_t dv)
+{
+	cvadrT cva;
+	uint8_t data[2];
+
+	if (bidib_opmode() != BIDIB_CONTROLLER) return;		// as a server, the upstream controller gets the original message
+
+	cva.cv = 0;
+	data[0] = value;
+	data[1] = dv;
+	reply_deliver (DECODER_DCC_MOBILE, adr, DECODERMSG_DYN, cva, fvNULL, 2, data);
+}
+
+/**
+ * Update the occupied state of a single detector port.
+ *
+ * \param n			the detector node
+ * \param port		the detector port (MNUM)
+ * \param occupied	the new state
+ */
+void BDBbm_occupy (struct bidibnode *n, uint8_t port, bool occupied)
+{
+	struct occ_change chg;
+	bool changed;
+
+	if (!n || !mutex_lock(&mutex, 20, __func__)) return;
+	changed = occ_occupy(&model, n->uid, port, BDBbm_feedbackIndex(n, port), occupied, BDBbm_now(), &chg);
+	mutex_unlock(&mutex);
+	if (changed) BDBbm_blockEvent(&chg);
+}
+
+/**
+ * Update a range of detector ports from MSG_BM_MULTIPLE.
+ *
+ * \param n			the detector node
+ * \param base		the first port reported
+ * \param bits		the number of ports reported
+ * \param data		the bitmap with the occupied states (LSB first)
+ */
+void BDBbm_multiple (struct bidibnode *n, uint8_t base, int bits, const uint8_t *data)
+{
+	int i;
+
+	for (i = 0; i < bits; i++) {
+		BDBbm_occupy(n, base + i, !!(data[i >> 3] & (1 << (i & 0x07))));
+	}
+}
+
+/**
+ * MSG_BM_ADDRESS: MNUM followed by address pairs
+ */
+void BDBbm_address (struct bidibnode *n, bidibmsg_t *m)
+{
+	struct occ_change chg;
+	bool changed;
+
+	if (!n || m->datalen < 3) return;
+	if (!mutex_lock(&mutex, 20, __func__)) return;
+	changed = occ_address(&model, n->uid, m->data[0], BDBbm_feedbackIndex(n, m->data[0]), &m->data[1], m->datalen - 1, BDBbm_now(), &chg);
+	mutex_unlock(&mutex);
+	if (changed) BDBbm_blockEvent(&chg);
+}
+
+/**
+ * A transponder report from a detector that is not a BiDiB node (i.e. LocoNet).
+ * The block is assigned to the virtual feedback node that represents the
+ * module of this feedback input. If this module has no node, the UID it
+ * would get is used, so the report is not lost.
+ *
+ * \param fbidx		the zero based feedback input
+ * \param adr		the loco address
+ * \param present	the loco entered (true) or left (false) the block
+ * \return			the occupied state of the block after the report or -1 if it could not be processed
+ */
+int BDBbm_transponder (int fbidx, uint16_t adr, bool present)
+{
+	struct occ_change chg;
+	struct occ_block *b;
+	uint8_t uid[BIDIB_UID_LEN];
+	bool changed;
+	int occupied;
+
+	if (!BDBvn_feedbackUID(fbidx / 16, uid)) {
+		log_msg (LOG_BIDIB, "%s() input %d out of range\n", __func__, fbidx);
+		return -1;
+	}
+	if (!mutex_lock(&mutex, 20, __func__)) return -1;
+	changed = occ_transponder(&model, uid, fbidx % 16, fbidx, adr, present, BDBbm_now(), &chg);
+	occupied = ((b = occ_lookup(&model, uid, fbidx % 16)) != NULL) ? b->occupied : -1;
+	mutex_unlock(&mutex);
+	if (changed) BDBbm_blockEvent(&chg);
+	return occupied;
+}
+
+/**
+ * MSG_BM_SPEED: ADDR_L, ADDR_H, SPEED_L, SPEED_H
+ */
+void BDBbm_speed (struct bidibnode *n, bidibmsg_t *m)
+{
+	struct occ_loco l;
+	struct occ_rcdata *rc, copy;
+	uint16_t speed;
+
+	(void) n;
+
+	if (m->datalen < 4) return;
+	occ_decodeAddress(m->data[0], m->data[1], &l);
+	if (l.accessory || !l.adr) return;
+	speed = m->data[2] | (m->data[3] << 8);
+
+	if (!mutex_lock(&mutex, 20, __func__)) return;
+	if ((rc = occ_speed(&model, l.adr, speed, BDBbm_now())) != NULL) copy = *rc;
+	mutex_unlock(&mutex);
+	if (!rc) return;
+
+	BDBbm_railcomEvent(&copy);
+	if (speed > 255) BDBbm_deliverDyn(l.adr, speed - 256, 1);		// DV 1: real speed part 2
+	else BDBbm_deliverDyn(l.adr, speed, 0);							// DV 0: real speed part 1
+}
+
+/**
+ * MSG_BM_DYN_STATE: MNUM, ADDR_L, ADDR_H, DYN_NUM, VALUE
+ */
+void BDBbm_dynState (struct bidibnode *n, bidibmsg_t *m)
+{
+	struct occ_loco l;
+	struct occ_rcdata *rc, copy;
+	uint8_t dynnum, value;
+
+	(void) n;
+
+	if (m->datalen < 5) return;
+	occ_decodeAddress(m->data[1], m->data[2], &l);
+	if (l.accessory || !l.adr) return;
+	dynnum = m->data[3];
+	value = m->data[4];
+
+	if (!mutex_lock(&mutex, 20, __func__)) return;
+	if ((rc = occ_dynState(&model, l.adr, dynnum, value, BDBbm_now())) != NULL) copy = *rc;
+	mutex_unlock(&mutex);
+	if (!rc) return;
+
+	BDBbm_railcomEvent(&copy);
+	switch (dynnum) {					// map the DYN_NUM back to the RailCom DV (see BDBsrv_replyhandler() for the other direction)
+		case OCC_DYN_QOS:
+			BDBbm_deliverDyn(l.adr, value, 7);
+			break;
+		case OCC_DYN_TEMP:
+			BDBbm_deliverDyn(l.adr, (int8_t) value + 50, 26);
+			break;
+		case OCC_DYN_CONTAINER1:
+		case OCC_DYN_CONTAINER1 + 1:
+		case OCC_DYN_CONTAINER1 + 2:
+			BDBbm_deliverDyn(l.adr, value, dynnum + 5);
+			break;
+	}
+}
+
+/**
+ * Remove the blocks of a node that is gone.
+ *
+ * \param n		the node that was lost
+ */
+void BDBbm_nodeLost (struct bidibnode *n)
+{
+	int cnt;
+
+	if (!n || !mutex_lock(&mutex, 20, __func__)) return;
+	cnt = occ_dropNode(&model, n->uid);
+	mutex_unlock(&mutex);
+	if (cnt) log_msg (LOG_BIDIB, "%s() %s: %d blocks removed\n", __func__, bidib_formatUID(n->uid), cnt);
+}
+
+/**
+ * Copy the current state of all blocks.
+ *
+ * \param blk		where to store the blocks
+ * \param max		the maximum number of blocks to copy
+ * \return			the number of blocks copied
+ */
+int BDBbm_getBlocks (struct occ_block *blk, int max)
+{
+	int cnt;
+
+	if (!blk || max <= 0 || !mutex_lock(&mutex, 100, __func__)) return 0;
+	cnt = (model.nblocks < max) ? model.nblocks : max;
+	memcpy (blk, model.blk, cnt * sizeof(*blk));
+	mutex_unlock(&mutex);
+	return cnt;
+}
+
+/**
+ * Get the state of the block that is mapped to a feedback input.
+ *
+ * \param fbidx		the zero based feedback input
+ * \param blk		where to store the block
+ * \return			true, if a block is mapped to this feedback input
+ */
+bool BDBbm_getFeedback (int fbidx, struct occ_block *blk)
+{
+	struct occ_block *b;
+
+	if (!blk || !mutex_lock(&mutex, 100, __func__)) return false;
+	if ((b = occ_lookupFeedback(&model, fbidx)) != NULL) *blk = *b;
+	mutex_unlock(&mutex);
+	return (b != NULL);
+}
+
+/**
+ * Get the RailCom data reported for an address.
+ *
+ * \param adr		the loco address
+ * \param rc		where to store the data
+ * \return			true, if there is data for this address
+ */
+bool BDBbm_getRailcom (int adr, struct occ_rcdata *rc)
+{
+	struct occ_rcdata *p;
+
+	if (!rc || !mutex_lock(&mutex, 100, __func__)) return false;
+	if ((p = occ_rcLookup(&model, adr)) != NULL) *rc = *p;
+	mutex_unlock(&mutex);
+	return (p != NULL);
+}
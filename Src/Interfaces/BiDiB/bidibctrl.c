@@ -467,6 +467,7 @@ void BDBctrl_bmOCC (struct bidibnode *n, bidibmsg_t *m)
 			if (BDBctrl_bm2s88(m->data[0] + fbm->base, true)) s88_triggerUpdate();
 #endif
 		}
+		BDBbm_occupy(n, m->data[0], true);
 
 		if (   (bidib_opmode() == BIDIB_CONTROLLER)
 			&& (msg = bidib_genMessage(n, MSG_BM_MIRROR_OCC, 1, m->data)) != NULL) {
@@ -488,6 +489,7 @@ void BDBctrl_bmFREE (struct bidibnode *n, bidibmsg_t *m)
 			if (BDBctrl_bm2s88(m->data[0] + fbm->base, false)) s88_triggerUpdate();
 #endif
 		}
+		BDBbm_occupy(n, m->data[0], false);
 
 		if (   (bidib_opmode() == BIDIB_CONTROLLER)
 			&& (msg = bidib_genMessage(n, MSG_BM_MIRROR_FREE, 1, m->data)) != NULL) {
@@ -522,6 +524,7 @@ void BDBctrl_bmMULTIPLE (struct bidibnode *n, bidibmsg_t *m)
 #endif
 			}
 		}
+		if (m->datalen >= (m->data[1] + 7) / 8 + 2) BDBbm_multiple(n, m->data[0], m->data[1], &m->data[2]);
 
 		if (   (bidib_opmode() == BIDIB_CONTROLLER)
 			&& (msg = bidib_genMessage(n, MSG_BM_MIRROR_MULTIPLE, m->datalen, m->data)) != NULL) {
@@ -540,16 +543,20 @@ static void BDBctrl_errorMessage (struct bidibnode *n, bidibmsg_t *m)
 static void BDBctrl_POM_readMessage(struct bidibnode *n, bidibmsg_t *m)
 {
 	(void) n;
-	int adr;
+	struct occ_loco l;
+	dec_type dt;
 	cvadrT cva;
 
-	adr = m->data[0] + (m->data[1] << 8);
+	if (m->datalen < 5) return;
+
+	occ_decodeAddress(m->data[0], m->data[1], &l);		// the upper two bits of ADDR_H carry the decoder type
+	if (!l.accessory) dt = DECODER_DCC_MOBILE;
+	else if (m->data[1] & 0x80) dt = DECODER_DCC_EXT;
+	else dt = DECODER_DCC_ACC;
 	cva.cv = m->data[2] + (m->data[3] << 8);
 
-	log_msg (LOG_INFO, "%s(): %d %ld = %d\n", __func__, adr, cva.cv, m->data[4]);
-	if (m->datalen >= 5) {
-		reply_deliver (DECODER_DCC_MOBILE, adr, m->datalen > 5 ? DECODERMSG_XPOM00 : DECODERMSG_POM, cva, fvNULL, m->datalen - 4, &m->data[4]);
-	}
+	log_msg (LOG_INFO, "%s(): %d %ld = %d\n", __func__, l.adr, cva.cv, m->data[4]);
+	reply_deliver (dt, l.adr, m->datalen > 5 ? DECODERMSG_XPOM00 : DECODERMSG_POM, cva, fvNULL, m->datalen - 4, &m->data[4]);
 }
 
 void BDBctrl_dcca(struct bidibnode *n, bidibmsg_t *m)
@@ -614,31 +621,36 @@ void BDBctrl_boosterState(struct bidibnode *n, bidibmsg_t *m)
 	}
 }
 
-static const struct msgdecoder upstream[] = {
-	{ MSG_SYS_MAGIC,			BDBctrl_sysMagic },
-	{ MSG_SYS_P_VERSION,		BDBctrl_sysPversion },
-	{ MSG_SYS_SW_VERSION,		BDBctrl_sysSWversion },
-	{ MSG_SYS_IDENTIFY_STATE,	BDBctrl_identifyState },
-	{ MSG_NODETAB_COUNT,		BDBctrl_nodeTabCount },
-	{ MSG_NODETAB,				BDBctrl_nodeTab },
-	{ MSG_NODE_NA,				BDBctrl_msgNodeNA },
-	{ MSG_NODE_LOST,			BDBctrl_msgNodeLost },
-	{ MSG_NODE_NEW,				BDBctrl_msgNodeNew },
-	{ MSG_FEATURE_COUNT,		BDBctrl_featureCount },
-	{ MSG_FEATURE,				BDBctrl_feature },
-	{ MSG_FEATURE_NA,			BDBctrl_featureNA },
-	{ MSG_STRING,				BDBctrl_string },
-	{ MSG_BM_OCC,				BDBctrl_bmOCC },
-	{ MSG_BM_FREE,				BDBctrl_bmFREE },
-	{ MSG_BM_MULTIPLE,			BDBctrl_bmMULTIPLE },
-	{ MSG_SYS_ERROR,			BDBctrl_errorMessage },
-	{ MSG_BM_CV,				BDBctrl_POM_readMessage },
-	{ MSG_BM_DCCA,				BDBctrl_dcca },
-	{ MSG_ACCESSORY_STATE,		BDBctrl_accessoryState },
-	{ MSG_BOOST_STAT,			BDBctrl_boosterState },
-	{ 0, NULL }
+static const bdbd_handler upstream[BDBD_OPCODES] = {
+	[MSG_SYS_MAGIC]				= BDBctrl_sysMagic,
+	[MSG_SYS_P_VERSION]			= BDBctrl_sysPversion,
+	[MSG_SYS_SW_VERSION]		= BDBctrl_sysSWversion,
+	[MSG_SYS_IDENTIFY_STATE]	= BDBctrl_identifyState,
+	[MSG_NODETAB_COUNT]			= BDBctrl_nodeTabCount,
+	[MSG_NODETAB]				= BDBctrl_nodeTab,
+	[MSG_NODE_NA]				= BDBctrl_msgNodeNA,
+	[MSG_NODE_LOST]				= BDBctrl_msgNodeLost,
+	[MSG_NODE_NEW]				= BDBctrl_msgNodeNew,
+	[MSG_FEATURE_COUNT]			= BDBctrl_featureCount,
+	[MSG_FEATURE]				= BDBctrl_feature,
+	[MSG_FEATURE_NA]			= BDBctrl_featureNA,
+	[MSG_STRING]				= BDBctrl_string,
+	[MSG_BM_OCC]				= BDBctrl_bmOCC,
+	[MSG_BM_FREE]				= BDBctrl_bmFREE,
+	[MSG_BM_MULTIPLE]			= BDBctrl_bmMULTIPLE,
+	[MSG_BM_ADDRESS]			= BDBbm_address,	// from bidibbm.c
+	[MSG_BM_SPEED]				= BDBbm_speed,		// from bidibbm.c
+	[MSG_BM_DYN_STATE]			= BDBbm_dynState,	// from bidibbm.c
+	[MSG_SYS_ERROR]				= BDBctrl_errorMessage,
+	[MSG_BM_CV]					= BDBctrl_POM_readMessage,
+	[MSG_BM_DCCA]				= BDBctrl_dcca,
+	[MSG_ACCESSORY_STATE]		= BDBctrl_accessoryState,
+	[MSG_BOOST_STAT]			= BDBctrl_boosterState,
+	[MSG_FW_UPDATE_STAT]		= BDBfw_status,		// from bidibfw.c
 };
 
+struct bdbd_table BDBctrl_upstream = { .name = "controller", .handler = upstream };
+
 static void BDBctrl_sequenceError (struct bidibnode *n, uint8_t seq)
 {
 	if (n) {
@@ -658,23 +670,15 @@ static void BDBctrl_sequenceError (struct bidibnode *n, uint8_t seq)
 
 static void BDBctrl_handleMessage (struct bidibnode *n, bidibmsg_t *m)
 {
-	const struct msgdecoder *u;
-
 	if (n && m) {
-		u = upstream;
-		while (u->msg) {
-			if (u->msg == m->msg) {
-				if (u->handler) u->handler (n, m);
-				break;
-			}
-			u++;
-		}
+		bdbd_dispatch(&BDBctrl_upstream, n, m, m->msg);
 		// don't mess up message sequence counting on our own virtual nodes!
 		if ((n->uid[2] != hwinfo->manufacturer) || ((n->uid[3] & 0xF0) != BIDIB_PID_VIRTUAL)) {
 			if (m->seq == 0) {			// the node wishes to reset it's sequencing
 				n->rxmsgnum = 0;
 			}
 			if (m->seq != n->rxmsgnum) {				// we lost messages - restart the current action if possible
+				bdbd_error(&BDBctrl_upstream, m->msg);
 				BDBctrl_sequenceError(n, m->seq);
 			} else {
 				if (++n->rxmsgnum == 0) n->rxmsgnum = 1;
@@ -787,6 +791,8 @@ void BDBctrl_controller (void *pvParameter)
 				case BDBCTRL_LOSTNODE:
 					log_msg(LOG_BIDIB, "%s(): LOST NODE %s UID %s\n", __func__,
 							bidib_formatAdrStack(bidib_getAddress(msg.node)), bidib_formatUID(msg.node->uid));
+					BDBfw_nodeLost(msg.node);
+					BDBbm_nodeLost(msg.node);
 					BDBnode_dropNode(msg.node);
 					BDBnode_nodeEvent();
 					break;
@@ -822,6 +828,7 @@ void BDBctrl_controller (void *pvParameter)
 		} else {	// a timeout occured: check for node timeouts
 			BDBnode_iterate (BDBctrl_nodeTimeout);
 		}
+		BDBfw_poll();
 	}
 }
 
@@ -0,0 +1,134 @@
+/*
+ * bidibdispatch.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Message dispatching and packet parsing for BiDiB
+ *
+ * Each role (controller, local server, sniffer, virtual nodes) owns a direct
+ * indexed table of handlers. Dispatching a message is a single array access
+ * and each message type keeps its own counters that can be shown on the web
+ * interface.
+ *
+ * The packet parser splits a received BiDiB packet into its messages without
+ * copying anything and checks all lengths against the packet size, so that
+ * malformed input can never read beyond the buffer.
+ *
+ * The messages arrive from bidibserver.c, bidibctrl.c or bidibnode.c and
+ * the nodes are only touched by the handlers in the table. That is what lets
+ * Tests/bidibdispatch_fuzz.c throw random packets at the parser.
+ */
+
+#include <string.h>
+#include "bidibdispatch.h"
+
+/**
+ * Call the handler for a message and count it.
+ *
+ * \param t			the dispatch table of the role that received the message
+ * \param n			the node that received the message
+ * \param m			the message
+ * \param msg		the message type (the caller knows the layout of the message)
+ * \return			true, if there was a handler for this message type
+ */
+bool bdbd_dispatch (struct bdbd_table *t, struct bidibnode *n, struct bidibmsg *m, uint8_t msg)
+{
+	bdbd_handler h;
+
+	if (!t) return false;
+	t->cnt[msg].rx++;
+	if (!t->handler || (h = t->handler[msg]) == NULL) {
+		t->cnt[msg].unknown++;
+		return false;
+	}
+	t->cnt[msg].handled++;
+	h(n, m);
+	return true;
+}
+
+/**
+ * Count a message that was rejected by the role.
+ *
+ * \param t			the dispatch table of the role that received the message
+ * \param msg		the message type
+ */
+void bdbd_error (struct bdbd_table *t, uint8_t msg)
+{
+	if (t) t->cnt[msg].error++;
+}
+
+void bdbd_clear (struct bdbd_table *t)
+{
+	if (t) memset (t->cnt, 0, sizeof(t->cnt));
+}
+
+/**
+ * Get the next message from a BiDiB packet.
+ *
+ * A message is made up of MSG_LENGTH, the address stack (up to four levels,
+ * terminated by a zero byte), MSG_NUM, MSG_TYPE and the message data.
+ * MSG_LENGTH does not count itself.
+ *
+ * \param pkt		the packet data
+ * \param len		the length of the packet
+ * \param pos		the read position in the packet, advanced to the next message on success
+ * \param v			where to store the message view (data points into the packet)
+ * \return			1 if a message was returned, 0 at the end of the packet and -1
+ * 					if the packet is malformed (the position is not advanced in that case)
+ */
+int bdbp_next (const uint8_t *pkt, int len, int *pos, struct bdbp_view *v)
+{
+	const uint8_t *p;
+	int mlen, levels;
+	uint32_t stack;
+
+	if (!pkt || !pos || !v || *pos < 0) return -1;
+	if (*pos >= len) return 0;
+
+	p = pkt + *pos;
+	mlen = *p++;
+	if (mlen < 3 || *pos + 1 + mlen > len) return -1;
+
+	stack = 0;
+	levels = 0;
+	while (levels < 4 && levels < mlen && p[levels]) {
+		stack = (stack << 8) | p[levels];
+		levels++;
+	}
+	if (levels) stack <<= 8 * (4 - levels);		// the first level is kept in the most significant byte
+
+	memset (v, 0, sizeof(*v));
+	v->adrstack = stack;
+	v->adrlen = levels + 1;						// with four levels the terminating zero is skipped unchecked
+	if (v->adrlen + 2 > mlen) return -1;		// no room for MSG_NUM and MSG_TYPE
+	v->seq = p[v->adrlen];
+	v->msg = p[v->adrlen + 1];
+	v->datalen = mlen - v->adrlen - 2;
+	v->data = p + v->adrlen + 2;
+
+	*pos += mlen + 1;
+	return 1;
+}
@@ -0,0 +1,427 @@
+/*
+ * bidibfw.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Firmware updates of BiDiB nodes from images stored on the station
+ *
+ * The images are uploaded to BIDIBFW_DIR (via the web interface or FTP) and
+ * matched against the UIDs of the nodes (see bidibfwu.c for the naming rules).
+ * An image for a single UID is preferred over an image for the product.
+ *
+ * Each node that should be updated gets a job. The jobs are scheduled by the
+ * BiDiB controller task: either one after the other or, in parallel mode, one
+ * job per branch (all nodes behind the same hub form a branch). The messages
+ * from the nodes are handed over to the state machine in bidibfwu.c.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "rb2.h"
+#include "yaffsfs.h"
+#include "intelhex.h"
+#include "config.h"
+#include "bidib.h"
+
+#define READ_CHUNK			(FWU_MAXRECORD + 16)	///< bytes to read from the image to find a complete record
+
+/**
+ * A firmware update job for one node
+ */
+struct fwjob {
+	struct fwjob		*next;						///< linked list of jobs
+	struct fwu_job		 fwu;						///< the state machine
+	adrstack_t			 branch;					///< the address of the parent node
+	bool				 resume;					///< a failed job should be resumed
+	int					 fd;						///< the currently opened image file
+	uint8_t				 fddest;					///< the destination of the opened image file
+	char				 image[FWU_DESTS][64];		///< the image file names per destination
+};
+
+static struct fwjob *jobs;							///< all jobs including the finished and failed ones
+static SemaphoreHandle_t mutex;						///< protects the job list
+static bool parallel;								///< run the jobs on different branches in parallel
+
+static uint32_t BDBfw_now (void)
+{
+	return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+static void BDBfw_closeImage (struct fwjob *j)
+{
+	if (j->fd >= 0) yaffs_close(j->fd);
+	j->fd = -1;
+}
+
+/**
+ * Read a single hex record from the image file. The record is checked with
+ * the Intel HEX parser, so a corrupted image is not sent to the node.
+ */
+static int BDBfw_read (void *priv, uint8_t dest, uint32_t pos, uint32_t *next, char *rec, int size)
+{
+	struct fwjob *j = (struct fwjob *) priv;
+	struct ihexdata ih;
+	char buf[READ_CHUNK + 1], *s, *e;
+	char fname[FILENAME_MAX];
+	int len;
+
+	if (dest >= FWU_DESTS || !j->image[dest][0]) return -1;
+	if (j->fd < 0 || j->fddest != dest) {
+		BDBfw_closeImage(j);
+		snprintf (fname, sizeof(fname), "%s%s", BIDIBFW_DIR, j->image[dest]);
+		if ((j->fd = yaffs_open(fname, O_RDONLY, 0)) < 0) return -1;
+		j->fddest = dest;
+	}
+
+	for (;;) {
+		if (yaffs_lseek(j->fd, pos, SEEK_SET) < 0) return -1;
+		if ((len = yaffs_read(j->fd, buf, READ_CHUNK)) < 0) return -1;
+		if (len == 0) return 0;						// end of file
+		buf[len] = 0;
+		s = buf;
+		while (*s == '\r' || *s == '\n' || *s == ' ' || *s == '\t') s++;
+		if (s != buf) {								// skip white space and read again from the start of the record
+			pos += s - buf;
+			continue;
+		}
+		e = s;
+		while (*e && *e != '\r' && *e != '\n') e++;
+		if (!*e && len == READ_CHUNK) return -1;	// record too long
+		*e = 0;
+		if (e - s >= size) return -1;
+		memset (&ih, 0, sizeof(ih));
+		if (*s != ':' || ihex_readline(&ih, s) < 0) return -1;
+		strcpy (rec, s);
+		*next = pos + (e - s);
+		return e - s;
+	}
+}
+
+static bool BDBfw_send (void *priv, uint8_t op, const uint8_t *data, int len)
+{
+	struct fwjob *j = (struct fwjob *) priv;
+	struct bidibnode *n;
+	bidibmsg_t *m;
+	uint8_t buf[FWU_MAXRECORD + 1];
+
+	if (len < 0 || len > FWU_MAXRECORD) return false;
+	if ((n = BDBnode_lookupNodeByUID(j->fwu.uid, NULL)) == NULL) return false;
+	buf[0] = op;
+	if (data && len > 0) memcpy (&buf[1], data, len);
+	if ((m = bidib_genMessage(n, MSG_FW_UPDATE_OP, len + 1, buf)) == NULL) return false;
+	BDBus_sendMessage(m);
+	return true;
+}
+
+static const struct fwu_ops ops = {
+	.read = BDBfw_read,
+	.send = BDBfw_send,
+};
+
+/**
+ * Find the images for a node. Images for the UID take precedence over images
+ * for the product.
+ *
+ * \param uid		the UID of the node
+ * \param names		where to store the file names of the images (may be NULL)
+ * \param sizes		where to store the sizes of the images (may be NULL)
+ * \return			a bitmap of the destinations that have an image
+ */
+uint8_t BDBfw_findImages (uint8_t *uid, char names[FWU_DESTS][64], uint32_t sizes[FWU_DESTS])
+{
+	yaffs_DIR *dir;
+	struct yaffs_dirent *dentry;
+	struct yaffs_stat st;
+	struct fwu_image img;
+	char fname[FILENAME_MAX];
+	uint8_t dests, byuid;
+
+	dests = byuid = 0;
+	if ((dir = yaffs_opendir(BIDIBFW_DIR)) == NULL) return 0;
+	while ((dentry = yaffs_readdir(dir)) != NULL) {
+		if (!fwu_parseName(dentry->d_name, &img) || !fwu_matches(&img, uid)) continue;
+		if ((byuid & (1 << img.dest)) && !img.byuid) continue;		// we already have a more specific image
+		snprintf (fname, sizeof(fname), "%s%s", BIDIBFW_DIR, dentry->d_name);
+		if (yaffs_stat(fname, &st) != 0 || (st.st_mode & S_IFMT) != S_IFREG) continue;
+		dests |= 1 << img.dest;
+		if (img.byuid) byuid |= 1 << img.dest;
+		if (names) {
+			strncpy (names[img.dest], dentry->d_name, sizeof(names[img.dest]) - 1);
+			names[img.dest][sizeof(names[img.dest]) - 1] = 0;
+		}
+		if (sizes) sizes[img.dest] = st.st_size;
+	}
+	yaffs_closedir(dir);
+	return dests;
+}
+
+static struct fwjob *BDBfw_lookupJob (uint8_t *uid)
+{
+	struct fwjob *j;
+
+	for (j = jobs; j; j = j->next) {
+		if (!memcmp(j->fwu.uid, uid, BIDIB_UID_LEN)) return j;
+	}
+	return NULL;
+}
+
+/**
+ * Create a job for a single node. An existing job that is not active is
+ * replaced by the new one.
+ *
+ * \return		0 for success or a negative error code
+ */
+static int BDBfw_addJob (struct bidibnode *n)
+{
+	struct fwjob *j, **jpp;
+	char names[FWU_DESTS][64];
+	uint32_t sizes[FWU_DESTS];
+	uint8_t dests;
+
+	if (!n || (n->flags & NODEFLG_VIRTUAL)) return -1;
+	if (n->state != NS_BOOTMODE && bidib_getFeatureValue(n, FEATURE_FW_UPDATE_MODE) != 1) return -2;	// node cannot be updated
+	memset (names, 0, sizeof(names));
+	memset (sizes, 0, sizeof(sizes));
+	if ((dests = BDBfw_findImages(n->uid, names, sizes)) == 0) return -3;		// no image for this node
+
+	if ((j = BDBfw_lookupJob(n->uid)) != NULL) {
+		if (fwu_isActive(&j->fwu)) return -4;			// already running
+		BDBfw_closeImage(j);
+	} else {
+		if ((j = malloc(sizeof(*j))) == NULL) return -5;
+		j->next = NULL;
+		jpp = &jobs;
+		while (*jpp) jpp = &(*jpp)->next;
+		*jpp = j;
+	}
+	fwu_init(&j->fwu, n->uid, dests, &ops, j);
+	memcpy (j->fwu.size, sizes, sizeof(j->fwu.size));
+	memcpy (j->image, names, sizeof(j->image));
+	j->branch = bidib_getAddress(n->parent);
+	j->resume = false;
+	j->fd = -1;
+	log_msg (LOG_BIDIB, "%s(): UID %s flash '%s' EEPROM '%s'\n", __func__, bidib_formatUID(n->uid), names[0], names[1]);
+	return 0;
+}
+
+static void BDBfw_addAll (struct bidibnode *list)
+{
+	while (list) {
+		BDBfw_addJob(list);
+		if (list->children) BDBfw_addAll(list->children);
+		list = list->next;
+	}
+}
+
+/**
+ * Queue the update of one node or all nodes that have an image.
+ *
+ * \param uid		the UID of the node or NULL for all nodes
+ * \param par		run the jobs on different branches in parallel
+ * \return			0 for success or a negative error code
+ */
+int BDBfw_start (uint8_t *uid, bool par)
+{
+	int rc = 0;
+
+	if (bidib_opmode() != BIDIB_CONTROLLER) return -10;		// only possible when we control the system ourself
+	if (!mutex_lock(&mutex, 100, __func__)) return -11;
+	parallel = par;
+	if (uid) {
+		rc = BDBfw_addJob(BDBnode_lookupNodeByUID(uid, NULL));
+	} else if (BDBnode_getRoot()) {
+		BDBfw_addAll(BDBnode_getRoot()->children);
+	}
+	mutex_unlock(&mutex);
+	return rc;
+}
+
+/**
+ * Resume failed jobs.
+ *
+ * \param uid		the UID of the node or NULL for all failed jobs
+ */
+void BDBfw_resume (uint8_t *uid)
+{
+	struct fwjob *j;
+
+	if (!mutex_lock(&mutex, 100, __func__)) return;
+	for (j = jobs; j; j = j->next) {
+		if (j->fwu.state == FWU_FAILED && (!uid || !memcmp(j->fwu.uid, uid, BIDIB_UID_LEN))) j->resume = true;
+	}
+	mutex_unlock(&mutex);
+}
+
+/**
+ * Cancel jobs. Jobs that are not yet started are removed.
+ *
+ * \param uid		the UID of the node or NULL for all jobs
+ */
+void BDBfw_cancel (uint8_t *uid)
+{
+	struct fwjob *j, **jpp;
+
+	if (!mutex_lock(&mutex, 100, __func__)) return;
+	jpp = &jobs;
+	while ((j = *jpp) != NULL) {
+		if (!uid || !memcmp(j->fwu.uid, uid, BIDIB_UID_LEN)) {
+			if (j->fwu.state == FWU_IDLE) {
+				*jpp = j->next;
+				free (j);
+				continue;
+			}
+			fwu_cancel(&j->fwu);
+			j->resume = false;
+			BDBfw_closeImage(j);
+		}
+		jpp = &j->next;
+	}
+	mutex_unlock(&mutex);
+}
+
+/**
+ * Remove all finished and failed jobs from the list.
+ */
+void BDBfw_clear (void)
+{
+	struct fwjob *j, **jpp;
+
+	if (!mutex_lock(&mutex, 100, __func__)) return;
+	jpp = &jobs;
+	while ((j = *jpp) != NULL) {
+		if (j->fwu.state >= FWU_FINISHED) {
+			*jpp = j->next;
+			BDBfw_closeImage(j);
+			free (j);
+		} else {
+			jpp = &j->next;
+		}
+	}
+	mutex_unlock(&mutex);
+}
+
+/**
+ * Check if a job may be started now.
+ */
+static bool BDBfw_mayStart (struct fwjob *j)
+{
+	struct fwjob *a;
+
+	for (a = jobs; a; a = a->next) {
+		if (!fwu_isActive(&a->fwu)) continue;
+		if (!parallel || a->branch == j->branch) return false;
+	}
+	return true;
+}
+
+/**
+ * Handle timeouts and start the next jobs. Called from the controller task.
+ */
+void BDBfw_poll (void)
+{
+	struct fwjob *j;
+	uint32_t now;
+
+	if (!jobs || !mutex_lock(&mutex, 20, __func__)) return;
+	now = BDBfw_now();
+	for (j = jobs; j; j = j->next) {
+		fwu_poll(&j->fwu, now);
+		if (!fwu_isActive(&j->fwu)) BDBfw_closeImage(j);
+	}
+	for (j = jobs; j; j = j->next) {
+		if (j->fwu.state == FWU_IDLE && BDBfw_mayStart(j)) {
+			log_msg (LOG_BIDIB, "%s(): starting update of %s\n", __func__, bidib_formatUID(j->fwu.uid));
+			fwu_start(&j->fwu, now);
+		} else if (j->fwu.state == FWU_FAILED && j->resume && BDBfw_mayStart(j)) {
+			log_msg (LOG_BIDIB, "%s(): resuming update of %s\n", __func__, bidib_formatUID(j->fwu.uid));
+			j->resume = false;
+			fwu_resume(&j->fwu, now);
+		}
+	}
+	mutex_unlock(&mutex);
+}
+
+/**
+ * Handle MSG_FW_UPDATE_STAT (1: status, 2: timeout or error code).
+ */
+void BDBfw_status (struct bidibnode *n, bidibmsg_t *m)
+{
+	struct fwjob *j;
+	enum fwu_state st;
+
+	if (!n || m->datalen < 2) return;
+	if (!mutex_lock(&mutex, 20, __func__)) return;
+	if ((j = BDBfw_lookupJob(n->uid)) != NULL) {
+		st = j->fwu.state;
+		fwu_status(&j->fwu, m->data[0], m->data[1], BDBfw_now());
+		if (j->fwu.state != st && !fwu_isActive(&j->fwu)) {
+			log_msg (LOG_BIDIB, "%s(): %s %s (%s, node error %u)\n", __func__, bidib_formatUID(n->uid),
+					fwu_stateName(j->fwu.state), fwu_errorName(j->fwu.error), j->fwu.nodeerr);
+			BDBfw_closeImage(j);
+		}
+	}
+	mutex_unlock(&mutex);
+}
+
+/**
+ * A node was lost. After leaving the update mode this is expected.
+ */
+void BDBfw_nodeLost (struct bidibnode *n)
+{
+	struct fwjob *j;
+
+	if (!n || !jobs || !mutex_lock(&mutex, 20, __func__)) return;
+	if ((j = BDBfw_lookupJob(n->uid)) != NULL) {
+		fwu_lost(&j->fwu);
+		if (!fwu_isActive(&j->fwu)) BDBfw_closeImage(j);
+	}
+	mutex_unlock(&mutex);
+}
+
+/**
+ * Get a copy of the state of the jobs.
+ *
+ * \param info		an array to fill in
+ * \param max		the number of entries in the array
+ * \return			the number of jobs copied
+ */
+int BDBfw_getJobs (struct bdbfw_info *info, int max)
+{
+	struct fwjob *j;
+	int cnt;
+
+	if (!info || !mutex_lock(&mutex, 100, __func__)) return 0;
+	for (j = jobs, cnt = 0; j && cnt < max; j = j->next, cnt++) {
+		memcpy (info[cnt].uid, j->fwu.uid, BIDIB_UID_LEN);
+		info[cnt].state = j->fwu.state;
+		info[cnt].error = j->fwu.error;
+		info[cnt].nodeerr = j->fwu.nodeerr;
+		info[cnt].progress = fwu_progress(&j->fwu);
+		info[cnt].resume = j->resume;
+	}
+	mutex_unlock(&mutex);
+	return cnt;
+}
@@ -0,0 +1,423 @@
+/*
+ * bidibfwu.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief The state machine for the firmware update of a single BiDiB node
+ *
+ * The update follows the BiDiB protocol: the node is put into update mode with
+ * MSG_FW_UPDATE_OP ENTER and its UID. For each destination (flash and EEPROM)
+ * the destination is selected with SETDEST, the hex records are sent one by one
+ * with DATA, each acknowledged by the node with MSG_FW_UPDATE_STAT DATA, and the
+ * destination is closed with DONE. At the end, EXIT starts the new firmware.
+ *
+ * If the node does not answer in time, the last operation is repeated a few
+ * times. A failed update can be resumed. Destinations that were completed before
+ * are skipped, the interrupted destination is transferred again from the start.
+ *
+ * Image files are named "<vid>_<pid>_<dest>.hex" for all nodes of a product or
+ * "<uid>_<dest>.hex" for a single node. The vendor and product IDs are decimal
+ * numbers, the UID is given as 14 hex digits. The destination is 0 for flash
+ * and 1 for EEPROM and may be left out for flash.
+ *
+ * Reading the hex file and sending the messages is left to the fwu_ops
+ * callbacks (bidibfw.c uses the file system and the BiDiB bus). With other
+ * callbacks, Tests/bidibfwu_test.c updates simulated nodes.
+ */
+
+#include <string.h>
+#include <ctype.h>
+#include "bidibfwu.h"
+
+static bool fwu_send (struct fwu_job *j, uint8_t op, const uint8_t *data, int len, uint32_t now)
+{
+	j->lastop = op;
+	j->deadline = now + ((op == FWU_OP_ENTER) ? FWU_ENTERTIMEOUT : j->timeout);
+	if (!j->ops->send(j->priv, op, data, len)) {
+		j->state = FWU_FAILED;
+		j->error = FWU_ERR_SEND;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * (Re-)send the last operation.
+ */
+static void fwu_resend (struct fwu_job *j, uint32_t now)
+{
+	switch (j->lastop) {
+		case FWU_OP_ENTER:
+			fwu_send(j, FWU_OP_ENTER, j->uid, FWU_UIDLEN, now);
+			break;
+		case FWU_OP_SETDEST:
+			fwu_send(j, FWU_OP_SETDEST, &j->dest, 1, now);
+			break;
+		case FWU_OP_DATA:
+			fwu_send(j, FWU_OP_DATA, (uint8_t *) j->rec, j->reclen, now);
+			break;
+		default:
+			fwu_send(j, j->lastop, NULL, 0, now);
+			break;
+	}
+}
+
+/**
+ * Select the next destination that must be transferred or leave the update
+ * mode, if all destinations are done.
+ */
+static void fwu_nextDest (struct fwu_job *j, uint32_t now)
+{
+	uint8_t d;
+
+	for (d = 0; d < FWU_DESTS; d++) {
+		if (j->dests & (1 << d)) break;
+	}
+	j->retry = 0;
+	if (d >= FWU_DESTS) {
+		j->state = FWU_EXIT;
+		fwu_send(j, FWU_OP_EXIT, NULL, 0, now);
+		return;
+	}
+	j->dest = d;
+	j->pos = j->next = 0;
+	j->state = FWU_SETDEST;
+	fwu_send(j, FWU_OP_SETDEST, &j->dest, 1, now);
+}
+
+/**
+ * Send the record at the position j->next or DONE at the end of the image.
+ */
+static void fwu_nextRecord (struct fwu_job *j, uint32_t now)
+{
+	j->retry = 0;
+	j->pos = j->next;
+	j->reclen = j->ops->read(j->priv, j->dest, j->pos, &j->next, j->rec, sizeof(j->rec));
+	if (j->reclen < 0 || (j->reclen > 0 && j->next <= j->pos)) {
+		j->state = FWU_FAILED;
+		j->error = FWU_ERR_IMAGE;
+	} else if (j->reclen == 0) {
+		j->state = FWU_DONE;
+		fwu_send(j, FWU_OP_DONE, NULL, 0, now);
+	} else {
+		j->state = FWU_DATA;
+		fwu_send(j, FWU_OP_DATA, (uint8_t *) j->rec, j->reclen, now);
+	}
+}
+
+/**
+ * Initialise an update job.
+ *
+ * \param j			the job to initialise
+ * \param uid		the UID of the node to update
+ * \param dests		a bitmap of the destinations to transfer (bit 0: flash, bit 1: EEPROM)
+ * \param ops		the access functions to the image and the node
+ * \param priv		private data that is handed to the access functions
+ */
+void fwu_init (struct fwu_job *j, const uint8_t *uid, uint8_t dests, const struct fwu_ops *ops, void *priv)
+{
+	if (!j) return;
+	memset (j, 0, sizeof(*j));
+	if (uid) memcpy (j->uid, uid, FWU_UIDLEN);
+	j->dests = dests & ((1 << FWU_DESTS) - 1);
+	j->ops = ops;
+	j->priv = priv;
+	j->timeout = FWU_MINTIMEOUT;
+}
+
+/**
+ * Start the update by sending ENTER.
+ *
+ * \param j			the job to start
+ * \param now		the current time in ms
+ * \return			true, if the update was started
+ */
+bool fwu_start (struct fwu_job *j, uint32_t now)
+{
+	if (!j || !j->ops || j->state != FWU_IDLE || !j->dests) return false;
+	j->state = FWU_ENTER;
+	j->error = FWU_ERR_NONE;
+	j->retry = 0;
+	return fwu_send(j, FWU_OP_ENTER, j->uid, FWU_UIDLEN, now);
+}
+
+/**
+ * Resume a failed update. Completed destinations are skipped.
+ *
+ * \param j			the job to resume
+ * \param now		the current time in ms
+ * \return			true, if the update was restarted
+ */
+bool fwu_resume (struct fwu_job *j, uint32_t now)
+{
+	if (!j || j->state != FWU_FAILED) return false;
+	j->state = FWU_IDLE;
+	j->nodeerr = 0;
+	return fwu_start(j, now);
+}
+
+/**
+ * Interpret a MSG_FW_UPDATE_STAT from the node.
+ *
+ * \param j			the job of the node
+ * \param stat		the status reported by the node
+ * \param detail	the timeout in units of 10ms or the error code in case of FWU_STAT_ERROR
+ * \param now		the current time in ms
+ */
+void fwu_status (struct fwu_job *j, uint8_t stat, uint8_t detail, uint32_t now)
+{
+	uint32_t to;
+
+	if (!fwu_isActive(j)) return;
+
+	if (stat == FWU_STAT_ERROR) {
+		j->state = FWU_FAILED;
+		j->error = FWU_ERR_NODE;
+		j->nodeerr = detail;
+		return;
+	}
+	to = detail * 10;
+	j->timeout = (to > FWU_MINTIMEOUT) ? to : FWU_MINTIMEOUT;
+
+	switch (j->state) {
+		case FWU_ENTER:
+			if (stat == FWU_STAT_READY) fwu_nextDest(j, now);
+			break;
+		case FWU_SETDEST:
+			if (stat == FWU_STAT_DATA) fwu_nextRecord(j, now);
+			break;
+		case FWU_DATA:
+			if (stat == FWU_STAT_DATA) fwu_nextRecord(j, now);
+			break;
+		case FWU_DONE:
+			if (stat == FWU_STAT_READY) {
+				j->dests &= ~(1 << j->dest);
+				j->base += j->size[j->dest];
+				fwu_nextDest(j, now);
+			}
+			break;
+		case FWU_EXIT:
+			if (stat == FWU_STAT_EXIT) j->state = FWU_FINISHED;
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+ * Check for a missing answer and repeat the last operation or give up.
+ *
+ * \param j			the job to check
+ * \param now		the current time in ms
+ */
+void fwu_poll (struct fwu_job *j, uint32_t now)
+{
+	if (!fwu_isActive(j)) return;
+	if ((int32_t) (now - j->deadline) < 0) return;
+
+	if (j->retry >= FWU_RETRIES) {
+		if (j->state == FWU_EXIT) {		// the node probably started the new firmware without acknowledge
+			j->state = FWU_FINISHED;
+		} else {
+			j->state = FWU_FAILED;
+			j->error = FWU_ERR_TIMEOUT;
+		}
+		return;
+	}
+	j->retry++;
+	fwu_resend(j, now);
+}
+
+/**
+ * The node was lost. This is expected after EXIT because the node resets.
+ *
+ * \param j			the job of the node
+ */
+void fwu_lost (struct fwu_job *j)
+{
+	if (!fwu_isActive(j)) return;
+	if (j->state == FWU_EXIT) {
+		j->state = FWU_FINISHED;
+	} else {
+		j->state = FWU_FAILED;
+		j->error = FWU_ERR_LOST;
+	}
+}
+
+/**
+ * Cancel the update. If nothing was written to the node yet, the update mode
+ * is left. Otherwise the node stays in update mode because the firmware may
+ * be incomplete.
+ *
+ * \param j			the job to cancel
+ */
+void fwu_cancel (struct fwu_job *j)
+{
+	if (!j) return;
+	if (j->ops && (j->state == FWU_ENTER || j->state == FWU_SETDEST)) j->ops->send(j->priv, FWU_OP_EXIT, NULL, 0);
+	if (j->state != FWU_FINISHED) {
+		j->state = FWU_FAILED;
+		j->error = FWU_ERR_CANCELLED;
+	}
+}
+
+bool fwu_isActive (const struct fwu_job *j)
+{
+	return j && j->state > FWU_IDLE && j->state < FWU_FINISHED;
+}
+
+/**
+ * Calculate the progress of the update.
+ *
+ * \param j			the job
+ * \return			the progress in percent
+ */
+int fwu_progress (const struct fwu_job *j)
+{
+	uint32_t total, done;
+	int d;
+
+	if (!j) return 0;
+	if (j->state == FWU_FINISHED) return 100;
+	for (d = 0, total = 0; d < FWU_DESTS; d++) total += j->size[d];
+	if (!total) return 0;
+	done = j->base;
+	if (j->state == FWU_DATA || j->state == FWU_DONE) done += j->pos;
+	if (done > total) done = total;
+	return (int) ((uint64_t) done * 100 / total);
+}
+
+const char *fwu_stateName (enum fwu_state st)
+{
+	switch (st) {
+		case FWU_IDLE: return "idle";
+		case FWU_ENTER: return "enter";
+		case FWU_SETDEST: return "setdest";
+		case FWU_DATA: return "data";
+		case FWU_DONE: return "done";
+		case FWU_EXIT: return "exit";
+		case FWU_FINISHED: return "finished";
+		case FWU_FAILED: return "failed";
+	}
+	return "unknown";
+}
+
+const char *fwu_errorName (enum fwu_error err)
+{
+	switch (err) {
+		case FWU_ERR_NONE: return "none";
+		case FWU_ERR_NODE: return "node";
+		case FWU_ERR_TIMEOUT: return "timeout";
+		case FWU_ERR_IMAGE: return "image";
+		case FWU_ERR_SEND: return "send";
+		case FWU_ERR_LOST: return "lost";
+		case FWU_ERR_CANCELLED: return "cancelled";
+	}
+	return "unknown";
+}
+
+static int fwu_hexdigit (char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	c = tolower((unsigned char) c);
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+static const char *fwu_decimal (const char *s, uint32_t *val)
+{
+	if (!isdigit((unsigned char) *s)) return NULL;
+	*val = 0;
+	while (isdigit((unsigned char) *s)) {
+		*val = *val * 10 + (*s++ - '0');
+		if (*val > 0xFFFF) return NULL;
+	}
+	return s;
+}
+
+/**
+ * Interpret the name of an image file.
+ *
+ * \param name		the file name without directory
+ * \param img		where to store the interpreted target
+ * \return			true, if the name follows the naming convention
+ */
+bool fwu_parseName (const char *name, struct fwu_image *img)
+{
+	const char *s;
+	uint32_t vid, pid;
+	int i, hi, lo;
+
+	if (!name || !img) return false;
+	memset (img, 0, sizeof(*img));
+	s = name;
+
+	for (i = 0; i < FWU_UIDLEN; i++) {
+		if ((hi = fwu_hexdigit(s[2 * i])) < 0 || (lo = fwu_hexdigit(s[2 * i + 1])) < 0) break;
+		img->uid[i] = (hi << 4) | lo;
+	}
+	if (i == FWU_UIDLEN && (s[2 * i] == '_' || s[2 * i] == '.')) {
+		img->byuid = true;
+		img->vid = img->uid[2];
+		img->pid = img->uid[3];
+		s += 2 * FWU_UIDLEN;
+	} else {
+		memset (img->uid, 0, sizeof(img->uid));
+		if ((s = fwu_decimal(s, &vid)) == NULL || vid > 0xFF || *s++ != '_') return false;
+		if ((s = fwu_decimal(s, &pid)) == NULL) return false;
+		img->vid = vid;
+		img->pid = pid;
+	}
+
+	if (*s == '_') {
+		s++;
+		if (*s < '0' || *s >= '0' + FWU_DESTS) return false;
+		img->dest = *s++ - '0';
+	}
+	if (*s++ != '.') return false;
+	return (tolower((unsigned char) s[0]) == 'h' && tolower((unsigned char) s[1]) == 'e'
+			&& tolower((unsigned char) s[2]) == 'x' && s[3] == 0);
+}
+
+/**
+ * Check if an image is meant for a node. The product ID is compared with the
+ * fourth byte of the UID. If it is bigger than 255, the fifth byte is taken
+ * as the high byte of the product ID.
+ *
+ * \param img		the interpreted image name
+ * \param uid		the UID of the node
+ * \return			true, if the image fits the node
+ */
+bool fwu_matches (const struct fwu_image *img, const uint8_t *uid)
+{
+	uint16_t pid;
+
+	if (!img || !uid) return false;
+	if (img->byuid) return !memcmp(img->uid, uid, FWU_UIDLEN);
+	if (uid[2] != img->vid) return false;
+	pid = (img->pid > 0xFF) ? uid[3] | (uid[4] << 8) : uid[3];
+	return pid == img->pid;
+}
@@ -52,6 +52,7 @@ static void BDBnode_freeNode (struct bidibnode *n)
 {
 	if (n) {
 		if (n->children) _BDBnode_freeNodeList(n->children);
+		if (n->flags & NODEFLG_VIRTUAL) BDBvn_nodeFreed(n);
 		if (n->features) free (n->features);
 		if (n->private) free (n->private);
 		free (n);
@@ -535,7 +536,6 @@ void BDBnode_pollChangeReport (void)
 int BDBnode_handleMessage (struct bidibnode *n, bidibmsg_t *m)
 {
 	struct bidibnode *child;
-	const struct msgdecoder *d;
 
 	if (!n) return -1;
 
@@ -544,14 +544,7 @@ int BDBnode_handleMessage (struct bidibnode *n, bidibmsg_t *m)
 		n->txmsgnum = n->rxmsgnum = 1;
 	}
 
-	d = n->downstream;
-	while (d->msg) {
-		if (d->msg == m->msg) {
-			if (d->handler) d->handler (n, m);
-			break;
-		}
-		d++;
-	}
+	bdbd_dispatch(n->downstream, n, m, m->msg);
 	if (bidib_isBroadcast(m->msg)) {	// probably forward the message down to our children
 		child = n->children;
 		while (child) {
@@ -0,0 +1,399 @@
+/*
+ * bidibocc.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief The block occupancy model for BiDiB detectors
+ *
+ * Every detector port (node UID and MNUM) that reports something becomes a
+ * block. A block knows whether it is occupied and which addresses (with their
+ * orientation) the detector has seen in it. The addresses come from
+ * MSG_BM_ADDRESS, the occupied state from MSG_BM_OCC, MSG_BM_FREE and
+ * MSG_BM_MULTIPLE. A block that gets free forgets all its addresses. LocoNet
+ * transponder reports add or remove single addresses.
+ *
+ * Independent of the blocks, the dynamic data of a decoder (speed, receive
+ * statistics and temperature from MSG_BM_SPEED and MSG_BM_DYN_STATE) is kept
+ * per address. The oldest entry is recycled if the table is full.
+ *
+ * Each update reports the resulting change so that the caller can inform
+ * the interested parties only about real changes.
+ *
+ * The model is a plain structure that is updated by the BiDiB layer
+ * (bidibctrl.c, bidibbm.c), while z21.c and cgi.c only see the reported
+ * changes. Tests/bidibocc_test.c runs recorded messages through it.
+ */
+
+#include <string.h>
+#include "bidibocc.h"
+
+void occ_init (struct occ_model *m)
+{
+	if (m) memset (m, 0, sizeof(*m));
+}
+
+/**
+ * Decode the address bytes used in the BiDiB BM messages.
+ *
+ * \param lo		the ADDR_L byte
+ * \param hi		the ADDR_H byte including the type and orientation bits
+ * \param l			where to store the decoded address
+ */
+void occ_decodeAddress (uint8_t lo, uint8_t hi, struct occ_loco *l)
+{
+	uint16_t adr;
+
+	adr = lo | (hi << 8);
+	l->adr = adr & OCC_ADR_MASK;
+	l->accessory = !!(adr & OCC_ADR_ACCESSORY);
+	l->reverse = !l->accessory && (adr & OCC_ADR_REVERSE);
+}
+
+struct occ_block *occ_lookup (struct occ_model *m, const uint8_t *uid, uint8_t port)
+{
+	int i;
+
+	if (!m || !uid) return NULL;
+	for (i = 0; i < m->nblocks; i++) {
+		if (m->blk[i].port == port && !memcmp (m->blk[i].uid, uid, OCC_UIDLEN)) return &m->blk[i];
+	}
+	return NULL;
+}
+
+struct occ_block *occ_lookupFeedback (struct occ_model *m, int fbidx)
+{
+	int i;
+
+	if (!m || fbidx < 0) return NULL;
+	for (i = 0; i < m->nblocks; i++) {
+		if (m->blk[i].fbidx == fbidx) return &m->blk[i];
+	}
+	return NULL;
+}
+
+/**
+ * Find or create the block for a detector port. The feedback mapping is
+ * updated every time, because it may have changed since the block was created.
+ *
+ * \return		the block or NULL, if the table is full
+ */
+static struct occ_block *occ_get (struct occ_model *m, const uint8_t *uid, uint8_t port, int fbidx)
+{
+	struct occ_block *b;
+
+	if ((b = occ_lookup(m, uid, port)) == NULL) {
+		if (!m || !uid || m->nblocks >= OCC_MAXBLOCKS) return NULL;
+		b = &m->blk[m->nblocks++];
+		memset (b, 0, sizeof(*b));
+		memcpy (b->uid, uid, OCC_UIDLEN);
+		b->port = port;
+	}
+	b->fbidx = (fbidx >= 0) ? fbidx : -1;
+	return b;
+}
+
+static bool occ_sameLoco (const struct occ_loco *a, const struct occ_loco *b)
+{
+	return a->adr == b->adr && a->accessory == b->accessory;
+}
+
+static void occ_startChange (struct occ_change *chg)
+{
+	if (chg) memset (chg, 0, sizeof(*chg));
+}
+
+static void occ_finishChange (struct occ_change *chg, struct occ_block *b)
+{
+	if (chg) chg->blk = *b;
+}
+
+/**
+ * Set the occupied state of a block. If the block gets free, all addresses
+ * are removed from it.
+ *
+ * \param m			the model
+ * \param uid		the UID of the detector
+ * \param port		the detector port (MNUM)
+ * \param fbidx		the feedback input the port is mapped to or -1
+ * \param occupied	the new state of the block
+ * \param now		the current time stamp
+ * \param chg		where to report the change (may be NULL)
+ * \return			true, if the block changed
+ */
+bool occ_occupy (struct occ_model *m, const uint8_t *uid, uint8_t port, int fbidx, bool occupied, uint32_t now, struct occ_change *chg)
+{
+	struct occ_block *b;
+	bool changed;
+	int i;
+
+	occ_startChange(chg);
+	if ((b = occ_get(m, uid, port, fbidx)) == NULL) return false;
+
+	changed = (b->occupied != occupied);
+	b->occupied = occupied;
+	if (chg) chg->occchg = changed;
+	if (!occupied && b->nlocos) {
+		for (i = 0; i < b->nlocos; i++) {
+			if (chg) chg->left[chg->nleft++] = b->loco[i];
+		}
+		b->nlocos = 0;
+		changed = true;
+	}
+	if (changed) b->stamp = now;
+	occ_finishChange(chg, b);
+	return changed;
+}
+
+/**
+ * Replace the addresses of a block with those from a MSG_BM_ADDRESS. A single
+ * address 0 means that the detector sees no valid address. A block with at
+ * least one address is occupied.
+ *
+ * \param m			the model
+ * \param uid		the UID of the detector
+ * \param port		the detector port (MNUM)
+ * \param fbidx		the feedback input the port is mapped to or -1
+ * \param data		the address pairs (ADDR_L, ADDR_H) following the MNUM
+ * \param len		the number of bytes in data
+ * \param now		the current time stamp
+ * \param chg		where to report the change (may be NULL)
+ * \return			true, if the block changed
+ */
+bool occ_address (struct occ_model *m, const uint8_t *uid, uint8_t port, int fbidx, const uint8_t *data, int len, uint32_t now, struct occ_change *chg)
+{
+	struct occ_block *b;
+	struct occ_loco locos[OCC_LOCOS], l;
+	bool changed, found;
+	int i, j, n;
+
+	occ_startChange(chg);
+	if (!data || len < 0) return false;
+	if ((b = occ_get(m, uid, port, fbidx)) == NULL) return false;
+
+	for (i = 0, n = 0; i + 1 < len && n < OCC_LOCOS; i += 2) {
+		occ_decodeAddress(data[i], data[i + 1], &l);
+		if (l.adr == 0) continue;
+		for (j = 0; j < n; j++) {
+			if (occ_sameLoco(&locos[j], &l)) break;		// ignore duplicates
+		}
+		if (j >= n) locos[n++] = l;
+	}
+
+	changed = false;
+	for (i = 0; i < b->nlocos; i++) {			// all old addresses that are missing now have left the block
+		for (j = 0, found = false; j < n && !found; j++) found = occ_sameLoco(&b->loco[i], &locos[j]);
+		if (!found) {
+			if (chg) chg->left[chg->nleft++] = b->loco[i];
+			changed = true;
+		}
+	}
+	for (j = 0; j < n; j++) {					// new addresses or a changed orientation count as entering
+		for (i = 0, found = false; i < b->nlocos && !found; i++) {
+			found = occ_sameLoco(&b->loco[i], &locos[j]) && b->loco[i].reverse == locos[j].reverse;
+		}
+		if (!found) {
+			if (chg) chg->entered[chg->nentered++] = locos[j];
+			changed = true;
+		}
+	}
+
+	memcpy (b->loco, locos, n * sizeof(locos[0]));
+	b->nlocos = n;
+	if (n > 0 && !b->occupied) {
+		b->occupied = true;
+		if (chg) chg->occchg = true;
+		changed = true;
+	}
+	if (changed) b->stamp = now;
+	occ_finishChange(chg, b);
+	return changed;
+}
+
+/**
+ * Add or remove a single loco address (i.e. from a transponder report). A
+ * transponding detector reports the occupancy by the addresses it sees, so
+ * the block is occupied as long as at least one address is present.
+ *
+ * \param m			the model
+ * \param uid		the UID of the detector
+ * \param port		the detector port (MNUM)
+ * \param fbidx		the feedback input the port is mapped to or -1
+ * \param adr		the loco address
+ * \param present	the loco entered (true) or left (false) the block
+ * \param now		the current time stamp
+ * \param chg		where to report the change (may be NULL)
+ * \return			true, if the block changed
+ */
+bool occ_transponder (struct occ_model *m, const uint8_t *uid, uint8_t port, int fbidx, uint16_t adr, bool present, uint32_t now, struct occ_change *chg)
+{
+	struct occ_block *b;
+	struct occ_loco l;
+	bool changed;
+	int i;
+
+	occ_startChange(chg);
+	adr &= OCC_ADR_MASK;
+	if (!adr) return false;
+	if ((b = occ_get(m, uid, port, fbidx)) == NULL) return false;
+
+	memset (&l, 0, sizeof(l));
+	l.adr = adr;
+	for (i = 0; i < b->nlocos; i++) {
+		if (occ_sameLoco(&b->loco[i], &l)) break;
+	}
+
+	changed = false;
+	if (present && i >= b->nlocos && b->nlocos < OCC_LOCOS) {
+		b->loco[b->nlocos++] = l;
+		if (chg) chg->entered[chg->nentered++] = l;
+		changed = true;
+	} else if (!present && i < b->nlocos) {
+		if (chg) chg->left[chg->nleft++] = b->loco[i];
+		b->nlocos--;
+		memmove (&b->loco[i], &b->loco[i + 1], (b->nlocos - i) * sizeof(b->loco[0]));
+		changed = true;
+	}
+	if (b->occupied != (b->nlocos > 0)) {
+		b->occupied = (b->nlocos > 0);
+		if (chg) chg->occchg = true;
+		changed = true;
+	}
+	if (changed) b->stamp = now;
+	occ_finishChange(chg, b);
+	return changed;
+}
+
+struct occ_rcdata *occ_rcLookup (struct occ_model *m, uint16_t adr)
+{
+	int i;
+
+	if (!m || !adr) return NULL;
+	for (i = 0; i < OCC_RCDATA; i++) {
+		if (m->rc[i].adr == adr) return &m->rc[i];
+	}
+	return NULL;
+}
+
+/**
+ * Find the RailCom data of an address or recycle the oldest entry for it.
+ */
+static struct occ_rcdata *occ_rcGet (struct occ_model *m, uint16_t adr, uint32_t now)
+{
+	struct occ_rcdata *rc, *oldest;
+	int i;
+
+	adr &= OCC_ADR_MASK;
+	if (!adr) return NULL;
+	if ((rc = occ_rcLookup(m, adr)) == NULL) {
+		for (i = 0, oldest = &m->rc[0]; i < OCC_RCDATA; i++) {
+			if (!m->rc[i].adr) {
+				oldest = &m->rc[i];
+				break;
+			}
+			if ((int32_t) (m->rc[i].stamp - oldest->stamp) < 0) oldest = &m->rc[i];
+		}
+		rc = oldest;
+		memset (rc, 0, sizeof(*rc));
+		rc->adr = adr;
+	}
+	rc->rxcount++;
+	rc->stamp = now;
+	return rc;
+}
+
+struct occ_rcdata *occ_speed (struct occ_model *m, uint16_t adr, uint16_t speed, uint32_t now)
+{
+	struct occ_rcdata *rc;
+
+	if (!m || (rc = occ_rcGet(m, adr, now)) == NULL) return NULL;
+	rc->speed = speed;
+	rc->valid |= OCC_RCVALID_SPEED;
+	return rc;
+}
+
+/**
+ * Store the dynamic state of a decoder. Values that are not kept in the
+ * model still count as a report for this address.
+ */
+struct occ_rcdata *occ_dynState (struct occ_model *m, uint16_t adr, uint8_t dynnum, uint8_t value, uint32_t now)
+{
+	struct occ_rcdata *rc;
+
+	if (!m || (rc = occ_rcGet(m, adr, now)) == NULL) return NULL;
+	switch (dynnum) {
+		case OCC_DYN_QOS:
+			rc->qos = value;
+			rc->valid |= OCC_RCVALID_QOS;
+			break;
+		case OCC_DYN_TEMP:
+			rc->temp = (int8_t) value;
+			rc->valid |= OCC_RCVALID_TEMP;
+			break;
+	}
+	return rc;
+}
+
+/**
+ * Remove all blocks of a detector node (i.e. when it is lost).
+ *
+ * \return		the number of blocks removed
+ */
+int occ_dropNode (struct occ_model *m, const uint8_t *uid)
+{
+	int i, j;
+
+	if (!m || !uid) return 0;
+	for (i = j = 0; i < m->nblocks; i++) {
+		if (memcmp (m->blk[i].uid, uid, OCC_UIDLEN)) {
+			if (i != j) m->blk[j] = m->blk[i];
+			j++;
+		}
+	}
+	i = m->nblocks - j;
+	m->nblocks = j;
+	return i;
+}
+
+/**
+ * Find the blocks where an address is detected.
+ *
+ * \param m			the model
+ * \param adr		the address to look for
+ * \param start		the index of the first block to check
+ * \return			the index of the next block containing the address or -1
+ */
+int occ_findLoco (const struct occ_model *m, uint16_t adr, int start)
+{
+	int i, j;
+
+	if (!m || start < 0) return -1;
+	for (i = start; i < m->nblocks; i++) {
+		for (j = 0; j < m->blk[i].nlocos; j++) {
+			if (!m->blk[i].loco[j].accessory && m->blk[i].loco[j].adr == adr) return i;
+		}
+	}
+	return -1;
+}
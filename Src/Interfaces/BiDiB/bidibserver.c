@@ -31,7 +31,22 @@
 #include "config.h"
 #include "bidib.h"
 
+#define LOCOREPORT_BATCH		8		///< number of MSG_CS_DRIVE_STATE messages that are posted in one go
+#define FBREPORT_DELAY			5		///< time in ms to collect feedback changes before they are reported
+
 static TimerHandle_t diagtimer;			///< the booster diagnose timer
+static TimerHandle_t fbtimer;			///< delays the feedback reports to collect the changes of several modules
+static uint8_t fbdirty[BIDIB_VFB_MODULES];	///< the changed bytes of the virtual feedback nodes that are not yet reported
+
+/**
+ * A running list report of MSG_CS_QUERY. It is only accessed from the
+ * netBiDiB server task, so no locking is needed.
+ */
+static struct {
+	uint16_t	*adr;					///< a snapshot of the loco addresses taken when the query was received
+	int			 count;					///< number of addresses in the snapshot
+	int			 idx;					///< the next address to report
+} locoreport;
 
 static uint8_t BDBsrv_boosterVoltage (struct bidibnode *n, struct nodefeature *nf, uint8_t val);
 static uint8_t BDBsrv_currentLimit (struct bidibnode *n, struct nodefeature *nf, uint8_t val);
@@ -654,19 +669,53 @@ static bidibmsg_t *BDBsrv_driveState (uint16_t adr, uint8_t opcode)
 	return bidib_genMessage(LOCAL_NODE(), MSG_CS_DRIVE_STATE, 10, data);
 }
 
-static void BDBsrv_locoReportThread (void *pvParameter)
+static void BDBsrv_locoReportCancel (void)
 {
-	bidibmsg_t *m;
-	ldataT *l;
+	free (locoreport.adr);
+	locoreport.adr = NULL;
+	locoreport.count = locoreport.idx = 0;
+}
+
+/**
+ * Start a list report of all locos in the refresh list. A report that is
+ * still running is dropped and the new one starts with a fresh snapshot.
+ * The report itself is sent in batches by BDBsrv_locoReportService().
+ */
+static void BDBsrv_locoReportStart (void)
+{
+	BDBsrv_locoReportCancel();
+	locoreport.adr = loco_snapshot(&locoreport.count);
+}
 
-	(void) pvParameter;
+bool BDBsrv_locoReportPending (void)
+{
+	return locoreport.adr != NULL;
+}
 
-	l = NULL;
-	while ((l = loco_iterateNext(l)) != NULL) {
-		m = BDBsrv_driveState(l->loco->adr, (l->next) ? 0x81 : 0xC1);
-		if (m) netBDB_postMessages(m);
+/**
+ * Send the next batch of a running loco list report. This is called from
+ * the netBiDiB server task as long as a report is pending and the TX queue
+ * of the connection has enough room left.
+ */
+void BDBsrv_locoReportService (void)
+{
+	bidibmsg_t *msgs, **msgpp;
+	int i;
+
+	if (!locoreport.adr) return;
+	if (bidib_opmode() != BIDIB_SERVER) {		// we lost the controlling client
+		BDBsrv_locoReportCancel();
+		return;
+	}
+
+	msgs = NULL;
+	msgpp = &msgs;
+	for (i = 0; i < LOCOREPORT_BATCH && locoreport.idx < locoreport.count; i++, locoreport.idx++) {
+		*msgpp = BDBsrv_driveState(locoreport.adr[locoreport.idx], (locoreport.idx < locoreport.count - 1) ? 0x81 : 0xC1);
+		if (*msgpp) msgpp = &(*msgpp)->next;
 	}
-	vTaskDelete(NULL);		// end the task
+	if (msgs) netBDB_postMessages(msgs);
+	if (locoreport.idx >= locoreport.count) BDBsrv_locoReportCancel();
 }
 
 static void BDBsrv_query (struct bidibnode *n, bidibmsg_t *msg)
@@ -686,7 +735,7 @@ static void BDBsrv_query (struct bidibnode *n, bidibmsg_t *msg)
 		switch (msg->data[0] & 0x0F) {
 			case 1:		// object type is "loco"
 				if (msg->data[0] & 0x80) {		// report all locos (list report, address is ignored)
-				    xTaskCreate(BDBsrv_locoReportThread, "BiDiB-Report", configMINIMAL_STACK_SIZE, NULL, 2, NULL);
+					BDBsrv_locoReportStart();
 				} else if (adr > 0) {			// only report the addressed loco
 					m = BDBsrv_driveState(adr, 0x41);	// END-OF-LIST + object type (1 = loco)
 				} else {						// reporting single loco with no address is not supported
@@ -892,23 +941,27 @@ static void BDBnode_nodeLost (struct bidibnode *n, bidibmsg_t *m)
 	}
 }
 
-static const struct msgdecoder sniffing[] = {
-	{ MSG_SYS_IDENTIFY_STATE,	BDBnode_identifyState },
-	{ MSG_FEATURE_COUNT,		BDBnode_featureCount },
-	{ MSG_FEATURE,				BDBnode_feature },
-	{ MSG_STRING,				BDBnode_string },
-	{ MSG_NODETAB_COUNT,		BDBnode_ntabCount },
-	{ MSG_NODETAB,				BDBnode_nodeTab },
-	{ MSG_NODE_NEW,				BDBnode_nodeTab },			// handled the same as MSG_NODETAB
-	{ MSG_NODE_NA,				BDBnode_nodeNA },
-	{ MSG_NODE_LOST,			BDBnode_nodeLost },
-	{ MSG_ACCESSORY_STATE,		BDBctrl_accessoryState },	// from bidibctrl.c
-	{ MSG_BM_DCCA,				BDBctrl_dcca },				// from bidibctrl.c
-	{ MSG_BM_OCC,				BDBctrl_bmOCC },			// from bidibctrl.c
-	{ MSG_BM_FREE,				BDBctrl_bmFREE },			// from bidibctrl.c
-	{ MSG_BM_MULTIPLE,			BDBctrl_bmMULTIPLE },		// from bidibctrl.c
-	{ 0, NULL }
+static const bdbd_handler sniffing[BDBD_OPCODES] = {
+	[MSG_SYS_IDENTIFY_STATE]	= BDBnode_identifyState,
+	[MSG_FEATURE_COUNT]			= BDBnode_featureCount,
+	[MSG_FEATURE]				= BDBnode_feature,
+	[MSG_STRING]				= BDBnode_string,
+	[MSG_NODETAB_COUNT]			= BDBnode_ntabCount,
+	[MSG_NODETAB]				= BDBnode_nodeTab,
+	[MSG_NODE_NEW]				= BDBnode_nodeTab,			// handled the same as MSG_NODETAB
+	[MSG_NODE_NA]				= BDBnode_nodeNA,
+	[MSG_NODE_LOST]				= BDBnode_nodeLost,
+	[MSG_ACCESSORY_STATE]		= BDBctrl_accessoryState,	// from bidibctrl.c
+	[MSG_BM_DCCA]				= BDBctrl_dcca,				// from bidibctrl.c
+	[MSG_BM_OCC]				= BDBctrl_bmOCC,			// from bidibctrl.c
+	[MSG_BM_FREE]				= BDBctrl_bmFREE,			// from bidibctrl.c
+	[MSG_BM_MULTIPLE]			= BDBctrl_bmMULTIPLE,		// from bidibctrl.c
+	[MSG_BM_ADDRESS]			= BDBbm_address,			// from bidibbm.c
+	[MSG_BM_SPEED]				= BDBbm_speed,				// from bidibbm.c
+	[MSG_BM_DYN_STATE]			= BDBbm_dynState,			// from bidibbm.c
 };
+
+struct bdbd_table BDBsrv_sniffing = { .name = "sniffer", .handler = sniffing };
 #endif
 
 /**
@@ -920,19 +973,11 @@ static const struct msgdecoder sniffing[] = {
 void BDBsrv_upstream (bidibmsg_t *m)
 {
 	struct bidibnode *n /*, *bn*/;
-	const struct msgdecoder *u;
 //	int cnt, len;
 
 	if ((n = BDBnode_lookupNode(m->adrstack)) != NULL) {
 #if 1
-		u = sniffing;
-		while (u->msg) {
-			if (u->msg == m->msg) {
-				if (u->handler) u->handler (n, m);
-				break;
-			}
-			u++;
-		}
+		bdbd_dispatch(&BDBsrv_sniffing, n, m, m->msg);
 #else
 		switch (m->msg) {		// TODO: change to table driven decoding ...
 			case MSG_SYS_IDENTIFY_STATE:
@@ -1009,6 +1054,8 @@ void BDBsrv_upstream (bidibmsg_t *m)
 				break;
 		}
 #endif
+	} else {
+		bdbd_error(&BDBsrv_sniffing, m->msg);
 	}
 }
 
@@ -1088,46 +1135,57 @@ static bool BDBsrv_eventhandler (eventT *e, void *priv)
 	return true;
 }
 
-static bool _BDBsrv_fbHandler (struct bidibnode *n, int module, uint16_t status)
+/**
+ * Report all collected feedback changes to the upstream controller. The
+ * changes of all modules are posted as a single list of MSG_BM_MULTIPLE
+ * messages, so that they leave in as few TCP packets as possible.
+ *
+ * \param t		the timer handle (unused)
+ */
+static void BDBsrv_fbReport (TimerHandle_t t)
 {
-	struct bidibnode *child;
-//	struct feedback_map *fm;
-	struct virtual_feedback *vfb;
-	bidibmsg_t *m;
-	uint8_t data[4];
-
-	log_msg (LOG_INFO, "%s() module %d status 0x%04x\n", __func__, module, status & 0xFFFF);
-	if (!n) n = BDBnode_getRoot();
-	child = n->children;
-	while (child) {
-		if ((child->uid[0] & BIDIB_CLASS_OCCUPANCY) && child->private) {
-			vfb = child->private;
-			if (vfb->base == module * 16) {
-				data[0] = 0;
-				data[1] = 16;
-				data[2] = fb_msb2lsb8(status >> 8);
-				data[3] = fb_msb2lsb8(status & 0xFF);
-				if ((m = bidib_genMessage(child, MSG_BM_MULTIPLE, 4, data)) != NULL) {
-					netBDB_postMessages(m);
-				}
-				return true;
-			}
+	bidibmsg_t *msgs, **tail, *m;
+	uint8_t bytes;
+	int module;
+
+	(void) t;
+
+	msgs = NULL;
+	tail = &msgs;
+	for (module = 0; module < BIDIB_VFB_MODULES; module++) {
+		if (!fbdirty[module]) continue;
+		taskENTER_CRITICAL();
+		bytes = fbdirty[module];
+		fbdirty[module] = 0;
+		taskEXIT_CRITICAL();
+		if ((m = BDBvn_feedbackReport(module, bytes)) != NULL) {
+			*tail = m;
+			tail = &m->next;
 		}
-		if (child->children && _BDBsrv_fbHandler(child, module, status)) break;
-		child = child->next;
 	}
-	return false;
+	if (msgs) netBDB_postMessages(msgs);
 }
 
+/**
+ * Take over a feedback change into the virtual feedback node of the module.
+ * The report is delayed by FBREPORT_DELAY to collect the changes of other
+ * modules (i.e. from the same s88 scan) and send them in one go.
+ */
 static bool BDBsrv_fbHandler (eventT *e, void *priv)
 {
 	fbeventT *fbevt;
+	uint8_t bytes;
 
 	(void) priv;
-	if (bidib_opmode() == BIDIB_CONTROLLER) return true;
 	fbevt = e->src;
 
-	_BDBsrv_fbHandler(NULL, fbevt->module, fbevt->status);
+	bytes = BDBvn_feedbackUpdate(fbevt->module, fbevt->status);
+	if (!bytes || bidib_opmode() == BIDIB_CONTROLLER) return true;
+
+	taskENTER_CRITICAL();
+	fbdirty[fbevt->module] |= bytes;
+	taskEXIT_CRITICAL();
+	if (fbtimer && !xTimerIsTimerActive(fbtimer)) xTimerStart(fbtimer, 0);
 	return true;
 }
 
@@ -1275,40 +1333,41 @@ static void BDBsrv_initFeatures (struct bidibnode *n)
 	}
 }
 
-static const struct msgdecoder downstream[] = {
-	{ MSG_SYS_GET_MAGIC,		BDBnf_sendSysMagic },
-	{ MSG_SYS_GET_P_VERSION,	BDBnf_sendPVersion },
-	{ MSG_SYS_ENABLE,			BDBsrv_sysEnable },
-	{ MSG_SYS_DISABLE,			BDBsrv_sysDisable },
-	{ MSG_SYS_GET_UNIQUE_ID,	BDBnf_sendUniqueID },
-	{ MSG_SYS_GET_SW_VERSION,	BDBnf_sendVersionInfo },
-	{ MSG_SYS_PING,				BDBnf_sendPong },
-	{ MSG_SYS_IDENTIFY,			BDBsrv_identify },
-	{ MSG_SYS_RESET,			BDBsrv_resetSystem },
-	{ MSG_NODETAB_GETALL,		BDBnf_reportNodetab },
-	{ MSG_NODETAB_GETNEXT,		BDBnf_nextNodetab },
-	{ MSG_NODE_CHANGED_ACK,		BDBnode_changeACK },
-	{ MSG_SYS_GET_ERROR,		BDBnf_getError },
-	{ MSG_FEATURE_GETALL,		BDBnf_reportFeatures },
-	{ MSG_FEATURE_GETNEXT,		BDBnf_getNextFeature },
-	{ MSG_FEATURE_GET,			BDBnf_getFeature },
-	{ MSG_FEATURE_SET,			BDBnf_setFeature },
-	{ MSG_STRING_GET,			BDBnf_getString },
-	{ MSG_STRING_SET,			BDBnf_setString },
-	{ MSG_BOOST_OFF,			BDBsrv_boosterOff },
-	{ MSG_BOOST_ON,				BDBsrv_boosterOn },
-	{ MSG_BOOST_QUERY,			BDBsrv_boosterQuery },
-	{ MSG_CS_SET_STATE,			BDBsrv_setState },
-	{ MSG_CS_DRIVE,				BDBsrv_loco },
-	{ MSG_CS_BIN_STATE,			BDBsrv_binstate },
-	{ MSG_CS_ACCESSORY,			BDBsrv_accessory },
-	{ MSG_CS_POM,				BDBsrv_pom },
-	{ MSG_CS_QUERY,				BDBsrv_query },
-	{ MSG_CS_PROG,				BDBsrv_prog },
-	{ MSG_LOCAL_PING,			BDBnf_sendPong },
-	{ 0, NULL }
+static const bdbd_handler downstream[BDBD_OPCODES] = {
+	[MSG_SYS_GET_MAGIC]			= BDBnf_sendSysMagic,
+	[MSG_SYS_GET_P_VERSION]		= BDBnf_sendPVersion,
+	[MSG_SYS_ENABLE]			= BDBsrv_sysEnable,
+	[MSG_SYS_DISABLE]			= BDBsrv_sysDisable,
+	[MSG_SYS_GET_UNIQUE_ID]		= BDBnf_sendUniqueID,
+	[MSG_SYS_GET_SW_VERSION]	= BDBnf_sendVersionInfo,
+	[MSG_SYS_PING]				= BDBnf_sendPong,
+	[MSG_SYS_IDENTIFY]			= BDBsrv_identify,
+	[MSG_SYS_RESET]				= BDBsrv_resetSystem,
+	[MSG_NODETAB_GETALL]		= BDBnf_reportNodetab,
+	[MSG_NODETAB_GETNEXT]		= BDBnf_nextNodetab,
+	[MSG_NODE_CHANGED_ACK]		= BDBnode_changeACK,
+	[MSG_SYS_GET_ERROR]			= BDBnf_getError,
+	[MSG_FEATURE_GETALL]		= BDBnf_reportFeatures,
+	[MSG_FEATURE_GETNEXT]		= BDBnf_getNextFeature,
+	[MSG_FEATURE_GET]			= BDBnf_getFeature,
+	[MSG_FEATURE_SET]			= BDBnf_setFeature,
+	[MSG_STRING_GET]			= BDBnf_getString,
+	[MSG_STRING_SET]			= BDBnf_setString,
+	[MSG_BOOST_OFF]				= BDBsrv_boosterOff,
+	[MSG_BOOST_ON]				= BDBsrv_boosterOn,
+	[MSG_BOOST_QUERY]			= BDBsrv_boosterQuery,
+	[MSG_CS_SET_STATE]			= BDBsrv_setState,
+	[MSG_CS_DRIVE]				= BDBsrv_loco,
+	[MSG_CS_BIN_STATE]			= BDBsrv_binstate,
+	[MSG_CS_ACCESSORY]			= BDBsrv_accessory,
+	[MSG_CS_POM]				= BDBsrv_pom,
+	[MSG_CS_QUERY]				= BDBsrv_query,
+	[MSG_CS_PROG]				= BDBsrv_prog,
+	[MSG_LOCAL_PING]			= BDBnf_sendPong,
 };
 
+struct bdbd_table BDBsrv_downstream = { .name = "server", .handler = downstream };
+
 /**
  * Called when switching to external control to make sure, some changeable features
  * get setup to current values.
@@ -1333,7 +1392,7 @@ struct bidibnode *BDBsrv_genLocalNode (void)
 	strncpy (n->user, cnf_getconfig()->bidib.user, MAX_USER_STRING);
 	n->user[MAX_USER_STRING] = 0;
 	n->pversion = BIDIB_VERSION;
-	n->downstream = downstream;
+	n->downstream = &BDBsrv_downstream;
 	n->flags |= NODEFLG_VIRTUAL;
 
 	return n;
@@ -1353,6 +1412,7 @@ void BDBsrv_start (void)
 		if (diagtimer) xTimerStart(diagtimer, 20);		// if feature is not present, start timer with the default value
 	}
 	event_register(EVENT_SYS_STATUS, BDBsrv_eventhandler, NULL, 0);
+	fbtimer = xTimerCreate("BiDiBfb", pdMS_TO_TICKS(FBREPORT_DELAY), pdFALSE, NULL, BDBsrv_fbReport);
 	event_register(EVENT_FBNEW, BDBsrv_fbHandler, NULL, 0);
 	reply_register (DECODER_ANY, 0, DECODERMSG_ANY, BDBsrv_replyhandler, fvNULL, 0);
 }
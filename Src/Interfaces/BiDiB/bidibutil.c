@@ -55,197 +55,191 @@ static char *bidib_outputNamespaceString (uint8_t *data, int len);
 static char *bidib_outputLocalLink (uint8_t *data, int len);
 static char *bidib_outputProtocollVersion (uint8_t *data, int len);
 
-#define DECODER(x, f)	{ x, #x, f }
-
-// All downward message codes with MSB cleared (i.e. 0x00 .. 0x7F)
-static const struct decoder bidib_downDecoder[] = {
-	DECODER (MSG_SYS_GET_MAGIC,				NULL ),
-	DECODER (MSG_SYS_GET_P_VERSION,			NULL ),
-	DECODER (MSG_SYS_ENABLE,				NULL ),
-	DECODER (MSG_SYS_DISABLE,				NULL ),
-	DECODER (MSG_SYS_GET_UNIQUE_ID,			NULL ),
-	DECODER (MSG_SYS_GET_SW_VERSION,		NULL ),
-	DECODER (MSG_SYS_PING,					NULL ),
-	DECODER (MSG_SYS_IDENTIFY,				NULL ),
-	DECODER (MSG_SYS_RESET,					NULL ),
-	DECODER (MSG_GET_PKT_CAPACITY,			NULL ),
-	DECODER (MSG_NODETAB_GETALL,			NULL ),
-	DECODER (MSG_NODETAB_GETNEXT,			NULL ),
-	DECODER (MSG_NODE_CHANGED_ACK,			NULL ),
-	DECODER (MSG_SYS_GET_ERROR,				NULL ),
-	DECODER (MSG_FW_UPDATE_OP,				NULL ),
+#define DECODER(x, f)		{ x, #x, f }
+#define MSGDECODER(x, f)	[x] = { x, #x, f }
+
+static const struct decoder bidib_msgDecoder[BDBD_OPCODES] = {
+	// All downward message codes with MSB cleared (i.e. 0x00 .. 0x7F)
+	MSGDECODER (MSG_SYS_GET_MAGIC,				NULL ),
+	MSGDECODER (MSG_SYS_GET_P_VERSION,			NULL ),
+	MSGDECODER (MSG_SYS_ENABLE,					NULL ),
+	MSGDECODER (MSG_SYS_DISABLE,				NULL ),
+	MSGDECODER (MSG_SYS_GET_UNIQUE_ID,			NULL ),
+	MSGDECODER (MSG_SYS_GET_SW_VERSION,			NULL ),
+	MSGDECODER (MSG_SYS_PING,					NULL ),
+	MSGDECODER (MSG_SYS_IDENTIFY,				NULL ),
+	MSGDECODER (MSG_SYS_RESET,					NULL ),
+	MSGDECODER (MSG_GET_PKT_CAPACITY,			NULL ),
+	MSGDECODER (MSG_NODETAB_GETALL,				NULL ),
+	MSGDECODER (MSG_NODETAB_GETNEXT,			NULL ),
+	MSGDECODER (MSG_NODE_CHANGED_ACK,			NULL ),
+	MSGDECODER (MSG_SYS_GET_ERROR,				NULL ),
+	MSGDECODER (MSG_FW_UPDATE_OP,				NULL ),
 
 	//-- feature and user config messages
-	DECODER (MSG_FEATURE_GETALL,			NULL ),
-	DECODER (MSG_FEATURE_GETNEXT,			NULL ),
-	DECODER (MSG_FEATURE_GET,				NULL ),
-	DECODER (MSG_FEATURE_SET,				NULL ),
-	DECODER (MSG_VENDOR_ENABLE,				NULL ),
-	DECODER (MSG_VENDOR_DISABLE,			NULL ),
-	DECODER (MSG_VENDOR_SET,				NULL ),
-	DECODER (MSG_VENDOR_GET,				NULL ),
-	DECODER (MSG_SYS_CLOCK,					bidib_outputClock ),
-	DECODER (MSG_STRING_GET,				NULL ),
-	DECODER (MSG_STRING_SET,				NULL ),
+	MSGDECODER (MSG_FEATURE_GETALL,				NULL ),
+	MSGDECODER (MSG_FEATURE_GETNEXT,			NULL ),
+	MSGDECODER (MSG_FEATURE_GET,				NULL ),
+	MSGDECODER (MSG_FEATURE_SET,				NULL ),
+	MSGDECODER (MSG_VENDOR_ENABLE,				NULL ),
+	MSGDECODER (MSG_VENDOR_DISABLE,				NULL ),
+	MSGDECODER (MSG_VENDOR_SET,					NULL ),
+	MSGDECODER (MSG_VENDOR_GET,					NULL ),
+	MSGDECODER (MSG_SYS_CLOCK,					bidib_outputClock ),
+	MSGDECODER (MSG_STRING_GET,					NULL ),
+	MSGDECODER (MSG_STRING_SET,					NULL ),
 
 	//-- occupancy messages
-	DECODER (MSG_BM_GET_RANGE,				NULL ),
-	DECODER (MSG_BM_MIRROR_MULTIPLE,		NULL ),
-	DECODER (MSG_BM_MIRROR_OCC,				NULL ),
-	DECODER (MSG_BM_MIRROR_FREE,			NULL ),
-	DECODER (MSG_BM_ADDR_GET_RANGE,			NULL ),
-	DECODER (MSG_BM_GET_CONFIDENCE,			NULL ),
-	DECODER (MSG_BM_MIRROR_POSITION,		NULL ),
+	MSGDECODER (MSG_BM_GET_RANGE,				NULL ),
+	MSGDECODER (MSG_BM_MIRROR_MULTIPLE,			NULL ),
+	MSGDECODER (MSG_BM_MIRROR_OCC,				NULL ),
+	MSGDECODER (MSG_BM_MIRROR_FREE,				NULL ),
+	MSGDECODER (MSG_BM_ADDR_GET_RANGE,			NULL ),
+	MSGDECODER (MSG_BM_GET_CONFIDENCE,			NULL ),
+	MSGDECODER (MSG_BM_MIRROR_POSITION,			NULL ),
 
 	//-- booster messages
-	DECODER (MSG_BOOST_OFF,					NULL ),
-	DECODER (MSG_BOOST_ON,					NULL ),
-	DECODER (MSG_BOOST_QUERY,				NULL ),
+	MSGDECODER (MSG_BOOST_OFF,					NULL ),
+	MSGDECODER (MSG_BOOST_ON,					NULL ),
+	MSGDECODER (MSG_BOOST_QUERY,				NULL ),
 
 	//-- accessory control messages
-	DECODER (MSG_ACCESSORY_SET,				NULL ),
-	DECODER (MSG_ACCESSORY_GET,				NULL ),
-	DECODER (MSG_ACCESSORY_PARA_SET,		NULL ),
-	DECODER (MSG_ACCESSORY_PARA_GET,		NULL ),
-	DECODER (MSG_ACCESSORY_GETALL,			NULL ),
+	MSGDECODER (MSG_ACCESSORY_SET,				NULL ),
+	MSGDECODER (MSG_ACCESSORY_GET,				NULL ),
+	MSGDECODER (MSG_ACCESSORY_PARA_SET,			NULL ),
+	MSGDECODER (MSG_ACCESSORY_PARA_GET,			NULL ),
+	MSGDECODER (MSG_ACCESSORY_GETALL,			NULL ),
 
 	//-- switch/light/servo control messages
-	DECODER (MSG_LC_PORT_QUERY_ALL,			NULL ),
-	DECODER (MSG_LC_OUTPUT,					NULL ),
-	DECODER (MSG_LC_CONFIG_SET,				NULL ),
-	DECODER (MSG_LC_CONFIG_GET,				NULL ),
-	DECODER (MSG_LC_KEY_QUERY,				NULL ),
-	DECODER (MSG_LC_OUTPUT_QUERY,			NULL ),
-	DECODER (MSG_LC_PORT_QUERY,				NULL ),
-	DECODER (MSG_LC_CONFIGX_GET_ALL,		NULL ),
-	DECODER (MSG_LC_CONFIGX_SET,			NULL ),
-	DECODER (MSG_LC_CONFIGX_GET,			NULL ),
+	MSGDECODER (MSG_LC_PORT_QUERY_ALL,			NULL ),
+	MSGDECODER (MSG_LC_OUTPUT,					NULL ),
+	MSGDECODER (MSG_LC_CONFIG_SET,				NULL ),
+	MSGDECODER (MSG_LC_CONFIG_GET,				NULL ),
+	MSGDECODER (MSG_LC_KEY_QUERY,				NULL ),
+	MSGDECODER (MSG_LC_OUTPUT_QUERY,			NULL ),
+//	MSGDECODER (MSG_LC_PORT_QUERY,				NULL ),	// same code as MSG_LC_OUTPUT_QUERY
+	MSGDECODER (MSG_LC_CONFIGX_GET_ALL,			NULL ),
+	MSGDECODER (MSG_LC_CONFIGX_SET,				NULL ),
+	MSGDECODER (MSG_LC_CONFIGX_GET,				NULL ),
 
 	//-- macro messages
-	DECODER (MSG_LC_MACRO_HANDLE,			NULL ),
-	DECODER (MSG_LC_MACRO_SET,				NULL ),
-	DECODER (MSG_LC_MACRO_GET,				NULL ),
-	DECODER (MSG_LC_MACRO_PARA_SET,			NULL ),
-	DECODER (MSG_LC_MACRO_PARA_GET,			NULL ),
+	MSGDECODER (MSG_LC_MACRO_HANDLE,			NULL ),
+	MSGDECODER (MSG_LC_MACRO_SET,				NULL ),
+	MSGDECODER (MSG_LC_MACRO_GET,				NULL ),
+	MSGDECODER (MSG_LC_MACRO_PARA_SET,			NULL ),
+	MSGDECODER (MSG_LC_MACRO_PARA_GET,			NULL ),
 
 	//-- distributed control messages
-	DECODER (MSG_DDIS,						NULL ),
-
-	DECODER (MSG_CS_ALLOCATE,				NULL ),
-	DECODER (MSG_CS_SET_STATE,				NULL ),
-	DECODER (MSG_CS_DRIVE,					NULL ),
-	DECODER (MSG_CS_ACCESSORY,				bidib_outputAccessory ),
-	DECODER (MSG_CS_BIN_STATE,				NULL ),
-	DECODER (MSG_CS_POM,					NULL ),
-	DECODER (MSG_CS_RCPLUS,					NULL ),
-	DECODER (MSG_CS_M4,						NULL ),
-	DECODER (MSG_CS_QUERY,					NULL ),
-	DECODER (MSG_CS_DCCA,					NULL ),
+	MSGDECODER (MSG_DDIS,						NULL ),
+
+	MSGDECODER (MSG_CS_ALLOCATE,				NULL ),
+	MSGDECODER (MSG_CS_SET_STATE,				NULL ),
+	MSGDECODER (MSG_CS_DRIVE,					NULL ),
+	MSGDECODER (MSG_CS_ACCESSORY,				bidib_outputAccessory ),
+	MSGDECODER (MSG_CS_BIN_STATE,				NULL ),
+	MSGDECODER (MSG_CS_POM,						NULL ),
+	MSGDECODER (MSG_CS_RCPLUS,					NULL ),
+	MSGDECODER (MSG_CS_M4,						NULL ),
+	MSGDECODER (MSG_CS_QUERY,					NULL ),
+	MSGDECODER (MSG_CS_DCCA,					NULL ),
 
 	//-- service mode
-	DECODER (MSG_CS_PROG,					NULL ),
-
-	DECODER (MSG_LOCAL_LOGON_ACK,			bidib_outputNodeUID ),
-	DECODER (MSG_LOGON_ACK,					NULL ),
-	DECODER (MSG_LOCAL_PING,				NULL ),
-	DECODER (MSG_LOCAL_LOGON_REJECTED,		bidib_outputUID ),
-	DECODER (MSG_LOGON_REJECTED,			NULL ),
-	DECODER (MSG_LOCAL_ACCESSORY,			NULL ),
-	DECODER (MSG_LOCAL_SYNC,				NULL ),
-	DECODER (MSG_LOCAL_DISCOVER,			NULL ),
-	DECODER (MSG_LOCAL_BIDIB_DOWN,			NULL ),
-
-
-	{ 0, NULL, NULL }
-};
-
-// All upward message codes with MSB set (i.e. 0x80 .. 0xFF)
-static const struct decoder bidib_upDecoder[] = {
-	DECODER (MSG_SYS_MAGIC,					NULL ),
-	DECODER (MSG_SYS_PONG,					NULL ),
-	DECODER (MSG_SYS_P_VERSION,				NULL ),
-	DECODER (MSG_SYS_UNIQUE_ID,				NULL ),
-	DECODER (MSG_SYS_SW_VERSION,			NULL ),
-	DECODER (MSG_SYS_ERROR,					NULL ),
-	DECODER (MSG_SYS_IDENTIFY_STATE,		NULL ),
-	DECODER (MSG_NODETAB_COUNT,				NULL ),
-	DECODER (MSG_NODETAB,					NULL ),
-	DECODER (MSG_PKT_CAPACITY,				NULL ),
-	DECODER (MSG_NODE_NA,					NULL ),
-	DECODER (MSG_NODE_LOST,					NULL ),
-	DECODER (MSG_NODE_NEW,					NULL ),
-	DECODER (MSG_STALL,						NULL ),
-	DECODER (MSG_FW_UPDATE_STAT,			NULL ),
-
-	DECODER (MSG_FEATURE,					NULL ),
-	DECODER (MSG_FEATURE_NA,				NULL ),
-	DECODER (MSG_FEATURE_COUNT,				NULL ),
-	DECODER (MSG_VENDOR,					NULL ),
-	DECODER (MSG_VENDOR_ACK,				NULL ),
-	DECODER (MSG_STRING,					bidib_outputNamespaceString ),
-
-	DECODER (MSG_BM_OCC,					NULL ),
-	DECODER (MSG_BM_FREE,					NULL ),
-	DECODER (MSG_BM_MULTIPLE,				NULL ),
-	DECODER (MSG_BM_ADDRESS,				NULL ),
-	DECODER (MSG_BM_ACCESSORY,				NULL ),
-	DECODER (MSG_BM_CV,						NULL ),
-	DECODER (MSG_BM_SPEED,					NULL ),
-	DECODER (MSG_BM_CURRENT,				NULL ),
-	DECODER (MSG_BM_BLOCK_CV,				NULL ),
-	DECODER (MSG_BM_XPOM,					NULL ),
-	DECODER (MSG_BM_CONFIDENCE,				NULL ),
-	DECODER (MSG_BM_DYN_STATE,				NULL ),
-	DECODER (MSG_BM_RCPLUS,					NULL ),
-	DECODER (MSG_BM_DCCA,					NULL ),
-	DECODER (MSG_BM_POSITION,				NULL ),
-
-	DECODER (MSG_BOOST_STAT,				NULL ),
-	DECODER (MSG_BOOST_CURRENT,				NULL ),
-	DECODER (MSG_BOOST_DIAGNOSTIC,			NULL ),
-
-	DECODER (MSG_ACCESSORY_STATE,			NULL ),
-	DECODER (MSG_ACCESSORY_PARA,			NULL ),
-	DECODER (MSG_ACCESSORY_NOTIFY,			NULL ),
-
-	DECODER (MSG_LC_STAT,					NULL ),
-	DECODER (MSG_LC_NA,						NULL ),
-	DECODER (MSG_LC_CONFIG,					NULL ),
-	DECODER (MSG_LC_KEY,					NULL ),
-	DECODER (MSG_LC_WAIT,					NULL ),
-	DECODER (MSG_LC_CONFIGX,				NULL ),
-
-	DECODER (MSG_LC_MACRO_STATE,			NULL ),
-	DECODER (MSG_LC_MACRO,					NULL ),
-	DECODER (MSG_LC_MACRO_PARA,				NULL ),
-
-	DECODER (MSG_UDIS,						NULL ),
-
-	DECODER (MSG_CS_ALLOC_ACK,				NULL ),
-	DECODER (MSG_CS_STATE,					NULL ),
-	DECODER (MSG_CS_DRIVE_ACK,				NULL ),
-	DECODER (MSG_CS_ACCESSORY_ACK,			NULL ),
-	DECODER (MSG_CS_POM_ACK,				NULL ),
-	DECODER (MSG_CS_DRIVE_MANUAL,			NULL ),
-	DECODER (MSG_CS_DRIVE_EVENT,			NULL ),
-	DECODER (MSG_CS_ACCESSORY_MANUAL,		NULL ),
-	DECODER (MSG_CS_RCPLUS_ACK,				NULL ),
-	DECODER (MSG_CS_M4_ACK,					NULL ),
-	DECODER (MSG_CS_DRIVE_STATE,			NULL ),
-	DECODER (MSG_CS_DCCA_ACK,				NULL ),
-
-	DECODER (MSG_CS_PROG_STATE,				NULL ),
-
-	DECODER (MSG_LOCAL_LOGON,				bidib_outputUID ),
-	DECODER (MSG_LOCAL_PONG,				NULL ),
-	DECODER (MSG_LOCAL_LOGOFF,				bidib_outputUID ),
-	DECODER (MSG_LOCAL_ANNOUNCE,			NULL ),
-	DECODER (MSG_LOCAL_BIDIB_UP,			NULL ),
-
-	DECODER (MSG_LOCAL_PROTOCOL_SIGNATURE,	bidib_outputString ),
-	DECODER (MSG_LOCAL_LINK,				bidib_outputLocalLink ),
-
-	{ 0, NULL, NULL }
+	MSGDECODER (MSG_CS_PROG,					NULL ),
+
+	MSGDECODER (MSG_LOCAL_LOGON_ACK,			bidib_outputNodeUID ),
+//	MSGDECODER (MSG_LOGON_ACK,					NULL ),	// same code as MSG_LOCAL_LOGON_ACK
+	MSGDECODER (MSG_LOCAL_PING,					NULL ),
+	MSGDECODER (MSG_LOCAL_LOGON_REJECTED,		bidib_outputUID ),
+//	MSGDECODER (MSG_LOGON_REJECTED,			NULL ),	// same code as MSG_LOCAL_LOGON_REJECTED
+	MSGDECODER (MSG_LOCAL_ACCESSORY,			NULL ),
+	MSGDECODER (MSG_LOCAL_SYNC,					NULL ),
+	MSGDECODER (MSG_LOCAL_DISCOVER,				NULL ),
+	MSGDECODER (MSG_LOCAL_BIDIB_DOWN,			NULL ),
+
+	// All upward message codes with MSB set (i.e. 0x80 .. 0xFF)
+	MSGDECODER (MSG_SYS_MAGIC,					NULL ),
+	MSGDECODER (MSG_SYS_PONG,					NULL ),
+	MSGDECODER (MSG_SYS_P_VERSION,				NULL ),
+	MSGDECODER (MSG_SYS_UNIQUE_ID,				NULL ),
+	MSGDECODER (MSG_SYS_SW_VERSION,				NULL ),
+	MSGDECODER (MSG_SYS_ERROR,					NULL ),
+	MSGDECODER (MSG_SYS_IDENTIFY_STATE,			NULL ),
+	MSGDECODER (MSG_NODETAB_COUNT,				NULL ),
+	MSGDECODER (MSG_NODETAB,					NULL ),
+	MSGDECODER (MSG_PKT_CAPACITY,				NULL ),
+	MSGDECODER (MSG_NODE_NA,					NULL ),
+	MSGDECODER (MSG_NODE_LOST,					NULL ),
+	MSGDECODER (MSG_NODE_NEW,					NULL ),
+	MSGDECODER (MSG_STALL,						NULL ),
+	MSGDECODER (MSG_FW_UPDATE_STAT,				NULL ),
+
+	MSGDECODER (MSG_FEATURE,					NULL ),
+	MSGDECODER (MSG_FEATURE_NA,					NULL ),
+	MSGDECODER (MSG_FEATURE_COUNT,				NULL ),
+	MSGDECODER (MSG_VENDOR,						NULL ),
+	MSGDECODER (MSG_VENDOR_ACK,					NULL ),
+	MSGDECODER (MSG_STRING,						bidib_outputNamespaceString ),
+
+	MSGDECODER (MSG_BM_OCC,						NULL ),
+	MSGDECODER (MSG_BM_FREE,					NULL ),
+	MSGDECODER (MSG_BM_MULTIPLE,				NULL ),
+	MSGDECODER (MSG_BM_ADDRESS,					NULL ),
+	MSGDECODER (MSG_BM_ACCESSORY,				NULL ),
+	MSGDECODER (MSG_BM_CV,						NULL ),
+	MSGDECODER (MSG_BM_SPEED,					NULL ),
+	MSGDECODER (MSG_BM_CURRENT,					NULL ),
+	MSGDECODER (MSG_BM_BLOCK_CV,				NULL ),
+//	MSGDECODER (MSG_BM_XPOM,					NULL ),	// same code as MSG_BM_BLOCK_CV
+	MSGDECODER (MSG_BM_CONFIDENCE,				NULL ),
+	MSGDECODER (MSG_BM_DYN_STATE,				NULL ),
+	MSGDECODER (MSG_BM_RCPLUS,					NULL ),
+//	MSGDECODER (MSG_BM_DCCA,					NULL ),	// same code as MSG_BM_RCPLUS
+	MSGDECODER (MSG_BM_POSITION,				NULL ),
+
+	MSGDECODER (MSG_BOOST_STAT,					NULL ),
+	MSGDECODER (MSG_BOOST_CURRENT,				NULL ),
+	MSGDECODER (MSG_BOOST_DIAGNOSTIC,			NULL ),
+
+	MSGDECODER (MSG_ACCESSORY_STATE,			NULL ),
+	MSGDECODER (MSG_ACCESSORY_PARA,				NULL ),
+	MSGDECODER (MSG_ACCESSORY_NOTIFY,			NULL ),
+
+	MSGDECODER (MSG_LC_STAT,					NULL ),
+	MSGDECODER (MSG_LC_NA,						NULL ),
+	MSGDECODER (MSG_LC_CONFIG,					NULL ),
+	MSGDECODER (MSG_LC_KEY,						NULL ),
+	MSGDECODER (MSG_LC_WAIT,					NULL ),
+	MSGDECODER (MSG_LC_CONFIGX,					NULL ),
+
+	MSGDECODER (MSG_LC_MACRO_STATE,				NULL ),
+	MSGDECODER (MSG_LC_MACRO,					NULL ),
+	MSGDECODER (MSG_LC_MACRO_PARA,				NULL ),
+
+	MSGDECODER (MSG_UDIS,						NULL ),
+
+	MSGDECODER (MSG_CS_ALLOC_ACK,				NULL ),
+	MSGDECODER (MSG_CS_STATE,					NULL ),
+	MSGDECODER (MSG_CS_DRIVE_ACK,				NULL ),
+	MSGDECODER (MSG_CS_ACCESSORY_ACK,			NULL ),
+	MSGDECODER (MSG_CS_POM_ACK,					NULL ),
+	MSGDECODER (MSG_CS_DRIVE_MANUAL,			NULL ),
+	MSGDECODER (MSG_CS_DRIVE_EVENT,				NULL ),
+	MSGDECODER (MSG_CS_ACCESSORY_MANUAL,		NULL ),
+	MSGDECODER (MSG_CS_RCPLUS_ACK,				NULL ),
+	MSGDECODER (MSG_CS_M4_ACK,					NULL ),
+	MSGDECODER (MSG_CS_DRIVE_STATE,				NULL ),
+	MSGDECODER (MSG_CS_DCCA_ACK,				NULL ),
+
+	MSGDECODER (MSG_CS_PROG_STATE,				NULL ),
+
+	MSGDECODER (MSG_LOCAL_LOGON,				bidib_outputUID ),
+	MSGDECODER (MSG_LOCAL_PONG,					NULL ),
+	MSGDECODER (MSG_LOCAL_LOGOFF,				bidib_outputUID ),
+	MSGDECODER (MSG_LOCAL_ANNOUNCE,				NULL ),
+	MSGDECODER (MSG_LOCAL_BIDIB_UP,				NULL ),
+
+	MSGDECODER (MSG_LOCAL_PROTOCOL_SIGNATURE,	bidib_outputString ),
+	MSGDECODER (MSG_LOCAL_LINK,					bidib_outputLocalLink ),
 };
 
 static const struct decoder bidib_localLinkDecoder[] = {
@@ -460,7 +454,7 @@ void bidib_debugSingleMessage (const char *caller, struct bidibmsg *msg, bool up
 		return;
 	}
 	sprintf (msgnum, "0x%02x", msg->msg);	// just in case this message is not known
-	d = bidib_matchCommand(msg->msg, (msg->msg & 0x80) ? bidib_upDecoder : bidib_downDecoder);
+	d = &bidib_msgDecoder[msg->msg];
 	if (d->command && d->handler) {
 		content = d->handler(msg->data, msg->datalen);
 	} else {
@@ -504,6 +498,33 @@ void bidib_debugError (const char *caller, struct bidibmsg *msg)
 	mutex_unlock(&mutex);
 }
 
+/**
+ * Get the symbolic name of a message type.
+ *
+ * \param msg		the message type
+ * eturn			the name of the message (i.e. "MSG_SYS_MAGIC") or NULL if the message is not known
+ */
+const char *bidib_msgName (uint8_t msg)
+{
+	return bidib_msgDecoder[msg].command;
+}
+
+/**
+ * Iterate over all dispatch tables, i.e. to report the statistics.
+ *
+ * \param idx		the index of the table starting with 0
+ * eturn			the dispatch table or NULL if the index is behind the last table
+ */
+struct bdbd_table *bidib_dispatchTable (int idx)
+{
+	static struct bdbd_table * const tables[] = {
+		&BDBctrl_upstream, &BDBsrv_sniffing, &BDBsrv_downstream, &BDBvn_bridgeDown, &BDBvn_feedbackDown
+	};
+
+	if (idx < 0 || idx >= DIM(tables)) return NULL;
+	return tables[idx];
+}
+
 /**
  * Format an UID to a temporary string.
  *
@@ -895,45 +916,31 @@ int bidib_packAllMessages (bidibmsg_t *bm, uint8_t *data, int maxlen)
 bidibmsg_t *bidib_unpackMessages (uint8_t *pkt, int packetlen, uint8_t adr)
 {
 	bidibmsg_t *msgs, **msgpp;
-	int messagelen, adrstacklen, datalen;
-	uint8_t *end, *p;
+	struct bdbp_view v;
 	adrstack_t stack;
+	int pos, rc;
 
 	if (!pkt || packetlen <= 0) return NULL;
-	end = pkt + packetlen;					// points just behind the last byte
 	msgs = NULL;
 	msgpp = &msgs;
-	while (pkt < end) {
-		p = pkt;
-		messagelen = *p++;							// MSG_LENGTH includes address stack, MSG_NUM, MSG_TYPE and optional message data
-		if (messagelen < 3) {
-			fprintf (stderr, "%s(): illegal MESSAGE-LENGTH %d - packet ignored\n", __func__, messagelen);
-			bidib_errorMessage(LOCAL_NODE(), BIDIB_ERR_SUBPAKET, 1, &adr);
-			return msgs;		// return only what we have received as valid packet
-		}
-		stack = bidib_adrReadMsg(p);
-		adrstacklen = bidib_adrStackLen(stack);
+	pos = 0;
+	while ((rc = bdbp_next(pkt, packetlen, &pos, &v)) > 0) {
+		stack = v.adrstack;
 		if (adr) stack = (stack >> 8) | (adr << 24);	// insert the address from the node we received this message from
-//		log_msg (LOG_BIDIB, "%s(): STACK=0x%08lx, Stacklen=%d\n", __func__, stack, adrstacklen);
-		datalen = messagelen - adrstacklen - 2;
-		if ((*msgpp = calloc (1, sizeof(*msgs) + datalen)) == NULL) break;
+		if ((*msgpp = calloc (1, sizeof(*msgs) + v.datalen)) == NULL) break;
 		(*msgpp)->adrstack = stack;
-		p += adrstacklen;
-		(*msgpp)->seq = *p++;
-		(*msgpp)->msg = *p++;
-		(*msgpp)->datalen = datalen;
-		memcpy ((*msgpp)->data, p, datalen);		// subtract the already interpreted bytes and add one for the MSG_LENGTH byte
-
-		pkt += messagelen + 1;			// the messagelen doesn't include the MSG_LENGTH byte itself
-		if (pkt > end) {				// STOP: the message was bigger than the (rest of the) buffer provided - last packet was invalid
-			free (*msgpp);
-			*msgpp = NULL;
-			break;						// we must not continue!
-		}
+		(*msgpp)->seq = v.seq;
+		(*msgpp)->msg = v.msg;
+		(*msgpp)->datalen = v.datalen;
+		memcpy ((*msgpp)->data, v.data, v.datalen);
 		msgpp = &(*msgpp)->next;
 	}
+	if (rc < 0) {		// the rest of the packet is invalid - we must not continue
+		fprintf (stderr, "%s(): illegal MESSAGE at offset %d of %d - rest of packet ignored\n", __func__, pos, packetlen);
+		bidib_errorMessage(LOCAL_NODE(), BIDIB_ERR_SUBPAKET, 1, &adr);
+	}
 
-	return msgs;
+	return msgs;		// return only what we have received as valid messages
 }
 
 /* ======================================================================================= */
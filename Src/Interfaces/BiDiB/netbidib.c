@@ -29,10 +29,16 @@
 #include "bidib.h"
 #include "config.h"
 #include "events.h"
+#include "swdog.h"
 #include "lwip/sockets.h"
 
 #define BIDIBSERVER_STACK		2048			///< allocated stack for the netBiDiB server interpreter
 #define BIDIBSERVER_PRIO		1				///< the standard priority for the server thread
+#define TXPIPE_LENGTH			32				///< number of entries in the TX pipe
+#define TXPIPE_RESERVE			16				///< free entries in the TX pipe that are kept for normal traffic when sending list reports
+#define TXBUFFER_SIZE			512				///< the buffer to collect messages for a single TCP write (at least one maximum sized message)
+#define REPORT_POLL				10				///< the time in ms to wait for room in the TX pipe when a list report is pending
+#define WRITER_WDOG_TIMEOUT		30000			///< the maximum time in ms a TCP write may block (i.e. a client that does not read)
 
 //#define TRUST_ALWAYS							///< if defined, all connecting clients are trusted
 
@@ -77,10 +83,10 @@ static TaskHandle_t task;						///< the server task (can be queried via netBDB_g
 
 /**
  * Send all linked messages over the socket.
- * The messages are packed to a byte buffer and this buffer is then
- * transmitted to the socket. If the currently prepared message has
- * the next pointer set, then the flag MSG_MORE is used to indicate
- * that it may make sense to buffer the contents before transmission.
+ * The messages are packed to a byte buffer as long as they fit into it and
+ * the whole buffer is then transmitted to the socket with a single write.
+ * If more messages follow, the flag MSG_MORE is used to indicate that it
+ * may make sense to buffer the contents before transmission.
  *
  * \param s		the socket to use for sending
  * \param m		the linked messages to send
@@ -89,27 +95,42 @@ static TaskHandle_t task;						///< the server task (can be queried via netBDB_g
 static int netBDB_sendMessages (int s, bidibmsg_t *m)
 {
 	int rc, len, total;
-	uint8_t *packet;
+	uint8_t *packet, *p;
 
 	if (s < 0 || !m) return 0;
 //	bidib_debugMessages (__func__, m, true);
-	if ((packet = malloc (300)) == NULL) return -1;
+	if ((packet = malloc (TXBUFFER_SIZE)) == NULL) return -1;
 	total = 0;
 
 	while (m) {
-		len = bidib_packMessage(m, packet) - packet;
-		if (len > 0) {
-			rc = lwip_send(s, packet, len, (m->next) ? MSG_MORE : 0);
-			if (rc != len) break;
-			total += rc;
+		p = packet;
+		while (m && (p - packet) + bidib_packSize(m) <= TXBUFFER_SIZE) {
+			p = bidib_packMessage(m, p);
+			m = m->next;
 		}
-		m = m->next;
+		len = p - packet;
+		if (len <= 0) break;		// a single message exceeds the buffer - cannot happen with valid messages
+		rc = lwip_send(s, packet, len, (m) ? MSG_MORE : 0);
+		if (rc != len) break;
+		total += rc;
 	}
 
 	free (packet);
 	return total;
 }
 
+/**
+ * Check if there is enough room in the TX pipe to post the next batch of
+ * a list report. This way a long list report cannot flood the TX pipe and
+ * follows the speed of the TCP connection.
+ *
+ * \return		true, if another batch of a list report may be posted
+ */
+static bool netBDB_txReady (void)
+{
+	return txpipe && uxQueueSpacesAvailable(txpipe) > TXPIPE_RESERVE;
+}
+
 static void netBDB_postMessagesLocal (struct conninfo *ci, bidibmsg_t *msgs)
 {
 	struct txmessage tx;
@@ -599,13 +620,17 @@ static void netBDB_writer (void *pvParameter)
 
 	(void) pvParameter;
 
-	if ((txpipe = xQueueCreate(32, sizeof (struct txmessage))) == NULL) {
+	if ((txpipe = xQueueCreate(TXPIPE_LENGTH, sizeof (struct txmessage))) == NULL) {
 		fprintf (stderr, "%s() cannot create queue for message piping\n", __func__);
 		vTaskDelete (NULL);
 	}
 
+	wdog_register(NULL, WRITER_WDOG_TIMEOUT);
+
 	for (;;) {
+		wdog_idle();
 		if (xQueueReceive(txpipe, &tx, portMAX_DELAY) == pdTRUE) {
+			wdog_kick();
 			ci = tx.ci;			// save the first connection and it's messages
 			msgs = tx.msgs;
 			msgpp = &msgs;
@@ -631,6 +656,7 @@ static void netBDB_server (void *pvParameter)
 	struct sysconf *cfg;
 	struct conninfo *ci, *cinext;
 	struct sockaddr_in client;
+	struct timeval tv;
 	socklen_t size;
 	int accept_socket, newsocket, nfds, rc;
 	fd_set rfds, efds;
@@ -660,7 +686,9 @@ static void netBDB_server (void *pvParameter)
 			}
 			ci = ci->next;
 		}
-		rc = lwip_select(nfds, &rfds, NULL, &efds, NULL);
+		tv.tv_sec = 0;
+		tv.tv_usec = REPORT_POLL * 1000;
+		rc = lwip_select(nfds, &rfds, NULL, &efds, BDBsrv_locoReportPending() ? &tv : NULL);
 		if (rc < 0) break;		// an error condition
 		if (rc > 0) {			// at least one fd_set has bits set
 			if (FD_ISSET(accept_socket, &efds)) break;	// error in accept socket
@@ -686,6 +714,7 @@ static void netBDB_server (void *pvParameter)
 				ci = cinext;
 			}
 		}
+		while (BDBsrv_locoReportPending() && netBDB_txReady()) BDBsrv_locoReportService();
 	}
 
 	// close all sockets
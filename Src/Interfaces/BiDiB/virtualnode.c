@@ -153,71 +153,66 @@ static void BDBvn_mirrorFREE (struct bidibnode *n, bidibmsg_t *msg);
 static void BDBvn_mirrorMultiple (struct bidibnode *n, bidibmsg_t *msg);
 static void BDBvn_getConfidence (struct bidibnode *n, bidibmsg_t *msg);
 
-static const struct msgdecoder bridge_down[] = {
-	{ MSG_SYS_GET_MAGIC,		BDBnf_sendSysMagic },
-	{ MSG_SYS_GET_P_VERSION,	BDBnf_sendPVersion },
-	{ MSG_SYS_ENABLE,			BDBvn_sysEnable },
-	{ MSG_SYS_DISABLE,			BDBvn_sysDisable },
-	{ MSG_SYS_GET_UNIQUE_ID,	BDBnf_sendUniqueID },
-	{ MSG_SYS_GET_SW_VERSION,	BDBnf_sendVersionInfo },
-	{ MSG_SYS_PING,				BDBnf_sendPong },
-	{ MSG_SYS_IDENTIFY,			BDBvn_identify },
-//	{ MSG_SYS_RESET,			BDBsrv_resetSystem },
-	{ MSG_NODETAB_GETALL,		BDBnf_reportNodetab },
-	{ MSG_NODETAB_GETNEXT,		BDBnf_nextNodetab },
-	{ MSG_NODE_CHANGED_ACK,		BDBnode_changeACK },
-	{ MSG_SYS_GET_ERROR,		BDBnf_getError },
-	{ MSG_FEATURE_GETALL,		BDBnf_reportFeatures },
-	{ MSG_FEATURE_GETNEXT,		BDBnf_getNextFeature },
-	{ MSG_FEATURE_GET,			BDBnf_getFeature },
-	{ MSG_FEATURE_SET,			BDBnf_setFeature },
-	{ MSG_SYS_CLOCK,			BDBnf_sysClock },
-	{ MSG_STRING_GET,			BDBnf_getString },
-	{ MSG_STRING_SET,			BDBnf_setString },
-	{ 0, NULL }
+static const bdbd_handler bridge_down[BDBD_OPCODES] = {
+	[MSG_SYS_GET_MAGIC]			= BDBnf_sendSysMagic,
+	[MSG_SYS_GET_P_VERSION]		= BDBnf_sendPVersion,
+	[MSG_SYS_ENABLE]			= BDBvn_sysEnable,
+	[MSG_SYS_DISABLE]			= BDBvn_sysDisable,
+	[MSG_SYS_GET_UNIQUE_ID]		= BDBnf_sendUniqueID,
+	[MSG_SYS_GET_SW_VERSION]	= BDBnf_sendVersionInfo,
+	[MSG_SYS_PING]				= BDBnf_sendPong,
+	[MSG_SYS_IDENTIFY]			= BDBvn_identify,
+//	[MSG_SYS_RESET]			= BDBsrv_resetSystem,
+	[MSG_NODETAB_GETALL]		= BDBnf_reportNodetab,
+	[MSG_NODETAB_GETNEXT]		= BDBnf_nextNodetab,
+	[MSG_NODE_CHANGED_ACK]		= BDBnode_changeACK,
+	[MSG_SYS_GET_ERROR]			= BDBnf_getError,
+	[MSG_FEATURE_GETALL]		= BDBnf_reportFeatures,
+	[MSG_FEATURE_GETNEXT]		= BDBnf_getNextFeature,
+	[MSG_FEATURE_GET]			= BDBnf_getFeature,
+	[MSG_FEATURE_SET]			= BDBnf_setFeature,
+	[MSG_SYS_CLOCK]				= BDBnf_sysClock,
+	[MSG_STRING_GET]			= BDBnf_getString,
+	[MSG_STRING_SET]			= BDBnf_setString,
 };
 
-static const struct msgdecoder fb_down[] = {
-	{ MSG_SYS_GET_MAGIC,		BDBnf_sendSysMagic },
-	{ MSG_SYS_GET_P_VERSION,	BDBnf_sendPVersion },
-	{ MSG_SYS_ENABLE,			BDBvn_sysEnable },
-	{ MSG_SYS_DISABLE,			BDBvn_sysDisable },
-	{ MSG_SYS_GET_UNIQUE_ID,	BDBnf_sendUniqueID },
-	{ MSG_SYS_GET_SW_VERSION,	BDBnf_sendVersionInfo },
-	{ MSG_SYS_PING,				BDBnf_sendPong },
-	{ MSG_SYS_IDENTIFY,			BDBvn_identify },
-	{ MSG_NODETAB_GETALL,		BDBvn_reportNodetabSingle },
-	{ MSG_NODETAB_GETNEXT,		BDBvn_nextNodetabSingle },
-	{ MSG_SYS_GET_ERROR,		BDBnf_getError },
-	{ MSG_FEATURE_GETALL,		BDBnf_reportFeatures },
-	{ MSG_FEATURE_GETNEXT,		BDBnf_getNextFeature },
-	{ MSG_FEATURE_GET,			BDBnf_getFeature },
-	{ MSG_FEATURE_SET,			BDBnf_setFeature },
-	{ MSG_SYS_CLOCK,			BDBnf_sysClock },
-	{ MSG_STRING_GET,			BDBnf_getString },
-	{ MSG_STRING_SET,			BDBnf_setString },
-	{ MSG_BM_GET_RANGE,			BDBvn_getRange },
-	{ MSG_BM_MIRROR_OCC,		BDBvn_mirrorOCC },
-	{ MSG_BM_MIRROR_FREE,		BDBvn_mirrorFREE },
-	{ MSG_BM_MIRROR_MULTIPLE,	BDBvn_mirrorMultiple },
-	{ MSG_BM_GET_CONFIDENCE,	BDBvn_getConfidence },
-	{ 0, NULL }
+struct bdbd_table BDBvn_bridgeDown = { .name = "bridge", .handler = bridge_down };
+
+static const bdbd_handler fb_down[BDBD_OPCODES] = {
+	[MSG_SYS_GET_MAGIC]			= BDBnf_sendSysMagic,
+	[MSG_SYS_GET_P_VERSION]		= BDBnf_sendPVersion,
+	[MSG_SYS_ENABLE]			= BDBvn_sysEnable,
+	[MSG_SYS_DISABLE]			= BDBvn_sysDisable,
+	[MSG_SYS_GET_UNIQUE_ID]		= BDBnf_sendUniqueID,
+	[MSG_SYS_GET_SW_VERSION]	= BDBnf_sendVersionInfo,
+	[MSG_SYS_PING]				= BDBnf_sendPong,
+	[MSG_SYS_IDENTIFY]			= BDBvn_identify,
+	[MSG_NODETAB_GETALL]		= BDBvn_reportNodetabSingle,
+	[MSG_NODETAB_GETNEXT]		= BDBvn_nextNodetabSingle,
+	[MSG_SYS_GET_ERROR]			= BDBnf_getError,
+	[MSG_FEATURE_GETALL]		= BDBnf_reportFeatures,
+	[MSG_FEATURE_GETNEXT]		= BDBnf_getNextFeature,
+	[MSG_FEATURE_GET]			= BDBnf_getFeature,
+	[MSG_FEATURE_SET]			= BDBnf_setFeature,
+	[MSG_SYS_CLOCK]				= BDBnf_sysClock,
+	[MSG_STRING_GET]			= BDBnf_getString,
+	[MSG_STRING_SET]			= BDBnf_setString,
+	[MSG_BM_GET_RANGE]			= BDBvn_getRange,
+	[MSG_BM_MIRROR_OCC]			= BDBvn_mirrorOCC,
+	[MSG_BM_MIRROR_FREE]		= BDBvn_mirrorFREE,
+	[MSG_BM_MIRROR_MULTIPLE]	= BDBvn_mirrorMultiple,
+	[MSG_BM_GET_CONFIDENCE]		= BDBvn_getConfidence,
 };
 
+struct bdbd_table BDBvn_feedbackDown = { .name = "feedback", .handler = fb_down };
+
 enum fbtype {
 	FBTYPE_S88,								///< create a virtual s88 node
 	FBTYPE_MCAN,							///< create a virtual mCAN node
 	FBTYPE_LNET,							///< create a virtual LocoNet node
 };
 
-struct vfeedback {
-	struct vfeedback	*next;				///< singly linked list
-	int					 module;			///< the module number (0-based) that this module is responsible for
-	struct bidibnode	*node;				///< the node structure
-	uint16_t			 oldstat;			///< the last status successfully sent to host
-};
-
-static struct vfeedback *virtual_fb;
+static struct bidibnode *fbnodes[BIDIB_VFB_MODULES];	///< the virtual feedback node for each (s88-)module, NULL if there is none
 
 /*
  * ==================================================================================================
@@ -441,35 +436,20 @@ static void BDBvn_getConfidence (struct bidibnode *n, bidibmsg_t *msg)
 
 static void BDBvn_delMapping (struct bidibnode *n)
 {
-	struct vfeedback *vfp, **pp;
+	int i;
 
-	pp = &virtual_fb;
-	while (*pp && (*pp)->node != n) pp = &(*pp)->next;
-	if ((vfp = *pp) != NULL) {
-		*pp = vfp->next;
-		free (vfp);
+	taskENTER_CRITICAL();
+	for (i = 0; i < BIDIB_VFB_MODULES; i++) {
+		if (fbnodes[i] == n) fbnodes[i] = NULL;
 	}
+	taskEXIT_CRITICAL();
 }
 
 static void BDBvn_addMapping (struct bidibnode *n, int module)
 {
-	struct vfeedback *vfp, **pp;
-
+	if (module < 0 || module >= BIDIB_VFB_MODULES) return;
 	BDBvn_delMapping(n);		// delete a potential previous mapping
-	pp = &virtual_fb;
-	while (*pp && (*pp)->module < module) pp = &(*pp)->next;
-	if ((*pp)->module == module) {	// replace nodepointer - should not happen ...
-		vfp = *pp;
-		vfp->node = n;
-	} else {						// create a new pointer entry here
-		if ((vfp = malloc (sizeof(*vfp))) != NULL) {
-			vfp->next = *pp;
-			vfp->module = module;
-			vfp->node = n;
-			vfp->oldstat = 0;	// OR: get the current state from feedback.c
-			*pp = vfp;
-		}
-	}
+	fbnodes[module] = n;
 }
 
 /**
@@ -556,7 +536,7 @@ struct bidibnode *BDBvn_newBridge (struct bidibnode *parent, int serial)
 		strncpy (n->product, BIDIB_PRODSTR_VIRT_IF, MAX_PRODUCT_STRING);
 		n->product[MAX_PRODUCT_STRING] = 0;
 		sprintf (n->user, "virtual HUB #%d", serial);
-		n->downstream = bridge_down;
+		n->downstream = &BDBvn_bridgeDown;
 		BDBnode_insertNode(parent, n);
 		data[0] = parent->ntab_version++;
 		data[1] = n->localadr;
@@ -608,13 +588,17 @@ struct bidibnode *BDBvn_newFeedback (struct bidibnode *parent, int serial, enum
 				break;
 		}
 		n->product[MAX_PRODUCT_STRING] = 0;			// force termination of string
-		n->downstream = fb_down;
+		n->downstream = &BDBvn_feedbackDown;
 		vfb = calloc (1, sizeof(*vfb) + fbarray * sizeof(uint32_t));	//	allocate memory for the bitarray
 		vfb->base = fbbase;
 		vfb->count = fbcount;
 		vfb->bitset = (uint32_t *) vfb->status;		// bitset and status are the same except for the data type
 		n->private = vfb;
 		BDBnode_insertNode(parent, n);
+		if ((fbbase % 16) == 0) {
+			BDBvn_addMapping(n, fbbase / 16);
+			BDBvn_feedbackUpdate(fbbase / 16, fb_getModuleState(fbbase / 16));	// start with the current state
+		}
 		data[0] = parent->ntab_version++;
 		data[1] = n->localadr;
 		memcpy (&data[2], n->uid, BIDIB_UID_LEN);
@@ -697,12 +681,113 @@ int BDBvn_feedbackModules (int oldcount, int count, int maxcount, int hubSerial)
 
 void BDBvn_clearFbMappings (void)
 {
-	struct vfeedback *vfp;
+	taskENTER_CRITICAL();
+	memset (fbnodes, 0, sizeof(fbnodes));
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * Forget a node that is about to be freed. Must be called for every
+ * virtual node before the memory is released.
+ *
+ * \param n		the node that is freed
+ */
+void BDBvn_nodeFreed (struct bidibnode *n)
+{
+	if (n && (n->uid[0] & BIDIB_CLASS_OCCUPANCY)) BDBvn_delMapping(n);
+}
 
-	while ((vfp = virtual_fb) != NULL) {
-		virtual_fb = vfp->next;
-		free (vfp);
+/**
+ * Look up the virtual feedback node for a module.
+ *
+ * \param module	the zero based (s88-)module number
+ * \return			the node representing this module or NULL
+ */
+struct bidibnode *BDBvn_feedbackNode (int module)
+{
+	if (module < 0 || module >= BIDIB_VFB_MODULES) return NULL;
+	return fbnodes[module];
+}
+
+/**
+ * Get the UID of the virtual feedback node for a module. If there is no
+ * node (i.e. the module is not configured for BiDiB), the UID the node would
+ * get is returned instead. This keeps blocks of detectors, that report
+ * without a node (LocoNet transponding), under the same identity when the
+ * node is created later.
+ *
+ * \param module	the zero based (s88-)module number
+ * \param uid		where to store the UID (BIDIB_UID_LEN bytes)
+ * eturn			true, if the module is in the range of virtual feedback nodes
+ */
+bool BDBvn_feedbackUID (int module, uint8_t *uid)
+{
+	struct bidibnode *n;
+	bool found = false;
+
+	if (module < 0 || module >= BIDIB_VFB_MODULES || !uid) return false;
+	taskENTER_CRITICAL();
+	if ((n = fbnodes[module]) != NULL) {
+		memcpy (uid, n->uid, BIDIB_UID_LEN);
+		found = true;
 	}
+	taskEXIT_CRITICAL();
+	if (found) return true;
+
+	if (module >= FB_MCAN_OFFSET / 16) BDBvn_createUID(uid, BIDIB_CLASS_OCCUPANCY, BIDIB_PID_VIRT_MCAN, module - FB_MCAN_OFFSET / 16 + 1);
+	else if (module >= FB_LNET_OFFSET / 16) BDBvn_createUID(uid, BIDIB_CLASS_OCCUPANCY, BIDIB_PID_VIRT_LNET, module - FB_LNET_OFFSET / 16 + 1);
+	else BDBvn_createUID(uid, BIDIB_CLASS_OCCUPANCY, BIDIB_PID_VIRT_S88, module + 1);
+	return true;
+}
+
+/**
+ * Take over the new state of a module into the virtual feedback node.
+ *
+ * \param module	the zero based (s88-)module number
+ * \param status	the 16 bits of the module (MSB is feedback #1)
+ * \return			a bitmap of the BiDiB bytes in the node that changed
+ * 					(bit 0 for detectors 0 .. 7, bit 1 for 8 .. 15) or 0 if there is no node
+ */
+uint8_t BDBvn_feedbackUpdate (int module, uint16_t status)
+{
+	struct virtual_feedback *vfb;
+	uint8_t st[2], changed;
+
+	if (module < 0 || module >= BIDIB_VFB_MODULES) return 0;
+	st[0] = fb_msb2lsb8(status >> 8);
+	st[1] = fb_msb2lsb8(status & 0xFF);
+	changed = 0;
+	taskENTER_CRITICAL();
+	if (fbnodes[module] && (vfb = fbnodes[module]->private) != NULL) {
+		if (vfb->status[0] != st[0]) changed |= 0x01;
+		if (vfb->status[1] != st[1]) changed |= 0x02;
+		vfb->status[0] = st[0];
+		vfb->status[1] = st[1];
+	}
+	taskEXIT_CRITICAL();
+	return changed;
+}
+
+/**
+ * Generate a MSG_BM_MULTIPLE for the changed bytes of a virtual feedback node.
+ *
+ * \param module	the zero based (s88-)module number
+ * \param bytes		the changed bytes as returned by BDBvn_feedbackUpdate()
+ * \return			the message or NULL, if there is no node for this module
+ */
+bidibmsg_t *BDBvn_feedbackReport (int module, uint8_t bytes)
+{
+	struct bidibnode *n;
+	struct virtual_feedback *vfb;
+	uint8_t data[4], *p;
+
+	if ((n = BDBvn_feedbackNode(module)) == NULL || (vfb = n->private) == NULL || !(bytes & 0x03)) return NULL;
+	p = data;
+	*p++ = (bytes & 0x01) ? 0 : 8;					// MNUM of the first reported detector
+	*p++ = (bytes == 0x03) ? 16 : 8;				// number of detectors reported
+	if (bytes & 0x01) *p++ = vfb->status[0];
+	if (bytes & 0x02) *p++ = vfb->status[1];
+	return bidib_genMessage(n, MSG_BM_MULTIPLE, p - data, data);
 }
 
 static int BDBvn_fbMapping (uint8_t prodId, int idx, int fbbase, int fbcount)
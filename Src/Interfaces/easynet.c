@@ -33,6 +33,7 @@
 #include "events.h"
 #include "config.h"
 #include "intelhex.h"
+#include "enboot.h"
 
 #define ALIVE_VALUE			210			// full live
 
@@ -354,6 +355,7 @@ static void en_statuspoll (int ctrl)
 		if (--clients[ctrl].alive == 0) {
 			log_msg (LOG_EASYNET, "%s() UNIT %d vanished\n", __func__, ctrl);
 			en_controlEvent(ctrl, 0);
+			loco_releaseAll(OWN_TOKEN(OWN_EASYNET, ctrl));
 			clients[ctrl].serno = 0;
 		}
 	}
@@ -701,6 +703,7 @@ static void en_request (en_block *blk)
 	if (!blk) return;
 	unit = blk->adr & 0x7F;
 	adr = bus_get14bit(blk->data);
+	loco_setClient(OWN_TOKEN(OWN_EASYNET, unit));
 
 	if (blk->cmd != ANS_SETSPEED) log_msg (LOG_EASYNET, "%s(): Unit %d CMD = 0x%02x (loco=%d)\n", __func__, unit, blk->cmd, adr);
 	memset (data, 0, sizeof(data));
@@ -891,9 +894,12 @@ static void en_request (en_block *blk)
 //				log_msg(LOG_INFO, "%s(): ADR %d speed %c%d\n", __func__, adr, (speed & 0x80) ? 'F' : 'R', speed & 0x7F);
 				newfuncs = ((blk->data[3] & 0x3F) << 10) | ((blk->data[4] & 0x7F) << 3) | ((blk->data[5] & 0x70) >> 4);
 				if (l && (speed != l->speed || newfuncs != (l->funcs[0] & FUNC_F0_F15))) {
-					rq_setSpeed (adr, speed);
-					rq_setFuncMasked(adr, newfuncs, FUNC_F0_F15);
-					en_override(l, unit);
+					if (rq_setSpeed (adr, speed) < 0) {		// the loco is controlled by another client - block this unit, too
+						en_override(l, -1);
+					} else {
+						rq_setFuncMasked(adr, newfuncs, FUNC_F0_F15);
+						en_override(l, unit);
+					}
 				}
 			}
 			break;
@@ -918,8 +924,8 @@ static void en_request (en_block *blk)
 				l = loco_call (adr, true);
 				newfuncs = ((blk->data[2] & 0x7F) << 16) | ((blk->data[3] & 0x7F) << 23) | ((blk->data[4] & 0x03) << 30);
 				if (l && (l->funcs[0] & FUNC_F16_F31) != newfuncs) {
-					rq_setFuncMasked(adr, newfuncs, FUNC_F16_F31);
-					en_override(l, unit);
+					if (rq_setFuncMasked(adr, newfuncs, FUNC_F16_F31) < 0) en_override(l, -1);
+					else en_override(l, unit);
 				}
 			}
 			break;
@@ -949,8 +955,8 @@ static void en_request (en_block *blk)
 					} else {
 						newfuncs = 0;
 					}
-					rq_setFuncMasked(adr, newfuncs, FUNC_F16_F31);
-					en_override(l, unit);
+					if (rq_setFuncMasked(adr, newfuncs, FUNC_F16_F31) < 0) en_override(l, -1);
+					else en_override(l, unit);
 				} else if(newfuncs > 68) {
 					loco_setBinState (adr, newfuncs, (blk->data[4] & 0x40) ? 1: 0);
 				} else {
@@ -1025,10 +1031,18 @@ static void en_request (en_block *blk)
 
 static bool en_eventHandler (eventT *e, void *arg)
 {
+	struct own_change *oc;
 	ldataT *l;
 
 	(void) arg;
 
+	if (e->ev == EVENT_LOCO_OWNER) {		// may be caused by another unit on our own bus
+		oc = (struct own_change *) e->src;
+		if (!oc->taken || OWN_IFC(oc->from) != OWN_EASYNET) return true;
+		if ((l = loco_call(oc->adr, false)) != NULL) en_override(l, (OWN_IFC(oc->to) == OWN_EASYNET) ? OWN_CLIENT(oc->to) : -1);
+		return true;
+	}
+
 	if (e->tid == tid) return true;		// this event is triggered by our own activity - ignore it
 
 	switch (e->ev) {
@@ -1064,6 +1078,7 @@ void easynet (void *pvParameter)
 //	event_register(EVENT_S88, en_pushS88, NULL, 0);
 	event_register(EVENT_LOCO_FUNCTION, en_eventHandler, NULL, 0);
 	event_register(EVENT_LOCO_SPEED, en_eventHandler, NULL, 0);
+	event_register(EVENT_LOCO_OWNER, en_eventHandler, NULL, 0);
 //	event_register(EVENT_PROTOCOL, en_changeFlags, NULL, 0);
 
 	stop = false;
@@ -1160,13 +1175,11 @@ void easynet (void *pvParameter)
  */
 
 #define READSIZE			4096		///< read the HEX file with this block size and store it binary in memory chunks
-#define CHUNKSIZE			64			///< the binary file contents in 64-Byte Units
 #define TINYSIZE			64			///< tiny 64-Byte Blocks (32 Words)
 #define SMALLSIZE			128			///< mid sized 128-Byte Blocks (64 Words)
 #define BIGSIZE				256			///< big 256-Byte Blocks (128 Words) for ATmega128
+#define BOOT_SETTLE			15000		///< the time in ms the units get to register on the bus after an update pass
 
-#define BOOTCRC_POLYNOM		0xA001		///< DEC polynom X^16+X^15+X^13+X
-#define BOOTCRC_START		0xFFFF		///< CRC start value
 #define BOOTCRC_SIZE		sizeof(uint16_t)
 
 enum bootstate {
@@ -1203,136 +1216,41 @@ static union mblock {
    struct data256	 big;				///< big block (256 bytes)
 } bootblk;
 
-struct chunk {
-   struct chunk		*next;
-   uint32_t			 adr;
-   uint8_t			 mem[CHUNKSIZE];
-};
-
 struct en_bootProgress progress;
+static struct enb_session session;
 
-static void en_bootFreeChunks (struct chunk *ch)
-{
-	struct chunk *tmp;
-
-	while ((tmp = ch) != NULL) {
-		ch = ch->next;
-		free (tmp);
-	}
-}
-
-static int en_bootCountBlocks (struct chunk *chunks)
-{
-   struct chunk *ch;
-   int cnt;
-
-   ch = chunks;
-   cnt = 0;
-   while (ch) {
-      cnt++;
-      ch = ch->next;
-   }
-
-   return cnt;
-}
-
-static int en_bootAddData (struct chunk **chpp, uint32_t adr, uint8_t *data, int len)
-{
-	struct chunk *ch;
-	int i, j;
-
-	if (!chpp || !data || len <= 0) return 0;	// can't do anything ...
-
-	while ((ch = *chpp) != NULL && ch->adr + CHUNKSIZE <= adr) chpp = &ch->next;
-	if (!ch || ch->adr > adr) {		// insert a new block
-		if ((ch = malloc (sizeof(*ch))) == NULL) return -1;
-		memset (ch->mem, 0xFF, sizeof(ch->mem));
-		ch->adr = (adr / CHUNKSIZE) * CHUNKSIZE;
-		ch->next = *chpp;
-		*chpp = ch;
-	}
-
-	for (i = adr - ch->adr, j = 0; i < CHUNKSIZE && j < len; i++, j++) ch->mem[i] = data[j];
-	if (j < len) return en_bootAddData (chpp, adr + j, &data[j], len - j);	// should data overflow the current chunk, add it to the next chunk
-
-	return 0;
-}
-
-static uint16_t en_bootCRC (uint16_t crc, uint8_t *p, int len)
+static union mblock *en_bootGetBlock (struct enb_image *img, union mblock *mb, uint32_t adr, int size)
 {
-	int i;
+	bool data;
 
-	while (len > 0) {
-		crc ^= *p++;
-		for (i = 0; i < 8; i++) {
-			if (crc & 1) crc = (crc >> 1) ^ BOOTCRC_POLYNOM;
-			else crc >>= 1;
-		}
-		len--;
-	}
-	return crc;
-}
-
-static union mblock *en_bootGetBlock (struct chunk *ch, union mblock *mb, uint32_t adr, int size)
-{
-	uint8_t *p;
-
-	if (!mb || !ch) return NULL;
+	if (!mb || !img) return NULL;
 
 	if (size < SMALLSIZE) size = TINYSIZE;
 	if (size > SMALLSIZE) size = BIGSIZE;
 	adr = (adr / size) * size;					// align address to a block boundary
 
-	progress.current = 0;
-	while (ch && ch->adr < adr) {
-		progress.current++;
-		ch = ch->next;	// search for first chunk to be copied to memblock
-	}
-
 	switch (size) {
 		case TINYSIZE:
-			mb->tiny.start = (uint16_t) adr;
-			if (!ch) mb->tiny.start = 0xFFFF;		// end marker (outside memory region)
-			p = mb->tiny.mem;
+			data = enb_getBlock(img, adr, size, mb->tiny.mem, &progress.current);
+			mb->tiny.start = (data) ? (uint16_t) adr : 0xFFFF;		// end marker (outside memory region)
+			mb->tiny.crc16 = enb_crc16 (ENB_CRCSTART, (uint8_t *) &mb->tiny.start, size + sizeof(mb->tiny.start));
 			break;
 		case SMALLSIZE:
-			mb->middle.start = (uint16_t) adr;
-			if (!ch) mb->middle.start = 0xFFFF;		// end marker (outside memory region)
-			p = mb->middle.mem;
+			data = enb_getBlock(img, adr, size, mb->middle.mem, &progress.current);
+			mb->middle.start = (data) ? (uint16_t) adr : 0xFFFF;		// end marker (outside memory region)
+			mb->middle.crc16 = enb_crc16 (ENB_CRCSTART, (uint8_t *) &mb->middle.start, size + sizeof(mb->middle.start));
 			break;
 		case BIGSIZE:
-			mb->big.start = adr;
-			if (!ch) mb->big.start = 0xFFFFFFFF;	// end marker (outside memory region)
-			p = mb->big.mem;
-			break;
-		default:
-			p = mb->big.mem;		// to keep compiler happy
-			break;
-	}
-
-	memset (p, 0xFF, size);
-
-	while (ch && ch->adr < (adr + size)) {
-		memcpy (p + ch->adr - adr, ch->mem, CHUNKSIZE);	// the chunk data always fits into the memblock!
-		ch = ch->next;
-	}
-
-	switch (size) {
-		case TINYSIZE:
-			mb->tiny.crc16 = en_bootCRC (0xFFFF, (uint8_t *) &mb->tiny.start, size + sizeof(mb->tiny.start));
-			break;
-		case SMALLSIZE:
-			mb->middle.crc16 = en_bootCRC (0xFFFF, (uint8_t *) &mb->middle.start, size + sizeof(mb->middle.start));
-			break;
-		case BIGSIZE:
-			mb->big.crc16 = en_bootCRC (0xFFFF, (uint8_t *) &mb->big.start, size + sizeof(mb->big.start));
+			data = enb_getBlock(img, adr, size, mb->big.mem, &progress.current);
+			mb->big.start = (data) ? adr : 0xFFFFFFFF;				// end marker (outside memory region)
+			mb->big.crc16 = enb_crc16 (ENB_CRCSTART, (uint8_t *) &mb->big.start, size + sizeof(mb->big.start));
 			mb->big.fill = 0xFEFE;
 			break;
 	}
 	return mb;
 }
 
-static enum bootstate en_bootBlockTransmit (struct chunk *chunks, union mblock *mb, int c, enum bootstate state)
+static enum bootstate en_bootBlockTransmit (struct enb_image *img, union mblock *mb, int c, enum bootstate state)
 {
 	int size;
 	uint32_t adr = 0;
@@ -1383,7 +1301,7 @@ static enum bootstate en_bootBlockTransmit (struct chunk *chunks, union mblock *
 				if (state == BSTATE_BLOCKREPEAT) return BSTATE_RECOVER;
 				else state = BSTATE_BLOCKREPEAT;
 			}
-			mb = en_bootGetBlock(chunks, mb, adr, size);
+			mb = en_bootGetBlock(img, mb, adr, size);
 			log_msg (LOG_INFO, "%s(): %d blocks transmitted / size=%d c='%c' (%d 0x%02x)\n", __func__, progress.current, size, c, c, c);
 			event_fire(EVENT_ENBOOT, 0, &progress);
 			switch (size) {
@@ -1425,28 +1343,50 @@ static enum bootstate en_bootBlockTransmit (struct chunk *chunks, union mblock *
 	return state;
 }
 
-static void en_bootMode (struct chunk *ch)
+static void en_bootProgressEvent (void)
 {
-	enum bootstate bs;
-	TickType_t to;
-	int c;
-
-	log_msg (LOG_INFO, "%s(): start update\n", __func__);
-
-	if (!ch) {
-		log_msg (LOG_WARNING, "%s() ERROR: no memory chunks\n", __func__);
-		return;
-	}
-
-	progress.total = en_bootCountBlocks(ch);
-	progress.current = 0;
-	log_msg (LOG_INFO, "%s(): %d blocks total\n", __func__, progress.total);
+	progress.pass = session.pass;
+	progress.units = session.count;
+	progress.done = enb_sessionCount(&session, ENB_UNIT_DONE);
+	progress.failed = enb_sessionCount(&session, ENB_UNIT_FAILED);
 	event_fire(EVENT_ENBOOT, 0, &progress);
+}
 
+static void en_bootStopTask (void)
+{
 	if (tid) {
 		stop = true;
 		while (tid) vTaskDelay(10);
 	}
+}
+
+/**
+ * Transfer the image once. All units that run their boot loader receive
+ * the same blocks. The first pass sends all units to their boot loader, the
+ * following passes only the units of the session that are not yet done.
+ * Units that did not register at all are expected to wait in their boot
+ * loader anyway.
+ *
+ * \param img		the image to transfer
+ * \return			true, if a unit reported the reception of the terminating block
+ */
+static bool en_bootPass (struct enb_image *img)
+{
+	enum bootstate bs;
+	TickType_t to;
+	int c, i;
+
+	if (tid) {
+		if (session.pass <= 1) {
+			en_doReset();			// let all units start their boot loader
+		} else {
+			for (i = EN_MINUNIT; i <= EN_MAXUNIT; i++) {
+				if (clients[i].alive > 0 && enb_sessionPending(&session, clients[i].serno)) en_sendBlock(i, CMD_DORESET, NULL);
+			}
+		}
+		vTaskDelay(100);
+	}
+	en_bootStopTask();
 	spi_init(true);
 
 	to = tim_timeout(10000);
@@ -1455,26 +1395,97 @@ static void en_bootMode (struct chunk *ch)
 	to = tim_timeout(10000);
 	bs = BSTATE_STARTUP;
 	bootblk.big.start = 0;
+	progress.current = 0;
+	en_bootProgressEvent();
 	while (bs != BSTATE_FINISHED && !tim_isover(to)) {
 		if ((c = spi_getchar()) != EOF) {
 			log_msg(LOG_INFO,  "%s() got '%c'\n", __func__, c);
-			bs = en_bootBlockTransmit (ch, &bootblk, c, bs);
+			bs = en_bootBlockTransmit (img, &bootblk, c, bs);
 			to = tim_timeout(1000);
 		}
 	}
-	event_fire(EVENT_ENBOOT, 0, NULL);
 
 	SPI1->CR1 = 0;		// disable SPI1
 	SPI1->CR1 = 0;		// disable SPI1
 	SPI1->CR1 = 0;		// disable SPI1
 	SPI1->CR1 = 0;		// disable SPI1
-	log_msg (LOG_INFO, "%s() finished\n", __func__);
+
+	memset (clients, 0, sizeof(clients));		// the units register again after their update
 	xTaskCreate(easynet, "EasyNet", 1024, NULL, 1, NULL);
+	return bs == BSTATE_FINISHED;
+}
+
+/**
+ * Wait for the units of the session to register on the bus again and to
+ * report their firmware version (requested by en_setUnitAddress()).
+ */
+static void en_bootCollect (void)
+{
+	TickType_t to;
+	int i;
+
+	to = tim_timeout(BOOT_SETTLE);
+	while (enb_sessionCount(&session, ENB_UNIT_PENDING) > 0 && !tim_isover(to)) {
+		vTaskDelay(500);
+		for (i = EN_MINUNIT; i <= EN_MAXUNIT; i++) {
+			if (clients[i].alive > 0 && clients[i].serno) enb_sessionSeen(&session, clients[i].serno, clients[i].sw_no);
+		}
+	}
+}
+
+/**
+ * Update the units on the bus. The units known before the update are checked
+ * after each pass and the pass is repeated for the units that did not come
+ * back with the new firmware, until ENB_RETRIES passes are done.
+ *
+ * \param img		the image to transfer
+ */
+static void en_bootMode (struct enb_image *img)
+{
+	uint32_t serno[ENB_MAXUNITS], version[ENB_MAXUNITS];
+	bool finished;
+	int i, cnt;
+
+	log_msg (LOG_INFO, "%s(): start update\n", __func__);
+
+	if (!img || img->chunks <= 0) {
+		log_msg (LOG_WARNING, "%s() ERROR: no image data\n", __func__);
+		return;
+	}
+
+	for (i = EN_MINUNIT, cnt = 0; i <= EN_MAXUNIT && cnt < ENB_MAXUNITS; i++) {
+		if (clients[i].alive > 0 && clients[i].serno) {
+			serno[cnt] = clients[i].serno;
+			version[cnt++] = clients[i].sw_no;
+		}
+	}
+	enb_sessionStart(&session, serno, version, cnt);
+
+	progress.total = img->chunks;
+	progress.current = 0;
+	log_msg (LOG_INFO, "%s(): %d blocks total, %d units\n", __func__, progress.total, cnt);
+
+	do {
+		finished = en_bootPass(img);
+		log_msg (LOG_INFO, "%s(): pass %d %s\n", __func__, session.pass, (finished) ? "finished" : "timed out");
+		if (!session.count) break;
+		en_bootCollect();
+		en_bootProgressEvent();
+	} while (enb_sessionNextPass(&session));
+
+	for (i = 0; i < session.count; i++) {
+		if (session.unit[i].state == ENB_UNIT_FAILED) {
+			log_error ("%s(): unit %lu did not report back with the new firmware (version %06lx)\n", __func__,
+					session.unit[i].serno, session.unit[i].version);
+		}
+	}
+	event_fire(EVENT_ENBOOT, 0, NULL);
+	log_msg (LOG_INFO, "%s() finished\n", __func__);
 }
 
 int en_bootReadBuffer (void *arg, uint8_t *buf, int len)
 {
-	static struct chunk *chunks;
+	static struct enb_image image;
 	static uint8_t input[256];		// maximum line fragment we can remember between calls
 	static uint8_t *end;
 	static struct ihexdata ihex;
@@ -1487,15 +1498,14 @@ int en_bootReadBuffer (void *arg, uint8_t *buf, int len)
 	if (len < 0) {			// initialisation call
 		log_msg (LOG_INFO, "%s(): INIT\n", __func__);
 		end = NULL;
-		en_bootFreeChunks(chunks);
-		chunks = NULL;
+		enb_free(&image);
 		memset (&ihex, 0, sizeof(ihex));
 	} else if (buf == NULL) {
 		log_msg (LOG_INFO, "%s(): START UPDATE\n", __func__);
 		vTaskDelay(200);
-		en_bootMode(chunks);
-		en_bootFreeChunks(chunks);
-		chunks = NULL;
+		if (enb_finish(&image) < 0) log_error ("%s(): no memory\n", __func__);
+		else en_bootMode(&image);
+		enb_free(&image);
 	} else {
 //		log_msg (LOG_INFO, "%s(): DATA len=%d input=%p end=%p\n", __func__, len, input, end);
 //		vTaskDelay(20);
@@ -1521,7 +1531,9 @@ int en_bootReadBuffer (void *arg, uint8_t *buf, int len)
 						break;
 					}
 					if (rc > 0) {
-						en_bootAddData(&chunks, ihex.segadr + ihex.reladr, ihex.data, rc);
+						if (enb_addData(&image, ihex.segadr + ihex.reladr, ihex.data, rc) < 0) {
+							log_error ("%s(): cannot store data at 0x%06lx\n", __func__, ihex.segadr + ihex.reladr);
+						}
 					}
 					while (s < end && (*s == '\r' || *s == '\n')) s++;		// skip everything that is a line ending
 					p = s;													// and position p to new line start
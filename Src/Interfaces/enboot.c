@@ -0,0 +1,365 @@
+/*
+ * enboot.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Firmware images and update sessions for EasyNet units
+ *
+ * The Intel-HEX file is stored in a flat buffer that covers the address
+ * range of the image. Gaps in the HEX file stay 0xFF, just like erased flash.
+ * A flag per chunk of 64 bytes remembers which parts received data, so the
+ * progress can still be reported in chunks and the end of the image is known.
+ *
+ * The boot loader of the units requests blocks of 64, 128 or 256 bytes. A
+ * block is copied from the buffer at the requested address and protected by
+ * a CRC-16 (polynom 0xA001, start value 0xFFFF) over the start address and
+ * the data. A request behind the last chunk is answered with the end marker.
+ *
+ * The boot protocol is not addressed, so all units that run their boot loader
+ * receive the same blocks. An update session tracks the units by their serial
+ * number. A unit is done when it registers on the bus again and reports the
+ * new firmware version. The image does not carry its version, so the version
+ * is learned from the first unit that reports a version different from the
+ * one it had before the update. If no unit changes its version (the same
+ * firmware is loaded again), the units that report their old version are done
+ * when the pass is over. All others get another pass until ENB_RETRIES is
+ * reached.
+ *
+ * easynet.c owns the bus and only asks for the next block and reports the
+ * answers of the units. Tests/enboot_test.c compares the blocks with the
+ * old chunk list of easynet.c and plays the boot loaders of the units.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "enboot.h"
+
+static const uint16_t crctab[256] = {
+	0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+	0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+	0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+	0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+	0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+	0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+	0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+	0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+	0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+	0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+	0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+	0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+	0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+	0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+	0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+	0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+	0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+	0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+	0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+	0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+	0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+	0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+	0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+	0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+	0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+	0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+	0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+	0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+	0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+	0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+	0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+	0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040,
+};
+
+/**
+ * Calculate the CRC-16 (polynom 0xA001) of a memory area.
+ *
+ * \param crc		the start value (ENB_CRCSTART) or the CRC of the previous data
+ * \param p			the data
+ * \param len		the length of the data
+ * \return			the new CRC
+ */
+uint16_t enb_crc16 (uint16_t crc, const uint8_t *p, int len)
+{
+	while (len > 0) {
+		crc = (crc >> 8) ^ crctab[(crc ^ *p++) & 0xFF];
+		len--;
+	}
+	return crc;
+}
+
+void enb_init (struct enb_image *img)
+{
+	memset (img, 0, sizeof(*img));
+}
+
+void enb_free (struct enb_image *img)
+{
+	if (!img) return;
+	free (img->mem);
+	free (img->used);
+	free (img->before);
+	enb_init(img);
+}
+
+/**
+ * Make sure the buffer covers the range from lo to hi. The buffer is grown
+ * in bigger steps if data is appended, so a HEX file with ascending addresses
+ * only needs a few reallocations.
+ *
+ * \param img		the image
+ * \param lo		the first address (aligned to ENB_CHUNKSIZE)
+ * \param hi		the address behind the last byte (aligned to ENB_CHUNKSIZE)
+ * \return			0 for OK, -1 if the image gets too big or there is no memory left
+ */
+static int enb_cover (struct enb_image *img, uint32_t lo, uint32_t hi)
+{
+	uint8_t *mem, *used;
+	uint32_t base, top, grow;
+
+	if (img->mem && lo >= img->base && hi <= img->base + img->size) return 0;
+
+	base = img->mem ? img->base : lo;
+	top = img->mem ? img->base + img->size : lo;
+	if (lo < base) base = lo;
+	if (hi > top) {
+		grow = (top - base < 4096) ? 4096 : top - base;		// at least double the size of the buffer
+		top = (hi > top + grow) ? hi : top + grow;
+		if (top - base > ENB_MAXIMAGE) top = base + ENB_MAXIMAGE;
+	}
+	if (hi > top || top - base > ENB_MAXIMAGE) return -1;
+
+	mem = malloc (top - base);
+	used = calloc ((top - base) / ENB_CHUNKSIZE, 1);
+	if (!mem || !used) {
+		free (mem);
+		free (used);
+		return -1;
+	}
+	memset (mem, 0xFF, top - base);
+	if (img->mem) {
+		memcpy (&mem[img->base - base], img->mem, img->size);
+		memcpy (&used[(img->base - base) / ENB_CHUNKSIZE], img->used, img->size / ENB_CHUNKSIZE);
+		free (img->mem);
+		free (img->used);
+	}
+	img->mem = mem;
+	img->used = used;
+	img->base = base;
+	img->size = top - base;
+	return 0;
+}
+
+/**
+ * Add the data of a HEX record to the image.
+ *
+ * \param img		the image
+ * \param adr		the address of the data
+ * \param data		the data
+ * \param len		the length of the data
+ * \return			0 for OK, -1 if the data could not be stored
+ */
+int enb_addData (struct enb_image *img, uint32_t adr, const uint8_t *data, int len)
+{
+	uint32_t lo, hi, i;
+
+	if (!img || !data || len <= 0) return 0;	// can't do anything ...
+
+	lo = (adr / ENB_CHUNKSIZE) * ENB_CHUNKSIZE;
+	hi = ((adr + len + ENB_CHUNKSIZE - 1) / ENB_CHUNKSIZE) * ENB_CHUNKSIZE;
+	if (enb_cover(img, lo, hi) != 0) return -1;
+
+	memcpy (&img->mem[adr - img->base], data, len);
+	for (i = lo; i < hi; i += ENB_CHUNKSIZE) img->used[(i - img->base) / ENB_CHUNKSIZE] = 1;
+	if (hi > img->end) img->end = hi;
+	return 0;
+}
+
+/**
+ * Finish the image after the last HEX record. This counts the used chunks
+ * for the progress reports.
+ *
+ * \param img		the image
+ * \return			the number of used chunks (0 if the image is empty) or -1 if there is no memory left
+ */
+int enb_finish (struct enb_image *img)
+{
+	uint32_t i, n;
+
+	if (!img || !img->mem) return 0;
+
+	n = img->size / ENB_CHUNKSIZE;
+	free (img->before);
+	if ((img->before = malloc (n * sizeof(*img->before))) == NULL) return -1;
+	img->chunks = 0;
+	for (i = 0; i < n; i++) {
+		img->before[i] = img->chunks;
+		if (img->used[i]) img->chunks++;
+	}
+	return img->chunks;
+}
+
+/**
+ * Copy a block from the image.
+ *
+ * \param img		the image (after enb_finish())
+ * \param adr		the start address of the block (aligned to the block size)
+ * \param size		the size of the block
+ * \param mem		where to store the block data
+ * \param current	where to store the number of chunks in front of the block (may be NULL)
+ * \return			true if the block is part of the image, false if the end marker should be sent
+ */
+bool enb_getBlock (const struct enb_image *img, uint32_t adr, int size, uint8_t *mem, int *current)
+{
+	uint32_t from, to;
+
+	memset (mem, 0xFF, size);
+	if (!img || !img->mem || adr >= img->end) {
+		if (current) *current = img ? img->chunks : 0;
+		return false;
+	}
+
+	if (current) *current = (adr <= img->base) ? 0 : img->before[(adr - img->base) / ENB_CHUNKSIZE];
+	from = (adr > img->base) ? adr : img->base;
+	to = (adr + size < img->base + img->size) ? adr + size : img->base + img->size;
+	if (to > from) memcpy (&mem[from - adr], &img->mem[from - img->base], to - from);
+	return true;
+}
+
+/**
+ * Start an update session.
+ *
+ * \param s			the session
+ * \param serno		the serial numbers of the units to update
+ * \param version	the firmware versions of the units before the update
+ * \param count		the number of units
+ */
+void enb_sessionStart (struct enb_session *s, const uint32_t *serno, const uint32_t *version, int count)
+{
+	int i;
+
+	memset (s, 0, sizeof(*s));
+	if (count > ENB_MAXUNITS) count = ENB_MAXUNITS;
+	for (i = 0; i < count; i++) {
+		s->unit[i].serno = serno[i];
+		s->unit[i].oldver = version[i];
+		s->unit[i].passes = 1;
+	}
+	s->count = count;
+	s->pass = 1;
+}
+
+/**
+ * A unit registered on the bus after an update pass. A unit that did not
+ * yet answer the version request stays pending, as does a unit that reports
+ * a version other than the new one (i.e. it missed the pass and started its
+ * old firmware).
+ *
+ * \param s			the session
+ * \param serno		the serial number of the unit
+ * \param version	the firmware version the unit reports (0 = not yet known)
+ */
+void enb_sessionSeen (struct enb_session *s, uint32_t serno, uint32_t version)
+{
+	struct enb_unit *u;
+	int i;
+
+	if (!version) return;
+	for (i = 0, u = s->unit; i < s->count; i++, u++) {
+		if (u->serno != serno || u->state != ENB_UNIT_PENDING) continue;
+		u->version = version;
+		if (!s->version && version != u->oldver) s->version = version;
+		if (s->version && version == s->version) u->state = ENB_UNIT_DONE;
+	}
+}
+
+/**
+ * Check if a unit still waits for its update.
+ *
+ * \param s			the session
+ * \param serno		the serial number of the unit
+ * \return			true, if the unit is part of the session and not yet done or failed
+ */
+bool enb_sessionPending (const struct enb_session *s, uint32_t serno)
+{
+	int i;
+
+	for (i = 0; i < s->count; i++) {
+		if (s->unit[i].serno == serno) return s->unit[i].state == ENB_UNIT_PENDING;
+	}
+	return false;
+}
+
+/**
+ * Decide if another pass is needed after all units had the chance to report
+ * back. Units that did not report back with the new firmware within
+ * ENB_RETRIES passes are failed.
+ * Without any known units (i.e. units that were not registered on the bus
+ * before the update) a single pass is done.
+ *
+ * \param s			the session
+ * \return			true, if another pass should be done
+ */
+bool enb_sessionNextPass (struct enb_session *s)
+{
+	bool again = false;
+	int i;
+
+	if (!s->version) {			// no unit changed its version: the same firmware was loaded again
+		for (i = 0; i < s->count; i++) {
+			if (s->unit[i].state == ENB_UNIT_PENDING && s->unit[i].version && s->unit[i].version == s->unit[i].oldver) {
+				s->unit[i].state = ENB_UNIT_DONE;
+			}
+		}
+	}
+
+	for (i = 0; i < s->count; i++) {
+		if (s->unit[i].state != ENB_UNIT_PENDING) continue;
+		if (s->unit[i].passes >= ENB_RETRIES) {
+			s->unit[i].state = ENB_UNIT_FAILED;
+		} else {
+			s->unit[i].passes++;
+			again = true;
+		}
+	}
+	if (again) s->pass++;
+	return again;
+}
+
+/**
+ * Count the units in a given state.
+ *
+ * \param s			the session
+ * \param state		the state to look for
+ * \return			the number of units in this state
+ */
+int enb_sessionCount (const struct enb_session *s, enum enb_unitstate state)
+{
+	int i, cnt;
+
+	for (i = cnt = 0; i < s->count; i++) {
+		if (s->unit[i].state == state) cnt++;
+	}
+	return cnt;
+}
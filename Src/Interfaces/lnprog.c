@@ -0,0 +1,276 @@
+/*
+ * lnprog.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Encoding and decoding of LocoNet slot, programming and transponding messages
+ *
+ * A throttle may write a complete loco slot. FRED throttles do so to set
+ * their throttle ID after they got a loco with a DISPATCH GET, and to set
+ * the slot to common or idle when they let the loco go.
+ *
+ * The programming slot (#124) carries the programming command, the CV, the data
+ * and, in operations mode, the decoder address. Because LocoNet only transports
+ * 7-bit bytes, the upper bits of the CV and the data byte are collected in the
+ * CVH byte:
+ *
+ *		CVH = 0 0 CV9 CV8 0 0 D7 CV7
+ *
+ * LNCV messages (used by Uhlenbrock modules and some others) transport seven
+ * binary bytes (article number, LNCV number, value and flags) with the MSBits
+ * collected in the PXCT1 byte in front of them.
+ *
+ * OPC_MULTI_SENSE reports the detector section and the loco address when a
+ * transponder enters or leaves a section.
+ *
+ * The blocks handled here never include the checksum, which is calculated
+ * when the block is sent.
+ *
+ * loconet.c decodes the received blocks with these functions and encodes
+ * its answers, the bus itself stays there. Tests/lnprog_test.c replays
+ * recorded programming traffic the same way.
+ */
+
+#include <string.h>
+#include "lnprog.h"
+
+/**
+ * Transform a binary block (using all 8 bits of a byte) to the
+ * LocoNet message format with 7 bits per byte only. A maximum of
+ * 7 bytes can be tranformed to 8 bytes of LocoNet data.
+ *
+ * The first byte of the subpart of the message will receive all
+ * the MSBits of the following bytes which then are simply put there
+ * with their MSB stipped away.
+ *
+ * The resulting message array 'msg' must at least have len + 1 bytes
+ * of space to hold the result. The first byte will contain the MSBit
+ * from the follow-up bytes.
+ *
+ * \param bin		pointer to the real binary bytes containing the message to transform
+ * \param msg		pointer to the resulting message bytes, each only allowed to contain 7-bit bytes
+ * \param len		the length of the binary package (max 7 bytes)
+ */
+void lnp_bin2msg (const uint8_t *bin, uint8_t *msg, int len)
+{
+	uint8_t *p, mask;
+
+	if (!bin || !msg || len <= 0) return;	// nothing to do
+	if (len > 7) len = 7;					// take care not to overwrite other stuff :-)
+	p = msg;
+	mask = 0x01;
+	*p++ = 0;								// initialize the MSBit storage and let p point to &msg[1]
+	while (len) {
+		if (*bin & 0x80) *msg |= mask;
+		*p++ = *bin++ & 0x7F;
+		mask <<= 1;
+		len--;
+	}
+}
+
+/**
+ * Transfor a sequence of 7-bit bytes to a binary data array holding the
+ * corresponding 8-bit bytes. This is the inverser of \ref lnp_bin2msg().
+ *
+ * The first byte of the message contains the MSBits of the followup
+ * 7-bit bytes. The target buffer 'bin' must supply space for len bytes
+ * and len + 1 bytes from the message are interpreted.
+ *
+ * \param bin		pointer to the real binary bytes that will contai the resulting 8-bit bytes
+ * \param msg		pointer to the original message bytes, each only contain 7-bit bytes
+ * \param len		the length of the binary package (max 7 bytes)
+ */
+void lnp_msg2bin (uint8_t *bin, const uint8_t *msg, int len)
+{
+	const uint8_t *p;
+	uint8_t mask;
+
+	if (!bin || !msg || len <= 0) return;	// nothing to do
+	if (len > 7) len = 7;					// take care not to overwrite other stuff :-)
+	p = &msg[1];
+	mask = 0x01;
+	while (len) {
+		*bin = *p++;
+		if (*msg & mask) *bin |= 0x80;
+		bin++;
+		mask <<= 1;
+		len--;
+	}
+}
+
+enum lnp_progmode lnp_progMode (uint8_t pcmd)
+{
+	if (pcmd & LNP_PCMD_OPS) return (pcmd & LNP_PCMD_TY0) ? LNP_MODE_OPSFEEDBACK : LNP_MODE_OPS;
+	if (pcmd & LNP_PCMD_TY0) return LNP_MODE_DIRECT;
+	if (pcmd & LNP_PCMD_TY1) return LNP_MODE_REGISTER;
+	return LNP_MODE_PAGED;
+}
+
+/**
+ * Decode an OPC_WR_SL_DATA to a loco slot.
+ *
+ * \param blk		the received block
+ * \param sd		where to store the decoded content
+ * \return			true, if this is a write to a loco slot
+ */
+bool lnp_decodeSlotData (const uint8_t *blk, struct lnp_slotdata *sd)
+{
+	if (!blk || !sd || blk[1] != LNP_SLOTLEN || blk[2] < 1 || blk[2] > LNP_MAXSLOT) return false;
+
+	sd->slot = blk[2];
+	sd->stat1 = blk[3] & 0x7F;
+	sd->status = (blk[3] & LNP_STAT_MASK) >> LNP_STAT_SHIFT;
+	sd->adr = ((blk[9] & 0x7F) << 7) | (blk[4] & 0x7F);
+	sd->spd = blk[5] & 0x7F;
+	sd->dirf = blk[6] & 0x7F;
+	sd->snd = blk[10] & 0x7F;
+	sd->id = ((blk[12] & 0x7F) << 7) | (blk[11] & 0x7F);
+	return true;
+}
+
+/**
+ * Decode an OPC_WR_SL_DATA to the programming slot.
+ *
+ * \param blk		the received block
+ * \param ps		where to store the decoded content
+ * \return			true, if this is a write to the programming slot
+ */
+bool lnp_decodeProgSlot (const uint8_t *blk, struct lnp_progslot *ps)
+{
+	if (!blk || !ps || blk[1] != LNP_SLOTLEN || blk[2] != LNP_PROGSLOT) return false;
+
+	ps->pcmd = blk[3];
+	ps->pstat = blk[4];
+	ps->adr = ((blk[5] & 0x7F) << 7) | (blk[6] & 0x7F);
+	ps->trk = blk[7];
+	ps->cv = ((blk[8] & 0x30) << 4) | ((blk[8] & 0x01) << 7) | (blk[9] & 0x7F);
+	ps->data = ((blk[8] & 0x02) << 6) | (blk[10] & 0x7F);
+	return true;
+}
+
+/**
+ * Encode the programming slot (i.e. as OPC_SL_RD_DATA to report the result).
+ *
+ * \param opc		the OPCode to use
+ * \param ps		the content of the programming slot
+ * \param blk		the block to fill (at least LNP_SLOTLEN bytes)
+ */
+void lnp_encodeProgSlot (uint8_t opc, const struct lnp_progslot *ps, uint8_t *blk)
+{
+	if (!ps || !blk) return;
+
+	memset (blk, 0, LNP_SLOTLEN);
+	blk[0] = opc;
+	blk[1] = LNP_SLOTLEN;
+	blk[2] = LNP_PROGSLOT;
+	blk[3] = ps->pcmd & 0x7F;
+	blk[4] = ps->pstat & 0x7F;
+	blk[5] = (ps->adr >> 7) & 0x7F;
+	blk[6] = ps->adr & 0x7F;
+	blk[7] = ps->trk & 0x7F;
+	blk[8] = ((ps->cv >> 4) & 0x30) | ((ps->cv >> 7) & 0x01) | ((ps->data >> 6) & 0x02);
+	blk[9] = ps->cv & 0x7F;
+	blk[10] = ps->data & 0x7F;
+}
+
+/**
+ * Decode a LNCV request or reply.
+ *
+ * \param blk		the received block (OPC_IMM_PACKET or OPC_PEER_XFER)
+ * \param cv		where to store the decoded content
+ * \return			true, if this is a LNCV message
+ */
+bool lnp_decodeLNCV (const uint8_t *blk, struct lnp_lncv *cv)
+{
+	uint8_t db[7];
+
+	if (!blk || !cv || blk[1] != LNP_PEERLEN) return false;
+	if (blk[5] != LNCV_CMD_WRITE && blk[5] != LNCV_CMD_READ && blk[5] != LNCV_CMD_READREPLY) return false;
+
+	lnp_msg2bin(db, &blk[6], 7);
+	cv->src = blk[2];
+	cv->dst = blk[3] | (blk[4] << 8);
+	cv->cmd = blk[5];
+	cv->article = db[0] | (db[1] << 8);
+	cv->cv = db[2] | (db[3] << 8);
+	cv->value = db[4] | (db[5] << 8);
+	cv->flags = db[6];
+	return true;
+}
+
+/**
+ * Encode a LNCV request or reply.
+ *
+ * \param opc		the OPCode to use (OPC_IMM_PACKET for requests, OPC_PEER_XFER for replies)
+ * \param cv		the content of the message
+ * \param blk		the block to fill (at least LNP_PEERLEN bytes)
+ */
+void lnp_encodeLNCV (uint8_t opc, const struct lnp_lncv *cv, uint8_t *blk)
+{
+	uint8_t db[7];
+
+	if (!cv || !blk) return;
+
+	db[0] = cv->article & 0xFF;
+	db[1] = cv->article >> 8;
+	db[2] = cv->cv & 0xFF;
+	db[3] = cv->cv >> 8;
+	db[4] = cv->value & 0xFF;
+	db[5] = cv->value >> 8;
+	db[6] = cv->flags;
+
+	blk[0] = opc;
+	blk[1] = LNP_PEERLEN;
+	blk[2] = cv->src & 0x7F;
+	blk[3] = cv->dst & 0x7F;
+	blk[4] = (cv->dst >> 8) & 0x7F;
+	blk[5] = cv->cmd & 0x7F;
+	lnp_bin2msg(db, &blk[6], 7);
+	blk[14] = 0;
+}
+
+/**
+ * Decode a transponding report. Power management reports, that share
+ * the same OPCode, are ignored.
+ *
+ * \param blk		the received OPC_MULTI_SENSE block
+ * \param tp		where to store the decoded report
+ * \return			true, if this is a transponder report
+ */
+bool lnp_decodeMultiSense (const uint8_t *blk, struct lnp_transponder *tp)
+{
+	uint8_t type;
+
+	if (!blk || !tp) return false;
+	type = blk[1] & LNP_MS_TYPEMASK;
+	if (type != LNP_MS_PRESENT && type != LNP_MS_ABSENT) return false;
+
+	tp->present = (type == LNP_MS_PRESENT);
+	tp->section = ((blk[1] & 0x1F) << 7) | (blk[2] & 0x7F);
+	if (blk[3] == LNP_MS_SHORTADR) tp->adr = blk[4] & 0x7F;
+	else tp->adr = ((blk[3] & 0x7F) << 7) | (blk[4] & 0x7F);
+	return tp->adr != 0;
+}
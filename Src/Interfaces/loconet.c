@@ -24,6 +24,7 @@
 #include "decoder.h"
 #include "config.h"
 #include "bidib.h"
+#include "lnprog.h"
 
 /**
  * @file	Interfaces/loconet.c
@@ -138,6 +139,8 @@
 #define LN_PACKET_TIMEOUT		1200			///< the minimum GAP between two packets and also the timeout for incomplete blocks
 #define LN_TX_RETRY_ATTEMPTS	10				///< maximum attempts we are doing when transmitting a block
 #define NUMBER_OF_SLOTS			120				///< slot 0 (DISPATCH!) + 1 to 119 for loco slots
+#define LNCV_TIMEOUT			500				///< the time in ms to wait for the answer of a LNCV module
+#define LN_OWNER				OWN_TOKEN(OWN_LOCONET, 0)	///< all throttles share the slot of a loco and so are a single client in the loco ownership
 
 enum commstate {
 	COMM_IDLE = 0,								///< no communication is going on
@@ -220,6 +223,7 @@ typedef struct slot {
 	int					id;						///< the ID from the original LocoNet slot definition
 	volatile uint32_t	lastfuncs;				///< the last known state of the functions F0 to F31
 	volatile int		lastspeed;				///< the last known speed including the direction bit
+	TickType_t			lastcmd;				///< the time of the last access by a throttle (for the slot purge)
 } slotT;
 
 static slotT slots[NUMBER_OF_SLOTS];			///< all the slots that are possible, slot #0 will not be used because it is special
@@ -231,6 +235,17 @@ static struct irq_block rxblock;				///< the block used by the interrupt to rece
 static volatile int backoff;					///< the backofftime currently used by the system in micro seconds (us) - 0 for MASTER
 //static struct irq_block txblock;				///< the block used by the interrupt to transmit data frames
 static struct txrequest txreq;					///< the block used by the interrupt to transmit  data frames
+static struct lnp_progslot progslot;			///< the last task (and result) of the programming slot
+static volatile bool progbusy;					///< a programming task with a result is running
+static SemaphoreHandle_t lncvmutex;				///< serializes the LNCV requests
+
+static struct {
+	TaskHandle_t		waiter;					///< the task waiting for the answer of the module
+	uint16_t			article;				///< the article number of the addressed module
+	uint16_t			cv;						///< the requested LNCV
+	bool				write;					///< the request is a write (answered by LONG_ACK)
+	int					result;					///< the value read, 0 for a successful write or a negative error code
+} lncv;
 //static volatile enum commstate cs;			///< the interrupt-internal system state
 
 // forward declare the functions for the function table
@@ -252,6 +267,9 @@ static int ln_slotFuncUH (uint8_t *blk);
 static int ln_FuncDigitrax (uint8_t *blk);
 static int ln_IB_configRequest (uint8_t *blk);
 static int ln_slotWrite (uint8_t *blk);
+static int ln_multiSense (uint8_t *blk);
+static int ln_peerXfer (uint8_t *blk);
+static int ln_longAckRx (uint8_t *blk);
 
 static const uint8_t speed28[] = {
 	0, 2, 7, 11, 16, 20, 25, 29, 34, 38, 43, 47, 52, 56, 61, 65,	// speed codes 0 .. 15 (without emergency stop!)
@@ -291,15 +309,16 @@ static const struct decoder {
 	{ OPC_RQ_SL_DATA,	 4, "OPC_RQ_SL_DATA",	ln_slotRead },
 	{ OPC_SW_STATE,		 4, "OPC_SW_STATE",		ln_trntQuery },
 	{ OPC_LOCO_ADR,		 4, "OPC_LOCO_ADR",		ln_reqLoco },
+	{ OPC_MULTI_SENSE,	 6, "OPC_MULTI_SENSE",	ln_multiSense },		// transponding (power management reports are ignored)
 	{ OPC_UHLI_FUN,		 6, "OPC_UHLI_FUN",		ln_slotFuncUH },
 	{ OPC_IMM_PACKET,	11, "OPC_IMM_PACKET",	ln_FuncDigitrax },		// with 11 bytes, it probably is the Digitrax func packet
 	{ OPC_IMM_PACKET,	15, "OPC_CONFIG_REQ",	ln_IB_configRequest },	// with 15 bytes, it probably is an IB specific config request
 	{ OPC_WR_SL_DATA,	14, "OPC_WR_SL_DATA",	ln_slotWrite },
+	{ OPC_PEER_XFER,	15, "OPC_PEER_XFER",	ln_peerXfer },			// LNCV read replies
+	{ OPC_LONG_ACK,		 4,	"OPC_LONG_ACK",		ln_longAckRx },			// LNCV write acknowledge
 
 	// some send-only blocks to have them as debug output
 	{ OPC_SL_RD_DATA,	14,	"OPC_SL_RD_DATA",	NULL },
-	{ OPC_LONG_ACK,		 4,	"OPC_LONG_ACK",		NULL },
-	{ OPC_PEER_XFER,	15, "OPC_PEER_XFER",	NULL },
 
 	// end of list
 	{ 0x00, 0, "(**unknown**)", NULL }
@@ -555,69 +574,6 @@ static uint8_t ln_speed2msg (int speeds, int speed)
 	}
 }
 
-/**
- * Transform a binary block (using all 8 bits of a byte) to the
- * LocoNet message format with 7 bits per byte only. A maximum of
- * 7 bytes can be tranformed to 8 bytes of LocoNet data.
- *
- * The first byte of the subpart of the message will receive all
- * the MSBits of the following bytes which then are simply put there
- * with their MSB stipped away.
- *
- * The resulting message array 'msg' must at least have len + 1 bytes
- * of space to hold the result. The first byte will contain the MSBit
- * from the follow-up bytes.
- *
- * \param bin		pointer to the real binary bytes containing the message to transform
- * \param msg		pointer to the resulting message bytes, each only allowed to contain 7-bit bytes
- * \param len		the length of the binary package (max 7 bytes)
- */
-static void ln_bin2msg (uint8_t *bin, uint8_t *msg, int len)
-{
-	uint8_t *p, mask;
-
-	if (!bin || !msg || len <= 0) return;	// nothing to do
-	if (len > 7) len = 7;					// take care not to overwrite other stuff :-)
-	p = msg;
-	mask = 0x01;
-	*p++ = 0;								// initialize the MSBit storage and let p point to &msg[1]
-	while (len) {
-		if (*bin & 0x80) *msg |= mask;
-		*p++ = *bin++ & 0x7F;
-		mask <<= 1;
-		len--;
-	}
-}
-
-/**
- * Transfor a sequence of 7-bit bytes to a binary data array holding the
- * corresponding 8-bit bytes. This is the inverser of \ref ln_bin2msg().
- *
- * The first byte of the message contains the MSBits of the followup
- * 7-bit bytes. The target buffer 'bin' must supply space for len bytes
- * and len + 1 bytes from the message are interpreted.
- *
- * \param bin		pointer to the real binary bytes that will contai the resulting 8-bit bytes
- * \param msg		pointer to the original message bytes, each only contain 7-bit bytes
- * \param len		the length of the binary package (max 7 bytes)
- */
-static void ln_msg2bin (uint8_t *bin, uint8_t *msg, int len)
-{
-	uint8_t *p, mask;
-
-	if (!bin || !msg || len <= 0) return;	// nothing to do
-	if (len > 7) len = 7;					// take care not to overwrite other stuff :-)
-	p = &msg[1];
-	mask = 0x01;
-	while (len) {
-		*bin = *p++;
-		if (*msg & mask) *bin |= 0x80;
-		bin++;
-		mask <<= 1;
-		len--;
-	}
-}
-
 static int ln_lookupSlot (int adr)
 {
 	int slot;
@@ -702,6 +658,119 @@ static void ln_sendSlot (uint8_t n)
 	ln_sendBlock(blk);
 }
 
+/*
+ * The programming slot #124
+ * -------------------------
+ * A task written to the programming slot is acknowledged by a LONG_ACK. If a
+ * result is expected, the slot is sent back as OPC_SL_RD_DATA when the task
+ * is finished. Service mode tasks are all done in direct mode, because this is
+ * the only mode supported by our programming track engine. Operations mode
+ * tasks are mapped to the POM functions and, if a feedback is requested, are
+ * answered with the RailCom reply of the decoder.
+ */
+static void ln_sendProgSlot (void)
+{
+	uint8_t blk[LN_MAX_BLOCK_LEN];
+
+	progslot.trk = ln_trackstatus();
+	if (progbusy) progslot.trk |= 0x08;		// programming track is busy
+	lnp_encodeProgSlot(OPC_SL_RD_DATA, &progslot, blk);
+	ln_sendBlock(blk);
+}
+
+static void ln_progResult (uint8_t pstat, int data)
+{
+	progslot.pstat = pstat;
+	if (data >= 0) progslot.data = data;
+	progbusy = false;
+	ln_sendProgSlot();
+}
+
+static void ln_ptCallback (int rc, void *priv)
+{
+	(void) priv;
+
+	switch (rc) {
+		case ERR_NO_LOCO:
+		case ERR_SHORT:
+			ln_progResult(LNP_PSTAT_NODECODER, -1);
+			break;
+		case ERR_INTERRUPTED:
+			ln_progResult(LNP_PSTAT_ABORTED, -1);
+			break;
+		default:
+			if (rc < 0) {
+				ln_progResult((progslot.pcmd & LNP_PCMD_WRITE) ? LNP_PSTAT_WRITEFAIL : LNP_PSTAT_READFAIL, -1);
+			} else if (progslot.pcmd & (LNP_PCMD_BYTE | LNP_PCMD_WRITE)) {
+				ln_progResult(LNP_PSTAT_OK, rc & 0xFF);
+			} else {								// bit read: report the bit value in the D bit
+				ln_progResult(LNP_PSTAT_OK, (progslot.data & ~0x08) | ((rc) ? 0x08 : 0));
+			}
+			break;
+	}
+}
+
+static bool ln_pomCallback (struct decoder_reply *msg, flexval priv)
+{
+	(void) priv;
+
+	if (!msg || msg->mt != DECODERMSG_POM || !msg->len) {
+		ln_progResult((progslot.pcmd & LNP_PCMD_WRITE) ? LNP_PSTAT_WRITEFAIL : LNP_PSTAT_READFAIL, -1);
+	} else {
+		ln_progResult(LNP_PSTAT_OK, msg->data[0]);
+	}
+	return false;
+}
+
+static int ln_pomTask (struct lnp_progslot *ps, reply_handler handler)
+{
+	if (!(ps->pcmd & LNP_PCMD_WRITE)) return dccpom_readByte(ps->adr, DECODER_DCC_MOBILE, ps->cv, handler, fvNULL);
+	if (ps->pcmd & LNP_PCMD_BYTE) return dccpom_writeByte(ps->adr, DECODER_DCC_MOBILE, ps->cv, ps->data, handler, fvNULL);
+	return dccpom_writeBit(ps->adr, DECODER_DCC_MOBILE, ps->cv, ps->data & 0x07, !!(ps->data & 0x08), handler, fvNULL);
+}
+
+static int ln_progTask (uint8_t *blk)
+{
+	struct lnp_progslot ps;
+	enum lnp_progmode mode;
+
+	if (!lnp_decodeProgSlot(blk, &ps)) {
+		ln_longACK(blk[0], LNP_ACK_NOTIMPL);
+		return -1;
+	}
+	if (progbusy) {
+		ln_longACK(blk[0], LNP_ACK_BUSY);
+		return -1;
+	}
+
+	mode = lnp_progMode(ps.pcmd);
+	log_msg (LOG_INFO, "%s() PCMD 0x%02x ADR %d CV %d DATA 0x%02x\n", __func__, ps.pcmd, ps.adr, ps.cv + 1, ps.data);
+	ps.pstat = LNP_PSTAT_OK;
+	progslot = ps;
+
+	if (mode == LNP_MODE_OPS) {				// no feedback: acknowledge blind and forget about it
+		if (!(ps.pcmd & LNP_PCMD_WRITE) || ln_pomTask(&ps, NULL) != 0) {
+			ln_longACK(blk[0], LNP_ACK_NOTIMPL);
+			return -1;
+		}
+		ln_longACK(blk[0], LNP_ACK_BLIND);
+		return 0;
+	}
+
+	progbusy = true;
+	ln_longACK(blk[0], LNP_ACK_ACCEPTED);	// the acknowledge must be queued before the result
+	if (mode == LNP_MODE_OPSFEEDBACK) {
+		if (ln_pomTask(&ps, ln_pomCallback) != 0) ln_pomCallback(NULL, fvNULL);
+	} else if (ps.pcmd & LNP_PCMD_BYTE) {
+		if (ps.pcmd & LNP_PCMD_WRITE) dccpt_cvWriteByteBG(ps.cv, ps.data, ln_ptCallback, NULL);
+		else dccpt_cvReadByteBG(ps.cv, ln_ptCallback, NULL);
+	} else {
+		if (ps.pcmd & LNP_PCMD_WRITE) dccpt_cvWriteBitBG(ps.cv, ps.data & 0x07, !!(ps.data & 0x08), ln_ptCallback, NULL);
+		else dccpt_cvReadBitBG(ps.cv, ps.data & 0x07, ln_ptCallback, NULL);
+	}
+	return 0;
+}
+
 static int ln_pwrOff (uint8_t *blk)
 {
 	(void) blk;
@@ -742,6 +811,7 @@ static int ln_slotSpeed (uint8_t *blk)
 			rq_setSpeed(adr, (l->speed & 0x80) | ln_msg2speed(loco_getSpeeds(l->loco), blk[2]));
 		}
 		slots[slot].lastspeed = l->speed;
+		slots[slot].lastcmd = xTaskGetTickCount();
 	}
 	return 0;
 }
@@ -766,6 +836,7 @@ static int ln_slotDirFunc (uint8_t *blk)
 		rq_setFuncMasked(adr, newfuncs, FUNC_F0_F4);
 		slots[slot].lastfuncs = l->funcs[0];
 		slots[slot].lastspeed = l->speed;
+		slots[slot].lastcmd = xTaskGetTickCount();
 	}
 	return 0;
 }
@@ -783,6 +854,7 @@ static int ln_slotFunc58 (uint8_t *blk)
 		newfuncs = (blk[2] & 0x0F) << 5;
 		rq_setFuncMasked(adr, newfuncs, FUNC_F5_F8);
 		slots[slot].lastfuncs = l->funcs[0];
+		slots[slot].lastcmd = xTaskGetTickCount();
 	}
 	return 0;
 }
@@ -801,6 +873,7 @@ static int ln_slotFunc912 (uint8_t *blk)
 		log_msg (LOG_INFO, "%s(%d) NEW 0x%08lx MASK 0x%08x\n", __func__, adr, newfuncs, FUNC_F9_F12);
 		rq_setFuncMasked(adr, newfuncs, FUNC_F9_F12);
 		slots[slot].lastfuncs = l->funcs[0];
+		slots[slot].lastcmd = xTaskGetTickCount();
 	}
 	return 0;
 }
@@ -838,6 +911,7 @@ static int ln_slotFuncUH (uint8_t *blk)
 				break;
 		}
 		slots[slot].lastfuncs = l->funcs[0];
+		slots[slot].lastcmd = xTaskGetTickCount();
 	}
 	return 0;
 }
@@ -853,7 +927,7 @@ static int ln_FuncDigitrax (uint8_t *blk)
 	if (blk[2] != 0x7F) return -1;					// no - this is not an immediate N-Byte paket
 	// blk[4] contains the following byte's MSBits
 	db[0] = db[1] = db[2] = db[3] = db[4] = 0;		// just to keep compiler happy (maybe used uninitialized)
-	ln_msg2bin(db, &blk[4], 5);
+	lnp_msg2bin(db, &blk[4], 5);
 
 	if (!(db[0] & 0x80)) { //short address
 		adr = db[0];
@@ -906,30 +980,38 @@ static int ln_trntSwitch (uint8_t *blk)
  * LocoNet simple feed back modules
  * Addresses can range from 0 to 4095 equivalent to 256 s88 modules
  */
-static int ln_Input (uint8_t *blk)
+
+/**
+ * Set a single feedback input of the LocoNet range.
+ *
+ * \param adr		the zero based input number inside the LocoNet range
+ * \param on		the new state of the input
+ */
+static void ln_feedback (int adr, bool on)
 {
 #ifdef CENTRAL_FEEDBACK
-	uint16_t adr;
-
-	adr = ((blk[2] & 0x0F) << 7) + blk[1];
-	adr <<= 1;
-	if(blk[2] & 0x20) adr++;
-
-	fb_BitInput(adr + FB_LNET_OFFSET, !!(blk[2] & 0x10));
+	fb_BitInput(adr + FB_LNET_OFFSET, on);
 #else
 	volatile uint16_t *input;
-	uint16_t adr;
 
 	input = s88_getInputs();
-	adr = ((blk[2] & 0x0F) << 7) + blk[1];
-	adr <<= 1;
-	if(blk[2] & 0x20) adr++;
 	input[adr/16] &= ~(0x8000>>(adr % 16));
-	if(blk[2] & 0x10) {
+	if (on) {
 		input[adr/16] |= 0x8000>>(adr % 16);
 	}
 	s88_triggerUpdate();
 #endif
+}
+
+static int ln_Input (uint8_t *blk)
+{
+	uint16_t adr;
+
+	adr = ((blk[2] & 0x0F) << 7) + blk[1];
+	adr <<= 1;
+	if(blk[2] & 0x20) adr++;
+
+	ln_feedback(adr, !!(blk[2] & 0x10));
 	log_msg (LOG_INFO, "%s() Modul %d, input %X %s\n", __func__, adr / 16, adr % 16, (blk[2] & 0x10)? "on" : "off");
 	return 0;
 }
@@ -941,9 +1023,14 @@ static int ln_writeSlotStat (uint8_t *blk)
 	slot = blk[1];
 	log_msg (LOG_INFO, "%s(#%d) STATUS 0x%02x (old 0x%02x)\n", __func__, slot, blk[2], ln_slotstatus(slot));
 	if (slot > 0 && slot < NUMBER_OF_SLOTS) {
-		slots[slot].status = blk[2] >> 4;
-		if (slots[slot].status == SLOT_INUSE) ln_controlEvent(slot, 1);
-		else ln_controlEvent(slot, 0);
+		slots[slot].status = (blk[2] & LNP_STAT_MASK) >> LNP_STAT_SHIFT;
+		if (slots[slot].status == SLOT_INUSE) {
+			slots[slot].lastcmd = xTaskGetTickCount();
+			ln_controlEvent(slot, 1);
+		} else {
+			loco_release(slots[slot].adr, LN_OWNER);
+			ln_controlEvent(slot, 0);
+		}
 	}
 	return 0;
 }
@@ -959,9 +1046,14 @@ static int ln_slotMove (uint8_t *blk)
 	if (src >= NUMBER_OF_SLOTS || dest >= NUMBER_OF_SLOTS) {
 		ln_longACK(blk[0], 0);
 	} else if (src == 0) {
+		if (slot0stack && loco_acquire(slots[slot0stack].adr, LN_OWNER, OWN_ACQUIRE) < 0) {
+			log_msg (LOG_INFO, "%s() DISPATCH GET slot#%d: loco %d was taken by another client\n", __func__, slot0stack, slots[slot0stack].adr);
+			slot0stack = 0;
+		}
 		if (slot0stack) {		// get Block from DISPATCH if a slot was put there before
 			log_msg (LOG_INFO, "%s() DISPATCH GET slot#%d\n", __func__, slot0stack);
 			slots[slot0stack].status = SLOT_INUSE;
+			slots[slot0stack].lastcmd = xTaskGetTickCount();
 			ln_sendSlot(slot0stack);
 			ln_controlEvent(slot0stack, 1);
 			slot0stack = 0;
@@ -971,14 +1063,23 @@ static int ln_slotMove (uint8_t *blk)
 		}
 	} else if (dest == 0) {		// mark slot as DISPATCH (which one? --> probably src)
 		log_msg (LOG_INFO, "%s() DISPATCH PUT slot#%d\n", __func__, src);
+		if (loco_dispatch(slots[src].adr, LN_OWNER) < 0) {		// the loco is controlled by another client
+			ln_longACK(blk[0], 0);
+			return 0;
+		}
 		slots[src].status = SLOT_COMMON;
 		slots[src].id = 0;					// zero out slot-ID when dispatching for a new throttle
 		slot0stack = src;
 		ln_controlEvent(src, 0);
 	} else {
-		if (src == dest) {
-			slots[src].status = SLOT_INUSE;	// NULL-move, occupy this slot
+		if (src == dest && slots[src].status != SLOT_FREE) {	// NULL-move, occupy this slot
+			if (loco_acquire(slots[src].adr, LN_OWNER, OWN_ACQUIRE) < 0) {		// the loco is controlled by another client
+				ln_longACK(blk[0], 0);
+				return 0;
+			}
+			slots[src].status = SLOT_INUSE;
 			slots[src].id = 0;
+			slots[src].lastcmd = xTaskGetTickCount();
 			ln_controlEvent(src, 1);
 		}
 		ln_sendSlot(dest);
@@ -988,7 +1089,8 @@ static int ln_slotMove (uint8_t *blk)
 
 static int ln_slotRead (uint8_t *blk)
 {
-	ln_sendSlot(blk[1]);
+	if (blk[1] == LNP_PROGSLOT) ln_sendProgSlot();
+	else ln_sendSlot(blk[1]);
 	return 0;
 }
 
@@ -1093,7 +1195,7 @@ static int ln_sendLocConfig(int adr)
     blk[3] = 'I';
     blk[4] = 'K';		// 'K' in reply!
     blk[5] = 0x0B;
-	ln_bin2msg(db, &blk[6], 7);
+	lnp_bin2msg(db, &blk[6], 7);
 	ln_sendBlock(blk);
 
 	return 0;
@@ -1107,7 +1209,7 @@ static int ln_IB_configRequest (uint8_t *blk)
 	if (blk[3] != 'I' || blk[4] != 'B' || blk[5] != 0x0D) return -1;	// no - this is not IB
 	// blk[6] contains the following byte's MSBits
 	db[0] = db[1] = 0;		// just to keep compiler happy (maybe used uninitialized)
-	ln_msg2bin(db, &blk[6], 2);
+	lnp_msg2bin(db, &blk[6], 2);
 	adr = db[0] | (db[1] << 8);
 	ln_sendLocConfig(adr);
 	return 0;
@@ -1135,31 +1237,54 @@ static enum fmt ln_fmtFromStatus (uint8_t status)
 	return FMT_UNKNOWN;		// to keep compiler happy
 }
 
+/**
+ * A throttle writes a complete loco slot. FRED throttles do this after a
+ * DISPATCH GET to store their ID in the slot and when they let the loco go.
+ * Setting the slot to IN_USE acquires the loco for the LocoNet, leaving this
+ * state releases it. While the slot is in use, the speed, direction and
+ * functions F0 - F8 are taken over as if they were sent with the single
+ * commands.
+ */
 static int ln_slotWrite (uint8_t *blk)
 {
+	struct lnp_slotdata sd;
 	locoT *l;
+	uint8_t cmd[4];
 	int n;
-//	int i;
 
-	// TODO: maybe we must interpret the written data - for now let's just acknowledge a success
 	n = blk[2];		// slot number
-	if (n < 0 || n >= NUMBER_OF_SLOTS) {
+	if (n == LNP_PROGSLOT) return ln_progTask(blk);
+	if (!lnp_decodeSlotData(blk, &sd) || n >= NUMBER_OF_SLOTS || slots[n].status == SLOT_FREE) {
 		ln_longACK(blk[0], 0x00);
 		return -1;
 	}
 
-//	log_msg (LOG_INFO, "%s(): ", __func__);	// test for manipulation of speed step setting
-//	for (i = 0; i < 14; i++) {
-//		log_msg (LOG_INFO, " 0x%02x", blk[i]);
-//	}
-//	putchar ('\n');
-	slots[n].id = blk[11] | (blk[12] << 7);		// currently we only accept the ID for FRED(I) throttles
+	log_msg (LOG_INFO, "%s(#%d) STATUS %d ID 0x%04x\n", __func__, n, sd.status, sd.id);
+	if (sd.status == SLOT_INUSE && slots[n].status != SLOT_INUSE) {
+		if (loco_acquire(slots[n].adr, LN_OWNER, OWN_ACQUIRE) < 0) {		// the loco is controlled by another client
+			ln_longACK(blk[0], 0x00);
+			return -1;
+		}
+	} else if (sd.status != SLOT_INUSE && slots[n].status == SLOT_INUSE) {
+		loco_release(slots[n].adr, LN_OWNER);
+	}
+	slots[n].status = sd.status;
+	slots[n].id = sd.id;
+	slots[n].lastcmd = xTaskGetTickCount();
+
 	if (slots[n].status == SLOT_INUSE) {
 		if ((l = db_getLoco(slots[n].adr, false)) != NULL) {
-			if (db_getSpeeds(ln_fmtFromStatus(blk[3])) != loco_getSpeeds(l)) {
-				db_setLocoFmt(slots[n].adr, ln_fmtFromStatus(blk[3]));
+			if (db_getSpeeds(ln_fmtFromStatus(sd.stat1)) != loco_getSpeeds(l)) {
+				db_setLocoFmt(slots[n].adr, ln_fmtFromStatus(sd.stat1));
 			}
 		}
+		cmd[1] = n;
+		cmd[2] = sd.dirf;
+		ln_slotDirFunc(cmd);
+		cmd[2] = sd.spd;
+		ln_slotSpeed(cmd);
+		cmd[2] = sd.snd;
+		ln_slotFunc58(cmd);
 		ln_controlEvent(n, 1);
 	} else {
 		ln_controlEvent(n, 0);
@@ -1168,8 +1293,124 @@ static int ln_slotWrite (uint8_t *blk)
 	return 0;
 }
 
+/**
+ * Transponder reports are fed into the block occupancy model. The
+ * sections are numbered like the LocoNet feedback inputs. The occupancy of
+ * the block is also set as the state of this feedback input, so clients
+ * that only know about feedback inputs see the section as occupied as long
+ * as at least one loco is reported in it.
+ */
+static int ln_multiSense (uint8_t *blk)
+{
+	struct lnp_transponder tp;
+	int occupied;
+
+	if (!lnp_decodeMultiSense(blk, &tp)) return -1;
+	log_msg (LOG_INFO, "%s() section %d loco %d %s\n", __func__, tp.section, tp.adr, (tp.present) ? "present" : "absent");
+	if ((occupied = BDBbm_transponder(FB_LNET_OFFSET + tp.section, tp.adr, tp.present)) < 0) occupied = tp.present;
+	if (tp.section < MAX_LNETMODULES * 16) ln_feedback(tp.section, occupied);
+	return 0;
+}
+
+static void ln_lncvAnswer (int result)
+{
+	TaskHandle_t t;
+
+	if ((t = lncv.waiter) != NULL) {
+		lncv.result = result;
+		lncv.waiter = NULL;
+		xTaskNotifyGive(t);
+	}
+}
+
+static int ln_peerXfer (uint8_t *blk)
+{
+	struct lnp_lncv rep;
+
+	if (!lnp_decodeLNCV(blk, &rep) || rep.cmd != LNCV_CMD_READREPLY) return -1;
+	log_msg (LOG_INFO, "%s() LNCV ART %u CV %u = %u\n", __func__, rep.article, rep.cv, rep.value);
+	if (!lncv.write && rep.article == lncv.article && rep.cv == lncv.cv) ln_lncvAnswer(rep.value);
+	return 0;
+}
+
+static int ln_longAckRx (uint8_t *blk)
+{
+	if (blk[1] != (OPC_IMM_PACKET & 0x7F)) return -1;		// we only expect the acknowledge of LNCV writes
+	if (lncv.write) ln_lncvAnswer((blk[2] == LNCV_WRITE_OK) ? 0 : -2);
+	return 0;
+}
+
+/**
+ * Send a LNCV request to the modules and wait for the answer.
+ *
+ * \param cmd		the command (LNCV_CMD_READ or LNCV_CMD_WRITE)
+ * \param article	the article number of the module
+ * \param cv		the LNCV to read or write
+ * \param value		the value to write (or the module address when starting or stopping a session)
+ * \param flags		the session flags
+ * \return			the value read, 0 for a successful write or a negative error code
+ */
+static int ln_lncvRequest (uint8_t cmd, int article, int cv, int value, uint8_t flags)
+{
+	struct lnp_lncv req;
+	uint8_t blk[LN_MAX_BLOCK_LEN];
+	int rc;
+
+	if (!txqueue || !mutex_lock(&lncvmutex, LNCV_TIMEOUT, __func__)) return -1;
+
+	req.src = LNCV_SRC_MASTER;
+	req.dst = LNCV_SRC_MODULE;
+	req.cmd = cmd;
+	req.article = article;
+	req.cv = cv;
+	req.value = value;
+	req.flags = flags;
+	lnp_encodeLNCV(OPC_IMM_PACKET, &req, blk);
+
+	lncv.article = article;
+	lncv.cv = cv;
+	lncv.write = (cmd == LNCV_CMD_WRITE);
+	lncv.result = -1;							// timeout
+	xTaskNotifyStateClear(NULL);
+	lncv.waiter = (flags & LNCV_FLAG_PROFF) ? NULL : xTaskGetCurrentTaskHandle();	// there is no answer when stopping the session
+	ln_sendBlock(blk);
+	if (lncv.waiter) ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LNCV_TIMEOUT));
+	lncv.waiter = NULL;
+	rc = (flags & LNCV_FLAG_PROFF) ? 0 : lncv.result;
+	mutex_unlock(&lncvmutex);
+	return rc;
+}
+
+/**
+ * Start a LNCV programming session with a module.
+ *
+ * \param article	the article number of the module
+ * \param module	the module address (LNCV 0)
+ * \return			the module address as reported by the module or a negative error code
+ */
+int ln_lncvStart (int article, int module)
+{
+	return ln_lncvRequest(LNCV_CMD_READ, article, 0, module, LNCV_FLAG_PRON);
+}
+
+int ln_lncvRead (int article, int cv)
+{
+	return ln_lncvRequest(LNCV_CMD_READ, article, cv, 0, 0);
+}
+
+int ln_lncvWrite (int article, int cv, int value)
+{
+	return ln_lncvRequest(LNCV_CMD_WRITE, article, cv, value, 0);
+}
+
+void ln_lncvEnd (int article, int module)
+{
+	ln_lncvRequest(LNCV_CMD_READ, article, 0, module, LNCV_FLAG_PROFF);
+}
+
 static bool ln_eventHandler (eventT *e, void *arg)
 {
+	struct own_change *oc;
 	fbeventT *fbev;
 	uint8_t blk[LN_MAX_BLOCK_LEN];
 	ldataT *l;
@@ -1268,6 +1509,15 @@ static bool ln_eventHandler (eventT *e, void *arg)
 			}
 			slots[slot].lastspeed = l->speed;
 			break;
+		case EVENT_LOCO_OWNER:
+			oc = (struct own_change *) e->src;
+			if (!oc->taken || oc->from != LN_OWNER) break;
+			if ((slot = ln_lookupSlot(oc->adr)) > 0 && slots[slot].status == SLOT_INUSE) {		// the throttle lost the loco
+				slots[slot].status = SLOT_COMMON;
+				ln_sendSlot(slot);
+				ln_controlEvent(slot, 0);
+			}
+			break;
 		case EVENT_TURNOUT:
 			t = (turnoutT *) e->src;
 			if (t->adr <= 2048) {
@@ -1384,10 +1634,40 @@ static void ln_sender (void *pvParameter)
 	}
 }
 
+/**
+ * Purge the slots of throttles that vanished (i.e. an unplugged FRED). A slot
+ * that is in use, but was not accessed for LNP_PURGE_TIME, is set back to
+ * COMMON and the loco is released. The loco keeps running as it was and any
+ * throttle can select it again.
+ */
+static void ln_purgeSlots (void)
+{
+	TickType_t now;
+	int slot;
+
+	now = xTaskGetTickCount();
+	for (slot = 1; slot < NUMBER_OF_SLOTS; slot++) {
+		if (slots[slot].status != SLOT_INUSE || (now - slots[slot].lastcmd) < pdMS_TO_TICKS(LNP_PURGE_TIME)) continue;
+		log_msg (LOG_INFO, "%s() slot #%d (loco %d, ID 0x%04x) purged\n", __func__, slot, slots[slot].adr, slots[slot].id);
+		slots[slot].status = SLOT_COMMON;
+		loco_release(slots[slot].adr, LN_OWNER);
+		ln_controlEvent(slot, 0);
+	}
+}
+
+/**
+ * Put a loco to the DISPATCH slot on behalf of the client served by the
+ * calling task (i.e. Z21 LAN_LOCONET_DISPATCH_ADDR). The next throttle that
+ * does a DISPATCH GET will control this loco.
+ *
+ * \param adr		the loco to dispatch
+ * \return			the slot of the loco or -1 if no slot is free or the loco is controlled by another client
+ */
 int ln_dispatchLoco (int adr)
 {
 	int slot;
 
+	if (loco_dispatch(adr, loco_getClient()) < 0) return -1;
 	db_getLoco (adr, true);
 	slot = ln_lookupSlot (adr);
 	if (slot < 1) {
@@ -1406,6 +1686,7 @@ void vLocoNet (void *pvParameter)
 {
 	uint8_t blk[LN_MAX_BLOCK_LEN];
 	const struct decoder *d;
+	TickType_t lastpurge;
 	int n;
 
 	(void) pvParameter;
@@ -1427,11 +1708,13 @@ void vLocoNet (void *pvParameter)
 	}
 
 	rxtask = xTaskGetCurrentTaskHandle();
+	loco_setClient(LN_OWNER);
 	backoff = 0;		// superfluous - but for clarity: we are MASTER and have no addition al timeouts!
 	xTaskCreate(ln_sender, "LN-TX", 1024, NULL, 1, NULL);
 	event_register(EVENT_SYS_STATUS, ln_eventHandler, NULL, 0);
 	event_register(EVENT_LOCO_FUNCTION, ln_eventHandler, NULL, 0);
 	event_register(EVENT_LOCO_SPEED, ln_eventHandler, NULL, 0);
+	event_register(EVENT_LOCO_OWNER, ln_eventHandler, NULL, 0);
 	event_register(EVENT_TURNOUT, ln_eventHandler, NULL, 0);
 	event_register(EVENT_FBNEW, ln_eventHandler, NULL, 0);
 //	_lnet_setModules(0, cnf_getconfig()->lnetModules);
@@ -1443,8 +1726,13 @@ void vLocoNet (void *pvParameter)
 	}
 #endif
 
+	lastpurge = xTaskGetTickCount();
 	for (;;) {
-		if (xQueueReceive(rxqueue, blk, portMAX_DELAY)) {
+		if ((xTaskGetTickCount() - lastpurge) >= pdMS_TO_TICKS(1000)) {
+			ln_purgeSlots();
+			lastpurge = xTaskGetTickCount();
+		}
+		if (xQueueReceive(rxqueue, blk, pdMS_TO_TICKS(1000))) {
 #if PACKET_DUMP != 0
 			ln_dumpPacket(blk, false);
 #endif
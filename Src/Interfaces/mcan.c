@@ -32,6 +32,7 @@
 #include "timers.h"
 #include "config.h"
 #include "bidib.h"
+#include "mcancfg.h"
 
 #define CAN_WORDS_PER_MSG		4			///< the number of 32bit words used for every buffer position (max. 8 data bytes)
 #define CAN_WORDS_PER_TXEVENT	2			///< the number of 32bit words used for every TX event entry
@@ -49,6 +50,7 @@
 
 #define CAN_MAXUNIT				16
 #define ALIVE_VALUE				10			// full live
+#define CFG_RETRIES				3			///< the number of retries for a block of the status data configuration
 
 #define CAN_SYS					0x00
 #define CAN_SUB_STOP			0x00
@@ -61,6 +63,7 @@
 #define CAN_LF					0x06
 #define CAN_AC					0x0B
 #define CAN_S88					0x11
+#define CAN_STATUSCFG			MCC_CMD_STATUSCFG
 
 typedef union {
 	struct {
@@ -143,6 +146,24 @@ static struct CAN_Client {
 	uint16_t	hash;
 } can_clients[CAN_MAXUNIT];
 
+/**
+ * A device with config channels and the progress of reading them
+ */
+static struct cfgdev {
+	struct mcc_device	dev;				///< the description and the config channels
+	bool				described;			///< block 0 (the device description) was read
+	bool				failed;				///< reading the status data configuration failed
+	uint16_t			pending[MCC_MAXCHANNELS];	///< the values written to the channels (taken over when confirmed)
+} *cfgdevs[MCC_MAXDEVICES];
+
+static SemaphoreHandle_t cfgmutex;			///< protects the config devices and the Link S88 mapping
+static struct mcc_stream cfgstream;			///< the block that is currently read
+static struct cfgdev *cfgreading;			///< the device that is currently read (NULL = idle)
+static int cfgretry;						///< the number of retries for the current block
+static bool cfgprogress;					///< frames were received since the last check in aliveTimer()
+static struct mcc_link links[MCC_MAXDEVICES];	///< the feedback mapping of the Link S88 devices
+static int nlinks;							///< the number of Link S88 devices in the mapping
+
 static QueueHandle_t txqueue;
 static QueueHandle_t rxqueue;
 static TaskHandle_t rx_taskid;
@@ -312,6 +333,315 @@ static int mcan_sendframe (uint32_t id, bool eid, int len, void *data)
 	return 0;
 }
 
+/**
+ * Request the current block of the status data configuration.
+ * Must be called with cfgmutex locked.
+ */
+static void mcan_cfgRequest (void)
+{
+	uint8_t data[8];
+	int dlc;
+
+	dlc = mcc_encodeStatusRequest(cfgstream.uid, cfgstream.index, data);
+	mcc_streamStart(&cfgstream, cfgstream.uid, cfgstream.index);
+	mcan_sendframe (MCC_ID(0, MCC_CMD_STATUSCFG, false, mc_hash), true, dlc, data);
+}
+
+/**
+ * Start reading the next block of a device that is not complete yet.
+ * Must be called with cfgmutex locked.
+ */
+static void mcan_cfgNext (void)
+{
+	struct cfgdev *cd;
+	int i;
+
+	cfgreading = NULL;
+	for (i = 0; i < MCC_MAXDEVICES; i++) {
+		if ((cd = cfgdevs[i]) == NULL || cd->failed) continue;
+		if (!cd->described) {
+			mcc_streamStart(&cfgstream, cd->dev.uid, 0);
+		} else if (cd->dev.nch < cd->dev.channels && cd->dev.nch < MCC_MAXCHANNELS) {
+			mcc_streamStart(&cfgstream, cd->dev.uid, cd->dev.nch + 1);
+		} else {
+			continue;
+		}
+		cfgreading = cd;
+		cfgretry = 0;
+		cfgprogress = true;
+		mcan_cfgRequest();
+		return;
+	}
+}
+
+static struct mcc_channel *mcan_cfgChannel (struct mcc_device *dev, int ch)
+{
+	if (ch < 1 || ch > dev->nch) return NULL;
+	return &dev->ch[ch - 1];
+}
+
+/**
+ * Rebuild the feedback mapping of all Link S88 devices that are completely
+ * read and ask them for the current state of their contacts. The number of
+ * CAN feedback modules is raised if the Link S88 devices need more modules.
+ * Must be called with cfgmutex locked.
+ *
+ * \return		the number of feedback modules used by the Link S88 devices
+ */
+static int mcan_ls88Update (void)
+{
+	struct mcc_device *dev;
+	struct mcc_channel *ch;
+	struct mcc_link *l;
+	uint8_t data[8];
+	int i, b, dlc, modules;
+
+	nlinks = 0;
+	for (i = 0; i < MCC_MAXDEVICES; i++) {
+		if (!cfgdevs[i] || cfgdevs[i]->dev.devid != MCC_DEV_LINKS88) continue;
+		dev = &cfgdevs[i]->dev;
+		if (!cfgdevs[i]->described || dev->nch < MCC_LS88_CYCLE1 - 1) continue;
+		l = &links[nlinks++];
+		ch = mcan_cfgChannel(dev, MCC_LS88_NODE);
+		l->node = (ch) ? ch->value : 0;
+		for (b = 0; b < MCC_LS88_BUSSES; b++) {
+			ch = mcan_cfgChannel(dev, MCC_LS88_BUS1 + b);
+			l->bus[b] = (ch) ? ch->value : 0;
+		}
+	}
+	modules = mcc_layout(links, nlinks);
+
+	for (i = 0; i < nlinks; i++) {
+		l = &links[i];
+		dlc = mcc_encodeS88Range(l->node, 1, 16, data);
+		mcan_sendframe (MCC_ID(0, MCC_CMD_S88EVENT, false, mc_hash), true, dlc, data);
+		for (b = 0; b < MCC_LS88_BUSSES; b++) {
+			if (!l->bus[b]) continue;
+			dlc = mcc_encodeS88Range(l->node, (b + 1) * MCC_LS88_CONTACTS + 1, (b + 1) * MCC_LS88_CONTACTS + l->bus[b] * 16, data);
+			mcan_sendframe (MCC_ID(0, MCC_CMD_S88EVENT, false, mc_hash), true, dlc, data);
+		}
+	}
+	log_msg (LOG_INFO, "%s() %d Link S88 with %d modules\n", __func__, nlinks, modules);
+	return modules;
+}
+
+/**
+ * A device with config channels was found. The reading of the status data
+ * configuration starts, if no other device is currently read.
+ *
+ * \param uid		the UID of the device
+ * \param devid		the device ID from the ping reply
+ */
+static void mcan_cfgDiscover (uint32_t uid, uint16_t devid)
+{
+	struct cfgdev *cd;
+	int i, free;
+
+	if (devid != MCC_DEV_LINKS88 && devid != MCC_DEV_GLEISBOX && devid != MCC_DEV_GLEISBOX2) return;
+	if (!mutex_lock(&cfgmutex, 20, __func__)) return;
+	for (i = 0, free = -1; i < MCC_MAXDEVICES; i++) {
+		if (cfgdevs[i] && cfgdevs[i]->dev.uid == uid) break;
+		if (!cfgdevs[i] && free < 0) free = i;
+	}
+	if (i >= MCC_MAXDEVICES && free >= 0 && (cd = calloc (1, sizeof(*cd))) != NULL) {
+		cd->dev.uid = uid;
+		cd->dev.devid = devid;
+		cfgdevs[free] = cd;
+		log_msg (LOG_INFO, "%s() device 0x%04x UID 0x%08lx\n", __func__, devid, uid);
+		if (!cfgreading) mcan_cfgNext();
+	}
+	mutex_unlock(&cfgmutex);
+}
+
+/**
+ * Handle a frame of a status data configuration reply.
+ *
+ * \param rx		the received frame
+ */
+static void mcan_cfgReply (canrxbuf *rx)
+{
+	struct mcc_channel ch;
+	struct cfgdev *cd;
+	int modules = 0;
+
+	if (!mutex_lock(&cfgmutex, 20, __func__)) return;
+	if ((cd = cfgreading) == NULL) {
+		mutex_unlock(&cfgmutex);
+		return;
+	}
+	cfgprogress = true;
+	switch (mcc_streamFrame(&cfgstream, MCC_ID_HASH(rx->id), rx->dlc, rx->data)) {
+		case MCC_STREAM_MORE:
+			break;
+		case MCC_STREAM_ERROR:
+			if (++cfgretry > CFG_RETRIES) {
+				log_error ("%s() UID 0x%08lx: block %d failed\n", __func__, cd->dev.uid, cfgstream.index);
+				cd->failed = true;
+				mcan_cfgNext();
+			} else {
+				mcan_cfgRequest();
+			}
+			break;
+		case MCC_STREAM_DONE:
+			if (cfgstream.index == 0) {
+				cd->described = mcc_parseDevice(cfgstream.buf, cfgstream.len, &cd->dev);
+				if (!cd->described) cd->failed = true;
+				if (cd->described && cd->dev.channels > MCC_MAXCHANNELS) {		// we only keep the first channels (the Link S88 needs 7)
+					log_msg (LOG_WARNING, "%s() UID 0x%08lx: %d config channels, only %d are read\n", __func__, cd->dev.uid, cd->dev.channels, MCC_MAXCHANNELS);
+					cd->dev.channels = MCC_MAXCHANNELS;
+				}
+			} else if (mcc_parseChannel(cfgstream.buf, cfgstream.len, &ch)) {
+				cd->dev.ch[cd->dev.nch++] = ch;
+			} else {
+				cd->failed = true;
+			}
+			if (cd->dev.devid == MCC_DEV_LINKS88 && cd->described && cd->dev.nch >= cd->dev.channels) {
+				modules = mcan_ls88Update();
+			}
+			mcan_cfgNext();
+			break;
+	}
+	mutex_unlock(&cfgmutex);
+	if (modules > cnf_getconfig()->canModules) can_setModules(modules);
+}
+
+/**
+ * Handle the reply to a config channel write. The written value is taken
+ * over and the Link S88 mapping is rebuilt if one of its busses was changed.
+ *
+ * \param rx		the received frame
+ */
+static void mcan_cfgWritten (canrxbuf *rx)
+{
+	struct mcc_channel *ch;
+	uint32_t uid;
+	uint8_t chn;
+	bool ok;
+	int i, modules = 0;
+
+	if (!mcc_decodeChannelWrite(rx->dlc, rx->data, &uid, &chn, &ok)) return;
+	if (!mutex_lock(&cfgmutex, 20, __func__)) return;
+	for (i = 0; i < MCC_MAXDEVICES; i++) {
+		if (!cfgdevs[i] || cfgdevs[i]->dev.uid != uid) continue;
+		if (!ok) {
+			log_error ("%s() UID 0x%08lx: writing channel %d failed\n", __func__, uid, chn);
+		} else if ((ch = mcan_cfgChannel(&cfgdevs[i]->dev, chn)) != NULL) {
+			ch->value = cfgdevs[i]->pending[chn - 1];
+			if (cfgdevs[i]->dev.devid == MCC_DEV_LINKS88 && chn >= MCC_LS88_NODE && chn <= MCC_LS88_BUS3) modules = mcan_ls88Update();
+		}
+		break;
+	}
+	mutex_unlock(&cfgmutex);
+	if (modules > cnf_getconfig()->canModules) can_setModules(modules);
+}
+
+/**
+ * Check the progress of the status data configuration reading. Called
+ * from the alive timer.
+ */
+static void mcan_cfgTimeout (void)
+{
+	if (!mutex_lock(&cfgmutex, 20, __func__)) return;
+	if (cfgreading && !cfgprogress) {
+		if (++cfgretry > CFG_RETRIES) {
+			log_error ("%s() UID 0x%08lx: no reply\n", __func__, cfgreading->dev.uid);
+			cfgreading->failed = true;
+			mcan_cfgNext();
+		} else {
+			mcan_cfgRequest();
+		}
+	}
+	cfgprogress = false;
+	mutex_unlock(&cfgmutex);
+}
+
+/**
+ * Write a config channel of a device. The new value is taken over to
+ * the channel description when the device confirms the write.
+ *
+ * \param uid		the UID of the device
+ * \param ch		the config channel
+ * \param value		the new value
+ * \return			0 if the request was sent, -1 if the device or channel is unknown or the value out of range
+ */
+int mcan_cfgWrite (uint32_t uid, int ch, int value)
+{
+	struct mcc_channel *c;
+	uint8_t data[8];
+	int i, dlc, rc = -1;
+
+	if (!mutex_lock(&cfgmutex, 20, __func__)) return -1;
+	for (i = 0; i < MCC_MAXDEVICES; i++) {
+		if (!cfgdevs[i] || cfgdevs[i]->dev.uid != uid) continue;
+		if ((c = mcan_cfgChannel(&cfgdevs[i]->dev, ch)) != NULL && value >= c->min && value <= c->max) {
+			cfgdevs[i]->pending[ch - 1] = value;
+			dlc = mcc_encodeChannelWrite(uid, ch, value, data);
+			mcan_sendframe (MCC_ID(0, MCC_CMD_SYSTEM, false, mc_hash), true, dlc, data);
+			rc = 0;
+		}
+		break;
+	}
+	mutex_unlock(&cfgmutex);
+	return rc;
+}
+
+/**
+ * Set the polling cycle of all three busses of a Link S88.
+ *
+ * \param uid		the UID of the Link S88
+ * \param ms		the polling cycle in ms
+ * \return			0 if all requests were sent, -1 otherwise
+ */
+int mcan_ls88SetCycle (uint32_t uid, int ms)
+{
+	int b, rc = 0;
+
+	for (b = 0; b < MCC_LS88_BUSSES; b++) {
+		if (mcan_cfgWrite(uid, MCC_LS88_CYCLE1 + b, ms) != 0) rc = -1;
+	}
+	return rc;
+}
+
+/**
+ * Copy the devices with config channels.
+ *
+ * \param devs		where to store the devices
+ * \param max		the maximum number of devices to copy
+ * \return			the number of devices copied
+ */
+int mcan_getConfigDevices (struct mcc_device *devs, int max)
+{
+	int i, cnt;
+
+	if (!devs || max <= 0 || !mutex_lock(&cfgmutex, 100, __func__)) return 0;
+	for (i = cnt = 0; i < MCC_MAXDEVICES && cnt < max; i++) {
+		if (cfgdevs[i]) devs[cnt++] = cfgdevs[i]->dev;
+	}
+	mutex_unlock(&cfgmutex);
+	return cnt;
+}
+
+/**
+ * Map a contact from a S88 event to a feedback input in the CAN area.
+ * Contacts of unknown devices are mapped by their contact number.
+ *
+ * \param node		the node number from the S88 event
+ * \param contact	the contact number from the S88 event
+ * \return			the zero based feedback input relative to FB_MCAN_OFFSET or -1
+ */
+static int mcan_mapContact (uint16_t node, uint16_t contact)
+{
+	int idx = -1;
+
+	if (mutex_lock(&cfgmutex, 20, __func__)) {
+		idx = mcc_mapContact(links, nlinks, node, contact);
+		if (idx < 0 && nlinks == 0) idx = contact - 1;
+		mutex_unlock(&cfgmutex);
+	}
+	if (idx >= MAX_CANMODULES * 16) idx = -1;
+	return idx;
+}
+
 static void mcan_dump (canrxbuf *fr)
 {
     int i;
@@ -614,8 +944,10 @@ static void mcan_receive (canrxbuf *rx)
 	MCAN_MSG_ID msgid;
 	uint8_t data[8], ui8, dir, fmt = 0;
 	uint16_t ui16;
-	uint16_t adr;
+	uint16_t adr, node, contact;
 	uint32_t ui32;
+	bool state;
+	int idx;
 	ldataT *l;
 
 	mcan_dump(rx);
@@ -669,6 +1001,10 @@ static void mcan_receive (canrxbuf *rx)
 					mcan_sendframe (msgid.msgID, true, 7, data);
 					break;
 
+				case MCC_SYS_STATUS:	// config channel write (only the replies are of interest)
+					if (MCC_ID_RESP(rx->id)) mcan_cfgWritten(rx);
+					break;
+
 				case 0x80:	// reset
 					printf ("%s(); RESET: %d\n", __func__, rx->data[5]);
 					mcan_sendframe (msgid.msgID, true, 6, data);
@@ -712,6 +1048,7 @@ static void mcan_receive (canrxbuf *rx)
 							can_clients[ui8].hash = rx->rb[0] & 0xFFFF;
 							printf("%s(); New Device -> SW version UID: 0x%lx; SW: 0x%lx, device: 0x%lx, hash: 0x%x\n", __func__, can_clients[ui8].UID, can_clients[ui8].sw_no, can_clients[ui8].dev_id, can_clients[ui8].hash);
 							mcan_controlEvent(ui8, 1);
+							mcan_cfgDiscover(can_clients[ui8].UID, can_clients[ui8].dev_id);
 						}
 						break;
 					} else {
@@ -918,7 +1255,7 @@ static void mcan_receive (canrxbuf *rx)
 			}
 			msgid.resp = 1;
 			if(rx->dlc == 6) {	//set function
-				loco_setFunc (adr, rx->data[4], rx->data[5] ? 1 : 0);
+				rq_setFuncGroup(adr, rx->data[4], 1, rx->data[5] ? 1 : 0);
 				for(ui8 = 0; ui8 < 8; ui8++) {
 					data[ui8] = rx->data[ui8];
 				}
@@ -966,14 +1303,16 @@ static void mcan_receive (canrxbuf *rx)
 			break;
 
 		case CAN_S88:	// s88 event
+			if (!MCC_ID_RESP(rx->id) || !mcc_decodeS88Event(rx->dlc, rx->data, &node, &contact, &state)) break;
+			if ((idx = mcan_mapContact(node, contact)) < 0) break;
 #ifdef CENTRAL_FEEDBACK
-			ui16 = (rx->data[2] << 8) + rx->data[3] - 1;	// the 1-based feedback address
-			fb_BitInput(ui16 + FB_MCAN_OFFSET, !!rx->data[5]);
+			ui8 = state;
+			fb_rangeInput(idx + FB_MCAN_OFFSET, 1, &ui8);
 #else
-			ui16 = ((rx->data[2] << 8) + rx->data[3] - 1) / 16;		// module no
-			tmp =  ((rx->data[2] << 8) + rx->data[3] - 1) % 16;		// input no
+			ui16 = idx / 16;		// module no
+			tmp =  idx % 16;		// input no
 			input = s88_getInputs();
-			if(rx->data[5]) {
+			if(state) {
 				input[ui16] |= 0x8000 >> tmp;
 			} else {
 				input[ui16] &= ~(0x8000 >> tmp);
@@ -982,6 +1321,10 @@ static void mcan_receive (canrxbuf *rx)
 #endif
 			break;
 
+		case CAN_STATUSCFG:	// status data configuration (device and config channel descriptions)
+			if (MCC_ID_RESP(rx->id) || !MCC_ISHASH(MCC_ID_HASH(rx->id))) mcan_cfgReply(rx);
+			break;
+
 		default:
 			printf ("%s(); cmd: %x; DLC: %d\n", __func__, cmd, rx->dlc);
 			break;
@@ -1020,6 +1363,7 @@ static void aliveTimer( TimerHandle_t xTimer )
 	uint8_t data[8];
 	(void) xTimer;
 
+	mcan_cfgTimeout();
 	for (uint8_t ui8 = 0; ui8 < CAN_MAXUNIT; ui8++) {
 		if (can_clients[ui8].alive > 0) {
 			if(can_clients[ui8].alive == 3) {
@@ -1066,6 +1410,7 @@ void vMCanHandler (void *pvParameter)
 	mcan_init();
 	can_modules = cnf_getconfig()->canModules;
 	rx_taskid = xTaskGetCurrentTaskHandle();
+	loco_setClient(OWN_TOKEN(OWN_MCAN, 0));
 	xTaskCreate(mcan_txhandler, "MCAN-TX", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
 	event_register(EVENT_LOCO_SPEED, mcan_eventhandler, NULL, 0);
 	event_register(EVENT_LOCO_FUNCTION, mcan_eventhandler, NULL, 0);
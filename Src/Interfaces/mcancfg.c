@@ -0,0 +1,352 @@
+/*
+ * mcancfg.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Configuration channels and S88 events of Märklin CAN devices
+ *
+ * Devices like the Link S88 or the Gleisbox describe their settings with the
+ * status data configuration (command 0x3A). A request for block 0 returns the
+ * device description, a request for block n the description and the current
+ * value of config channel n. The block is transported in data frames of eight
+ * bytes each, where the hash of the CAN ID is replaced by the packet number
+ * (starting with 1). A final frame with the real hash, the UID, the block
+ * number and the number of data frames closes the transfer.
+ *
+ * Config channels are written with the system sub command 0x0B (UID, 0x0B,
+ * channel, value). The reply carries a result byte instead of the value.
+ *
+ * The contacts of a Link S88 are numbered 1 .. 16 for the internal inputs and
+ * n * 1000 + 1 ... for the modules on bus n. Each Link S88 gets a consecutive
+ * range of feedback modules: first the internal inputs, then the modules of
+ * the three busses.
+ *
+ * Frames are passed in and out as plain structures by mcan.c, the CAN
+ * controller is never touched here. Tests/mcancfg_test.c reassembles the
+ * replies of a simulated Link S88 with it.
+ */
+
+#include <string.h>
+#include "mcancfg.h"
+
+static void mcc_putUID (uint8_t *data, uint32_t uid)
+{
+	data[0] = (uid >> 24) & 0xFF;
+	data[1] = (uid >> 16) & 0xFF;
+	data[2] = (uid >> 8) & 0xFF;
+	data[3] = uid & 0xFF;
+}
+
+static uint32_t mcc_getUID (const uint8_t *data)
+{
+	return ((uint32_t) data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+/**
+ * Copy a NUL terminated string from the block. If the string is not
+ * terminated inside the block, the rest of the block is taken.
+ *
+ * \param p			the start of the string
+ * \param end		the end of the block
+ * \param s			where to store the string (may be NULL to skip the string)
+ * \param size		the size of the target
+ * \return			the position behind the string
+ */
+static const uint8_t *mcc_string (const uint8_t *p, const uint8_t *end, char *s, int size)
+{
+	int i = 0;
+
+	while (p < end && *p) {
+		if (s && i < size - 1) s[i++] = *p;
+		p++;
+	}
+	if (s && size > 0) s[i] = 0;
+	return (p < end) ? p + 1 : end;
+}
+
+/**
+ * Encode the request for a block of the status data configuration.
+ *
+ * \param uid		the UID of the device
+ * \param index		the block to read (0 = device description, 1 .. n = config channel)
+ * \param data		the data bytes of the frame (at least 5 bytes)
+ * \return			the DLC of the frame
+ */
+int mcc_encodeStatusRequest (uint32_t uid, uint8_t index, uint8_t *data)
+{
+	mcc_putUID(data, uid);
+	data[4] = index;
+	return 5;
+}
+
+/**
+ * Encode the system command to write a config channel.
+ *
+ * \param uid		the UID of the device
+ * \param ch		the config channel
+ * \param value		the new value (for lists: the index of the choice)
+ * \param data		the data bytes of the frame (8 bytes)
+ * \return			the DLC of the frame
+ */
+int mcc_encodeChannelWrite (uint32_t uid, uint8_t ch, uint16_t value, uint8_t *data)
+{
+	mcc_putUID(data, uid);
+	data[4] = MCC_SYS_STATUS;
+	data[5] = ch;
+	data[6] = value >> 8;
+	data[7] = value & 0xFF;
+	return 8;
+}
+
+/**
+ * Decode the reply to a config channel write.
+ *
+ * \param dlc		the DLC of the frame
+ * \param data		the data bytes of the frame
+ * \param uid		where to store the UID of the device
+ * \param ch		where to store the config channel
+ * \param ok		where to store the result
+ * \return			true, if this is a reply to a config channel write
+ */
+bool mcc_decodeChannelWrite (int dlc, const uint8_t *data, uint32_t *uid, uint8_t *ch, bool *ok)
+{
+	if (dlc != 7 || data[4] != MCC_SYS_STATUS) return false;
+	*uid = mcc_getUID(data);
+	*ch = data[5];
+	*ok = !!data[6];
+	return true;
+}
+
+/**
+ * Encode the S88 event request for a range of contacts. The device reports
+ * the current state of all contacts in the range as single S88 events.
+ *
+ * \param node		the node number of the device
+ * \param first		the first contact of the range
+ * \param last		the last contact of the range
+ * \param data		the data bytes of the frame (at least 7 bytes)
+ * \return			the DLC of the frame
+ */
+int mcc_encodeS88Range (uint16_t node, uint16_t first, uint16_t last, uint8_t *data)
+{
+	data[0] = node >> 8;
+	data[1] = node & 0xFF;
+	data[2] = first >> 8;
+	data[3] = first & 0xFF;
+	data[4] = last >> 8;
+	data[5] = last & 0xFF;
+	data[6] = 0x01;			// report the current state of all contacts
+	return 7;
+}
+
+/**
+ * Decode a S88 event (node, contact, old state, new state, time).
+ *
+ * \param dlc		the DLC of the frame
+ * \param data		the data bytes of the frame
+ * \param node		where to store the node number of the device
+ * \param contact	where to store the contact number
+ * \param state		where to store the new state of the contact
+ * \return			true, if this is a S88 event with a state
+ */
+bool mcc_decodeS88Event (int dlc, const uint8_t *data, uint16_t *node, uint16_t *contact, bool *state)
+{
+	if (dlc < 6) return false;
+	*node = (data[0] << 8) | data[1];
+	*contact = (data[2] << 8) | data[3];
+	*state = !!data[5];
+	return (*contact != 0);
+}
+
+/**
+ * Prepare the reassembly of a status data configuration block.
+ *
+ * \param s			the stream to prepare
+ * \param uid		the UID of the device that was asked
+ * \param index		the requested block
+ */
+void mcc_streamStart (struct mcc_stream *s, uint32_t uid, uint8_t index)
+{
+	memset (s, 0, sizeof(*s));
+	s->uid = uid;
+	s->index = index;
+}
+
+/**
+ * Feed a frame of a status data configuration reply into the reassembly.
+ * Data frames carry the packet number instead of the hash. The final frame
+ * has a real hash and carries the UID, the block number and the number of
+ * data frames.
+ *
+ * \param s			the stream
+ * \param hash		the hash part of the CAN ID
+ * \param dlc		the DLC of the frame
+ * \param data		the data bytes of the frame
+ * \return			MCC_STREAM_DONE if the block is complete, MCC_STREAM_MORE if more
+ * 					frames are expected and MCC_STREAM_ERROR if the transfer failed
+ */
+enum mcc_streamstat mcc_streamFrame (struct mcc_stream *s, uint16_t hash, int dlc, const uint8_t *data)
+{
+	int cnt;
+
+	if (!s || !data) return MCC_STREAM_ERROR;
+
+	if (MCC_ISHASH(hash)) {				// the final frame
+		if (dlc < 6) return MCC_STREAM_MORE;					// the request itself (i.e. from another master)
+		if (mcc_getUID(data) != s->uid || data[4] != s->index) return MCC_STREAM_MORE;
+		cnt = data[5];
+		if (cnt <= 0 || cnt > MCC_STREAM_FRAMES) return MCC_STREAM_ERROR;
+		if (s->frames != ((cnt >= 32) ? 0xFFFFFFFFu : ((1u << cnt) - 1))) return MCC_STREAM_ERROR;
+		s->len = cnt * 8;
+		return MCC_STREAM_DONE;
+	}
+
+	if (dlc != 8 || hash < 1 || hash > MCC_STREAM_FRAMES) return MCC_STREAM_ERROR;
+	memcpy (&s->buf[(hash - 1) * 8], data, 8);
+	s->frames |= 1u << (hash - 1);
+	return MCC_STREAM_MORE;
+}
+
+/**
+ * Interpret block 0 of the status data configuration.
+ *
+ * \param buf		the reassembled block
+ * \param len		the length of the block
+ * \param dev		the device to fill in (uid and devid are not touched)
+ * \return			true, if the block could be interpreted
+ */
+bool mcc_parseDevice (const uint8_t *buf, int len, struct mcc_device *dev)
+{
+	int i;
+
+	if (!buf || !dev || len < 16) return false;
+
+	dev->measures = buf[0];
+	dev->channels = buf[1];
+	dev->serial = mcc_getUID(&buf[4]);
+	for (i = 0; i < 8 && buf[8 + i]; i++) dev->article[i] = buf[8 + i];
+	dev->article[i] = 0;
+	mcc_string(&buf[16], &buf[len], dev->name, sizeof(dev->name));
+	return true;
+}
+
+/**
+ * Interpret block n (n > 0) of the status data configuration.
+ *
+ * \param buf		the reassembled block
+ * \param len		the length of the block
+ * \param ch		the channel description to fill in
+ * \return			true, if the block could be interpreted
+ */
+bool mcc_parseChannel (const uint8_t *buf, int len, struct mcc_channel *ch)
+{
+	const uint8_t *p, *end;
+
+	if (!buf || !ch || len < 8) return false;
+
+	memset (ch, 0, sizeof(*ch));
+	end = &buf[len];
+	ch->index = buf[0];
+	ch->type = buf[1];
+	switch (ch->type) {
+		case MCC_CHTYPE_LIST:
+			ch->choices = buf[2];
+			ch->value = buf[3];
+			ch->min = 0;
+			ch->max = (ch->choices > 0) ? ch->choices - 1 : 0;
+			mcc_string(&buf[8], end, ch->name, sizeof(ch->name));
+			break;
+		case MCC_CHTYPE_VALUE:
+			ch->min = (buf[2] << 8) | buf[3];
+			ch->max = (buf[4] << 8) | buf[5];
+			ch->value = (buf[6] << 8) | buf[7];
+			p = mcc_string(&buf[8], end, ch->name, sizeof(ch->name));
+			p = mcc_string(p, end, NULL, 0);		// text for the start of the range
+			p = mcc_string(p, end, NULL, 0);		// text for the end of the range
+			mcc_string(p, end, ch->unit, sizeof(ch->unit));
+			break;
+		default:
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Assign consecutive ranges of feedback modules to the Link S88 devices.
+ * Each device gets one module for the internal inputs followed by the
+ * modules of its three busses.
+ *
+ * \param links		the devices
+ * \param cnt		the number of devices
+ * \return			the total number of modules used
+ */
+int mcc_layout (struct mcc_link *links, int cnt)
+{
+	int i, b, base;
+
+	for (i = 0, base = 0; i < cnt; i++) {
+		links[i].base = base;
+		links[i].modules = 1;
+		for (b = 0; b < MCC_LS88_BUSSES; b++) links[i].modules += links[i].bus[b];
+		base += links[i].modules;
+	}
+	return base;
+}
+
+/**
+ * Map a contact of a Link S88 to a feedback input.
+ *
+ * \param links		the devices (with the layout already done)
+ * \param cnt		the number of devices
+ * \param node		the node number from the S88 event
+ * \param contact	the contact number from the S88 event
+ * \return			the zero based feedback input relative to the first module
+ * 					of the CAN area or -1 if the contact is not mapped
+ */
+int mcc_mapContact (const struct mcc_link *links, int cnt, uint16_t node, uint16_t contact)
+{
+	const struct mcc_link *l;
+	int i, bus, in, mod;
+
+	for (i = 0, l = NULL; i < cnt; i++) {
+		if (links[i].node == node) {
+			l = &links[i];
+			break;
+		}
+	}
+	if (!l || contact == 0) return -1;
+
+	bus = contact / MCC_LS88_CONTACTS;
+	in = contact % MCC_LS88_CONTACTS - 1;
+	if (in < 0) return -1;
+	if (bus == 0) {						// the internal inputs
+		if (in >= 16) return -1;
+		return l->base * 16 + in;
+	}
+	if (bus > MCC_LS88_BUSSES || in >= l->bus[bus - 1] * 16) return -1;
+	for (i = 0, mod = 1; i < bus - 1; i++) mod += l->bus[i];
+	return (l->base + mod) * 16 + in;
+}
@@ -32,8 +32,10 @@
 #include "lwip/sockets.h"
 #include "config.h"
 #include "events.h"
+#include "p50xudp.h"
 
-#define P50X_UDP			0				///< if enabled, the service is also available as UDP (not implemented yet)
+#define P50X_UDP			1				///< if enabled, the P50Xb binary commands are also available via UDP on the same port
+#define P50X_UDPREPLY		1024			///< the maximum size of a reply datagram
 #define P50X_STACK			2048			///< allocated stack for the P50X interpreter
 #define P50X_PRIO			1				///< priority of the created interpreter thread
 #define MAX_CMDLEN			256				///< the maximum length of a command
@@ -86,6 +88,9 @@
 #define EVT_MASK			(EVT_MASK1 | EVT_MASK2)
 #define MORE_EVENTS			0x80			///< Bit 7 of a Event-Report byte should be set to announce a followup Event-Report byte
 
+#define P50X_TCPOWNER(sock)	OWN_TOKEN(OWN_P50X, (sock) & 0x7F)		///< the identity of a TCP connection in the loco ownership
+#define P50X_UDPOWNER(idx)	OWN_TOKEN(OWN_P50X, 0x80 | (idx))		///< the identity of a UDP client in the loco ownership
+
 struct parameter {
 	char			*text;					///< A pointer in the command line that contains the raw text. This will be a null-terminated string.
 	int				 value;					///< The numerical value (if any)
@@ -123,8 +128,27 @@ struct connection {
 	struct trnt_event	*trnt;				///< a linked list of turnout activities
 	uint16_t			 s88Sum[P50X_MAXFBMODULES];					///< summation of s88 status (each s88 module contains 16 bits)
 	uint32_t			 s88EvFlag[(P50X_MAXFBMODULES + 31) / 32];	///< a flag for each changed s88 module
+	struct pxu_client	*udp;				///< the UDP client that is currently served (NULL on TCP connections)
+	uint8_t				*reply;				///< the reply buffer for UDP (NULL on TCP connections)
+	int					 rlen;				///< the number of bytes in the reply buffer
+};
+
+/**
+ * The events of a UDP client that are not yet reported. While a request of
+ * this client is executed, they are moved to the UDP connection structure.
+ */
+struct udpevents {
+	struct loco_change	*loco;				///< a linked list of loco change antries
+	struct trnt_event	*trnt;				///< a linked list of turnout activities
+	int					 flags;				///< the event flags (EVT_xxx)
 };
 
+static struct pxu_table udptab;						///< the UDP clients
+static struct udpevents udpevt[PXU_MAXCLIENTS];		///< the pending events of the UDP clients (same index as in udptab)
+static struct pxu_fbsnap udpfb;						///< the feedback state shared by all UDP clients
+static SemaphoreHandle_t udpmutex;					///< protects the three structures above
+static TaskHandle_t udptid;							///< the task handle of the UDP receiver
+
 /*
  * ===============================================================================================
  * Helper functions ==============================================================================
@@ -330,6 +354,32 @@ static int p50x_SOget (int adr)
 	return -1;		// SO not implemented
 }
 
+static struct loco_change *p50x_locoChange (ldataT *l)
+{
+	struct loco_change *lc;
+
+	if ((lc = malloc (sizeof(*lc))) == NULL) return NULL;
+	lc->next = NULL;
+	lc->adr = l->loco->adr;
+	lc->fmt = l->loco->fmt;
+	lc->funcs = l->funcs[0] & (FUNC_LIGHT | FUNC_F1_F8);
+	lc->speed = l->speed;
+	if ((lc->speed & 0x7F) > 0) lc->speed++;		// skip emergency stop code
+	return lc;
+}
+
+static struct trnt_event *p50x_trntEvent (turnoutT *t)
+{
+	struct trnt_event *te;
+
+	if ((te = malloc (sizeof(*te))) == NULL) return NULL;
+	te->next = NULL;
+	te->adr_st = t->adr & 0x7FF;
+	if (!t->dir) te->adr_st |= 0x8000;	// highest bit reports direction: 1: straight / 0: thrown (inverted from our internal sense)
+	if (t->on) te->adr_st |= 0x4000;	// bit #14 (bit #6 of high byte) denotes the "powered" state
+	return te;
+}
+
 /**
  * Handle events coming in. The events that stem from out own activity are
  * ignored (just like in other event handlers).
@@ -361,24 +411,12 @@ static bool p50x_eventhandler (eventT *e, void *priv)
 			case EVENT_LOCO_SPEED:
 			case EVENT_LOCO_FUNCTION:
 				l = (ldataT *) e->src;
-				if ((lc = malloc (sizeof(*lc))) == NULL) break;
-				lc->next = NULL;
-				lc->adr = l->loco->adr;
-				lc->fmt = l->loco->fmt;
-				lc->funcs = l->funcs[0] & (FUNC_LIGHT | FUNC_F1_F8);
-				lc->speed = l->speed;
-				if ((lc->speed & 0x7F) > 0) lc->speed++;		// skip emergency stop code
-				list_append(&con->loco, lc);
+				if ((lc = p50x_locoChange(l)) != NULL) list_append(&con->loco, lc);
 				break;
 			case EVENT_TURNOUT:
 				t = (turnoutT *) e->src;
-				if ((te = malloc (sizeof(*te))) == NULL) break;
 				printf ("%s() EVENT_TURNOUT adr %d\n", __func__, t->adr);
-				te->next = NULL;
-				te->adr_st = t->adr & 0x7FF;
-				if (!t->dir) te->adr_st |= 0x8000;	// highest bit reports direction: 1: straight / 0: thrown (inverted from our internal sense)
-				if (t->on) te->adr_st |= 0x4000;	// bit #14 (bit #6 of high byte) denotes the "powered" state
-				list_append(&con->trnt, te);
+				if ((te = p50x_trntEvent(t)) != NULL) list_append(&con->trnt, te);
 				break;
 			case EVENT_FEEDBACK:
 				s88 = (struct s88_status *) e->src;
@@ -407,6 +445,84 @@ static bool p50x_eventhandler (eventT *e, void *priv)
 	return true;
 }
 
+static uint32_t p50x_now (void)
+{
+	return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+/**
+ * Read the current state of all feedback modules that can be reported.
+ *
+ * \param state		where to store the state (P50X_MAXFBMODULES entries)
+ * \return			the number of modules
+ */
+static int p50x_fbState (uint16_t *state)
+{
+	int i, modules;
+
+	modules = s88_getModules();
+	if (modules > P50X_MAXFBMODULES) modules = P50X_MAXFBMODULES;
+	for (i = 0; i < modules; i++) {
+#ifdef CENTRAL_FEEDBACK
+		state[i] = fb_getModuleState(i);
+#else
+		state[i] = s88_getInput(i);
+#endif
+	}
+	return modules;
+}
+
+/**
+ * Handle events for the UDP clients. Feedback changes go to the shared
+ * feedback state, all other events are queued for every active client.
+ *
+ * \param e		the event structure that describes the nature and details of the event
+ * \param priv	unused
+ * \return		always true to continue to receive events
+ */
+static bool p50x_udpEventhandler (eventT *e, void *priv)
+{
+	struct udpevents *ue;
+	struct loco_change *lc;
+	struct trnt_event *te;
+	fbeventT *fbevt;
+	uint32_t now;
+	int i;
+
+	(void) priv;
+
+	if (e->tid == udptid) return true;	// this is an event we triggered ourself, so don't report back!
+	if (!mutex_lock(&udpmutex, 20, __func__)) return true;
+
+	if (e->ev == EVENT_FBNEW) {
+		fbevt = (fbeventT *) e->src;
+		pxu_fbUpdate(&udpfb, fbevt->module, fbevt->status);
+	} else {
+		now = p50x_now();
+		for (i = 0; i < PXU_MAXCLIENTS; i++) {
+			if (!pxu_isActive(&udptab.cl[i], now)) continue;
+			ue = &udpevt[i];
+			switch (e->ev) {
+				case EVENT_SYS_STATUS:
+					if (rt.tm == TM_STOP || rt.tm == TM_SHORT) ue->flags |= EVT_PWROFF;
+					ue->flags |= EVT_STATUS;
+					break;
+				case EVENT_LOCO_SPEED:
+				case EVENT_LOCO_FUNCTION:
+					if ((lc = p50x_locoChange((ldataT *) e->src)) != NULL) list_append(&ue->loco, lc);
+					break;
+				case EVENT_TURNOUT:
+					if ((te = p50x_trntEvent((turnoutT *) e->src)) != NULL) list_append(&ue->trnt, te);
+					break;
+				default:
+					break;
+			}
+		}
+	}
+	mutex_unlock(&udpmutex);
+	return true;
+}
+
 /*
  * ===============================================================================================
  * the P50X binary commands ======================================================================
@@ -416,19 +532,34 @@ static bool p50x_eventhandler (eventT *e, void *priv)
 // forward declaration to call p50 commands from P50Xb-mode via p50xb_XP50Len1() and p50xb_XP50Len2()
 static int p50_interpret (struct connection *con, uint8_t *data, int len);
 
-static void p50xb_sendbuf (int sock, uint8_t *data, int len)
+/**
+ * Send binary answer data. On UDP the data is collected in the reply buffer
+ * and sent as a single datagram when the request is completely interpreted.
+ * Data that does not fit into the reply buffer is dropped.
+ *
+ * \param con		the current connection structure
+ * \param data		the data to send
+ * \param len		the length of the data
+ */
+static void p50xb_sendbuf (struct connection *con, uint8_t *data, int len)
 {
-	lwip_send (sock, data, len, 0);
+	if (con->reply) {
+		if (len > P50X_UDPREPLY - con->rlen) len = P50X_UDPREPLY - con->rlen;
+		if (len > 0) memcpy (&con->reply[con->rlen], data, len);
+		con->rlen += len;
+	} else {
+		lwip_send (con->sock, data, len, 0);
+	}
 }
 
-static void p50xb_error (int sock, int errcode)
+static void p50xb_error (struct connection *con, int errcode)
 {
 	uint8_t err = errcode & 0xFF;
 
-	if (errcode != NOANSWER) p50xb_sendbuf(sock, &err, 1);
+	if (errcode != NOANSWER) p50xb_sendbuf(con, &err, 1);
 }
 
-static ldataT *p50xb_getloco (int sock, uint8_t *cmd, bool add)
+static ldataT *p50xb_getloco (struct connection *con, uint8_t *cmd, bool add)
 {
    ldataT *l;
    unsigned short adr;
@@ -436,28 +567,28 @@ static ldataT *p50xb_getloco (int sock, uint8_t *cmd, bool add)
    adr = cmd[1] | (cmd[2] << 8);
    printf ("%s(): ADR %d\n", __func__, adr);
    if (adr == 0 || adr > MAX_LOCO_ADR) {
-      p50xb_error(sock, XBADPRM);
+      p50xb_error(con, XBADPRM);
       return NULL;
    }
 
    l = loco_call(adr, add);
 
    if (!l) {
-      if (add) p50xb_error(sock, XNOSLOT);
-      else p50xb_error(sock, XNODATA);
+      if (add) p50xb_error(con, XNOSLOT);
+      else p50xb_error(con, XNODATA);
       return NULL;
    }
 
    return l;
 }
 
-static int _XLok (int sock, uint8_t *cmd, bool ifspeed)
+static int _XLok (struct connection *con, uint8_t *cmd, bool ifspeed)
 {
 	ldataT *l;
 	uint32_t newfuncs;
 	uint8_t speed;
 
-	if ((l = p50xb_getloco (sock, cmd, true)) == NULL) return NOANSWER;
+	if ((l = p50xb_getloco (con, cmd, true)) == NULL) return NOANSWER;
 
 	speed = cmd[3];
 	if (ifspeed && speed == 1) {	// emergency stop
@@ -490,7 +621,7 @@ static int p50xb_XLok (struct connection *con)
 
 	cmd = con->data;
 	if (!(con->flags & FLAG_IFEXT)) cmd++;
-	return _XLok (con->sock, cmd, true);
+	return _XLok (con, cmd, true);
 }
 
 static int p50xb_XLokX (struct connection *con)
@@ -499,7 +630,7 @@ static int p50xb_XLokX (struct connection *con)
 
 	cmd = con->data;
 	if (!(con->flags & FLAG_IFEXT)) cmd++;
-	return _XLok (con->sock, cmd, false);
+	return _XLok (con, cmd, false);
 }
 
 static int p50xb_XLokSts (struct connection *con)
@@ -511,7 +642,7 @@ static int p50xb_XLokSts (struct connection *con)
 	cmd = con->data;
 	if (!(con->flags & FLAG_IFEXT)) cmd++;
 
-	if ((l = p50xb_getloco (con->sock, cmd, true)) == NULL) return NOANSWER;
+	if ((l = p50xb_getloco (con, cmd, true)) == NULL) return NOANSWER;
 
 	buf[0] = OK;
 	buf[1] = p50x_speed2if (l->speed, l->loco->fmt);	// interface speed
@@ -521,7 +652,7 @@ static int p50xb_XLokSts (struct connection *con)
 	buf[2] = funcs & 0xFF;					// funcs and direction
 	buf[3] = l->speed & 0x7F;				// the real speed
 
-	p50xb_sendbuf(con->sock, buf, 4);
+	p50xb_sendbuf(con, buf, 4);
 	return NOANSWER;
 }
 
@@ -532,7 +663,7 @@ static int p50xb_XLokCfg (struct connection *con)
 
 	cmd = con->data;
 	if (!(con->flags & FLAG_IFEXT)) cmd++;
-	if ((l = p50xb_getloco (con->sock, cmd, true)) == NULL) return NOANSWER;
+	if ((l = p50xb_getloco (con, cmd, true)) == NULL) return NOANSWER;
 
 	buf[0] = OK;
 	if (FMT_IS_MM1(l->loco->fmt)) buf[1] = 1;
@@ -564,7 +695,7 @@ static int p50xb_XLokCfg (struct connection *con)
 	buf[3] = 0xFF;		// virtual loco (not supported)
 	buf[4] = 0xFF;		// virtual loco (not supported)
 
-	p50xb_sendbuf(con->sock, buf, 5);
+	p50xb_sendbuf(con, buf, 5);
 	return NOANSWER;
 }
 
@@ -576,7 +707,7 @@ static int p50xb_XLokCfgSet (struct connection *con)
 
 	cmd = con->data;
 	if (!(con->flags & FLAG_IFEXT)) cmd++;
-	if ((l = p50xb_getloco (con->sock, cmd, true)) == NULL) return NOANSWER;
+	if ((l = p50xb_getloco (con, cmd, true)) == NULL) return NOANSWER;
 
 	switch (cmd[3]) {
 		case 0:					// M3 formats (only option is FMT_M3_126)
@@ -639,7 +770,7 @@ static int p50xb_Xm3Sid (struct connection *con)
 	cmd = con->data;
 	if (!(con->flags & FLAG_IFEXT)) cmd++;
 	if (rt.tm != TM_GO) return XLKPOFF;
-	if ((l = p50xb_getloco (con->sock, cmd, true)) == NULL) return NOANSWER;
+	if ((l = p50xb_getloco (con, cmd, true)) == NULL) return NOANSWER;
 	db_setLocoFmt(l->loco->adr, FMT_M3_126);
 	db_setLocoMaxfunc(l->loco->adr, 31);
 	memset (l->funcs, 0, sizeof(l->funcs));
@@ -658,7 +789,7 @@ static int p50xb_XFunc (struct connection *con)
 
 	cmd = con->data;
 	if (!(con->flags & FLAG_IFEXT)) cmd++;
-	if ((l = p50xb_getloco (con->sock, cmd, true)) == NULL) return NOANSWER;
+	if ((l = p50xb_getloco (con, cmd, true)) == NULL) return NOANSWER;
 
 	rq_setFuncMasked(l->loco->adr, cmd[3] << 1, FUNC_F1_F8);
 
@@ -672,7 +803,7 @@ static int p50xb_XFuncX (struct connection *con)
 
 	cmd = con->data;
 	if (!(con->flags & FLAG_IFEXT)) cmd++;
-	if ((l = p50xb_getloco (con->sock, cmd, true)) == NULL) return NOANSWER;
+	if ((l = p50xb_getloco (con, cmd, true)) == NULL) return NOANSWER;
 
 	rq_setFuncMasked(l->loco->adr, cmd[3] << 9, FUNC_F9_F16);
 
@@ -687,7 +818,7 @@ static int p50xb_XFunc34 (struct connection *con)
 
 	cmd = con->data;
 	if (!(con->flags & FLAG_IFEXT)) cmd++;
-	if ((l = p50xb_getloco (con->sock, cmd, true)) == NULL) return NOANSWER;
+	if ((l = p50xb_getloco (con, cmd, true)) == NULL) return NOANSWER;
 
 	// cmd[3] contains F17..F24
 	// cmd[4] contains F25..F31 (a hypothetical F32 could be included but is not defined so far)
@@ -705,7 +836,7 @@ static int p50xb_XBinSt (struct connection *con)
 
 	cmd = con->data;
 	if (!(con->flags & FLAG_IFEXT)) cmd++;
-	if ((l = p50xb_getloco (con->sock, cmd, true)) == NULL) return NOANSWER;
+	if ((l = p50xb_getloco (con, cmd, true)) == NULL) return NOANSWER;
 	if (!FMT_IS_DCC(l->loco->fmt)) return XBADPRM;
 	flag_adr = (cmd[3] & 0x7F) | (cmd[4] << 7);
 
@@ -722,11 +853,11 @@ static int p50xb_XFuncSts (struct connection *con)
 
 	cmd = con->data;
 	if (!(con->flags & FLAG_IFEXT)) cmd++;
-	if ((l = p50xb_getloco (con->sock, cmd, true)) == NULL) return NOANSWER;
+	if ((l = p50xb_getloco (con, cmd, true)) == NULL) return NOANSWER;
 
 	buf[0] = OK;
 	buf[1] = (l->funcs[0] >> 1) & 0xFF;
-	p50xb_sendbuf(con->sock, buf, 2);
+	p50xb_sendbuf(con, buf, 2);
 
 	return NOANSWER;
 }
@@ -738,11 +869,11 @@ static int p50xb_XFuncXSts (struct connection *con)
 
 	cmd = con->data;
 	if (!(con->flags & FLAG_IFEXT)) cmd++;
-	if ((l = p50xb_getloco (con->sock, cmd, true)) == NULL) return NOANSWER;
+	if ((l = p50xb_getloco (con, cmd, true)) == NULL) return NOANSWER;
 
 	buf[0] = OK;
 	buf[1] = (l->funcs[0] >> 9) & 0xFF;
-	p50xb_sendbuf(con->sock, buf, 2);
+	p50xb_sendbuf(con, buf, 2);
 
 	return NOANSWER;
 }
@@ -754,12 +885,12 @@ static int p50xb_XFunc34Sts (struct connection *con)
 
 	cmd = con->data;
 	if (!(con->flags & FLAG_IFEXT)) cmd++;
-	if ((l = p50xb_getloco (con->sock, cmd, true)) == NULL) return NOANSWER;
+	if ((l = p50xb_getloco (con, cmd, true)) == NULL) return NOANSWER;
 
 	buf[0] = OK;
 	buf[1] = (l->funcs[0] >> 17) & 0xFF;
 	buf[2] = (l->funcs[0] >> 25) & 0x7F;
-	p50xb_sendbuf(con->sock, buf, 3);
+	p50xb_sendbuf(con, buf, 3);
 
 	return NOANSWER;
 }
@@ -816,7 +947,7 @@ static int p50xb_XTrntSts (struct connection *con)
 	buf[0] = OK;
 	buf[1] = (!t->dir) ? 0x04 : 0x00;
 	if (t->fmt == TFMT_DCC) buf[1] |= 0x01;
-	p50xb_sendbuf(con->sock, buf, 2);
+	p50xb_sendbuf(con, buf, 2);
 
 	return NOANSWER;
 }
@@ -841,7 +972,7 @@ static int p50xb_XTrntGrp (struct connection *con)
 			if (!t->dir) buf[1] |= 0x80;
 		}
 	}
-	p50xb_sendbuf(con->sock, buf, 3);
+	p50xb_sendbuf(con, buf, 3);
 
 	return NOANSWER;
 }
@@ -872,8 +1003,8 @@ static int p50xb_XSensor (struct connection *con)
 #endif
 	buf[1] = (mstat >> 8) & 0x0FF;
 	buf[2] = (mstat >> 0) & 0xFF;
-	p50xb_sendbuf(con->sock, buf, 3);
-	bs_clear(con->s88EvFlag, module);
+	p50xb_sendbuf(con, buf, 3);
+	if (!con->udp) bs_clear(con->s88EvFlag, module);		// UDP clients share the feedback state, so nothing is cleared here
 
 	return NOANSWER;
 }
@@ -895,6 +1026,14 @@ static int p50xb_XSensOff (struct connection *con)
 {
 	int i;
 
+	if (con->udp) {
+		if (mutex_lock(&udpmutex, 100, __func__)) {
+			pxu_fbReset(con->udp);
+			mutex_unlock(&udpmutex);
+		}
+		return OK;
+	}
+
 	memset (con->s88EvFlag, 0, sizeof(con->s88EvFlag));
 
 	for (i = 0; i < s88_getModules(); i++) {
@@ -936,7 +1075,7 @@ static int p50xb_X88PGet (struct connection *con)
 		default:
 			return XBADPRM;
 	}
-	p50xb_sendbuf(con->sock, buf, 2);
+	p50xb_sendbuf(con, buf, 2);
 
 	return NOANSWER;
 }
@@ -995,13 +1134,13 @@ static int p50xb_XVer (struct connection *con)
 		*p |= (*s++ - '0');
 		p++;
 	}
-	p50xb_sendbuf(con->sock, buf, 9);
+	p50xb_sendbuf(con, buf, 9);
 #else
 	buf[4] = 3;										// three bytes serial number
 	buf[5] = (hwinfo->serial >> 16) & 0xFF;			// MSB of serial #
 	buf[6] = (hwinfo->serial >> 8) & 0xFF;			// middle of serial #
 	buf[7] = (hwinfo->serial >> 0) & 0xFF;			// LSB of serial #
-	p50xb_sendbuf(con->sock, buf, 8);
+	p50xb_sendbuf(con, buf, 8);
 #endif
 
 	return OK;		// terminates the answer with a 0x00
@@ -1014,7 +1153,7 @@ static int p50xb_XStatus (struct connection *con)
 	c = 0;
 	if (rt.tm == TM_GO || rt.tm == TM_TAMSPROG || rt.tm == TM_HALT) c |= 0x08;
 	if (rt.tm == TM_HALT) c |= 0x10;
-	p50xb_sendbuf(con->sock, &c, 1);
+	p50xb_sendbuf(con, &c, 1);
 
 	return NOANSWER;
 }
@@ -1046,7 +1185,7 @@ static int p50xb_XSoGet (struct connection *con)
 
 	buf[0] = OK;
 	buf[1] = rc & 0xFF;
-	p50xb_sendbuf(con->sock, buf, 2);
+	p50xb_sendbuf(con, buf, 2);
 
 	return NOANSWER;
 }
@@ -1117,13 +1256,23 @@ static int p50xb_XP50Len2 (struct connection *con)
  */
 static int p50xb_XEvent (struct connection *con)
 {
+	uint16_t state[P50X_MAXFBMODULES];
 	uint8_t buf[16];
-	int len = 0;
+	int len = 0, modules;
+	bool fbevent = false;
+
+	if (con->udp) {
+		modules = p50x_fbState(state);
+		if (mutex_lock(&udpmutex, 100, __func__)) {
+			fbevent = pxu_fbPending(&udpfb, con->udp, state, modules);
+			mutex_unlock(&udpmutex);
+		}
+	}
 
 	mutex_lock(&con->mutex, 100, __func__);		// this should work! If the mutex cannot be aquired, we simply ignore it
 	buf[len] = 0;		// start with "no event to report"
 	if (con->loco) buf[len] |= 0x01;
-	if (!bs_isempty(con->s88EvFlag, MAX_FBMODULES)) buf[len] |= 0x04;
+	if (fbevent || !bs_isempty(con->s88EvFlag, MAX_FBMODULES)) buf[len] |= 0x04;
 	if (con->flags & EVT_PWROFF) buf[len] |= 0x08;
 	if (con->trnt) buf[len] |= 0x20;
 	con->flags &= ~EVT_MASK1;
@@ -1147,7 +1296,7 @@ static int p50xb_XEvent (struct connection *con)
 //	}
 
 	mutex_unlock(&con->mutex);
-	p50xb_sendbuf(con->sock, buf, len);
+	p50xb_sendbuf(con, buf, len);
 	printf ("%s(): %d bytes sent\n", __func__, len);
 
 	return NOANSWER;
@@ -1172,13 +1321,13 @@ static int p50xb_XEvtLok (struct connection *con)
 		p[4] = lc->speed & 0x7F;					// the real decoder speed
 		p += 5;
 		if ((unsigned) (p - buf) >= sizeof(buf)) {
-			p50xb_sendbuf(con->sock, buf, p - buf);
+			p50xb_sendbuf(con, buf, p - buf);
 			p = buf;
 		}
 		free (lc);
 	}
 	if ((p - buf) > 0) {
-		p50xb_sendbuf(con->sock, buf, p - buf);	// send a partial buffer
+		p50xb_sendbuf(con, buf, p - buf);	// send a partial buffer
 		printf ("%s(): %d bytes sent\n", __func__, p - buf);
 	}
 	mutex_unlock(&con->mutex);
@@ -1208,7 +1357,34 @@ static int p50xb_XEvtTrn (struct connection *con)
 		}
 		mutex_unlock(&con->mutex);
 	}
-	p50xb_sendbuf(con->sock, buf, p - buf);
+	p50xb_sendbuf(con, buf, p - buf);
+
+	return NOANSWER;
+}
+
+/**
+ * Report the changed s88 modules to a UDP client using the feedback state
+ * that is shared by all UDP clients (see p50xudp.c).
+ *
+ * \param con		the current connection structure
+ * \return			a code for the caller to reply with on the connection
+ */
+static int p50xb_udpEvtSen (struct connection *con)
+{
+	uint16_t state[P50X_MAXFBMODULES];
+	uint8_t buf[3 * P50X_MAXFBMODULES + 1];
+	int len, modules;
+
+	modules = p50x_fbState(state);
+	if (modules > MAX_FBMODULES) modules = MAX_FBMODULES;
+	if (!mutex_lock(&udpmutex, 100, __func__)) {
+		buf[0] = 0;		// empty list
+		len = 1;
+	} else {
+		len = pxu_fbReport(&udpfb, &udptab, con->udp, state, modules, buf, p50x_now());
+		mutex_unlock(&udpmutex);
+	}
+	p50xb_sendbuf(con, buf, len);
 
 	return NOANSWER;
 }
@@ -1253,6 +1429,8 @@ static int p50xb_XEvtSen (struct connection *con)
 	uint16_t s88;
 	int i, modules;
 
+	if (con->udp) return p50xb_udpEvtSen(con);
+
 	mutex_lock(&con->mutex, 100, __func__);		// this should work! If the mutex cannot be aquired, we simply ignore it
 	modules = s88_getModules();
 	for (i = 0, p = buf; i < modules; i++) {
@@ -1273,7 +1451,7 @@ static int p50xb_XEvtSen (struct connection *con)
 		}
 	}
 	*p++ = 0;		// End-of-List marker
-	p50xb_sendbuf(con->sock, buf, p - buf);
+	p50xb_sendbuf(con, buf, p - buf);
 	printf ("%s(): %d bytes sent\n", __func__, p - buf);
 	mutex_unlock(&con->mutex);
 
@@ -1286,7 +1464,7 @@ static int p50xb_XEvtPT (struct connection *con)
 
 	// currently this function is only a dummy (as it was in MasterControl ...)
 	c = OK;
-	p50xb_sendbuf(con->sock, &c, 1);
+	p50xb_sendbuf(con, &c, 1);
 
 	return NOANSWER;
 }
@@ -1385,13 +1563,13 @@ static int p50xb_interpret (struct connection *con)
 		if (cmd == ct->cmd) {
 			if (len < ct->len) return 0;							// command not yet complete - don't eat any characters
 			con->rc = ct->func(con);
-			p50xb_error(con->sock, con->rc);
+			p50xb_error(con, con->rc);
 			if (!(con->flags & FLAG_IFEXT)) return ct->len + 1;		// take care of leading 'X' to be counted as char to be dropped
 			return ct->len;
 		}
 		ct++;
 	}
-	p50xb_error(con->sock, XERROR);
+	p50xb_error(con, XERROR);
 	return con->idx;	// drop all bytes received
 }
 
@@ -2818,7 +2996,7 @@ static void p50_speedfunc (struct connection *con, uint8_t *data)
 	speed = data[0] & 0x0F;		// the 4 LSB of the first byte encode the speed
 	adr = data[1];				// p50 allows addresses 0 .. 255 only!
 	if ((l = loco_call(adr, true)) != NULL) {
-		loco_setFunc(adr, 0, data[0] & 0x10);
+		rq_setFuncMasked(adr, (data[0] & 0x10) ? FUNC_LIGHT : 0, FUNC_LIGHT);
 		if (speed == 0x0F) {		// this encodes a direction change
 			speed = (l->speed & 0x80) ^ 0x80;	// reverse direction and set speed to zero
 		} else {
@@ -2876,35 +3054,59 @@ static void p50_startstop (struct connection *con, uint8_t *data)
 	if (data[0] == 0x61) sig_setMode(TM_STOP);
 }
 
+/**
+ * Get the s88 data of a module for the P50 dump commands. UDP clients don't
+ * have a summation of their own and get the current state of the module.
+ *
+ * \param con		the current connection structure
+ * \param idx		the zero based module
+ * \param buf		where to store the two bytes (MSB first)
+ */
+static void p50_s88data (struct connection *con, int idx, uint8_t *buf)
+{
+	uint16_t s88data;
+
+	if (con->udp) {
+#ifdef CENTRAL_FEEDBACK
+		s88data = fb_getModuleState(idx);
+#else
+		s88data = s88_getInput(idx);
+#endif
+	} else {
+		s88data = con->s88Sum[idx];
+		if (con->flags & FLAG_S88AUTORESET) con->s88Sum[idx] = 0;
+	}
+	buf[0] = (s88data >> 8) & 0xFF;		// p50 expects the MSB first
+	buf[1] = s88data & 0xFF;
+}
+
 static void p50_s88dumpMulti (struct connection *con, uint8_t *data)
 {
+	uint8_t buf[2 * 31];
 	int i, param;
-	uint16_t s88data;
 
 	param = data[0] & 0x1F;
 	if (!param)	{
 		con->flags &= ~FLAG_S88AUTORESET;
 	} else {
 		for (i = 0; i < param; i++) {
-			s88data = htons(con->s88Sum[i]);			// p50 expects the MSB first
-			lwip_send(con->sock, &s88data, sizeof(s88data), (i < (param - 1)) ? MSG_MORE : 0);
-			if (con->flags & FLAG_S88AUTORESET) con->s88Sum[i] = 0;
+			p50_s88data(con, i, &buf[2 * i]);
 		}
+		p50xb_sendbuf(con, buf, 2 * param);
 	}
 }
 
 static void p50_s88dumpSingle (struct connection *con, uint8_t *data)
 {
+	uint8_t buf[2];
 	int param;
-	uint16_t s88data;
 
 	param = data[0] & 0x1F;
 	if (!param)	{
 		con->flags |= FLAG_S88AUTORESET;
 	} else {
-		s88data = htons(con->s88Sum[param - 1]);			// p50 expects the MSB first
-		lwip_send(con->sock, &s88data, sizeof(s88data), 0);
-		if (con->flags & FLAG_S88AUTORESET) con->s88Sum[param - 1] = 0;
+		p50_s88data(con, param - 1, buf);
+		p50xb_sendbuf(con, buf, 2);
 	}
 }
 
@@ -2969,6 +3171,7 @@ static void p50x_tcpHandler (void *pvParameter)
 	con->sock = (int) pvParameter;
 	con->tid = xTaskGetCurrentTaskHandle();
 	con->flags = FLAG_S88AUTORESET;
+	loco_setClient(P50X_TCPOWNER(con->sock));
 
 	printf ("%s(): Starting with FD=%d\n", __func__, con->sock);
 //	event_register(EVENT_FEEDBACK, p50x_eventhandler, con, 0);
@@ -3015,6 +3218,7 @@ static void p50x_tcpHandler (void *pvParameter)
 	}
 
 	event_deregister(EVENT_DEREGISTER_ALL, p50x_eventhandler, con);
+	loco_releaseAll(P50X_TCPOWNER(con->sock));
 
 	// now free the allocated structure and sublists
 	mutex_lock(&con->mutex, portMAX_DELAY, __func__);
@@ -3036,46 +3240,186 @@ static void p50x_tcpHandler (void *pvParameter)
 }
 
 #if (P50X_UDP != 0)
-static void p50_udpReceiver(void *pvParameter)
+static void p50x_freeEvents (struct loco_change **loco, struct trnt_event **trnt)
 {
-	struct connection con;
-	struct sockaddr from;
-	struct sockaddr_in local, *remote;
-	socklen_t fromlen;
-	int rc;
+	void *p;
+
+	while ((p = *loco) != NULL) {
+		*loco = (*loco)->next;
+		free (p);
+	}
+	while ((p = *trnt) != NULL) {
+		*trnt = (*trnt)->next;
+		free (p);
+	}
+}
+
+/**
+ * Called from the client table when a UDP client is forgotten.
+ *
+ * \param c		the client that is dropped
+ */
+static void p50x_udpDrop (struct pxu_client *c)
+{
+	struct udpevents *ue;
+
+	ue = &udpevt[c - udptab.cl];
+	p50x_freeEvents(&ue->loco, &ue->trnt);
+	ue->flags = 0;
+	loco_releaseAll(P50X_UDPOWNER(c - udptab.cl));
+}
+
+/**
+ * Give the events that were not reported back to the client. They are put in
+ * front of the events that arrived while the request was executed.
+ *
+ * \param con	the UDP connection structure
+ * \param ue	the pending events of the client
+ */
+static void p50x_udpRequeue (struct connection *con, struct udpevents *ue)
+{
+	struct loco_change *lc;
+	struct trnt_event *te;
+
+	if ((lc = con->loco) != NULL) {
+		while (lc->next) lc = lc->next;
+		lc->next = ue->loco;
+		ue->loco = con->loco;
+	}
+	if ((te = con->trnt) != NULL) {
+		while (te->next) te = te->next;
+		te->next = ue->trnt;
+		ue->trnt = con->trnt;
+	}
+	ue->flags |= con->flags & EVT_MASK;
+	con->loco = NULL;
+	con->trnt = NULL;
+}
+
+/**
+ * Execute the P50Xb commands of a datagram. Partial commands at the end of
+ * the datagram are dropped.
+ *
+ * \param con	the UDP connection structure with the commands in data[]
+ */
+static void p50x_udpExecute (struct connection *con)
+{
+	int c_read;
 
-	(void) pvParameter;
+	do {
+		c_read = p50xb_interpret(con);
+		if (c_read == con->idx) {	// everything is read - clear buffer
+			con->idx = 0;
+		} else if (c_read > 0) {	// only part of buffer was read
+			memmove (con->data, &con->data[c_read], con->idx - c_read);
+			con->idx -= c_read;
+		}
+	} while (c_read > 0 && con->idx > 0);
+	con->idx = 0;
+}
 
-	memset (&con, 0, sizeof(con));
+/**
+ * The UDP receiver. Each datagram consists of a sequence number followed by
+ * one or more P50Xb commands (without the leading 'X'). The reply starts with
+ * the same sequence number followed by the answers of all commands. A request
+ * with the same sequence number as the previous one is regarded as a repetition
+ * because the reply got lost.
+ *
+ * \param pvParameter	the UDP port to listen to
+ */
+static void p50_udpReceiver(void *pvParameter)
+{
+	struct connection *con;
+	struct pxu_client *c;
+	struct udpevents *ue;
+	struct sockaddr_in local, remote;
+	socklen_t fromlen;
+	uint8_t *rx, *reply;
+	uint16_t port;
+	int rc, len;
+
+	port = (uint16_t) ((uint32_t) pvParameter);
+	con = calloc (1, sizeof(*con));
+	rx = malloc (MAX_CMDLEN + 1);
+	reply = malloc (P50X_UDPREPLY);
+	if (!con || !rx || !reply) {
+		free (con);
+		free (rx);
+		free (reply);
+		log_error ("%s(): no memory\n", __func__);
+		vTaskDelete(NULL);		// won't return
+	}
 
-	con.sock = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+	udptid = xTaskGetCurrentTaskHandle();
+	udptab.drop = p50x_udpDrop;
+	con->tid = udptid;
+	con->sock = lwip_socket(AF_INET, SOCK_DGRAM, 0);
 	local.sin_family = AF_INET;
 	local.sin_addr.s_addr = INADDR_ANY;
-	local.sin_port = htons (5000);
+	local.sin_port = htons (port);
 	local.sin_len = sizeof(local);
-	lwip_bind(con.sock, (struct sockaddr *) &local, sizeof(local));
+	lwip_bind(con->sock, (struct sockaddr *) &local, sizeof(local));
+
+	event_register(EVENT_FBNEW, p50x_udpEventhandler, NULL, 0);
+	event_register(EVENT_SYS_STATUS, p50x_udpEventhandler, NULL, 0);
+	event_register(EVENT_LOCO_FUNCTION, p50x_udpEventhandler, NULL, 0);
+	event_register(EVENT_LOCO_SPEED, p50x_udpEventhandler, NULL, 0);
+	event_register(EVENT_TURNOUT, p50x_udpEventhandler, NULL, 0);
 
-	printf ("%s(): Starting at port 5000 UDP\n", __func__);
+	printf ("%s(): Starting at port %u UDP\n", __func__, port);
 	for (;;) {
-		rc = lwip_recvfrom(con.sock, con.data, sizeof(con.data) - con.idx, 0, &from, &fromlen);
-		if (rc <= 0) break;
-		remote = (struct sockaddr_in *) &from;
-		printf ("%s(): %d bytes from %s:%d\n", __func__, rc, inet_ntoa(remote->sin_addr.s_addr), ntohs(remote->sin_port));
-		con.idx += rc;
-		p50xb_interpret(&con);
-		con.idx = 0;
+		fromlen = sizeof(remote);
+		rc = lwip_recvfrom(con->sock, rx, MAX_CMDLEN + 1, 0, (struct sockaddr *) &remote, &fromlen);
+		if (rc < 0) {				// i.e. no network buffers - the socket stays usable, the client will repeat the request
+			log_error ("%s(): recvfrom() failed (errno = %d)\n", __func__, errno);
+			vTaskDelay(100);
+			continue;
+		}
+		if (rc < 2) continue;		// we need at least the sequence number and a command byte
+
+		if (!mutex_lock(&udpmutex, 100, __func__)) continue;		// the client will repeat the request
+		c = pxu_lookup(&udptab, remote.sin_addr.s_addr, remote.sin_port, p50x_now());
+		if (pxu_match(c, rx[0]) == PXU_REPEAT) {
+			reply[0] = rx[0];
+			memcpy (&reply[1], c->reply, c->rlen);
+			len = c->rlen + 1;
+			mutex_unlock(&udpmutex);
+			lwip_sendto(con->sock, reply, len, 0, (struct sockaddr *) &remote, fromlen);
+			continue;
+		}
+		ue = &udpevt[c - udptab.cl];
+		loco_setClient(P50X_UDPOWNER(c - udptab.cl));
+		con->loco = ue->loco;
+		con->trnt = ue->trnt;
+		con->flags = FLAG_IFEXT | ue->flags;
+		ue->loco = NULL;
+		ue->trnt = NULL;
+		ue->flags = 0;
+		mutex_unlock(&udpmutex);
+
+		con->udp = c;
+		con->reply = reply;
+		reply[0] = rx[0];
+		con->rlen = 1;
+		con->idx = rc - 1;
+		memcpy (con->data, &rx[1], con->idx);
+		p50x_udpExecute(con);
+
+		mutex_lock(&udpmutex, portMAX_DELAY, __func__);
+		p50x_udpRequeue(con, ue);
+		pxu_store(c, rx[0], &reply[1], con->rlen - 1);
+		mutex_unlock(&udpmutex);
+		con->udp = NULL;
+
+		lwip_sendto(con->sock, reply, con->rlen, 0, (struct sockaddr *) &remote, fromlen);
 	}
-
-	lwip_close(con.sock);
-	printf ("%s(): finished\n", __func__);
-	vTaskDelete(NULL);
 }
 #endif
 
 int p50x_start (uint16_t port)
 {
 #if (P50X_UDP != 0)
-	xTaskCreate(p50_udpReceiver, "P50X_UDP", P50X_STACK, NULL, P50X_PRIO, NULL);
+	xTaskCreate(p50_udpReceiver, "P50X_UDP", P50X_STACK, (void *) ((uint32_t) port), P50X_PRIO, NULL);
 #endif
 	return tcpsrv_startserver(port, p50x_tcpHandler, P50X_STACK, P50X_PRIO);
 }
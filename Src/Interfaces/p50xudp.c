@@ -0,0 +1,262 @@
+/*
+ * p50xudp.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Client table and shared feedback state for P50Xb over UDP
+ *
+ * Every datagram starts with a sequence number followed by one or more P50Xb
+ * commands. The reply carries the same sequence number, so the client can
+ * match it to its request. If a request is repeated (i.e. because the reply
+ * got lost), the cached reply is sent again instead of executing the commands
+ * a second time. Only short replies are cached, long ones (event lists) are
+ * generated again.
+ *
+ * The clients are kept in a small table and forgotten after PXU_IDLE_MS
+ * without a request. If the table is full, the client that was idle for the
+ * longest time is replaced.
+ *
+ * Other than the TCP connections, the UDP clients share a single copy of the
+ * feedback state. A client only remembers the generation it has seen last.
+ * Set inputs are latched until every active client has seen them. When the
+ * latch is released and contained inputs that are cleared by now, the module
+ * is marked as changed again, so every client learns about the cleared inputs.
+ *
+ * p50x.c owns the socket and the feedback bits and calls in here with the
+ * current time. Tests/p50xudp_test.c does the same for simulated clients
+ * that lose replies or go silent.
+ */
+
+#include <string.h>
+#include "p50xudp.h"
+
+static void pxu_drop (struct pxu_table *t, struct pxu_client *c)
+{
+	if (t->drop) t->drop(c);
+	memset (c, 0, sizeof(*c));
+}
+
+/**
+ * Check if a client sent a request within PXU_IDLE_MS.
+ *
+ * \param c			the client
+ * \param now		the current time in ms
+ * \return			true, if the client is active
+ */
+bool pxu_isActive (const struct pxu_client *c, uint32_t now)
+{
+	return c->used && (uint32_t) (now - c->lastseen) < PXU_IDLE_MS;
+}
+
+/**
+ * Forget all clients that are idle for PXU_IDLE_MS or longer.
+ *
+ * \param t			the client table
+ * \param now		the current time in ms
+ * \return			the number of clients dropped
+ */
+int pxu_expire (struct pxu_table *t, uint32_t now)
+{
+	int i, cnt;
+
+	for (i = cnt = 0; i < PXU_MAXCLIENTS; i++) {
+		if (t->cl[i].used && !pxu_isActive(&t->cl[i], now)) {
+			pxu_drop(t, &t->cl[i]);
+			cnt++;
+		}
+	}
+	return cnt;
+}
+
+/**
+ * Find the entry of a client or create it. If the table is full, the client
+ * that was idle for the longest time is replaced.
+ *
+ * \param t			the client table
+ * \param addr		the IPv4 address of the client
+ * \param port		the UDP port of the client
+ * \param now		the current time in ms
+ * \return			the client entry
+ */
+struct pxu_client *pxu_lookup (struct pxu_table *t, uint32_t addr, uint16_t port, uint32_t now)
+{
+	struct pxu_client *c, *oldest;
+	int i;
+
+	pxu_expire(t, now);
+	for (i = 0, c = NULL, oldest = NULL; i < PXU_MAXCLIENTS; i++) {
+		if (t->cl[i].used && t->cl[i].addr == addr && t->cl[i].port == port) {
+			t->cl[i].lastseen = now;
+			return &t->cl[i];
+		}
+		if (!t->cl[i].used) {
+			if (!c) c = &t->cl[i];
+		} else if (!oldest || (int32_t) (t->cl[i].lastseen - oldest->lastseen) < 0) {
+			oldest = &t->cl[i];
+		}
+	}
+	if (!c) {
+		c = oldest;
+		pxu_drop(t, c);
+	}
+	c->used = true;
+	c->addr = addr;
+	c->port = port;
+	c->lastseen = now;
+	c->fball = true;				// a new client gets the current state of all modules
+	return c;
+}
+
+/**
+ * Match a request against the last request of this client.
+ *
+ * \param c			the client
+ * \param seq		the sequence number of the request
+ * \return			PXU_NEW for a new request, PXU_REPEAT if the cached reply should
+ * 					be sent again and PXU_REEXEC if the request must be executed again
+ */
+enum pxu_match pxu_match (struct pxu_client *c, uint8_t seq)
+{
+	if (!c->seqvalid || c->seq != seq) return PXU_NEW;
+	return (c->rlen >= 0) ? PXU_REPEAT : PXU_REEXEC;
+}
+
+/**
+ * Remember the reply to a request.
+ *
+ * \param c			the client
+ * \param seq		the sequence number of the request
+ * \param reply		the reply (without the sequence number)
+ * \param len		the length of the reply
+ */
+void pxu_store (struct pxu_client *c, uint8_t seq, const uint8_t *reply, int len)
+{
+	c->seqvalid = true;
+	c->seq = seq;
+	if (len <= PXU_REPLYMAX) {
+		memcpy (c->reply, reply, len);
+		c->rlen = len;
+	} else {
+		c->rlen = -1;
+	}
+}
+
+/**
+ * A feedback module reported a change.
+ *
+ * \param s			the shared feedback state
+ * \param module	the zero based module
+ * \param bits		the current inputs of the module
+ */
+void pxu_fbUpdate (struct pxu_fbsnap *s, int module, uint16_t bits)
+{
+	if (module < 0 || module >= PXU_FBMODULES) return;
+	s->latch[module] |= bits;
+	s->modgen[module] = ++s->gen;
+}
+
+/**
+ * Let the next feedback poll report all modules with set inputs.
+ *
+ * \param c			the client
+ */
+void pxu_fbReset (struct pxu_client *c)
+{
+	c->fbcursor = 0;
+	c->fball = true;
+}
+
+static bool pxu_fbChanged (const struct pxu_fbsnap *s, const struct pxu_client *c, const uint16_t *state, int m)
+{
+	if ((int32_t) (s->modgen[m] - c->fbcursor) > 0) return true;
+	return c->fball && (state[m] | s->latch[m]);
+}
+
+/**
+ * Check if there are feedback changes to report to a client.
+ *
+ * \param s			the shared feedback state
+ * \param c			the client
+ * \param state		the current inputs of all modules
+ * \param modules	the number of modules
+ * \return			true, if at least one module must be reported
+ */
+bool pxu_fbPending (const struct pxu_fbsnap *s, const struct pxu_client *c, const uint16_t *state, int modules)
+{
+	int m;
+
+	if (modules > PXU_FBMODULES) modules = PXU_FBMODULES;
+	for (m = 0; m < modules; m++) {
+		if (pxu_fbChanged(s, c, state, m)) return true;
+	}
+	return false;
+}
+
+/**
+ * Build the feedback report of a client (as in XEvtSen: module number, high
+ * and low byte of the inputs, terminated by a null byte) and release the
+ * latches that all active clients have seen now.
+ *
+ * \param s			the shared feedback state
+ * \param t			the client table
+ * \param c			the client
+ * \param state		the current inputs of all modules
+ * \param modules	the number of modules
+ * \param buf		where to store the report (at least 3 * modules + 1 bytes)
+ * \param now		the current time in ms
+ * \return			the length of the report
+ */
+int pxu_fbReport (struct pxu_fbsnap *s, struct pxu_table *t, struct pxu_client *c, const uint16_t *state, int modules, uint8_t *buf, uint32_t now)
+{
+	uint8_t *p;
+	uint16_t bits;
+	uint32_t mincursor;
+	int m, i;
+
+	if (modules > PXU_FBMODULES) modules = PXU_FBMODULES;
+	for (m = 0, p = buf; m < modules; m++) {
+		if (!pxu_fbChanged(s, c, state, m)) continue;
+		bits = s->latch[m] | state[m];
+		*p++ = m + 1;				// in interface, modules are 1-based
+		*p++ = (bits >> 8) & 0xFF;
+		*p++ = bits & 0xFF;
+	}
+	*p++ = 0;						// End-of-List marker
+	c->fbcursor = s->gen;
+	c->fball = false;
+
+	// release the latches that every active client has seen
+	mincursor = c->fbcursor;
+	for (i = 0; i < PXU_MAXCLIENTS; i++) {
+		if (pxu_isActive(&t->cl[i], now) && (int32_t) (t->cl[i].fbcursor - mincursor) < 0) mincursor = t->cl[i].fbcursor;
+	}
+	for (m = 0; m < modules; m++) {
+		if (!s->latch[m] || (int32_t) (s->modgen[m] - mincursor) > 0) continue;
+		if (s->latch[m] & ~state[m]) s->modgen[m] = ++s->gen;		// inputs were cleared meanwhile - report the module again
+		s->latch[m] = 0;
+	}
+	return p - buf;
+}
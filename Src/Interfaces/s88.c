@@ -48,6 +48,21 @@
  * we are using. So at the GPIO hardware level, the bits must be inverted
  * to the real levels for the outside world. This also includes the s88
  * DATA input pin!
+ *
+ * To keep the interrupt load low, only the first few steps of a cycle (the
+ * LOAD/RESET sequence and the first data bit) are done in the TIM4 update
+ * interrupt. After that, the shifting of the remaining bits is completely
+ * done by two DMA streams triggered by TIM4:
+ *   - DMA1 Stream2 (request TIM4_UP) writes the CLK level alternating HIGH
+ *     and LOW to the BSRR register of the CLK port with every update event
+ *   - DMA1 Stream3 (request TIM4_CH1) samples the IDR register of the DATA
+ *     port in the middle of each timer period
+ * When all samples are collected, the transfer complete interrupt of Stream3
+ * stops the timer and wakes up the s88 task. So a complete scan only needs
+ * six interrupts regardless of the number of modules.
+ *
+ * The raw bits are finally passed thru a debounce filter (see s88filter.c)
+ * before they are handed over to the central feedback handling.
  */
 
 #include <string.h>
@@ -56,13 +71,18 @@
 #include "events.h"
 #include "config.h"
 #include "bidib.h"
+#include "s88filter.h"
 
 #define TIMER_CLOCKRATE				1000000			///< the timer runs at a base clock rate of 1MHz
-#define S88_CS2_SEQUENCE			0				///< if defined to != 0, we use the sequence of the CS2 s88 bus (see explanation above interrupt handler)
+#define DMAREQ_TIM4_CH1				29				///< DMAMUX1 request input for TIM4 capture/compare channel 1
+#define DMAREQ_TIM4_UP				32				///< DMAMUX1 request input for TIM4 update event
+#define S88_DMABITS					(MAX_S88MODULES * 16 - 1)	///< the first bit is read in the interrupt, all others are read by DMA
+#define S88_SAMPLES					(S88_DMABITS * 2 + 1)		///< two samples per bit plus the first (dummy) sample
 //#define S88_CLK_DEBUG								///< if defined, the Märklin booster ON/OFF is a copy of the clock signal
 
 #ifdef CENTRAL_FEEDBACK
 static volatile uint16_t input[MAX_S88MODULES];		///< the current status of all information bits read in
+static uint16_t filtered[MAX_S88MODULES];			///< the debounced status of all information bits
 static volatile int s88_modules;					///< the actual number of used s88 modules
 
 #else
@@ -77,6 +97,64 @@ static volatile int modules;						///< the total number of available feedback mo
 #endif
 
 static TaskHandle_t s88_task;						///< the task to wake up every time there is a full reading done
+static struct s88filter filter;						///< the debounce filter for all s88 inputs
+
+/**
+ * The GPIO lines used for CLK and DATA depend on the hardware revision.
+ * They are resolved once at startup, so the interrupt and the DMA setup
+ * don't need to check the HW version on every clock edge.
+ */
+static struct {
+	GPIO_TypeDef	*clk;			///< the GPIO port of the CLK line
+	uint32_t		 clkhigh;		///< the BSRR value to bring the CLK line HIGH on the s88N connector
+	uint32_t		 clklow;		///< the BSRR value to bring the CLK line LOW on the s88N connector
+	GPIO_TypeDef	*data;			///< the GPIO port of the DATA line
+	uint16_t		 datamask;		///< the bit in IDR representing the DATA line
+} pins;
+
+static uint32_t clkseq[8] __attribute__((aligned(32)));			///< the CLK sequence for DMA (only the first two entries are used)
+static uint16_t samples[(S88_SAMPLES + 15) & ~15] __attribute__((aligned(32)));	///< the sampled IDR values from DMA
+
+/*
+ * LOAD (P/S) and RESET never changed since HW V0.7, so we can use macros
+ * instead of functions.
+ */
+#define LOAD_HIGH()		do { GPIOB->BSRR = GPIO_BSRR_BR4; } while(0)
+#define LOAD_LOW()		do { GPIOB->BSRR = GPIO_BSRR_BS4; } while(0)
+#define RESET_HIGH()	do { GPIOD->BSRR = GPIO_BSRR_BR3; } while(0)
+#define RESET_LOW()		do { GPIOD->BSRR = GPIO_BSRR_BS3; } while(0)
+
+#define CLK_HIGH()		do { pins.clk->BSRR = pins.clkhigh; } while(0)
+#define CLK_LOW()		do { pins.clk->BSRR = pins.clklow; } while(0)
+#define DATA_ISSET()	((pins.data->IDR & pins.datamask) == 0)		/* the DATA line is inverted by the opto coupler */
+
+/**
+ * Resolve the hardware dependant mapping of the CLK and DATA lines.
+ * See the table above TIM4_IRQHandler() for the details.
+ */
+static void s88_initPins (void)
+{
+	if (hwinfo->HW >= HW11) {		// all HW from V1.1 onwards uses PG13 as CLK (with additional inverter) and PG12 as DATA line
+		pins.clk = GPIOG;
+		pins.clkhigh = GPIO_BSRR_BS13;
+		pins.clklow = GPIO_BSRR_BR13;
+		pins.data = GPIOG;
+		pins.datamask = GPIO_IDR_ID12;
+	} else {						// hardware V0.7 and V1.0 used PG11 as CLK and PD02 as DATA line
+		pins.clk = GPIOG;
+		pins.clkhigh = GPIO_BSRR_BR11;
+		pins.clklow = GPIO_BSRR_BS11;
+		pins.data = GPIOD;
+		pins.datamask = GPIO_IDR_ID2;
+	}
+
+	clkseq[0] = pins.clkhigh;		// the odd DMA steps shift out the next bit
+	clkseq[1] = pins.clklow;		// the even DMA steps are sampled
+	cache_flush((uint32_t) clkseq, sizeof(clkseq));
+
+	CLK_LOW();
+	LOAD_HIGH();					// the latches are read into the shift register with the next rising clock edge
+}
 
 static void s88_initTimer (void)
 {
@@ -87,8 +165,8 @@ static void s88_initTimer (void)
 	TIM4->SMCR = 0;					// no settings are used (slave mode is disabled)
 	TIM4->DIER = 0;					// start with disabling interrupts
 	TIM4->SR = 0;					// clear all status bits
-	TIM4->CCER = 0;					// we don't use the capture / compare channels
-	TIM4->CCMR1 = 0;				// we use simple timer mode - no output compare or input capture
+	TIM4->CCER = 0;					// we don't use the capture / compare outputs
+	TIM4->CCMR1 = 0;				// channel 1 is used in frozen mode to trigger the DATA sampling in mid of the timer period
 	TIM4->CCMR2 = 0;				// we use simple timer mode - no output compare or input capture
 
 	TIM4->PSC = 199;				// select a prescaler of 200 (PSC + 1)
@@ -96,14 +174,96 @@ static void s88_initTimer (void)
 	TIM4->AF1 = 0;					// we don't use any ETR input stuff
 
 	TIM4->ARR = 99;					// set ARR to 100 ticks (giving 10kHz interrupt rate)
+	TIM4->CCR1 = 50;				// sample the DATA line in the middle of the timer period
 	TIM4->EGR = TIM_EGR_UG;			// trigger an update to get ARR value loaded
 
+	/*
+	 * DMA1 Stream2: memory to peripheral (clkseq -> CLK port BSRR), 32 bit, circular
+	 * DMA1 Stream3: peripheral to memory (DATA port IDR -> samples), 16 bit, transfer complete interrupt
+	 */
+	DMA1_Stream2->CR = 0;
+	DMA1_Stream3->CR = 0;
+	while ((DMA1_Stream2->CR | DMA1_Stream3->CR) & DMA_SxCR_EN) ;		// wait until the DMA is really disabled (just in case ...)
+	DMAMUX1_Channel2->CCR = (DMAREQ_TIM4_UP << DMAMUX_CxCR_DMAREQ_ID_Pos);
+	DMAMUX1_Channel3->CCR = (DMAREQ_TIM4_CH1 << DMAMUX_CxCR_DMAREQ_ID_Pos);
+
 	NVIC_SetPriority(TIM4_IRQn, 14);
 	NVIC_ClearPendingIRQ(TIM4_IRQn);
 	NVIC_EnableIRQ(TIM4_IRQn);
+	NVIC_SetPriority(DMA1_Stream3_IRQn, 14);
+	NVIC_ClearPendingIRQ(DMA1_Stream3_IRQn);
+	NVIC_EnableIRQ(DMA1_Stream3_IRQn);
 
 	TIM4->SR = 0;							// clear a possibly pending interrupt
-	SET_BIT (TIM4->DIER, TIM_DIER_UIE);		// enable update interrupt (i.e. at timer overflow)
+}
+
+/**
+ * Prepare the two DMA streams for the next cycle. They are enabled, but
+ * will only start working when the interrupt switches the timer from
+ * interrupt to DMA requests (see step 5 in TIM4_IRQHandler()).
+ *
+ * \param bits		the number of bits to shift in by DMA
+ */
+static void s88_prepareDMA (int bits)
+{
+	DMA1_Stream2->CR = (0b10 << DMA_SxCR_MSIZE_Pos) | (0b10 << DMA_SxCR_PSIZE_Pos) | DMA_SxCR_MINC | DMA_SxCR_CIRC | (0b01 << DMA_SxCR_DIR_Pos);
+	DMA1_Stream2->NDTR = 2;
+	DMA1_Stream2->PAR = (uint32_t) &pins.clk->BSRR;
+	DMA1_Stream2->M0AR = (uint32_t) clkseq;
+	DMA1_Stream2->FCR = 0;				// direct mode
+
+	DMA1_Stream3->CR = (0b01 << DMA_SxCR_MSIZE_Pos) | (0b01 << DMA_SxCR_PSIZE_Pos) | DMA_SxCR_MINC | (0b00 << DMA_SxCR_DIR_Pos) | (0b10 << DMA_SxCR_PL_Pos);
+	DMA1_Stream3->NDTR = bits * 2 + 1;
+	DMA1_Stream3->PAR = (uint32_t) &pins.data->IDR;
+	DMA1_Stream3->M0AR = (uint32_t) samples;
+	DMA1_Stream3->FCR = 0;				// direct mode
+
+	// clear all interrupt flags of DMA1 Stream2 and Stream3
+	DMA1->LIFCR = DMA_LIFCR_CTCIF2 | DMA_LIFCR_CHTIF2 | DMA_LIFCR_CTEIF2 | DMA_LIFCR_CDMEIF2 | DMA_LIFCR_CFEIF2
+				| DMA_LIFCR_CTCIF3 | DMA_LIFCR_CHTIF3 | DMA_LIFCR_CTEIF3 | DMA_LIFCR_CDMEIF3 | DMA_LIFCR_CFEIF3;
+
+	SET_BIT(DMA1_Stream2->CR, DMA_SxCR_EN);
+	SET_BIT(DMA1_Stream3->CR, DMA_SxCR_EN | DMA_SxCR_TCIE);
+}
+
+/**
+ * Run a complete s88 cycle on the given number of modules and wait for
+ * it's completion. The result is put to the input[] array.
+ *
+ * The bit #1 of the first module is already read by the interrupt, all
+ * other bits are taken from the sample buffer. Samples with an even index
+ * are taken while CLK is LOW (sample 0 is a dummy, see TIM4_IRQHandler()).
+ *
+ * \param mods		number of s88 modules to read
+ */
+static void s88_scan (int mods)
+{
+	volatile uint16_t *p;
+	uint16_t *s, mask, w;
+	int bits;
+
+	if (mods <= 0) return;
+	if (mods > MAX_S88MODULES) mods = MAX_S88MODULES;
+
+	s88_prepareDMA(mods * 16 - 1);
+	TIM4->SR = 0;
+	TIM4->DIER = TIM_DIER_UIE;					// the first steps are handled by the update interrupt
+	SET_BIT (TIM4->CR1, TIM_CR1_CEN);			// enable and start the timer
+	ulTaskNotifyTake(pdTRUE, portMAX_DELAY);	// if we return, the timer is disabled - we have time to do our job
+
+	cache_invalidate((uint32_t) samples, sizeof(samples));
+	p = input;
+	w = *p & 0x8000;							// bit #1 of first module (read by interrupt)
+	mask = 0x4000;
+	s = &samples[2];
+	for (bits = mods * 16 - 1; bits > 0; bits--, s += 2) {
+		if ((*s & pins.datamask) == 0) w |= mask;
+		if ((mask >>= 1) == 0) {
+			*p++ = w;
+			w = 0;
+			mask = 0x8000;
+		}
+	}
 }
 
 #if 0
@@ -216,13 +376,17 @@ static int s88_createBiDiBnodes (int s88, int mcan, int lnet)
  * structure, while the timer interrupt in the next round will fill the
  * independant input[] array.
  *
+ * With CENTRAL_FEEDBACK, the read bits are debounced by the filter and then
+ * handed over to fb_s88input() which does the change detection.
+ *
  * This continues endless. The minimum time between two rounds is at 5kHz
- * clock rate with just one single s88 module. The timer interrupt fires at
- * 10kHz (every 100µs) and needs (s88_modules * 16 * 2 + 4) steps to complete.
+ * clock rate with just one single s88 module. The timer runs at 10kHz
+ * (every 100µs) and needs (s88_modules * 16 * 2 + 4) steps to complete.
  * This gives the minium time of 36 steps = 3,6ms. The maximum time is when
  * we drop the clockrate to 500Hz with MAX_S88MODULES (64). With 500Hz clock
- * rate we use a 1kHz interrupt rate (1ms). This leads to 2052 steps, in other
- * words more than 2 seconds.
+ * rate we use a 1kHz timer rate (1ms). This leads to 2052 steps, in other
+ * words more than 2 seconds. Only the first six steps and the end of the
+ * cycle need an interrupt, all other steps are handled by DMA.
  *
  * If no s88 modules are defined, the thread just sleeps for 200ms and then
  * checks again if the number of defined modules is above zero.
@@ -238,9 +402,11 @@ void vS88Bus (void *pvParameter)
 	(void) pvParameter;
 
 	s88_task = xTaskGetCurrentTaskHandle();
+	s88_initPins();
 	s88_initTimer();
 	cnf = cnf_getconfig();
 	s88_setFrequency(cnf->s88Frequency);
+	s88f_init(&filter, &cnf->s88filter);
 
 	s88_modules = cnf->s88Modules;
 
@@ -248,9 +414,9 @@ void vS88Bus (void *pvParameter)
 
 	for (;;) {
 		if (s88_modules > 0) {
-			SET_BIT (TIM4->CR1, TIM_CR1_CEN);			// enable and start the timer
-			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);	// if we return, the timer is disabled - we have time to do our job
-			fb_s88input(s88_modules, (uint16_t *) input);
+			s88_scan(s88_modules);
+			s88f_apply(&filter, s88_modules, (uint16_t *) input, filtered);
+			fb_s88input(s88_modules, filtered);
 		} else {
 			vTaskDelay(200);
 		}
@@ -290,6 +456,7 @@ void s88_setFrequency (int hz)
 	}
 	hz <<= 1;					// frequency must be doubled
 	TIM4->ARR = (TIMER_CLOCKRATE / hz) - 1;
+	TIM4->CCR1 = (TIMER_CLOCKRATE / hz) / 2;	// DATA is sampled in the middle of the period
 }
 
 int s88_getFrequency(void)
@@ -312,9 +479,11 @@ void vS88Bus (void *pvParameter)
 	(void) pvParameter;
 
 	s88_task = xTaskGetCurrentTaskHandle();
+	s88_initPins();
 	s88_initTimer();
 	cnf = cnf_getconfig();
 	s88_setFrequency(cnf->s88Frequency);
+	s88f_init(&filter, &cnf->s88filter);
 
 	s88_modules = cnf->s88Modules;
 	can_modules = cnf->canModules;
@@ -332,8 +501,8 @@ void vS88Bus (void *pvParameter)
 
 	for (;;) {
 		if (modules > 0) {
-			SET_BIT (TIM4->CR1, TIM_CR1_CEN);			// enable and start the timer
-			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);	// if we return, the timer is disabled - we have time to do our job
+			s88_scan(s88_modules);
+			s88f_apply(&filter, s88_modules, (uint16_t *) input, (uint16_t *) input);
 			memset (status.evFlag, 0, sizeof(status.evFlag));
 #ifdef CENTRAL_FEEDBACK
 			fb_s88input(modules, (uint16_t *) input);
@@ -424,6 +593,7 @@ void s88_setFrequency (int hz)
 	}
 	hz <<= 1;					// frequency must be doubled
 	TIM4->ARR = (TIMER_CLOCKRATE / hz) - 1;
+	TIM4->CCR1 = (TIMER_CLOCKRATE / hz) / 2;	// DATA is sampled in the middle of the period
 	s88_triggerUpdate();
 }
 
@@ -438,14 +608,46 @@ int s88_getFrequency(void)
 
 #endif
 
-/*
- * LOAD (P/S) and RESET never changed since HW V0.7, so we can use macros
- * instead of functions.
+/**
+ * Define a debounce filter profile.
+ *
+ * \param idx		the profile number (1 .. S88F_PROFILES - 1)
+ * \param onN		number of occupied samples that are needed to switch ON
+ * \param onM		size of the window of samples to look at for switching ON
+ * \param offN		number of free samples that are needed to switch OFF
+ * \param offM		size of the window of samples to look at for switching OFF
+ * \return			0 if the profile was accepted, -1 otherwise
  */
-#define LOAD_HIGH()		do { GPIOB->BSRR = GPIO_BSRR_BR4; } while(0)
-#define LOAD_LOW()		do { GPIOB->BSRR = GPIO_BSRR_BS4; } while(0)
-#define RESET_HIGH()	do { GPIOD->BSRR = GPIO_BSRR_BR3; } while(0)
-#define RESET_LOW()		do { GPIOD->BSRR = GPIO_BSRR_BS3; } while(0)
+int s88_setFilterProfile (int idx, int onN, int onM, int offN, int offM)
+{
+	if (!s88f_setProfile(&cnf_getconfig()->s88filter, idx, onN, onM, offN, offM)) return -1;
+	cnf_triggerStore(__func__);
+	event_fire(EVENT_FBPARAM, 0, NULL);
+	return 0;
+}
+
+/**
+ * Assign a debounce filter profile to a range of inputs.
+ *
+ * \param first		the first input (0-based, i.e. 0 .. 15 are the inputs of the first module)
+ * \param last		the last input (inclusive)
+ * \param profile	the profile to assign to the inputs
+ * \return			0 if the settings were accepted, -1 otherwise
+ */
+int s88_setInputFilter (int first, int last, int profile)
+{
+	struct sysconf *cnf;
+	int i;
+
+	if (first < 0 || last < first || last >= MAX_S88MODULES * 16) return -1;
+	if (profile < 0 || profile >= S88F_PROFILES) return -1;
+
+	cnf = cnf_getconfig();
+	for (i = first; i <= last; i++) s88f_setInputProfile(&cnf->s88filter, i, profile);
+	cnf_triggerStore(__func__);
+	event_fire(EVENT_FBPARAM, 0, NULL);
+	return 0;
+}
 
 /*
  *   STEP	-2 -1  0  1  2  3  4  5  6  7  8  9  10 11
@@ -473,13 +675,17 @@ int s88_getFrequency(void)
  *   7: CLK is taken LOW and this second bit is read in
  *   8 .. n: on every even step CLK line is set HIGH to shift out the next s88 data bit, on the odd steps it is set LOW and the bit is read
  *
+ * Steps 1 to 5 are done in the update interrupt. In step 5 the timer is switched
+ * over to DMA requests and steps 6 .. n are handled by the DMA streams. Step 0
+ * is done by the DMA transfer complete interrupt.
+ *
  * The parallel latches sum up data between step 4 and until step 1 is reached again.
  * Low-High-Low glitches that happen between step 1 and 4 will be lost! This makes a
  * blind spot of 0,3ms - 3ms depending on the actual clockrate choosen.
  *
  * -------------------------------------------------------------------------------------
- * The CS2 timing (read position estimated). There is a pause between the last
- * bit read and the beginning of a new cycle. This pause is probably determined
+ * The CS2 timing (read position estimated, for reference only - not implemented
+ * any more). There is a pause between the last bit read and the beginning of a new cycle. This pause is probably determined
  * by the set read intervall. In reality, the LOW impulse on the CLK line is quite
  * short in contrast to the HIGH portion.
  *
@@ -509,122 +715,30 @@ int s88_getFrequency(void)
  */
 
 /**
- * Set or clear the mask bit in the result array depending on the
- * value of the s88 input serial bit. This function must account for
- * the HW version. Remember: the read bit is inverted due to the
- * opto coupler used to isolate the s88 port from the rest of the
- * hardware.
- *
- * \param mask		a 16-Bit mask with the positional bit set (MSB is used first and then right-shifting until zero)
- * \param p			a pointer in the uint16_t array of s88 module status bits
- * \return			the next mask to be used (mask >> 1, may drop down to zero)
+ * The update interrupt handles the LOAD/RESET sequence and the first data bit
+ * of a cycle (steps 1 - 5). With step 5 the counter is restarted and the timer
+ * requests are switched from interrupt to DMA. The CC1 request of this
+ * restarted period produces the dummy sample #0 (CLK still LOW before
+ * step 6). From then on, every update event writes the next CLK level and
+ * every CC1 event samples the DATA line half a period later.
  */
-static uint16_t s88_readBit (uint16_t mask, volatile uint16_t *p)
-{
-	if (p && mask) {	// we need p and the mask should not be zero!
-		if (hwinfo->HW >= HW11) {		// all HW from V1.1 onwards uses PG12 as DATA line
-			if ((GPIOG->IDR & GPIO_IDR_ID12) == 0) *p |= mask;
-			else *p &= ~mask;
-		} else {						// hardware V0.7 and V1.0 used PD02 as DATA line
-			if ((GPIOD->IDR & GPIO_IDR_ID2) == 0) *p |= mask;
-			else *p &= ~mask;
-		}
-	}
-	return mask >> 1;
-}
-
-/**
- * Switch the CLK line to a logical state on the s88N connector.
- * This accounts for the HW version.
- *
- * \param high		the requiered state of the CLK signal on the s88N connector
- */
-static void s88_clock (bool high)
-{
-	if (hwinfo->HW >= HW11) {			// additional inverter in CLK line from HW V1.5 (on isolated/secondary side)
-										// this is also the case on HW from V1.1 onwards, see commented lines below
-		if (high) GPIOG->BSRR = GPIO_BSRR_BS13;		// PG13 HIGH
-		else GPIOG->BSRR = GPIO_BSRR_BR13;			// PG13 LOW
-//	} else if (hwinfo->HW >= HW11) {	// from HW 1.1: CLK on PG13, DATA on PG12, RESET on PD3, P/S on PB4 - inverter was added by HW-patch!
-//		if (high) GPIOG->BSRR = GPIO_BSRR_BR13;		// PG13 LOW
-//		else GPIOG->BSRR = GPIO_BSRR_BS13;			// PG13 HIGH
-	} else {							// up to HW 1.0 we used PG11 as CLK and PA6 as DATA pin
-		if (high) GPIOG->BSRR = GPIO_BSRR_BR11;		// PG11 LOW
-		else GPIOG->BSRR = GPIO_BSRR_BS11;			// PG11 HIGH
-	}
-}
-
 void TIM4_IRQHandler (void)
 {
-	static int step;		// the steps counted from 0 to (s88_modules * 16(bits) * 2(edges)) + 4(extra steps for load/reset)
-	static volatile uint16_t *p;
-	static uint16_t mask;
-//	static uint8_t filter;
+	static int step;		// the steps counted from 1 to 5
 
 	BaseType_t xHigherPriorityTaskWoken = 0;
 	TIM4->SR = 0;						// clear all interrupt flags
 
-#if S88_CS2_SEQUENCE
-	if (step < 0 || step >= (s88_modules * 16 * 2 + 1)) step = 0;
-
-	switch (step) {
-		case 0:
-			CLEAR_BIT (TIM4->CR1, TIM_CR1_CEN);
-			s88_clock(LOW);			// should already be the case
-			LOAD_HIGH();			// switch to parallel inputs (from latches)
-			vTaskNotifyGiveFromISR(s88_task, &xHigherPriorityTaskWoken);
-			break;
-		case 1:
-			s88_clock(HIGH);		// this latches the parallel data to the shift register
-			break;
-		case 2:
-			s88_clock(LOW);
-			LOAD_LOW();
-			p = input;
-			mask = s88_readBit(0x8000, p);
-			break;
-		case 3:
-			s88_clock(HIGH);		// shift out next bit
-			RESET_HIGH();			// clear parallel input latches
-			break;
-		case 4:
-			s88_clock(LOW);			// no shifting is done, but we now can safely read the s88 bit
-			mask = s88_readBit(mask, p);
-			break;
-		case 5:
-			s88_clock(HIGH);		// shift out next bit
-			RESET_LOW();			// release clear enabling the LOW-active latch setting
-			break;
-		default:
-			if (step & 1) {			// rising edge on odd steps
-				s88_clock(HIGH);	// shift out next bit
-			} else {				// falling edge on even steps
-				s88_clock(LOW);		// no shifting is done, but we now can safely read the s88 bit
-				mask = s88_readBit(mask, p);
-				if (!mask) {
-					p++;
-					mask = 0x8000;
-				}
-			}
-			break;
-	}
-#else	/* S88_CS2_SEQUENCE */
-	if (step < 0 || step >= (s88_modules * 16 * 2 + 4)) step = 0;
+	if (step < 1 || step > 5) step = 1;
 
 	switch (step) {
-		case 0:
-			s88_clock(LOW);			// should already be the case
-			LOAD_HIGH();			// switch to parallel inputs (from latches)
-			vTaskNotifyGiveFromISR(s88_task, &xHigherPriorityTaskWoken);
-			CLEAR_BIT (TIM4->CR1, TIM_CR1_CEN);
-			break;
 		case 1:
-			s88_clock(HIGH);		// this latches the parallel data to the shift register
+			CLK_HIGH();				// this latches the parallel data to the shift register
 			break;
 		case 2:
-			s88_clock(LOW);
-			p = input;
-			/*if (s88_modules)*/ mask = s88_readBit(0x8000, p);		// read first bit of new cycle
+			CLK_LOW();
+			if (DATA_ISSET()) input[0] |= 0x8000;		// read first bit of new cycle
+			else input[0] &= ~0x8000;
 			break;
 		case 3:
 			RESET_HIGH();			// clear parallel input latches
@@ -634,23 +748,35 @@ void TIM4_IRQHandler (void)
 			break;
 		case 5:
 			LOAD_LOW();
-			break;
-		default:
-			if (!(step & 1)) {
-				s88_clock(HIGH);					// shift out next bit
-			} else {
-				s88_clock(LOW);				// no shifting is done, but we now can safely read the s88 bit
-				mask = s88_readBit(mask, p);
-				if (!mask) {
-					p++;
-					mask = 0x8000;
-				}
-			}
+			TIM4->CNT = 0;			// restart period, so the first CC1 DMA request is the (dummy) sample #0
+			TIM4->SR = 0;
+			TIM4->DIER = TIM_DIER_UDE | TIM_DIER_CC1DE;	// from now on, DMA does the work
 			break;
 	}
-#endif	/* !S88_CS2_SEQUENCE */
 
 	step++;
 	NVIC_ClearPendingIRQ(TIM4_IRQn);
-    portEND_SWITCHING_ISR (xHigherPriorityTaskWoken);
+	portEND_SWITCHING_ISR (xHigherPriorityTaskWoken);
+}
+
+/**
+ * All samples are read in. We stop the timer and the CLK DMA and prepare the
+ * next cycle (step 0): CLK is LOW and LOAD is HIGH to switch to parallel inputs.
+ */
+void DMA_STR3_IRQHandler (void)
+{
+	BaseType_t xHigherPriorityTaskWoken = 0;
+
+	if (DMA1->LISR & DMA_LISR_TCIF3) {
+		CLEAR_BIT (TIM4->CR1, TIM_CR1_CEN);
+		TIM4->DIER = 0;
+		CLEAR_BIT(DMA1_Stream2->CR, DMA_SxCR_EN);
+		CLEAR_BIT(DMA1_Stream3->CR, DMA_SxCR_EN);
+		CLK_LOW();				// should already be the case
+		LOAD_HIGH();			// switch to parallel inputs (from latches)
+		if (s88_task) vTaskNotifyGiveFromISR(s88_task, &xHigherPriorityTaskWoken);
+	}
+	// clear all DMA1 Stream3 interrupt flags
+	DMA1->LIFCR = DMA_LIFCR_CTCIF3 | DMA_LIFCR_CHTIF3 | DMA_LIFCR_CTEIF3 | DMA_LIFCR_CDMEIF3 | DMA_LIFCR_CFEIF3;
+	portEND_SWITCHING_ISR (xHigherPriorityTaskWoken);
 }
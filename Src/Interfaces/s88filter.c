@@ -0,0 +1,201 @@
+/*
+ * s88filter.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Debouncing of the s88 inputs
+ *
+ * Reed contacts and track occupancy detectors with bad wheel contacts tend to
+ * produce short pulses that would make the feedback bits flicker. Because the
+ * s88 modules latch every LOW pulse between two reads, a single bounce will
+ * show up as a complete scan cycle with the input occupied.
+ *
+ * Each input is assigned to one of S88F_PROFILES filter profiles. A profile
+ * defines an N-of-M rule for switching ON and a separate one for switching
+ * OFF, so an input may for example react immedeately on occupancy (1 of 1) but
+ * will only report free after 3 of 4 samples where read as free.
+ *
+ * Profile 0 is the pass thru profile. Modules where all inputs use this
+ * profile are simply copied.
+ *
+ * s88.c calls s88f_apply() after each scan of the bus with the raw inputs,
+ * the filter itself only keeps the recent samples of each input and has no
+ * timing of its own. Tests/s88filter_test.c counts the delays in scans the
+ * same way.
+ */
+
+#include <string.h>
+#include "s88filter.h"
+
+static int s88f_bitcount (uint16_t w)
+{
+	return __builtin_popcount(w);
+}
+
+static uint16_t s88f_window (int m)
+{
+	if (m >= S88F_MAXSAMPLES) return 0xFFFF;
+	return (1u << m) - 1;
+}
+
+/**
+ * Setup a configuration with default values. All inputs use profile 0 (no
+ * filtering). Profile 1 to 3 are predefined with typical settings.
+ *
+ * \param cnf		the configuration to initialise
+ */
+void s88f_defaults (struct s88f_config *cnf)
+{
+	if (!cnf) return;
+
+	memset (cnf, 0, sizeof(*cnf));
+	s88f_setProfile(cnf, 0, 1, 1, 1, 1);		// pass thru
+	s88f_setProfile(cnf, 1, 1, 1, 3, 3);		// fast ON, delayed OFF (occupancy detectors)
+	s88f_setProfile(cnf, 2, 2, 3, 2, 3);		// 2 of 3 in both directions (reed contacts)
+	s88f_setProfile(cnf, 3, 3, 4, 4, 4);		// strong filtering
+}
+
+/**
+ * Define the parameters of a profile. All values are checked and the
+ * profile is only changed if they are valid (1 <= N <= M <= S88F_MAXSAMPLES).
+ * Profile 0 is fixed to the pass thru behavior.
+ *
+ * \param cnf		the configuration to manipulate
+ * \param idx		the profile index (1 .. S88F_PROFILES - 1, 0 only accepts 1/1 1/1)
+ * \param onN		number of occupied samples that are needed to switch ON
+ * \param onM		size of the window of samples to look at for switching ON
+ * \param offN		number of free samples that are needed to switch OFF
+ * \param offM		size of the window of samples to look at for switching OFF
+ * \return			true, if the profile was accepted, false otherwise
+ */
+bool s88f_setProfile (struct s88f_config *cnf, int idx, int onN, int onM, int offN, int offM)
+{
+	struct s88f_profile *p;
+
+	if (!cnf || idx < 0 || idx >= S88F_PROFILES) return false;
+	if (onN < 1 || onN > onM || onM > S88F_MAXSAMPLES) return false;
+	if (offN < 1 || offN > offM || offM > S88F_MAXSAMPLES) return false;
+	if (idx == 0 && (onN != 1 || onM != 1 || offN != 1 || offM != 1)) return false;
+
+	p = &cnf->profile[idx];
+	p->onN = onN;
+	p->onM = onM;
+	p->offN = offN;
+	p->offM = offM;
+	return true;
+}
+
+/**
+ * Assign a profile to a single input.
+ *
+ * \param cnf		the configuration to manipulate
+ * \param input		the 0-based input number (0 .. 15 is module 1, 16 .. 31 is module 2, ...)
+ * \param profile	the profile index to use for this input
+ * \return			true, if the setting was accepted, false otherwise
+ */
+bool s88f_setInputProfile (struct s88f_config *cnf, int input, int profile)
+{
+	int shift;
+
+	if (!cnf || input < 0 || input >= S88F_MODULES * 16) return false;
+	if (profile < 0 || profile >= S88F_PROFILES) return false;
+
+	shift = (15 - (input & 15)) * 2;
+	cnf->map[input >> 4] &= ~(3u << shift);
+	cnf->map[input >> 4] |= (uint32_t) profile << shift;
+	return true;
+}
+
+/**
+ * Read the profile that is assigned to a single input.
+ *
+ * \param cnf		the configuration to interrogate
+ * \param input		the 0-based input number (0 .. 15 is module 1, 16 .. 31 is module 2, ...)
+ * \return			the profile index or 0 if the parameters are out of range
+ */
+int s88f_getInputProfile (const struct s88f_config *cnf, int input)
+{
+	if (!cnf || input < 0 || input >= S88F_MODULES * 16) return 0;
+	return (cnf->map[input >> 4] >> ((15 - (input & 15)) * 2)) & 3;
+}
+
+/**
+ * Initialise the runtime state of a filter. All inputs start as free.
+ *
+ * \param f			the filter to initialise
+ * \param cnf		the configuration to use (must stay valid as long as the filter is used)
+ */
+void s88f_init (struct s88filter *f, const struct s88f_config *cnf)
+{
+	if (!f) return;
+
+	memset (f, 0, sizeof(*f));
+	f->cnf = cnf;
+}
+
+/**
+ * Feed a new set of raw samples into the filter and calculate the filtered
+ * output. The bit order is the same as used for the s88 modules (MSB is
+ * input #1, LSB is input #16).
+ *
+ * \param f			the filter to use
+ * \param modules	the number of modules that are presented
+ * \param raw		the raw input states as read from the bus
+ * \param out		the filtered output (may be identical to raw)
+ */
+void s88f_apply (struct s88filter *f, int modules, const uint16_t *raw, uint16_t *out)
+{
+	const struct s88f_profile *p;
+	uint16_t mask, st, *h;
+	uint32_t map;
+	int mod, i;
+
+	if (!f || !f->cnf || !raw || !out) return;
+	if (modules > S88F_MODULES) modules = S88F_MODULES;
+
+	for (mod = 0; mod < modules; mod++) {
+		map = f->cnf->map[mod];
+		h = f->hist[mod];
+		if (!map) {								// pass thru for all inputs - just keep the history up to date
+			for (i = 0, mask = 0x8000; i < 16; i++, mask >>= 1) {
+				h[i] = (h[i] << 1) | !!(raw[mod] & mask);
+			}
+			f->state[mod] = out[mod] = raw[mod];
+			continue;
+		}
+		st = f->state[mod];
+		for (i = 0, mask = 0x8000; i < 16; i++, mask >>= 1, map <<= 2) {
+			h[i] = (h[i] << 1) | !!(raw[mod] & mask);
+			p = &f->cnf->profile[map >> 30];
+			if (st & mask) {
+				if (s88f_bitcount(~h[i] & s88f_window(p->offM)) >= p->offN) st &= ~mask;
+			} else {
+				if (s88f_bitcount(h[i] & s88f_window(p->onM)) >= p->onN) st |= mask;
+			}
+		}
+		f->state[mod] = out[mod] = st;
+	}
+}
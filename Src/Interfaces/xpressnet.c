@@ -368,6 +368,78 @@ static void xpn_lostControl (struct xpn_node *node)
 	_xpn_sendmessage(XPN_ANSWER + node->adr, 0xE3, 0x40, loco >> 8, loco & 0xFF);
 }
 
+/**
+ * Get the state of eight functions as a byte with the lowest function in bit 0.
+ *
+ * \param l		the live loco data
+ * \param first	the first function to report
+ * \return		the state of the functions first .. first + 7
+ */
+static uint8_t xpn_funcByte (const ldataT *l, int first)
+{
+	uint32_t w;
+	int idx, sh;
+
+	if (!l || first < 0 || first >= LOCO_MAX_FUNCS) return 0;
+	idx = first / 32;
+	sh = first % 32;
+	w = l->funcs[idx] >> sh;
+	if (sh > 24 && idx + 1 < MAX_FUNC_WORDS) w |= l->funcs[idx + 1] << (32 - sh);
+	return w & 0xFF;
+}
+
+/**
+ * Get the momentary attribute of up to eight functions from the loco DB as a byte
+ * with the lowest function in bit 0. Functions with a fixed activation time are
+ * switched off by the system and are reported as switching functions.
+ *
+ * \param l		the live loco data
+ * \param first	the first function to report
+ * \param count	the number of functions to report
+ * \return		a bitmap of the momentary functions
+ */
+static uint8_t xpn_momentaryByte (const ldataT *l, int first, int count)
+{
+	uint8_t b;
+	int i;
+
+	if (!l) return 0;
+	for (i = 0, b = 0; i < count; i++) {
+		if (db_getLocoFunc(l->loco, first + i)->timing < 0) b |= 1 << i;
+	}
+	return b;
+}
+
+/**
+ * Store the momentary attributes of a function group in the loco DB.
+ * Timed functions are left untouched if they are reported as momentary.
+ *
+ * \param adr		the loco address
+ * \param first		the first function of the group
+ * \param count		the number of functions in this group
+ * \param bits		the attributes with the lowest function in bit 0 (1 = momentary)
+ */
+static void xpn_setMomentary (int adr, int first, int count, uint8_t bits)
+{
+	locoT *l;
+	int i, tim;
+
+	if ((l = db_getLoco(adr, true)) == NULL) return;
+	for (i = 0; i < count; i++) {
+		tim = db_getLocoFunc(l, first + i)->timing;
+		if ((bits & (1 << i)) && tim == 0) db_locoFuncTiming(l, first + i, -1);
+		else if (!(bits & (1 << i)) && tim < 0) db_locoFuncTiming(l, first + i, 0);
+	}
+}
+
+/**
+ * Convert F0 .. F4 to the XpressNet format 000 F0 F4 F3 F2 F1.
+ */
+static uint8_t xpn_group1 (uint8_t f0_f4)
+{
+	return ((f0_f4 >> 1) & 0x0F) | ((f0_f4 & 0x01) << 4);
+}
+
 static void xpn_locoinformation (struct xpn_node *node)
 {
 	uint8_t speed, id, funcA, funcB, ui8;
@@ -409,8 +481,8 @@ static void xpn_locoinformation (struct xpn_node *node)
 			}
 			if (l->speed & 0x80) speed |= 0x80;		// direction bit must be included in bit 7
 			id |= (node->flags & NODEFLG_LB);
-			funcA = (uint8_t)((l->funcs[0] >> 1) & 0x0F) | ((l->funcs[0] & 1) ? 0x10 : 0);	// function A	(F0, F4 .. F1)
-			funcB = (uint8_t)((l->funcs[0] >> 5) & 0xFF);									// function B	(F12 .. F5)
+			funcA = xpn_group1(xpn_funcByte(l, 0));		// function A	(F0, F4 .. F1)
+			funcB = xpn_funcByte(l, 5);					// function B	(F12 .. F5)
 			for(ui8 = 0; ui8 < MAX_NODES; ui8++) {
 				if(nodes[ui8].alive) {
 					if(node->adr != nodes[ui8].adr) {
@@ -449,7 +521,7 @@ static bool POM_Result (struct decoder_reply *msg, flexval priv)
 static int xpn_loco(struct xpn_node *node, struct blockbuf *msg)
 {
 	int loco, locoDT;
-	uint8_t speed, funcA, funcB;
+	uint8_t speed;
 	ldataT *l;
 
 	loco = ((msg->buf[2] << 8) | msg->buf[3]) & 0x3FFF;		// loco addresses in the range of 0 .. 16383
@@ -462,27 +534,31 @@ static int xpn_loco(struct xpn_node *node, struct blockbuf *msg)
 			xpn_locoinformation(node);
 			return 1;
 
-		case 0x07:// request function information switch / momentary (F0 - F12)
-			_xpn_sendmessage(XPN_ANSWER | node->adr, 0xE3, 0x50, 0x00, 0x00);
+		case CMD_FSTAT_F0_F12:	// request function information switch / momentary (F0 - F12)
+			l = loco_call(loco, true);
+			_xpn_sendmessage(XPN_ANSWER | node->adr, 0xE3, 0x50, xpn_group1(xpn_momentaryByte(l, 0, 5)), xpn_momentaryByte(l, 5, 8));
 			return 1;
 
-		case 0x08:// request function information switch / momentary (F13 - F28)
-			_xpn_sendmessage(XPN_ANSWER | node->adr, 0xE4, 0x51, 0x00, 0x00, 0x0F);
+		case CMD_FSTAT_F13_F28:	// request function information switch / momentary (F13 - F28)
+			l = loco_call(loco, true);
+			_xpn_sendmessage(XPN_ANSWER | node->adr, 0xE3, 0x51, xpn_momentaryByte(l, 13, 8), xpn_momentaryByte(l, 21, 8));
 			return 1;
 
-		case 0x09:	// request function information status (F13 - F28)
-//			funcA = (xcp->funcs >> 13) & 0xFF;	// function A	(F13 - F20)
-//			funcB = (xcp->funcs >> 21) & 0xFF;	// function B	(F21 - F28)
-			funcA = funcB = 0;
-			_xpn_sendmessage(XPN_ANSWER | node->adr, 0xE3, 0x52, (int) funcA, (int) funcB);
+		case CMD_FINFO_F13_F28:	// request function information status (F13 - F28)
+			l = loco_call(loco, true);
+			_xpn_sendmessage(XPN_ANSWER | node->adr, 0xE3, 0x52, xpn_funcByte(l, 13), xpn_funcByte(l, 21));
 			return 1;
 
-		case 0x0A:	// request function information status (F13 - F28)
-			_xpn_sendmessage(XPN_ANSWER | node->adr, 0xE6, 0x54, 0, 0, 0, 0, 0);	// F29 - F68 not supported at this time
+		case CMD_FSTAT_F29_F68:	// request function information switch / momentary (F29 - F68)
+			l = loco_call(loco, true);
+			_xpn_sendmessage(XPN_ANSWER | node->adr, 0xE6, 0x54, xpn_momentaryByte(l, 29, 8), xpn_momentaryByte(l, 37, 8),
+					xpn_momentaryByte(l, 45, 8), xpn_momentaryByte(l, 53, 8), xpn_momentaryByte(l, 61, 8));
 			return 1;
 
-		case 0x0B:	// request function information status (F29 - F68)
-			_xpn_sendmessage(XPN_ANSWER | node->adr, 0xE6, 0x53, 0, 0, 0, 0, 0);	// F29 - F68 not supported at this time
+		case CMD_FINFO_F29_F68:	// request function information status (F29 - F68)
+			l = loco_call(loco, true);
+			_xpn_sendmessage(XPN_ANSWER | node->adr, 0xE6, 0x53, xpn_funcByte(l, 29), xpn_funcByte(l, 37),
+					xpn_funcByte(l, 45), xpn_funcByte(l, 53), xpn_funcByte(l, 61));
 			return 1;
 
 		case CMD_SPEED27:// set speed and direction (27 speed, see coding scheme above)
@@ -495,9 +571,9 @@ static int xpn_loco(struct xpn_node *node, struct blockbuf *msg)
 				if (speed) speed -= 3;
 				speed = (msg->buf[4] & 0x80) | speed;
 			}
-			rq_setSpeed (loco, speed);
 			node->loco = loco;
-			node->flags &= ~NODEFLG_LB;
+			if (rq_setSpeed (loco, speed) < 0) node->flags |= NODEFLG_LB | NODEFLG_INFORM;	// the loco is controlled by another device
+			else node->flags &= ~NODEFLG_LB;
 			return 0;
 
 		case CMD_SPEED14:	// set speed and direction (14 speed)
@@ -512,40 +588,75 @@ static int xpn_loco(struct xpn_node *node, struct blockbuf *msg)
 				if (speed) speed--;
 				speed = (msg->buf[4] & 0x80) | speed;
 			}
-			rq_setSpeed (loco, speed);
 			node->loco = loco;
-			node->flags &= ~NODEFLG_LB;
+			if (rq_setSpeed (loco, speed) < 0) node->flags |= NODEFLG_LB | NODEFLG_INFORM;	// the loco is controlled by another device
+			else node->flags &= ~NODEFLG_LB;
 			return 0;
 
 		case CMD_FG1:	// set function group 1 (F0, F4 .. F1)
-			rq_setFuncMasked(loco, ((msg->buf[4] & 0x0F) << 1) | ((msg->buf[4] & 0x10) >> 4), FUNC_F0_F4);
 			node->loco = loco;
-			node->flags &= ~NODEFLG_LB;
+			if (rq_setFuncMasked(loco, ((msg->buf[4] & 0x0F) << 1) | ((msg->buf[4] & 0x10) >> 4), FUNC_F0_F4) < 0) node->flags |= NODEFLG_LB | NODEFLG_INFORM;	// the loco is controlled by another device
+			else node->flags &= ~NODEFLG_LB;
 			return 0;
 
 		case CMD_FG2:	// set function group 2 (F8 .. F5)
-			rq_setFuncMasked(loco, (msg->buf[4] & 0x0F) << 5, FUNC_F5_F8);
 			node->loco = loco;
-			node->flags &= ~NODEFLG_LB;
+			if (rq_setFuncMasked(loco, (msg->buf[4] & 0x0F) << 5, FUNC_F5_F8) < 0) node->flags |= NODEFLG_LB | NODEFLG_INFORM;	// the loco is controlled by another device
+			else node->flags &= ~NODEFLG_LB;
 			return 0;
 
 		case CMD_FG3:	// set function group 3 (F12 .. F9)
-			rq_setFuncMasked(loco, (msg->buf[4] & 0x0F) << 9, FUNC_F9_F12);
 			node->loco = loco;
-			node->flags &= ~NODEFLG_LB;
+			if (rq_setFuncMasked(loco, (msg->buf[4] & 0x0F) << 9, FUNC_F9_F12) < 0) node->flags |= NODEFLG_LB | NODEFLG_INFORM;	// the loco is controlled by another device
+			else node->flags &= ~NODEFLG_LB;
 			return 0;
 
 		case CMD_FG4:	// set function group 4 (F20 .. F13)
 		case CMD_FG4R:	// set function group 4 (F20 .. F13) -> ROCO MultiMaus
-			rq_setFuncMasked(loco, msg->buf[4] << 13, FUNC_F13_F20);
 			node->loco = loco;
-			node->flags &= ~NODEFLG_LB;
+			if (rq_setFuncMasked(loco, msg->buf[4] << 13, FUNC_F13_F20) < 0) node->flags |= NODEFLG_LB | NODEFLG_INFORM;	// the loco is controlled by another device
+			else node->flags &= ~NODEFLG_LB;
 			return 0;
 
 		case CMD_FG5:	// set function group 5 (F28 .. F21)
-			rq_setFuncMasked(loco, msg->buf[4] << 21, FUNC_F21_F28);
 			node->loco = loco;
-			node->flags &= ~NODEFLG_LB;
+			if (rq_setFuncMasked(loco, msg->buf[4] << 21, FUNC_F21_F28) < 0) node->flags |= NODEFLG_LB | NODEFLG_INFORM;	// the loco is controlled by another device
+			else node->flags &= ~NODEFLG_LB;
+			return 0;
+
+		case CMD_FG6:	// set function group 6 (F36 .. F29)
+		case CMD_FG7:	// set function group 7 (F44 .. F37)
+		case CMD_FG8:	// set function group 8 (F52 .. F45)
+			node->loco = loco;
+			if (rq_setFuncGroup(loco, 29 + (msg->buf[1] - CMD_FG6) * 8, 8, msg->buf[4]) < 0) node->flags |= NODEFLG_LB | NODEFLG_INFORM;	// the loco is controlled by another device
+			else node->flags &= ~NODEFLG_LB;
+			return 0;
+
+		case CMD_FG9:	// set function group 9 (F60 .. F53)
+		case CMD_FG10:	// set function group 10 (F68 .. F61)
+			node->loco = loco;
+			if (rq_setFuncGroup(loco, 53 + (msg->buf[1] - CMD_FG9) * 8, 8, msg->buf[4]) < 0) node->flags |= NODEFLG_LB | NODEFLG_INFORM;	// the loco is controlled by another device
+			else node->flags &= ~NODEFLG_LB;
+			return 0;
+
+		case CMD_FS1:	// switch / momentary attributes of function group 1 (F0, F4 .. F1)
+			xpn_setMomentary(loco, 0, 5, ((msg->buf[4] & 0x0F) << 1) | ((msg->buf[4] & 0x10) >> 4));
+			return 0;
+
+		case CMD_FS2:	// switch / momentary attributes of function group 2 (F8 .. F5)
+			xpn_setMomentary(loco, 5, 4, msg->buf[4]);
+			return 0;
+
+		case CMD_FS3:	// switch / momentary attributes of function group 3 (F12 .. F9)
+			xpn_setMomentary(loco, 9, 4, msg->buf[4]);
+			return 0;
+
+		case CMD_FS4:	// switch / momentary attributes of function group 4 (F20 .. F13)
+			xpn_setMomentary(loco, 13, 8, msg->buf[4]);
+			return 0;
+
+		case CMD_FS5:	// switch / momentary attributes of function group 5 (F28 .. F21)
+			xpn_setMomentary(loco, 21, 8, msg->buf[4]);
 			return 0;
 
 		case CMD_BUILD_DT:	// build or dissolve a consist of two locos
@@ -610,6 +721,7 @@ static int xpn_interpret (struct xpn_node *node, struct blockbuf *msg)
 		xn_controlEvent (node, 1);
 	}
 	node->alive = XPN_ALIVE;
+	loco_setClient(OWN_TOKEN(OWN_XPRESSNET, node->adr));
 
 	switch (msg->buf[0] >> 4) {
 		case 0x02:	// system requests
@@ -681,12 +793,24 @@ static int xpn_nextNode (int curr_node)
 
 static bool xpn_eventhandler (eventT *e, void *priv)
 {
+	struct own_change *oc;
 	ldataT *l;
 	int i;
 	theTime = (struct modeltime *)e->src;
 
 	(void) priv;
 
+	if (e->ev == EVENT_LOCO_OWNER) {		// may be caused by another node on our own bus
+		oc = (struct own_change *) e->src;
+		if (!oc->taken || OWN_IFC(oc->from) != OWN_XPRESSNET) return true;
+		for (i = 0; i < MAX_NODES; i++) {
+			if ((nodes[i].flags & NODEFLG_ACTIVE) && nodes[i].adr == OWN_CLIENT(oc->from) && nodes[i].loco == oc->adr) {
+				nodes[i].flags |= NODEFLG_LB | NODEFLG_INFORM;
+			}
+		}
+		return true;
+	}
+
 //	printf ("%s() %s\n", __func__, (e->tid == xpn_task) ? "OWN EVENT" : "REMOTE EVENT");
 	if (e->tid == xpn_task) return true;				// this is an event we triggered ourself, so don't report back!
 	if ((l = (ldataT *) e->src) == NULL) return true;	// no loco given as source ... ignore this event
@@ -694,6 +818,7 @@ static bool xpn_eventhandler (eventT *e, void *priv)
 	if(e->ev == EVENT_MODELTIME) {
 //		printf ("%s(): Modeltime: day: %d, hour: %d, Minute: %d\n", __func__, theTime->mday, theTime-> hour, theTime-> min);
 		bTimeUpdate = true;
+		return true;		// the source is not a loco - don't look for nodes to inform
 	}
 	for (i = 0; i < MAX_NODES; i++) {
 		if ((nodes[i].flags & NODEFLG_ACTIVE) && (nodes[i].loco == l->loco->adr)) {
@@ -732,6 +857,7 @@ void vXpressNet (void *pvParameter)
 	xpn_task = xTaskGetCurrentTaskHandle();
 	event_register(EVENT_LOCO_FUNCTION, xpn_eventhandler, NULL, 0);
 	event_register(EVENT_LOCO_SPEED, xpn_eventhandler, NULL, 0);
+	event_register(EVENT_LOCO_OWNER, xpn_eventhandler, NULL, 0);
 	event_register(EVENT_MODELTIME, xpn_eventhandler, NULL, 0);
 	mt_report();
 
@@ -812,6 +938,7 @@ void vXpressNet (void *pvParameter)
 			if(!--nodes[nodeidx].alive) {
 				fprintf (stderr, "node: %d lost\n", nodeidx);
 				nodes[nodeidx].flags = 0;
+				loco_releaseAll(OWN_TOKEN(OWN_XPRESSNET, nodeidx));
 				xn_controlEvent(&nodes[nodeidx], 0);
 			}
 		}
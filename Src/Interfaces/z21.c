@@ -30,6 +30,7 @@
 #include "decoder.h"
 #include "events.h"
 #include "config.h"
+#include "bidib.h"
 
 #define XBUS_COMMANDS					0x0040
 
@@ -140,8 +141,11 @@ struct client {
 	int					 lidx;			///< the index at which new loco subscriptions are stored (wrap around!)
 	uint16_t			 loco[MAX_SUBSCRIBED_LOCOS];	///< the currently controlled loco
 	uint8_t				 speed[MAX_SUBSCRIBED_LOCOS];	///< the last commanded speed (for some quirks in MM2-27B format)
+	uint8_t				 id;			///< the number of this client as owner of locos (1 .. 255)
 };
 
+#define Z21_OWNER(z)	OWN_TOKEN(OWN_Z21, (z)->id)		///< the identity of a client in the loco ownership
+
 static int sock;
 
 static uint16_t oldFeedback[FEEDBACK_MODULES]; ///< 192 feedback modules
@@ -251,6 +255,7 @@ static void z21_purgeRun (void)
 				inet_ntoa_r(z->saddr.sin_addr.s_addr, ipaddr, sizeof(ipaddr));
 				log_msg (LOG_DEBUG, "%s() Purging client @%s:%d\n", __func__, ipaddr, ntohs(z->saddr.sin_port));
 				*zpp = z->next;
+				loco_releaseAll(Z21_OWNER(z));
 				free (z);
 			} else {
 				zpp = &z->next;
@@ -270,12 +275,30 @@ static void z21_purgeClient (z21clntT *z)
 		while (*zpp != NULL && *zpp != z) zpp = &(*zpp)->next;
 		if (*zpp == z) {
 			*zpp = z->next;
+			loco_releaseAll(Z21_OWNER(z));
 			free (z);
 		}
 		mutex_unlock(&mutex);
 	}
 }
 
+/**
+ * Find an unused client number. This function must be called with the mutex held.
+ *
+ * \return				a number that no other client is using
+ */
+static uint8_t z21_newId (void)
+{
+	static uint8_t id;
+	z21clntT *z;
+
+	do {
+		if (++id == 0) id = 1;
+		for (z = clients; z && z->id != id; z = z->next) ;
+	} while (z);
+	return id;
+}
+
 /**
  * Look up a client that matched the given IP address or create a new entry for the
  * list. Can only fail, if memory allocation fails.
@@ -306,6 +329,7 @@ static z21clntT *z21_lookupClient (struct sockaddr_in *saddr, int size)
 		z->tout = tim_timeout(PURGE_TIMEOUT);
 		z->size = size;
 		memcpy (&z->saddr, saddr, sizeof(z->saddr));
+		z->id = z21_newId();
 		z->next = clients;
 		inet_ntoa_r(z->saddr.sin_addr.s_addr, ipaddr, sizeof(ipaddr));
 		log_msg (LOG_DEBUG, "%s() new client @%s:%d\n", __func__, ipaddr, ntohs(z->saddr.sin_port));
@@ -494,6 +518,7 @@ static void z21_lanXLocoInfo (z21clntT *z, ldataT *l)
 		default:
 			return;
 	}
+	if (l->own.owner != OWN_ANONYMOUS && l->own.owner != Z21_OWNER(z)) xpkt[3] |= 0x08;	// busy: the loco is controlled by another client
 	*p++ = (fwd) ? 0x80 | speed : speed;
 //	log_msg (LOG_INFO, "%s() Adr %d FMT %d/%d Speed = 0x%02x (%d %s)\n", __func__, l->loco->adr, xpkt[3],
 //		l->loco->fmt, xpkt[4], l->speed & 0x7F, (l->speed & 0x80 ? "FWD" : "REV"));
@@ -643,6 +668,91 @@ static void z21_evt_FBNew (z21clntT *z, void *priv)
 	}
 }
 
+/**
+ * Send the RailCom data of an address (LAN_RAILCOM_DATACHANGED).
+ * BiDiB detectors only report the number of received messages, so the error
+ * counter is always zero. Speeds beyond 255km/h are reported as speed 2.
+ *
+ * \param z			the client to send the data to
+ * \param rc		the RailCom data of the address
+ */
+static void z21_railcomData (z21clntT *z, struct occ_rcdata *rc)
+{
+	uint8_t *pkt, *p;
+	uint8_t options;
+
+	options = 0;
+	if (rc->valid & OCC_RCVALID_SPEED) options |= (rc->speed > 255) ? 0x02 : 0x01;		// rcoSpeed1 / rcoSpeed2
+	if (rc->valid & OCC_RCVALID_QOS) options |= 0x04;									// rcoQoS
+
+	p = pkt = z21_getPacket(13);
+	*p++ = rc->adr & 0xFF;
+	*p++ = (rc->adr >> 8) & 0xFF;
+	*p++ = (rc->rxcount >>  0) & 0xFF;
+	*p++ = (rc->rxcount >>  8) & 0xFF;
+	*p++ = (rc->rxcount >> 16) & 0xFF;
+	*p++ = (rc->rxcount >> 24) & 0xFF;
+	*p++ = 0;			// error counter
+	*p++ = 0;
+	*p++ = 0;			// reserved
+	*p++ = options;
+	*p++ = (rc->speed > 255) ? rc->speed - 256 : rc->speed;
+	*p++ = rc->qos;
+	*p++ = 0;			// reserved
+	z21_sendPacket(z, LAN_RAILCOM_DATACHANGED, pkt, p - pkt);
+}
+
+/**
+ * Report a loco address entering or leaving a block (LAN_LOCONET_DETECTOR
+ * with type 0x02 / 0x03 as for transponding detectors).
+ */
+static void z21_transponder (z21clntT *z, uint8_t type, int fbidx, uint16_t adr)
+{
+	uint8_t *pkt, *p;
+
+	p = pkt = z21_getPacket(5);
+	*p++ = type;
+	*p++ = fbidx & 0xFF;
+	*p++ = (fbidx >> 8) & 0xFF;
+	*p++ = adr & 0xFF;
+	*p++ = (adr >> 8) & 0xFF;
+	z21_sendPacket(z, LAN_LOCONET_DETECTOR, pkt, p - pkt);
+}
+
+/**
+ * Iteration function for changes reported by BiDiB detectors. The occupied
+ * state itself is already reported via the feedback system, so only the
+ * addresses are handled here.
+ *
+ * \param z			the client from the iteration
+ * \param priv		the event (param tells the type of the src member)
+ */
+static void z21_evtBlock (z21clntT *z, void *priv)
+{
+	eventT *e;
+	struct occ_change *chg;
+	struct occ_rcdata *rc;
+	int i;
+
+	e = (eventT *) priv;
+	if (e->param == BDBBM_EVT_BLOCK) {
+		chg = (struct occ_change *) e->src;
+		if (!(z->subscriptions & BCFLG_LOCONET_OCCUPY) || chg->blk.fbidx < 0) return;
+		for (i = 0; i < chg->nleft; i++) {
+			if (!chg->left[i].accessory) z21_transponder(z, 0x03, chg->blk.fbidx, chg->left[i].adr);
+		}
+		for (i = 0; i < chg->nentered; i++) {
+			if (!chg->entered[i].accessory) z21_transponder(z, 0x02, chg->blk.fbidx, chg->entered[i].adr);
+		}
+	} else {
+		rc = (struct occ_rcdata *) e->src;
+		if (   (z->subscriptions & BCFLG_ALL_RAILCOM)
+			|| ((z->subscriptions & BCFLG_RAILCOMCHANGE) && z21_checkLocoSubscription(z, rc->adr))) {
+			z21_railcomData(z, rc);
+		}
+	}
+}
+
 static void z21_trackMode (z21clntT *z, void *priv)
 {
 	eventT *e;
@@ -670,6 +780,8 @@ static void z21_trackMode (z21clntT *z, void *priv)
 
 static bool z21_eventhandler (eventT *e, void *priv)
 {
+	ldataT *l;
+
 	(void) priv;
 
 	// ATTENTION: as we rely on some broadcast messages informing clients of the result of their own
@@ -685,6 +797,9 @@ static bool z21_eventhandler (eventT *e, void *priv)
 		case EVENT_LOCO_FUNCTION:
 			z21_iterate(z21_evtSpeedFunc, e->src);
 			break;
+		case EVENT_LOCO_OWNER:		// the busy flag of the loco changed
+			if ((l = loco_call(((struct own_change *) e->src)->adr, false)) != NULL) z21_iterate(z21_evtSpeedFunc, l);
+			break;
 		case EVENT_TURNOUT:
 			z21_iterate(z21_evtTurnout, e->src);
 			break;
@@ -694,6 +809,9 @@ static bool z21_eventhandler (eventT *e, void *priv)
 		case EVENT_FBNEW:
 			z21_iterate(z21_evt_FBNew, e->src);
 			break;
+		case EVENT_BLOCKOCC:
+			z21_iterate(z21_evtBlock, e);
+			break;
 		default:
 			break;
 	}
@@ -861,8 +979,8 @@ static void z21_xSetLocoDrive (z21clntT *z, uint16_t xcmd, uint8_t *packet)
 	int loco, i;
 	enum fmt fmt;
 	bool fwd, estop;
+	int rc;
 
-	(void) z;
 	(void) xcmd;
 
 	db0 = packet[5];
@@ -925,14 +1043,15 @@ static void z21_xSetLocoDrive (z21clntT *z, uint16_t xcmd, uint8_t *packet)
 	}
 	if (fmt != l->loco->fmt) db_setLocoFmt (loco, fmt);
 	if (estop) {
-		rq_emergencyStop(loco);
+		rc = rq_emergencyStop(loco);
 	} else {
 		if (fwd != !!(l->speed & 0x80)) {		// the direction changed - change direction and set speed to zero
-			rq_setSpeed(loco, (fwd) ? 0x80 : 0x00);
+			rc = rq_setSpeed(loco, (fwd) ? 0x80 : 0x00);
 		} else {
-			rq_setSpeed(loco, (fwd) ? speed | 0x80 : speed);
+			rc = rq_setSpeed(loco, (fwd) ? speed | 0x80 : speed);
 		}
 	}
+	if (rc < 0) z21_lanXLocoInfo(z, l);		// rejected (i.e. the loco is controlled by another client) - restore the client's view
 	/* no answer - event reporting only! */
 }
 
@@ -942,7 +1061,6 @@ static void z21_xSetLocoFunction (z21clntT *z, uint16_t xcmd, uint8_t *packet)
 	int loco;
 	uint32_t mask, nfunc;
 
-	(void) z;
 	(void) xcmd;
 
 	loco = ((packet[6] << 8) + packet[7]) & 0x3FFF;
@@ -956,7 +1074,7 @@ static void z21_xSetLocoFunction (z21clntT *z, uint16_t xcmd, uint8_t *packet)
 		case 0x80: nfunc = l->funcs[0] ^ mask; break;
 		default: return;		// illegal request not handled
 	}
-	rq_setFuncMasked(loco, nfunc, mask);
+	if (rq_setFuncMasked(loco, nfunc, mask) < 0) z21_lanXLocoInfo(z, l);	// rejected - restore the client's view
 	/* no answer - event reporting only! */
 }
 
@@ -1468,6 +1586,46 @@ static void z21_notImplemented (z21clntT *z, uint16_t cmd, uint8_t *packet, uint
 	log_msg (LOG_INFO, "%s() CMD 0x%04x (len %d) not implemented\n", __func__, cmd, pktlen);
 }
 
+static void z21_railcomGetdata (z21clntT *z, uint16_t cmd, uint8_t *packet, uint16_t pktlen)
+{
+	struct occ_rcdata rc;
+
+	(void) cmd;
+
+	if (pktlen < 7 || packet[4] != 0x01) return;		// only type 0x01 (poll a loco address) is supported
+	if (BDBbm_getRailcom(packet[5] | (packet[6] << 8), &rc)) z21_railcomData(z, &rc);
+}
+
+/**
+ * Poll the state of a detector (type 0x80). Only blocks of BiDiB detectors
+ * can be answered, as we need to know the addresses in that block.
+ */
+static void z21_loconetDetector (z21clntT *z, uint16_t cmd, uint8_t *packet, uint16_t pktlen)
+{
+	struct occ_block blk;
+	uint8_t *pkt, *p;
+	int fbidx, i;
+
+	if (pktlen < 7 || packet[4] != 0x80) {
+		z21_notImplemented(z, cmd, packet, pktlen);
+		return;
+	}
+	fbidx = packet[5] | (packet[6] << 8);
+	if (!BDBbm_getFeedback(fbidx, &blk)) {
+		z21_notImplemented(z, cmd, packet, pktlen);
+		return;
+	}
+	p = pkt = z21_getPacket(4);
+	*p++ = 0x01;
+	*p++ = fbidx & 0xFF;
+	*p++ = (fbidx >> 8) & 0xFF;
+	*p++ = blk.occupied;
+	z21_sendPacket(z, LAN_LOCONET_DETECTOR, pkt, p - pkt);
+	for (i = 0; i < blk.nlocos; i++) {
+		if (!blk.loco[i].accessory) z21_transponder(z, 0x02, fbidx, blk.loco[i].adr);
+	}
+}
+
 static const struct z21decoder {
 	uint16_t		cmd;
 	void (*func) (z21clntT *, uint16_t cmd, uint8_t *, uint16_t);
@@ -1488,10 +1646,10 @@ static const struct z21decoder {
 	{ LAN_RMBUS_GETDATA,				z21_rmbusGetdata },
 	{ LAN_RMBUS_PROGRAMMODULE,			z21_notImplemented },
 	{ LAN_SYSTEMSTATE_GETDATA,			z21_systemStateGetData },
-	{ LAN_RAILCOM_GETDATA,				z21_dummy },
+	{ LAN_RAILCOM_GETDATA,				z21_railcomGetdata },
 	{ LAN_LOCONET_FROM_LAN,				z21_dummy },
 	{ LAN_LOCONET_DISPATCH_ADDR,		z21_loconetDispatch },
-	{ LAN_LOCONET_DETECTOR,				z21_notImplemented },
+	{ LAN_LOCONET_DETECTOR,				z21_loconetDetector },
 	{ LAN_CAN_DETECTOR,					z21_notImplemented },
 	{ LAN_CAN_DEVICE_GET_DESCRIPTION,	z21_notImplemented },
 	{ LAN_CAN_DEVICE_SET_DESCRIPTION,	z21_notImplemented },
@@ -1512,6 +1670,7 @@ void z21_request (z21clntT *z, uint16_t cmd, uint8_t *packet, uint16_t pktlen)
 {
 	const struct z21decoder *zd;
 
+	loco_setClient(Z21_OWNER(z));
 	zd = z21cmds;
 	while (zd->func != NULL) {
 		if (zd->cmd == cmd) {
@@ -1611,9 +1770,11 @@ void z21_service (void *pvParameter)
 	event_register(EVENT_SYS_STATUS, z21_eventhandler, NULL, 0);
 	event_register(EVENT_LOCO_SPEED, z21_eventhandler, NULL, 0);
 	event_register(EVENT_LOCO_FUNCTION, z21_eventhandler, NULL, 0);
+	event_register(EVENT_LOCO_OWNER, z21_eventhandler, NULL, 0);
 	event_register(EVENT_TURNOUT, z21_eventhandler, NULL, 0);
 	event_register(EVENT_FEEDBACK, z21_eventhandler, NULL, 0);
 	event_register(EVENT_FBNEW, z21_eventhandler, NULL, 0);
+	event_register(EVENT_BLOCKOCC, z21_eventhandler, NULL, 0);
 	memset (oldFeedback, 0, sizeof(oldFeedback));
 
 	for (;;) {
@@ -0,0 +1,441 @@
+/*
+ * backup.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Backup and restore of the complete state of the station
+ *
+ * A backup contains all areas known to archive.c (the configuration
+ * directory and the user images). Before the files are read, pending changes
+ * of the configuration and of the loco database are written to the file
+ * system (cnf_flushStore(), db_flushStore()), so the backup reflects the
+ * current state. The ini files are always replaced as a whole (see
+ * ini_writeFile()) and each file is read twice from the same open handle
+ * (once for the checksum and once for sending), so the contents of a file
+ * are consistent even if it is stored again while the backup is running.
+ * The operation of the station is never stopped.
+ *
+ * A restore first unpacks the archive to BAK_STAGE while it is received.
+ * Nothing of the running configuration is touched until the archive is
+ * complete and all checksums are verified. Then each area is moved to
+ * BAK_OLD and replaced by the staged version. The journal file BAK_JOURNAL
+ * marks the time while the areas are exchanged. If anything fails, or if the
+ * station is switched off during this phase, the old areas are moved back
+ * (at the next startup in the latter case, see bak_recover()). After a
+ * successful restore the station must be restarted to read the restored
+ * configuration. The replaced areas stay in BAK_OLD until the next restore.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "rb2.h"
+#include "config.h"
+#include "decoder.h"
+#include "yaffsfs.h"
+#include "backup.h"
+
+#define BAK_STAGE			"/restore"				///< the archive is unpacked to this directory before it is applied
+#define BAK_OLD				"/restore.old"			///< the areas that were replaced by the last restore
+#define BAK_JOURNAL			BAK_OLD "/applying"		///< exists while the areas are exchanged
+#define BAK_BUFSIZE			2048					///< the buffer size for reading files
+
+struct bak_writer {
+	int				sock;							///< the socket to send the archive to
+	uint32_t		ino;							///< the number of members sent so far
+	uint8_t			*buf;							///< a buffer for reading files
+	char			path[ARC_NAMELEN + 1];			///< the path of the current member (member name with a leading slash)
+	char			manifest[ARC_MANIFEST_MAX];		///< the contents of the manifest
+};
+
+struct bak_restore {
+	struct arc_reader	rd;							///< the reader of the archive
+	enum arc_error		err;						///< the first error that occurred
+	int					fd;							///< the file currently written to the staging directory
+	char				fname[sizeof(BAK_STAGE) + ARC_NAMELEN];	///< the name of this file
+};
+
+static int bak_sendMember (struct bak_writer *w, const char *name, uint32_t mode, uint32_t size, uint32_t mtime, uint32_t check)
+{
+	int len;
+
+	if ((len = arc_header((char *) w->buf, BAK_BUFSIZE, ++w->ino, name, mode, size, mtime, check)) <= 0) return -1;
+	return (socket_senddata(w->sock, w->buf, len) == len) ? 0 : -1;
+}
+
+static int bak_sendPadding (struct bak_writer *w, uint32_t size)
+{
+	static const uint8_t zeros[4];
+	int len;
+
+	len = arc_padding(size);
+	if (len == 0) return 0;
+	return (socket_senddata(w->sock, zeros, len) == len) ? 0 : -1;
+}
+
+/**
+ * Send the file w->path. The checksum must be known before the header is sent,
+ * so the file is read twice.
+ *
+ * \param w			the state of the backup
+ * \return			0 if the file was sent or skipped, -1 if the connection is broken
+ */
+static int bak_sendFile (struct bak_writer *w)
+{
+	struct yaffs_stat st;
+	uint32_t sum, size, n;
+	int fd, len;
+
+	if ((fd = yaffs_open(w->path, O_RDONLY, 0)) < 0) {
+		log_msg (LOG_WARNING, "%s(): '%s' vanished - skipped\n", __func__, w->path);
+		return 0;
+	}
+	if (yaffs_fstat(fd, &st) != 0) {
+		yaffs_close(fd);
+		return 0;
+	}
+
+	size = st.st_size;
+	sum = 0;
+	for (n = 0; n < size; n += len) {
+		if ((len = yaffs_read(fd, w->buf, (size - n > BAK_BUFSIZE) ? BAK_BUFSIZE : size - n)) <= 0) break;
+		sum = arc_checksum(sum, w->buf, len);
+	}
+	if (n != size || yaffs_lseek(fd, 0, SEEK_SET) != 0) {
+		log_error ("%s(): cannot read '%s'\n", __func__, w->path);
+		yaffs_close(fd);
+		return 0;
+	}
+
+	if (bak_sendMember(w, w->path + 1, ARC_IFREG | (st.st_mode & 07777), size, st.yst_mtime, sum) != 0) {
+		yaffs_close(fd);
+		return -1;
+	}
+	for (n = 0; n < size; n += len) {
+		if ((len = yaffs_read(fd, w->buf, (size - n > BAK_BUFSIZE) ? BAK_BUFSIZE : size - n)) <= 0) break;
+		if (socket_senddata(w->sock, w->buf, len) != len) break;
+	}
+	yaffs_close(fd);
+	if (n != size) return -1;		// the archive is broken now - the receiver will detect it as truncated
+	return bak_sendPadding(w, size);
+}
+
+/**
+ * Send the directory w->path and everything below it. Symbolic links are
+ * not saved and neither are the temporary files of ini_writeFile().
+ *
+ * \param w			the state of the backup
+ * \return			0 if the directory was sent, -1 if the connection is broken
+ */
+static int bak_sendTree (struct bak_writer *w)
+{
+	yaffs_DIR *dir;
+	struct yaffs_dirent *dentry;
+	struct yaffs_stat st;
+	int len, rc;
+
+	if (yaffs_lstat(w->path, &st) != 0) return 0;			// does not exist - nothing to save
+	if (bak_sendMember(w, w->path + 1, ARC_IFDIR | (st.st_mode & 07777), 0, st.yst_mtime, 0) != 0) return -1;
+	if ((dir = yaffs_opendir(w->path)) == NULL) return 0;
+
+	len = strlen(w->path);
+	rc = 0;
+	while (rc == 0 && (dentry = yaffs_readdir(dir)) != NULL) {
+		if (len + 1 + strlen(dentry->d_name) >= sizeof(w->path) - 1) {
+			log_error ("%s(): name too long '%s/%s' - skipped\n", __func__, w->path, dentry->d_name);
+			continue;
+		}
+		sprintf (w->path + len, "/%s", dentry->d_name);
+		if (yaffs_lstat(w->path, &st) != 0) continue;
+		switch (st.st_mode & S_IFMT) {
+			case S_IFDIR:
+				rc = bak_sendTree(w);
+				break;
+			case S_IFREG:
+				if (strlen(dentry->d_name) > 4 && !strcmp(w->path + strlen(w->path) - 4, ".tmp")) break;
+				rc = bak_sendFile(w);
+				break;
+		}
+		w->path[len] = 0;
+	}
+	yaffs_closedir(dir);
+	return rc;
+}
+
+/**
+ * Send a backup of all areas to the given socket. The HTTP headers must
+ * already be sent by the caller.
+ *
+ * \param sock		the socket to send the archive to
+ * \return			0 if the archive was sent completely, -1 on error
+ */
+int bak_backup (int sock)
+{
+	struct bak_writer *w;
+	struct arc_info info;
+	int i, len, rc;
+
+	cnf_flushStore();
+	db_flushStore();
+
+	if ((w = malloc(sizeof(*w))) == NULL) return -1;
+	if ((w->buf = malloc(BAK_BUFSIZE)) == NULL) {
+		free (w);
+		return -1;
+	}
+	w->sock = sock;
+	w->ino = 0;
+
+	memset (&info, 0, sizeof(info));
+	info.version = ARC_VERSION;
+	info.serial = hwinfo->serial;
+	snprintf (info.firmware, sizeof(info.firmware), "%s", SOFT_VERSION);
+	for (i = 0; arc_area(i); i++) info.areas |= 1 << i;
+
+	len = arc_manifest(w->manifest, sizeof(w->manifest), &info);
+	rc = bak_sendMember(w, ARC_MANIFEST, ARC_IFREG | 0644, len, 0, arc_checksum(0, (uint8_t *) w->manifest, len));
+	if (rc == 0 && socket_senddata(sock, w->manifest, len) != len) rc = -1;
+	if (rc == 0) rc = bak_sendPadding(w, len);
+
+	for (i = 0; rc == 0 && arc_area(i); i++) {
+		snprintf (w->path, sizeof(w->path), "/%s", arc_area(i));
+		rc = bak_sendTree(w);
+	}
+	if (rc == 0) rc = bak_sendMember(w, ARC_TRAILER, 0, 0, 0, 0);
+
+	if (rc == 0) log_msg (LOG_INFO, "%s(): %lu entries sent\n", __func__, w->ino);
+	else log_error ("%s(): backup aborted\n", __func__);
+	free (w->buf);
+	free (w);
+	return rc;
+}
+
+static int bak_begin (void *priv, const char *name, uint32_t mode, uint32_t size)
+{
+	struct bak_restore *rs = priv;
+
+	(void) size;
+
+	snprintf (rs->fname, sizeof(rs->fname), BAK_STAGE "/%s", name);
+	if ((mode & ARC_IFMT) == ARC_IFDIR) {
+		if (yaffs_access(rs->fname, 0) == 0) return 0;
+		ensure_path(rs->fname);
+		return yaffs_mkdir(rs->fname, S_IREAD | S_IWRITE | S_IEXEC);
+	}
+
+	ensure_path(rs->fname);
+	if ((rs->fd = yaffs_open(rs->fname, O_CREAT | O_TRUNC | O_RDWR, S_IREAD | S_IWRITE)) < 0) {
+		log_error ("%s(): cannot create '%s'\n", __func__, rs->fname);
+		return -1;
+	}
+	return 0;
+}
+
+static int bak_data (void *priv, const uint8_t *buf, int len)
+{
+	struct bak_restore *rs = priv;
+	int rc;
+
+	while (len > 0) {
+		if ((rc = yaffs_write(rs->fd, buf, len)) <= 0) {
+			log_error ("%s(): cannot write '%s'\n", __func__, rs->fname);
+			return -1;
+		}
+		buf += rc;
+		len -= rc;
+	}
+	return 0;
+}
+
+static int bak_end (void *priv)
+{
+	struct bak_restore *rs = priv;
+	int rc;
+
+	if (rs->fd < 0) return 0;
+	rc = yaffs_close(rs->fd);
+	rs->fd = -1;
+	return rc;
+}
+
+static const struct arc_handler stage_handler = {
+	.begin = bak_begin,
+	.data = bak_data,
+	.end = bak_end,
+};
+
+/**
+ * Prepare a restore. Remains of an earlier, failed restore are removed.
+ *
+ * \return			the state of the restore or NULL if the staging directory cannot be created
+ */
+struct bak_restore *bak_restoreStart (void)
+{
+	struct bak_restore *rs;
+
+	if (webup_removeDirectory(BAK_STAGE) != 0 || yaffs_mkdir(BAK_STAGE, S_IREAD | S_IWRITE | S_IEXEC) != 0) {
+		log_error ("%s(): cannot create %s\n", __func__, BAK_STAGE);
+		return NULL;
+	}
+	if ((rs = malloc(sizeof(*rs))) == NULL) return NULL;
+	arc_readerInit(&rs->rd, &stage_handler, rs);
+	rs->err = ARC_OK;
+	rs->fd = -1;
+	return rs;
+}
+
+/**
+ * Receive the next part of the archive. The signature matches the storage
+ * functions of the file upload in cgi.c.
+ *
+ * \param arg		the state of the restore (see bak_restoreStart())
+ * \param buf		the next part of the archive (NULL at the end of the transmission)
+ * \param len		the number of bytes in the buffer
+ * \return			0 if everything is OK so far, -1 if the archive was rejected
+ */
+int bak_restoreData (void *arg, uint8_t *buf, int len)
+{
+	struct bak_restore *rs = arg;
+
+	if (!rs) return -1;
+	if (!buf || rs->err != ARC_OK) return (rs->err == ARC_OK) ? 0 : -1;
+	rs->err = arc_feed(&rs->rd, buf, len);
+	return (rs->err == ARC_OK) ? 0 : -1;
+}
+
+static bool bak_move (const char *from, const char *to)
+{
+	if (yaffs_rename(from, to) == 0) return true;
+	log_error ("%s(): cannot rename '%s' to '%s'\n", __func__, from, to);
+	return false;
+}
+
+/**
+ * Move the replaced areas back from BAK_OLD. An area that was not yet moved
+ * away is left untouched, a new version that was already moved in is dropped.
+ *
+ * \param mask		a bitmask of the areas of the restore
+ */
+static void bak_rollback (uint32_t mask)
+{
+	char live[ARC_NAMELEN], old[ARC_NAMELEN];
+	int i;
+
+	for (i = 0; arc_area(i); i++) {
+		if (!(mask & (1 << i))) continue;
+		snprintf (live, sizeof(live), "/%s", arc_area(i));
+		snprintf (old, sizeof(old), BAK_OLD "/%s", arc_area(i));
+		if (yaffs_access(old, 0) != 0) continue;
+		if (yaffs_access(live, 0) == 0) webup_removeDirectory(live);
+		bak_move(old, live);
+	}
+	yaffs_unlink(BAK_JOURNAL);
+	yaffs_sync("/");
+	log_msg (LOG_WARNING, "%s(): previous state restored\n", __func__);
+}
+
+/**
+ * Exchange the areas of the running system with the staged ones.
+ *
+ * \param mask		a bitmask of the areas contained in the archive
+ * \return			true if all areas were replaced, false if the old state was restored
+ */
+static bool bak_apply (uint32_t mask)
+{
+	char live[ARC_NAMELEN], old[ARC_NAMELEN], stage[ARC_NAMELEN];
+	int i, fd;
+
+	if (webup_removeDirectory(BAK_OLD) != 0 || yaffs_mkdir(BAK_OLD, S_IREAD | S_IWRITE | S_IEXEC) != 0) return false;
+	if ((fd = yaffs_open(BAK_JOURNAL, O_CREAT | O_TRUNC | O_RDWR, S_IREAD | S_IWRITE)) < 0) return false;
+	yaffs_close(fd);
+	yaffs_sync("/");
+
+	for (i = 0; arc_area(i); i++) {
+		if (!(mask & (1 << i))) continue;
+		snprintf (live, sizeof(live), "/%s", arc_area(i));
+		snprintf (old, sizeof(old), BAK_OLD "/%s", arc_area(i));
+		snprintf (stage, sizeof(stage), BAK_STAGE "/%s", arc_area(i));
+		if (yaffs_access(stage, 0) != 0 && yaffs_mkdir(stage, S_IREAD | S_IWRITE | S_IEXEC) != 0) break;		// an empty area
+		if (yaffs_access(live, 0) != 0 && yaffs_mkdir(live, S_IREAD | S_IWRITE | S_IEXEC) != 0) break;		// so there is always something to roll back
+		if (!bak_move(live, old) || !bak_move(stage, live)) break;
+	}
+	if (arc_area(i)) {
+		bak_rollback(mask);
+		return false;
+	}
+
+	yaffs_unlink(BAK_JOURNAL);
+	yaffs_sync("/");
+	return true;
+}
+
+/**
+ * Finish a restore after the archive was received. If the archive is complete
+ * and valid, the staged areas replace the running ones. The staging directory
+ * is removed in any case and the state of the restore is freed.
+ *
+ * \param rs		the state of the restore (see bak_restoreStart())
+ * \return			ARC_OK if the archive was applied and the station should be restarted, an error otherwise
+ */
+enum arc_error bak_restoreFinish (struct bak_restore *rs)
+{
+	enum arc_error err;
+
+	if (!rs) return ARC_EWRITE;
+
+	if (rs->fd >= 0) yaffs_close(rs->fd);
+	err = (rs->err != ARC_OK) ? rs->err : arc_finish(&rs->rd);
+	if (err == ARC_OK) {
+		log_msg (LOG_INFO, "%s(): applying backup version %d of station %lu (firmware %s)\n", __func__,
+				rs->rd.info.version, rs->rd.info.serial, rs->rd.info.firmware);
+		cnf_flushStore();				// no pending store may overwrite the restored files
+		db_flushStore();
+		if (!bak_apply(rs->rd.info.areas)) err = ARC_EWRITE;
+	} else {
+		log_error ("%s(): %s\n", __func__, arc_strerror(err));
+	}
+
+	webup_removeDirectory(BAK_STAGE);
+	free (rs);
+	return err;
+}
+
+/**
+ * Check for an interrupted restore at startup and roll it back. This must
+ * be called after mounting the file system and before any configuration
+ * is read.
+ */
+void bak_recover (void)
+{
+	uint32_t mask;
+	int i;
+
+	if (yaffs_access(BAK_JOURNAL, 0) == 0) {
+		log_msg (LOG_WARNING, "%s(): restore was interrupted\n", __func__);
+		for (i = 0, mask = 0; arc_area(i); i++) mask |= 1 << i;
+		bak_rollback(mask);
+	}
+	webup_removeDirectory(BAK_STAGE);
+}
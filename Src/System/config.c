@@ -31,6 +31,7 @@
 #include "config.h"
 #include "decoder.h"
 #include "defaults.h"
+#include "dnssd.h"
 
 #define STORAGE_TIMEOUT		pdMS_TO_TICKS(3 * 1000)
 
@@ -63,6 +64,7 @@ static void cnf_rdDCC (int param1, struct key_value *kv);
 static void cnf_rdMM (int param1, struct key_value *kv);
 static void cnf_rdM3 (int param1, struct key_value *kv);
 static void cnf_rdTrnt (int param1, struct key_value *kv);
+static void cnf_rdS88Filter (int param1, struct key_value *kv);
 
 /*
  * Forward declarations of function prototypes for writing
@@ -77,6 +79,7 @@ static struct key_value *cnf_wrDCC (struct key_value *kv, const char *key, int p
 static struct key_value *cnf_wrMM (struct key_value *kv, const char *key, int param1);
 static struct key_value *cnf_wrM3 (struct key_value *kv, const char *key, int param1);
 static struct key_value *cnf_wrTrnt (struct key_value *kv, const char *key, int param1);
+static struct key_value *cnf_wrS88Filter (struct key_value *kv, const char *key, int param1);
 
 /* === the handler functions for all settings ================================================ */
 static const struct keyhandler network[] = {
@@ -96,6 +99,14 @@ static const struct keyhandler booster[] = {
 	{ "inrush",			4, cnf_rdTrack, cnf_wrTrack },		// inrush time in ms
 	{ "mmshort",		5, cnf_rdTrack, cnf_wrTrack },		// short time for MM booster in ms
 	{ "dccshort",		6, cnf_rdTrack, cnf_wrTrack },		// short time for DCC booster in ms
+	{ "restart",		7, cnf_rdTrack, cnf_wrTrack },		// restart strategy after short (manual / auto)
+	{ "retries",		8, cnf_rdTrack, cnf_wrTrack },		// max. consecutive automatic restarts
+	{ "restartdelay",	9, cnf_rdTrack, cnf_wrTrack },		// delay before first automatic restart in ms
+	{ "restartmax",		10, cnf_rdTrack, cnf_wrTrack },		// maximum restart delay in ms
+	{ "restartstable",	11, cnf_rdTrack, cnf_wrTrack },		// time in ms without short to reset the retry counter
+	{ "capturetrigger",	12, cnf_rdTrack, cnf_wrTrack },		// current in mA that triggers a capture (0 = shorts only)
+	{ "pretrigger",		13, cnf_rdTrack, cnf_wrTrack },		// samples (ms) to capture before trigger
+	{ "posttrigger",	14, cnf_rdTrack, cnf_wrTrack },		// samples (ms) to capture after trigger
 	{ NULL,				0, NULL, NULL }
 };
 
@@ -110,6 +121,9 @@ static const struct keyhandler sysconfig[] = {
 	{ "StartState",			7, cnf_rdSystem, cnf_wrSystem },
 	{ "BiDiGlobalShort",	8, cnf_rdSystem, cnf_wrSystem },
 	{ "BiDiRemoteOnOff",	9, cnf_rdSystem, cnf_wrSystem },
+	{ "ReportTargetSpeed",	10, cnf_rdSystem, cnf_wrSystem },
+	{ "LocoOwnership",		11, cnf_rdSystem, cnf_wrSystem },
+	{ "WLAN",				12, cnf_rdSystem, cnf_wrSystem },
 
 //#define SYSFLAG_LONGPAUSE			0001	// MM long pause
 //#define SYSFLAG_DEFAULTDCC		0010	// locos are DCC by default
@@ -160,6 +174,12 @@ static const struct keyhandler trnt[] = {
 	{ NULL,				0, NULL, NULL }
 };
 
+static const struct keyhandler s88filter[] = {
+	{ "profile",		0, cnf_rdS88Filter, cnf_wrS88Filter },	// indexed: "onN/onM offN/offM"
+	{ "module",			1, cnf_rdS88Filter, cnf_wrS88Filter },	// indexed: 16 profile digits, input #1 first
+	{ NULL,				0, NULL, NULL }
+};
+
 /* === the sections ========================================================================== */
 static const struct section_map sections[] = {
 	{ "network",		network },
@@ -170,6 +190,7 @@ static const struct section_map sections[] = {
 	{ "protocol-mm",	mm },
 	{ "protocol-m3",	m3 },
 	{ "turnouts",		trnt },
+	{ "s88filter",		s88filter },
 	{ NULL,				NULL }
 };
 
@@ -379,6 +400,17 @@ static void cnf_rdSystem (int param1, struct key_value *kv)
 			if (cnf_boolean(kv->value)) syscfg.sysflags |= SYSFLAG_BIDIB_ONOFF;
 			else syscfg.sysflags &= ~SYSFLAG_BIDIB_ONOFF;
 			break;
+		case 10:	// report the target speed of locos with momentum
+			if (cnf_boolean(kv->value)) syscfg.sysflags |= SYSFLAG_REPORTTARGET;
+			else syscfg.sysflags &= ~SYSFLAG_REPORTTARGET;
+			break;
+		case 11:	// the policy for locos owned by another client
+			syscfg.ownpolicy = own_string2policy(kv->value);
+			break;
+		case 12:	// the WLAN interface over the ESP-01 module
+			if (cnf_boolean(kv->value)) syscfg.sysflags |= SYSFLAG_WLAN;
+			else syscfg.sysflags &= ~SYSFLAG_WLAN;
+			break;
 	}
 }
 
@@ -419,6 +451,15 @@ static struct key_value *cnf_wrSystem (struct key_value *kv, const char *key, in
 		case 9:		// BiDi remote On/Off control
 			sprintf (tmp, "%s", (syscfg.sysflags & SYSFLAG_BIDIB_ONOFF) ? "yes" : "no");
 			break;
+		case 10:	// report the target speed of locos with momentum
+			sprintf (tmp, "%s", (syscfg.sysflags & SYSFLAG_REPORTTARGET) ? "yes" : "no");
+			break;
+		case 11:	// the policy for locos owned by another client
+			sprintf (tmp, "%s", own_policy2string(syscfg.ownpolicy));
+			break;
+		case 12:	// the WLAN interface over the ESP-01 module
+			sprintf (tmp, "%s", (syscfg.sysflags & SYSFLAG_WLAN) ? "yes" : "no");
+			break;
 		default:
 			return NULL;
 	}
@@ -508,6 +549,37 @@ static void cnf_rdTrack (int param1, struct key_value *kv)
 			if (syscfg.dccshort < EXTERNSHORT_MIN) syscfg.dccshort = EXTERNSHORT_MIN;
 			if (syscfg.dccshort > EXTERNSHORT_MAX) syscfg.dccshort = EXTERNSHORT_MAX;
 			break;
+		case 7:		// restart strategy
+			syscfg.bstsv.restart = (!strcasecmp(kv->value, "auto")) ? BSV_RESTART_AUTO : BSV_RESTART_MANUAL;
+			break;
+		case 8:		// max. consecutive automatic restarts
+			val = cnf_decimal(kv->value, 0);
+			syscfg.bstsv.retries = (val < 0) ? 0 : (val > 20) ? 20 : val;
+			break;
+		case 9:		// delay before first automatic restart
+			val = cnf_decimal(kv->value, 0);
+			syscfg.bstsv.delay = (val < 100) ? 100 : (val > 60000) ? 60000 : val;
+			break;
+		case 10:	// maximum restart delay
+			val = cnf_decimal(kv->value, 0);
+			syscfg.bstsv.maxdelay = (val < 100) ? 100 : (val > 60000) ? 60000 : val;
+			break;
+		case 11:	// time without short to reset the retry counter
+			val = cnf_decimal(kv->value, 0);
+			syscfg.bstsv.stable = (val < 1000) ? 1000 : (val > 60000) ? 60000 : val;
+			break;
+		case 12:	// capture trigger level in mA
+			val = cnf_decimal(kv->value, 0);
+			syscfg.bstsv.trigger = (val < 0) ? 0 : (val > 0xFFFF) ? 0xFFFF : val;
+			break;
+		case 13:	// pre-trigger samples
+			val = cnf_decimal(kv->value, 0);
+			syscfg.bstsv.pre = (val < 0) ? 0 : (val > BSV_MAXPRE) ? BSV_MAXPRE : val;
+			break;
+		case 14:	// post-trigger samples
+			val = cnf_decimal(kv->value, 0);
+			syscfg.bstsv.post = (val < 1) ? 1 : (val > BSV_MAXPOST) ? BSV_MAXPOST : val;
+			break;
 	}
 }
 
@@ -545,6 +617,30 @@ static struct key_value *cnf_wrTrack (struct key_value *kv, const char *key, int
 		case 6:		// short sensitivity for DCC booster in ms
 			sprintf (tmp, "%d", syscfg.dccshort);
 			break;
+		case 7:		// restart strategy
+			strcpy (tmp, (syscfg.bstsv.restart == BSV_RESTART_AUTO) ? "auto" : "manual");
+			break;
+		case 8:		// max. consecutive automatic restarts
+			sprintf (tmp, "%d", syscfg.bstsv.retries);
+			break;
+		case 9:		// delay before first automatic restart
+			sprintf (tmp, "%d", syscfg.bstsv.delay);
+			break;
+		case 10:	// maximum restart delay
+			sprintf (tmp, "%d", syscfg.bstsv.maxdelay);
+			break;
+		case 11:	// time without short to reset the retry counter
+			sprintf (tmp, "%d", syscfg.bstsv.stable);
+			break;
+		case 12:	// capture trigger level in mA
+			sprintf (tmp, "%d", syscfg.bstsv.trigger);
+			break;
+		case 13:	// pre-trigger samples
+			sprintf (tmp, "%d", syscfg.bstsv.pre);
+			break;
+		case 14:	// post-trigger samples
+			sprintf (tmp, "%d", syscfg.bstsv.post);
+			break;
 		default:
 			return NULL;
 	}
@@ -763,6 +859,65 @@ static struct key_value *cnf_wrTrnt (struct key_value *kv, const char *key, int
 	return kv_add (kv, key, tmp);
 }
 
+// ==============================================================================================
+// === s88 debounce filter configuration ========================================================
+// ==============================================================================================
+
+static void cnf_rdS88Filter (int param1, struct key_value *kv)
+{
+	int onN, onM, offN, offM;
+	char *s;
+	int i;
+
+	if (!kv->indexed || !kv->value) return;
+
+	switch (param1) {
+		case 0:		// profile definition
+			if (sscanf(kv->value, "%d/%d %d/%d", &onN, &onM, &offN, &offM) == 4) {
+				if (!s88f_setProfile(&syscfg.s88filter, kv->idx, onN, onM, offN, offM)) {
+					log_error ("%s(): invalid filter profile %d '%s'\n", __func__, kv->idx, kv->value);
+				}
+			}
+			break;
+		case 1:		// the profiles of the 16 inputs of a module (1-based)
+			if (kv->idx < 1 || kv->idx > S88F_MODULES) break;
+			for (i = 0, s = kv->value; i < 16 && isdigit(*s); i++, s++) {
+				s88f_setInputProfile(&syscfg.s88filter, (kv->idx - 1) * 16 + i, *s - '0');
+			}
+			break;
+	}
+}
+
+static struct key_value *cnf_wrS88Filter (struct key_value *kv, const char *key, int param1)
+{
+	struct s88f_profile *p;
+	char tmp[32];
+	int i, j;
+
+	if (!key || !*key) return NULL;
+
+	switch (param1) {
+		case 0:		// profile definitions (profile 0 is fixed and not written)
+			for (i = 1; i < S88F_PROFILES; i++) {
+				p = &syscfg.s88filter.profile[i];
+				sprintf (tmp, "%d/%d %d/%d", p->onN, p->onM, p->offN, p->offM);
+				kv = kv_addIndexed(kv, key, i, tmp);
+			}
+			break;
+		case 1:		// modules that have at least one filtered input
+			for (i = 0; i < S88F_MODULES; i++) {
+				if (!syscfg.s88filter.map[i]) continue;
+				for (j = 0; j < 16; j++) tmp[j] = '0' + s88f_getInputProfile(&syscfg.s88filter, i * 16 + j);
+				tmp[j] = 0;
+				kv = kv_addIndexed(kv, key, i + 1, tmp);
+			}
+			break;
+		default:
+			return NULL;
+	}
+	return kv;
+}
+
 // ==============================================================================================
 // === handling of ini file contents ============================================================
 // ==============================================================================================
@@ -796,7 +951,7 @@ static struct ini_section *cnf_generateIni (void)
 	const struct section_map *sm;
 	const struct keyhandler *kh;
 	struct ini_section *root, *ini;
-	struct key_value *kv, *tmp;
+	struct key_value head, *kv, *tmp;
 
 	sm = sections;
 	ini = root = NULL;
@@ -804,15 +959,17 @@ static struct ini_section *cnf_generateIni (void)
 		ini = ini_add(ini, sm->section);
 		if (!root) root = ini;
 		if ((kh = sm->handlers) != NULL) {
-			kv = NULL;
+			// a writer may append more than one (indexed) key and returns the last one, so we use a dummy list head
+			head.next = NULL;
+			kv = &head;
 			while (kh->key) {
 				if (kh->writer) {
 					tmp = kh->writer(kv, kh->key, kh->param1);
 					if (tmp != NULL) kv = tmp;
-					if (!ini->kv) ini->kv = tmp;
 				}
 				kh++;
 			}
+			ini->kv = head.next;
 		}
 		sm++;
 	}
@@ -837,6 +994,8 @@ static void cnf_defconfig (void)
 	syscfg.s88Modules = CNF_DEF_s88modules;
 	syscfg.canModules = 0;
 	syscfg.s88Frequency = CNF_DEF_s88frequency;
+	s88f_defaults(&syscfg.s88filter);
+	bsv_defaults(&syscfg.bstsv);
 
 	fmtcfg.sigflags = CNF_DEF_Sigflags;
 
@@ -920,11 +1079,33 @@ struct sysconf *cnf_readConfig (void)
 	return &syscfg;
 }
 
+static void cnf_flush (void *pvParameter1, uint32_t ulParameter2)
+{
+	(void) ulParameter2;
+
+	if (xTimerIsTimerActive(storage_timer)) cnf_store(storage_timer);
+	xTaskNotifyGive((TaskHandle_t) pvParameter1);
+}
+
+/**
+ * Write a pending change of the configuration to the file system now and
+ * wait for it to finish. The store is executed in the timer task, so it
+ * cannot run twice at the same time.
+ */
+void cnf_flushStore (void)
+{
+	if (!storage_timer) return;
+	if (xTimerPendFunctionCall(cnf_flush, xTaskGetCurrentTaskHandle(), 0, 100) == pdPASS) {
+		ulTaskNotifyTake(pdTRUE, 5000);
+	}
+}
+
 void cnf_triggerStore (const char *caller)
 {
 	if (storage_timer) {
 		log_msg (LOG_INFO, "%s(): from %s()\n", __func__, caller);
 		xTimerReset(storage_timer, 20);
+		zc_update();				// the name of the station or the ports of the services may have changed
 	} else {
 		log_msg (LOG_INFO, "%s(): from %s() ignored (timer not yet active)\n", __func__, caller);
 	}
@@ -0,0 +1,368 @@
+/*
+ * crashrec.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Post mortem crash records
+ *
+ * Faults, failed assertions and stack overflows write a crash record to the
+ * backup SRAM of the STM32H7. This RAM is not touched by a reset (only by a
+ * power cycle), so the record survives the reboot that follows the crash.
+ * On the next boot crash_persist() copies it to the file system, where the
+ * last CRASH_KEEP records are kept and can be downloaded via CGI.
+ *
+ * The record holds the fault registers, the task that crashed, a snapshot
+ * of all tasks with their stack high water marks, a backtrace and the tail
+ * of the debug log. Tools/crashdecode.py decodes a downloaded record and
+ * resolves the addresses with the ELF file of the firmware.
+ *
+ * A record is protected with a CRC-32. A record that is not yet persisted is
+ * never overwritten by a later crash, because the first crash usually is the
+ * cause of the following ones.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "rb2.h"
+#include "yaffsfs.h"
+#include "backtrace.h"
+#include "crashrec.h"
+
+static struct crash_record * const rec = (struct crash_record *) D3_BKPSRAM_BASE;
+static bool active;								///< the record in the backup SRAM belongs to the current crash
+static TaskHandle_t owner;						///< the task that started the record of the current crash
+static TaskStatus_t taskstat[CRASH_MAXTASKS];	///< static to keep the stack usage low in the crashed task
+static backtrace_t backtrace[CRASH_FRAMES];
+
+static uint32_t crash_crc32 (const uint8_t *p, int len)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	int i;
+
+	while (len > 0) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++) crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+		len--;
+	}
+	return ~crc;
+}
+
+static bool crash_valid (void)
+{
+	uint32_t crc;
+	bool ok;
+
+	if (rec->magic != CRASH_MAGIC || rec->version != CRASH_VERSION || rec->size != sizeof(*rec)) return false;
+	crc = rec->crc;
+	rec->crc = 0;
+	ok = (crash_crc32((uint8_t *) rec, sizeof(*rec)) == crc);
+	rec->crc = crc;
+	return ok;
+}
+
+/**
+ * Read the tick counter. A record is also started in exception handlers
+ * (the fault handler, the tick hook via wdog_check() and the context switch
+ * via the stack overflow hook), where only the ISR variant may be used.
+ *
+ * \return			the current tick count
+ */
+static TickType_t crash_ticks (void)
+{
+	if (__get_IPSR() != 0) return xTaskGetTickCountFromISR();
+	return xTaskGetTickCount();
+}
+
+/**
+ * Start a new record. If a record from an earlier crash is still waiting
+ * to be persisted, it is kept. The record of the current crash may only be
+ * extended by the task that started it (i.e. a fault while the crashed task
+ * records an assertion). Other tasks that crash in the meantime must not
+ * overwrite it.
+ *
+ * The OS functions used here only read the kernel state and take no locks,
+ * so they can be used from the fault handler.
+ *
+ * \param reason	the reason for the record
+ * \return			true, if the record may be written
+ */
+static bool crash_begin (enum crash_reason reason)
+{
+	TaskHandle_t me;
+
+	me = xTaskGetCurrentTaskHandle();
+	if (active) return (me == owner);		// add to the record of the current crash
+	if (crash_valid()) return false;		// keep the record of the first crash
+	owner = me;
+	active = true;
+	memset (rec, 0, sizeof(*rec));
+	rec->reason = reason;
+	rec->uptime = crash_ticks() * portTICK_PERIOD_MS;
+	strncpy (rec->task, pcTaskGetName(NULL), sizeof(rec->task) - 1);
+	return true;
+}
+
+/**
+ * Fill in the log tail and make the record valid.
+ */
+static void crash_seal (void)
+{
+	rec->loglen = dbg_getTail(rec->log, sizeof(rec->log));
+	rec->magic = CRASH_MAGIC;
+	rec->version = CRASH_VERSION;
+	rec->size = sizeof(*rec);
+	rec->crc = 0;
+	rec->crc = crash_crc32((uint8_t *) rec, sizeof(*rec));
+	cache_flush((uint32_t) rec, sizeof(*rec));		// the data must reach the RAM before the reset
+}
+
+static void crash_tasks (void)
+{
+	int i, n;
+
+	n = uxTaskGetSystemState(taskstat, DIM(taskstat), NULL);
+	for (i = 0; i < n; i++) {
+		strncpy (rec->tasks[i].name, taskstat[i].pcTaskName, sizeof(rec->tasks[i].name));
+		rec->tasks[i].state = taskstat[i].eCurrentState;
+		rec->tasks[i].prio = taskstat[i].uxCurrentPriority;
+		rec->tasks[i].hwm = taskstat[i].usStackHighWaterMark;
+		rec->tasks[i].stack = (uint32_t) taskstat[i].pxStackBase;
+	}
+	rec->ntasks = n;
+}
+
+static void crash_frames (int n)
+{
+	int i;
+
+	if (n > CRASH_FRAMES) n = CRASH_FRAMES;
+	for (i = 0; i < n; i++) rec->frames[i] = (uint32_t) backtrace[i].address;
+	rec->nframes = (n > 0) ? n : 0;
+}
+
+void crash_init (void)
+{
+	RCC->AHB4ENR |= RCC_AHB4ENR_BKPRAMEN;		// clock for the backup SRAM
+	PWR->CR1 |= PWR_CR1_DBP;					// allow write access to the backup domain
+}
+
+/**
+ * Record a fault. This is called from the fault handler with the exception
+ * stack frame (r0, r1, r2, r3, r12, lr, pc, xpsr) and must not use any OS
+ * functions that block or take a lock.
+ *
+ * \param frame		the exception stack frame
+ * \param isr		true, if the fault occured in an exception handler
+ */
+void crash_fault (const uint32_t *frame, bool isr)
+{
+	if (!crash_begin(isr ? CRASH_FAULT_ISR : CRASH_FAULT)) return;
+	memcpy (rec->r, frame, 4 * sizeof(uint32_t));
+	rec->r[4] = frame[4];
+	rec->lr = frame[5];
+	rec->pc = frame[6];
+	rec->xpsr = frame[7];
+	rec->sp = (uint32_t) &frame[8];
+	if (rec->xpsr & (1 << 9)) rec->sp += 4;		// the stack was aligned on exception entry
+	rec->cfsr = SCB->CFSR;
+	rec->hfsr = SCB->HFSR;
+	rec->mmfar = SCB->MMFAR;
+	rec->bfar = SCB->BFAR;
+	crash_seal();
+}
+
+/**
+ * Complete the record of a fault in a task. This is called in the context
+ * of the crashed task after the fault handler returned to the kill function.
+ * The backtrace starts at the faulting instruction.
+ */
+void crash_faultTask (void)
+{
+	backtrace_frame_t frame;
+
+	if (!active || owner != xTaskGetCurrentTaskHandle()) return;
+	crash_tasks();
+	frame.fp = frame.sp = rec->sp;
+	frame.lr = rec->lr;
+	frame.pc = rec->pc;
+	crash_frames(_backtrace_unwind(backtrace, DIM(backtrace), &frame));
+	crash_seal();
+}
+
+/**
+ * Record a failed assertion.
+ *
+ * \param file		the source file
+ * \param line		the line in the source file
+ * \param func		the function that contains the assertion
+ * \param expr		the failed expression
+ * \param caller	the address the assertion was called from
+ */
+void crash_assert (const char *file, unsigned long line, const char *func, const char *expr, void *caller)
+{
+	if (!crash_begin(CRASH_ASSERT)) return;
+	snprintf (rec->info, sizeof(rec->info), "%s:%lu %s(): %s", file, line, func, expr);
+	rec->pc = (uint32_t) caller;
+	crash_tasks();
+	crash_frames(backtrace_unwind(backtrace, DIM(backtrace)));
+	crash_seal();
+}
+
+/**
+ * Record a stack overflow. This is called during the task switch, so
+ * no task snapshot is possible.
+ *
+ * \param name		the name of the task that overflowed its stack
+ */
+void crash_stackOverflow (const char *name)
+{
+	if (!crash_begin(CRASH_STACKOVERFLOW)) return;
+	snprintf (rec->info, sizeof(rec->info), "stack overflow in '%s'", name);
+	crash_seal();
+	active = false;				// the system continues, a later crash must not add to this record
+}
+
+/**
+ * Record a starved task. This is called from the tick hook right before the
+ * hardware watchdog resets the system, so only OS functions that are safe
+ * in interrupt context can be used.
+ * If a fault is being recorded, that record is kept.
+ *
+ * \param task		the name of the task that starved
+ * \param info		a description of the situation
+ */
+void crash_watchdog (const char *task, const char *info)
+{
+	if (active || !crash_begin(CRASH_WATCHDOG)) return;
+	snprintf (rec->task, sizeof(rec->task), "%s", task);
+	snprintf (rec->info, sizeof(rec->info), "%s", info);
+	crash_seal();
+}
+
+static int crash_number (const char *fname)
+{
+	int n;
+	char c;
+
+	if (sscanf (fname, "crash%d.bi%c", &n, &c) != 2 || c != 'n') return -1;
+	return n;
+}
+
+static void crash_fname (char *buf, int idx)
+{
+	sprintf (buf, CRASH_DIR "crash%d.bin", idx);
+}
+
+/**
+ * List the crash records in the file system. If there are more records
+ * than fit into the array, the newest are reported.
+ *
+ * \param idx		where to store the numbers of the records (ascending)
+ * \param max		the size of the array
+ * \return			the number of records found
+ */
+int crash_list (int *idx, int max)
+{
+	yaffs_DIR *dir;
+	struct yaffs_dirent *dentry;
+	int i, n, cnt;
+
+	if ((dir = yaffs_opendir(CRASH_DIR)) == NULL) return 0;
+	cnt = 0;
+	while ((dentry = yaffs_readdir(dir)) != NULL) {
+		if ((n = crash_number(dentry->d_name)) < 0) continue;
+		if (cnt >= max) {					// drop the oldest entry
+			if (n < idx[0]) continue;
+			memmove (idx, &idx[1], --cnt * sizeof(*idx));
+		}
+		for (i = cnt; i > 0 && idx[i - 1] > n; i--) idx[i] = idx[i - 1];	// insertion sort
+		idx[i] = n;
+		cnt++;
+	}
+	yaffs_closedir(dir);
+	return cnt;
+}
+
+/**
+ * Read a crash record from the file system.
+ *
+ * \param idx		the number of the record
+ * \param buf		where to store the record
+ * \param size		the size of the buffer
+ * \return			the number of bytes read or -1 if the record does not exist
+ */
+int crash_read (int idx, uint8_t *buf, int size)
+{
+	char *fname;
+	int fd, len;
+
+	fname = tmp64();
+	crash_fname(fname, idx);
+	if ((fd = yaffs_open(fname, O_RDONLY, 0)) < 0) return -1;
+	len = yaffs_read(fd, buf, size);
+	yaffs_close(fd);
+	return len;
+}
+
+/**
+ * Copy a crash record from the backup SRAM to the file system. This must be
+ * called on boot after the file system is mounted. Only the last CRASH_KEEP
+ * records are kept.
+ */
+void crash_persist (void)
+{
+	int idx[CRASH_KEEP + 1];
+	char *fname;
+	int fd, cnt, n, i;
+
+	active = false;
+	if (!crash_valid()) return;
+
+	yaffs_mkdir(CRASH_DIR, S_IREAD | S_IWRITE | S_IEXEC);
+	cnt = crash_list(idx, DIM(idx));
+	n = (cnt > 0) ? idx[cnt - 1] + 1 : 0;
+	fname = tmp64();
+	crash_fname(fname, n);
+	if ((fd = yaffs_open(fname, O_CREAT | O_TRUNC | O_RDWR, 0666)) < 0) {
+		log_error ("%s(): cannot create '%s'\n", __func__, fname);
+		return;
+	}
+	if (yaffs_write(fd, rec, sizeof(*rec)) != sizeof(*rec)) {
+		log_error ("%s(): cannot write '%s'\n", __func__, fname);
+		yaffs_close(fd);
+		yaffs_unlink(fname);
+		return;
+	}
+	yaffs_close(fd);
+	log_msg (LOG_WARNING, "%s(): crash record of task '%s' saved as '%s'\n", __func__, rec->task, fname);
+
+	for (i = 0; i < cnt + 1 - CRASH_KEEP; i++) {		// remove the oldest records
+		crash_fname(fname, idx[i]);
+		yaffs_unlink(fname);
+	}
+	rec->magic = 0;
+	cache_flush((uint32_t) rec, sizeof(*rec));
+}
@@ -216,6 +216,39 @@ void dbg_write (const char *s, int len)
 	if (output && SenderTask) xTaskNotifyGive (SenderTask);
 }
 
+/**
+ * Copy the last lines of the log buffer. This may be called from fault handlers,
+ * so it doesn't take the mutex and only reads the buffer. The copy starts at
+ * the beginning of a line.
+ *
+ * \param buf		where to store the text
+ * \param size		the size of the buffer
+ * \return			the number of characters copied (no terminating null character)
+ */
+int dbg_getTail (char *buf, int size)
+{
+	const char *h, *p;
+	int len, i;
+
+	if (!buf || size <= 0 || (h = (const char *) head) == NULL) return 0;
+
+	if (size > LOGBUFFER_SIZE) size = LOGBUFFER_SIZE;
+	p = h - size;
+	if (p < logbuffer) p += LOGBUFFER_SIZE;
+	for (i = 0; i < size && *p != '\n'; i++) {		// skip the (probably incomplete) first line
+		if (++p >= logbuffer + LOGBUFFER_SIZE) p = logbuffer;
+	}
+	if (i >= size) return 0;
+	if (++p >= logbuffer + LOGBUFFER_SIZE) p = logbuffer;
+
+	len = 0;
+	while (p != h && len < size) {
+		buf[len++] = *p;
+		if (++p >= logbuffer + LOGBUFFER_SIZE) p = logbuffer;
+	}
+	return len;
+}
+
 void dbg_putc (const char c)
 {
 	if (!mutex_lock (&mutex, 10, __func__)) return;
@@ -41,10 +41,12 @@
 #include "rb2.h"
 #include "timers.h"
 #include "events.h"
+#include "swdog.h"
 
 #define MAX_MUTEX_WAIT		100			///< maximum waittime (in ms) for the list mutex to become available
 #define TIMER_OVERFLOW		(1 << 31)	///< the topmost bit marks a time difference, that tells us that the current time is later than the defined timeout
 #define MAX_PENDING_EVENTS	64			///< the queue length for pending events
+#define WORKER_WDOG_TIMEOUT	5000		///< the maximum time in ms the handlers of a single event may take
 
 static volatile struct evtListener *listener;		///< the currently active listeners
 static SemaphoreHandle_t mutex;						///< locking for access to listener list
@@ -83,6 +85,8 @@ static const char *event_name (enum event evt)
 		case EVENT_ENBOOT:				return str(EVENT_ENBOOT);
 		case EVENT_CONSIST:				return str(EVENT_CONSIST);
 		case EVENT_FBNEW:				return str(EVENT_FBNEW);
+		case EVENT_BLOCKOCC:			return str(EVENT_BLOCKOCC);
+		case EVENT_LOCO_OWNER:			return str(EVENT_LOCO_OWNER);
 		case EVENT_MAX_EVENT:			return str(EVENT_MAX_EVENT);
 		case EVENT_DEREGISTER_ALL:		return str(EVENT_DEREGISTER_ALL);
 		default:						return "(unknown)";
@@ -186,9 +190,12 @@ static void event_worker (void *pvParameter)
 		vTaskDelete(NULL);
 	}
 	worker = xTaskGetCurrentTaskHandle();
+	wdog_register(NULL, WORKER_WDOG_TIMEOUT);
 
 	for (;;) {
+		wdog_idle();
 		if (xQueueReceive(evtqueue, &e, portMAX_DELAY)) {
+			wdog_kick();
 //			log_msg (LOG_DEBUG, "%s() event %d (%s) received\n", __func__, e.ev, event_name(e.ev));
 //			vTaskDelay(10);
 			ev_mask = 1 << e.ev;
@@ -22,12 +22,15 @@
 #include "rb2.h"
 #include "lwip/ip.h"
 #include "lwip/tcpip.h"
-#include "lwip/apps/mdns.h"
 #include "ethernet.h"
 #include "nandflash.h"
 #include "decoder.h"
 #include "config.h"
 #include "events.h"
+#include "crashrec.h"
+#include "swdog.h"
+#include "dnssd.h"
+#include "backup.h"
 
 static TaskHandle_t rebootHandler;
 
@@ -112,6 +115,7 @@ static void vRebootProc (void *pvParameter)
 
 	ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
+	wdog_shutdown();		// tasks may block now, but a hanging unmount should still end in a reset
 	vTaskDelay(200);
 	retry = 0;
 	do {
@@ -194,8 +198,9 @@ void vInit(void *pvParameters)
     	while (KEY1_PRESSED()) vTaskDelay(20);
     	yaffs_unlink(CONFIG_SYSTEM);
     	yaffs_unlink(CONFIG_LOCO);
-    	seg_display(0, 0);
+    	seg_clear(DM_LAYER_ALERT);
     }
+    bak_recover();
     cfg = cnf_readConfig();
 
     tcpip_init(NULL, NULL);
@@ -221,8 +226,7 @@ void vInit(void *pvParameters)
 		ip4_set_default_multicast_netif(rt.en);
 		if (cfg->ipm == IPMETHOD_DHCP) netifapi_dhcp_start(rt.en);
 	}
-	mdns_resp_init();
-	mdns_resp_add_netif(rt.en, "mc2", 120);
+	zc_start(rt.en);
 
 //	xTaskCreate(idlefunc, "IDLE", 256, NULL, tskIDLE_PRIORITY, NULL);		// a timeburner task at idle priority (DEBUG)
 	key_init();
@@ -240,7 +244,7 @@ void vInit(void *pvParameters)
 #endif
     xTaskCreate(vKeyHandler, "KeyHandler", configMINIMAL_STACK_SIZE, NULL, 4, NULL);
 //    xTaskCreate(player, "Audioplayer", 1024, NULL, 1, NULL);
-//    xTaskCreate(esp_testthread, "ESP-01", 2048, NULL, 1, NULL);
+    if (cfg->sysflags & SYSFLAG_WLAN) xTaskCreate(esp_thread, "ESP-01", 2048, NULL, 1, NULL);
     xTaskCreate(vAudioTest, "AUDIOtest", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
 
     if (yaffs_access(FLASH_FILE, 0) == 0) {
@@ -254,6 +258,8 @@ void vInit(void *pvParameters)
     yaffs_mkdir(CONFIG_DIR, S_IREAD | S_IWRITE | S_IEXEC);
     yaffs_mkdir(FIRMWARE_DIR, S_IREAD | S_IWRITE | S_IEXEC);
     yaffs_mkdir(MANUALS_DIR, S_IREAD | S_IWRITE | S_IEXEC);
+    yaffs_mkdir(BIDIBFW_DIR, S_IREAD | S_IWRITE | S_IEXEC);
+    crash_persist();
     webup_manuals();
 
     if (yaffs_access(CONFIG_DIR "company.js", 0) != 0) {
@@ -26,55 +26,105 @@
 #include <stdio.h>
 #include "rb2.h"
 #include "events.h"
+#include "config.h"
 #include "bidib.h"
 
+#define MENU_RESULT_TIME	1500			///< time in ms to show the result of a menu action
+
 static volatile TaskHandle_t pairing;		// if set, GO means OK and STOP means "NO" and also switch off track
+static struct dm_menu menu;					// the service menu (see dispmgr.c)
+static TickType_t menu_result;				// if set, the time when the result of a menu action is replaced by the menu label again
+
+static const int speedsteps[] = { 0, 1, 2, 4, 8, 16, 32, 60 };	///< the model time speeds that can be selected from the menu
 
-static void disp_ip (void)
+static void key_menuLabel (void)
 {
-	keyevent k;
-	char buf[20], *s;
-	uint8_t cl, cr;
-
-	if (rt.en) {
-		seg_display(0b0110000,  0b1110011);
-		do {
-			k = key_getEvent(portMAX_DELAY);
-			if (KEY(k) != KEY_GO) return;
-		} while (k != BREAK(KEY_GO));
-
-		// format IPv4 Address as four tuples of 3 digits each.
-		// ATTENTION: IP-Address is in network byte order!
-		sprintf (buf, "%03lu.%03lu.%03lu.%03lu",
-				(rt.en->ip_addr.addr >> 0) & 0xFF, (rt.en->ip_addr.addr >> 8) & 0xFF,
-				(rt.en->ip_addr.addr >> 16) & 0xFF, (rt.en->ip_addr.addr >> 24) & 0xFF);
-		printf ("%s() IP-Addr = %s\n", __func__, buf);
-		s = buf;
-		while (*s) {
-			cl = seg_getHexDigit(*s++ - '0');
-			if (*s == '.') {
-				cl |= 0x80;
-				s++;
+	menu_result = 0;
+	seg_message(DM_LAYER_MENU, dm_menuLabel(&menu), 0, 0);
+}
+
+static void key_menuResult (const char *text)
+{
+	seg_message(DM_LAYER_MENU, text, 0, 0);
+	menu_result = xTaskGetTickCount() + pdMS_TO_TICKS(MENU_RESULT_TIME);
+}
+
+static void key_menuLeave (void)
+{
+	menu.active = false;
+	menu_result = 0;
+	seg_clear(DM_LAYER_MENU);
+}
+
+/**
+ * Show the IP address as a scrolling text. It stays on the display until the next key.
+ */
+static void key_showIP (void)
+{
+	char buf[20];
+
+	if (!rt.en) {
+		fprintf (stderr, "%s(): Interface not (yet) defined\n", __func__);
+		seg_message(DM_LAYER_MENU, "--", 0, 0);	// show two dashes ('--')
+		return;
+	}
+	// ATTENTION: IP-Address is in network byte order!
+	sprintf (buf, "%lu.%lu.%lu.%lu",
+			(rt.en->ip_addr.addr >> 0) & 0xFF, (rt.en->ip_addr.addr >> 8) & 0xFF,
+			(rt.en->ip_addr.addr >> 16) & 0xFF, (rt.en->ip_addr.addr >> 24) & 0xFF);
+	printf ("%s() IP-Addr = %s\n", __func__, buf);
+	seg_message(DM_LAYER_MENU, buf, 0, 0);
+	menu_result = 0;
+}
+
+static void key_menuAction (enum dm_action act)
+{
+	struct sysconf *cfg;
+	int i, speed;
+
+	switch (act) {
+		case DM_ACT_NONE:
+			key_menuLabel();		// maybe a new item or a request for confirmation
+			break;
+		case DM_ACT_EXIT:
+			key_menuLeave();
+			break;
+		case DM_ACT_SHOWIP:
+			key_showIP();
+			break;
+		case DM_ACT_BOOSTER:
+			if (rt.tm == TM_GO || rt.tm == TM_HALT) {
+				sig_setMode(TM_STOP);
+				key_menuResult("oF");
+			} else {
+				sig_setMode(TM_GO);
+				key_menuResult((rt.tm == TM_GO) ? "on" : "--");
 			}
-			if (*s) {
-				cr = seg_getHexDigit(*s++ - '0');
-				if (*s == '.') {
-					cr |= 0x80;
-					s++;
-				}
+			break;
+		case DM_ACT_PROG:
+			if (rt.tm == TM_DCCPROG) {
+				sig_setMode(TM_STOP);
+				key_menuResult("St.");
 			} else {
-				cr = 0;
+				sig_setMode(TM_DCCPROG);
+				key_menuResult((rt.tm == TM_DCCPROG) ? "Pr" : "--");
 			}
-			seg_display(cl,  cr);
-			do {
-				k = key_getEvent(portMAX_DELAY);
-				if (KEY(k) != KEY_GO) return;
-			} while (k != BREAK(KEY_GO));
-		}
-	} else {
-		fprintf (stderr, "%s(): Interface not (yet) defined\n", __func__);
-		seg_display(0b1000000, 0b1000000);	// show two dashes ('--')
-		key_getEvent(portMAX_DELAY);		// wait for any key event (probably release of the GO key)!
+			break;
+		case DM_ACT_IPRESET:
+			cfg = cnf_getconfig();
+			cfg->ipm = IPMETHOD_DHCP;				// takes effect after the next reboot
+			cnf_triggerStore(__func__);
+			log_msg (LOG_INFO, "%s() network configuration reset to DHCP\n", __func__);
+			key_menuResult("dHCP");
+			break;
+		case DM_ACT_SPEED:
+			speed = mt_getSpeedup();
+			for (i = 0; i < DIM(speedsteps) && speedsteps[i] <= speed; i++) ;
+			speed = (i < DIM(speedsteps)) ? speedsteps[i] : speedsteps[0];
+			mt_speedup(speed);
+			seg_number(DM_LAYER_MENU, speed, false, 0);
+			menu_result = xTaskGetTickCount() + pdMS_TO_TICKS(MENU_RESULT_TIME);
+			break;
 	}
 }
 
@@ -95,11 +145,13 @@ void vKeyHandler (void *pvParameter)
 			case NOKEY:
 				if (go) go++;		// count GO as long as GO is not released
 				if (stop) stop++;	// count STOP as long as STOP is not released
-				if (!stop && (go > 10)) {	// show IP if GO (but not STOP) is pressed for more than a second
-					disp_ip ();
-					seg_display(0, 0);
-					vTaskDelay(pdMS_TO_TICKS(500));
-					seg_display(0, 0);
+				if (!stop && (go > 10)) {	// long press of GO (but not STOP) for more than a second: enter the menu or execute the current item
+					if (menu.active) {
+						key_menuAction(dm_menuKey(&menu, DM_KEY_SELECT, xTaskGetTickCount()));
+					} else {
+						dm_menuEnter(&menu, xTaskGetTickCount());
+						key_menuLabel();
+					}
 					go = 0;
 				}
 				if (!go && (stop > 10)) {	// BiDiB identify if STOP (but not GO) is pressed for more than a second
@@ -111,10 +163,13 @@ void vKeyHandler (void *pvParameter)
 					sig_setMode(TM_RESET);
 					reboot_flag = true;
 				}
+				if (menu.active && menu_result && (int) (xTaskGetTickCount() - menu_result) >= 0) key_menuLabel();
+				if (dm_menuTimeout(&menu, xTaskGetTickCount())) key_menuLeave();
 				break;
 			case MAKE(KEY_STOP):
 //				player_play("/detodos.opus");
-				sig_setMode(TM_STOP);
+				sig_setMode(TM_STOP);	// STOP always keeps its function, even in the menu
+				if (menu.active) key_menuAction(dm_menuKey(&menu, DM_KEY_LEAVE, xTaskGetTickCount()));
 				if (pairing) xTaskNotify(pairing, 0, eSetValueWithOverwrite);
 				stop = 1;
 				break;
@@ -133,7 +188,8 @@ void vKeyHandler (void *pvParameter)
 					reboot();			// RESET if both GO and STOP are hold pressed for more than two seconds and then released
 				}
 				if (!stop && go > 0) {
-					sig_setMode(TM_GO);
+					if (menu.active) key_menuAction(dm_menuKey(&menu, DM_KEY_NEXT, xTaskGetTickCount()));
+					else sig_setMode(TM_GO);
 				}
 				go = 0;
 				break;
@@ -147,13 +203,13 @@ void vKeyHandler (void *pvParameter)
 				break;
 			case MAKE(MB_SHORT):
 				if (rt.tm == TM_GO || rt.tm == TM_HALT) {		// in the other modes this is probably a late reaction of the booster to a STOP
-					sig_setMode(TM_SHORT);
+					ts_reportShort(BSV_SRC_MAERKLIN);
 					printf("MB SHORT!\n");
 				}
 				break;
 			case MAKE(DCC_SHORT):
 				if (rt.tm == TM_GO || rt.tm == TM_HALT) {		// in the other modes this is probably a late reaction of the booster to a STOP
-					sig_setMode(TM_SHORT);
+					ts_reportShort(BSV_SRC_DCC);
 					printf("DCC SHORT!\n");
 				}
 				break;
@@ -125,6 +125,11 @@ void mt_speedup (int factor)
 	}
 }
 
+int mt_getSpeedup (void)
+{
+	return theTime.speedup;
+}
+
 void mt_setdatetime (int year, int mon, int mday, int hour, int min)
 {
 	bool dateChanged, timeChanged;
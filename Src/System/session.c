@@ -0,0 +1,421 @@
+/*
+ * session.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Recording and playback of layout sessions
+ *
+ * While the recorder is active, the command entry points (rq_setSpeed(),
+ * rq_setFuncMasked(), rq_emergencyStop(), trnt_switch(), sig_setMode())
+ * and the feedback changes are reported with sess_record(). The caller only
+ * fills a record and puts it to a queue without waiting. If the queue is full,
+ * the record is dropped and counted. The number of dropped records is written
+ * to the file as a SESS_LOST record.
+ *
+ * The recorder task collects the records and appends them to the file in
+ * batches of up to SESS_BUFSIZE bytes, but at least every SESS_FLUSH ms.
+ * A file is closed when it reaches SESS_FILE_MAX bytes and a new one is
+ * started. Only the last SESS_KEEP files are kept in SESS_DIR, from where
+ * they can be downloaded by FTP and converted to text with Tools/sessdecode.py.
+ *
+ * The player re-runs a recorded session with the original timing and can
+ * optionally wait for the recorded feedback changes (see sessrec.c). The
+ * commands of the player itself are not recorded. Changes to the track mode
+ * are only replayed for STOP, HALT and GO. A short or a programming mode in
+ * the recording is kept for information.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "rb2.h"
+#include "decoder.h"
+#include "events.h"
+#include "yaffsfs.h"
+#include "session.h"
+
+#define SESS_DIR			"/sessions/"		///< the directory where the recordings are stored
+#define SESS_KEEP			8					///< the number of recordings kept in the file system
+#define SESS_FILE_MAX		(256 * 1024)		///< a new file is started when a recording reaches this size
+#define SESS_QUEUE			64					///< the number of records that can wait for the recorder task
+#define SESS_BUFSIZE		(32 * SESS_MAXSIZE)	///< the batch size for appending records to the file
+#define SESS_FLUSH			1000				///< the maximum time in ms that records stay in the batch buffer
+#define SESS_PLAYPOLL		100					///< the maximum time in ms between two checks for the end of a playback
+#define SESS_STACK			1024				///< stack size of the recorder and player tasks
+#define SESS_PRIO			1					///< the priority of the recorder and player tasks
+
+static QueueHandle_t queue;
+static volatile bool recording;			///< set to request a running recording, cleared to stop it
+static volatile bool playing;			///< set to request a running playback, cleared to stop it
+static TaskHandle_t rec_task;
+static TaskHandle_t play_task;
+static TickType_t start;				///< the time stamps of a recording are relative to this time
+static volatile uint32_t lost;			///< the number of records dropped because the queue was full
+
+static struct {
+	int			idx;					///< the recording to play
+	bool		loop;					///< restart the playback at the end of the recording
+	bool		triggers;				///< wait for the recorded feedback changes
+} playcfg;
+
+static int sess_number (const char *fname)
+{
+	int n;
+	char c;
+
+	if (sscanf (fname, "sess%d.bi%c", &n, &c) != 2 || c != 'n') return -1;
+	return n;
+}
+
+static void sess_fname (char *buf, int idx)
+{
+	sprintf (buf, SESS_DIR "sess%d.bin", idx);
+}
+
+/**
+ * Record a command or event. This function is called from the command
+ * entry points and must not block. If no recording is running, it returns
+ * immediately.
+ *
+ * \param type		the type of the record
+ * \param adr		the address of the loco, turnout or feedback module
+ * \param v1		the first value (see enum sess_type)
+ * \param v2		the second value (see enum sess_type)
+ */
+void sess_record (enum sess_type type, int adr, uint32_t v1, uint32_t v2)
+{
+	struct sess_rec r;
+
+	if (!recording || !queue) return;
+	if (play_task && xTaskGetCurrentTaskHandle() == play_task) return;
+
+	r.ts = xTaskGetTickCount() - start;
+	r.type = type;
+	r.src = loco_getClient();
+	r.adr = adr;
+	r.v1 = v1;
+	r.v2 = v2;
+	if (xQueueSendToBack(queue, &r, 0) != pdTRUE) lost++;
+}
+
+static bool sess_fbHandler (eventT *e, void *priv)
+{
+	fbeventT *fb;
+
+	(void) priv;
+
+	if ((fb = e->src) != NULL) sess_record(SESS_FEEDBACK, fb->module, fb->status, fb->chgflag);
+	return true;
+}
+
+/**
+ * List the recordings in the file system. If there are more recordings
+ * than fit into the array, the newest are reported.
+ *
+ * \param idx		where to store the numbers of the recordings (ascending)
+ * \param size		where to store the sizes of the files (may be NULL)
+ * \param max		the size of the arrays
+ * \return			the number of recordings found
+ */
+int sess_list (int *idx, int *size, int max)
+{
+	yaffs_DIR *dir;
+	struct yaffs_dirent *dentry;
+	struct yaffs_stat st;
+	char *fname;
+	int i, n, cnt;
+
+	if ((dir = yaffs_opendir(SESS_DIR)) == NULL) return 0;
+	cnt = 0;
+	while ((dentry = yaffs_readdir(dir)) != NULL) {
+		if ((n = sess_number(dentry->d_name)) < 0) continue;
+		if (cnt >= max) {					// drop the oldest entry
+			if (n < idx[0]) continue;
+			memmove (idx, &idx[1], --cnt * sizeof(*idx));
+		}
+		for (i = cnt; i > 0 && idx[i - 1] > n; i--) idx[i] = idx[i - 1];	// insertion sort
+		idx[i] = n;
+		cnt++;
+	}
+	yaffs_closedir(dir);
+
+	if (size) {
+		fname = tmp64();
+		for (i = 0; i < cnt; i++) {
+			sess_fname(fname, idx[i]);
+			size[i] = (yaffs_stat(fname, &st) == 0) ? (int) st.st_size : 0;
+		}
+	}
+	return cnt;
+}
+
+/**
+ * Create the next file for the recorder and remove the oldest ones, so
+ * only SESS_KEEP files remain.
+ *
+ * \return			the file descriptor or -1 if the file cannot be created
+ */
+static int sess_create (void)
+{
+	int idx[SESS_KEEP];
+	char *fname;
+	int fd, cnt, n, i;
+
+	yaffs_mkdir(SESS_DIR, S_IREAD | S_IWRITE | S_IEXEC);
+	cnt = sess_list(idx, NULL, DIM(idx));
+	n = (cnt > 0) ? idx[cnt - 1] + 1 : 0;
+	fname = tmp64();
+	for (i = 0; i < cnt + 1 - SESS_KEEP; i++) {		// remove the oldest recordings
+		sess_fname(fname, idx[i]);
+		yaffs_unlink(fname);
+	}
+	sess_fname(fname, n);
+	if ((fd = yaffs_open(fname, O_CREAT | O_WRONLY | O_TRUNC, S_IREAD | S_IWRITE)) < 0) {
+		log_error ("%s() cannot create '%s'\n", __func__, fname);
+		return -1;
+	}
+	log_msg (LOG_INFO, "%s() recording to '%s'\n", __func__, fname);
+	return fd;
+}
+
+static int sess_addRecord (uint8_t *buf, int len, int size, enum sess_type type, int adr, uint32_t v1)
+{
+	struct sess_rec r;
+
+	r.ts = xTaskGetTickCount() - start;
+	r.type = type;
+	r.src = OWN_ANONYMOUS;
+	r.adr = adr;
+	r.v1 = v1;
+	r.v2 = 0;
+	return len + sess_encode(&r, buf + len, size - len);
+}
+
+static void sess_recorder (void *pvParameter)
+{
+	struct sess_rec r;
+	uint8_t buf[SESS_BUFSIZE];
+	TickType_t lastwrite;
+	uint32_t dropped;
+	int fd, len, total;
+
+	(void) pvParameter;
+
+	fd = -1;
+	len = total = 0;
+	lastwrite = xTaskGetTickCount();
+	while (recording || uxQueueMessagesWaiting(queue)) {
+		if (fd < 0) {
+			if ((fd = sess_create()) < 0) break;
+			total = 0;
+			len = sess_addRecord(buf, len, sizeof(buf), SESS_START, SESS_VERSION, xTaskGetTickCount());
+		}
+		if (xQueueReceive(queue, &r, pdMS_TO_TICKS(SESS_FLUSH)) == pdTRUE) {
+			len += sess_encode(&r, buf + len, sizeof(buf) - len);
+		}
+		if ((dropped = lost) != 0 && len + SESS_MAXSIZE <= (int) sizeof(buf)) {
+			lost -= dropped;
+			len = sess_addRecord(buf, len, sizeof(buf), SESS_LOST, 0, (dropped > 0xFFFF) ? 0xFFFF : dropped);
+		}
+		if (len == 0) continue;
+		if (len + SESS_MAXSIZE <= (int) sizeof(buf) && (xTaskGetTickCount() - lastwrite) < pdMS_TO_TICKS(SESS_FLUSH)) continue;
+
+		if (yaffs_write(fd, buf, len) != len) {
+			log_error ("%s() write error - recording stopped\n", __func__);
+			break;
+		}
+		yaffs_flush(fd);
+		total += len;
+		len = 0;
+		lastwrite = xTaskGetTickCount();
+		if (total >= SESS_FILE_MAX) {		// rotate to a new file
+			yaffs_close(fd);
+			fd = -1;
+		}
+	}
+
+	if (fd >= 0) {
+		if (len > 0) yaffs_write(fd, buf, len);
+		yaffs_close(fd);
+	}
+	log_msg (LOG_INFO, "%s() recording finished\n", __func__);
+	recording = false;
+	rec_task = NULL;
+	vTaskDelete(NULL);
+}
+
+/**
+ * Start a new recording. A recording that is still running is continued.
+ *
+ * \return			0 if the recording is running, -1 if it could not be started
+ */
+int sess_startRecording (void)
+{
+	static bool registered;
+
+	if (!queue && (queue = xQueueCreate(SESS_QUEUE, sizeof(struct sess_rec))) == NULL) return -1;
+	if (!registered) registered = (event_register(EVENT_FBNEW, sess_fbHandler, NULL, 0) == 0);
+
+	if (rec_task) {
+		recording = true;
+		return 0;
+	}
+	start = xTaskGetTickCount();
+	lost = 0;
+	recording = true;
+	if (xTaskCreate(sess_recorder, "SESS-REC", SESS_STACK, NULL, SESS_PRIO, &rec_task) != pdPASS) {
+		recording = false;
+		rec_task = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+void sess_stopRecording (void)
+{
+	recording = false;
+}
+
+bool sess_isRecording (void)
+{
+	return recording;
+}
+
+static void sess_execute (const struct sess_rec *r)
+{
+	switch (r->type) {
+		case SESS_SPEED:
+			rq_setSpeed(r->adr, r->v1);
+			break;
+		case SESS_FUNC:
+			rq_setFuncMasked(r->adr, r->v1, r->v2);
+			break;
+		case SESS_ESTOP:
+			rq_emergencyStop(r->adr);
+			break;
+		case SESS_TURNOUT:
+			if (r->v2) trnt_switchTimed(r->adr, r->v1 & 1, r->v2);
+			else trnt_switch(r->adr, r->v1 & 1, !!(r->v1 & 2));
+			break;
+		case SESS_TRACKMODE:
+			if (r->v1 == TM_STOP || r->v1 == TM_HALT || r->v1 == TM_GO) sig_setMode(r->v1);
+			break;
+	}
+}
+
+static void sess_player (void *pvParameter)
+{
+	struct sess_player p;
+	struct sess_rec r;
+	enum sess_action act;
+	uint8_t buf[SESS_BUFSIZE];
+	uint32_t wait;
+	char fname[32];
+	int fd, len, pos, rc, cnt;
+
+	(void) pvParameter;
+
+	loco_setClient(OWN_ANONYMOUS);
+	sess_fname(fname, playcfg.idx);
+	if ((fd = yaffs_open(fname, O_RDONLY, 0)) < 0) {
+		log_error ("%s() cannot open '%s'\n", __func__, fname);
+		playing = false;
+		play_task = NULL;
+		vTaskDelete(NULL);
+	}
+
+	log_msg (LOG_INFO, "%s() playing '%s'%s%s\n", __func__, fname, (playcfg.loop) ? " in a loop" : "", (playcfg.triggers) ? " with feedback triggers" : "");
+	sess_playerStart(&p, xTaskGetTickCount(), playcfg.triggers);
+	len = pos = cnt = 0;
+	while (playing) {
+		if ((rc = sess_decode(buf + pos, len - pos, &r)) < 0) {		// skip garbage until the next valid record
+			pos++;
+			continue;
+		}
+		if (rc == 0) {
+			memmove (buf, buf + pos, len - pos);
+			len -= pos;
+			pos = 0;
+			if ((rc = yaffs_read(fd, buf + len, sizeof(buf) - len)) > 0) {
+				len += rc;
+				continue;
+			}
+			if (!playcfg.loop || cnt == 0) break;
+			yaffs_lseek(fd, 0, SEEK_SET);
+			sess_playerStart(&p, xTaskGetTickCount(), playcfg.triggers);
+			len = cnt = 0;
+			continue;
+		}
+		pos += rc;
+		cnt++;
+
+		act = SESS_SKIP;
+		while (playing && (act = sess_schedule(&p, &r, xTaskGetTickCount(),
+				(r.type == SESS_FEEDBACK) ? fb_getModuleState(r.adr) : 0, &wait)) == SESS_WAIT) {
+			vTaskDelay(pdMS_TO_TICKS((wait > SESS_PLAYPOLL) ? SESS_PLAYPOLL : wait));
+		}
+		if (playing && act == SESS_EXEC) sess_execute(&r);
+	}
+
+	yaffs_close(fd);
+	log_msg (LOG_INFO, "%s() playback of '%s' finished\n", __func__, fname);
+	playing = false;
+	play_task = NULL;
+	vTaskDelete(NULL);
+}
+
+/**
+ * Start the playback of a recording.
+ *
+ * \param idx		the number of the recording (see sess_list())
+ * \param loop		if true, the recording is played again and again until sess_stopPlayback() is called
+ * \param triggers	if true, the playback waits for the recorded feedback changes
+ * \return			0 if the playback is started, -1 if a playback is already running or the task cannot be created
+ */
+int sess_play (int idx, bool loop, bool triggers)
+{
+	if (play_task) return -1;
+
+	playcfg.idx = idx;
+	playcfg.loop = loop;
+	playcfg.triggers = triggers;
+	playing = true;
+	if (xTaskCreate(sess_player, "SESS-PLAY", SESS_STACK, NULL, SESS_PRIO, &play_task) != pdPASS) {
+		playing = false;
+		play_task = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+void sess_stopPlayback (void)
+{
+	playing = false;
+}
+
+bool sess_isPlaying (void)
+{
+	return playing;
+}
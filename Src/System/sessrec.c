@@ -0,0 +1,220 @@
+/*
+ * sessrec.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief The records of the session recorder and the timing of the playback
+ *
+ * Each command that enters the system from one of the interfaces is put into
+ * a struct sess_rec and written to the session file in a compact binary form:
+ *
+ * <pre>
+ *   offset  size  content
+ *     0      1    SESS_SYNC (0x5A)
+ *     1      1    total length of this record (header + payload)
+ *     2      1    type (enum sess_type)
+ *     3      4    time stamp in ms since the start of the recording (little endian)
+ *     7      2    the client that sent the command (interface << 8 | client, little endian)
+ *     9      2    address (little endian)
+ *    11      n    v1 and v2 with a width that depends on the type (little endian)
+ * </pre>
+ *
+ * A value that does not fit into its field is saturated to the largest value
+ * of the field. This only happens for the time of a SESS_TURNOUT (2 bytes,
+ * so the longest recorded time is 65535ms).
+ *
+ * For playback, each record is handed to sess_schedule() until it is either
+ * executed or skipped. The time stamps are relative to a base time. If
+ * triggers are enabled, a recorded feedback change must happen again before
+ * any later record is executed. The base time is then moved to the moment
+ * the trigger fired, so the following commands keep their distance to the
+ * feedback change and not to the start of the recording. This way a demo
+ * loop stays in sync with the trains, even if they run faster or slower
+ * than during the recording. The SESS_START record at the beginning of each
+ * file sets the base time as well, so a file of a rotated recording starts
+ * playing immediately.
+ *
+ * The files and the tasks of the recorder and the player are in session.c,
+ * here the records are only encoded, decoded and scheduled. The files can
+ * be checked on a PC with Tools/sessdecode.py.
+ */
+
+#include <string.h>
+#include "session.h"
+
+/**
+ * The number of bytes used for v1 and v2 of each record type
+ */
+static const struct {
+	uint8_t		w1, w2;
+} widths[SESS_TYPES] = {
+	[SESS_START] =		{ 4, 0 },
+	[SESS_SPEED] =		{ 1, 0 },
+	[SESS_FUNC] =		{ 4, 4 },
+	[SESS_ESTOP] =		{ 0, 0 },
+	[SESS_TURNOUT] =	{ 1, 2 },
+	[SESS_TRACKMODE] =	{ 1, 0 },
+	[SESS_FEEDBACK] =	{ 2, 2 },
+	[SESS_LOST] =		{ 2, 0 },
+};
+
+static void sess_put (uint8_t *p, uint32_t v, int width)
+{
+	while (width-- > 0) {
+		*p++ = v & 0xFF;
+		v >>= 8;
+	}
+}
+
+static uint32_t sess_clip (uint32_t v, int width)
+{
+	if (width <= 0) return 0;
+	if (width < 4 && v > (1u << (8 * width)) - 1) return (1u << (8 * width)) - 1;
+	return v;
+}
+
+static uint32_t sess_get (const uint8_t *p, int width)
+{
+	uint32_t v = 0;
+
+	while (width-- > 0) v = (v << 8) | p[width];
+	return v;
+}
+
+/**
+ * Encode a record to the binary file format.
+ *
+ * \param r			the record to encode
+ * \param buf		the buffer to write the encoded record to
+ * \param size		the size of the buffer
+ * \return			the number of bytes written or 0 if the buffer is too small or the type is unknown
+ */
+int sess_encode (const struct sess_rec *r, uint8_t *buf, int size)
+{
+	int len;
+
+	if (!r || !buf || r->type >= SESS_TYPES) return 0;
+	len = SESS_HEADER + widths[r->type].w1 + widths[r->type].w2;
+	if (size < len) return 0;
+
+	buf[0] = SESS_SYNC;
+	buf[1] = len;
+	buf[2] = r->type;
+	sess_put (&buf[3], r->ts, 4);
+	sess_put (&buf[7], r->src, 2);
+	sess_put (&buf[9], r->adr, 2);
+	sess_put (&buf[SESS_HEADER], sess_clip(r->v1, widths[r->type].w1), widths[r->type].w1);
+	sess_put (&buf[SESS_HEADER + widths[r->type].w1], sess_clip(r->v2, widths[r->type].w2), widths[r->type].w2);
+	return len;
+}
+
+/**
+ * Decode a record from the binary file format. This is the counterpart
+ * to sess_encode().
+ *
+ * \param buf		the buffer containing the encoded record
+ * \param len		the number of bytes available in the buffer
+ * \param r			the record to fill
+ * \return			the number of bytes consumed, 0 if the record is not
+ * 					yet complete or -1 if the buffer doesn't start with a valid record
+ */
+int sess_decode (const uint8_t *buf, int len, struct sess_rec *r)
+{
+	int reclen;
+
+	if (!buf || !r) return -1;
+	if (len < 3) return 0;
+	if (buf[0] != SESS_SYNC || buf[2] >= SESS_TYPES) return -1;
+	reclen = buf[1];
+	if (reclen != SESS_HEADER + widths[buf[2]].w1 + widths[buf[2]].w2) return -1;
+	if (len < reclen) return 0;
+
+	r->type = buf[2];
+	r->ts = sess_get(&buf[3], 4);
+	r->src = sess_get(&buf[7], 2);
+	r->adr = sess_get(&buf[9], 2);
+	r->v1 = sess_get(&buf[SESS_HEADER], widths[r->type].w1);
+	r->v2 = sess_get(&buf[SESS_HEADER + widths[r->type].w1], widths[r->type].w2);
+	return reclen;
+}
+
+/**
+ * Start (or restart for a loop) the playback of a recording.
+ *
+ * \param p			the player state
+ * \param now		the current time in ms
+ * \param triggers	if true, the recorded feedback changes are waited for
+ */
+void sess_playerStart (struct sess_player *p, uint32_t now, bool triggers)
+{
+	if (!p) return;
+	p->base = now;
+	p->triggers = triggers;
+}
+
+/**
+ * Decide what to do with the next record of a playback.
+ *
+ * \param p			the player state
+ * \param r			the next record of the recording
+ * \param now		the current time in ms
+ * \param fbstate	the current state of the feedback module r->adr (only used for SESS_FEEDBACK)
+ * \param wait		where to store the time in ms to wait before asking again (SESS_WAIT)
+ * \return			the action to take for this record
+ */
+enum sess_action sess_schedule (struct sess_player *p, const struct sess_rec *r, uint32_t now, uint16_t fbstate, uint32_t *wait)
+{
+	int32_t due;
+
+	if (!p || !r) return SESS_SKIP;
+
+	switch (r->type) {
+		case SESS_START:			// a new file of the recording - its time stamps continue those of the previous file
+			p->base = now - r->ts;
+			return SESS_SKIP;
+		case SESS_SPEED:
+		case SESS_FUNC:
+		case SESS_ESTOP:
+		case SESS_TURNOUT:
+		case SESS_TRACKMODE:
+			due = (int32_t) (p->base + r->ts - now);
+			if (due > 0) {
+				if (wait) *wait = due;
+				return SESS_WAIT;
+			}
+			return SESS_EXEC;
+		case SESS_FEEDBACK:
+			if (!p->triggers) return SESS_SKIP;
+			if (((fbstate ^ r->v1) & r->v2) == 0) {		// all changed bits now have the recorded state
+				p->base = now - r->ts;
+				return SESS_SKIP;
+			}
+			if (wait) *wait = SESS_TRIGGER_POLL;
+			return SESS_WAIT;
+		default:
+			return SESS_SKIP;
+	}
+}
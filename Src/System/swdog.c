@@ -0,0 +1,251 @@
+/*
+ * swdog.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Supervision of task heartbeats (software watchdog)
+ *
+ * Critical tasks register with a timeout. While a task is busy, it must send
+ * a heartbeat (swd_kick()) at least once per timeout. Before a task blocks
+ * waiting for work that may legitimately never come (i.e. an empty queue),
+ * it declares itself idle (swd_idle()) and is not supervised until the next
+ * heartbeat.
+ *
+ * While a task waits for a mutex, the mutex and the waiting function are noted
+ * in the entry. If the task starves, the report can tell which lock it waited
+ * for and (with the help of the OS) who is holding it.
+ *
+ * The supervisor calls swd_check() before it serves the hardware watchdog.
+ * The entries are written by the tasks and only read by the supervisor, so no
+ * locking is needed as long as the heartbeat time is written before the state.
+ *
+ * On a shutdown the tasks are not supervised any more, but the hardware
+ * watchdog is only served for SWD_SHUTDOWN_MS. A shutdown that hangs will
+ * still end in a reset.
+ *
+ * watchdog.c calls swd_check() with the tick count and decides if the
+ * hardware watchdog is served, the supervision itself only sees its table and
+ * the time. Tests/swdog_test.c supervises simulated tasks with it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "swdog.h"
+
+/**
+ * Register a task for supervision. The task starts in the busy state.
+ *
+ * \param tbl		the table of supervised tasks
+ * \param name		the name of the task
+ * \param handle	the OS handle of the task
+ * \param timeout	the maximum time between two heartbeats in ms
+ * \param now		the current time in ms
+ * \return			the entry of the task or NULL, if the table is full
+ */
+struct swd_task *swd_register (struct swd_table *tbl, const char *name, void *handle, uint32_t timeout, uint32_t now)
+{
+	struct swd_task *t;
+	int i;
+
+	if ((t = swd_find(tbl, handle)) == NULL) {
+		for (i = 0; i < SWD_MAXTASKS; i++) {
+			if (tbl->t[i].state == SWD_FREE) {
+				t = &tbl->t[i];
+				break;
+			}
+		}
+		if (!t) return NULL;
+	}
+
+	strncpy (t->name, name ? name : "?", sizeof(t->name) - 1);
+	t->name[sizeof(t->name) - 1] = 0;
+	t->handle = handle;
+	t->timeout = timeout;
+	t->waitobj = NULL;
+	t->waitfn = NULL;
+	swd_kick(t, now);
+	return t;
+}
+
+/**
+ * Remove a task from the supervision.
+ *
+ * \param t			the entry of the task
+ */
+void swd_unregister (struct swd_task *t)
+{
+	if (!t) return;
+	t->state = SWD_FREE;
+	t->handle = NULL;
+}
+
+/**
+ * Find the entry of a task.
+ *
+ * \param tbl		the table of supervised tasks
+ * \param handle	the OS handle of the task
+ * \return			the entry of the task or NULL, if the task is not registered
+ */
+struct swd_task *swd_find (struct swd_table *tbl, void *handle)
+{
+	int i;
+
+	for (i = 0; i < SWD_MAXTASKS; i++) {
+		if (tbl->t[i].state != SWD_FREE && tbl->t[i].handle == handle) return &tbl->t[i];
+	}
+	return NULL;
+}
+
+/**
+ * Send a heartbeat. A task that was idle is supervised again.
+ *
+ * \param t			the entry of the task
+ * \param now		the current time in ms
+ */
+void swd_kick (struct swd_task *t, uint32_t now)
+{
+	if (!t) return;
+	t->last = now;				// must be written before the state
+	t->state = SWD_BUSY;
+}
+
+/**
+ * The task blocks waiting for work and is not supervised until the next
+ * heartbeat.
+ *
+ * \param t			the entry of the task
+ */
+void swd_idle (struct swd_task *t)
+{
+	if (t) t->state = SWD_IDLE;
+}
+
+/**
+ * Change the timeout of a task. This counts as a heartbeat.
+ *
+ * \param t			the entry of the task
+ * \param timeout	the new maximum time between two heartbeats in ms
+ * \param now		the current time in ms
+ */
+void swd_setTimeout (struct swd_task *t, uint32_t timeout, uint32_t now)
+{
+	if (!t) return;
+	t->timeout = timeout;
+	swd_kick(t, now);
+}
+
+/**
+ * Note the mutex the task is about to wait for.
+ *
+ * \param t			the entry of the task
+ * \param obj		the mutex or NULL, if the task got the mutex (or gave up)
+ * \param fn		the function that waits for the mutex
+ * \param now		the current time in ms
+ */
+void swd_waitFor (struct swd_task *t, const void *obj, const char *fn, uint32_t now)
+{
+	if (!t) return;
+	if (obj) {
+		t->waitsince = now;
+		t->waitfn = fn;
+	}
+	t->waitobj = obj;
+}
+
+/**
+ * Stop the supervision of the tasks for a shutdown. The hardware watchdog
+ * is served for another SWD_SHUTDOWN_MS.
+ *
+ * \param tbl		the table of supervised tasks
+ * \param now		the current time in ms
+ */
+void swd_shutdown (struct swd_table *tbl, uint32_t now)
+{
+	if (tbl->shutdown) return;
+	tbl->deadline = now + SWD_SHUTDOWN_MS;
+	tbl->shutdown = true;
+}
+
+/**
+ * Check the heartbeats of all busy tasks.
+ *
+ * \param tbl		the table of supervised tasks
+ * \param now		the current time in ms
+ * \return			SWD_HEALTHY if the hardware watchdog may be served, SWD_EXPIRED
+ * 					if a shutdown took too long or the index of the task that is
+ * 					overdue the most
+ */
+int swd_check (const struct swd_table *tbl, uint32_t now)
+{
+	const struct swd_task *t;
+	int32_t over, worst;
+	int i, idx;
+
+	if (tbl->shutdown) return ((int32_t) (now - tbl->deadline) >= 0) ? SWD_EXPIRED : SWD_HEALTHY;
+
+	for (i = 0, idx = SWD_HEALTHY, worst = 0; i < SWD_MAXTASKS; i++) {
+		t = &tbl->t[i];
+		if (t->state != SWD_BUSY) continue;
+		over = (int32_t) (now - t->last - t->timeout);
+		if (over > worst) {
+			worst = over;
+			idx = i;
+		}
+	}
+	return idx;
+}
+
+/**
+ * Describe a starved task for the crash record.
+ *
+ * \param tbl		the table of supervised tasks
+ * \param idx		the index of the task as returned by swd_check()
+ * \param now		the current time in ms
+ * \param holder	the name of the task holding the mutex the starved task waits for (may be NULL)
+ * \param buf		where to store the description
+ * \param size		the size of the buffer
+ * \return			the length of the description
+ */
+int swd_describe (const struct swd_table *tbl, int idx, uint32_t now, const char *holder, char *buf, int size)
+{
+	const struct swd_task *t;
+	int len;
+
+	if (!buf || size <= 0) return 0;
+	if (idx == SWD_EXPIRED) return snprintf (buf, size, "shutdown not completed within %dms", SWD_SHUTDOWN_MS);
+	if (idx < 0 || idx >= SWD_MAXTASKS) {
+		*buf = 0;
+		return 0;
+	}
+
+	t = &tbl->t[idx];
+	len = snprintf (buf, size, "%lums without heartbeat (max %lu)", (unsigned long) (now - t->last), (unsigned long) t->timeout);
+	if (t->waitobj && len < size) {
+		len += snprintf (buf + len, size - len, ", waits %lums for mutex in %s() held by '%s'",
+				(unsigned long) (now - t->waitsince), t->waitfn ? t->waitfn : "?", holder ? holder : "?");
+	}
+	return (len < size) ? len : size - 1;
+}
@@ -0,0 +1,188 @@
+/*
+ * watchdog.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief The software watchdog on top of the hardware window watchdog (WWDG1)
+ *
+ * Tasks register themselves with wdog_register() and then send heartbeats
+ * with wdog_kick(). The entry of a task is linked to it with a thread local
+ * storage pointer, so the heartbeat functions need no parameters and cost
+ * almost nothing for tasks that are not supervised.
+ *
+ * The tick hook asks wdog_check() before it serves the hardware watchdog.
+ * If a task starved, a crash record with the name of the task and the mutex
+ * it waits for (including the task that holds this mutex) is written and the
+ * hardware watchdog is not served any more. It will reset the system a few
+ * milliseconds later.
+ *
+ * The supervision logic itself is found in swdog.c.
+ */
+
+#include <stdio.h>
+#include "rb2.h"
+#include "swdog.h"
+#include "crashrec.h"
+
+static struct swd_table table;
+static volatile bool running;			///< at least one task was registered (or a shutdown is in progress)
+static bool reported;					///< the starvation was already recorded
+
+static struct swd_task *wdog_self (void)
+{
+	if (!running) return NULL;
+	return pvTaskGetThreadLocalStoragePointer(NULL, WDOG_TLS_INDEX);
+}
+
+/**
+ * Register the calling task for supervision. A task that is already
+ * registered just gets the new timeout.
+ *
+ * \param name		the name to report (NULL = the name of the task)
+ * \param timeout	the maximum time between two heartbeats in ms
+ * \return			0 for success or -1 if the table is full
+ */
+int wdog_register (const char *name, uint32_t timeout)
+{
+	struct swd_task *t;
+
+	if (!name) name = pcTaskGetName(NULL);
+	taskENTER_CRITICAL();
+	t = swd_register(&table, name, xTaskGetCurrentTaskHandle(), timeout, xTaskGetTickCount());
+	taskEXIT_CRITICAL();
+	if (!t) {
+		log_error ("%s(): no space to supervise '%s'\n", __func__, name);
+		return -1;
+	}
+	vTaskSetThreadLocalStoragePointer(NULL, WDOG_TLS_INDEX, t);
+	running = true;
+	log_msg (LOG_INFO, "%s(): '%s' supervised with %lums\n", __func__, t->name, timeout);
+	return 0;
+}
+
+/**
+ * Remove the calling task from the supervision (i.e. before it terminates).
+ */
+void wdog_unregister (void)
+{
+	struct swd_task *t;
+
+	if ((t = wdog_self()) == NULL) return;
+	vTaskSetThreadLocalStoragePointer(NULL, WDOG_TLS_INDEX, NULL);
+	taskENTER_CRITICAL();
+	swd_unregister(t);
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * Send a heartbeat for the calling task.
+ */
+void wdog_kick (void)
+{
+	swd_kick(wdog_self(), xTaskGetTickCount());
+}
+
+/**
+ * The calling task is about to block waiting for work.
+ */
+void wdog_idle (void)
+{
+	swd_idle(wdog_self());
+}
+
+/**
+ * Change the timeout of the calling task (i.e. for a phase with a known
+ * longer processing time).
+ *
+ * \param timeout	the new maximum time between two heartbeats in ms
+ */
+void wdog_setTimeout (uint32_t timeout)
+{
+	swd_setTimeout(wdog_self(), timeout, xTaskGetTickCount());
+}
+
+/**
+ * Called from mutex_lock() before the calling task waits for a mutex.
+ *
+ * \param mutex		the mutex
+ * \param fn		the function that wants the mutex
+ */
+void wdog_mutexWait (const void *mutex, const char *fn)
+{
+	struct swd_task *t;
+
+	if ((t = wdog_self()) != NULL) swd_waitFor(t, mutex, fn, xTaskGetTickCount());
+}
+
+/**
+ * Called from mutex_lock() after the wait for a mutex ended.
+ */
+void wdog_mutexDone (void)
+{
+	struct swd_task *t;
+
+	if ((t = wdog_self()) != NULL) swd_waitFor(t, NULL, NULL, 0);
+}
+
+/**
+ * Stop the supervision of the tasks for a reboot. If the reboot does not
+ * complete within SWD_SHUTDOWN_MS, the hardware watchdog resets the system.
+ */
+void wdog_shutdown (void)
+{
+	swd_shutdown(&table, xTaskGetTickCount());
+	running = true;
+}
+
+/**
+ * Check all supervised tasks. This is called from the tick hook (i.e. in
+ * interrupt context) when the hardware watchdog may be served.
+ *
+ * \return			true, if the hardware watchdog should be served
+ */
+bool wdog_check (void)
+{
+	static char info[CRASH_INFOLEN];
+	TaskHandle_t holder;
+	const char *task;
+	uint32_t now;
+	int idx;
+
+	if (!running) return true;
+	now = xTaskGetTickCountFromISR();
+	if ((idx = swd_check(&table, now)) == SWD_HEALTHY) return true;
+
+	if (!reported) {
+		reported = true;
+		holder = NULL;
+		if (idx >= 0 && table.t[idx].waitobj) holder = xSemaphoreGetMutexHolderFromISR((SemaphoreHandle_t) table.t[idx].waitobj);
+		swd_describe(&table, idx, now, holder ? pcTaskGetName(holder) : NULL, info, sizeof(info));
+		task = (idx >= 0) ? table.t[idx].name : "REBOOT";
+		crash_watchdog(task, info);
+		irqdbg_printf("WATCHDOG '%s': %s\n", task, info);
+	}
+	return false;
+}
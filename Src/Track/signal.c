@@ -25,6 +25,9 @@
 #include "decoder.h"
 #include "events.h"
 #include "bidib.h"
+#include "swdog.h"
+#include "m3scan.h"
+#include "session.h"
 
 /**
  * \ingroup Track
@@ -150,6 +153,7 @@ static volatile uint16_t TIM3_RCR;		// repeat counter register as a software emu
 #endif
 
 #define f0(p)	(!!(p->funcs[0] & FUNC_LIGHT))		// handy macro to check for LIGHT function bit in packet
+#define SIG_WDOG_TIMEOUT	1000				///< the maximum time in ms the signal task may be busy without a heartbeat
 
 static TaskHandle_t SIGtask;					///< the task handle to be signaled by the interrupt handler requesting next packet preparation
 static struct bitbuffer buffers[BUFFER_COUNT];	///< a static array of buffers to prepare the signal
@@ -1608,6 +1612,10 @@ static struct dcc_renderer {
 	{ QCMD_DCC_SETF13_20,			DECODER_DCC_MOBILE,	sig_dccAddress,		sig_dccFunctions },
 	{ QCMD_DCC_SETF21_28,			DECODER_DCC_MOBILE,	sig_dccAddress,		sig_dccFunctions },
 	{ QCMD_DCC_SETF29_36,			DECODER_DCC_MOBILE,	sig_dccAddress,		sig_dccFunctions },
+	{ QCMD_DCC_SETF37_44,			DECODER_DCC_MOBILE,	sig_dccAddress,		sig_dccFunctions },
+	{ QCMD_DCC_SETF45_52,			DECODER_DCC_MOBILE,	sig_dccAddress,		sig_dccFunctions },
+	{ QCMD_DCC_SETF53_60,			DECODER_DCC_MOBILE,	sig_dccAddress,		sig_dccFunctions },
+	{ QCMD_DCC_SETF61_68,			DECODER_DCC_MOBILE,	sig_dccAddress,		sig_dccFunctions },
 	{ QCMD_DCC_BINSTATE,			DECODER_DCC_MOBILE,	sig_dccAddress,		sig_dccBinaryState },
 	{ QCMD_MAGNET_ON,				DECODER_DCC_ACC,	sig_accAddress,		sig_accSwitch },
 	{ QCMD_MAGNET_OFF,				DECODER_DCC_ACC,	sig_accAddress,		sig_accSwitch },
@@ -1942,6 +1950,8 @@ static struct bitbuffer *sig_renderM3 (struct packet *p, struct bitbuffer *bb)
 			bb->components |= COMP_M3_FLAG3 | COMP_M3_REPLYWIN2 | COMP_M3_FLAG4;		// additional flags
 			bb->adr = 0;
 			bb->rdt = READBACK_M3BIN;
+			bb->param.u32 = p->value.u32;	// the reply carries the UID and the length of the search to tell the answers of pipelined searches apart
+			bb->cva.cv = p->param.u32;
 			break;
 		case QCMD_M3_NADR:
 			bb->bits = sig_m3Nadr(p->value.u32, p->adr, bb->databits);
@@ -2017,90 +2027,152 @@ static struct bitbuffer *sig_renderBuffer (struct packet *p, struct bitbuffer *b
 	return NULL;
 }
 
-#define M3REPLY_TIMEOUT		1
-#define M3REPLY_ACK			2
-#define M3REPLY_NACK		3
+#define M3SCAN_TIMEOUT		2000	///< the time to wait for the answers of the search packets in flight
+#define M3SCAN_MAXTIMEOUT	3		///< give up after this number of consecutive timeouts
 
-static bool sig_m3SearchCallback (struct decoder_reply *msg, flexval fv)
+/**
+ * The answer to a single search packet as posted from the reply handler to the scanning task
+ */
+struct m3scan_reply {
+	uint32_t		serial;			///< the serial number of the query (modulo M3S_INFLIGHT it is the tag)
+	bool			ack;			///< at least one decoder answered
+};
+
+static QueueHandle_t m3scanQueue;					///< the answers to the search packets in flight
+static volatile uint32_t m3scanSerial[M3S_INFLIGHT];	///< the serial number of the query in flight per tag (0 = none)
+static uint32_t m3scanUID[M3S_INFLIGHT];			///< the UID searched per tag
+static int m3scanLen[M3S_INFLIGHT];					///< the length of the UID searched per tag
+
+/**
+ * The reply handler for the search packets of sig_scanM3Locos(). The search
+ * packets in flight all listen to the M3BIN answers, so the UID and length of
+ * the answer are compared to the query that belongs to this listener. Answers
+ * to other queries are ignored.
+ *
+ * \param msg		the reply
+ * \param fv		the serial number of the query
+ * \return			true to keep on listening, false to remove this listener
+ */
+static bool sig_m3ScanCallback (struct decoder_reply *msg, flexval fv)
 {
-	TaskHandle_t task;
-	uint32_t val;
+	struct m3scan_reply r;
+	int tag;
 
-	task = (TaskHandle_t) fv.p;
+	tag = fv.u32 % M3S_INFLIGHT;
+	if (m3scanSerial[tag] != fv.u32) return false;		// the query was already answered or the scan ended
 	switch (msg->mt) {
-		default:
 		case DECODERMSG_TIMEOUT:
-			val = M3REPLY_TIMEOUT;
+			r.ack = false;
 			break;
 		case DECODERMSG_M3BIN:
-			val = (msg->data[0]) ? M3REPLY_ACK : M3REPLY_NACK;
+			if (msg->param.u32 != m3scanUID[tag] || (int) msg->cva.cv != m3scanLen[tag]) return true;
+			r.ack = !!msg->data[0];
 			break;
+		default:
+			return true;
 	}
-	xTaskNotify(task, val, eSetValueWithOverwrite);
+	r.serial = fv.u32;
+	xQueueSendToBack(m3scanQueue, &r, 0);
 	return false;	// de-register this callback
 }
 
 /**
- * Search for m3 decoders without loco address (SID) and return the found UID
- * and number of decoders found (future expansion - currently only a singel decoder can be found!).
+ * Search all m3 decoders without loco address (SID) on the track. The search
+ * packets are kept in flight together (see m3scan.c), so the signal generator
+ * always has the next one ready and no round trip is wasted between the bits.
  *
- * \param id	pointer to a variable that will receive the UID of the decoder, if any
- * \return		the number of decoders found (0 .. n - currently max. 1) or a negative error code
+ * A decoder that is found must get its loco address before the search goes on,
+ * or it will answer again. This is the job of the callback function, that is
+ * called for every decoder as soon as it is found. If no callback is given,
+ * only the first decoder is reported.
+ *
+ * \param uids		an array that receives the UIDs of the decoders found (may be NULL)
+ * \param max		the maximum number of decoders to find (and the size of the array)
+ * \param found		a function that assigns the loco address to a decoder that was found (may be NULL)
+ * \return			the number of decoders found or a negative error code
  */
-int sig_searchM3Loco (uint32_t *id)
+int sig_scanM3Locos (uint32_t *uids, int max, void (*found)(uint32_t uid))
 {
-	uint32_t rc;
-	uint32_t uid, mask;
-	flexval fv;
-	struct packet *p;
-	int len;
-
-	if (!id) return -1;
-
+	static SemaphoreHandle_t mutex;
+	static struct m3s_scan scan;
+	static uint32_t serial;
 
-	uid = 0;
-	len = 0;
-	while (len <= 32) {
-//		reply_register(DECODER_M3_MOBILE, 0, DECODERMSG_M3BIN, sig_m3SearchCallback, task, 500);
-		mask = 1 << (32 - len);		// if (len == 0) we will have a zero mask - that is intended!
-		fv.p = xTaskGetCurrentTaskHandle();
-		if ((p = sigq_m3SearchPacket(uid, len, sig_m3SearchCallback, fv)) == NULL) {
-			log_error ("%s(): cannot create packet @ UID=0x%lX len %d!\n", __func__, uid, len);
-			return -2;
-		}
-		sigq_queuePacket(p);
-
-//		if (m3_scan(uid, len) != 0) {
-//			log_error ("%s(): cannot gen packet @ UID=0x%lX len %d!\n", __func__, uid, len);
-//			return -2;
-//		}
-		rc = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(2000));
-		if (!rc) {
-			log_error ("%s(): TIMEOUT @ UID=0x%lX len %d!\n", __func__, uid, len);
-			return -3;
+	struct m3scan_reply r;
+	struct packet *p;
+	flexval fv;
+	uint32_t uid;
+	int tag, len, timeouts, rc;
+
+	if (!found) max = 1;
+	if (max <= 0) return -1;
+	if (!m3scanQueue && (m3scanQueue = xQueueCreate(M3S_INFLIGHT * 2, sizeof(r))) == NULL) return -1;
+	if (!mutex_lock(&mutex, 10000, __func__)) return -1;
+
+	xQueueReset(m3scanQueue);
+	m3s_init(&scan, max);
+	timeouts = 0;
+	rc = 0;
+	while (!m3s_done(&scan)) {
+		while ((tag = m3s_next(&scan, &uid, &len)) >= 0) {
+			if ((serial = (serial + 1) & 0x00FFFFFF) == 0) serial = 1;
+			m3scanUID[tag] = uid;
+			m3scanLen[tag] = len;
+			m3scanSerial[tag] = serial * M3S_INFLIGHT + tag;
+			fv.u32 = m3scanSerial[tag];
+			if ((p = sigq_m3SearchPacket(uid, len, sig_m3ScanCallback, fv)) == NULL) {
+				log_error ("%s(): cannot create packet @ UID=0x%lX len %d!\n", __func__, uid, len);
+				rc = -2;
+				break;
+			}
+			sigq_queuePacket(p);
 		}
-		if (rc == M3REPLY_TIMEOUT) rc = M3REPLY_NACK;		// both should be equivalent
-		if ((rc == M3REPLY_NACK) && (mask == 0)) {
-			log_msg(LOG_INFO, "%s(): no decoder found\n", __func__);
-			return 0;
-		} else if ((rc == M3REPLY_NACK) && ((uid & mask) != 0)) {
-			log_error ("%s(): lost tree search (bit %d neither 0 nor 1?)\n", __func__, len - 1);
-			return -4;
+		if (rc < 0) break;
+
+		if (!xQueueReceive(m3scanQueue, &r, pdMS_TO_TICKS(M3SCAN_TIMEOUT))) {
+			log_error ("%s(): TIMEOUT with %d queries in flight\n", __func__, m3s_pending(&scan));
+			memset ((void *) m3scanSerial, 0, sizeof(m3scanSerial));
+			m3s_abort(&scan);
+			if (++timeouts >= M3SCAN_MAXTIMEOUT) {
+				rc = -3;
+				break;
+			}
+			continue;
 		}
-		if (rc == M3REPLY_NACK) {		// no loco found with a cleared bit - try a set bit
-			uid |= mask;
-		} else {
-			len++;
+		timeouts = 0;
+		tag = r.serial % M3S_INFLIGHT;
+		if (m3scanSerial[tag] != r.serial) continue;		// a late answer to an aborted query
+		m3scanSerial[tag] = 0;
+		if (m3s_answer(&scan, tag, r.ack, &uid) > 0) {
+			log_msg(LOG_INFO, "%s(): LOCO UID 0x%08lx\n", __func__, uid);
+			if (uids) uids[scan.nfound - 1] = uid;
+			if (found) found(uid);
 		}
 	}
+	memset ((void *) m3scanSerial, 0, sizeof(m3scanSerial));
 
-	if (len > 32) {
-		log_msg(LOG_INFO, "%s(): LOCO UID 0x%08lx\n", __func__, uid);
-		*id = uid;
-		return 1;
-	}
-	log_error ("%s(): failed\n", __func__);
-	return -5;
+	if (scan.overflow) log_error ("%s(): search stack overflow - the scan may be incomplete\n", __func__);
+	log_msg(LOG_INFO, "%s(): %d decoders found with %d queries in %d passes (%d lost answers)\n", __func__,
+			scan.nfound, scan.queries, scan.passes, scan.lost);
+	if (rc == 0 || scan.nfound > 0) rc = scan.nfound;
+	mutex_unlock(&mutex);
+	return rc;
+}
+
+/**
+ * Search for m3 decoders without loco address (SID) and return the found UID
+ * of the first decoder. Use sig_scanM3Locos() to find all of them.
+ *
+ * \param id	pointer to a variable that will receive the UID of the decoder, if any
+ * \return		the number of decoders found (0 or 1) or a negative error code
+ */
+int sig_searchM3Loco (uint32_t *id)
+{
+	int rc;
+
+	if (!id) return -1;
+
+	if ((rc = sig_scanM3Locos(id, 1, NULL)) == 0) log_msg(LOG_INFO, "%s(): no decoder found\n", __func__);
+	return rc;
 }
 
 /**
@@ -2250,6 +2322,7 @@ enum trackmode sig_setMode (enum trackmode mode)
 
 	if (rt.tm == TM_OVERTTEMP && mode != TM_TEMPOK && mode != TM_RESET) return rt.tm;
 
+	if (mode != rt.tm) sess_record(SESS_TRACKMODE, 0, mode, 0);
 	if (mode != rt.tm && mutex_lock(&mutex, 10, __func__)) {
 		switch (mode) {
 			case TM_STOP:
@@ -2487,10 +2560,15 @@ void vSigGeneration (void *pvParameters)
 #endif
 	fmtcfg = cnf_getFMTconfig();
 	bb = onHold = NULL;
+	wdog_register(NULL, SIG_WDOG_TIMEOUT);
 
 	for (;;) {
 		// if we could assemble a bit buffer and didn't need to put it on hold, we can just create the next one without waiting
-		if (!bb || onHold) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		if (!bb || onHold) {
+			wdog_idle();		// the interrupt will not request buffers while the track is switched off
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		}
+		wdog_kick();
 		bb = onHold;
 		onHold = NULL;
 		switch (rt.tm) {
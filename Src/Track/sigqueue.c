@@ -339,7 +339,7 @@ struct packet *sigq_funcPacket (const ldataT *l, int f)
 	switch (l->loco->fmt) {
 		case FMT_MM1_14:
 			if (f == 0) {
-				p = sigq_speedPacket(l, l->speed);
+				p = sigq_speedPacket(l, l->current);
 			} else {
 				p = sigq_genPacket(l, 0, QCMD_MM_FDFUNCS);
 			}
@@ -348,10 +348,10 @@ struct packet *sigq_funcPacket (const ldataT *l, int f)
 		case FMT_MM2_27A:
 		case FMT_MM2_27B:
 			if (f == 0) {
-				p = sigq_speedPacket(l, l->speed);
+				p = sigq_speedPacket(l, l->current);
 			} else if (f <= 4) {
 				p = sigq_genPacket(l, 0, QCMD_MM_SETF1 + f - 1);
-				if (p) p->value.i32 = l->speed & 0xFF;
+				if (p) p->value.i32 = l->current & 0xFF;
 			}
 			break;
 		case FMT_DCC_14:
@@ -359,7 +359,7 @@ struct packet *sigq_funcPacket (const ldataT *l, int f)
 		case FMT_DCC_126:
 		case FMT_DCC_SDF:
 			if (f == 0 && l->loco->fmt == FMT_DCC_14) {		// F0 is included in speed packet for the 14 speed decoders only
-				p = sigq_speedPacket(l, l->speed);
+				p = sigq_speedPacket(l, l->current);
 			} else if (f <= 4) {							// this includes F0 for 28 and 126 speed decoders
 				p = sigq_genPacket(l, 0, QCMD_DCC_SETF1_4);
 			} else if (f <= 8) {
@@ -399,7 +399,7 @@ struct packet *sigq_emergencyStopPacket (const ldataT *l)
 	if (!l || !l->loco) return NULL;				// if no sensefull information is supplied, we won't create a packet
 	if ((p = sigq_genPacket(l, 0, QCMD_EMERGENYSTOP)) != NULL) {	// this is an important information
 		if (p->repeat < 5) p->repeat = 5;					// as this is importent, repeat it at least 5 times
-		p->value.i32 = l->speed & 0x80;						// the current direction should be kept
+		p->value.i32 = l->current & 0x80;						// the current direction should be kept
 	}
 	return p;
 }
@@ -438,7 +438,7 @@ struct packet *sigq_sdfPacket (const ldataT *l)
 	if (!l || !l->loco) return NULL;				// if no sensefull information is supplied, we won't create a packet
 	if (l->loco->fmt != FMT_DCC_SDF) return NULL;
 	if ((p = sigq_genPacket(l, 0, QCMD_DCC_SDF)) != NULL) {
-		p->value.i32 = l->speed & 0xFF;
+		p->value.i32 = l->current & 0xFF;
 		p->param.i32 = l->loco->maxfunc;
 	}
 
@@ -1097,7 +1097,7 @@ static const locoT dummy = {
 
 static const ldataT dummylok = {
 	.loco = (locoT *) &dummy,
-	.speed = 0x80,
+	.current = 0x80,
 };
 
 /**
@@ -1143,7 +1143,7 @@ static struct packet* sigq_getrefresh(void)
 		switch (lok->fmt) {
 			case FMT_MM1_14:
 				// send speed (incl. F0)
-				p = sigq_speedPacket(l, l->speed);
+				p = sigq_speedPacket(l, l->current);
 				break;
 			case FMT_MM2_14:
 			case FMT_MM2_27A:
@@ -1151,13 +1151,13 @@ static struct packet* sigq_getrefresh(void)
 				switch (l->age % 5) {
 					case 0:
 						// Speed + direction (incl. F0)
-						p = sigq_speedPacket(l, l->speed);
+						p = sigq_speedPacket(l, l->current);
 						if (lok->fmt == FMT_MM2_27A) {// if we must send two packet, the current packet is inserted in front of queue
 							// to generate MM27a even speeds, we send "speed + 1" + "speed" in two packets
-							if ((l->speed & 0x7F) > 0 && (l->speed & 1) == 0) {	// this is an even speed step, so send two packets
+							if ((l->current & 0x7F) > 0 && (l->current & 1) == 0) {	// this is an even speed step, so send two packets
 								p->repeat = 2;// as with the other speed packets, this is going to be sent twice
 								sigq_insertPacket(p);// put the "real speed" packet to the front of the queue
-								p = sigq_speedPacket(l, l->speed + 1);// ... and immedeately send out the "speed+1" packet
+								p = sigq_speedPacket(l, l->current + 1);// ... and immedeately send out the "speed+1" packet
 							}
 						}
 						break;
@@ -1199,7 +1199,7 @@ static struct packet* sigq_getrefresh(void)
 					cycles++;
 				switch (l->age % cycles) {
 					case 0:						// Speed + direction (incl. F0 on 14-speed decoders)
-						p = sigq_speedPacket(l, l->speed);
+						p = sigq_speedPacket(l, l->current);
 						break;
 					case 1:						// F1 - F4 (incl. F0 on 28 and 126 speed decoders)
 						p = sigq_funcPacket(l, 1);
@@ -1229,7 +1229,7 @@ static struct packet* sigq_getrefresh(void)
 				p = sigq_genPacket(l, 0, QCMD_M3_SPEEDFUNC);
 				p->repeat = 1;					// override packet repeat count
 				if (p)
-					p->value.i32 = l->speed & 0xFF;
+					p->value.i32 = l->current & 0xFF;
 				break;
 			default:
 				return NULL;
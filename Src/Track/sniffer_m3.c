@@ -116,6 +116,7 @@ struct decoder {
 
 static QueueHandle_t timings;
 static volatile bool startup;
+static uint64_t edgeclock;				///< the sum of all edge timings in 1/10µs, used as time stamp for the records
 
 uint32_t volatile ui32DisplayFilter;	/* Bit	display
  --- DCC ---
@@ -199,6 +200,48 @@ void sniffer_stop (void)
 }
 #endif
 
+/**
+ * Publish a decoded (or rejected) packet as a sniffer record.
+ *
+ * \param fmt		the track format
+ * \param cmd		the classification of the packet
+ * \param adr		the decoder address
+ * \param valid		true if the packet passed all checks
+ * \param data		the raw packet data
+ * \param len		the number of data bytes
+ */
+static void sniffer_emit (enum srec_fmt fmt, int cmd, int adr, bool valid, const uint8_t *data, int len)
+{
+	struct srec r;
+
+	if (len > SREC_MAXDATA) len = SREC_MAXDATA;
+	r.ts = (uint32_t) (edgeclock / 10);
+	r.fmt = fmt;
+	r.cmd = cmd;
+	r.flags = (valid) ? SREC_FLAG_VALID : 0;
+	r.adr = adr;
+	r.len = len;
+	memcpy (r.data, data, len);
+	sniffer_publish(&r);
+}
+
+/**
+ * Publish a MM packet. The payload consists of the 18 bits of both halves
+ * (MSB first, three bytes each).
+ */
+static void sniffer_emitMM (struct mm_packet *p, int cmd, int adr, bool valid)
+{
+	uint8_t data[6];
+
+	data[0] = (p->data1 >> 16) & 0xFF;
+	data[1] = (p->data1 >> 8) & 0xFF;
+	data[2] = p->data1 & 0xFF;
+	data[3] = (p->data2 >> 16) & 0xFF;
+	data[4] = (p->data2 >> 8) & 0xFF;
+	data[5] = p->data2 & 0xFF;
+	sniffer_emit(SREC_FMT_MM, cmd, adr, valid, data, sizeof(data));
+}
+
 #if DEBUG_ONLY
 static void dcc_basicspeed (int adr, uint8_t *d, int len)
 {
@@ -283,10 +326,10 @@ static bool dcc_interpret(struct dcc_packet *p)
 	uint8_t *d, xor;
 	bool loco = false;
 	uint32_t newfuncs;
-	int i;
+	int i, cmd;
 
-	if (p->len < 3) {
-		log_error("%s(): packet too short!\n", __func__);
+	if (p->len < 3) {			// packet too short - no log output, the record carries the information
+		sniffer_emit(SREC_FMT_DCC, SREC_CMD_OTHER, 0, false, p->data, p->len);
 		return false;
 	}
 
@@ -294,10 +337,9 @@ static bool dcc_interpret(struct dcc_packet *p)
 	for (i = 0, xor = 0; i < p->len; i++) {
 		xor ^= *d++;
 	}
-	if (xor) {
-		log_error("%s(): packet XOR ERROR!\n", __func__);
-		return false;
-	}
+	cmd = srec_dccClassify(p->data, p->len, &adr);
+	sniffer_emit(SREC_FMT_DCC, cmd, adr, !xor, p->data, p->len);
+	if (xor) return false;
 
 	adr = p->data[0];
 	d = &p->data[1];
@@ -305,7 +347,7 @@ static bool dcc_interpret(struct dcc_packet *p)
 	dec = NULL;
 #endif
 	if (adr == 0) {					// broadcast
-		log_msg(LOG_INFO, "%s(): BROADCAST loco decoders\n", __func__);
+		// nothing to do - broadcasts are only reported as sniffer records
 	} else if (adr <= 127) {		// short address mobile decoder
 //		log_msg (LOG_INFO, "%s(): SHORT Address: %d / loco decoder\n", __func__, adr);
 		loco = true;
@@ -333,7 +375,7 @@ static bool dcc_interpret(struct dcc_packet *p)
 		dec = dcc_mobile;
 #endif
 	} else if (adr <= 254) {		// reserved address range
-		log_msg(LOG_INFO, "%s(): RESERVED Address: %d\n", __func__, adr);
+		// nothing to do - packets to reserved addresses are only reported as sniffer records
 	} else {	// adr == 255		// idle address
 //		log_msg (LOG_INFO, "%s(): ILDE Address: %d\n", __func__, adr);
 	}
@@ -504,11 +546,9 @@ static bool dcc_interpret(struct dcc_packet *p)
 
 			case 0xE0:
 				//--------------------- POM --------------------------------------
-				log_msg(LOG_INFO, "programming on main\n");
 				break;
 
-			default:
-				log_msg(LOG_WARNING, " I don't know...\n");
+			default:		// unknown instructions are only reported as sniffer records
 				break;
 		}
 	}
@@ -667,7 +707,7 @@ static uint8_t mm_funcHandler (int adr, int f, uint8_t funcs, bool on)
 
 	if (on) funcs |= mask;
 	else funcs &= ~mask;
-	loco_setFunc(adr, f, on);
+	rq_setFuncMasked(adr, (on) ? FUNC(f) : 0, FUNC(f));
 	if (LOCOMM) printf(" F%d: %s", f, (on) ? "on" : "off");
 	return funcs;
 }
@@ -681,9 +721,8 @@ static bool mm_interpret(struct mm_packet *p)
 #if DEBUG_ONLY
 	uint8_t abcd, efgh;
 #endif
-	if (p->data1 != p->data2) {
-		log_error("%s(): data mismatch: 0x%05lx <> 0x%05lx\n", __func__,
-		        p->data1, p->data2);
+	if (p->data1 != p->data2) {	// the record carries both halves for analysis
+		sniffer_emitMM(p, SREC_CMD_OTHER, MM_revtable[(p->data1 >> 10) & 0xFF], false);
 		return false;
 	}
 
@@ -811,8 +850,10 @@ static bool mm_interpret(struct mm_packet *p)
 				else DEBUG(ACCMM, "%s(): Address: %03d / unknown control code 0x%02x\n", __func__, adr, ui8MM_DATA);
 				break;
 		}
+		sniffer_emitMM(p, SREC_CMD_ACC, adr, true);
 		if (ui8) trnt_switch(adr, ui8 & 1, 1);
 	} else {				// loco
+		sniffer_emitMM(p, SREC_CMD_SPEED, adr, true);
 		if ((l = loco_call(adr, true)) == NULL) return false;
 		bDirection = (l->speed & 0x80) ? 1 : 0;
 		if (LOCOMM) log_msg(LOG_INFO, "%s(): Address: %03d\n", __func__, adr);
@@ -896,21 +937,21 @@ static bool mm_interpret(struct mm_packet *p)
 				if (ui8MM_DATA & 0x20) {			// ist F4
 					if (ui8MM_DATA & 0x80) {
 						ui8Func |= 0x20;			// F4 on
-						loco_setFunc(adr, 4, true);
+						rq_setFuncMasked(adr, FUNC(4), FUNC(4));
 						if (LOCOMM) printf(" F4: on");
 					} else {
 						ui8Func &= ~0x20;			// F4 off
-						loco_setFunc(adr, 4, false);
+						rq_setFuncMasked(adr, 0, FUNC(4));
 						if (LOCOMM) printf(" F4: off");
 					}
 				} else {							// ist F1
 					if (ui8MM_DATA & 0x80) {
 						ui8Func |= 0x04;			// F1 on
-						loco_setFunc(adr, 1, true);
+						rq_setFuncMasked(adr, FUNC(1), FUNC(1));
 						if (LOCOMM) printf(" F1: on");
 					} else {
 						ui8Func &= ~0x04;			// F1 off
-						loco_setFunc(adr, 1, false);
+						rq_setFuncMasked(adr, 0, FUNC(1));
 						if (LOCOMM) printf(" F1: off");
 					}
 				}
@@ -920,11 +961,11 @@ static bool mm_interpret(struct mm_packet *p)
 				if (ui8MM_DATA & 0x20) {			// ist F2
 					if (ui8MM_DATA & 0x80) {
 						ui8Func |= 0x08;			// F2 on
-						loco_setFunc(adr, 2, true);
+						rq_setFuncMasked(adr, FUNC(2), FUNC(2));
 						if (LOCOMM) printf(" F2: on");
 					} else {
 						ui8Func &= ~0x08;			// F2 off
-						loco_setFunc(adr, 2, false);
+						rq_setFuncMasked(adr, 0, FUNC(2));
 						if (LOCOMM) printf(" F2: off");
 					}
 				}
@@ -932,11 +973,11 @@ static bool mm_interpret(struct mm_packet *p)
 				if (ui8MM_DATA & 0x20) {			//ist F3
 					if (ui8MM_DATA & 0x80) {
 						ui8Func |= 0x10;			//F3 on
-						loco_setFunc(adr, 3, true);
+						rq_setFuncMasked(adr, FUNC(3), FUNC(3));
 						if (LOCOMM) printf(" F3: on");
 					} else {
 						ui8Func &= ~0x10;			//F3 off
-						loco_setFunc(adr, 3, false);
+						rq_setFuncMasked(adr, 0, FUNC(3));
 						if (LOCOMM) printf(" F3: off");
 					}
 				}
@@ -1137,6 +1178,8 @@ void sniffer(void *pvParameter)
 	(void) pvParameter;
 
 	log_msg(LOG_INFO, "%s(): STARTUP\n", __func__);
+	loco_setClient(OWN_TOKEN(OWN_SNIFFER, 0));
+	sniffer_streamStart();
 	init_tim2();
 	timings = xQueueCreate(QUEUE_LENGTH, sizeof(uint32_t));
 	if (timings == NULL) {
@@ -1154,6 +1197,7 @@ void sniffer(void *pvParameter)
 				t = 0;
 				startup = false;
 			}
+			edgeclock += t;
 			valid = false;
 			valid |= sniffer_dcc(t);
 			valid |= sniffer_mm(t);
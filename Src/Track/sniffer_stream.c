@@ -0,0 +1,249 @@
+/*
+ * sniffer_stream.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Distribution of the sniffer records to TCP clients and a capture file
+ *
+ * The sniffer task publishes each decoded packet as a struct srec to a ring
+ * buffer. Any number of readers (TCP clients and the file capture) can read
+ * from that ring at their own pace. A reader that is too slow will receive
+ * an overrun marker instead of the lost records.
+ *
+ * TCP clients connect to SNIFFER_PORT and get a continous stream of binary
+ * records (see snifferrec.c for the format). A client may send text lines
+ * to change its filter settings at any time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rb2.h"
+#include "decoder.h"
+#include "snifferrec.h"
+#include "yaffsfs.h"
+#include "lwip/sockets.h"
+
+#define SNIFFER_PORT			5551		///< the TCP port for streaming the records
+#define SNIFFER_STACK			1024		///< stack size of the client threads
+#define SNIFFER_PRIO			1			///< the priority of the client threads
+#define SNIFFER_POLL			20			///< time in ms between two polls of the ring buffer
+#define SNIFFER_CAPTURE			"/sniffer.bin"			///< the file for capturing records
+#define SNIFFER_CAPTURE_MAX		(4 * 1024 * 1024)		///< the maximum size of the capture file
+
+static SemaphoreHandle_t mutex;
+static struct srec_ring *ring;
+static volatile bool capture;			///< set to request a running capture, cleared to stop it
+static TaskHandle_t capture_task;
+
+/**
+ * Publish a record to the ring buffer. The first call allocates the ring.
+ * If the ring cannot be locked in a short time, the record is dropped
+ * because the sniffer must not be blocked.
+ *
+ * \param r			the record to publish
+ */
+void sniffer_publish (const struct srec *r)
+{
+	if (!ring) {
+		if ((ring = calloc(1, sizeof(*ring))) == NULL) return;
+		srec_ringInit(ring);
+	}
+	if (mutex_lock(&mutex, 5, __func__)) {
+		srec_ringPut(ring, r);
+		mutex_unlock(&mutex);
+	}
+}
+
+/**
+ * Read the next record that passes the given filter.
+ *
+ * \param seq		the sequence number of the reader
+ * \param f			the filter of this reader
+ * \param r			where to store the record
+ * \return			true, if a record was returned
+ */
+static bool sniffer_read (uint32_t *seq, const struct srec_filter *f, struct srec *r)
+{
+	bool rc = false;
+
+	if (!ring) return false;
+	if (!mutex_lock(&mutex, 20, __func__)) return false;
+	while (srec_ringGet(ring, seq, r)) {
+		if (srec_match(f, r)) {
+			rc = true;
+			break;
+		}
+	}
+	mutex_unlock(&mutex);
+	return rc;
+}
+
+static uint32_t sniffer_head (void)
+{
+	uint32_t head = 0;
+
+	if (ring && mutex_lock(&mutex, 20, __func__)) {
+		head = ring->head;
+		mutex_unlock(&mutex);
+	}
+	return head;
+}
+
+/**
+ * Check for filter settings sent by the client. Lines are terminated by
+ * CR and/or LF.
+ *
+ * \param sock		the client socket
+ * \param f			the filter of this client
+ * \param line		the line buffer
+ * \param idx		pointer to the current fill level of the line buffer
+ * \param size		the size of the line buffer
+ */
+static void sniffer_clientCommand (int sock, struct srec_filter *f, char *line, int *idx, int size)
+{
+	char *eol;
+	int rc;
+
+	if ((rc = lwip_recv(sock, line + *idx, size - *idx - 1, MSG_DONTWAIT)) <= 0) return;
+	*idx += rc;
+	line[*idx] = 0;
+	while ((eol = strpbrk(line, "\r\n")) != NULL) {
+		*eol++ = 0;
+		if (*line && !srec_parseFilter(f, line)) {
+			log_msg (LOG_WARNING, "%s() filter '%s' not accepted\n", __func__, line);
+		}
+		while (*eol == '\r' || *eol == '\n') eol++;
+		*idx -= eol - line;
+		memmove (line, eol, *idx + 1);
+	}
+	if (*idx >= size - 1) *idx = 0;		// overlong line - discard it
+}
+
+static void sniffer_client (void *pvParameter)
+{
+	struct srec_filter f;
+	struct srec r;
+	uint8_t buf[8 * SREC_MAXSIZE];
+	char line[128];
+	uint32_t seq;
+	int sock, len, idx, rc;
+
+	sock = (int) pvParameter;
+	srec_filterAll(&f);
+	seq = sniffer_head();
+	idx = 0;
+
+	log_msg (LOG_INFO, "%s() client connected\n", __func__);
+	while (tcp_checkSocket(sock)) {
+		sniffer_clientCommand(sock, &f, line, &idx, sizeof(line));
+		len = 0;
+		while ((len + SREC_MAXSIZE) <= (int) sizeof(buf) && sniffer_read(&seq, &f, &r)) {
+			len += srec_encode(&r, buf + len, sizeof(buf) - len);
+		}
+		if (len > 0) {
+			if ((rc = lwip_send(sock, buf, len, 0)) != len) {
+				log_error ("%s() send failed (%d)\n", __func__, rc);
+				break;
+			}
+		} else {
+			vTaskDelay(SNIFFER_POLL);
+		}
+	}
+
+	lwip_close(sock);
+	log_msg (LOG_INFO, "%s() client disconnected\n", __func__);
+	vTaskDelete(NULL);
+}
+
+static void sniffer_captureThread (void *pvParameter)
+{
+	struct srec_filter f;
+	struct srec r;
+	uint8_t buf[16 * SREC_MAXSIZE];
+	uint32_t seq;
+	int fd, len, total;
+
+	(void) pvParameter;
+
+	if ((fd = yaffs_open(SNIFFER_CAPTURE, O_CREAT | O_WRONLY | O_TRUNC, S_IREAD | S_IWRITE)) < 0) {
+		log_error ("%s() cannot create '%s'\n", __func__, SNIFFER_CAPTURE);
+		capture = false;
+		capture_task = NULL;
+		vTaskDelete(NULL);
+	}
+
+	log_msg (LOG_INFO, "%s() capturing to '%s'\n", __func__, SNIFFER_CAPTURE);
+	srec_filterAll(&f);
+	f.cmdmask &= ~(1 << SREC_CMD_IDLE);		// idle packets would just fill up the file
+	seq = sniffer_head();
+	total = 0;
+	while (capture && total < SNIFFER_CAPTURE_MAX) {
+		len = 0;
+		while ((len + SREC_MAXSIZE) <= (int) sizeof(buf) && sniffer_read(&seq, &f, &r)) {
+			len += srec_encode(&r, buf + len, sizeof(buf) - len);
+		}
+		if (len > 0) {
+			if (yaffs_write(fd, buf, len) != len) {
+				log_error ("%s() write error - capture stopped\n", __func__);
+				break;
+			}
+			total += len;
+		}
+		vTaskDelay(SNIFFER_POLL * 5);
+	}
+
+	yaffs_close(fd);
+	log_msg (LOG_INFO, "%s() capture finished (%d bytes)\n", __func__, total);
+	capture = false;
+	capture_task = NULL;
+	vTaskDelete(NULL);
+}
+
+/**
+ * Start or stop capturing the sniffer records to a file.
+ *
+ * \param on		true to start a new capture (truncating the old file), false to stop
+ */
+void sniffer_capture (bool on)
+{
+	if (on && !capture_task) {
+		capture = true;
+		xTaskCreate(sniffer_captureThread, "SNIFF-CAP", SNIFFER_STACK, NULL, SNIFFER_PRIO, &capture_task);
+	} else if (!on) {
+		capture = false;
+	}
+}
+
+bool sniffer_isCapturing (void)
+{
+	return capture;
+}
+
+int sniffer_streamStart (void)
+{
+	return tcpsrv_startserver(SNIFFER_PORT, sniffer_client, SNIFFER_STACK, SNIFFER_PRIO);
+}
@@ -0,0 +1,389 @@
+/*
+ * snifferrec.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Structured records of the track sniffer
+ *
+ * Each packet that the sniffer decodes is put into a struct srec. These
+ * records are kept in a ring buffer and can be streamed to PC tools or
+ * captured to a file in a compact binary form:
+ *
+ * <pre>
+ *   offset  size  content
+ *     0      1    SREC_SYNC (0xA5)
+ *     1      1    total length of this record (header + payload)
+ *     2      1    bits 0..3: format (enum srec_fmt), bits 4..7: flags (SREC_FLAG_xxx)
+ *     3      1    command classification (enum srec_cmd)
+ *     4      4    time stamp in µs (little endian)
+ *     8      2    address (little endian)
+ *    10      n    payload (the raw packet bytes)
+ * </pre>
+ *
+ * The filters are set by a simple text line of whitespace separated
+ * settings, e.g. "fmt=dcc,mm adr=3-10 cmd=speed,func valid=1". A line
+ * containing "all" resets the filter to pass everything.
+ *
+ * sniffer_m3.c converts the decoded packets to records and sniffer_stream.c
+ * does the output, the filter and the ring only work on those records. They
+ * are covered by Tests/snifferrec_test.c.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "snifferrec.h"
+
+static const char * const fmtnames[] = { "none", "dcc", "mm", "m3" };
+static const char * const cmdnames[] = {
+	"other", "idle", "broadcast", "speed", "func", "acc", "extacc", "pom", "lost"
+};
+
+/**
+ * Encode a record to the binary stream format.
+ *
+ * \param r			the record to encode
+ * \param buf		the buffer to write the encoded record to
+ * \param size		the size of the buffer
+ * \return			the number of bytes written or 0 if the buffer is too small
+ */
+int srec_encode (const struct srec *r, uint8_t *buf, int size)
+{
+	int len;
+
+	if (!r || !buf || r->len > SREC_MAXDATA) return 0;
+	len = SREC_HEADER + r->len;
+	if (size < len) return 0;
+
+	buf[0] = SREC_SYNC;
+	buf[1] = len;
+	buf[2] = (r->fmt & 0x0F) | (r->flags & 0xF0);
+	buf[3] = r->cmd;
+	buf[4] = r->ts & 0xFF;
+	buf[5] = (r->ts >> 8) & 0xFF;
+	buf[6] = (r->ts >> 16) & 0xFF;
+	buf[7] = (r->ts >> 24) & 0xFF;
+	buf[8] = r->adr & 0xFF;
+	buf[9] = (r->adr >> 8) & 0xFF;
+	memcpy (&buf[SREC_HEADER], r->data, r->len);
+	return len;
+}
+
+/**
+ * Decode a record from the binary stream format. This is the counterpart
+ * to srec_encode() and mainly used for reading back captures.
+ *
+ * \param buf		the buffer containing the encoded record
+ * \param len		the number of bytes available in the buffer
+ * \param r			the record to fill
+ * \return			the number of bytes consumed, 0 if the record is not
+ * 					yet complete or -1 if the buffer doesn't start with a valid record
+ */
+int srec_decode (const uint8_t *buf, int len, struct srec *r)
+{
+	int reclen;
+
+	if (!buf || !r) return -1;
+	if (len < 2) return 0;
+	if (buf[0] != SREC_SYNC) return -1;
+	reclen = buf[1];
+	if (reclen < SREC_HEADER || reclen > SREC_MAXSIZE) return -1;
+	if (len < reclen) return 0;
+
+	r->fmt = buf[2] & 0x0F;
+	r->flags = buf[2] & 0xF0;
+	r->cmd = buf[3];
+	r->ts = buf[4] | (buf[5] << 8) | (buf[6] << 16) | ((uint32_t) buf[7] << 24);
+	r->adr = buf[8] | (buf[9] << 8);
+	r->len = reclen - SREC_HEADER;
+	memcpy (r->data, &buf[SREC_HEADER], r->len);
+	return reclen;
+}
+
+/**
+ * Classify a DCC packet and extract the decoder address. The address
+ * numbering follows the one used by the sniffer for its text output.
+ *
+ * \param data		the packet bytes including the XOR byte
+ * \param len		the number of bytes in the packet
+ * \param adr		where to store the decoded address (may be NULL)
+ * \return			the packet classification as enum srec_cmd
+ */
+int srec_dccClassify (const uint8_t *data, int len, uint16_t *adr)
+{
+	uint16_t a = 0;
+	int cmd = SREC_CMD_OTHER;
+	const uint8_t *d;
+
+	if (!data || len < 3) {
+		if (adr) *adr = 0;
+		return SREC_CMD_OTHER;
+	}
+
+	a = data[0];
+	d = &data[1];
+	if (a == 0) {							// broadcast
+		cmd = SREC_CMD_BROADCAST;
+	} else if (a <= 127) {					// short address mobile decoder
+		cmd = -1;
+	} else if (a <= 191) {					// basic and extended accessory decoder
+		a = ((a & 0x3F) << 2) | (((*d & 0x70) ^ 0x70) << 4) | ((*d & 0x06) >> 1);
+		if (*d & 0x80) {
+			a >>= 2;
+			cmd = SREC_CMD_ACC;
+		} else {
+			cmd = SREC_CMD_EXTACC;
+		}
+	} else if (a <= 231) {					// long address mobile decoder
+		if (len < 4) {
+			a = 0;
+		} else {
+			a = (a & 0x3F) << 8 | *d++;
+			cmd = -1;
+		}
+	} else if (a == 255) {					// idle packet
+		a = 0;
+		cmd = SREC_CMD_IDLE;
+	} else {								// reserved address range
+		a = 0;
+	}
+
+	if (cmd < 0) {							// mobile decoder - look at the instruction byte
+		cmd = SREC_CMD_OTHER;
+		switch (*d & 0xE0) {
+			case 0x20:
+				if (*d == 0x3F || *d == 0x3C) cmd = SREC_CMD_SPEED;
+				break;
+			case 0x40:
+			case 0x60:
+				cmd = SREC_CMD_SPEED;
+				break;
+			case 0x80:
+			case 0xA0:
+				cmd = SREC_CMD_FUNC;
+				break;
+			case 0xC0:
+				if (*d == 0xDE || *d == 0xDF || (*d >= 0xD8 && *d <= 0xDC)) cmd = SREC_CMD_FUNC;
+				break;
+			case 0xE0:
+				cmd = SREC_CMD_POM;
+				break;
+		}
+	}
+
+	if (adr) *adr = a;
+	return cmd;
+}
+
+/**
+ * Reset a filter to pass all records.
+ *
+ * \param f			the filter to reset
+ */
+void srec_filterAll (struct srec_filter *f)
+{
+	if (!f) return;
+	f->fmtmask = 0xFF;
+	f->cmdmask = 0xFFFF;
+	f->adrmin = 0;
+	f->adrmax = 0xFFFF;
+	f->validonly = false;
+}
+
+static int srec_lookupName (const char * const *names, int cnt, const char *s, int len)
+{
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		if ((int) strlen(names[i]) == len && !strncasecmp(names[i], s, len)) return i;
+	}
+	return -1;
+}
+
+/**
+ * Parse a comma separated list of names into a bitmask.
+ *
+ * \param names		the table of known names, the index is the bit number
+ * \param cnt		the number of entries in the table
+ * \param s			the list to parse
+ * \param len		the length of the list
+ * \param mask		where to store the resulting mask
+ * \return			true, if all names in the list were known
+ */
+static bool srec_parseList (const char * const *names, int cnt, const char *s, int len, uint32_t *mask)
+{
+	const char *end = s + len;
+	const char *p;
+	int idx;
+
+	*mask = 0;
+	while (s < end) {
+		for (p = s; p < end && *p != ','; p++) ;
+		if ((p - s) == 3 && !strncasecmp(s, "all", 3)) {
+			*mask = 0xFFFFFFFF;
+		} else {
+			if ((idx = srec_lookupName(names, cnt, s, p - s)) < 0) return false;
+			*mask |= 1 << idx;
+		}
+		s = p + 1;
+	}
+	return true;
+}
+
+/**
+ * Parse a filter setting line. Only the settings that are found in the line
+ * are changed. If any setting is not understood, the filter is left untouched.
+ *
+ * \param f			the filter to change
+ * \param line		the line with the filter settings
+ * \return			true, if the line was accepted
+ */
+bool srec_parseFilter (struct srec_filter *f, const char *line)
+{
+	struct srec_filter tmp;
+	const char *s, *val;
+	uint32_t mask;
+	char *end;
+	long a1, a2;
+	int len, vlen;
+
+	if (!f || !line) return false;
+
+	tmp = *f;
+	s = line;
+	for (;;) {
+		while (isspace((unsigned char) *s)) s++;
+		if (!*s) break;
+		for (len = 0; s[len] && !isspace((unsigned char) s[len]); len++) ;
+		if (len == 3 && !strncasecmp(s, "all", 3)) {
+			srec_filterAll(&tmp);
+			s += len;
+			continue;
+		}
+		if ((val = memchr(s, '=', len)) == NULL) return false;
+		val++;
+		vlen = len - (val - s);
+		if (!strncasecmp(s, "fmt=", 4)) {
+			if (!srec_parseList(fmtnames, sizeof(fmtnames) / sizeof(fmtnames[0]), val, vlen, &mask)) return false;
+			tmp.fmtmask = mask | (1 << SREC_FMT_NONE);
+		} else if (!strncasecmp(s, "cmd=", 4)) {
+			if (!srec_parseList(cmdnames, sizeof(cmdnames) / sizeof(cmdnames[0]), val, vlen, &mask)) return false;
+			tmp.cmdmask = mask | (1 << SREC_CMD_LOST);
+		} else if (!strncasecmp(s, "adr=", 4)) {
+			a1 = strtol(val, &end, 10);
+			if (end == val) return false;
+			a2 = a1;
+			if (*end == '-') {
+				val = end + 1;
+				a2 = strtol(val, &end, 10);
+				if (end == val) return false;
+			}
+			if (end != s + len || a1 < 0 || a2 < a1 || a2 > 0xFFFF) return false;
+			tmp.adrmin = a1;
+			tmp.adrmax = a2;
+		} else if (!strncasecmp(s, "valid=", 6)) {
+			tmp.validonly = (*val == '1');
+		} else {
+			return false;
+		}
+		s += len;
+	}
+
+	*f = tmp;
+	return true;
+}
+
+/**
+ * Check a record against a filter. The overrun marker always passes.
+ *
+ * \param f			the filter to apply (NULL lets everything pass)
+ * \param r			the record to check
+ * \return			true, if the record passes the filter
+ */
+bool srec_match (const struct srec_filter *f, const struct srec *r)
+{
+	if (!r) return false;
+	if (!f || r->cmd == SREC_CMD_LOST) return true;
+	if (r->fmt > 7 || !(f->fmtmask & (1 << r->fmt))) return false;
+	if (r->cmd > 15 || !(f->cmdmask & (1 << r->cmd))) return false;
+	if (r->adr < f->adrmin || r->adr > f->adrmax) return false;
+	if (f->validonly && !(r->flags & SREC_FLAG_VALID)) return false;
+	return true;
+}
+
+void srec_ringInit (struct srec_ring *ring)
+{
+	if (ring) ring->head = 0;
+}
+
+/**
+ * Put a record to the ring. The oldest record is silently overwritten.
+ *
+ * \param ring		the ring buffer
+ * \param r			the record to append
+ */
+void srec_ringPut (struct srec_ring *ring, const struct srec *r)
+{
+	if (!ring || !r) return;
+	ring->rec[ring->head & (SREC_RINGSIZE - 1)] = *r;
+	ring->head++;
+}
+
+/**
+ * Get the next record from the ring. If the reader was overrun by the
+ * writer, an overrun marker (SREC_CMD_LOST) is returned that carries the
+ * number of lost records in the address field and the sequence number is
+ * advanced to the oldest record still available.
+ *
+ * To start reading only new records, a reader should initialise its
+ * sequence number with the current head of the ring.
+ *
+ * \param ring		the ring buffer
+ * \param seq		the sequence number of the reader, advanced on success
+ * \param r			where to store the record
+ * \return			1 if a record (or overrun marker) was returned, 0 if no new record is available
+ */
+int srec_ringGet (const struct srec_ring *ring, uint32_t *seq, struct srec *r)
+{
+	uint32_t lost;
+
+	if (!ring || !seq || !r) return 0;
+	if (*seq == ring->head) return 0;
+
+	if ((lost = ring->head - *seq) > SREC_RINGSIZE) {
+		lost -= SREC_RINGSIZE;
+		*seq += lost;
+		memset (r, 0, sizeof(*r));
+		r->fmt = SREC_FMT_NONE;
+		r->cmd = SREC_CMD_LOST;
+		r->adr = (lost > 0xFFFF) ? 0xFFFF : lost;
+		return 1;
+	}
+	*r = ring->rec[*seq & (SREC_RINGSIZE - 1)];
+	(*seq)++;
+	return 1;
+}
@@ -0,0 +1,493 @@
+/*
+ * archive.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief The archive format of a backup of the station
+ *
+ * A backup is a cpio archive in the "new ASCII" format with checksums
+ * (magic "070702"), so it can be unpacked with the standard tools on a PC
+ * (i.e. "cpio -idv < backup.cpio"). The checksum of each member is the sum
+ * of all bytes of its contents.
+ *
+ * The first member is the manifest ARC_MANIFEST, a small text file with one
+ * "key=value" per line:
+ *
+ * <pre>
+ *   version=1
+ *   serial=12345
+ *   firmware=1.4.2
+ *   areas=config,userimages
+ * </pre>
+ *
+ * An area is a top level directory of the file system that is completely
+ * contained in the archive. All other members must lie in one of the areas
+ * listed in the manifest. A restore replaces each of these areas as a whole,
+ * so files that were created after the backup are removed, too. Unknown keys
+ * are ignored to allow later versions to add information.
+ *
+ * The reader gets the archive in chunks as they are received from the network
+ * and checks each member before it is reported to the handler. A member is
+ * only completed (by the end() callback) after its checksum was verified.
+ * Any error stops the reading and the caller should discard everything that
+ * was stored so far.
+ *
+ * The socket and the file system stay in backup.c, which passes the
+ * received chunks to the reader. Tests/archive_test.c builds archives with
+ * the same functions and damages them on purpose.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "backup.h"
+
+enum state {
+	ST_HEADER = 0,				///< reading the fixed part of the header
+	ST_NAME,					///< reading the name including its padding
+	ST_DATA,					///< reading the contents of the member
+	ST_PAD,						///< skipping the padding after the contents
+	ST_DONE,					///< the trailer was read
+	ST_ERROR,					///< an error occurred
+};
+
+/**
+ * The top level directories that are saved and restored
+ */
+static const char * const areas[] = {
+	"config",					///< CONFIG_DIR - system settings, loco and accessory database, BiDiB setup
+	"userimages",				///< the icons that were uploaded by the user
+	NULL
+};
+
+static const char * const errors[ARC_ERRORS] = {
+	[ARC_OK] =			"OK",
+	[ARC_EFORMAT] =		"invalid archive format",
+	[ARC_EMANIFEST] =	"invalid or missing manifest",
+	[ARC_EVERSION] =	"archive was written by a newer firmware",
+	[ARC_EPATH] =		"illegal path in archive",
+	[ARC_ETYPE] =		"unsupported file type in archive",
+	[ARC_ECHECKSUM] =	"checksum error",
+	[ARC_ETRUNCATED] =	"archive is truncated",
+	[ARC_EWRITE] =		"cannot store file",
+};
+
+/**
+ * Get the name of an area.
+ *
+ * \param idx		the number of the area (starting with 0)
+ * \return			the name of the directory (without slashes) or NULL if there are no more areas
+ */
+const char *arc_area (int idx)
+{
+	int i;
+
+	for (i = 0; areas[i]; i++) {
+		if (i == idx) return areas[i];
+	}
+	return NULL;
+}
+
+/**
+ * Add the contents of a buffer to a checksum.
+ *
+ * \param sum		the checksum so far (start with 0)
+ * \param buf		the data
+ * \param len		the number of bytes in the buffer
+ * \return			the new checksum
+ */
+uint32_t arc_checksum (uint32_t sum, const uint8_t *buf, int len)
+{
+	while (len-- > 0) sum += *buf++;
+	return sum;
+}
+
+/**
+ * Get the number of bytes needed to align a length to four bytes.
+ *
+ * \param size		the length
+ * \return			the number of padding bytes (0 to 3)
+ */
+int arc_padding (uint32_t size)
+{
+	return (4 - (size & 3)) & 3;
+}
+
+/**
+ * Write a header including the name and its padding. The contents of the
+ * member must follow with arc_padding(fsize) zero bytes after it.
+ *
+ * \param buf		the buffer to write the header to
+ * \param size		the size of the buffer
+ * \param ino		a number that is unique for each member (the inode number for the tools on a PC)
+ * \param name		the name of the member (without leading slash)
+ * \param mode		the file type and permissions (see ARC_IFMT)
+ * \param fsize		the size of the contents
+ * \param mtime		the modification time
+ * \param check		the checksum of the contents (see arc_checksum())
+ * \return			the number of bytes written or 0 if the buffer is too small
+ */
+int arc_header (char *buf, int size, uint32_t ino, const char *name, uint32_t mode, uint32_t fsize, uint32_t mtime, uint32_t check)
+{
+	int namesize, len;
+
+	if (!buf || !name) return 0;
+	namesize = strlen(name) + 1;
+	len = ARC_HDRSIZE + namesize;
+	len += arc_padding(len);
+	if (len > size) return 0;
+
+	sprintf (buf, "%s%08lX%08lX%08lX%08lX%08lX%08lX%08lX%08lX%08lX%08lX%08lX%08lX%08lX", ARC_MAGIC,
+			(unsigned long) ino, (unsigned long) mode, 0ul, 0ul, ((mode & ARC_IFMT) == ARC_IFDIR) ? 2ul : 1ul,
+			(unsigned long) mtime, (unsigned long) fsize, 0ul, 0ul, 0ul, 0ul, (unsigned long) namesize, (unsigned long) check);
+	memset (buf + ARC_HDRSIZE, 0, len - ARC_HDRSIZE);
+	memcpy (buf + ARC_HDRSIZE, name, namesize);
+	return len;
+}
+
+/**
+ * Write the contents of the manifest.
+ *
+ * \param buf		the buffer to write the manifest to
+ * \param size		the size of the buffer
+ * \param info		the information to put in the manifest
+ * \return			the length of the manifest or 0 if the buffer is too small
+ */
+int arc_manifest (char *buf, int size, const struct arc_info *info)
+{
+	int i, len;
+
+	if (!buf || !info) return 0;
+	len = snprintf (buf, size, "version=%d\nserial=%lu\nfirmware=%s\nareas=", info->version, (unsigned long) info->serial, info->firmware);
+	for (i = 0; areas[i] && len < size; i++) {
+		if (!(info->areas & (1 << i))) continue;
+		len += snprintf (buf + len, size - len, "%s%s", (buf[len - 1] == '=') ? "" : ",", areas[i]);
+	}
+	if (len < size) len += snprintf (buf + len, size - len, "\n");
+	return (len < size) ? len : 0;
+}
+
+static uint32_t arc_parseAreas (const char *s, int len)
+{
+	const char *e;
+	uint32_t mask;
+	int i, n;
+
+	mask = 0;
+	while (len > 0) {
+		for (e = s; e < s + len && *e != ','; e++) ;
+		n = e - s;
+		for (i = 0; areas[i]; i++) {
+			if ((int) strlen(areas[i]) == n && !strncmp(areas[i], s, n)) break;
+		}
+		if (!areas[i]) return 0;				// an unknown area cannot be restored
+		mask |= 1 << i;
+		len -= n + 1;
+		s = e + 1;
+	}
+	return mask;
+}
+
+/**
+ * Interpret the contents of the manifest.
+ *
+ * \param buf		the contents of the manifest (need not be null terminated)
+ * \param len		the length of the manifest
+ * \param info		where to store the information
+ * \return			true, if the manifest is complete and only names known areas
+ */
+bool arc_parseManifest (const char *buf, int len, struct arc_info *info)
+{
+	const char *line, *end, *eq;
+	int n;
+
+	if (!buf || !info) return false;
+	memset (info, 0, sizeof(*info));
+
+	for (line = buf; line < buf + len; line = end + 1) {
+		for (end = line; end < buf + len && *end != '\n'; end++) ;
+		n = end - line;
+		if (n > 0 && line[n - 1] == '\r') n--;
+		if ((eq = memchr(line, '=', n)) == NULL) continue;
+		if (eq - line == 7 && !strncmp(line, "version", 7)) {
+			info->version = atoi(eq + 1);
+		} else if (eq - line == 6 && !strncmp(line, "serial", 6)) {
+			info->serial = strtoul(eq + 1, NULL, 10);
+		} else if (eq - line == 8 && !strncmp(line, "firmware", 8)) {
+			snprintf (info->firmware, sizeof(info->firmware), "%.*s", (int) (line + n - eq - 1), eq + 1);
+		} else if (eq - line == 5 && !strncmp(line, "areas", 5)) {
+			if ((info->areas = arc_parseAreas(eq + 1, line + n - eq - 1)) == 0) return false;
+		}
+	}
+	return info->version > 0 && info->areas != 0;
+}
+
+/**
+ * Check a member name. It must be relative, must not contain empty path
+ * components, "." or ".." and must lie in one of the given areas (or be the
+ * directory of the area itself).
+ *
+ * \param name		the name of the member
+ * \param mask		a bitmask of the allowed areas
+ * \return			true, if the name is acceptable
+ */
+bool arc_pathAllowed (const char *name, uint32_t mask)
+{
+	const char *s, *comp;
+	int i, len;
+
+	if (!name || !*name || strlen(name) >= ARC_NAMELEN) return false;
+
+	for (i = 0; areas[i]; i++) {
+		if (!(mask & (1 << i))) continue;
+		len = strlen(areas[i]);
+		if (!strncmp(name, areas[i], len) && (name[len] == '/' || name[len] == 0)) break;
+	}
+	if (!areas[i]) return false;
+
+	comp = name;
+	for (s = name; ; s++) {
+		if (*s == '/' || *s == 0) {
+			len = s - comp;
+			if (len == 0) return false;
+			if (len == 1 && comp[0] == '.') return false;
+			if (len == 2 && comp[0] == '.' && comp[1] == '.') return false;
+			if (*s == 0) break;
+			comp = s + 1;
+		} else if (*s < ' ' || *s > '~' || *s == '\\') {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Prepare a reader for a new archive.
+ *
+ * \param r			the reader
+ * \param h			the callbacks for the members following the manifest
+ * \param priv		a private argument for the callbacks
+ */
+void arc_readerInit (struct arc_reader *r, const struct arc_handler *h, void *priv)
+{
+	if (!r) return;
+	memset (r, 0, sizeof(*r));
+	r->h = h;
+	r->priv = priv;
+}
+
+static enum arc_error arc_fail (struct arc_reader *r, enum arc_error err)
+{
+	r->state = ST_ERROR;
+	r->err = err;
+	return err;
+}
+
+static bool arc_hex (const uint8_t *p, uint32_t *val)
+{
+	int i;
+
+	*val = 0;
+	for (i = 0; i < 8; i++, p++) {
+		*val <<= 4;
+		if (*p >= '0' && *p <= '9') *val |= *p - '0';
+		else if (*p >= 'A' && *p <= 'F') *val |= *p - 'A' + 10;
+		else if (*p >= 'a' && *p <= 'f') *val |= *p - 'a' + 10;
+		else return false;
+	}
+	return true;
+}
+
+/**
+ * Interpret the fixed part of the header.
+ */
+static enum arc_error arc_parseHeader (struct arc_reader *r)
+{
+	uint32_t dummy;
+	int i;
+
+	if (memcmp(r->hdr, ARC_MAGIC, 6)) return ARC_EFORMAT;
+	for (i = 0; i < 13; i++) {
+		if (!arc_hex(&r->hdr[6 + i * 8], &dummy)) return ARC_EFORMAT;
+	}
+	arc_hex(&r->hdr[14], &r->mode);
+	arc_hex(&r->hdr[54], &r->size);
+	arc_hex(&r->hdr[94], &r->namesize);
+	arc_hex(&r->hdr[102], &r->check);
+	if (r->namesize < 2 || r->namesize > ARC_NAMELEN) return (r->members == 0) ? ARC_EFORMAT : ARC_EPATH;
+	return ARC_OK;
+}
+
+/**
+ * Check the name of a member after it is completely read.
+ */
+static enum arc_error arc_parseName (struct arc_reader *r)
+{
+	if (r->name[r->namesize - 1] != 0 || strlen(r->name) != r->namesize - 1) return ARC_EFORMAT;
+
+	if (!strcmp(r->name, ARC_TRAILER)) {
+		if (r->members == 0) return ARC_EMANIFEST;
+		r->state = ST_DONE;
+		return ARC_OK;
+	}
+
+	if (r->members == 0) {					// the first member must be the manifest
+		if (strcmp(r->name, ARC_MANIFEST) || (r->mode & ARC_IFMT) != ARC_IFREG || r->size >= ARC_MANIFEST_MAX) return ARC_EMANIFEST;
+	} else {
+		switch (r->mode & ARC_IFMT) {
+			case ARC_IFREG:
+				break;
+			case ARC_IFDIR:
+				if (r->size != 0) return ARC_EFORMAT;
+				break;
+			default:
+				return ARC_ETYPE;
+		}
+		if (!arc_pathAllowed(r->name, r->info.areas)) return ARC_EPATH;
+		if (r->h && r->h->begin && r->h->begin(r->priv, r->name, r->mode, r->size) < 0) return ARC_EWRITE;
+	}
+	r->sum = 0;
+	r->fill = 0;
+	r->state = ST_DATA;
+	return ARC_OK;
+}
+
+/**
+ * Finish a member after its contents were read.
+ */
+static enum arc_error arc_endMember (struct arc_reader *r)
+{
+	if (r->sum != r->check) return ARC_ECHECKSUM;
+
+	if (r->members == 0) {
+		if (!arc_parseManifest(r->manifest, r->size, &r->info)) return ARC_EMANIFEST;
+		if (r->info.version > ARC_VERSION) return ARC_EVERSION;
+	} else if (r->h && r->h->end && r->h->end(r->priv) < 0) {
+		return ARC_EWRITE;
+	}
+	r->members++;
+	r->fill = 0;
+	r->state = ST_PAD;
+	return ARC_OK;
+}
+
+/**
+ * Feed the next part of an archive to the reader.
+ *
+ * \param r			the reader
+ * \param buf		the next bytes of the archive
+ * \param len		the number of bytes
+ * \return			ARC_OK or the first error that occurred in the archive
+ */
+enum arc_error arc_feed (struct arc_reader *r, const uint8_t *buf, int len)
+{
+	enum arc_error err;
+	uint32_t n, need;
+
+	if (!r) return ARC_EFORMAT;
+	if (!buf) len = 0;
+
+	while (r->state != ST_ERROR && r->state != ST_DONE && len > 0) {
+		n = 0;
+		switch (r->state) {
+			case ST_HEADER:
+				n = ARC_HDRSIZE - r->fill;
+				if (n > (uint32_t) len) n = len;
+				memcpy (&r->hdr[r->fill], buf, n);
+				r->fill += n;
+				if (r->fill == ARC_HDRSIZE) {
+					if ((err = arc_parseHeader(r)) != ARC_OK) return arc_fail(r, err);
+					r->fill = 0;
+					r->state = ST_NAME;
+				}
+				break;
+			case ST_NAME:
+				need = r->namesize + arc_padding(ARC_HDRSIZE + r->namesize);
+				n = need - r->fill;
+				if (n > (uint32_t) len) n = len;
+				if (r->fill < r->namesize) {		// the padding is simply skipped
+					memcpy (&r->name[r->fill], buf, (r->fill + n > r->namesize) ? r->namesize - r->fill : n);
+				}
+				r->fill += n;
+				if (r->fill == need) {
+					if ((err = arc_parseName(r)) != ARC_OK) return arc_fail(r, err);
+					if (r->state == ST_DATA && r->size == 0 && (err = arc_endMember(r)) != ARC_OK) return arc_fail(r, err);
+				}
+				break;
+			case ST_DATA:
+				n = r->size - r->fill;
+				if (n > (uint32_t) len) n = len;
+				r->sum = arc_checksum(r->sum, buf, n);
+				if (r->members == 0) {
+					memcpy (&r->manifest[r->fill], buf, n);
+				} else if (r->h && r->h->data && r->h->data(r->priv, buf, n) < 0) {
+					return arc_fail(r, ARC_EWRITE);
+				}
+				r->fill += n;
+				if (r->fill == r->size && (err = arc_endMember(r)) != ARC_OK) return arc_fail(r, err);
+				break;
+			case ST_PAD:
+				n = arc_padding(r->size) - r->fill;
+				if (n > (uint32_t) len) n = len;
+				r->fill += n;
+				break;
+		}
+		buf += n;
+		len -= n;
+		if (r->state == ST_PAD && r->fill == (uint32_t) arc_padding(r->size)) {
+			r->fill = 0;
+			r->state = ST_HEADER;
+		}
+	}
+
+	return r->err;
+}
+
+/**
+ * Check the state at the end of the archive.
+ *
+ * \param r			the reader
+ * \return			ARC_OK if the archive was complete and valid, the error otherwise
+ */
+enum arc_error arc_finish (struct arc_reader *r)
+{
+	if (!r) return ARC_EFORMAT;
+	if (r->state == ST_ERROR) return r->err;
+	if (r->state != ST_DONE) return arc_fail(r, (r->members == 0 && r->state == ST_HEADER && r->fill == 0) ? ARC_EFORMAT : ARC_ETRUNCATED);
+	return ARC_OK;
+}
+
+/**
+ * Get a readable text for an error code.
+ *
+ * \param err		the error code
+ * \return			a text describing the error
+ */
+const char *arc_strerror (enum arc_error err)
+{
+	if ((unsigned) err >= ARC_ERRORS) return "unknown error";
+	return errors[err];
+}
@@ -0,0 +1,207 @@
+/*
+ * dnssd.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief The DNS-SD services of the station and their names
+ *
+ * The station advertises its network services with DNS-SD (RFC 6763) on top
+ * of the mDNS responder of lwIP. All services share the same instance name,
+ * which is the configured name of the station (the BiDiB user name) or
+ * "mc2 <serial>" if no name was configured. This way several stations on the
+ * same LAN can be told apart by the user.
+ *
+ * If the responder reports a name conflict while probing, the host name and
+ * the instance name get a suffix ("mc2-2.local" and "name (2)") and all
+ * services are registered again. The number of the suffix is incremented
+ * with every conflict, up to DNSSD_MAXCONFLICTS.
+ *
+ * A service is only advertised if it has a port. Whenever the configuration
+ * changes, dnssd_plan() computes which services must be removed and which
+ * must be registered (again) to reflect the new configuration.
+ *
+ * The calls to the mDNS responder of lwIP are all in zeroconf.c, which
+ * executes the plans. Tests/dnssd_test.c executes them against a simulated
+ * responder instead.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "dnssd.h"
+
+static const struct {
+	const char	*service;					///< the service type (without the protocol)
+	bool		udp;						///< the service uses UDP (else TCP)
+} services[DNSSD_SERVICES] = {
+	[DNSSD_HTTP] =	{ "_http", false },
+	[DNSSD_FTP] =	{ "_ftp", false },
+	[DNSSD_Z21] =	{ "_z21", true },
+	[DNSSD_P50X] =	{ "_p50x", false },
+	[DNSSD_BIDIB] =	{ "_bidib", false },
+};
+
+/**
+ * Reset the state to "nothing published".
+ *
+ * \param s			the state
+ */
+void dnssd_init (struct dnssd_state *s)
+{
+	int i;
+
+	if (!s) return;
+	memset (s, 0, sizeof(*s));
+	for (i = 0; i < DNSSD_SERVICES; i++) s->slot[i] = -1;
+}
+
+/**
+ * Get the service type of a service.
+ *
+ * \param svc		the service
+ * \param udp		where to store if the service uses UDP (may be NULL)
+ * \return			the service type (i.e. "_http") or NULL for an unknown service
+ */
+const char *dnssd_service (enum dnssd_svc svc, bool *udp)
+{
+	if ((unsigned) svc >= DNSSD_SERVICES) return NULL;
+	if (udp) *udp = services[svc].udp;
+	return services[svc].service;
+}
+
+/**
+ * Build the host name and the instance name.
+ *
+ * \param c			the configuration
+ * \param conflicts	the number of name conflicts so far
+ * \param host		where to store the host name (DNSSD_NAMELEN bytes)
+ * \param instance	where to store the instance name (DNSSD_NAMELEN bytes)
+ */
+void dnssd_names (const struct dnssd_config *c, int conflicts, char *host, char *instance)
+{
+	char base[DNSSD_NAMELEN];
+
+	if (conflicts > 0) snprintf (host, DNSSD_NAMELEN, "%s-%d", DNSSD_HOSTNAME, conflicts + 1);
+	else snprintf (host, DNSSD_NAMELEN, "%s", DNSSD_HOSTNAME);
+
+	if (*c->name && strcmp(c->name, DNSSD_DEFNAME)) snprintf (base, sizeof(base), "%s", c->name);
+	else snprintf (base, sizeof(base), "%s %lu", DNSSD_HOSTNAME, (unsigned long) c->serial);
+
+	if (conflicts > 0) {
+		snprintf (instance, DNSSD_NAMELEN, "%.*s (%d)", DNSSD_NAMELEN - 16, base, conflicts + 1);	// leave room for the suffix
+	} else {
+		snprintf (instance, DNSSD_NAMELEN, "%s", base);
+	}
+}
+
+/**
+ * Get a TXT item of a service.
+ *
+ * \param c			the configuration
+ * \param svc		the service
+ * \param idx		the number of the item (starting with 0)
+ * \param buf		where to store the item
+ * \param size		the size of the buffer
+ * \return			the length of the item or 0 if there are no more items
+ */
+int dnssd_txt (const struct dnssd_config *c, enum dnssd_svc svc, int idx, char *buf, int size)
+{
+	int len;
+
+	switch (idx) {
+		case 0:
+			len = snprintf (buf, size, "serial=%lu", (unsigned long) c->serial);
+			break;
+		case 1:
+			len = snprintf (buf, size, "fw=%s", (c->firmware) ? c->firmware : "");
+			break;
+		case 2:
+			if (svc != DNSSD_HTTP) return 0;
+			len = snprintf (buf, size, "path=/");
+			break;
+		default:
+			return 0;
+	}
+	return (len < size) ? len : size - 1;
+}
+
+static bool dnssd_txtChanged (const struct dnssd_config *a, const struct dnssd_config *b)
+{
+	if (a->serial != b->serial) return true;
+	if (!a->firmware || !b->firmware) return a->firmware != b->firmware;
+	return strcmp(a->firmware, b->firmware) != 0;
+}
+
+/**
+ * Compare the published state with a configuration and compute the changes.
+ * The state is updated to the new configuration and names, but the slots of
+ * the services must be set by the caller while executing the plan (-1 for
+ * each removed service and the result of the registration for each added
+ * service).
+ *
+ * \param s			the published state
+ * \param c			the new configuration
+ * \param p			where to store the changes
+ * \return			true, if anything has to be changed
+ */
+bool dnssd_plan (struct dnssd_state *s, const struct dnssd_config *c, struct dnssd_plan *p)
+{
+	char host[DNSSD_NAMELEN], instance[DNSSD_NAMELEN];
+	bool all;
+	int i;
+
+	if (!s || !c || !p) return false;
+	memset (p, 0, sizeof(*p));
+
+	dnssd_names(c, s->conflicts, host, instance);
+	p->rename = !s->started || strcmp(host, s->host);
+	all = p->rename || strcmp(instance, s->instance) || dnssd_txtChanged(&s->cfg, c);
+
+	for (i = 0; i < DNSSD_SERVICES; i++) {
+		if (!all && s->cfg.port[i] == c->port[i] && (s->slot[i] >= 0) == (c->port[i] != 0)) continue;
+		if (s->slot[i] >= 0) p->del |= 1 << i;
+		if (c->port[i]) p->add |= 1 << i;
+	}
+
+	s->cfg = *c;
+	strcpy (s->host, host);
+	strcpy (s->instance, instance);
+	s->started = true;
+	return p->rename || p->del || p->add;
+}
+
+/**
+ * Count a name conflict. The next call to dnssd_plan() will then use new
+ * names and register all services again.
+ *
+ * \param s			the published state
+ * \return			true, if new names should be tried, false if we gave up after DNSSD_MAXCONFLICTS
+ */
+bool dnssd_conflict (struct dnssd_state *s)
+{
+	if (!s || s->conflicts >= DNSSD_MAXCONFLICTS) return false;
+	s->conflicts++;
+	return true;
+}
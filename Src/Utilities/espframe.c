@@ -0,0 +1,492 @@
+/*
+ * espframe.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief The framing of the network link to the ESP-01 WLAN module
+ *
+ * The WLAN module is connected by a serial line without handshake lines.
+ * The ethernet frames and some control information are packed into frames
+ * using the SLIP encoding we already know from the bootloader of the module
+ * (see esp.h):
+ *
+ *     SLIP_BLOCK | type | payload ... | CRC-16 (LSB first) | SLIP_BLOCK
+ *
+ * The CRC (CCITT, start value 0xFFFF) covers the type and the payload and
+ * is calculated before the escaping. Frames with a bad CRC are silently
+ * dropped - the protocols above (TCP, Z21 retries) must cope with that as
+ * they do on a real network.
+ *
+ * Flow control is done in software with EF_FLOW frames. Each side tells the
+ * other one if it may send data frames. A receiver pauses the peer when the
+ * backlog of unprocessed bytes reaches the high water mark or when a frame
+ * could not be delivered (no network buffers) and resumes it when the
+ * backlog drops to the low water mark. Control frames are always allowed.
+ * The flow state is repeated every EF_FLOW_REFRESH ms, so a lost frame
+ * can't block the link forever and the peer knows we are alive.
+ *
+ * The module reports the state of the WLAN link and its MAC address with
+ * EF_LINK frames about once a second. If nothing is received for
+ * EF_LINK_TIMEOUT ms, the link is considered down.
+ *
+ * If the receiver loses bytes (the DMA overwrote data in the receive ring
+ * that was not read yet), it must call ef_resync(). The rest of the frame
+ * that was interrupted is then skipped instead of being glued to the bytes
+ * before the gap.
+ *
+ * The receive ring is read by ef_ringReceive(). Its backlog is handed to
+ * ef_poll(), which pauses the peer in time. The UART, the DMA and lwIP are
+ * handled in espnet.c, which only tells how far the DMA has written and
+ * sends what ef_poll() and the encoder return. Tests/espframe_test.c
+ * connects the same functions to a simulated module.
+ */
+
+#include <string.h>
+#include "espnet.h"
+#include "esp.h"
+
+/**
+ * Calculate the CRC-16 (CCITT, polynom 0x1021) over a block of data.
+ *
+ * \param crc		the start value (0xFFFF) or the result of the previous block
+ * \param data		the data
+ * \param len		the number of bytes in data
+ * \return			the new CRC
+ */
+uint16_t ef_crc (uint16_t crc, const uint8_t *data, int len)
+{
+	int i;
+
+	while (len-- > 0) {
+		crc ^= *data++ << 8;
+		for (i = 0; i < 8; i++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+static void ef_putc (struct ef_encoder *e, uint8_t c)
+{
+	if (e->len >= e->size) {
+		e->overflow = true;
+		return;
+	}
+	e->buf[e->len++] = c;
+}
+
+static void ef_putEscaped (struct ef_encoder *e, uint8_t c)
+{
+	if (c == SLIP_BLOCK) {
+		ef_putc(e, SLIP_ESCAPE);
+		ef_putc(e, SLIP_ESC_BLOCK);
+	} else if (c == SLIP_ESCAPE) {
+		ef_putc(e, SLIP_ESCAPE);
+		ef_putc(e, SLIP_ESC_ESCAPE);
+	} else {
+		ef_putc(e, c);
+	}
+}
+
+/**
+ * Start a new frame. The payload is then added with one or more calls to
+ * ef_encData() (i.e. one for each part of a pbuf chain) and the frame is
+ * completed with ef_encEnd().
+ *
+ * \param e			the encoder
+ * \param buf		the output buffer (at least EF_ENCODED_MAX bytes for any data frame)
+ * \param size		the size of the output buffer
+ * \param type		the type of the frame
+ */
+void ef_encBegin (struct ef_encoder *e, uint8_t *buf, int size, enum ef_type type)
+{
+	uint8_t t = type;
+
+	e->buf = buf;
+	e->size = size;
+	e->len = 0;
+	e->overflow = false;
+	e->crc = ef_crc(0xFFFF, &t, 1);
+	ef_putc(e, SLIP_BLOCK);
+	ef_putEscaped(e, t);
+}
+
+/**
+ * Add payload to the frame.
+ *
+ * \param e			the encoder
+ * \param data		the payload
+ * \param len		the number of bytes in data
+ * \return			true if the data still fits into the output buffer
+ */
+bool ef_encData (struct ef_encoder *e, const uint8_t *data, int len)
+{
+	e->crc = ef_crc(e->crc, data, len);
+	while (len-- > 0 && !e->overflow) ef_putEscaped(e, *data++);
+	return !e->overflow;
+}
+
+/**
+ * Add payload to the frame, but leave out the first bytes. This is meant
+ * for buffer chains that start with some bytes that are not part of the
+ * frame, like the padding word in front of the ethernet header of a pbuf
+ * chain. The bytes to leave out may span several buffers of the chain.
+ *
+ * \param e			the encoder
+ * \param data		the payload
+ * \param len		the number of bytes in data
+ * \param skip		the number of bytes still to leave out, reduced by the bytes skipped here
+ * \return			true if the data still fits into the output buffer
+ */
+bool ef_encDataSkip (struct ef_encoder *e, const uint8_t *data, int len, int *skip)
+{
+	int n;
+
+	n = (*skip < len) ? *skip : len;
+	if (n < 0) n = 0;
+	*skip -= n;
+	return ef_encData(e, data + n, len - n);
+}
+
+/**
+ * Complete the frame with the CRC and the terminating block character.
+ *
+ * \param e			the encoder
+ * \return			the number of bytes in the output buffer or -1 if the frame did not fit
+ */
+int ef_encEnd (struct ef_encoder *e)
+{
+	ef_putEscaped(e, e->crc & 0xFF);
+	ef_putEscaped(e, e->crc >> 8);
+	ef_putc(e, SLIP_BLOCK);
+	return (e->overflow) ? -1 : e->len;
+}
+
+/**
+ * Encode a complete frame.
+ *
+ * \param buf		the output buffer
+ * \param size		the size of the output buffer
+ * \param type		the type of the frame
+ * \param data		the payload
+ * \param len		the number of bytes in the payload
+ * \return			the number of bytes in the output buffer or -1 if the frame did not fit
+ */
+int ef_encode (uint8_t *buf, int size, enum ef_type type, const uint8_t *data, int len)
+{
+	struct ef_encoder e;
+
+	ef_encBegin(&e, buf, size, type);
+	ef_encData(&e, data, len);
+	return ef_encEnd(&e);
+}
+
+/**
+ * Initialise a link.
+ *
+ * \param l			the link
+ * \param ops		the callbacks for received frames and link state changes
+ * \param priv		a private argument for the callbacks
+ * \param ringsize	the size of the receive buffer (to calculate the water marks for the flow control)
+ */
+void ef_linkInit (struct ef_link *l, const struct ef_ops *ops, void *priv, int ringsize)
+{
+	memset (l, 0, sizeof(*l));
+	l->ops = ops;
+	l->priv = priv;
+	l->highwater = ringsize * 3 / 4;
+	l->lowwater = ringsize / 4;
+}
+
+static void ef_setLink (struct ef_link *l, bool up, const uint8_t *mac)
+{
+	bool changed;
+
+	changed = (up != l->up) || (mac && memcmp(mac, l->mac, sizeof(l->mac)));
+	l->up = up;
+	if (mac) memcpy (l->mac, mac, sizeof(l->mac));
+	if (changed && l->ops && l->ops->link) l->ops->link(l->priv, l->up, l->mac);
+}
+
+/**
+ * Interpret a complete frame in the decoder buffer.
+ *
+ * \param l			the link
+ * \param now		the current time in ms
+ */
+static void ef_frame (struct ef_link *l, uint32_t now)
+{
+	struct ef_decoder *d = &l->dec;
+	const uint8_t *payload;
+	char line[EF_TEXTLEN];
+	uint16_t crc;
+	int len;
+
+	if (d->len < 3) {					// too short - could be noise between two frames
+		if (d->len > 0) l->stats.crcErrors++;
+		return;
+	}
+	len = d->len - 2;
+	crc = d->buf[len] | (d->buf[len + 1] << 8);
+	if (ef_crc(0xFFFF, d->buf, len) != crc) {
+		l->stats.crcErrors++;
+		return;
+	}
+	l->stats.rxFrames++;
+	l->lastRx = now;
+	l->alive = true;
+
+	payload = &d->buf[1];
+	len--;
+	switch (d->buf[0]) {
+		case EF_DATA:
+			if (len < 14) break;		// not even an ethernet header
+			if (!l->ops || !l->ops->frame || !l->ops->frame(l->priv, payload, len)) {
+				l->stats.drops++;
+				l->busy = true;
+				l->busyUntil = now + EF_BUSY_TIME;
+			}
+			break;
+		case EF_LINK:
+			if (len < 7) break;
+			ef_setLink(l, payload[0] != 0, &payload[1]);
+			break;
+		case EF_FLOW:
+			if (len < 1) break;
+			l->peerPaused = (payload[0] == EF_FLOW_PAUSE);
+			break;
+		case EF_TEXT:
+			if (len >= EF_TEXTLEN) len = EF_TEXTLEN - 1;
+			memcpy (line, payload, len);
+			while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) len--;
+			line[len] = 0;
+			if (l->ops && l->ops->text) l->ops->text(l->priv, line);
+			break;
+		default:						// unknown frame types are ignored for compatibility with newer modules
+			break;
+	}
+}
+
+/**
+ * Feed received bytes to the link. The bytes may be split at any position,
+ * complete frames are handed to the callbacks immediately.
+ *
+ * \param l			the link
+ * \param data		the received bytes
+ * \param len		the number of bytes
+ * \param now		the current time in ms
+ */
+void ef_input (struct ef_link *l, const uint8_t *data, int len, uint32_t now)
+{
+	struct ef_decoder *d = &l->dec;
+	uint8_t c;
+
+	while (len-- > 0) {
+		c = *data++;
+		if (c == SLIP_BLOCK) {
+			if (!d->discard && !d->esc) ef_frame(l, now);
+			else if (d->esc) l->stats.crcErrors++;
+			d->len = 0;
+			d->esc = d->discard = false;
+			continue;
+		}
+		if (d->discard) continue;
+		if (d->esc) {
+			d->esc = false;
+			if (c == SLIP_ESC_BLOCK) c = SLIP_BLOCK;
+			else if (c == SLIP_ESC_ESCAPE) c = SLIP_ESCAPE;
+			else {
+				l->stats.crcErrors++;
+				d->discard = true;
+				continue;
+			}
+		} else if (c == SLIP_ESCAPE) {
+			d->esc = true;
+			continue;
+		}
+		if (d->len >= (int) sizeof(d->buf)) {
+			l->stats.overruns++;
+			d->discard = true;
+			continue;
+		}
+		d->buf[d->len++] = c;
+	}
+}
+
+/**
+ * Forget a partially received frame after bytes were lost. Everything up to
+ * the start of the next frame is skipped.
+ *
+ * \param l			the link
+ */
+void ef_resync (struct ef_link *l)
+{
+	l->dec.len = 0;
+	l->dec.esc = false;
+	l->dec.discard = true;
+	l->stats.resyncs++;
+}
+
+/**
+ * Calculate how many bytes a DMA in circular mode has written to a ring since
+ * it was started. The interrupt of the DMA counts the half transfer and the
+ * transfer complete events. If the interrupt for the half the DMA just entered
+ * is still pending, the count is one behind, which is detected by comparing
+ * it with the half the DMA is currently writing to.
+ *
+ * The result is compared with the number of bytes read from the ring. A
+ * difference of more than the size of the ring means that the DMA has
+ * overwritten data that was not read yet.
+ *
+ * \param halves	the number of half transfer and transfer complete events so far
+ * \param ndtr		the number of transfers left in the current round (the NDTR register of the DMA)
+ * \param size		the size of the ring (a power of two, so the count can wrap around)
+ * \return			the number of bytes written
+ */
+uint32_t ef_ringWritten (uint32_t halves, int ndtr, int size)
+{
+	int pos;
+
+	pos = size - ndtr;
+	if (pos < 0 || pos >= size) pos = 0;		// NDTR is reloaded with the size at the end of each round
+	if ((pos >= size / 2) != (halves & 1)) halves++;
+	return halves * (uint32_t) (size / 2) + pos % (size / 2);
+}
+
+/**
+ * Initialise a receive ring.
+ *
+ * \param r			the ring
+ * \param buf		the ring buffer
+ * \param size		the size of the ring buffer (a power of two)
+ * \param written	returns the number of bytes the DMA has written to the ring so far
+ * \param invalidate	makes a part of the ring visible to the CPU before it is read (may be NULL)
+ * \param priv		a private argument for the callbacks
+ */
+void ef_ringInit (struct ef_ring *r, uint8_t *buf, int size, uint32_t (*written)(void *), void (*invalidate)(void *, const uint8_t *, int), void *priv)
+{
+	memset (r, 0, sizeof(*r));
+	r->buf = buf;
+	r->size = size;
+	r->written = written;
+	r->invalidate = invalidate;
+	r->priv = priv;
+}
+
+/**
+ * Process all bytes the DMA has written to the ring so far. If the DMA has
+ * lapped the read position, the overwritten data is lost. Reading then
+ * continues with the last half ring of data, which stays intact for the time
+ * the DMA needs to write another half ring. If the DMA overwrote data while
+ * it was read, the bytes already handed to the decoder are suspect. In both
+ * cases the decoder is resynchronised and the full ring is reported as
+ * backlog, so ef_poll() pauses the peer.
+ *
+ * \param l			the link that decodes the received bytes
+ * \param r			the receive ring
+ * \param now		the current time in ms
+ * \return			the number of bytes that were waiting for processing (the backlog for ef_poll())
+ */
+int ef_ringReceive (struct ef_link *l, struct ef_ring *r, uint32_t now)
+{
+	uint32_t written, start;
+	int pos, backlog, len;
+
+	written = r->written(r->priv);
+	backlog = written - r->read;
+	if (written - r->read > (uint32_t) r->size) {
+		ef_resync(l);
+		r->read = written - r->size / 2;
+		backlog = r->size;
+	}
+
+	start = r->read;
+	while (r->read != written) {
+		pos = r->read % r->size;
+		len = written - r->read;
+		if (len > r->size - pos) len = r->size - pos;
+		if (r->invalidate) r->invalidate(r->priv, &r->buf[pos], len);
+		ef_input(l, &r->buf[pos], len, now);
+		r->read += len;
+	}
+	if (r->written(r->priv) - start > (uint32_t) r->size) {
+		ef_resync(l);
+		backlog = r->size;
+	}
+	return backlog;
+}
+
+/**
+ * Check the link state and the flow control. This should be called
+ * regularly (at least every EF_FLOW_REFRESH ms) and whenever received bytes
+ * were processed. The returned control frames must be sent before any
+ * further data frame.
+ *
+ * \param l			the link
+ * \param backlog	the number of received bytes that are not yet processed
+ * \param now		the current time in ms
+ * \param buf		a buffer for the control frames to send
+ * \param size		the size of the buffer
+ * \return			the number of bytes to send from the buffer (may be 0)
+ */
+int ef_poll (struct ef_link *l, int backlog, uint32_t now, uint8_t *buf, int size)
+{
+	uint8_t state;
+	bool pause;
+	int len;
+
+	if (l->alive && (int32_t) (now - l->lastRx) >= EF_LINK_TIMEOUT) {
+		l->alive = false;
+		l->peerPaused = false;
+		ef_setLink(l, false, NULL);
+	}
+	if (l->busy && (int32_t) (now - l->busyUntil) >= 0) l->busy = false;
+
+	pause = l->paused;
+	if (l->busy || backlog >= l->highwater) pause = true;
+	else if (backlog <= l->lowwater) pause = false;
+
+	if (pause == l->paused && l->flowSent && (int32_t) (now - l->lastFlow) < EF_FLOW_REFRESH) return 0;
+
+	state = (pause) ? EF_FLOW_PAUSE : EF_FLOW_RESUME;
+	if ((len = ef_encode(buf, size, EF_FLOW, &state, 1)) < 0) return 0;
+	if (pause && !l->paused) l->stats.pauses++;
+	l->paused = pause;
+	l->flowSent = true;
+	l->lastFlow = now;
+	return len;
+}
+
+/**
+ * Check if a data frame may be sent to the peer.
+ *
+ * \param l			the link
+ * \return			true if the peer is alive, its WLAN link is up and it did not pause us
+ */
+bool ef_mayTransmit (struct ef_link *l)
+{
+	return l->alive && l->up && !l->peerPaused;
+}
@@ -350,15 +350,34 @@ struct ini_section *ini_readFile (const char *fname)
 	return root;
 }
 
+/**
+ * Write the structure to a file. The contents are written to a temporary file
+ * first that then replaces the original file. So readers of the file (i.e. a
+ * backup) always see a complete version of it.
+ *
+ * This runs in the timer task (see the store functions of the modules), so
+ * the name of the temporary file is kept in a small buffer instead of one
+ * with FILENAME_MAX bytes. Our file names are much shorter anyway.
+ *
+ * \param fname		the name of the file
+ * \param ini		the sections to write
+ * \return			0 on success, a negative value on error
+ */
 int ini_writeFile (const char *fname, struct ini_section *ini)
 {
 	FILE *fp;
 	struct key_value *kv;
+	char tmpname[64];
+	int rc;
 
 	if (!fname  || !*fname || !ini) return 1;	// non-fatal NOP (?)
 
-	if ((fp = fopen (fname, "w")) == NULL) {
-		log_error ("%s(): cannot open '%s'\n", __func__, fname);
+	if (snprintf (tmpname, sizeof(tmpname), "%s.tmp", fname) >= (int) sizeof(tmpname)) {
+		log_error ("%s(): file name '%s' too long\n", __func__, fname);
+		return -1;
+	}
+	if ((fp = fopen (tmpname, "w")) == NULL) {
+		log_error ("%s(): cannot open '%s'\n", __func__, tmpname);
 		return -1;
 	}
 	log_msg (LOG_INFO, "%s() '%s' opened successfully\n", __func__, fname);
@@ -383,7 +402,12 @@ int ini_writeFile (const char *fname, struct ini_section *ini)
 		ini = ini->next;
 	}
 
-	fclose (fp);
+	rc = fclose (fp);
+	if (rc != 0 || yaffs_rename(tmpname, fname) != 0) {
+		log_error ("%s(): cannot replace '%s'\n", __func__, fname);
+		yaffs_unlink(tmpname);
+		return -1;
+	}
 
 	return 0;
 }
@@ -19,6 +19,7 @@
 
 #include <stdio.h>
 #include "rb2.h"
+#include "swdog.h"
 
 /**
  * Lock a mutex and create it, if it doesn't already exist (i.e. lazy loading).
@@ -58,7 +59,12 @@ bool mutex_lock(SemaphoreHandle_t * volatile mutex, TickType_t tout, const char
 		if (tmp) vSemaphoreDelete(tmp);	// if the temporary mutex was not used, we must destroy it after leaving the critical section
 	}
 
-	if (xSemaphoreTake(*mutex, pdMS_TO_TICKS(tout)) == pdTRUE) return true;
+	wdog_mutexWait(*mutex, caller);		// a supervised task that starves here can be reported together with the holder of the mutex
+	if (xSemaphoreTake(*mutex, pdMS_TO_TICKS(tout)) == pdTRUE) {
+		wdog_mutexDone();
+		return true;
+	}
+	wdog_mutexDone();
 	log_error ("%s(): could not aquire mutex (%lums)!\n", caller, tout);
 	return false;
 }
@@ -287,6 +287,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <ctype.h>
 #include <strings.h>
 #include <string.h>
 #include "rb2.h"
@@ -299,8 +300,13 @@
 #include "intelhex.h"
 #include "config.h"
 #include "bidib.h"
+#include "mcancfg.h"
+#include "crashrec.h"
 #include "easynet.h"
 #include "defaults.h"
+#include "m3scan.h"
+#include "session.h"
+#include "backup.h"
 
 #define RX_BUFSIZE		2048				///< size of an allocated buffer for receiving files
 
@@ -315,6 +321,7 @@ static int cgi_command (int sock, struct http_request *hr, const char *rest, int
 static int cgi_regEvent (int sock, struct http_request *hr, const char *rest, int sz);
 static int cgi_consist (int sock, struct http_request *hr, const char *rest, int sz);
 static int cgi_update (int sock, struct http_request *hr, const char *rest, int sz);
+static int cgi_restore (int sock, struct http_request *hr, const char *rest, int sz);
 static int cgi_readfile (int sock, struct http_request *hr, const char *rest, int sz);
 static int cgi_modeltime (int sock, struct http_request *hr, const char *rest, int sz);
 //static int cgi_sound (int sock, struct http_request *hr, const char *rest, int sz);
@@ -341,6 +348,7 @@ static const struct vFuncT {
 	{ "/cgi/update", POST, cgi_update },		///< transfer a file for update purpose (using POST method)
 	{ "/cgi/update", PUT, cgi_update },			///< transfer a file for update purpose (using PUT method)
 	{ "/cgi/store", POST, cgi_update },			///< transfer a file for general purpose (using POST method)
+	{ "/cgi/restore", POST, cgi_restore },		///< restore a backup of the station (see query "backup")
 	{ "/cgi/readfile", GET, cgi_readfile },		///< transfer a file from RB2 to PC for general purpose (using GET method)
 	{ "/cgi/modeltime", GET, cgi_modeltime },	///< commands to manipulate modeltime subsystem
 //	{ "/cgi/sound", GET, cgi_sound },			///< sound control
@@ -462,6 +470,218 @@ static int cgi_sendJSON (int sock, json_valT *root)
 	return rc;
 }
 
+static int cgi_sendHeaderJSON (int sock, json_valT *root)
+{
+	struct key_value *hdrs;
+
+	hdrs = kv_add(NULL, "Content-Type", CONTENT_JSON);
+	httpd_header(sock, FILE_OK, hdrs);
+	kv_free(hdrs);
+	return cgi_sendJSON(sock, root);
+}
+
+/*
+ * ==============================================================================================
+ * Routing of queries and the cache for static or slow changing answers
+ * ==============================================================================================
+ */
+#define CGI_HASHSIZE		64					///< slots in the route hash tables (power of 2, at least twice the number of routes)
+#define CGI_FLASHINFO_TTL	10000				///< time in ms before the flash usage is read again from the file system
+
+/**
+ * Usage statistics for each route
+ */
+struct cgistat {
+	uint32_t		hits;						///< number of calls of this route
+	uint32_t		ms;							///< total time spent in the handler (ms)
+	uint32_t		maxms;						///< the longest time spent in a single call (ms)
+};
+
+/**
+ * A hash table on top of a route table (struct cgiquery) for case insensitive
+ * lookup of the route names. It is built on first use.
+ */
+struct cgihash {
+	const struct cgiquery	*tab;				///< the route table (terminated by a NULL entry)
+	struct cgistat			*stats;				///< statistics for each entry of the route table
+	volatile bool			 valid;				///< the slots are set up
+	uint8_t					 slot[CGI_HASHSIZE];	///< index + 1 into the route table, 0 marks an empty slot
+};
+
+/**
+ * The cached answers. Each one is invalidated when one of the events in
+ * its mask is fired. A mask of 0 means that the answer never changes.
+ */
+enum cgicache {
+	CACHE_LOCOFORMATS = 0,						///< the list of loco formats (static)
+	CACHE_S88FILTER,							///< the s88 filter profiles and assignment
+	CACHE_COUNT
+};
+
+static struct {
+	const uint32_t	 evmask;					///< events that invalidate this cache entry
+	char			*response;					///< the rendered JSON answer or NULL if not cached
+	uint32_t		 hits;						///< statistics: answers sent from cache
+	uint32_t		 misses;					///< statistics: answers that must be generated
+} cache[CACHE_COUNT] = {
+	[CACHE_LOCOFORMATS] = { .evmask = 0 },
+	[CACHE_S88FILTER] = { .evmask = (1 << EVENT_FBPARAM) },
+};
+
+static SemaphoreHandle_t cache_mutex;
+
+static uint32_t cgi_hashString (const char *s)
+{
+	uint32_t h = 2166136261u;					// FNV-1a
+
+	while (*s) {
+		h ^= (uint8_t) tolower((unsigned char) *s++);
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static void cgi_hashInit (struct cgihash *h)
+{
+	int i, idx;
+
+	memset (h->slot, 0, sizeof(h->slot));
+	for (i = 0; h->tab[i].cmd; i++) {
+		idx = cgi_hashString(h->tab[i].cmd) & (CGI_HASHSIZE - 1);
+		while (h->slot[idx]) idx = (idx + 1) & (CGI_HASHSIZE - 1);
+		h->slot[idx] = i + 1;
+	}
+}
+
+/**
+ * Lookup a route by name.
+ *
+ * \param h		the hash table to use
+ * \param name	the name of the route (case insensitive)
+ * \return		the index in the route table or -1 if the name is unknown
+ */
+static int cgi_hashLookup (struct cgihash *h, const char *name)
+{
+	int idx;
+
+	if (!name) return -1;
+	if (!h->valid) {
+		vTaskSuspendAll();
+		if (!h->valid) {
+			cgi_hashInit(h);
+			h->valid = true;
+		}
+		xTaskResumeAll();
+	}
+
+	idx = cgi_hashString(name) & (CGI_HASHSIZE - 1);
+	while (h->slot[idx]) {
+		if (!strcasecmp(h->tab[h->slot[idx] - 1].cmd, name)) return h->slot[idx] - 1;
+		idx = (idx + 1) & (CGI_HASHSIZE - 1);
+	}
+	return -1;
+}
+
+static int cgi_callRoute (struct cgihash *h, int idx, int sock, struct http_request *hr)
+{
+	struct cgistat *st;
+	TickType_t start, t;
+	int rc;
+
+	start = xTaskGetTickCount();
+	rc = h->tab[idx].func(sock, hr);
+	t = xTaskGetTickCount() - start;
+
+	st = &h->stats[idx];
+	taskENTER_CRITICAL();
+	st->hits++;
+	st->ms += t;
+	if (t > st->maxms) st->maxms = t;
+	taskEXIT_CRITICAL();
+	return rc;
+}
+
+static bool cgi_cacheInvalidate (eventT *e, void *priv)
+{
+	int i;
+
+	(void) priv;
+
+	if (mutex_lock(&cache_mutex, 100, __func__)) {
+		for (i = 0; i < CACHE_COUNT; i++) {
+			if (cache[i].evmask & (1 << e->ev)) {
+				free (cache[i].response);
+				cache[i].response = NULL;
+			}
+		}
+		mutex_unlock(&cache_mutex);
+	}
+	return true;
+}
+
+/**
+ * Send an answer from the cache if it is available.
+ *
+ * \param sock		the socket to send the answer to
+ * \param slot		the cache slot
+ * \return			true, if the answer was sent, false if it must be generated
+ */
+static bool cgi_cacheSend (int sock, enum cgicache slot)
+{
+	struct key_value *hdrs;
+	char *s = NULL;
+
+	if (!mutex_lock(&cache_mutex, 100, __func__)) return false;
+	if (cache[slot].response) {
+		s = strdup(cache[slot].response);
+		cache[slot].hits++;
+	} else {
+		cache[slot].misses++;
+	}
+	mutex_unlock(&cache_mutex);
+	if (!s) return false;
+
+	hdrs = kv_add(NULL, "Content-Type", CONTENT_JSON);
+	httpd_header(sock, FILE_OK, hdrs);
+	kv_free(hdrs);
+	lwip_send (sock, s, strlen(s), MSG_MORE);
+	lwip_send (sock, "\n\n", 2, 0);
+	free (s);
+	return true;
+}
+
+/**
+ * Store a generated answer in the cache. The event listeners that
+ * invalidate the cache entries are registered with the first call.
+ *
+ * \param slot		the cache slot
+ * \param root		the JSON tree of the answer
+ */
+static void cgi_cacheStore (enum cgicache slot, json_valT *root)
+{
+	static bool registered;
+
+	uint32_t mask;
+	char *s;
+	int i;
+
+	if ((s = json_toString(root)) == NULL) return;
+	if (!mutex_lock(&cache_mutex, 100, __func__)) {
+		free (s);
+		return;
+	}
+	free (cache[slot].response);
+	cache[slot].response = s;
+	if (!registered) {
+		for (i = 0, mask = 0; i < CACHE_COUNT; i++) mask |= cache[i].evmask;
+		for (i = 0; i < EVENT_MAX_EVENT; i++) {
+			if (mask & (1 << i)) event_register(i, cgi_cacheInvalidate, NULL, 0);
+		}
+		registered = true;
+	}
+	mutex_unlock(&cache_mutex);
+}
+
 static int cgi_sendJSONeventdata (int sock, json_valT *root)
 {
 	int rc;
@@ -497,6 +717,44 @@ static int cgi_listBIDIBnodes (json_stackT *jstk, struct bidibnode *bn)
 	return cnt;
 }
 
+/**
+ * Add the members describing a BiDiB detector block to the current object.
+ */
+static void cgi_blockMembers (json_stackT *jstk, struct occ_block *blk)
+{
+	json_valT *obj;
+	json_itmT *itm;
+	int i;
+
+	json_addStringItem(jstk, "uid", bidib_formatUID(blk->uid));
+	json_addIntItem(jstk, "port", blk->port);
+	json_addIntItem(jstk, "fb", blk->fbidx);
+	json_addIntItem(jstk, "occupied", blk->occupied);
+	itm = json_addArrayItem(jstk, "locos");
+	jstk = json_pushArray(jstk, itm);
+	for (i = 0; i < blk->nlocos; i++) {
+		obj = json_addObject(jstk);
+		jstk = json_pushObject(jstk, obj);
+		json_addIntItem(jstk, "adr", blk->loco[i].adr);
+		json_addIntItem(jstk, "acc", blk->loco[i].accessory);
+		json_addIntItem(jstk, "reverse", blk->loco[i].reverse);
+		jstk = json_pop(jstk);
+	}
+	json_pop(jstk);
+}
+
+/**
+ * Add the members describing the RailCom data of an address to the current object.
+ */
+static void cgi_railcomMembers (json_stackT *jstk, struct occ_rcdata *rc)
+{
+	json_addIntItem(jstk, "adr", rc->adr);
+	if (rc->valid & OCC_RCVALID_SPEED) json_addIntItem(jstk, "speed", rc->speed);
+	if (rc->valid & OCC_RCVALID_QOS) json_addIntItem(jstk, "qos", rc->qos);
+	if (rc->valid & OCC_RCVALID_TEMP) json_addIntItem(jstk, "temp", rc->temp);
+	json_addUintItem(jstk, "count", rc->rxcount);
+}
+
 static bool cgi_eventHandler (eventT *e, void *prv)
 {
 	struct cbdata *cb;
@@ -508,6 +766,7 @@ static bool cgi_eventHandler (eventT *e, void *prv)
 	struct bidibnode *bn;
 	struct en_bootProgress *enprogress;
 	struct consist *c;
+	struct occ_change *occ;
 	ldataT *l;
 	locoT *ldb;
 	turnoutT *t;
@@ -646,6 +905,22 @@ static bool cgi_eventHandler (eventT *e, void *prv)
 			json_addIntItem(jstk, "module", fbevt->module);
 			json_addIntItem(jstk, "occupy", fbevt->status);
 			break;
+		case EVENT_BLOCKOCC:
+			root = json_addObject(NULL);	// create root object
+			jstk = json_pushObject(NULL, root);
+			if (e->param == BDBBM_EVT_BLOCK) {
+				occ = (struct occ_change *) e->src;
+				itm = json_addItem(jstk, "block");
+				itm->value = json_addObject(NULL);
+				jstk = json_pushObject(jstk, itm->value);
+				cgi_blockMembers(jstk, &occ->blk);
+			} else {
+				itm = json_addItem(jstk, "railcom");
+				itm->value = json_addObject(NULL);
+				jstk = json_pushObject(jstk, itm->value);
+				cgi_railcomMembers(jstk, (struct occ_rcdata *) e->src);
+			}
+			break;
 		case EVENT_CURRENT:
 			root = json_addObject(NULL);	// create root object
 			jstk = json_pushObject(NULL, root);
@@ -724,6 +999,9 @@ static bool cgi_eventHandler (eventT *e, void *prv)
 			json_addIntItem(jstk, "supply", (an_getSupply() + 50) / 100);
 			json_addIntItem(jstk, "temperature", an_getTemperature());
 			json_addIntItem(jstk, "startstate", !!(sc->sysflags & SYSFLAG_STARTSTATE));
+			json_addIntItem(jstk, "reporttarget", !!(sc->sysflags & SYSFLAG_REPORTTARGET));
+			json_addStringItem(jstk, "ownership", own_policy2string(sc->ownpolicy));
+			json_addIntItem(jstk, "wlan", !!(sc->sysflags & SYSFLAG_WLAN));
 			break;
 		case EVENT_RAILCOM:
 			msg = e->src;
@@ -842,6 +1120,10 @@ static bool cgi_eventHandler (eventT *e, void *prv)
 				jstk = json_pushArray(jstk, itm);
 				json_addIntValue(jstk, enprogress->current);
 				json_addIntValue(jstk, enprogress->total);
+				json_addIntValue(jstk, enprogress->pass);
+				json_addIntValue(jstk, enprogress->units);
+				json_addIntValue(jstk, enprogress->done);
+				json_addIntValue(jstk, enprogress->failed);
 			}
 			break;
 		case EVENT_CONSIST:
@@ -912,6 +1194,8 @@ static int cgi_regEvent (int sock, struct http_request *hr, const char *rest, in
 			ev_mask |= 1 << EVENT_FEEDBACK;
 			ev_mask |= 1 << EVENT_FBPARAM;
 			ev_mask |= 1 << EVENT_FBNEW;
+		} else if (!strcasecmp("blocks", kv->key)) {
+			ev_mask |= 1 << EVENT_BLOCKOCC;
 		} else if (!strcasecmp("current", kv->key)) {
 			ev_mask |= 1 << EVENT_CURRENT;
 		} else if (!strcasecmp("booster", kv->key)) {
@@ -1130,52 +1414,28 @@ static int cgi_createFile (int sock, char *dir, char *name)
 	return fd;
 }
 
-static int cgi_update (int sock, struct http_request *hr, const char *rest, int sz)
+/**
+ * Receive the body of a POST or PUT request and hand it to a storage function.
+ * If the body is a multipart form (Content-Type with a boundary), only the
+ * contents of the first part are stored. At the end, the storage function is
+ * called with a NULL buffer.
+ *
+ * \param sock		the socket to read from
+ * \param hr		the request headers
+ * \param rest		the part of the body that was already received with the headers
+ * \param sz		the number of bytes in rest
+ * \param len		the length of the body (from the Content-Length header)
+ * \param func		the storage function
+ * \param arg		the argument for the storage function
+ * \return			the number of bytes that are missing (0 if all was received) or
+ * 					-1 on errors, where the error response was already sent
+ */
+static int cgi_receive (int sock, struct http_request *hr, const char *rest, int sz, int len, int (*func)(void *, uint8_t *, int), void *arg)
 {
 	struct key_value *kv;
-	int (*func)(void *, uint8_t *, int);
-	void *arg;
 	char *boundary = NULL;
 	uint8_t *buf;
-	int fd, discard, len;
-
-	if ((kv = kv_lookup(hr->headers, "Content-Length")) != NULL) {
-		len = atoi(kv->value);
-	} else {
-		httpd_header(sock, LENGTH_REQUIRED, NULL);
-		return 0;
-	}
-
-	func = NULL;
-	if ((kv = kv_lookup(hr->param, "device")) != NULL) {	// this is an update request
-		if (!strcmp ("zentrale", kv->value)) {
-			if ((fd = cgi_createFile(sock, FIRMWARE_DIR, kv->value)) < 0) return 0;
-			arg = (void *) fd;
-			func = cgi_fileStorage;
-			sig_setMode(TM_RESET);
-		} else if (!strcmp ("ENContr", kv->value)) {
-			func = en_bootReadBuffer;
-			en_bootReadBuffer(NULL, NULL, -1);		// init the memory and line buffer
-			arg = NULL;
-		} else if (!strcmp ("web", kv->value)) {
-			if ((fd = cgi_createFile(sock, FIRMWARE_DIR, "html.cpio")) < 0) return 0;
-			arg = (void *) fd;
-			func = cgi_fileStorage;
-		}
-	} else {
-		if ((kv = kv_lookup(hr->param, "fname")) != NULL) {
-			if ((fd = cgi_createFile(sock, "/", kv->value)) < 0) return 0;
-			arg = (void *) fd;
-			func = cgi_fileStorage;
-		} else {
-			httpd_header(sock, BAD_REQUEST, NULL);
-			return 0;
-		}
-	}
-	if (func == NULL) {		// we need some kind of target for the file data
-		httpd_header(sock, FILE_NOT_FOUND, NULL);
-		return 0;
-	}
+	int discard;
 
 	if ((kv = kv_lookup(hr->headers, "Content-Type")) != NULL) {
 		if ((boundary = strstr(kv->value, "boundary=")) != NULL) {
@@ -1186,8 +1446,9 @@ static int cgi_update (int sock, struct http_request *hr, const char *rest, int
 
 	// let's allocate a buffer for data reception
 	if ((buf = malloc(RX_BUFSIZE)) == NULL) {
+		func (arg, NULL, 0);
 		httpd_header(sock, INTERNAL_SERVER_ERROR, NULL);
-		return 0;
+		return -1;
 	}
 	if (sz > 0) {
 //		log_msg(LOG_INFO, "%s() already received: '%*.*s'\n", __func__, sz, sz, rest);
@@ -1201,8 +1462,10 @@ static int cgi_update (int sock, struct http_request *hr, const char *rest, int
 		}
 		if (sz <= 0) {
 			log_error ("%s(): boundary not found in stream - give up\n", __func__);
+			func (arg, NULL, 0);
 			httpd_header(sock, BAD_REQUEST, NULL);
-			return 0;
+			free (buf);
+			return -1;
 		}
 		sz -= 4;
 		memmove (buf, buf + 4, sz);
@@ -1226,16 +1489,119 @@ static int cgi_update (int sock, struct http_request *hr, const char *rest, int
 	}
 
 	func (arg, NULL, 0);		// signal end of data
+	free (buf);
 
 	if (len > 0) {
 		log_error ("%s(): premature end-of-transmission with %d bytes left\n", __func__, len);
+		return len;
+	}
+	return 0;
+}
+
+static int cgi_update (int sock, struct http_request *hr, const char *rest, int sz)
+{
+	struct key_value *kv;
+	int (*func)(void *, uint8_t *, int);
+	void *arg;
+	int fd, len;
+
+	if ((kv = kv_lookup(hr->headers, "Content-Length")) != NULL) {
+		len = atoi(kv->value);
+	} else {
+		httpd_header(sock, LENGTH_REQUIRED, NULL);
+		return 0;
+	}
+
+	func = NULL;
+	if ((kv = kv_lookup(hr->param, "device")) != NULL) {	// this is an update request
+		if (!strcmp ("zentrale", kv->value)) {
+			if ((fd = cgi_createFile(sock, FIRMWARE_DIR, kv->value)) < 0) return 0;
+			arg = (void *) fd;
+			func = cgi_fileStorage;
+			sig_setMode(TM_RESET);
+		} else if (!strcmp ("ENContr", kv->value)) {
+			func = en_bootReadBuffer;
+			en_bootReadBuffer(NULL, NULL, -1);		// init the memory and line buffer
+			arg = NULL;
+		} else if (!strcmp ("web", kv->value)) {
+			if ((fd = cgi_createFile(sock, FIRMWARE_DIR, "html.cpio")) < 0) return 0;
+			arg = (void *) fd;
+			func = cgi_fileStorage;
+		} else if (!strcmp ("bidib", kv->value)) {		// firmware image for BiDiB nodes
+			if ((kv = kv_lookup(hr->param, "fname")) == NULL || strchr(kv->value, '/')) {
+				httpd_header(sock, BAD_REQUEST, NULL);
+				return 0;
+			}
+			if ((fd = cgi_createFile(sock, BIDIBFW_DIR, kv->value)) < 0) return 0;
+			arg = (void *) fd;
+			func = cgi_fileStorage;
+		}
+	} else {
+		if ((kv = kv_lookup(hr->param, "fname")) != NULL) {
+			if ((fd = cgi_createFile(sock, "/", kv->value)) < 0) return 0;
+			arg = (void *) fd;
+			func = cgi_fileStorage;
+		} else {
+			httpd_header(sock, BAD_REQUEST, NULL);
+			return 0;
+		}
+	}
+	if (func == NULL) {		// we need some kind of target for the file data
+		httpd_header(sock, FILE_NOT_FOUND, NULL);
+		return 0;
 	}
+
+	if (cgi_receive(sock, hr, rest, sz, len, func, arg) < 0) return 0;
+
 	log_msg (LOG_INFO, "%s(): upload finished\n", __func__);
 	httpd_header(sock, RESOURCE_CREATED, NULL);
-	free (buf);
 	return 0;
 }
 
+/**
+ * Restore a backup that was created with the query "backup". The archive is
+ * sent as the body of the request (plain or as a multipart form). If it is
+ * valid, it replaces the configuration and the station is restarted after
+ * the answer is sent. The answer is a JSON object with the result.
+ */
+static int cgi_restore (int sock, struct http_request *hr, const char *rest, int sz)
+{
+	struct key_value *kv;
+	struct bak_restore *rs;
+	enum arc_error err;
+	json_valT *root;
+	json_stackT *jstk;
+	int len;
+
+	if ((kv = kv_lookup(hr->headers, "Content-Length")) != NULL) {
+		len = atoi(kv->value);
+	} else {
+		httpd_header(sock, LENGTH_REQUIRED, NULL);
+		return 0;
+	}
+
+	if ((rs = bak_restoreStart()) == NULL) {
+		httpd_header(sock, INTERNAL_SERVER_ERROR, NULL);
+		return 0;
+	}
+	if (cgi_receive(sock, hr, rest, sz, len, bak_restoreData, rs) < 0) {
+		bak_restoreFinish(rs);		// the archive is incomplete, so this only cleans up
+		return 0;
+	}
+	err = bak_restoreFinish(rs);
+
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	json_addIntItem(jstk, "result", (err == ARC_OK));
+	json_addStringItem(jstk, "message", arc_strerror(err));
+	cgi_sendHeaderJSON(sock, root);
+	json_free(root);
+	json_popAll(jstk);
+
+	if (err == ARC_OK) reboot();
+	return -1;
+}
+
 static int cgi_readfile (int sock, struct http_request *hr, const char *rest, int sz)
 {
 	struct key_value *kv, *hdrs;
@@ -1366,6 +1732,7 @@ static void cgi_postLocoDBdata (int sock, locoT *l)
 	socket_sendstring (sock, response);
 	socket_printf (sock, "\"fmt\": \"%s\",\n", db_fmt2string(l->fmt));
 	socket_printf (sock, "\"uid\": %lu,\n", l->uid);
+	socket_printf (sock, "\"momentum\": \"%u,%u,%s\",\n", l->ramp.accel, l->ramp.decel, ramp_curve2string(l->ramp.curve));
 	socket_printf (sock, "\"vid\": %lu,\n", l->vid);
 	socket_printf (sock, "\"maxfunc\": %d,\n", l->maxfunc);
 	switch (l->config) {
@@ -1996,22 +2363,63 @@ static int cgi_pgcvwrite (int sock, struct http_request *hr)
 	return -1;
 }
 
-static int cgi_m3read (int sock, struct http_request *hr)
+/**
+ * Read or write (if a value is given) a LNCV of a LocoNet module. The complete
+ * session (start, read or write and stop) is done with a single request.
+ */
+static int cgi_lncv (int sock, struct http_request *hr)
 {
 	struct key_value *kv, *hdrs;
-	ldataT *l = NULL;
+	int art, mod, cv, val, rc;
 
-	if (rt.tm != TM_GO && rt.tm != TM_HALT && rt.tm != TM_TESTDRIVE) return 1;
-	if ((kv = kv_lookup(hr->param, "lok")) != NULL) {	// check if we are supplied with a mobile decoder address
-		if ((l = loco_call(atoi(kv->value), true)) != NULL) {		// check for illegal decoder address or out of memory
-			if (FMT_IS_M3(l->loco->fmt)) {
-				m3_readDecoder(l->loco->adr);
-			}
-		}
+	if ((kv = kv_lookup(hr->param, "art")) == NULL) {
+		log_error ("%s(): ART parameter missing\n", __func__);
+		return 1;
 	}
-
-	hdrs = kv_add(NULL, "Content-Length", "0");
-	httpd_header(sock, FILE_OK, hdrs);
+	art = atoi(kv->value);
+	if ((kv = kv_lookup(hr->param, "mod")) == NULL) {
+		log_error ("%s(): MOD parameter missing\n", __func__);
+		return 1;
+	}
+	mod = atoi(kv->value);
+	if ((kv = kv_lookup(hr->param, "cv")) == NULL) {
+		log_error ("%s(): CV parameter missing\n", __func__);
+		return 1;
+	}
+	cv = atoi(kv->value);
+
+	if ((rc = ln_lncvStart(art, mod)) >= 0) {
+		if ((kv = kv_lookup(hr->param, "val")) != NULL) {
+			val = atoi(kv->value);
+			if ((rc = ln_lncvWrite(art, cv, val)) == 0) rc = val;
+		} else {
+			rc = ln_lncvRead(art, cv);
+		}
+		ln_lncvEnd(art, mod);
+	}
+	hdrs = kv_add(NULL, "Content-Type", CONTENT_JSON);
+	httpd_header(sock, FILE_OK, hdrs);
+	kv_free(hdrs);
+	socket_printf (sock, "{ \"lncv\": [ %d, %d ] }\n", cv, rc);
+	return -1;
+}
+
+static int cgi_m3read (int sock, struct http_request *hr)
+{
+	struct key_value *kv, *hdrs;
+	ldataT *l = NULL;
+
+	if (rt.tm != TM_GO && rt.tm != TM_HALT && rt.tm != TM_TESTDRIVE) return 1;
+	if ((kv = kv_lookup(hr->param, "lok")) != NULL) {	// check if we are supplied with a mobile decoder address
+		if ((l = loco_call(atoi(kv->value), true)) != NULL) {		// check for illegal decoder address or out of memory
+			if (FMT_IS_M3(l->loco->fmt)) {
+				m3_readDecoder(l->loco->adr);
+			}
+		}
+	}
+
+	hdrs = kv_add(NULL, "Content-Length", "0");
+	httpd_header(sock, FILE_OK, hdrs);
 	kv_free(hdrs);
 	return -1;
 }
@@ -2146,10 +2554,541 @@ static int cgi_getBiDiBs88Mapping (int sock, struct http_request *hr)
 		}
 		socket_printf (sock, "] }\n");
 	}
-
+
+	return -1;
+}
+
+static int cgi_getS88Filter (int sock, struct http_request *hr)
+{
+	struct s88f_config *fc;
+	struct s88f_profile *p;
+	json_valT *root, *obj;
+	json_itmT *itm;
+	json_stackT *jstk;
+	int i, j;
+	char tmp[20];
+
+	(void) hr;
+
+	if (cgi_cacheSend(sock, CACHE_S88FILTER)) return -1;
+
+	fc = &cnf_getconfig()->s88filter;
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	itm = json_addArrayItem(jstk, "profiles");
+	jstk = json_pushArray(jstk, itm);
+	for (i = 0; i < S88F_PROFILES; i++) {
+		p = &fc->profile[i];
+		obj = json_addObject(jstk);
+		jstk = json_pushObject(jstk, obj);
+		json_addIntItem(jstk, "onN", p->onN);
+		json_addIntItem(jstk, "onM", p->onM);
+		json_addIntItem(jstk, "offN", p->offN);
+		json_addIntItem(jstk, "offM", p->offM);
+		jstk = json_pop(jstk);
+	}
+	jstk = json_pop(jstk);
+	itm = json_addArrayItem(jstk, "modules");
+	jstk = json_pushArray(jstk, itm);
+	for (i = 0; i < s88_getModules() && i < S88F_MODULES; i++) {
+		for (j = 0; j < 16; j++) tmp[j] = '0' + s88f_getInputProfile(fc, i * 16 + j);
+		tmp[j] = 0;
+		json_addStringValue(jstk, tmp);
+	}
+	cgi_cacheStore(CACHE_S88FILTER, root);
+	cgi_sendHeaderJSON(sock, root);
+	json_free(root);
+	json_popAll(jstk);
+
+	return -1;
+}
+
+static const char *cgi_bsvSource (int src)
+{
+	switch (src) {
+		case BSV_SRC_INTERNAL:		return "internal";
+		case BSV_SRC_MAERKLIN:		return "maerklin";
+		case BSV_SRC_DCC:			return "dcc";
+		case BSV_SRC_SUPPLY:		return "supply";
+		case BSV_SRC_OVERCURRENT:	return "overcurrent";
+	}
+	return "unknown";
+}
+
+/**
+ * Send the short circuit statistics of the booster supervisor.
+ */
+static int cgi_getBoosterStats (int sock, struct http_request *hr)
+{
+	struct bsv_stats st;
+	json_valT *root;
+	json_itmT *itm;
+	json_stackT *jstk;
+	int i;
+
+	(void) hr;
+
+	ts_getShortStats(&st);
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	itm = json_addItem(jstk, "shorts");
+	itm->value = json_addObject(NULL);
+	jstk = json_pushObject(jstk, itm->value);
+	for (i = 0; i < BSV_SRC_COUNT; i++) {
+		json_addUintItem(jstk, cgi_bsvSource(i), st.shorts[i]);
+	}
+	jstk = json_pop(jstk);
+	json_addUintItem(jstk, "first", st.first);
+	json_addUintItem(jstk, "last", st.last);
+	json_addUintItem(jstk, "now", xTaskGetTickCount());
+	json_addUintItem(jstk, "overcurrent", st.overcurrent);
+	json_addUintItem(jstk, "longest", st.longest);
+	json_addUintItem(jstk, "restarts", st.restarts);
+	json_addUintItem(jstk, "giveups", st.giveups);
+	cgi_sendHeaderJSON(sock, root);
+	json_free(root);
+	json_popAll(jstk);
+	return -1;
+}
+
+/**
+ * Send one of the captured current waveforms of the internal booster.
+ * The parameter "idx" selects the capture (0 = newest, default).
+ */
+static int cgi_getBoosterCapture (int sock, struct http_request *hr)
+{
+	struct bsv_capture *cap;
+	struct key_value *kv;
+	json_valT *root;
+	json_itmT *itm;
+	json_stackT *jstk;
+	int i, idx;
+
+	idx = ((kv = kv_lookup(hr->param, "idx")) != NULL) ? atoi(kv->value) : 0;
+	if ((cap = malloc(sizeof(*cap))) == NULL) return 1;
+	if (!ts_getCapture(idx, cap)) {
+		free (cap);
+		return 1;
+	}
+
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	json_addUintItem(jstk, "seq", cap->seq);
+	json_addUintItem(jstk, "ts", cap->ts);
+	json_addStringItem(jstk, "source", cgi_bsvSource(cap->source));
+	json_addIntItem(jstk, "pre", cap->pre);
+	json_addIntItem(jstk, "peak", cap->peak);
+	itm = json_addArrayItem(jstk, "samples");
+	jstk = json_pushArray(jstk, itm);
+	for (i = 0; i < cap->count; i++) {
+		json_addIntValue(jstk, cap->samples[i]);
+	}
+	cgi_sendHeaderJSON(sock, root);
+	json_free(root);
+	json_popAll(jstk);
+	free (cap);
+	return -1;
+}
+
+static const char *cgi_crashReason (uint32_t reason)
+{
+	switch (reason) {
+		case CRASH_FAULT:			return "fault";
+		case CRASH_FAULT_ISR:		return "isrfault";
+		case CRASH_ASSERT:			return "assert";
+		case CRASH_STACKOVERFLOW:	return "stackoverflow";
+		case CRASH_WATCHDOG:		return "watchdog";
+		default:					return "unknown";
+	}
+}
+
+/**
+ * Send the crash records stored in the file system. Without parameters, a
+ * summary of all records is sent. With the parameter "idx" the complete
+ * record is sent as binary file (to be decoded with Tools/crashdecode.py).
+ */
+static int cgi_getCrash (int sock, struct http_request *hr)
+{
+	struct crash_record *cr;
+	struct key_value *kv, *hdrs;
+	json_valT *root, *obj;
+	json_itmT *itm;
+	json_stackT *jstk;
+	int idx[CRASH_KEEP];
+	int i, cnt, len;
+	char *tmp;
+
+	if ((cr = malloc(sizeof(*cr))) == NULL) return 1;
+
+	if ((kv = kv_lookup(hr->param, "idx")) != NULL) {
+		i = atoi(kv->value);
+		if ((len = crash_read(i, (uint8_t *) cr, sizeof(*cr))) <= 0) {
+			free (cr);
+			return 1;
+		}
+		tmp = tmp64();
+		sprintf (tmp, "attachment; filename=\"crash%d.bin\"", i);
+		hdrs = kv_add(NULL, "Content-Type", "application/octet-stream");
+		hdrs = kv_add(hdrs, "Content-Disposition", tmp);
+		sprintf (tmp, "%d", len);
+		hdrs = kv_add(hdrs, "Content-Length", tmp);
+		httpd_header(sock, FILE_OK, hdrs);
+		kv_free(hdrs);
+		socket_senddata(sock, cr, len);
+		free (cr);
+		return -1;
+	}
+
+	cnt = crash_list(idx, DIM(idx));
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	itm = json_addArrayItem(jstk, "crash");
+	jstk = json_pushArray(jstk, itm);
+	for (i = cnt - 1; i >= 0; i--) {		// newest first
+		if (crash_read(idx[i], (uint8_t *) cr, sizeof(*cr)) != sizeof(*cr) || cr->magic != CRASH_MAGIC) continue;
+		cr->task[sizeof(cr->task) - 1] = 0;
+		cr->info[sizeof(cr->info) - 1] = 0;
+		obj = json_addObject(jstk);
+		jstk = json_pushObject(jstk, obj);
+		json_addIntItem(jstk, "idx", idx[i]);
+		json_addStringItem(jstk, "reason", cgi_crashReason(cr->reason));
+		json_addUintItem(jstk, "uptime", cr->uptime);
+		json_addStringItem(jstk, "task", cr->task);
+		json_addFormatStringItem(jstk, "pc", "0x%08lx", cr->pc);
+		json_addFormatStringItem(jstk, "cfsr", "0x%08lx", cr->cfsr);
+		json_addStringItem(jstk, "info", cr->info);
+		jstk = json_pop(jstk);
+	}
+	cgi_sendHeaderJSON(sock, root);
+	json_free(root);
+	json_popAll(jstk);
+	free (cr);
+	return -1;
+}
+
+/**
+ * Control the session recorder and send its state and the list of
+ * recordings. The parameters are:
+ *   - rec=1 / rec=0 to start or stop a recording
+ *   - play=n to play the recording n (with loop=1 to repeat it and trigger=1
+ *     to wait for the recorded feedback changes)
+ *   - stop=1 to stop a running playback
+ *
+ * The recordings can be downloaded by FTP from /sessions/ and converted
+ * with Tools/sessdecode.py.
+ */
+static int cgi_session (int sock, struct http_request *hr)
+{
+	struct key_value *kv;
+	json_valT *root, *obj;
+	json_itmT *itm;
+	json_stackT *jstk;
+	int idx[8], size[8];
+	int i, cnt;
+	bool loop, triggers;
+
+	if ((kv = kv_lookup(hr->param, "rec")) != NULL) {
+		if (atoi(kv->value)) sess_startRecording();
+		else sess_stopRecording();
+	}
+	if ((kv = kv_lookup(hr->param, "stop")) != NULL && atoi(kv->value)) {
+		sess_stopPlayback();
+	}
+	if ((kv = kv_lookup(hr->param, "play")) != NULL) {
+		i = atoi(kv->value);
+		loop = ((kv = kv_lookup(hr->param, "loop")) != NULL && atoi(kv->value));
+		triggers = ((kv = kv_lookup(hr->param, "trigger")) != NULL && atoi(kv->value));
+		sess_play(i, loop, triggers);
+	}
+
+	cnt = sess_list(idx, size, DIM(idx));
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	json_addIntItem(jstk, "recording", sess_isRecording());
+	json_addIntItem(jstk, "playing", sess_isPlaying());
+	itm = json_addArrayItem(jstk, "sessions");
+	jstk = json_pushArray(jstk, itm);
+	for (i = cnt - 1; i >= 0; i--) {		// newest first
+		obj = json_addObject(jstk);
+		jstk = json_pushObject(jstk, obj);
+		json_addIntItem(jstk, "idx", idx[i]);
+		json_addIntItem(jstk, "size", size[i]);
+		jstk = json_pop(jstk);
+	}
+	cgi_sendHeaderJSON(sock, root);
+	json_free(root);
+	json_popAll(jstk);
+	return -1;
+}
+
+/**
+ * Send a backup of the configuration as a cpio archive (see archive.c).
+ * The archive can be restored with a POST request to /cgi/restore.
+ */
+static int cgi_backup (int sock, struct http_request *hr)
+{
+	struct key_value *hdrs;
+	char *tmp;
+
+	(void) hr;
+
+	tmp = tmp64();
+	sprintf (tmp, "attachment; filename=\"mc2-%d.cpio\"", hwinfo->serial);
+	hdrs = kv_add(NULL, "Content-Type", "application/x-cpio");
+	hdrs = kv_add(hdrs, "Content-Disposition", tmp);
+	httpd_header(sock, FILE_OK, hdrs);
+	kv_free(hdrs);
+	bak_backup(sock);
+	return -1;
+}
+
+/**
+ * Send the per message statistics of the BiDiB dispatch tables. Only message
+ * types that were seen at least once are reported. With the parameter "reset=1"
+ * the statistics are cleared after reporting them.
+ */
+static int cgi_getBiDiBStats (int sock, struct http_request *hr)
+{
+	struct bdbd_table *t;
+	struct bdbd_counter *c;
+	struct key_value *kv;
+	json_valT *root, *obj;
+	json_itmT *itm;
+	json_stackT *jstk;
+	const char *name;
+	int i, msg;
+	bool reset;
+
+	reset = ((kv = kv_lookup(hr->param, "reset")) != NULL) && atoi(kv->value);
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	for (i = 0; (t = bidib_dispatchTable(i)) != NULL; i++) {
+		itm = json_addArrayItem(jstk, t->name);
+		jstk = json_pushArray(jstk, itm);
+		for (msg = 0; msg < BDBD_OPCODES; msg++) {
+			c = &t->cnt[msg];
+			if (!c->rx && !c->error) continue;
+			obj = json_addObject(jstk);
+			jstk = json_pushObject(jstk, obj);
+			json_addIntItem(jstk, "msg", msg);
+			if ((name = bidib_msgName(msg)) != NULL) json_addStringItem(jstk, "name", name);
+			json_addUintItem(jstk, "rx", c->rx);
+			json_addUintItem(jstk, "handled", c->handled);
+			json_addUintItem(jstk, "unknown", c->unknown);
+			json_addUintItem(jstk, "error", c->error);
+			jstk = json_pop(jstk);
+		}
+		jstk = json_pop(jstk);
+		if (reset) bdbd_clear(t);
+	}
+	cgi_sendHeaderJSON(sock, root);
+	json_free(root);
+	json_popAll(jstk);
+	return -1;
+}
+
+/**
+ * Manage the firmware updates of BiDiB nodes and report the images and jobs.
+ * The parameter "op" may be "start", "resume", "cancel" or "clear". The
+ * operation affects the node with the given "uid" (14 hex digits) or all nodes.
+ * With "parallel=1" the updates on different branches run at the same time.
+ */
+static int cgi_bidibFirmware (int sock, struct http_request *hr)
+{
+	struct bdbfw_info *info;
+	struct key_value *kv;
+	struct fwu_image img;
+	yaffs_DIR *dir;
+	struct yaffs_dirent *dentry;
+	json_valT *root, *obj;
+	json_itmT *itm;
+	json_stackT *jstk;
+	uint8_t uid[BIDIB_UID_LEN], *up;
+	bool par;
+	int i, cnt, rc;
+
+	up = NULL;
+	if ((kv = kv_lookup(hr->param, "uid")) != NULL) {
+		if (strlen(kv->value) != 2 * BIDIB_UID_LEN) return 1;
+		for (i = 0; i < BIDIB_UID_LEN; i++) {
+			uid[i] = hex_byte(&kv->value[i * 2]);
+		}
+		up = uid;
+	}
+	par = ((kv = kv_lookup(hr->param, "parallel")) != NULL) && atoi(kv->value);
+	rc = 0;
+	if ((kv = kv_lookup(hr->param, "op")) != NULL) {
+		if (!strcmp("start", kv->value)) rc = BDBfw_start(up, par);
+		else if (!strcmp("resume", kv->value)) BDBfw_resume(up);
+		else if (!strcmp("cancel", kv->value)) BDBfw_cancel(up);
+		else if (!strcmp("clear", kv->value)) BDBfw_clear();
+		else return 1;
+	}
+
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	json_addIntItem(jstk, "result", rc);
+	itm = json_addArrayItem(jstk, "images");
+	jstk = json_pushArray(jstk, itm);
+	if ((dir = yaffs_opendir(BIDIBFW_DIR)) != NULL) {
+		while ((dentry = yaffs_readdir(dir)) != NULL) {
+			if (!fwu_parseName(dentry->d_name, &img)) continue;
+			obj = json_addObject(jstk);
+			jstk = json_pushObject(jstk, obj);
+			json_addStringItem(jstk, "name", dentry->d_name);
+			if (img.byuid) json_addStringItem(jstk, "uid", bidib_formatUID(img.uid));
+			json_addIntItem(jstk, "vid", img.vid);
+			json_addIntItem(jstk, "pid", img.pid);
+			json_addIntItem(jstk, "dest", img.dest);
+			jstk = json_pop(jstk);
+		}
+		yaffs_closedir(dir);
+	}
+	jstk = json_pop(jstk);
+	itm = json_addArrayItem(jstk, "jobs");
+	jstk = json_pushArray(jstk, itm);
+	if ((info = calloc(BIDIB_MAX_FWJOBS, sizeof(*info))) != NULL) {
+		cnt = BDBfw_getJobs(info, BIDIB_MAX_FWJOBS);
+		for (i = 0; i < cnt; i++) {
+			obj = json_addObject(jstk);
+			jstk = json_pushObject(jstk, obj);
+			json_addStringItem(jstk, "uid", bidib_formatUID(info[i].uid));
+			json_addStringItem(jstk, "state", fwu_stateName(info[i].state));
+			json_addStringItem(jstk, "error", fwu_errorName(info[i].error));
+			json_addIntItem(jstk, "nodeerr", info[i].nodeerr);
+			json_addIntItem(jstk, "progress", info[i].progress);
+			json_addIntItem(jstk, "resume", info[i].resume);
+			jstk = json_pop(jstk);
+		}
+		free (info);
+	}
+	cgi_sendHeaderJSON(sock, root);
+	json_free(root);
+	json_popAll(jstk);
+	return -1;
+}
+
+/**
+ * Report the blocks of the BiDiB detectors with the detected addresses.
+ * With the parameter "lok" only the blocks containing that loco are reported
+ * together with the RailCom data of the loco.
+ */
+static int cgi_bidibBlocks (int sock, struct http_request *hr)
+{
+	struct key_value *kv;
+	struct occ_block *blk;
+	struct occ_rcdata rc;
+	json_valT *root, *obj;
+	json_itmT *itm;
+	json_stackT *jstk;
+	int i, j, cnt, loco;
+
+	loco = ((kv = kv_lookup(hr->param, "lok")) != NULL) ? atoi(kv->value) : 0;
+	if ((blk = calloc(OCC_MAXBLOCKS, sizeof(*blk))) == NULL) return 1;
+	cnt = BDBbm_getBlocks(blk, OCC_MAXBLOCKS);
+
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	itm = json_addArrayItem(jstk, "blocks");
+	jstk = json_pushArray(jstk, itm);
+	for (i = 0; i < cnt; i++) {
+		if (loco > 0) {
+			for (j = 0; j < blk[i].nlocos; j++) {
+				if (!blk[i].loco[j].accessory && blk[i].loco[j].adr == loco) break;
+			}
+			if (j >= blk[i].nlocos) continue;
+		}
+		obj = json_addObject(jstk);
+		jstk = json_pushObject(jstk, obj);
+		cgi_blockMembers(jstk, &blk[i]);
+		jstk = json_pop(jstk);
+	}
+	jstk = json_pop(jstk);
+	free (blk);
+	if (loco > 0 && BDBbm_getRailcom(loco, &rc)) {
+		itm = json_addItem(jstk, "railcom");
+		itm->value = json_addObject(NULL);
+		jstk = json_pushObject(jstk, itm->value);
+		cgi_railcomMembers(jstk, &rc);
+	}
+	cgi_sendHeaderJSON(sock, root);
+	json_free(root);
+	json_popAll(jstk);
+	return -1;
+}
+
+/**
+ * List the Märklin CAN devices with config channels (Link S88, Gleisbox).
+ * With the parameters "uid", "ch" and "val" a config channel is written
+ * first, with "uid" and "cycle" the polling cycle of a Link S88 is set.
+ * The new value is reported after the device confirmed the write.
+ */
+static int cgi_mcanConfig (int sock, struct http_request *hr)
+{
+	struct key_value *kv, *kvch;
+	struct mcc_device *devs;
+	struct mcc_channel *ch;
+	json_valT *root, *obj;
+	json_itmT *itm;
+	json_stackT *jstk;
+	uint32_t uid;
+	int i, j, cnt;
+
+	if ((kv = kv_lookup(hr->param, "uid")) != NULL) {
+		uid = strtoul(kv->value, NULL, 16);
+		if ((kvch = kv_lookup(hr->param, "ch")) != NULL) {
+			if ((kv = kv_lookup(hr->param, "val")) == NULL) {
+				log_error ("%s(): VAL parameter missing\n", __func__);
+				return 1;
+			}
+			if (mcan_cfgWrite(uid, atoi(kvch->value), atoi(kv->value)) != 0) return 1;
+		} else if ((kv = kv_lookup(hr->param, "cycle")) != NULL) {
+			if (mcan_ls88SetCycle(uid, atoi(kv->value)) != 0) return 1;
+		}
+	}
+
+	if ((devs = calloc(MCC_MAXDEVICES, sizeof(*devs))) == NULL) return 1;
+	cnt = mcan_getConfigDevices(devs, MCC_MAXDEVICES);
+
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	itm = json_addArrayItem(jstk, "devices");
+	jstk = json_pushArray(jstk, itm);
+	for (i = 0; i < cnt; i++) {
+		obj = json_addObject(jstk);
+		jstk = json_pushObject(jstk, obj);
+		json_addFormatStringItem(jstk, "uid", "%08lx", devs[i].uid);
+		json_addIntItem(jstk, "devid", devs[i].devid);
+		json_addStringItem(jstk, "name", devs[i].name);
+		json_addStringItem(jstk, "article", devs[i].article);
+		json_addUintItem(jstk, "serial", devs[i].serial);
+		itm = json_addArrayItem(jstk, "channels");
+		jstk = json_pushArray(jstk, itm);
+		for (j = 0; j < devs[i].nch; j++) {
+			ch = &devs[i].ch[j];
+			obj = json_addObject(jstk);
+			jstk = json_pushObject(jstk, obj);
+			json_addIntItem(jstk, "ch", ch->index);
+			json_addStringItem(jstk, "name", ch->name);
+			json_addStringItem(jstk, "type", (ch->type == MCC_CHTYPE_LIST) ? "list" : "value");
+			json_addIntItem(jstk, "min", ch->min);
+			json_addIntItem(jstk, "max", ch->max);
+			json_addIntItem(jstk, "value", ch->value);
+			if (ch->unit[0]) json_addStringItem(jstk, "unit", ch->unit);
+			jstk = json_pop(jstk);
+		}
+		jstk = json_pop(jstk);
+		jstk = json_pop(jstk);
+	}
+	free (devs);
+	cgi_sendHeaderJSON(sock, root);
+	json_free(root);
+	json_popAll(jstk);
 	return -1;
 }
 
+static int cgi_getStats (int sock, struct http_request *hr);
+
 static const struct cgiquery queries[] = {
 	{ "get", cgi_getDevice },			// get decoder (loco) information and control (including refresh-info)
 	{ "info", cgi_infoDevice },			// get decoder (loco) information without refresh-info or pulling the loco into refresh list
@@ -2161,159 +3100,341 @@ static const struct cgiquery queries[] = {
 	{ "xpomwrite", cgi_xpomwrite },		// On-Track CV writing (XPOM) to decoder
 	{ "pgcvread", cgi_pgcvread },		// Programming-Track CV reading from decoder
 	{ "pgcvwrite", cgi_pgcvwrite },		// Programming-Track CV writing to decoder
+	{ "lncv", cgi_lncv },				// read or write a LNCV of a LocoNet module
 	{ "m3read", cgi_m3read },			// On-Track reading a M3 decoder (lots of configuration)
 	{ "m3info", cgi_m3info },			// On-Track reading a M3 decoder (only function icons and name)
 	{ "m3name", cgi_m3name },			// write a loco name to the m3 decoder
 	{ "BiDiMapping", cgi_getBiDiBtrntMapping },	// map accessory numbers to BiDiB outputs
 	{ "BiDis88", cgi_getBiDiBs88Mapping },	// map BiDiB inputs to s88 system
+	{ "s88filter", cgi_getS88Filter },	// debounce filter profiles and their assignment to the s88 inputs
+	{ "cgistats", cgi_getStats },		// usage statistics of the query routes and the response cache
+	{ "bststats", cgi_getBoosterStats },	// short circuit statistics of the booster supervisor
+	{ "bstcapture", cgi_getBoosterCapture },	// captured current waveforms of the internal booster
+	{ "crash", cgi_getCrash },			// post mortem crash records (summary or binary record with idx=n)
+	{ "session", cgi_session },			// session recorder and playback (state, list of recordings, rec/play/stop)
+	{ "backup", cgi_backup },			// download a backup of the complete configuration (restore with /cgi/restore)
+	{ "bidibstats", cgi_getBiDiBStats },	// per message statistics of the BiDiB dispatch tables
+	{ "bidibfw", cgi_bidibFirmware },	// firmware updates of BiDiB nodes from images on the station
+	{ "bidibblocks", cgi_bidibBlocks },	// occupancy and detected addresses of the BiDiB detector blocks
+	{ "mcancfg", cgi_mcanConfig },		// config channels of Märklin CAN devices (Link S88, Gleisbox)
 	{ NULL, NULL }
 };
 
-static int cgi_query (int sock, struct http_request *hr, const char *rest, int sz)
+static int cgi_queryCmd (int sock, struct http_request *hr);
+
+/**
+ * Send the system information (versions, flash and RAM usage, network).
+ * Asking the file system for total and free space is quite slow, so these
+ * values are only refreshed after CGI_FLASHINFO_TTL.
+ */
+static int cgi_querySysinfo (int sock, struct http_request *hr)
 {
-	Y_LOFF_T total, avail, used;
-	int percent, rc, module, count;
-	struct key_value *kv, *hdrs;
-	uint32_t uid;
-	const struct cgiquery *p;
-	json_valT *root, *obj;
+	static Y_LOFF_T total, avail;
+	static TickType_t refresh;
+
+	struct key_value *hdrs;
+	json_valT *root;
 	json_itmT *itm;
 	json_stackT *jstk;
-	enum fmt f;
+	Y_LOFF_T used;
+	int percent;
 
-	(void) rest;
-	(void) sz;
+	(void) hr;
 
-	if ((kv = kv_lookup(hr->param, "cmd")) != NULL) {
-		p = queries;
-		rc = 1;
-		while (p->cmd != NULL) {
-			if (!strcasecmp(p->cmd, kv->value)) {
-				rc = p->func(sock, hr);
-				break;
-			}
-			p++;
-		}
-		// if the function returns a positive value, we must supply an answer to the caller
-		if (rc >= 0) {
-			hdrs = kv_add(NULL, "Content-Length", "0");
-			httpd_header(sock, (rc == 0) ? FILE_OK : FILE_NOT_FOUND, hdrs);
-			kv_free(hdrs);
-		}
-		return 0;
-	} else if ((kv = kv_lookup(hr->param, "info")) != NULL) {
-		hdrs = kv_add(NULL, "Content-Type", CONTENT_JSON);
-		httpd_header(sock, FILE_OK, hdrs);
-		kv_free(hdrs);
+	hdrs = kv_add(NULL, "Content-Type", CONTENT_JSON);
+	httpd_header(sock, FILE_OK, hdrs);
+	kv_free(hdrs);
+	if (!refresh || tim_isover(refresh)) {
 		total = yaffs_totalspace("/");
 		avail = yaffs_freespace("/");
-		used = total - avail;
-		percent = (int) ((used * 10000) / total);
-		root = json_addObject(NULL);	// create root object
-		jstk = json_pushObject(NULL, root);
-		json_addUintItem(jstk, "flashMax", total / 1024);
-		json_addIntItem(jstk, "flashPercent", percent);
-		json_addUintItem(jstk, "ramMax", rt.totalHeap / 1024);
-		percent = (int) (((rt.totalHeap - xPortGetFreeHeapSize()) * 10000LL) / rt.totalHeap);
-		json_addIntItem(jstk, "ramPercent", percent);
-		itm = json_addArrayItem(jstk, "infos");
-		jstk = json_pushArray(jstk, itm);
-		json_addFormatStringValue(jstk, "V%x.%x", hwinfo->HW >> 4, hwinfo->HW & 0x0F);
-		json_addStringValue(jstk, SOFT_VERSION);
-		json_addUintValue(jstk, hwinfo->serial);
-		json_addFormatStringValue(jstk, "%lu.%lu.%lu.%lu",
-			(rt.en->ip_addr.addr >> 0) & 0xFF, (rt.en->ip_addr.addr >> 8) & 0xFF,
-			(rt.en->ip_addr.addr >> 16) & 0xFF, (rt.en->ip_addr.addr >> 24) & 0xFF);
-		json_addFormatStringValue(jstk, "%02X:%02X:%02X:%02X:%02X:%02X",
-				rt.en->hwaddr[0], rt.en->hwaddr[1],	rt.en->hwaddr[2], rt.en->hwaddr[3], rt.en->hwaddr[4], rt.en->hwaddr[5]);
+		refresh = tim_timeout(CGI_FLASHINFO_TTL);
+	}
+	used = total - avail;
+	percent = (int) ((used * 10000) / total);
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	json_addUintItem(jstk, "flashMax", total / 1024);
+	json_addIntItem(jstk, "flashPercent", percent);
+	json_addUintItem(jstk, "ramMax", rt.totalHeap / 1024);
+	percent = (int) (((rt.totalHeap - xPortGetFreeHeapSize()) * 10000LL) / rt.totalHeap);
+	json_addIntItem(jstk, "ramPercent", percent);
+	itm = json_addArrayItem(jstk, "infos");
+	jstk = json_pushArray(jstk, itm);
+	json_addFormatStringValue(jstk, "V%x.%x", hwinfo->HW >> 4, hwinfo->HW & 0x0F);
+	json_addStringValue(jstk, SOFT_VERSION);
+	json_addUintValue(jstk, hwinfo->serial);
+	json_addFormatStringValue(jstk, "%lu.%lu.%lu.%lu",
+		(rt.en->ip_addr.addr >> 0) & 0xFF, (rt.en->ip_addr.addr >> 8) & 0xFF,
+		(rt.en->ip_addr.addr >> 16) & 0xFF, (rt.en->ip_addr.addr >> 24) & 0xFF);
+	json_addFormatStringValue(jstk, "%02X:%02X:%02X:%02X:%02X:%02X",
+			rt.en->hwaddr[0], rt.en->hwaddr[1],	rt.en->hwaddr[2], rt.en->hwaddr[3], rt.en->hwaddr[4], rt.en->hwaddr[5]);
+	jstk = json_pop(jstk);
+	itm = json_addArrayItem(jstk, "m3station");
+	jstk = json_pushArray(jstk, itm);
+	json_addUintValue(jstk, sig_getM3Beacon());
+	json_addUintValue(jstk, sig_getM3AnnounceCounter());
+	cgi_sendJSON(sock, root);
+	json_free(root);
+	json_popAll(jstk);
+	return -1;
+}
+
+static int cgi_queryM3search (int sock, struct http_request *hr)
+{
+	struct key_value *hdrs;
+	json_valT *root;
+	json_stackT *jstk;
+	uint32_t uid;
+
+	(void) hr;
+
+	hdrs = kv_add(NULL, "Content-Type", CONTENT_JSON);
+	httpd_header(sock, FILE_OK, hdrs);
+	kv_free(hdrs);
+	uid = m3pt_getUID();
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	json_addUintItem(jstk, "m3uid", uid);
+	cgi_sendJSON(sock, root);
+	json_free(root);
+	json_popAll(jstk);
+	return -1;
+}
+
+static int cgi_queryM3scan (int sock, struct http_request *hr)
+{
+	json_valT *root, *obj;
+	json_itmT *itm;
+	json_stackT *jstk;
+	uint32_t uids[M3S_MAXFOUND];
+	locoT *l;
+	int i, cnt;
+
+	(void) hr;
+
+	cnt = m3_discover(uids, DIM(uids));
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	json_addIntItem(jstk, "rc", (cnt < 0) ? cnt : 0);
+	itm = json_addArrayItem(jstk, "locos");
+	jstk = json_pushArray(jstk, itm);
+	for (i = 0; i < cnt; i++) {
+		obj = json_addObject(jstk);
+		jstk = json_pushObject(jstk, obj);
+		json_addUintItem(jstk, "m3uid", uids[i]);
+		if ((l = db_findLocoUID(0, uids[i])) != NULL) json_addIntItem(jstk, "adr", l->adr);
 		jstk = json_pop(jstk);
-		itm = json_addArrayItem(jstk, "m3station");
-		jstk = json_pushArray(jstk, itm);
-		json_addUintValue(jstk, sig_getM3Beacon());
-		json_addUintValue(jstk, sig_getM3AnnounceCounter());
-		cgi_sendJSON(sock, root);
-		json_free(root);
-		json_popAll(jstk);
-		return 0;
-	} else if ((kv = kv_lookup(hr->param, "m3search")) != NULL) {
-		hdrs = kv_add(NULL, "Content-Type", CONTENT_JSON);
-		httpd_header(sock, FILE_OK, hdrs);
-		kv_free(hdrs);
-		uid = m3pt_getUID();
-		root = json_addObject(NULL);	// create root object
-		jstk = json_pushObject(NULL, root);
-		json_addUintItem(jstk, "m3uid", uid);
-		cgi_sendJSON(sock, root);
-		json_free(root);
-		json_popAll(jstk);
-		return 0;
-	} else if ((kv = kv_lookup(hr->param, "tracklimits")) != NULL) {
-		hdrs = kv_add(NULL, "Content-Type", CONTENT_JSON);
-		httpd_header(sock, FILE_OK, hdrs);
-		kv_free(hdrs);
-		socket_sendstring (sock, ts_getRanges());
-		return 0;
-	} else if ((kv = kv_lookup(hr->param, "turnoutlimits")) != NULL) {
-		hdrs = kv_add(NULL, "Content-Type", CONTENT_JSON);
-		httpd_header(sock, FILE_OK, hdrs);
-		kv_free(hdrs);
-		socket_sendstring (sock, trnt_getRanges());
-		return 0;
-	} else if ((kv = kv_lookup(hr->param, "boosterlimits")) != NULL) {
-		hdrs = kv_add(NULL, "Content-Type", CONTENT_JSON);
-		httpd_header(sock, FILE_OK, hdrs);
-		kv_free(hdrs);
-		socket_sendstring (sock, cnf_getBoosterLimits());
-		return 0;
-	} else if ((kv = kv_lookup(hr->param, "s88query")) != NULL) {
+	}
+	jstk = json_pop(jstk);
+	cgi_sendHeaderJSON(sock, root);
+	json_free(root);
+	json_popAll(jstk);
+	return -1;
+}
+
+static int cgi_sendJSONstring (int sock, const char *s)
+{
+	struct key_value *hdrs;
+
+	hdrs = kv_add(NULL, "Content-Type", CONTENT_JSON);
+	httpd_header(sock, FILE_OK, hdrs);
+	kv_free(hdrs);
+	socket_sendstring (sock, s);
+	return -1;
+}
+
+static int cgi_queryTrackLimits (int sock, struct http_request *hr)
+{
+	(void) hr;
+
+	return cgi_sendJSONstring(sock, ts_getRanges());
+}
+
+static int cgi_queryTurnoutLimits (int sock, struct http_request *hr)
+{
+	(void) hr;
+
+	return cgi_sendJSONstring(sock, trnt_getRanges());
+}
+
+static int cgi_queryBoosterLimits (int sock, struct http_request *hr)
+{
+	(void) hr;
+
+	return cgi_sendJSONstring(sock, cnf_getBoosterLimits());
+}
+
+static int cgi_queryS88 (int sock, struct http_request *hr)
+{
 #ifdef CENTRAL_FEEDBACK
-		hdrs = kv_add(NULL, "Content-Type", CONTENT_JSON);
-		httpd_header(sock, FILE_OK, hdrs);
-		kv_free(hdrs);
-		module = atoi(kv->value);
-		count = 1;
-		if ((kv = kv_lookup(hr->param, "count")) != NULL) count = atoi(kv->value);
-		root = json_addObject(NULL);	// create root object
-		jstk = json_pushObject(NULL, root);
-		json_addIntItem(jstk, "module", module);
-		itm = json_addArrayItem(jstk, "occupy");
-		jstk = json_pushArray(jstk, itm);
-		for (; count > 0; module++, count--) {
-			json_addIntValue(jstk, fb_getModuleState(module));
-		}
-		cgi_sendJSON(sock, root);
-		json_free(root);
+	struct key_value *kv, *hdrs;
+	json_valT *root;
+	json_itmT *itm;
+	json_stackT *jstk;
+	int module, count;
+
+	hdrs = kv_add(NULL, "Content-Type", CONTENT_JSON);
+	httpd_header(sock, FILE_OK, hdrs);
+	kv_free(hdrs);
+	module = 0;
+	if ((kv = kv_lookup(hr->param, "s88query")) != NULL) module = atoi(kv->value);
+	count = 1;
+	if ((kv = kv_lookup(hr->param, "count")) != NULL) count = atoi(kv->value);
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	json_addIntItem(jstk, "module", module);
+	itm = json_addArrayItem(jstk, "occupy");
+	jstk = json_pushArray(jstk, itm);
+	for (; count > 0; module++, count--) {
+		json_addIntValue(jstk, fb_getModuleState(module));
+	}
+	cgi_sendJSON(sock, root);
+	json_free(root);
+	return -1;
 #else
-		s88_triggerUpdate();
-		hdrs = kv_add(NULL, "Content-Length", "0");
-		httpd_header(sock, FILE_OK, hdrs);
-		kv_free(hdrs);
+	(void) sock;
+	(void) hr;
+
+	s88_triggerUpdate();
+	return 0;
 #endif
-		return 0;
-	} else if ((kv = kv_lookup(hr->param, "locoformats")) != NULL) {
-		hdrs = kv_add(NULL, "Content-Type", CONTENT_JSON);
-		httpd_header(sock, FILE_OK, hdrs);
-		kv_free(hdrs);
+}
 
-		root = json_addObject(NULL);	// create root object
-		jstk = json_pushObject(NULL, root);
-		itm = json_addArrayItem(jstk, "formats");
-		jstk = json_pushArray(jstk, itm);
-		for (f = FMT_MM1_14; f <= FMT_DCC_SDF; f++) {
-			obj = json_addObject(jstk);
-			jstk = json_pushObject(jstk, obj);
-			json_addIntItem(jstk, "fmtid", f);
-			json_addStringItem(jstk, "fmt", db_fmt2string(f));
-			jstk = json_pop(jstk);
-		}
-		cgi_sendJSON(sock, root);
-		json_free(root);
-		return 0;
+static int cgi_queryLocoformats (int sock, struct http_request *hr)
+{
+	json_valT *root, *obj;
+	json_itmT *itm;
+	json_stackT *jstk;
+	enum fmt f;
+
+	(void) hr;
+
+	if (cgi_cacheSend(sock, CACHE_LOCOFORMATS)) return -1;
+
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	itm = json_addArrayItem(jstk, "formats");
+	jstk = json_pushArray(jstk, itm);
+	for (f = FMT_MM1_14; f <= FMT_DCC_SDF; f++) {
+		obj = json_addObject(jstk);
+		jstk = json_pushObject(jstk, obj);
+		json_addIntItem(jstk, "fmtid", f);
+		json_addStringItem(jstk, "fmt", db_fmt2string(f));
+		jstk = json_pop(jstk);
 	}
+	cgi_cacheStore(CACHE_LOCOFORMATS, root);
+	cgi_sendHeaderJSON(sock, root);
+	json_free(root);
+	json_popAll(jstk);
+	return -1;
+}
 
-	hdrs = kv_add(NULL, "Content-Length", "0");
-	httpd_header(sock, FILE_NOT_FOUND, hdrs);
-	kv_free(hdrs);
+/**
+ * The routes for /cgi/query. A route is selected by the name of a parameter.
+ * If more than one parameter matches a route, the route that comes first in
+ * this table wins.
+ */
+static const struct cgiquery routes[] = {
+	{ "cmd", cgi_queryCmd },					// a query specified by a command (see queries[] above)
+	{ "info", cgi_querySysinfo },				// system information
+	{ "m3search", cgi_queryM3search },			// UID of a M3 decoder found on the programming track
+	{ "m3scan", cgi_queryM3scan },				// find all M3 decoders without address on the main track and assign addresses
+	{ "tracklimits", cgi_queryTrackLimits },	// the ranges for the track settings
+	{ "turnoutlimits", cgi_queryTurnoutLimits },	// the ranges for the turnout settings
+	{ "boosterlimits", cgi_queryBoosterLimits },	// the ranges for the booster settings
+	{ "s88query", cgi_queryS88 },				// the state of s88 modules
+	{ "locoformats", cgi_queryLocoformats },	// the list of possible loco formats
+	{ NULL, NULL }
+};
+
+static struct cgistat query_stats[DIM(queries)];
+static struct cgistat route_stats[DIM(routes)];
+static struct cgihash query_hash = { .tab = queries, .stats = query_stats };
+static struct cgihash route_hash = { .tab = routes, .stats = route_stats };
+
+// the tables are terminated by a NULL entry, the hash tables need at least twice the slots of the real entries
+_Static_assert((DIM(queries) - 1) * 2 <= CGI_HASHSIZE, "CGI_HASHSIZE is too small for the query table");
+_Static_assert((DIM(routes) - 1) * 2 <= CGI_HASHSIZE, "CGI_HASHSIZE is too small for the route table");
+
+static void cgi_addStats (json_stackT *jstk, const char *name, struct cgihash *h)
+{
+	json_valT *obj;
+	json_itmT *itm;
+	int i;
+
+	itm = json_addArrayItem(jstk, name);
+	jstk = json_pushArray(jstk, itm);
+	for (i = 0; h->tab[i].cmd; i++) {
+		obj = json_addObject(jstk);
+		jstk = json_pushObject(jstk, obj);
+		json_addStringItem(jstk, "name", h->tab[i].cmd);
+		json_addUintItem(jstk, "hits", h->stats[i].hits);
+		json_addUintItem(jstk, "ms", h->stats[i].ms);
+		json_addUintItem(jstk, "maxms", h->stats[i].maxms);
+		jstk = json_pop(jstk);
+	}
+	json_pop(jstk);
+}
+
+static int cgi_getStats (int sock, struct http_request *hr)
+{
+	json_valT *root, *obj;
+	json_itmT *itm;
+	json_stackT *jstk;
+	int i;
+
+	(void) hr;
+
+	root = json_addObject(NULL);	// create root object
+	jstk = json_pushObject(NULL, root);
+	cgi_addStats(jstk, "routes", &route_hash);
+	cgi_addStats(jstk, "queries", &query_hash);
+	itm = json_addArrayItem(jstk, "cache");
+	jstk = json_pushArray(jstk, itm);
+	for (i = 0; i < CACHE_COUNT; i++) {
+		obj = json_addObject(jstk);
+		jstk = json_pushObject(jstk, obj);
+		json_addIntItem(jstk, "slot", i);
+		json_addUintItem(jstk, "hits", cache[i].hits);
+		json_addUintItem(jstk, "misses", cache[i].misses);
+		jstk = json_pop(jstk);
+	}
+	cgi_sendHeaderJSON(sock, root);
+	json_free(root);
+	json_popAll(jstk);
+	return -1;
+}
+
+static int cgi_queryCmd (int sock, struct http_request *hr)
+{
+	struct key_value *kv;
+	int idx;
+
+	if ((kv = kv_lookup(hr->param, "cmd")) == NULL) return 1;
+	if ((idx = cgi_hashLookup(&query_hash, kv->value)) < 0) return 1;
+	return cgi_callRoute(&query_hash, idx, sock, hr);
+}
+
+static int cgi_query (int sock, struct http_request *hr, const char *rest, int sz)
+{
+	struct key_value *kv, *hdrs;
+	int rc, idx, best;
+
+	(void) rest;
+	(void) sz;
+
+	best = -1;
+	for (kv = hr->param; kv; kv = kv->next) {
+		if ((idx = cgi_hashLookup(&route_hash, kv->key)) >= 0 && (best < 0 || idx < best)) best = idx;
+	}
+
+	rc = (best >= 0) ? cgi_callRoute(&route_hash, best, sock, hr) : 1;
+	// if the function returns a positive value, we must supply an answer to the caller
+	if (rc >= 0) {
+		hdrs = kv_add(NULL, "Content-Length", "0");
+		httpd_header(sock, (rc == 0) ? FILE_OK : FILE_NOT_FOUND, hdrs);
+		kv_free(hdrs);
+	}
 	return 0;
 }
 
@@ -2425,6 +3546,7 @@ static int cgi_dispatch (int sock, struct http_request *hr)
 	if ((kv = kv_lookup(hr->param, "lok")) == NULL) return -1;
 	loco = atoi(kv->value);
 
+	loco_setClient(OWN_TOKEN(OWN_WEB, 0));
 	ln_dispatchLoco(loco);
 	return 0;
 }
@@ -2451,6 +3573,8 @@ static int cgi_syscfg (int sock, struct http_request *hr)
 {
 	struct sysconf *sc;
 	struct key_value *kv;
+	int idx, onN, onM, offN, offM;
+	int first, last, profile;
 
 	(void) sock;
 
@@ -2473,6 +3597,16 @@ static int cgi_syscfg (int sock, struct http_request *hr)
 		else log_disable(LOG_RAILCOM);
 		event_fire (EVENT_SNIFFER, 0, NULL);
 	}
+	if ((kv = kv_lookup(hr->param, "sniffcapture")) != NULL) {
+		sniffer_capture(atoi(kv->value) != 0);
+	}
+	if ((kv = kv_lookup(hr->param, "bstrestart")) != NULL) {
+		sc->bstsv.restart = (atoi(kv->value)) ? BSV_RESTART_AUTO : BSV_RESTART_MANUAL;
+		cnf_triggerStore(__func__);
+	}
+	if ((kv = kv_lookup(hr->param, "bstclear")) != NULL) {
+		ts_clearShortStats();
+	}
 	if ((kv = kv_lookup(hr->param, "locked")) != NULL) {
 		if(atoi(kv->value) == 1) rt.ctrl |= EXTCTRL_LOCKED;
 		else rt.ctrl &= ~EXTCTRL_LOCKED;
@@ -2490,6 +3624,12 @@ static int cgi_syscfg (int sock, struct http_request *hr)
 	if ((kv = kv_lookup(hr->param, "canMod")) != NULL) can_setModules (atoi(kv->value));
 	if ((kv = kv_lookup(hr->param, "lnetMod")) != NULL) lnet_setModules (atoi(kv->value));
 	if ((kv = kv_lookup(hr->param, "s88Freq")) != NULL) s88_setFrequency(atoi(kv->value));
+	if ((kv = kv_lookup(hr->param, "s88FltProfile")) != NULL) {		// "idx,onN,onM,offN,offM"
+		if (sscanf(kv->value, "%d,%d,%d,%d,%d", &idx, &onN, &onM, &offN, &offM) == 5) s88_setFilterProfile(idx, onN, onM, offN, offM);
+	}
+	if ((kv = kv_lookup(hr->param, "s88FltInput")) != NULL) {		// "first,last,profile" with 0-based input numbers
+		if (sscanf(kv->value, "%d,%d,%d", &first, &last, &profile) == 3) s88_setInputFilter(first, last, profile);
+	}
 	if ((kv = kv_lookup(hr->param, "startstate")) != NULL) {
 		if (atoi(kv->value) == 1) sc->sysflags |= SYSFLAG_STARTSTATE;
 		else sc->sysflags &= ~SYSFLAG_STARTSTATE;
@@ -2497,6 +3637,25 @@ static int cgi_syscfg (int sock, struct http_request *hr)
 		event_fire (EVENT_ENVIRONMENT, 0, NULL);
 		cnf_triggerStore(__func__);
 	}
+	if ((kv = kv_lookup(hr->param, "reporttarget")) != NULL) {
+		if (atoi(kv->value) == 1) sc->sysflags |= SYSFLAG_REPORTTARGET;
+		else sc->sysflags &= ~SYSFLAG_REPORTTARGET;
+		event_fire (EVENT_ENVIRONMENT, 0, NULL);
+		cnf_triggerStore(__func__);
+	}
+	if ((kv = kv_lookup(hr->param, "wlan")) != NULL) {
+		if (atoi(kv->value) == 1) sc->sysflags |= SYSFLAG_WLAN;
+		else sc->sysflags &= ~SYSFLAG_WLAN;
+		log_msg (LOG_INFO, "%s() WLAN interface %s (after the next start)\n", __func__, (sc->sysflags & SYSFLAG_WLAN) ? "enabled" : "disabled");
+		event_fire (EVENT_ENVIRONMENT, 0, NULL);
+		cnf_triggerStore(__func__);
+	}
+	if ((kv = kv_lookup(hr->param, "ownership")) != NULL) {
+		sc->ownpolicy = own_string2policy(kv->value);
+		log_msg (LOG_INFO, "%s() loco ownership: %s\n", __func__, own_policy2string(sc->ownpolicy));
+		event_fire (EVENT_ENVIRONMENT, 0, NULL);
+		cnf_triggerStore(__func__);
+	}
 
 	return 0;
 }
@@ -2757,8 +3916,8 @@ static int cgi_mmprog (int sock, struct http_request *hr)
 static int cgi_loco (int adr, int sock, struct http_request *hr)
 {
 	struct key_value *kv;
-	char direction, *s, *delim;
-	int speed, func, icon, timing;
+	char direction, *s, *delim, curve[16];
+	int speed, func, icon, timing, accel, decel;
 	uint32_t vid, uid, newfuncs;
 	ldataT *loco;
 	locoT *l;
@@ -2768,6 +3927,7 @@ static int cgi_loco (int adr, int sock, struct http_request *hr)
 	(void) hr;
 
 	if (adr <= 0) return -1;
+	loco_setClient(OWN_TOKEN(OWN_WEB, 0));
 	direction = 0;
 	speed = func = -1;
 	vid = uid = 0;
@@ -2793,7 +3953,7 @@ static int cgi_loco (int adr, int sock, struct http_request *hr)
 			else newfuncs &= ~(1 << func);
 			rq_setFuncMasked(adr, newfuncs, (1 << func));
 		} else {
-			if (func >= 32) loco_setFunc(adr, func, on);
+			if (func >= 32) rq_setFuncGroup(adr, func, 1, on);
 		}
 	}
 
@@ -2811,6 +3971,9 @@ static int cgi_loco (int adr, int sock, struct http_request *hr)
 	if ((kv = kv_lookup(hr->param, "name")) != NULL) db_setLocoName(adr, kv->value);
 	if ((kv = kv_lookup(hr->param, "fmt")) != NULL) db_setLocoFmt(adr, atoi(kv->value));
 	if ((kv = kv_lookup(hr->param, "maxfunc")) != NULL) db_setLocoMaxfunc(adr, atoi(kv->value));
+	if ((kv = kv_lookup(hr->param, "momentum")) != NULL && kv->value) {		// "accel,decel,curve" with the times in ms
+		if (sscanf(kv->value, "%d,%d,%15s", &accel, &decel, curve) == 3) db_setLocoMomentum(adr, accel, decel, ramp_string2curve(curve));
+	}
 	if ((kv = kv_lookup(hr->param, "fuico")) != NULL && kv->value) {
 		// the string is constructed as a space-delimited list of "<func>|<icon>|<timing>" with each
 		// element beeing an integer number.
@@ -65,6 +65,7 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 #include "rb2.h"
 #include "json.h"
 
@@ -608,6 +609,108 @@ void json_free (json_valT *root)
 	json_freeValue(root);
 }
 
+static size_t json_renderItem (char *buf, size_t size, size_t pos, json_itmT *itm);
+static size_t json_renderValue (char *buf, size_t size, size_t pos, json_valT *val);
+
+/**
+ * Append a string to the render buffer. If the buffer is too small (or
+ * NULL), only the position is advanced. This way, the same functions can
+ * be used to calculate the needed space and to fill the buffer.
+ */
+static size_t json_renderString (char *buf, size_t size, size_t pos, const char *s)
+{
+	size_t len = strlen(s);
+
+	if (buf && pos + len < size) memcpy (buf + pos, s, len);
+	return pos + len;
+}
+
+static size_t json_renderItem (char *buf, size_t size, size_t pos, json_itmT *itm)
+{
+	bool comma = false;
+
+	while (itm) {
+		if (comma) pos = json_renderString(buf, size, pos, ", ");
+		pos = json_renderString(buf, size, pos, "\"");
+		pos = json_renderString(buf, size, pos, itm->name);
+		pos = json_renderString(buf, size, pos, "\": ");
+		pos = json_renderValue(buf, size, pos, itm->value);
+		itm = itm->next;
+		comma = true;
+	}
+	return pos;
+}
+
+static size_t json_renderValue (char *buf, size_t size, size_t pos, json_valT *val)
+{
+	char num[16];
+	bool comma = false;
+
+	while (val) {
+		if (comma) pos = json_renderString(buf, size, pos, ", ");
+		switch (val->type) {
+			case JSON_OBJECT:
+				pos = json_renderString(buf, size, pos, "{ ");
+				pos = json_renderItem(buf, size, pos, val->itm);
+				pos = json_renderString(buf, size, pos, " }");
+				break;
+			case JSON_ARRAY:
+				pos = json_renderString(buf, size, pos, "[ ");
+				pos = json_renderValue(buf, size, pos, val->array);
+				pos = json_renderString(buf, size, pos, " ]");
+				break;
+			case JSON_STRING:
+				pos = json_renderString(buf, size, pos, "\"");
+				pos = json_renderString(buf, size, pos, val->string);
+				pos = json_renderString(buf, size, pos, "\"");
+				break;
+			case JSON_INTEGER:
+				sprintf (num, "%d", val->intval);
+				pos = json_renderString(buf, size, pos, num);
+				break;
+			case JSON_UNSIGNED:
+				sprintf (num, "%u", val->uintval);
+				pos = json_renderString(buf, size, pos, num);
+				break;
+			case JSON_TRUE:
+				pos = json_renderString(buf, size, pos, "true");
+				break;
+			case JSON_FALSE:
+				pos = json_renderString(buf, size, pos, "false");
+				break;
+			case JSON_NULL:
+				pos = json_renderString(buf, size, pos, "null");
+				break;
+			default:
+				break;
+		}
+		val = val->next;
+		comma = true;
+	}
+	return pos;
+}
+
+/**
+ * Render a JSON tree to a newly allocated string. The output is the same
+ * as the one that is sent to the WEB clients. This is used to keep
+ * (mostly) static answers in a cache.
+ *
+ * \param root		the root value of the JSON tree
+ * \return			an allocated string that must be freed by the caller or NULL on error
+ */
+char *json_toString (json_valT *root)
+{
+	size_t len;
+	char *s;
+
+	if (!root) return NULL;
+	len = json_renderValue(NULL, 0, 0, root);
+	if ((s = malloc (len + 1)) == NULL) return NULL;
+	json_renderValue(s, len + 1, 0, root);
+	s[len] = 0;
+	return s;
+}
+
 static void json_debugItem (json_itmT *itm, int indent);
 static void json_debugValue (json_valT *val, int indent);
 
@@ -35,7 +35,7 @@
  * \param dir		the absolute path of the directory to be removed
  * \return			0 for OK, an error code otherwise
  */
-static int webup_removeDirectory (const char *path)
+int webup_removeDirectory (const char *path)
 {
 	yaffs_DIR *dir;
 	struct yaffs_dirent *dentry;
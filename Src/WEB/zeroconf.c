@@ -0,0 +1,166 @@
+/*
+ * zeroconf.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Advertising the network services with mDNS / DNS-SD
+ *
+ * This is the glue between the service list in dnssd.c and the mDNS
+ * responder of lwIP. The responder is not thread safe, so all calls to it
+ * are done in the TCP/IP thread (via tcpip_callback()).
+ *
+ * zc_update() is called whenever the configuration is changed and publishes
+ * the changes of the ports and the name of the station. A name conflict that
+ * is found while the responder probes for our names leads to new names
+ * (see dnssd_conflict()).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "rb2.h"
+#include "config.h"
+#include "dnssd.h"
+#include "lwip/tcpip.h"
+#include "lwip/apps/mdns.h"
+
+#define ZC_TTL				120			///< the TTL of all records in seconds
+#define ZC_HTTP_PORT		80			///< the port of the WEB server (see httpd_start())
+#define ZC_FTP_PORT			21			///< the port of the FTP server (see FTP_PORT in ftpd.c)
+#define ZC_Z21_PORT			21105		///< the port of the Z21 service (see init.c)
+
+static struct netif *zc_netif;
+static struct dnssd_state state;
+static bool netif_added;
+
+static void zc_config (struct dnssd_config *c)
+{
+	struct sysconf *cfg;
+
+	cfg = cnf_getconfig();
+	memset (c, 0, sizeof(*c));
+	snprintf (c->name, sizeof(c->name), "%s", cfg->bidib.user);
+	c->serial = hwinfo->serial;
+	c->firmware = SOFT_VERSION;
+	c->port[DNSSD_HTTP] = ZC_HTTP_PORT;
+	c->port[DNSSD_FTP] = ZC_FTP_PORT;
+	c->port[DNSSD_Z21] = ZC_Z21_PORT;
+	c->port[DNSSD_P50X] = cfg->p50_port;
+	c->port[DNSSD_BIDIB] = cfg->bidib.port;
+}
+
+static void zc_txt (struct mdns_service *service, void *txt_userdata)
+{
+	enum dnssd_svc svc;
+	char buf[64];
+	int i, len;
+
+	svc = (enum dnssd_svc) (uintptr_t) txt_userdata;
+	for (i = 0; (len = dnssd_txt(&state.cfg, svc, i, buf, sizeof(buf))) > 0; i++) {
+		mdns_resp_add_service_txtitem(service, buf, len);
+	}
+}
+
+/**
+ * Publish the current configuration. Runs in the TCP/IP thread.
+ *
+ * \param arg		unused
+ */
+static void zc_apply (void *arg)
+{
+	struct dnssd_config c;
+	struct dnssd_plan p;
+	const char *svc;
+	bool udp;
+	int i;
+
+	(void) arg;
+
+	if (!zc_netif) return;
+	zc_config(&c);
+	if (!dnssd_plan(&state, &c, &p)) return;
+
+	for (i = 0; i < DNSSD_SERVICES; i++) {
+		if (!(p.del & (1 << i))) continue;
+		mdns_resp_del_service(zc_netif, state.slot[i]);
+		state.slot[i] = -1;
+	}
+	if (p.rename) {
+		if (!netif_added) netif_added = (mdns_resp_add_netif(zc_netif, state.host, ZC_TTL) == ERR_OK);
+		else mdns_resp_rename_netif(zc_netif, state.host);
+	}
+	for (i = 0; i < DNSSD_SERVICES; i++) {
+		if (!(p.add & (1 << i))) continue;
+		svc = dnssd_service(i, &udp);
+		state.slot[i] = mdns_resp_add_service(zc_netif, state.instance, svc, (udp) ? DNSSD_PROTO_UDP : DNSSD_PROTO_TCP,
+				state.cfg.port[i], ZC_TTL, zc_txt, (void *) (uintptr_t) i);
+		if (state.slot[i] < 0) {
+			log_error ("%s(): cannot register service %s on port %u\n", __func__, svc, state.cfg.port[i]);
+			state.slot[i] = -1;
+		}
+	}
+	if (!p.rename) mdns_resp_announce(zc_netif);		// a new host name restarts the probing and announcing anyway
+	log_msg (LOG_INFO, "%s(): advertising '%s' on %s.local\n", __func__, state.instance, state.host);
+}
+
+/**
+ * Called by the responder after probing our names. Runs in the TCP/IP thread.
+ */
+static void zc_result (struct netif *netif, u8_t result)
+{
+	if (netif != zc_netif || result != MDNS_PROBING_CONFLICT) return;
+
+	if (dnssd_conflict(&state)) {
+		log_msg (LOG_WARNING, "%s(): name '%s' or '%s.local' is already in use\n", __func__, state.instance, state.host);
+		zc_apply(NULL);
+	} else {
+		log_error ("%s(): too many name conflicts - giving up\n", __func__);
+	}
+}
+
+/**
+ * Start the mDNS responder on the given interface and advertise our services.
+ *
+ * \param netif		the network interface
+ */
+void zc_start (struct netif *netif)
+{
+	if (!netif) return;
+
+	dnssd_init(&state);
+	mdns_resp_init();
+	mdns_resp_register_name_result_cb(zc_result);
+	zc_netif = netif;
+	tcpip_callback(zc_apply, NULL);
+}
+
+/**
+ * Publish a changed configuration (name of the station or ports of the
+ * services). Can be called from any task.
+ */
+void zc_update (void)
+{
+	if (zc_netif) tcpip_callback(zc_apply, NULL);
+}
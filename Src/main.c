@@ -29,6 +29,8 @@
 #include <string.h>
 #include "rb2.h"
 #include "backtrace.h"
+#include "crashrec.h"
+#include "swdog.h"
 
 // Let's start with some documentation and the copies of the license terms used
 // within this software.
@@ -528,6 +530,7 @@ void killThread (uint32_t address, uint32_t cfsr)
 	backtrace_t backtrace[20];
 	int size;
 
+	crash_faultTask();
 	fprintf (stderr, "%s() from %s\n", __func__, pcTaskGetName(NULL));
 	fprintf (stderr, "\t@ 0x%08lx\n", address);
 	// MemManage errors:
@@ -567,6 +570,7 @@ void killThread (uint32_t address, uint32_t cfsr)
 __attribute__((optimize("O0")))
 void faultHandler_c (sContextStateFrame *frame)
 {
+	crash_fault((uint32_t *) frame, (frame->xpsr & 0xFF) != 0);
 	if ((frame->xpsr & 0xFF) != 0) {		// in exception handler we cannot return and get back to normal operation - so just reset!
 		SCB->AIRCR = (0x05FA << 16) | 0x1 << 2;			// do a RESET
 		while (1) ;										// not reached
@@ -596,6 +600,7 @@ void vAssertCalled(const char * pcFile, unsigned long ulLine, const char * pcFun
 
 	if ((s = strstr(pcFile, SOURCE_BASE)) != NULL) pcFile = s;
 	log_error ("%s ASSERTION \"%s\" in %s() on line %lu\n", pcFile, failedexpr, pcFunc, ulLine);
+	crash_assert(pcFile, ulLine, pcFunc, failedexpr, __builtin_return_address(0));
 	vTaskGetInfo(xTaskGetCurrentTaskHandle(), &ts, pdTRUE, pdFALSE);
 	printf ("\ttask '%s'\n", ts.pcTaskName);
 	printf ("\tcurrent priority %ld\n", ts.uxCurrentPriority);
@@ -620,6 +625,7 @@ void vAssertCalled(const char * pcFile, unsigned long ulLine, const char * pcFun
 void vApplicationStackOverflowHook (TaskHandle_t t, char *name)
 {
 	fprintf (stderr, "STACK OVERFLOW in Task '%s'...\n", name);
+	crash_stackOverflow(name);
 	vTaskDelete(t);
 }
 
@@ -633,7 +639,8 @@ void vApplicationTickHook (void)
 	seg_timer();
 	key_scan();
 	ts_handler();
-	if ((WWDG1->CR & WWDG_CR_T_Msk) <= (WWDG1->CFR & WWDG_CFR_W_Msk)) WWDG1->CR = WWDG_CR_T_Msk;
+	// the watchdog is only served if all supervised tasks are healthy
+	if ((WWDG1->CR & WWDG_CR_T_Msk) <= (WWDG1->CFR & WWDG_CFR_W_Msk) && wdog_check()) WWDG1->CR = WWDG_CR_T_Msk;
 }
 
 int main(void)
@@ -646,6 +653,7 @@ int main(void)
 #endif
 
 	hw_setup();
+	crash_init();
 
 	memset (&rt, 0, sizeof(rt));
 	h = heap;
@@ -0,0 +1,542 @@
+/*
+ * archive_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief The backup archive format and the validation of a restore (archive.c)
+ *
+ * Archives are built with the same functions the backup uses and fed to the
+ * reader in chunks of every size, as they arrive from the network. The
+ * handler records what the restore would store. Damaged archives (truncated,
+ * bad checksums, illegal paths and types, wrong or missing manifests) must
+ * be rejected with the right error before the damaged member is completed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "backup.h"
+#include "check.h"
+
+#define ARCSIZE			8192
+#define MAXMEMBERS		16
+#define DATASIZE		2048
+
+#define AREA_CONFIG		(1 << 0)
+#define AREA_IMAGES		(1 << 1)
+
+#define MODE_FILE		(ARC_IFREG | 0644)
+#define MODE_DIR		(ARC_IFDIR | 0755)
+
+/**
+ * A member of a test archive
+ */
+struct member {
+	const char		*name;
+	uint32_t		mode;
+	const char		*data;
+	int				len;
+};
+
+/**
+ * What the handler was told about a member
+ */
+struct stored {
+	char			name[ARC_NAMELEN];
+	uint32_t		mode;
+	uint32_t		size;
+	uint8_t			data[DATASIZE];
+	uint32_t		len;
+	bool			complete;
+};
+
+static struct {
+	struct stored	m[MAXMEMBERS];
+	int				count;
+	bool			open;						///< begin() was called, end() not yet
+	int				failBegin;					///< let begin() of this member fail (-1 = never)
+	int				failData;
+	int				failEnd;
+	int				errors;						///< callbacks in the wrong order or with wrong sizes
+} st;
+
+static int h_begin (void *priv, const char *name, uint32_t mode, uint32_t size)
+{
+	struct stored *s;
+
+	if (st.open || st.count >= MAXMEMBERS) st.errors++;
+	if (st.count >= MAXMEMBERS) return -1;
+	if (st.failBegin == st.count) return -1;
+	s = &st.m[st.count];
+	memset (s, 0, sizeof(*s));
+	strcpy (s->name, name);
+	s->mode = mode;
+	s->size = size;
+	st.open = true;
+	return 0;
+}
+
+static int h_data (void *priv, const uint8_t *buf, int len)
+{
+	struct stored *s = &st.m[st.count];
+
+	if (!st.open || len <= 0 || s->len + len > s->size || s->len + len > DATASIZE) {
+		st.errors++;
+		return -1;
+	}
+	if (st.failData == st.count) return -1;
+	memcpy (&s->data[s->len], buf, len);
+	s->len += len;
+	return 0;
+}
+
+static int h_end (void *priv)
+{
+	struct stored *s = &st.m[st.count];
+
+	if (!st.open || s->len != s->size) st.errors++;
+	if (st.failEnd == st.count) return -1;
+	s->complete = true;
+	st.open = false;
+	st.count++;
+	return 0;
+}
+
+static const struct arc_handler handler = { h_begin, h_data, h_end };
+
+static void resetStore (void)
+{
+	memset (&st, 0, sizeof(st));
+	st.failBegin = st.failData = st.failEnd = -1;
+}
+
+static int contents[MAXMEMBERS + 1];			///< the offset of the contents of the manifest and the members in the last built archive
+
+static int put (uint8_t *buf, int pos, uint32_t ino, const char *name, uint32_t mode, const void *data, int len)
+{
+	int n;
+
+	n = arc_header((char *) buf + pos, ARCSIZE - pos, ino, name, mode, len, 0x6000000 + ino, arc_checksum(0, data, len));
+	if (n == 0 || pos + n + len + 3 > ARCSIZE) return -1;
+	pos += n;
+	if (ino >= 1 && ino <= MAXMEMBERS + 1) contents[ino - 1] = pos;
+	memcpy (buf + pos, data, len);
+	pos += len;
+	memset (buf + pos, 0, arc_padding(len));
+	return pos + arc_padding(len);
+}
+
+/**
+ * Build an archive like bak_backup() does it.
+ *
+ * \param buf		where to build the archive (ARCSIZE bytes)
+ * \param manifest	the contents of the manifest or NULL to have no manifest at all
+ * \param m			the members following the manifest
+ * \param n			the number of members
+ * \return			the size of the archive
+ */
+static int build (uint8_t *buf, const char *manifest, const struct member *m, int n)
+{
+	int pos, i;
+
+	pos = 0;
+	if (manifest) pos = put(buf, pos, 1, ARC_MANIFEST, MODE_FILE, manifest, strlen(manifest));
+	for (i = 0; i < n && pos >= 0; i++) {
+		pos = put(buf, pos, i + 2, m[i].name, m[i].mode, m[i].data, (m[i].data) ? m[i].len : 0);
+	}
+	if (pos >= 0) pos = put(buf, pos, 0, ARC_TRAILER, 0, NULL, 0);
+	return pos;
+}
+
+static const char *manifest (uint32_t areas, int version)
+{
+	static char buf[ARC_MANIFEST_MAX];
+	struct arc_info info;
+
+	memset (&info, 0, sizeof(info));
+	info.version = version;
+	info.serial = 12345;
+	strcpy (info.firmware, "1.4.2");
+	info.areas = areas;
+	CHECK(arc_manifest(buf, sizeof(buf), &info) > 0);
+	return buf;
+}
+
+/**
+ * Feed an archive to a new reader in chunks of the given size.
+ *
+ * \param buf		the archive
+ * \param len		the size of the archive
+ * \param chunk		the size of the chunks
+ * \param r			the reader to use
+ * \return			the result of arc_finish()
+ */
+static enum arc_error feed (const uint8_t *buf, int len, int chunk, struct arc_reader *r)
+{
+	enum arc_error err;
+	int pos, n;
+
+	resetStore();
+	arc_readerInit(r, &handler, NULL);
+	for (pos = 0; pos < len; pos += n) {
+		n = (len - pos < chunk) ? len - pos : chunk;
+		err = arc_feed(r, buf + pos, n);
+		if (err != ARC_OK) {
+			if (arc_feed(r, buf, len) != err) return ARC_ERRORS;		// errors are sticky
+			break;
+		}
+	}
+	return arc_finish(r);
+}
+
+static enum arc_error check (const uint8_t *buf, int len)
+{
+	static const int chunks[] = { 1, 3, 110, 111, ARCSIZE };
+	struct arc_reader r;
+	enum arc_error err, e;
+	int i;
+
+	err = feed(buf, len, chunks[0], &r);
+	for (i = 1; i < (int) (sizeof(chunks) / sizeof(chunks[0])); i++) {
+		if ((e = feed(buf, len, chunks[i], &r)) != err) {
+			fprintf (stderr, "chunk size %d: %s instead of %s\n", chunks[i], arc_strerror(e), arc_strerror(err));
+			return ARC_ERRORS;
+		}
+	}
+	return err;
+}
+
+static bool same (const struct member *m, int n)
+{
+	int i;
+
+	if (st.count != n || st.open || st.errors) return false;
+	for (i = 0; i < n; i++) {
+		if (strcmp(st.m[i].name, m[i].name) || st.m[i].mode != m[i].mode || !st.m[i].complete) return false;
+		if (st.m[i].len != (uint32_t) ((m[i].data) ? m[i].len : 0)) return false;
+		if (st.m[i].len && memcmp(st.m[i].data, m[i].data, m[i].len)) return false;
+	}
+	return true;
+}
+
+static const char text[] = "[system]\nname = Layout\nip = 192.168.0.2\n\n[loco]\nadr = 3\n";
+static uint8_t image[1000];
+
+static const struct member members[] = {
+	{ "config", MODE_DIR, NULL, 0 },
+	{ "config/config.ini", MODE_FILE, text, sizeof(text) - 1 },
+	{ "config/empty.ini", MODE_FILE, "", 0 },
+	{ "config/a", MODE_FILE, "1", 1 },
+	{ "config/ab", MODE_FILE, "12", 2 },
+	{ "config/abc", MODE_FILE, "123", 3 },
+	{ "config/abcd", MODE_FILE, "1234", 4 },
+	{ "userimages", MODE_DIR, NULL, 0 },
+	{ "userimages/sub", MODE_DIR, NULL, 0 },
+	{ "userimages/sub/loco.png", MODE_FILE, (const char *) image, sizeof(image) },
+};
+#define MEMBERS		((int) (sizeof(members) / sizeof(members[0])))
+
+static void testBasics (void)
+{
+	char buf[ARC_MANIFEST_MAX];
+	struct arc_info info, info2;
+	int i;
+
+	CHECK(!strcmp(arc_area(0), "config") && !strcmp(arc_area(1), "userimages") && arc_area(2) == NULL);
+	CHECK(arc_padding(0) == 0 && arc_padding(1) == 3 && arc_padding(2) == 2 && arc_padding(3) == 1 && arc_padding(4) == 0);
+	CHECK(arc_checksum(0, (const uint8_t *) "\x01\x02\xFF", 3) == 0x102 && arc_checksum(5, NULL, 0) == 5);
+	for (i = 0; i < ARC_ERRORS; i++) CHECK(arc_strerror(i) != NULL && strcmp(arc_strerror(i), "unknown error"));
+	CHECK(!strcmp(arc_strerror(ARC_ERRORS), "unknown error") && !strcmp(arc_strerror(-1), "unknown error"));
+
+	// the header is padded to four bytes together with the name
+	CHECK(arc_header(buf, sizeof(buf), 7, "ab", MODE_FILE, 10, 0, 0x1234) == ARC_HDRSIZE + 3 + 3);
+	CHECK(!memcmp(buf, "07070200000007000081A4", 22) && !memcmp(buf + 94, "0000000300001234ab\0\0\0", 21));
+	CHECK(arc_header(buf, sizeof(buf), 7, "a", MODE_FILE, 10, 0, 0) == ARC_HDRSIZE + 2);
+	CHECK(arc_header(buf, ARC_HDRSIZE + 5, 7, "abc", MODE_FILE, 10, 0, 0) == 0);
+	CHECK(arc_header(buf, sizeof(buf), 7, NULL, MODE_FILE, 10, 0, 0) == 0);
+
+	// the manifest
+	memset (&info, 0, sizeof(info));
+	info.version = ARC_VERSION;
+	info.serial = 4711;
+	strcpy (info.firmware, "1.4.2");
+	info.areas = AREA_CONFIG | AREA_IMAGES;
+	CHECK(arc_manifest(buf, sizeof(buf), &info) > 0);
+	CHECK(!strcmp(buf, "version=1\nserial=4711\nfirmware=1.4.2\nareas=config,userimages\n"));
+	CHECK(arc_parseManifest(buf, strlen(buf), &info2) && !memcmp(&info, &info2, sizeof(info)));
+	info.areas = AREA_IMAGES;
+	CHECK(arc_manifest(buf, sizeof(buf), &info) > 0 && strstr(buf, "areas=userimages\n"));
+	CHECK(arc_manifest(buf, 20, &info) == 0);
+
+	strcpy (buf, "version=1\r\nfuture=yes\r\nareas=config\r\nserial=1\r\n");
+	CHECK(arc_parseManifest(buf, strlen(buf), &info2) && info2.areas == AREA_CONFIG && info2.serial == 1);
+	CHECK(!arc_parseManifest(buf, 10, &info2));					// the areas are missing
+	strcpy (buf, "version=1\nareas=config,system\n");
+	CHECK(!arc_parseManifest(buf, strlen(buf), &info2));		// an unknown area
+	strcpy (buf, "serial=1\nareas=config\n");
+	CHECK(!arc_parseManifest(buf, strlen(buf), &info2));		// no version
+}
+
+static void testPaths (void)
+{
+	static const struct {
+		const char	*name;
+		uint32_t	mask;
+		bool		ok;
+	} paths[] = {
+		{ "config", AREA_CONFIG, true },
+		{ "config/loco.ini", AREA_CONFIG, true },
+		{ "config/sub/x.y", AREA_CONFIG, true },
+		{ "config/..x", AREA_CONFIG, true },
+		{ "config/loco.ini", AREA_IMAGES, false },
+		{ "userimages/a.png", AREA_CONFIG | AREA_IMAGES, true },
+		{ "configx/a", AREA_CONFIG, false },
+		{ "/config/a", AREA_CONFIG, false },
+		{ "config/../etc/passwd", AREA_CONFIG, false },
+		{ "config/..", AREA_CONFIG, false },
+		{ "config/./a", AREA_CONFIG, false },
+		{ "config//a", AREA_CONFIG, false },
+		{ "config/", AREA_CONFIG, false },
+		{ "config\\..\\a", AREA_CONFIG, false },
+		{ "config/a\tb", AREA_CONFIG, false },
+		{ "config/\xC3\xA4", AREA_CONFIG, false },
+		{ "", AREA_CONFIG, false },
+	};
+	char longname[ARC_NAMELEN + 1];
+	int i;
+
+	for (i = 0; i < (int) (sizeof(paths) / sizeof(paths[0])); i++) {
+		if (arc_pathAllowed(paths[i].name, paths[i].mask) != paths[i].ok) {
+			fprintf (stderr, "path '%s' is %s\n", paths[i].name, (paths[i].ok) ? "rejected" : "allowed");
+			CHECK(false);
+		}
+	}
+	CHECK(!arc_pathAllowed(NULL, AREA_CONFIG));
+
+	strcpy (longname, "config/");
+	memset (longname + 7, 'x', ARC_NAMELEN - 8);
+	longname[ARC_NAMELEN - 1] = 0;
+	CHECK(arc_pathAllowed(longname, AREA_CONFIG));
+	longname[ARC_NAMELEN - 1] = 'x';
+	longname[ARC_NAMELEN] = 0;
+	CHECK(!arc_pathAllowed(longname, AREA_CONFIG));
+}
+
+static void testChunks (void)
+{
+	static uint8_t buf[ARCSIZE + 100];
+	struct arc_reader r;
+	int len, chunk, i;
+
+	for (i = 0; i < (int) sizeof(image); i++) image[i] = i * 7 + (i >> 8);
+	len = build(buf, manifest(AREA_CONFIG | AREA_IMAGES, ARC_VERSION), members, MEMBERS);
+	CHECK(len > 0 && (len & 3) == 0);
+
+	for (chunk = 1; chunk < 300; chunk++) {
+		if (feed(buf, len, chunk, &r) != ARC_OK || !same(members, MEMBERS)) {
+			fprintf (stderr, "chunk size %d failed\n", chunk);
+			CHECK(false);
+		}
+	}
+	CHECK(r.info.version == ARC_VERSION && r.info.serial == 12345 && !strcmp(r.info.firmware, "1.4.2"));
+	CHECK(r.members == MEMBERS + 1);
+
+	// anything after the trailer (i.e. the block padding of cpio) is ignored
+	memset (buf + len, 0xAA, 100);
+	CHECK(feed(buf, len + 100, 7, &r) == ARC_OK && same(members, MEMBERS));
+
+	// a manifest without further members is a valid (empty) backup
+	len = build(buf, manifest(AREA_CONFIG, ARC_VERSION), NULL, 0);
+	CHECK(check(buf, len) == ARC_OK && st.count == 0);
+}
+
+static void testTruncated (void)
+{
+	static uint8_t buf[ARCSIZE];
+	struct arc_reader r;
+	int len, cut;
+
+	len = build(buf, manifest(AREA_CONFIG | AREA_IMAGES, ARC_VERSION), members, MEMBERS);
+	CHECK(feed(buf, 0, 1, &r) == ARC_EFORMAT);
+	for (cut = 1; cut < len; cut++) {
+		if (feed(buf, cut, 13, &r) != ARC_ETRUNCATED || st.errors) {
+			fprintf (stderr, "archive cut at %d of %d bytes\n", cut, len);
+			CHECK(false);
+		}
+	}
+	CHECK(feed(buf, len, 13, &r) == ARC_OK);
+}
+
+static void testDamaged (void)
+{
+	static uint8_t buf[ARCSIZE], good[ARCSIZE];
+	struct member m[MEMBERS];
+	int len, i;
+
+	len = build(good, manifest(AREA_CONFIG | AREA_IMAGES, ARC_VERSION), members, MEMBERS);
+
+	// a changed byte in the contents of a member is found before it is completed
+	for (i = 0; i < MEMBERS; i++) {
+		if (!members[i].len) continue;
+		memcpy (buf, good, len);
+		buf[contents[i + 1] + members[i].len / 2] ^= 0x10;
+		CHECK(check(buf, len) == ARC_ECHECKSUM);
+		CHECK(st.count == i && st.open && !strcmp(st.m[i].name, members[i].name) && !st.m[i].complete);
+	}
+
+	// and so is a damaged manifest
+	memcpy (buf, good, len);
+	buf[contents[0] + 20] ^= 1;
+	CHECK(check(buf, len) == ARC_ECHECKSUM && st.count == 0 && !st.open);
+
+	// damaged headers
+	memcpy (buf, good, len);
+	buf[0] = 'x';
+	CHECK(check(buf, len) == ARC_EFORMAT);
+	memcpy (buf, good, len);
+	buf[5] = '1';										// "070701" has no checksums
+	CHECK(check(buf, len) == ARC_EFORMAT);
+	memcpy (buf, good, len);
+	buf[60] = 'G';										// not a hex digit
+	CHECK(check(buf, len) == ARC_EFORMAT);
+	memcpy (buf, good, len);
+	buf[ARC_HDRSIZE + strlen(ARC_MANIFEST)] = 'x';		// the name is not terminated
+	CHECK(check(buf, len) == ARC_EFORMAT);
+
+	// a name that is too long for a member
+	memcpy (m, members, sizeof(m));
+	m[1].name = "config/xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx";
+	len = build(buf, manifest(AREA_CONFIG | AREA_IMAGES, ARC_VERSION), m, MEMBERS);
+	CHECK(check(buf, len) == ARC_EPATH && st.count == 1 && !st.open);
+
+	// a directory with contents
+	memcpy (m, members, sizeof(m));
+	m[0].data = "x";
+	m[0].len = 1;
+	len = build(buf, manifest(AREA_CONFIG | AREA_IMAGES, ARC_VERSION), m, MEMBERS);
+	CHECK(check(buf, len) == ARC_EFORMAT && st.count == 0 && !st.open);
+}
+
+static void testRejected (void)
+{
+	static const char *badpaths[] = {
+		"config/../etc/passwd", "/config/x", "etc/x", "config//x", "userimages/a.png",
+	};
+	static uint8_t buf[ARCSIZE];
+	struct member m[MEMBERS];
+	int len, i;
+
+	// only the areas of the manifest are allowed
+	memcpy (m, members, sizeof(m));
+	for (i = 0; i < (int) (sizeof(badpaths) / sizeof(badpaths[0])); i++) {
+		m[3].name = badpaths[i];
+		len = build(buf, manifest(AREA_CONFIG, ARC_VERSION), m, 4);
+		CHECK(check(buf, len) == ARC_EPATH && st.count == 3 && !st.open);
+	}
+	len = build(buf, manifest(AREA_CONFIG, ARC_VERSION), members, MEMBERS);
+	CHECK(check(buf, len) == ARC_EPATH && st.count == 7);
+
+	// no links, devices or fifos
+	memcpy (m, members, sizeof(m));
+	m[2].mode = 0120777;
+	m[2].data = "config.ini";
+	m[2].len = 10;
+	len = build(buf, manifest(AREA_CONFIG | AREA_IMAGES, ARC_VERSION), m, MEMBERS);
+	CHECK(check(buf, len) == ARC_ETYPE && st.count == 2);
+	m[2].mode = 0020644;
+	m[2].len = 0;
+	len = build(buf, manifest(AREA_CONFIG | AREA_IMAGES, ARC_VERSION), m, MEMBERS);
+	CHECK(check(buf, len) == ARC_ETYPE && st.count == 2);
+
+	// the version of the contents
+	len = build(buf, manifest(AREA_CONFIG | AREA_IMAGES, ARC_VERSION + 1), members, MEMBERS);
+	CHECK(check(buf, len) == ARC_EVERSION && st.count == 0);
+	len = build(buf, manifest(AREA_CONFIG | AREA_IMAGES, 0), members, MEMBERS);
+	CHECK(check(buf, len) == ARC_EMANIFEST && st.count == 0);
+
+	// the manifest must come first
+	len = build(buf, NULL, members, MEMBERS);
+	CHECK(check(buf, len) == ARC_EMANIFEST && st.count == 0);
+	len = build(buf, NULL, NULL, 0);
+	CHECK(check(buf, len) == ARC_EMANIFEST);
+	len = build(buf, "version=1\nareas=config,sounds\n", members, MEMBERS);
+	CHECK(check(buf, len) == ARC_EMANIFEST && st.count == 0);
+	len = build(buf, "", members, MEMBERS);
+	CHECK(check(buf, len) == ARC_EMANIFEST);
+	memset (buf + ARCSIZE / 2, '#', ARC_MANIFEST_MAX);
+	buf[ARCSIZE / 2 + ARC_MANIFEST_MAX] = 0;
+	len = build(buf, (char *) buf + ARCSIZE / 2, members, MEMBERS);
+	CHECK(check(buf, len) == ARC_EMANIFEST && st.count == 0);
+
+	// a manifest that is not a file
+	memcpy (m, members, sizeof(m));
+	m[0].name = ARC_MANIFEST;
+	len = build(buf, NULL, m, MEMBERS);
+	CHECK(check(buf, len) == ARC_EMANIFEST);
+}
+
+static void testWriteErrors (void)
+{
+	static uint8_t buf[ARCSIZE];
+	struct arc_reader r;
+	int len, i;
+
+	len = build(buf, manifest(AREA_CONFIG | AREA_IMAGES, ARC_VERSION), members, MEMBERS);
+	for (i = 0; i < MEMBERS; i++) {
+		resetStore();
+		st.failBegin = i;
+		arc_readerInit(&r, &handler, NULL);
+		CHECK(arc_feed(&r, buf, len) == ARC_EWRITE && arc_finish(&r) == ARC_EWRITE && st.count == i);
+
+		resetStore();
+		st.failEnd = i;
+		arc_readerInit(&r, &handler, NULL);
+		CHECK(arc_feed(&r, buf, len) == ARC_EWRITE && st.count == i && st.open);
+
+		resetStore();
+		st.failData = i;
+		arc_readerInit(&r, &handler, NULL);
+		CHECK(arc_feed(&r, buf, len) == ((members[i].len) ? ARC_EWRITE : ARC_OK));
+	}
+
+	// a reader without a handler only validates the archive
+	arc_readerInit(&r, NULL, NULL);
+	CHECK(arc_feed(&r, buf, len) == ARC_OK && arc_finish(&r) == ARC_OK && r.members == MEMBERS + 1);
+	CHECK(arc_feed(NULL, buf, len) == ARC_EFORMAT && arc_finish(NULL) == ARC_EFORMAT);
+}
+
+int main (int argc, char **argv)
+{
+	testBasics();
+	testPaths();
+	testChunks();
+	testTruncated();
+	testDamaged();
+	testRejected();
+	testWriteErrors();
+	return check_result("archive_test");
+}
@@ -0,0 +1,270 @@
+/*
+ * bidibdispatch_fuzz.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief Fuzz target for the BiDiB packet parser and the dispatcher (bidibdispatch.c)
+ *
+ * Each input is treated as a received BiDiB packet. It is split into its
+ * messages with bdbp_next() and unpacked the same way bidib_unpackMessages()
+ * does. The messages are then dispatched through a table where the handlers
+ * read every data byte. The input is copied to a buffer of its exact size,
+ * so the address sanitizer catches any read beyond the packet. Violated
+ * invariants of the parser abort the program.
+ *
+ * The file can be built in two ways:
+ *  - with libFuzzer (clang -fsanitize=fuzzer,address -DLIBFUZZER ...), then
+ *    only LLVMFuzzerTestOneInput() is provided
+ *  - as a standalone program (see Makefile), that runs the files given on
+ *    the command line or, without arguments, a fixed number of random
+ *    mutations of a few valid packets
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bidibdispatch.h"
+#include "bidib_messages.h"
+#include "check.h"
+
+/*
+ * The firmware's bidibmsg_t (bidib.h) pulls in the whole decoder and node
+ * handling, so a structure with the same layout is used here.
+ */
+struct bidibmsg {
+	struct bidibmsg	*next;
+	uint32_t		 adrstack;
+	uint8_t			 seq;
+	uint8_t			 msg;
+	uint8_t			 datalen;
+	uint8_t			 data[];
+};
+
+static uint32_t checksum;
+
+static void readAll (struct bidibnode *n, struct bidibmsg *m)
+{
+	int i;
+
+	for (i = 0; i < m->datalen; i++) checksum += m->data[i];
+}
+
+static void readFirst (struct bidibnode *n, struct bidibmsg *m)
+{
+	if (m->datalen > 0) checksum ^= m->data[0];
+}
+
+static const bdbd_handler handlers[BDBD_OPCODES] = {
+	[MSG_SYS_GET_MAGIC] = readFirst,
+	[MSG_SYS_ENABLE] = readFirst,
+	[MSG_NODETAB_GETNEXT] = readFirst,
+	[MSG_FEATURE_SET] = readAll,
+	[MSG_CS_DRIVE] = readAll,
+	[MSG_CS_ACCESSORY] = readAll,
+	[MSG_BM_MULTIPLE] = readAll,
+	[MSG_BM_OCC] = readAll,
+	[MSG_FW_UPDATE_OP] = readAll,
+	[MSG_LOCAL_PING] = readAll,
+};
+
+static struct bdbd_table table = {
+	.name = "fuzz",
+	.handler = handlers,
+};
+
+static void fail (const char *what, int pos)
+{
+	fprintf (stderr, "invariant violated at offset %d: %s\n", pos, what);
+	abort();
+}
+
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+	struct bidibmsg *msgs, *m, **mpp;
+	struct bdbp_view v;
+	uint8_t *pkt;
+	uint32_t rx, handled, unknown;
+	int pos, last, rc, count, i;
+
+	if (size > 4096) return 0;
+	if ((pkt = malloc(size ? size : 1)) == NULL) return 0;
+	memcpy (pkt, data, size);
+
+	msgs = NULL;
+	mpp = &msgs;
+	count = pos = 0;
+	bdbd_clear(&table);
+	for (;;) {
+		last = pos;
+		rc = bdbp_next(pkt, size, &pos, &v);
+		if (rc <= 0) {
+			if (pos != last) fail("position moved without a message", last);
+			if (rc == 0 && pos < (int) size) fail("end reported too early", pos);
+			break;
+		}
+		if (pos != last + 1 + pkt[last]) fail("position not advanced by MSG_LENGTH", last);
+		if (pos > (int) size) fail("message beyond the packet", last);
+		if (v.adrlen < 1 || v.adrlen > 5) fail("bad address stack length", last);
+		if (v.datalen != pkt[last] - v.adrlen - 2) fail("bad data length", last);
+		if (v.data != pkt + last + 1 + v.adrlen + 2) fail("data pointer", last);
+		if (v.data + v.datalen != pkt + pos) fail("data does not end with the message", last);
+
+		if ((*mpp = calloc(1, sizeof(*m) + v.datalen)) == NULL) break;
+		(*mpp)->adrstack = v.adrstack;
+		(*mpp)->seq = v.seq;
+		(*mpp)->msg = v.msg;
+		(*mpp)->datalen = v.datalen;
+		memcpy ((*mpp)->data, v.data, v.datalen);
+		mpp = &(*mpp)->next;
+		count++;
+	}
+
+	for (m = msgs; m; m = m->next) {
+		if (!m->seq && m->msg >= 0x80) bdbd_error(&table, m->msg);	// just to exercise the error counter
+		else bdbd_dispatch(&table, NULL, m, m->msg);
+	}
+	rx = handled = unknown = 0;
+	for (i = 0; i < BDBD_OPCODES; i++) {
+		rx += table.cnt[i].rx;
+		handled += table.cnt[i].handled;
+		unknown += table.cnt[i].unknown;
+		if (table.cnt[i].handled && !handlers[i]) fail("handled without a handler", i);
+	}
+	if (rx != handled + unknown) fail("counters do not add up", 0);
+	if ((int) rx > count) fail("more messages dispatched than parsed", 0);
+
+	while ((m = msgs) != NULL) {
+		msgs = m->next;
+		free (m);
+	}
+	free (pkt);
+	return 0;
+}
+
+#ifndef LIBFUZZER
+
+/*
+ * Valid packets used as seeds for the mutations
+ */
+static const struct {
+	int			len;
+	uint8_t		data[24];
+} seeds[] = {
+	{ 4, { 0x03, 0x00, 0x00, MSG_SYS_GET_MAGIC } },
+	{ 9, { 0x04, 0x00, 0x05, MSG_SYS_ENABLE, 0x00, 0x03, 0x00, 0x00, MSG_SYS_GET_MAGIC } },
+	{ 13, { 0x0C, 0x00, 0x07, MSG_CS_DRIVE, 0x03, 0x00, 0x03, 0x03, 0x80, 0x00, 0x00, 0x00, 0x00 } },
+	{ 12, { 0x07, 0x01, 0x02, 0x00, 0x11, MSG_BM_OCC, 0x04, 0x08, 0x03, 0x00, 0x09, MSG_NODETAB_GETNEXT } },
+	{ 13, { 0x0C, 0x01, 0x02, 0x03, 0x04, 0x00, 0x21, MSG_BM_MULTIPLE, 0x00, 0x10, 0xFF, 0x01, 0x55 } },
+};
+
+#define SEEDS	((int) (sizeof(seeds) / sizeof(seeds[0])))
+
+static uint32_t rnd;
+
+static uint32_t random32 (void)
+{
+	rnd ^= rnd << 13;
+	rnd ^= rnd >> 17;
+	rnd ^= rnd << 5;
+	return rnd;
+}
+
+static int mutate (uint8_t *buf, int len, int size)
+{
+	int n, pos;
+
+	for (n = random32() % 4 + 1; n > 0; n--) {
+		pos = (len > 0) ? random32() % len : 0;
+		switch (random32() % 5) {
+			case 0:		// flip a bit
+				if (len > 0) buf[pos] ^= 1 << (random32() % 8);
+				break;
+			case 1:		// random byte
+				if (len > 0) buf[pos] = random32();
+				break;
+			case 2:		// interesting length values
+				if (len > 0) buf[pos] = (const uint8_t[]) { 0, 1, 2, 3, 4, 5, 6, 7, 0x7F, 0xFF }[random32() % 10];
+				break;
+			case 3:		// truncate
+				len = pos;
+				break;
+			case 4:		// insert a byte
+				if (len < size) {
+					memmove (&buf[pos + 1], &buf[pos], len - pos);
+					buf[pos] = random32();
+					len++;
+				}
+				break;
+		}
+	}
+	return len;
+}
+
+static int runFile (const char *fname)
+{
+	static uint8_t buf[4096];
+	FILE *fp;
+	int len;
+
+	if ((fp = fopen(fname, "rb")) == NULL) {
+		perror (fname);
+		return 1;
+	}
+	len = fread(buf, 1, sizeof(buf), fp);
+	fclose (fp);
+	LLVMFuzzerTestOneInput(buf, len);
+	return 0;
+}
+
+int main (int argc, char *argv[])
+{
+	uint8_t buf[256];
+	int i, n, len;
+
+	if (argc > 1) {
+		for (i = 1; i < argc; i++) {
+			if (runFile(argv[i])) return 1;
+		}
+		return 0;
+	}
+
+	rnd = 0x2545F491;
+	for (i = 0; i < SEEDS; i++) {
+		LLVMFuzzerTestOneInput(seeds[i].data, seeds[i].len);
+		for (n = len = 0; n < BDBD_OPCODES; n++) len += table.cnt[n].rx;
+		CHECK(len == 1 + (i == 1 || i == 3));		// all seeds are parsed completely
+	}
+	CHECK(table.cnt[MSG_BM_MULTIPLE].handled == 1);
+	for (n = 0; n < 500000; n++) {
+		i = random32() % SEEDS;
+		memcpy (buf, seeds[i].data, seeds[i].len);
+		len = mutate(buf, seeds[i].len, sizeof(buf));
+		LLVMFuzzerTestOneInput(buf, len);
+	}
+	return check_result("bidibdispatch_fuzz");
+}
+
+#endif	/* !LIBFUZZER */
@@ -0,0 +1,453 @@
+/*
+ * bidibfb_bench.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief Micro-benchmark of the feedback reports of virtual BiDiB feedback nodes (virtualnode.c)
+ *
+ * A node tree with virtual s88 and mcan feedback nodes is built with the real
+ * BDBvn_feedbackModules(). Two things are compared for the former and the
+ * current implementation:
+ *  - the lookup of the node for a module number: the former implementation
+ *    walked the node tree for every EVENT_FBNEW, the current one uses the
+ *    table behind BDBvn_feedbackNode(). Only the lookup is timed, the module
+ *    numbers are generated before and the nodes found go to a consumer that
+ *    does no work.
+ *  - the reports of s88 scan rounds with a number of changed modules: the
+ *    former implementation posted a MSG_BM_MULTIPLE with all 16 detectors
+ *    for each event, the current one posts one list of MSG_BM_MULTIPLE with
+ *    only the changed bytes per round, as BDBsrv_fbReport() does. The number
+ *    of posts (each one ends up in its own TCP packet), messages and bytes
+ *    are counted and the reports are checked against the module states.
+ *
+ * The node layer (bidibnode.c) and the network side are replaced by simple
+ * fakes below.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "rb2.h"
+#include "bidib.h"
+#include "host.h"
+#include "check.h"
+
+#define S88MODULES		64
+#define CANMODULES		32
+#define ROUNDS			20000
+#define CHANGES			8			///< modules that change in each scan round
+#define PASSES			10			///< passes over the module numbers when timing the lookup
+
+static struct bidibnode root = { .uid = { 0x40, 0x00, 0x0D, 0xA1, 0x00, 0x12, 0x30 } };
+static const struct hwinfo hw = { .serial = 0x123, .manufacturer = 0x0D };
+const struct hwinfo *hwinfo = &hw;
+
+static uint16_t modstate[BIDIB_VFB_MODULES];
+
+static int posts, messages, bytes;
+static uint8_t reported[BIDIB_VFB_MODULES][2];		///< the detector bytes as the controller sees them
+
+/*
+ * ==================================================================================================
+ * Fakes for the node layer and the network side
+ * ==================================================================================================
+ */
+struct bidibnode *BDBnode_getRoot (void)
+{
+	return &root;
+}
+
+struct bidibnode *BDBnode_createNode (uint8_t *uid, uint8_t adr)
+{
+	struct bidibnode *n;
+
+	if ((n = calloc (1, sizeof(*n))) == NULL) return NULL;
+	memcpy (n->uid, uid, BIDIB_UID_LEN);
+	n->localadr = adr;
+	return n;
+}
+
+void BDBnode_insertNode (struct bidibnode *parent, struct bidibnode *n)
+{
+	struct bidibnode **pp;
+
+	for (pp = &parent->children; *pp; pp = &(*pp)->next) ;
+	*pp = n;
+	n->parent = parent;
+}
+
+int BDBnode_getFreeAddress (struct bidibnode *n, int minadr)
+{
+	struct bidibnode *c;
+	int adr = minadr;
+
+	for (c = n->children; c; c = c->next) if (c->localadr >= adr) adr = c->localadr + 1;
+	return adr;
+}
+
+struct bidibnode *BDBnode_lookupChild (struct bidibnode *parent, uint8_t adr)
+{
+	struct bidibnode *c;
+
+	for (c = parent->children; c; c = c->next) if (c->localadr == adr) return c;
+	return NULL;
+}
+
+struct bidibnode *BDBnode_lookupNodeByUID (uint8_t *uid, struct bidibnode *list)
+{
+	struct bidibnode *n, *found;
+
+	for (n = (list) ? list : root.children; n; n = n->next) {
+		if (!memcmp(n->uid, uid, BIDIB_UID_LEN)) return n;
+		if (n->children && (found = BDBnode_lookupNodeByUID(uid, n->children)) != NULL) return found;
+	}
+	return NULL;
+}
+
+void BDBnode_dropNode (struct bidibnode *n)
+{
+}
+
+void BDBnode_changeACK (struct bidibnode *n, bidibmsg_t *m) { }
+void BDBnode_uplink (struct bidibnode *n, bidibmsg_t *m) { }
+void BDBnf_getError (struct bidibnode *n, bidibmsg_t *msg) { }
+void BDBnf_getFeature (struct bidibnode *n, bidibmsg_t *msg) { }
+void BDBnf_getNextFeature (struct bidibnode *n, bidibmsg_t *msg) { }
+void BDBnf_getString (struct bidibnode *n, bidibmsg_t *msg) { }
+void BDBnf_nextNodetab (struct bidibnode *n, bidibmsg_t *msg) { }
+void BDBnf_reportFeatures (struct bidibnode *n, bidibmsg_t *msg) { }
+void BDBnf_reportNodetab (struct bidibnode *n, bidibmsg_t *msg) { }
+void BDBnf_sendPVersion (struct bidibnode *n, bidibmsg_t *msg) { }
+void BDBnf_sendPong (struct bidibnode *n, bidibmsg_t *msg) { }
+void BDBnf_sendSysMagic (struct bidibnode *n, bidibmsg_t *msg) { }
+void BDBnf_sendUniqueID (struct bidibnode *n, bidibmsg_t *msg) { }
+void BDBnf_sendVersionInfo (struct bidibnode *n, bidibmsg_t *msg) { }
+void BDBnf_setFeature (struct bidibnode *n, bidibmsg_t *msg) { }
+void BDBnf_setString (struct bidibnode *n, bidibmsg_t *msg) { }
+void BDBnf_sysClock (struct bidibnode *n, bidibmsg_t *msg) { }
+
+bidibmsg_t *bidib_errorMessage (struct bidibnode *n, uint8_t code, int len, uint8_t *extra)
+{
+	return NULL;
+}
+
+struct nodefeature *bidib_readFeature (struct bidibnode *n, uint8_t ft)
+{
+	return NULL;
+}
+
+char *bidib_formatUID (uint8_t *uid)
+{
+	static char buf[32];
+
+	sprintf (buf, "%02X%02X%02X%02X%02X%02X%02X", uid[0], uid[1], uid[2], uid[3], uid[4], uid[5], uid[6]);
+	return buf;
+}
+
+static adrstack_t adrstack (struct bidibnode *n)
+{
+	adrstack_t adr = 0;
+
+	for (; n && n != &root; n = n->parent) adr = (adr << 8) | n->localadr;
+	return adr;
+}
+
+bidibmsg_t *bidib_genMessage (struct bidibnode *n, uint8_t msg, int len, uint8_t *data)
+{
+	bidibmsg_t *bm;
+
+	if ((bm = calloc (1, sizeof(*bm) + len)) != NULL) {
+		bm->adrstack = adrstack(n);
+		bm->msg = msg;
+		bm->datalen = len;
+		if (len > 0) memcpy (bm->data, data, len);
+	}
+	return bm;
+}
+
+/**
+ * The network side: each call ends up in a TCP packet. The MSG_BM_MULTIPLE
+ * contents are applied to what the controller knows about the detectors.
+ */
+void netBDB_postMessages (bidibmsg_t *m)
+{
+	bidibmsg_t *next;
+	struct bidibnode *n;
+	struct virtual_feedback *vfb;
+	int module, i;
+
+	posts++;
+	for (; m; m = next) {
+		next = m->next;
+		messages++;
+		bytes += 6 + m->datalen;			// MSG_LENGTH, two address bytes plus terminator, MSG_NUM and MSG_TYPE
+		if (m->msg == MSG_BM_MULTIPLE && m->datalen >= 3) {
+			for (module = 0; module < BIDIB_VFB_MODULES; module++) {
+				if ((n = BDBvn_feedbackNode(module)) != NULL && adrstack(n) == m->adrstack) break;
+			}
+			if (module < BIDIB_VFB_MODULES && (vfb = n->private) != NULL) {
+				for (i = 0; i < m->data[1] / 8; i++) reported[module][m->data[0] / 8 + i] = m->data[2 + i];
+			}
+		}
+		free (m);
+	}
+}
+
+uint16_t fb_getModuleState (int mod)
+{
+	return (mod >= 0 && mod < BIDIB_VFB_MODULES) ? modstate[mod] : 0;
+}
+
+uint8_t fb_msb2lsb8 (uint8_t b)
+{
+	uint8_t r = 0;
+	int i;
+
+	for (i = 0; i < 8; i++) if (b & (0x80 >> i)) r |= 1 << i;
+	return r;
+}
+
+int s88_getModules (void)
+{
+	return S88MODULES;
+}
+
+/*
+ * ==================================================================================================
+ * The two implementations
+ * ==================================================================================================
+ */
+
+/**
+ * The lookup of the former implementation (bidibserver.c before the lookup table)
+ */
+static struct bidibnode *oldLookup (struct bidibnode *n, int module)
+{
+	struct bidibnode *child, *found;
+	struct virtual_feedback *vfb;
+
+	if (!n) n = BDBnode_getRoot();
+	for (child = n->children; child; child = child->next) {
+		if ((child->uid[0] & BIDIB_CLASS_OCCUPANCY) && child->private) {
+			vfb = child->private;
+			if (vfb->base == module * 16) return child;
+		}
+		if (child->children && (found = oldLookup(child, module)) != NULL) return found;
+	}
+	return NULL;
+}
+
+/**
+ * The former implementation without the log message
+ */
+static void oldFbHandler (int module, uint16_t status)
+{
+	struct bidibnode *n;
+	bidibmsg_t *m;
+	uint8_t data[4];
+
+	if ((n = oldLookup(NULL, module)) != NULL) {
+		data[0] = 0;
+		data[1] = 16;
+		data[2] = fb_msb2lsb8(status >> 8);
+		data[3] = fb_msb2lsb8(status & 0xFF);
+		if ((m = bidib_genMessage(n, MSG_BM_MULTIPLE, 4, data)) != NULL) {
+			netBDB_postMessages(m);
+		}
+	}
+}
+
+static uint8_t fbdirty[BIDIB_VFB_MODULES];
+
+static void newFbHandler (int module, uint16_t status)
+{
+	fbdirty[module] |= BDBvn_feedbackUpdate(module, status);
+}
+
+static void newFbReport (void)
+{
+	bidibmsg_t *msgs, **tail, *m;
+	int module;
+
+	msgs = NULL;
+	tail = &msgs;
+	for (module = 0; module < BIDIB_VFB_MODULES; module++) {
+		if (!fbdirty[module]) continue;
+		if ((m = BDBvn_feedbackReport(module, fbdirty[module])) != NULL) {
+			*tail = m;
+			tail = &m->next;
+		}
+		fbdirty[module] = 0;
+	}
+	if (msgs) netBDB_postMessages(msgs);
+}
+
+/*
+ * ==================================================================================================
+ * The benchmark
+ * ==================================================================================================
+ */
+static uint32_t rnd = 0x1234567;
+
+static uint32_t random32 (void)
+{
+	rnd ^= rnd << 13;
+	rnd ^= rnd >> 17;
+	rnd ^= rnd << 5;
+	return rnd;
+}
+
+static int randomModule (void)
+{
+	int idx = random32() % (S88MODULES + CANMODULES);
+
+	return (idx < S88MODULES) ? idx : FB_MCAN_OFFSET / 16 + idx - S88MODULES;
+}
+
+static double seconds (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct bidibnode * volatile sink;
+
+/**
+ * The consumer of the looked up nodes. It only keeps the compiler from
+ * dropping the lookup.
+ */
+static void consume (struct bidibnode *n)
+{
+	sink = n;
+}
+
+/**
+ * Time the lookup of the nodes for a list of module numbers.
+ *
+ * \param current	use the current implementation
+ * \param modules	the module numbers
+ * \param count		the number of entries in modules
+ * \return			the time in seconds
+ */
+static double lookup (bool current, const int *modules, int count)
+{
+	double start;
+	int pass, i;
+
+	start = seconds();
+	for (pass = 0; pass < PASSES; pass++) {
+		if (current) {
+			for (i = 0; i < count; i++) consume(BDBvn_feedbackNode(modules[i]));
+		} else {
+			for (i = 0; i < count; i++) consume(oldLookup(NULL, modules[i]));
+		}
+	}
+	return seconds() - start;
+}
+
+/**
+ * Simulate the scan rounds. In each round CHANGES modules flip a single detector.
+ *
+ * \param current	use the current implementation
+ */
+static void run (bool current)
+{
+	int round, i, module;
+
+	rnd = 0x1234567;
+	posts = messages = bytes = 0;
+	for (round = 0; round < ROUNDS; round++) {
+		for (i = 0; i < CHANGES; i++) {
+			module = randomModule();
+			modstate[module] ^= 1 << (random32() % 16);
+			if (current) newFbHandler(module, modstate[module]);
+			else oldFbHandler(module, modstate[module]);
+		}
+		if (current) newFbReport();
+	}
+}
+
+static bool consistent (void)
+{
+	int module;
+
+	for (module = 0; module < BIDIB_VFB_MODULES; module++) {
+		if (!BDBvn_feedbackNode(module)) continue;
+		if (reported[module][0] != fb_msb2lsb8(modstate[module] >> 8)) return false;
+		if (reported[module][1] != fb_msb2lsb8(modstate[module] & 0xFF)) return false;
+	}
+	return true;
+}
+
+int main (void)
+{
+	int events = ROUNDS * CHANGES;
+	int *modules, module, i;
+	int oldposts, oldmessages, oldbytes;
+	double told, tnew;
+
+	CHECK(BDBvn_feedbackModules(0, S88MODULES, MAX_S88MODULES, BIDIB_HUB_S88) == S88MODULES);
+	CHECK(BDBvn_feedbackModules(0, CANMODULES, MAX_CANMODULES, BIDIB_HUB_MCAN) == CANMODULES);
+	CHECK(BDBvn_feedbackNode(0) != NULL && BDBvn_feedbackNode(S88MODULES) == NULL);
+	CHECK(BDBvn_feedbackNode(FB_MCAN_OFFSET / 16) != NULL);
+
+	if ((modules = malloc (events * sizeof(*modules))) == NULL) return 1;
+	for (i = 0; i < events; i++) {
+		modules[i] = randomModule();
+		if (i < 1000) CHECK(oldLookup(NULL, modules[i]) == BDBvn_feedbackNode(modules[i]));
+	}
+	for (module = 0; module < BIDIB_VFB_MODULES; module++) CHECK(oldLookup(NULL, module) == BDBvn_feedbackNode(module));
+	told = lookup(false, modules, events);
+	tnew = lookup(true, modules, events);
+	free (modules);
+
+	run(false);
+	oldposts = posts;
+	oldmessages = messages;
+	oldbytes = bytes;
+	CHECK(posts == events);
+	CHECK(consistent());
+
+	memset (reported, 0, sizeof(reported));
+	memset (modstate, 0, sizeof(modstate));
+	for (module = 0; module < BIDIB_VFB_MODULES; module++) BDBvn_feedbackUpdate(module, 0);
+	run(true);
+	CHECK(posts <= ROUNDS);
+	CHECK(messages <= events);
+	CHECK(consistent());
+
+	printf ("%d s88 + %d mcan modules, %d rounds with %d changed modules each\n", S88MODULES, CANMODULES, ROUNDS, CHANGES);
+	printf ("%-20s %12s %12s\n", "", "tree walk", "lookup table");
+	printf ("%-20s %12.1f %12.1f\n", "lookup ns/event", told * 1e9 / events / PASSES, tnew * 1e9 / events / PASSES);
+	printf ("%-20s %12d %12d\n", "posts", oldposts, posts);
+	printf ("%-20s %12d %12d\n", "messages", oldmessages, messages);
+	printf ("%-20s %12d %12d\n", "bytes", oldbytes, bytes);
+
+	return check_result("bidibfb_bench");
+}
@@ -0,0 +1,347 @@
+/*
+ * bidibfwu_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief Firmware update state machine against simulated BiDiB nodes (bidibfwu.c)
+ *
+ * A simulated node implements the node side of MSG_FW_UPDATE_OP: it answers
+ * each operation after a short delay with MSG_FW_UPDATE_STAT and collects the
+ * hex records per destination. Faults can be injected: lost answers, an error
+ * report, a node that resets without acknowledging EXIT or one that vanishes
+ * in the middle of the transfer. The time is simulated in steps of 1ms.
+ */
+
+#include <string.h>
+#include "bidibfwu.h"
+#include "check.h"
+
+static const char flash[] =
+	":020000040000FA\n"
+	":10000000000102030405060708090A0B0C0D0E0F78\n"
+	"\n"
+	":10001000101112131415161718191A1B1C1D1E1F68\n"
+	":00000001FF\n";
+
+static const char eeprom[] =
+	":0400000001020304F2\r\n"
+	":00000001FF\r\n";
+
+static const char *images[FWU_DESTS] = { flash, eeprom };
+
+/**
+ * The simulated node
+ */
+struct simnode {
+	uint8_t		uid[FWU_UIDLEN];
+	bool		inUpdate;			///< the node is in update mode
+	bool		pending;			///< an answer is scheduled
+	uint8_t		stat;				///< the scheduled answer
+	uint8_t		detail;				///< the timeout (10ms) or error code of the answer
+	uint32_t	due;				///< when the answer is delivered
+	uint8_t		dest;				///< the selected destination
+	char		rx[FWU_DESTS][256];	///< the received records (joined with newlines)
+	char		last[FWU_MAXRECORD + 1];	///< the last record (a repeated record is written to the same address)
+	int			ops;				///< number of operations received
+	int			dropEvery;			///< drop every n-th answer (0 = never)
+	int			failAt;				///< report an error at this operation (0 = never)
+	int			vanishAt;			///< the node is gone from this operation on (0 = never)
+	bool		silentExit;			///< the node resets on EXIT without acknowledge
+	bool		exited;				///< EXIT was received
+};
+
+static uint32_t now;
+
+static int imgRead (void *priv, uint8_t dest, uint32_t pos, uint32_t *next, char *rec, int size)
+{
+	const char *img, *s, *e;
+	int len;
+
+	if (dest >= FWU_DESTS) return -1;
+	img = images[dest];
+	s = img + pos;
+	while (*s == '\r' || *s == '\n') s++;		// skip empty lines
+	if (!*s) return 0;
+	for (e = s; *e && *e != '\r' && *e != '\n'; e++) ;
+	len = e - s;
+	if (len > size) return -1;
+	memcpy (rec, s, len);
+	*next = e - img;
+	return len;
+}
+
+static bool nodeSend (void *priv, uint8_t op, const uint8_t *data, int len)
+{
+	struct simnode *n = priv;
+	char *rx;
+
+	n->ops++;
+	if (n->vanishAt && n->ops >= n->vanishAt) return false;
+
+	n->pending = true;
+	n->due = now + 5;
+	n->detail = 10;					// 100ms timeout for the next answer
+	switch (op) {
+		case FWU_OP_ENTER:
+			if (len != FWU_UIDLEN || memcmp(data, n->uid, FWU_UIDLEN)) {
+				n->pending = false;	// not for us
+				return true;
+			}
+			n->inUpdate = true;
+			n->stat = FWU_STAT_READY;
+			break;
+		case FWU_OP_SETDEST:
+			if (len != 1 || data[0] >= FWU_DESTS) {
+				n->stat = FWU_STAT_ERROR;
+				n->detail = 1;
+				break;
+			}
+			n->dest = data[0];
+			n->rx[n->dest][0] = 0;	// the destination is erased
+			n->last[0] = 0;
+			n->stat = FWU_STAT_DATA;
+			break;
+		case FWU_OP_DATA:
+			rx = n->rx[n->dest];
+			if (len > FWU_MAXRECORD || (len == (int) strlen(n->last) && !memcmp(data, n->last, len))) break;
+			memcpy (n->last, data, len);
+			n->last[len] = 0;
+			snprintf (rx + strlen(rx), sizeof(n->rx[0]) - strlen(rx), "%s\n", n->last);
+			n->stat = FWU_STAT_DATA;
+			break;
+		case FWU_OP_DONE:
+			n->stat = FWU_STAT_READY;
+			break;
+		case FWU_OP_EXIT:
+			n->inUpdate = false;
+			n->exited = true;
+			n->stat = FWU_STAT_EXIT;
+			if (n->silentExit) n->pending = false;
+			break;
+	}
+	if (n->failAt && n->ops == n->failAt) {
+		n->stat = FWU_STAT_ERROR;
+		n->detail = 3;
+	}
+	if (n->dropEvery && (n->ops % n->dropEvery) == 0) n->pending = false;
+	return true;
+}
+
+static const struct fwu_ops simops = {
+	.read = imgRead,
+	.send = nodeSend,
+};
+
+static void nodeInit (struct simnode *n, uint8_t serial)
+{
+	static const uint8_t uid[FWU_UIDLEN] = { 0x80, 0x00, 0x0D, 0x68, 0x00, 0x00, 0x00 };
+
+	memset (n, 0, sizeof(*n));
+	memcpy (n->uid, uid, FWU_UIDLEN);
+	n->uid[6] = serial;
+}
+
+/**
+ * Run the simulation until the job is no longer active or the time limit is reached.
+ */
+static void run (struct fwu_job *j, struct simnode *n, uint32_t limit)
+{
+	uint32_t end = now + limit;
+
+	while (fwu_isActive(j) && (int32_t) (now - end) < 0) {
+		now++;
+		if (n->pending && now == n->due) {
+			n->pending = false;
+			fwu_status(j, n->stat, n->detail, now);
+		}
+		fwu_poll(j, now);
+	}
+}
+
+/**
+ * The image without empty lines and with '\n' as line end, as it should arrive at the node.
+ */
+static bool received (const struct simnode *n, int dest)
+{
+	char expect[256], *p;
+	const char *s;
+
+	for (s = images[dest], p = expect; *s; s++) {
+		if (*s == '\r') continue;
+		if (*s == '\n' && (p == expect || p[-1] == '\n')) continue;
+		*p++ = *s;
+	}
+	*p = 0;
+	return !strcmp(n->rx[dest], expect);
+}
+
+static void testUpdate (void)
+{
+	struct simnode n;
+	struct fwu_job j;
+
+	nodeInit(&n, 1);
+	fwu_init(&j, n.uid, 0x03, &simops, &n);
+	j.size[0] = sizeof(flash) - 1;
+	j.size[1] = sizeof(eeprom) - 1;
+	CHECK(fwu_progress(&j) == 0);
+	CHECK(fwu_start(&j, now));
+	CHECK(!fwu_start(&j, now));			// already running
+	run(&j, &n, 17);						// ENTER, SETDEST and the first record are acknowledged
+	CHECK(j.state == FWU_DATA);
+	CHECK(fwu_progress(&j) > 0 && fwu_progress(&j) < 100);
+	run(&j, &n, 10000);
+	CHECK(j.state == FWU_FINISHED);
+	CHECK(j.error == FWU_ERR_NONE);
+	CHECK(fwu_progress(&j) == 100);
+	CHECK(received(&n, 0));
+	CHECK(received(&n, 1));
+	CHECK(n.exited && !n.inUpdate);
+	CHECK(n.ops == 1 + (1 + 4 + 1) + (1 + 2 + 1) + 1);
+}
+
+static void testRetries (void)
+{
+	struct simnode n;
+	struct fwu_job j;
+
+	// every third answer gets lost: the operations are repeated
+	nodeInit(&n, 2);
+	n.dropEvery = 3;
+	fwu_init(&j, n.uid, 0x01, &simops, &n);
+	CHECK(fwu_start(&j, now));
+	run(&j, &n, 30000);
+	CHECK(j.state == FWU_FINISHED);
+	CHECK(received(&n, 0));
+	CHECK(n.ops > 7);
+
+	// a node that does not answer at all
+	nodeInit(&n, 3);
+	n.dropEvery = 1;
+	fwu_init(&j, n.uid, 0x01, &simops, &n);
+	CHECK(fwu_start(&j, now));
+	run(&j, &n, 30000);
+	CHECK(j.state == FWU_FAILED && j.error == FWU_ERR_TIMEOUT);
+	CHECK(n.ops == 1 + FWU_RETRIES);
+
+	// the node resets after EXIT without acknowledge: this counts as success
+	nodeInit(&n, 4);
+	n.silentExit = true;
+	fwu_init(&j, n.uid, 0x01, &simops, &n);
+	CHECK(fwu_start(&j, now));
+	run(&j, &n, 30000);
+	CHECK(j.state == FWU_FINISHED);
+	CHECK(received(&n, 0));
+}
+
+static void testFailures (void)
+{
+	struct simnode n;
+	struct fwu_job j;
+
+	// the node reports an error on the second record, the update is resumed
+	nodeInit(&n, 5);
+	n.failAt = 4;
+	fwu_init(&j, n.uid, 0x03, &simops, &n);
+	CHECK(fwu_start(&j, now));
+	run(&j, &n, 10000);
+	CHECK(j.state == FWU_FAILED && j.error == FWU_ERR_NODE && j.nodeerr == 3);
+	CHECK(fwu_resume(&j, now));
+	run(&j, &n, 10000);
+	CHECK(j.state == FWU_FINISHED);
+	CHECK(received(&n, 0) && received(&n, 1));
+
+	// the node vanishes during the EEPROM transfer: flash is not transferred again on resume
+	nodeInit(&n, 6);
+	n.vanishAt = 9;
+	fwu_init(&j, n.uid, 0x03, &simops, &n);
+	CHECK(fwu_start(&j, now));
+	run(&j, &n, 10000);
+	CHECK(j.state == FWU_FAILED && j.error == FWU_ERR_SEND);
+	CHECK(j.dests == 0x02);
+	CHECK(received(&n, 0));
+	n.vanishAt = 0;
+	n.rx[0][0] = 0;
+	CHECK(fwu_resume(&j, now));
+	run(&j, &n, 10000);
+	CHECK(j.state == FWU_FINISHED);
+	CHECK(n.rx[0][0] == 0);				// flash was not touched again
+	CHECK(received(&n, 1));
+
+	// the node is lost (i.e. removed from the bus) in the middle of the transfer
+	nodeInit(&n, 7);
+	fwu_init(&j, n.uid, 0x01, &simops, &n);
+	CHECK(fwu_start(&j, now));
+	run(&j, &n, 12);
+	CHECK(fwu_isActive(&j));
+	fwu_lost(&j);
+	CHECK(j.state == FWU_FAILED && j.error == FWU_ERR_LOST);
+
+	// cancelling before any data was written leaves the update mode
+	nodeInit(&n, 8);
+	fwu_init(&j, n.uid, 0x01, &simops, &n);
+	CHECK(fwu_start(&j, now));
+	fwu_cancel(&j);
+	CHECK(j.state == FWU_FAILED && j.error == FWU_ERR_CANCELLED);
+	CHECK(n.exited);
+
+	// an ENTER with a foreign UID is ignored by the node
+	nodeInit(&n, 9);
+	fwu_init(&j, (const uint8_t *) "\x80\x00\x0D\x68\x00\x00\x77", 0x01, &simops, &n);
+	CHECK(fwu_start(&j, now));
+	run(&j, &n, 30000);
+	CHECK(j.state == FWU_FAILED && j.error == FWU_ERR_TIMEOUT);
+	CHECK(!n.inUpdate);
+}
+
+static void testNames (void)
+{
+	static const uint8_t uid[FWU_UIDLEN] = { 0x80, 0x00, 0x0D, 0x68, 0x00, 0x12, 0x34 };
+	struct fwu_image img;
+
+	CHECK(fwu_parseName("13_104.hex", &img));
+	CHECK(!img.byuid && img.vid == 13 && img.pid == 104 && img.dest == 0);
+	CHECK(fwu_matches(&img, uid));
+	CHECK(fwu_parseName("13_104_1.HEX", &img) && img.dest == 1);
+	CHECK(fwu_parseName("80000D68001234_1.hex", &img));
+	CHECK(img.byuid && img.dest == 1 && fwu_matches(&img, uid));
+	CHECK(fwu_parseName("80000d68001235.hex", &img) && !fwu_matches(&img, uid));
+	CHECK(fwu_parseName("13_360.hex", &img) && !fwu_matches(&img, uid));
+	CHECK(!fwu_parseName("13_104_2.hex", &img));
+	CHECK(!fwu_parseName("256_104.hex", &img));
+	CHECK(!fwu_parseName("13_104.bin", &img));
+	CHECK(!fwu_parseName("13-104.hex", &img));
+}
+
+int main (void)
+{
+	testUpdate();
+	testRetries();
+	testFailures();
+	testNames();
+	return check_result("bidibfwu_test");
+}
@@ -0,0 +1,290 @@
+/*
+ * bidibocc_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief Replay of recorded BiDiB detector traffic through the block model (bidibocc.c)
+ *
+ * The recording holds the upstream packets of two detector nodes as they were
+ * received on the interface, one packet per line with a time stamp in ms and
+ * the packet bytes in hex. Each packet is split with bdbp_next() and the
+ * occupancy messages are fed to the model the same way bidibctrl.c and
+ * bidibbm.c do. Every reported change is written to a transcript that is
+ * compared with the expected one.
+ *
+ * A recording file in the same format can be given on the command line. It is
+ * replayed and the transcript and the resulting blocks are printed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "bidibdispatch.h"
+#include "bidib_messages.h"
+#include "bidibocc.h"
+#include "check.h"
+
+/*
+ * Two detectors: an occupancy detector (16 ports, feedback 0..15) on bus
+ * address 1 and a RailCom detector (8 ports, feedback 16..23) on address 2.
+ */
+static const struct {
+	uint8_t		adr;
+	uint8_t		uid[OCC_UIDLEN];
+	int			fbbase;
+} nodes[] = {
+	{ 1, { 0x40, 0x00, 0x0D, 0x6B, 0x00, 0x00, 0x11 }, 0 },
+	{ 2, { 0x40, 0x00, 0x0D, 0x71, 0x00, 0x00, 0x22 }, 16 },
+};
+
+#define NODES		((int) (sizeof(nodes) / sizeof(nodes[0])))
+
+static const char recording[] =
+	"# ms  packet (LEN ADR 00 NUM TYPE DATA...)\n"
+	"1000  08 01 00 01 a2 00 10 05 00\n"				// MULTIPLE: ports 0 and 2 occupied
+	"1010  05 02 00 01 a1 03\n"							// FREE port 3 on the RailCom detector (creates the block)
+	"1200  07 02 00 02 a3 03 03 00\n"					// ADDRESS port 3: loco 3 forward
+	"1210  08 02 00 03 a6 03 00 2a 00 05 01 00 00 a1 00\n"	// SPEED loco 3 = 42 km/h + FREE port 0 in one packet
+	"1300  09 02 00 04 aa 03 03 00 02 e7\n"				// DYN_STATE loco 3 temperature -25
+	"1400  09 02 00 05 a3 03 03 80 d2 04\n"				// ADDRESS port 3: loco 3 reverse + loco 1234
+	"1500  07 02 00 06 a3 03 d2 04\n"					// ADDRESS port 3: loco 3 has left
+	"1600  05 01 00 02 a0 02\n"							// OCC port 2 again: no change
+	"1700  08 01 00 03 a2 00 10 01 00\n"				// MULTIPLE: port 0 occupied again, port 2 free
+	"1800  07 02 00 07 a3 05 d2 04\n"					// ADDRESS port 5: loco 1234 moves on
+	"1810  05 02 00 08 a1 03\n"							// FREE port 3: loco 1234 left
+	"1900  09 02 00 09 aa 05 d2 04 01 0c\n"				// DYN_STATE loco 1234 QoS 12 %
+	"2000  07 02 00 0a a3 06 05 40\n"					// ADDRESS port 6: accessory 5
+	"2100  05 02 00 0b a3\n";							// a truncated message (MSG_LENGTH too small for the type)
+
+static const char expected[] =
+	"1000 11:0 occupied\n"
+	"1000 11:2 occupied\n"
+	"1200 22:3 occupied\n"
+	"1200 22:3 +3\n"
+	"1210 rc 3 speed 42\n"
+	"1210 11:0 free\n"
+	"1300 rc 3 temp -25\n"
+	"1400 22:3 +3r\n"
+	"1400 22:3 +1234\n"
+	"1500 22:3 -3r\n"
+	"1700 11:0 occupied\n"
+	"1700 11:2 free\n"
+	"1800 22:5 occupied\n"
+	"1800 22:5 +1234\n"
+	"1810 22:3 free\n"
+	"1810 22:3 -1234\n"
+	"1900 rc 1234 qos 12\n"
+	"2000 22:6 occupied\n"
+	"2000 22:6 +a5\n"
+	"2100 malformed\n";
+
+static struct occ_model model;
+static char transcript[4096];
+
+static void note (const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	len = strlen(transcript);
+	va_start (ap, fmt);
+	vsnprintf (transcript + len, sizeof(transcript) - len, fmt, ap);
+	va_end (ap);
+}
+
+static void noteLoco (uint32_t now, const struct occ_block *b, char dir, const struct occ_loco *l)
+{
+	note("%lu %02x:%d %c%s%d%s\n", (unsigned long) now, b->uid[6], b->port, dir, l->accessory ? "a" : "", l->adr, l->reverse ? "r" : "");
+}
+
+static void report (uint32_t now, bool changed, const struct occ_change *chg)
+{
+	int i;
+
+	if (!changed) return;
+	if (chg->occchg) note("%lu %02x:%d %s\n", (unsigned long) now, chg->blk.uid[6], chg->blk.port, chg->blk.occupied ? "occupied" : "free");
+	for (i = 0; i < chg->nentered; i++) noteLoco(now, &chg->blk, '+', &chg->entered[i]);
+	for (i = 0; i < chg->nleft; i++) noteLoco(now, &chg->blk, '-', &chg->left[i]);
+}
+
+/**
+ * Handle one message like bidibctrl.c and bidibbm.c do.
+ */
+static void handle (int node, const struct bdbp_view *v, uint32_t now)
+{
+	const uint8_t *uid = nodes[node].uid;
+	const uint8_t *d = v->data;
+	struct occ_change chg;
+	struct occ_rcdata *rc;
+	struct occ_loco l;
+	int i, fb = nodes[node].fbbase;
+
+	switch (v->msg) {
+		case MSG_BM_OCC:
+		case MSG_BM_FREE:
+			if (v->datalen < 1) break;
+			report(now, occ_occupy(&model, uid, d[0], fb + d[0], v->msg == MSG_BM_OCC, now, &chg), &chg);
+			break;
+		case MSG_BM_MULTIPLE:
+			if (v->datalen < 2 || v->datalen < (d[1] + 7) / 8 + 2) break;
+			for (i = 0; i < d[1]; i++) {
+				report(now, occ_occupy(&model, uid, d[0] + i, fb + d[0] + i, !!(d[2 + (i >> 3)] & (1 << (i & 7))), now, &chg), &chg);
+			}
+			break;
+		case MSG_BM_ADDRESS:
+			if (v->datalen < 3) break;
+			report(now, occ_address(&model, uid, d[0], fb + d[0], &d[1], v->datalen - 1, now, &chg), &chg);
+			break;
+		case MSG_BM_SPEED:
+			if (v->datalen < 4) break;
+			occ_decodeAddress(d[0], d[1], &l);
+			if (l.accessory || !l.adr) break;
+			if ((rc = occ_speed(&model, l.adr, d[2] | (d[3] << 8), now)) != NULL) note("%lu rc %d speed %d\n", (unsigned long) now, rc->adr, rc->speed);
+			break;
+		case MSG_BM_DYN_STATE:
+			if (v->datalen < 5) break;
+			occ_decodeAddress(d[1], d[2], &l);
+			if (l.accessory || !l.adr) break;
+			if ((rc = occ_dynState(&model, l.adr, d[3], d[4], now)) == NULL) break;
+			if (d[3] == OCC_DYN_TEMP) note("%lu rc %d temp %d\n", (unsigned long) now, rc->adr, rc->temp);
+			if (d[3] == OCC_DYN_QOS) note("%lu rc %d qos %d\n", (unsigned long) now, rc->adr, rc->qos);
+			break;
+	}
+}
+
+/**
+ * Replay a recording.
+ *
+ * \return		the number of packets replayed
+ */
+static int replay (const char *rec)
+{
+	uint8_t pkt[64];
+	struct bdbp_view v;
+	uint32_t now;
+	const char *s;
+	char *e;
+	int len, pos, rc, node, count = 0;
+
+	occ_init(&model);
+	transcript[0] = 0;
+	for (s = rec; *s; s = (*e) ? e + 1 : e) {
+		e = strchr(s, '\n');
+		if (!e) e = (char *) s + strlen(s);
+		if (*s == '#' || *s == '\n') continue;
+		now = strtoul(s, (char **) &s, 10);
+		for (len = 0; len < (int) sizeof(pkt) && s < e; ) {
+			while (*s == ' ' || *s == '\t' || *s == '\r') s++;
+			if (s >= e) break;
+			pkt[len++] = strtoul(s, (char **) &s, 16);
+		}
+		count++;
+		pos = 0;
+		while ((rc = bdbp_next(pkt, len, &pos, &v)) > 0) {
+			for (node = 0; node < NODES && (v.adrstack >> 24) != nodes[node].adr; node++) ;
+			if (node < NODES) handle(node, &v, now);
+		}
+		if (rc < 0) note("%lu malformed\n", (unsigned long) now);
+	}
+	return count;
+}
+
+static void testReplay (void)
+{
+	int i;
+
+	CHECK(replay(recording) == 14);
+	CHECK(!strcmp(transcript, expected));
+	if (strcmp(transcript, expected)) fprintf (stderr, "transcript:\n%s", transcript);
+
+	// the state after the replay
+	CHECK(model.nblocks == 16 + 3);
+	CHECK(occ_lookup(&model, nodes[0].uid, 0) && occ_lookup(&model, nodes[0].uid, 0)->occupied);
+	CHECK(occ_lookup(&model, nodes[0].uid, 2) && !occ_lookup(&model, nodes[0].uid, 2)->occupied);
+	CHECK(occ_lookupFeedback(&model, 16 + 5) && occ_lookupFeedback(&model, 16 + 5) == occ_lookup(&model, nodes[1].uid, 5));
+	CHECK(occ_findLoco(&model, 1234, 0) == occ_lookup(&model, nodes[1].uid, 5) - model.blk);
+	CHECK(occ_findLoco(&model, 3, 0) == -1);
+	CHECK(occ_findLoco(&model, 5, 0) == -1);					// accessories are not locos
+	CHECK(occ_rcLookup(&model, 3) && occ_rcLookup(&model, 3)->valid == (OCC_RCVALID_SPEED | OCC_RCVALID_TEMP));
+	CHECK(occ_rcLookup(&model, 1234) && occ_rcLookup(&model, 1234)->qos == 12);
+
+	// the RailCom detector is lost
+	CHECK(occ_dropNode(&model, nodes[1].uid) == 3);
+	CHECK(model.nblocks == 16);
+	for (i = 0; i < model.nblocks; i++) CHECK(model.blk[i].uid[6] == 0x11);
+	CHECK(occ_findLoco(&model, 1234, 0) == -1);
+}
+
+static void testLimits (void)
+{
+	static const uint8_t uid[OCC_UIDLEN] = { 0x40, 0x00, 0x0D, 0x6B, 0x00, 0x00, 0x33 };
+	static const uint8_t many[] = { 1, 0, 2, 0, 3, 0, 2, 0, 4, 0, 5, 0, 6, 0 };
+	struct occ_change chg;
+	int i;
+
+	occ_init(&model);
+	for (i = 0; i < OCC_MAXBLOCKS; i++) CHECK(occ_occupy(&model, uid, i, i, true, 1, NULL));
+	CHECK(!occ_occupy(&model, uid, OCC_MAXBLOCKS, 0, true, 1, &chg));	// the table is full
+	CHECK(occ_address(&model, uid, 0, 0, many, sizeof(many), 2, &chg));
+	CHECK(chg.blk.nlocos == OCC_LOCOS);							// duplicates ignored, the rest is cut
+	CHECK(chg.nentered == OCC_LOCOS && chg.entered[3].adr == 4);
+
+	// the RailCom table recycles the oldest entry
+	for (i = 1; i <= OCC_RCDATA; i++) occ_speed(&model, i, i, 100 + i);
+	occ_speed(&model, 1, 1, 200);								// refresh address 1
+	occ_speed(&model, 999, 0, 300);
+	CHECK(occ_rcLookup(&model, 1) != NULL);
+	CHECK(occ_rcLookup(&model, 2) == NULL);
+	CHECK(occ_rcLookup(&model, 999) != NULL);
+}
+
+int main (int argc, char *argv[])
+{
+	static char buf[1 << 20];
+	FILE *fp;
+	int len, i;
+
+	if (argc > 1) {
+		if ((fp = fopen(argv[1], "r")) == NULL) {
+			perror (argv[1]);
+			return 1;
+		}
+		len = fread(buf, 1, sizeof(buf) - 1, fp);
+		fclose (fp);
+		buf[len] = 0;
+		printf ("%d packets\n%s", replay(buf), transcript);
+		for (i = 0; i < model.nblocks; i++) {
+			printf ("block %02x:%d fb %d %s, %d locos\n", model.blk[i].uid[6], model.blk[i].port, model.blk[i].fbidx,
+					model.blk[i].occupied ? "occupied" : "free", model.blk[i].nlocos);
+		}
+		return 0;
+	}
+
+	testReplay();
+	testLimits();
+	return check_result("bidibocc_test");
+}
@@ -0,0 +1,230 @@
+/*
+ * bstsupervisor_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief Booster supervisor test with synthetic current traces (bstsupervisor.c)
+ *
+ * The traces are generated sample by sample (1ms each) like the ADC would
+ * deliver them: a quiet base load, a slow ramp, a short spike and a real
+ * short that is reported by the booster. The captures, the statistics and
+ * the restart delays are checked against the expected values.
+ */
+
+#include <string.h>
+#include "bstsupervisor.h"
+#include "check.h"
+
+#define BASE_LOAD		350			///< quiet base load in mA
+#define SHORT_LOAD		5200		///< current during a short in mA
+
+static uint32_t now;
+
+/**
+ * Feed a trace segment with a linear current change.
+ *
+ * \return			the number of captures completed in this segment
+ */
+static int feed (struct bsv *b, int ms, int from, int to)
+{
+	int i, done = 0;
+
+	for (i = 0; i < ms; i++) {
+		if (bsv_sample(b, now++, from + (to - from) * i / ms)) done++;
+	}
+	return done;
+}
+
+static void testShortCapture (void)
+{
+	struct bsv_config cnf;
+	struct bsv b;
+	const struct bsv_capture *c;
+	int i;
+
+	bsv_defaults(&cnf);
+	cnf.pre = 20;
+	cnf.post = 10;
+	bsv_init(&b, &cnf);
+	now = 1000;
+
+	CHECK(feed(&b, 100, BASE_LOAD, BASE_LOAD) == 0);
+	CHECK(bsv_getCapture(&b, 0) == NULL);
+	CHECK(bsv_short(&b, now, BSV_SRC_INTERNAL) == -1);		// manual restart
+	CHECK(bsv_getCapture(&b, 0) == NULL);					// still recording
+	CHECK(feed(&b, 9, SHORT_LOAD, SHORT_LOAD) == 0);
+	CHECK(feed(&b, 1, 0, 0) == 1);
+
+	c = bsv_getCapture(&b, 0);
+	CHECK(c != NULL);
+	if (!c) return;
+	CHECK(c->seq == 1);
+	CHECK(c->ts == 1100);
+	CHECK(c->source == BSV_SRC_INTERNAL);
+	CHECK(c->pre == 20 && c->count == 30);
+	CHECK(c->peak == SHORT_LOAD);
+	for (i = 0; i < 20; i++) CHECK(c->samples[i] == BASE_LOAD);
+	for (i = 20; i < 29; i++) CHECK(c->samples[i] == SHORT_LOAD);
+	CHECK(c->samples[29] == 0);
+
+	CHECK(b.stats.shorts[BSV_SRC_INTERNAL] == 1);
+	CHECK(b.stats.first == 1100 && b.stats.last == 1100);
+}
+
+static void testOvercurrent (void)
+{
+	struct bsv_config cnf;
+	struct bsv b;
+	const struct bsv_capture *c;
+
+	bsv_defaults(&cnf);
+	cnf.trigger = 3000;
+	cnf.pre = 50;
+	cnf.post = 40;
+	bsv_init(&b, &cnf);
+	now = 0;
+
+	// only 10 samples of history: the pre-trigger part is shortened (the trigger sample itself is part of it)
+	CHECK(feed(&b, 10, BASE_LOAD, BASE_LOAD) == 0);
+	CHECK(feed(&b, 5, 3500, 3500) == 0);
+	CHECK(b.over);
+	CHECK(feed(&b, 35, BASE_LOAD, BASE_LOAD) == 0);
+	CHECK(feed(&b, 1, BASE_LOAD, BASE_LOAD) == 1);
+	CHECK(!b.over);
+	CHECK(b.stats.overcurrent == 5 && b.stats.longest == 5);
+
+	c = bsv_getCapture(&b, 0);
+	CHECK(c && c->source == BSV_SRC_OVERCURRENT);
+	CHECK(c && c->pre == 11 && c->count == 51);
+	CHECK(c && c->peak == 3500);
+
+	// a slow ramp crosses the trigger and ends in a reported short: the capture belongs to the short
+	CHECK(feed(&b, 200, BASE_LOAD, BASE_LOAD) == 0);
+	CHECK(feed(&b, 60, 2000, 4000) == 0);				// crosses 3000 mA after 31 ms
+	CHECK(bsv_short(&b, now, BSV_SRC_MAERKLIN) == -1);
+	CHECK(feed(&b, 100, 0, 0) == 1);
+	c = bsv_getCapture(&b, 0);
+	CHECK(c && c->seq == 2 && c->source == BSV_SRC_MAERKLIN);
+	CHECK(c && c->pre == 50 && c->count == 90);
+	CHECK(c && c->samples[49] > 3000 && c->samples[48] <= 3000);
+	CHECK(b.stats.longest == 29);
+	CHECK(b.stats.overcurrent == 5 + 29);
+	CHECK(b.stats.shorts[BSV_SRC_MAERKLIN] == 1 && b.stats.shorts[BSV_SRC_OVERCURRENT] == 0);
+}
+
+static void testCaptureRing (void)
+{
+	struct bsv_config cnf;
+	struct bsv b;
+	const struct bsv_capture *c;
+	int i;
+
+	bsv_defaults(&cnf);
+	cnf.pre = 5;
+	cnf.post = 5;
+	bsv_init(&b, &cnf);
+	now = 0;
+
+	for (i = 0; i < BSV_CAPTURES + 2; i++) {
+		feed(&b, 50, BASE_LOAD, BASE_LOAD);
+		bsv_short(&b, now, BSV_SRC_DCC);
+		CHECK(feed(&b, 5, 1000 + i, 1000 + i) == 1);
+	}
+	for (i = 0; i < BSV_CAPTURES; i++) {
+		c = bsv_getCapture(&b, i);
+		CHECK(c && c->seq == (uint32_t) (BSV_CAPTURES + 2 - i));
+		CHECK(c && c->peak == 1000 + BSV_CAPTURES + 1 - i);
+	}
+	CHECK(bsv_getCapture(&b, BSV_CAPTURES) == NULL);
+
+	// while a capture is recorded, the slot of the oldest one is not visible
+	feed(&b, 50, BASE_LOAD, BASE_LOAD);
+	bsv_short(&b, now, BSV_SRC_DCC);
+	CHECK(bsv_getCapture(&b, 0)->seq == BSV_CAPTURES + 2);
+	CHECK(bsv_getCapture(&b, BSV_CAPTURES - 1) == NULL);
+	feed(&b, 5, 0, 0);
+	CHECK(bsv_getCapture(&b, 0)->seq == BSV_CAPTURES + 3);
+
+	// the history ring wraps many times without disturbing the captures
+	feed(&b, 10 * BSV_RINGSIZE + 3, BASE_LOAD, BASE_LOAD);
+	bsv_short(&b, now, BSV_SRC_SUPPLY);
+	feed(&b, 5, 0, 0);
+	c = bsv_getCapture(&b, 0);
+	CHECK(c && c->source == BSV_SRC_SUPPLY);
+	for (i = 0; c && i < 5; i++) CHECK(c->samples[i] == BASE_LOAD);
+}
+
+static void testRestart (void)
+{
+	struct bsv_config cnf;
+	struct bsv b;
+
+	bsv_defaults(&cnf);
+	cnf.restart = BSV_RESTART_AUTO;
+	cnf.retries = 4;
+	cnf.delay = 1000;
+	cnf.maxdelay = 5000;
+	cnf.stable = 30000;
+	bsv_init(&b, &cnf);
+	now = 10000;
+
+	// a permanent short: 1s, 2s, 4s, 5s (limited) and then give up
+	CHECK(bsv_short(&b, now, BSV_SRC_INTERNAL) == 1000);
+	now += 1000; bsv_restarted(&b);
+	CHECK(bsv_short(&b, now, BSV_SRC_INTERNAL) == 2000);
+	now += 2000; bsv_restarted(&b);
+	CHECK(bsv_short(&b, now, BSV_SRC_INTERNAL) == 4000);
+	now += 4000; bsv_restarted(&b);
+	CHECK(bsv_short(&b, now, BSV_SRC_INTERNAL) == 5000);
+	now += 5000; bsv_restarted(&b);
+	CHECK(bsv_short(&b, now, BSV_SRC_INTERNAL) == -1);
+	CHECK(b.stats.giveups == 1 && b.stats.restarts == 4);
+
+	// after the manual restart, a new series begins
+	now += 60000;
+	CHECK(bsv_short(&b, now, BSV_SRC_INTERNAL) == 1000);
+	now += 1000;
+	CHECK(bsv_short(&b, now, BSV_SRC_INTERNAL) == 2000);
+
+	// a stable period resets the retries
+	now += 30000;
+	CHECK(bsv_short(&b, now, BSV_SRC_INTERNAL) == 1000);
+	CHECK(b.stats.shorts[BSV_SRC_INTERNAL] == 8);
+	CHECK(b.stats.first == 10000 && b.stats.last == now);
+
+	bsv_clearStats(&b);
+	CHECK(b.stats.shorts[BSV_SRC_INTERNAL] == 0 && b.stats.giveups == 0);
+}
+
+int main (void)
+{
+	testShortCapture();
+	testOvercurrent();
+	testCaptureRing();
+	testRestart();
+	return check_result("bstsupervisor_test");
+}
@@ -0,0 +1,59 @@
+/*
+ * check.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief A minimal check framework for the host tests
+ *
+ * Each test program includes this header, uses CHECK() for its assertions
+ * and ends main() with "return check_result();". A failed check is reported
+ * with its location but does not stop the test, so one run shows all
+ * failures.
+ */
+
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+#include <stdio.h>
+
+static int check_failures;
+static int check_count;
+
+#define CHECK(cond)		do { \
+		check_count++; \
+		if (!(cond)) { \
+			fprintf (stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			check_failures++; \
+		} \
+	} while (0)
+
+static inline int check_result (const char *name)
+{
+	printf ("%s: %d checks, %d failed\n", name, check_count, check_failures);
+	return (check_failures) ? 1 : 0;
+}
+
+#endif /* __CHECK_H__ */
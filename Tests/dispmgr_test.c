@@ -0,0 +1,219 @@
+/*
+ * dispmgr_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief Host simulation of the seven-segment display manager (dispmgr.c)
+ *
+ * The layers are driven the same way seven_segment.c does (status changes,
+ * alerts, the pairing request, the service menu) and the display is rendered
+ * with dm_toAscii() at each step. The rendered text is compared with the
+ * rendering of the expected two characters. With "-v" on the command line,
+ * each step is printed so the display can be watched in the terminal.
+ */
+
+#include <string.h>
+#include "dispmgr.h"
+#include "check.h"
+
+#define ASCII_SIZE		(3 * (4 * DM_DIGITS + 1) + 1)
+
+static struct dispmgr dm;
+static uint32_t now;
+static bool verbose;
+
+/*
+ * The same layer handling as in seven_segment.c
+ */
+static void sim_status (const char *text)
+{
+	if (text) dm_setText(&dm, DM_LAYER_STATUS, text, 0, 0, now);
+	else dm_clear(&dm, DM_LAYER_STATUS);
+	dm_clear(&dm, DM_LAYER_ALERT);
+}
+
+static void sim_pairing (bool on)
+{
+	if (on) dm_setText(&dm, DM_LAYER_PAIRING, "PA", 600, 0, now);
+	else dm_clear(&dm, DM_LAYER_PAIRING);
+}
+
+/**
+ * Render the display and compare it with the expected text.
+ *
+ * \param step		a description of the step for the verbose output
+ * \param expect	the two characters that should be visible (blanks for a dark display)
+ * \return			true if the display shows the expected text
+ */
+static bool shows (const char *step, const char *expect)
+{
+	uint8_t seg[DM_DIGITS], want[DM_MAXTEXT];
+	char have[ASCII_SIZE], should[ASCII_SIZE];
+	int n;
+
+	dm_render(&dm, now, seg);
+	memset (want, 0, sizeof(want));
+	n = dm_encode(expect, want, DM_MAXTEXT);
+	if (n != DM_DIGITS) return false;
+	if (dm_toAscii(seg, DM_DIGITS, have, sizeof(have)) < 0) return false;
+	if (dm_toAscii(want, DM_DIGITS, should, sizeof(should)) < 0) return false;
+	if (verbose) printf ("%6lu ms: %s\n%s", (unsigned long) now, step, have);
+	return !strcmp(have, should);
+}
+
+static void testAscii (void)
+{
+	uint8_t seg[DM_DIGITS];
+	char buf[ASCII_SIZE];
+
+	CHECK(dm_encode("2.5", seg, DM_DIGITS) == 2);
+	CHECK(dm_toAscii(seg, DM_DIGITS, buf, sizeof(buf)) == ASCII_SIZE - 1);
+	CHECK(!strcmp(buf,
+		" _   _  \n"
+		" _| |_  \n"
+		"|_ . _| \n"));
+	CHECK(dm_toAscii(seg, DM_DIGITS, buf, ASCII_SIZE - 1) == -1);
+}
+
+static void testLayers (void)
+{
+	dm_init(&dm);
+	now = 5000;
+
+	dm_setDecimal(&dm, DM_LAYER_IDLE, 12, true, 0, now);
+	CHECK(shows("current 1.2A", "1.2"));
+	sim_status("St.");
+	CHECK(shows("STOP", "St."));
+	sim_status(NULL);
+	dm_setText(&dm, DM_LAYER_OVERLAY, "Go", 0, 1000, now);
+	CHECK(shows("GO", "Go"));
+	now += 999;
+	CHECK(shows("GO still shown", "Go"));
+	now += 1;
+	CHECK(shows("GO timed out", "1.2"));
+	CHECK(!dm_isActive(&dm, DM_LAYER_OVERLAY));
+
+	dm_setText(&dm, DM_LAYER_ALERT, "SH", 0, 0, now);
+	CHECK(shows("SHORT", "SH"));
+	dm_setDecimal(&dm, DM_LAYER_IDLE, 3, true, 0, now);
+	CHECK(shows("current update hidden", "SH"));
+	sim_status("St.");
+	CHECK(shows("STOP ends the alert", "St."));
+}
+
+static void testPairing (void)
+{
+	dm_init(&dm);
+	now = 0;
+	dm_setDecimal(&dm, DM_LAYER_IDLE, 5, true, 0, now);
+
+	sim_pairing(true);
+	CHECK(shows("pairing request", "PA"));
+	now += 300;
+	CHECK(shows("pairing blinks (dark phase)", "  "));
+	now += 300;
+	CHECK(shows("pairing blinks (bright phase)", "PA"));
+
+	// a status change during pairing must not remove the request
+	sim_status("St.");
+	CHECK(shows("STOP during pairing", "PA"));
+
+	// a short is shown on top of the pairing request and survives its end
+	dm_setText(&dm, DM_LAYER_ALERT, "SH", 0, 0, now);
+	CHECK(shows("SHORT during pairing", "SH"));
+	sim_pairing(false);
+	CHECK(shows("pairing ends, SHORT stays", "SH"));
+	CHECK(dm_isActive(&dm, DM_LAYER_ALERT));
+	sim_status("St.");
+	CHECK(shows("STOP acknowledges the SHORT", "St."));
+
+	// a short that ends while pairing is still pending uncovers the request again
+	sim_pairing(true);
+	dm_setText(&dm, DM_LAYER_ALERT, "SH", 0, 0, now);
+	sim_status("St.");
+	CHECK(shows("pairing visible again", "PA"));
+	sim_pairing(false);
+	CHECK(shows("pairing done", "St."));
+}
+
+static void testScrollAndMenu (void)
+{
+	struct dm_menu menu;
+	uint32_t next;
+	uint8_t seg[DM_DIGITS];
+
+	dm_init(&dm);
+	now = 100;
+	dm_setText(&dm, DM_LAYER_OVERLAY, "192", 0, 0, now);
+	CHECK(shows("scroll 1", "19"));
+	next = dm_render(&dm, now, seg);
+	CHECK(next == DM_SCROLLSTEP);
+	now += next;
+	CHECK(shows("scroll 2", "92"));
+	now += DM_SCROLLSTEP;
+	CHECK(shows("scroll 3", "2 "));
+	now += DM_SCROLLSTEP;
+	CHECK(shows("scroll 4", "  "));
+	now += DM_SCROLLSTEP;
+	CHECK(shows("scroll restarts", "19"));
+	dm_clear(&dm, DM_LAYER_OVERLAY);
+	CHECK(dm_render(&dm, now, seg) == DM_FOREVER);
+
+	dm_menuEnter(&menu, now);
+	dm_setText(&dm, DM_LAYER_MENU, dm_menuLabel(&menu), 0, 0, now);
+	CHECK(shows("menu", "IP"));
+	dm_menuKey(&menu, DM_KEY_NEXT, now);
+	dm_menuKey(&menu, DM_KEY_NEXT, now);
+	dm_menuKey(&menu, DM_KEY_NEXT, now);
+	dm_setText(&dm, DM_LAYER_MENU, dm_menuLabel(&menu), 0, 0, now);
+	CHECK(shows("menu IP reset", "rS"));
+	CHECK(dm_menuKey(&menu, DM_KEY_SELECT, now) == DM_ACT_NONE);
+	dm_setText(&dm, DM_LAYER_MENU, dm_menuLabel(&menu), 0, 0, now);
+	CHECK(shows("menu confirm", "r?"));
+
+	// a pairing request during the menu takes precedence
+	sim_pairing(true);
+	CHECK(shows("pairing over menu", "PA"));
+	sim_pairing(false);
+	CHECK(shows("back to the menu", "r?"));
+
+	CHECK(!dm_menuTimeout(&menu, now + DM_MENU_TIMEOUT - 1));
+	CHECK(dm_menuTimeout(&menu, now + DM_MENU_TIMEOUT));
+	dm_clear(&dm, DM_LAYER_MENU);
+	CHECK(shows("menu left", "  "));
+}
+
+int main (int argc, char *argv[])
+{
+	verbose = (argc > 1 && !strcmp(argv[1], "-v"));
+
+	testAscii();
+	testLayers();
+	testPairing();
+	testScrollAndMenu();
+	return check_result("dispmgr_test");
+}
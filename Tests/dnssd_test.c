@@ -0,0 +1,387 @@
+/*
+ * dnssd_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief The registration logic of the DNS-SD services (dnssd.c)
+ *
+ * The plans are executed against a simulated mDNS responder the same way
+ * zeroconf.c does it. After each step, the responder must advertise exactly
+ * the services that have a port, under the current names and with the
+ * current ports. Registrations that fail in the responder, name conflicts
+ * and random sequences of configuration changes are checked, too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dnssd.h"
+#include "check.h"
+
+#define SLOTS		8						///< the number of service slots of the simulated responder
+
+static struct {
+	bool		used;
+	enum dnssd_svc svc;
+	char		instance[DNSSD_NAMELEN];
+	uint16_t	port;
+} slots[SLOTS];
+static char hostname[DNSSD_NAMELEN];
+static bool hostadded;
+static int renames;
+static int registrations;
+static uint8_t failmask;					///< registrations of these services fail in the responder
+
+static int resp_add (const char *instance, enum dnssd_svc svc, uint16_t port)
+{
+	int i;
+
+	if (failmask & (1 << svc)) return -1;
+	for (i = 0; i < SLOTS; i++) {
+		if (slots[i].used) continue;
+		slots[i].used = true;
+		slots[i].svc = svc;
+		slots[i].port = port;
+		strcpy (slots[i].instance, instance);
+		registrations++;
+		return i;
+	}
+	return -1;
+}
+
+static bool resp_del (int slot)
+{
+	if (slot < 0 || slot >= SLOTS || !slots[slot].used) return false;
+	slots[slot].used = false;
+	return true;
+}
+
+static void reset (struct dnssd_state *s)
+{
+	memset (slots, 0, sizeof(slots));
+	memset (hostname, 0, sizeof(hostname));
+	hostadded = false;
+	renames = registrations = 0;
+	failmask = 0;
+	dnssd_init(s);
+}
+
+static void config (struct dnssd_config *c, const char *name)
+{
+	memset (c, 0, sizeof(*c));
+	snprintf (c->name, sizeof(c->name), "%s", name);
+	c->serial = 12345;
+	c->firmware = "1.2.3";
+	c->port[DNSSD_HTTP] = 80;
+	c->port[DNSSD_FTP] = 21;
+	c->port[DNSSD_Z21] = 21105;
+	c->port[DNSSD_P50X] = 0;
+	c->port[DNSSD_BIDIB] = 62875;
+}
+
+/**
+ * Publish a configuration like zc_apply() does it.
+ *
+ * \param s			the published state
+ * \param c			the configuration
+ * \param p			where to store the plan (may be NULL)
+ * \return			the result of dnssd_plan()
+ */
+static bool apply (struct dnssd_state *s, const struct dnssd_config *c, struct dnssd_plan *p)
+{
+	struct dnssd_plan plan;
+	bool changed;
+	int i;
+
+	if (!p) p = &plan;
+	if (!(changed = dnssd_plan(s, c, p))) return false;
+
+	for (i = 0; i < DNSSD_SERVICES; i++) {
+		if (!(p->del & (1 << i))) continue;
+		CHECK(resp_del(s->slot[i]));
+		s->slot[i] = -1;
+	}
+	if (p->rename) {
+		if (hostadded) renames++;
+		hostadded = true;
+		strcpy (hostname, s->host);
+	}
+	for (i = 0; i < DNSSD_SERVICES; i++) {
+		if (!(p->add & (1 << i))) continue;
+		CHECK(s->slot[i] < 0);				// a service is never registered twice
+		s->slot[i] = resp_add(s->instance, i, s->cfg.port[i]);
+	}
+	return changed;
+}
+
+/**
+ * Check that the responder advertises exactly what the configuration says.
+ * Only a service whose registration fails in the responder may be missing.
+ *
+ * \param s			the published state
+ * \param c			the configuration
+ * \return			true, if the responder matches the configuration
+ */
+static bool published (const struct dnssd_state *s, const struct dnssd_config *c)
+{
+	int i, n, count;
+
+	if (!hostadded || strcmp(hostname, s->host)) return false;
+	for (i = count = 0; i < SLOTS; i++) {
+		if (!slots[i].used) continue;
+		count++;
+		if (s->slot[slots[i].svc] != i) return false;
+		if (slots[i].port != c->port[slots[i].svc]) return false;
+		if (strcmp(slots[i].instance, s->instance)) return false;
+	}
+	for (i = n = 0; i < DNSSD_SERVICES; i++) {
+		if (s->slot[i] >= 0) n++;
+		if (!c->port[i] && s->slot[i] >= 0) return false;
+		if (c->port[i] && s->slot[i] < 0 && !(failmask & (1 << i))) return false;
+	}
+	return count == n;
+}
+
+static void testNames (void)
+{
+	struct dnssd_config c;
+	char host[DNSSD_NAMELEN], instance[DNSSD_NAMELEN];
+	char longname[DNSSD_NAMELEN];
+
+	config(&c, "");
+	dnssd_names(&c, 0, host, instance);
+	CHECK(!strcmp(host, "mc2") && !strcmp(instance, "mc2 12345"));
+	config(&c, DNSSD_DEFNAME);
+	dnssd_names(&c, 0, host, instance);
+	CHECK(!strcmp(instance, "mc2 12345"));
+
+	config(&c, "Layout");
+	dnssd_names(&c, 0, host, instance);
+	CHECK(!strcmp(host, "mc2") && !strcmp(instance, "Layout"));
+	dnssd_names(&c, 1, host, instance);
+	CHECK(!strcmp(host, "mc2-2") && !strcmp(instance, "Layout (2)"));
+	dnssd_names(&c, DNSSD_MAXCONFLICTS, host, instance);
+	CHECK(!strcmp(host, "mc2-17") && !strcmp(instance, "Layout (17)"));
+
+	// a long name is cut so the suffix still fits into a DNS label
+	memset (longname, 'x', sizeof(longname) - 1);
+	longname[sizeof(longname) - 1] = 0;
+	config(&c, longname);
+	dnssd_names(&c, 0, host, instance);
+	CHECK(strlen(instance) == DNSSD_NAMELEN - 1);
+	dnssd_names(&c, 3, host, instance);
+	CHECK(strlen(instance) < DNSSD_NAMELEN && !strcmp(instance + strlen(instance) - 4, " (4)"));
+}
+
+static void testServices (void)
+{
+	struct dnssd_config c;
+	char buf[32];
+	bool udp;
+
+	CHECK(!strcmp(dnssd_service(DNSSD_HTTP, &udp), "_http") && !udp);
+	CHECK(!strcmp(dnssd_service(DNSSD_Z21, &udp), "_z21") && udp);
+	CHECK(!strcmp(dnssd_service(DNSSD_BIDIB, NULL), "_bidib"));
+	CHECK(dnssd_service(DNSSD_SERVICES, &udp) == NULL);
+	CHECK(dnssd_service((enum dnssd_svc) -1, &udp) == NULL);
+
+	config(&c, "Layout");
+	CHECK(dnssd_txt(&c, DNSSD_HTTP, 0, buf, sizeof(buf)) == 12 && !strcmp(buf, "serial=12345"));
+	CHECK(dnssd_txt(&c, DNSSD_HTTP, 1, buf, sizeof(buf)) == 8 && !strcmp(buf, "fw=1.2.3"));
+	CHECK(dnssd_txt(&c, DNSSD_HTTP, 2, buf, sizeof(buf)) == 6 && !strcmp(buf, "path=/"));
+	CHECK(dnssd_txt(&c, DNSSD_HTTP, 3, buf, sizeof(buf)) == 0);
+	CHECK(dnssd_txt(&c, DNSSD_FTP, 2, buf, sizeof(buf)) == 0);
+	c.firmware = NULL;
+	CHECK(dnssd_txt(&c, DNSSD_Z21, 1, buf, sizeof(buf)) == 3 && !strcmp(buf, "fw="));
+	CHECK(dnssd_txt(&c, DNSSD_Z21, 0, buf, 6) == 5 && !strcmp(buf, "seria"));	// cut to the buffer
+}
+
+static void testPlan (void)
+{
+	struct dnssd_state s;
+	struct dnssd_config c;
+	struct dnssd_plan p;
+	int n;
+
+	reset(&s);
+	CHECK(!dnssd_plan(NULL, &c, &p) && !dnssd_plan(&s, NULL, &p) && !dnssd_plan(&s, &c, NULL));
+
+	// the first plan registers the host and all services with a port
+	config(&c, "Layout");
+	CHECK(apply(&s, &c, &p));
+	CHECK(p.rename && p.del == 0);
+	CHECK(p.add == ((1 << DNSSD_HTTP) | (1 << DNSSD_FTP) | (1 << DNSSD_Z21) | (1 << DNSSD_BIDIB)));
+	CHECK(published(&s, &c) && registrations == 4);
+
+	// nothing changed
+	CHECK(!apply(&s, &c, &p) && p.del == 0 && p.add == 0 && !p.rename);
+
+	// a new port only touches this service
+	c.port[DNSSD_BIDIB] = 62876;
+	CHECK(apply(&s, &c, &p));
+	CHECK(!p.rename && p.del == (1 << DNSSD_BIDIB) && p.add == (1 << DNSSD_BIDIB));
+	CHECK(published(&s, &c));
+
+	// switching a service on and off
+	c.port[DNSSD_P50X] = 8050;
+	CHECK(apply(&s, &c, &p) && p.del == 0 && p.add == (1 << DNSSD_P50X));
+	CHECK(published(&s, &c));
+	c.port[DNSSD_FTP] = 0;
+	CHECK(apply(&s, &c, &p) && p.del == (1 << DNSSD_FTP) && p.add == 0);
+	CHECK(published(&s, &c) && s.slot[DNSSD_FTP] == -1);
+
+	// a new name of the station registers all services again, but keeps the host name
+	n = registrations;
+	snprintf (c.name, sizeof(c.name), "Attic");
+	CHECK(apply(&s, &c, &p) && !p.rename && p.del == p.add && p.add == 0x1D);
+	CHECK(published(&s, &c) && !strcmp(s.instance, "Attic") && registrations == n + 4 && renames == 0);
+
+	// so does a change of the TXT records
+	c.firmware = "1.2.4";
+	CHECK(apply(&s, &c, &p) && p.del == p.add && p.add == 0x1D);
+	CHECK(published(&s, &c));
+	c.serial = 4711;
+	snprintf (c.name, sizeof(c.name), "%s", DNSSD_DEFNAME);
+	CHECK(apply(&s, &c, &p) && p.add == 0x1D && !strcmp(s.instance, "mc2 4711"));
+	CHECK(published(&s, &c));
+
+	// all services off and on again
+	memset (c.port, 0, sizeof(c.port));
+	CHECK(apply(&s, &c, &p) && p.del == 0x1D && p.add == 0);
+	CHECK(published(&s, &c));
+	CHECK(!apply(&s, &c, &p));
+	c.port[DNSSD_HTTP] = 8080;
+	CHECK(apply(&s, &c, &p) && p.del == 0 && p.add == (1 << DNSSD_HTTP));
+	CHECK(published(&s, &c));
+}
+
+static void testFailedRegistration (void)
+{
+	struct dnssd_state s;
+	struct dnssd_config c;
+	struct dnssd_plan p;
+
+	reset(&s);
+	config(&c, "Layout");
+	failmask = 1 << DNSSD_Z21;
+	CHECK(apply(&s, &c, &p) && (p.add & (1 << DNSSD_Z21)));
+	CHECK(s.slot[DNSSD_Z21] == -1 && published(&s, &c));
+
+	// the next update retries the registration of the failed service only
+	CHECK(apply(&s, &c, &p) && p.del == 0 && p.add == (1 << DNSSD_Z21));
+	failmask = 0;
+	CHECK(apply(&s, &c, &p) && p.add == (1 << DNSSD_Z21));
+	CHECK(s.slot[DNSSD_Z21] >= 0 && published(&s, &c));
+	CHECK(!apply(&s, &c, &p));
+}
+
+static void testConflicts (void)
+{
+	struct dnssd_state s;
+	struct dnssd_config c;
+	struct dnssd_plan p;
+	int i;
+
+	reset(&s);
+	config(&c, "Layout");
+	CHECK(apply(&s, &c, &p) && published(&s, &c));
+
+	// each conflict gives new names and registers everything again
+	for (i = 1; i <= DNSSD_MAXCONFLICTS; i++) {
+		CHECK(dnssd_conflict(&s) && s.conflicts == i);
+		CHECK(apply(&s, &c, &p) && p.rename && p.del == p.add && p.add == 0x17);
+		CHECK(published(&s, &c) && renames == i);
+	}
+	CHECK(!strcmp(hostname, "mc2-17") && !strcmp(s.instance, "Layout (17)"));
+
+	// then we give up and keep the last names
+	CHECK(!dnssd_conflict(&s) && s.conflicts == DNSSD_MAXCONFLICTS);
+	CHECK(!apply(&s, &c, &p));
+	CHECK(!dnssd_conflict(NULL));
+
+	// a new start forgets the conflicts
+	reset(&s);
+	CHECK(apply(&s, &c, &p) && p.rename && !strcmp(hostname, "mc2") && renames == 0);
+}
+
+/**
+ * Random sequences of configuration changes, failing registrations and
+ * name conflicts. The responder must always match the configuration and
+ * must never run out of slots (which would mean a service was leaked).
+ */
+static void testRandom (void)
+{
+	static const char *names[] = { "", DNSSD_DEFNAME, "Layout", "Attic", "Shed" };
+	static const char *firmware[] = { "1.2.3", "1.2.4", NULL };
+	struct dnssd_state s;
+	struct dnssd_config c;
+	int run, step, i;
+
+	srand (98);
+	for (run = 0; run < 200; run++) {
+		reset(&s);
+		config(&c, "Layout");
+		for (step = 0; step < 100; step++) {
+			switch (rand() % 6) {
+				case 0:
+					snprintf (c.name, sizeof(c.name), "%s", names[rand() % 5]);
+					break;
+				case 1:
+					c.firmware = firmware[rand() % 3];
+					break;
+				case 2:
+					c.serial = rand() % 3;
+					break;
+				case 3:
+					failmask = (rand() % 4 == 0) ? 1 << (rand() % DNSSD_SERVICES) : 0;
+					break;
+				case 4:
+					dnssd_conflict(&s);
+					break;
+				default:
+					i = rand() % DNSSD_SERVICES;
+					c.port[i] = (rand() % 3) ? 1000 + rand() % 3 : 0;
+					break;
+			}
+			apply(&s, &c, NULL);
+			CHECK(published(&s, &c));
+			CHECK(!apply(&s, &c, NULL) || failmask);		// stable unless a registration keeps failing
+			CHECK(published(&s, &c));
+		}
+	}
+}
+
+int main (int argc, char **argv)
+{
+	testNames();
+	testServices();
+	testPlan();
+	testFailedRegistration();
+	testConflicts();
+	testRandom();
+	return check_result("dnssd_test");
+}
@@ -0,0 +1,336 @@
+/*
+ * enboot_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief The EasyNet boot image, the block generator and the update session (enboot.c)
+ *
+ * The flat image replaced a sorted list of 64 byte chunks in easynet.c. The
+ * list implementation (image builder, bit-serial CRC and block generator) is
+ * kept here as the reference. Random images are built with both and every
+ * block the boot loader of a unit can request is compared: data, start
+ * address or end marker, CRC and the progress count.
+ *
+ * The update session is checked with simulated units that come back with
+ * the new firmware, with their old firmware or not at all.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "enboot.h"
+#include "check.h"
+
+#define TINYSIZE			64
+#define SMALLSIZE			128
+#define BIGSIZE				256
+
+/*
+ * ==================================================================================================
+ * The reference: the chunk list of easynet.c before the flat image
+ * ==================================================================================================
+ */
+#define CHUNKSIZE			64
+#define BOOTCRC_POLYNOM		0xA001
+
+struct chunk {
+   struct chunk		*next;
+   uint32_t			 adr;
+   uint8_t			 mem[CHUNKSIZE];
+};
+
+static void oldFreeChunks (struct chunk *ch)
+{
+	struct chunk *tmp;
+
+	while ((tmp = ch) != NULL) {
+		ch = ch->next;
+		free (tmp);
+	}
+}
+
+static int oldCountBlocks (struct chunk *ch)
+{
+	int cnt;
+
+	for (cnt = 0; ch; ch = ch->next) cnt++;
+	return cnt;
+}
+
+static int oldAddData (struct chunk **chpp, uint32_t adr, const uint8_t *data, int len)
+{
+	struct chunk *ch;
+	int i, j;
+
+	if (!chpp || !data || len <= 0) return 0;
+
+	while ((ch = *chpp) != NULL && ch->adr + CHUNKSIZE <= adr) chpp = &ch->next;
+	if (!ch || ch->adr > adr) {
+		if ((ch = malloc (sizeof(*ch))) == NULL) return -1;
+		memset (ch->mem, 0xFF, sizeof(ch->mem));
+		ch->adr = (adr / CHUNKSIZE) * CHUNKSIZE;
+		ch->next = *chpp;
+		*chpp = ch;
+	}
+
+	for (i = adr - ch->adr, j = 0; i < CHUNKSIZE && j < len; i++, j++) ch->mem[i] = data[j];
+	if (j < len) return oldAddData (chpp, adr + j, &data[j], len - j);
+	return 0;
+}
+
+static uint16_t oldCRC (uint16_t crc, const uint8_t *p, int len)
+{
+	int i;
+
+	while (len > 0) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++) {
+			if (crc & 1) crc = (crc >> 1) ^ BOOTCRC_POLYNOM;
+			else crc >>= 1;
+		}
+		len--;
+	}
+	return crc;
+}
+
+/*
+ * The blocks as they are sent on the bus (the start address is 16 bits for
+ * 64 and 128 byte blocks and 32 bits for 256 byte blocks, little endian).
+ */
+struct block {
+	uint32_t		start;
+	uint8_t			mem[BIGSIZE];
+	uint16_t		crc16;
+	int				current;
+};
+
+static int startLen (int size)
+{
+	return (size == BIGSIZE) ? 4 : 2;
+}
+
+static uint16_t blockCRC (uint16_t (*crc)(uint16_t, const uint8_t *, int), const struct block *b, int size)
+{
+	uint8_t start[4];
+	uint16_t c;
+
+	start[0] = b->start & 0xFF;
+	start[1] = (b->start >> 8) & 0xFF;
+	start[2] = (b->start >> 16) & 0xFF;
+	start[3] = (b->start >> 24) & 0xFF;
+	c = crc(0xFFFF, start, startLen(size));
+	return crc(c, b->mem, size);
+}
+
+static void oldGetBlock (struct chunk *ch, struct block *b, uint32_t adr, int size)
+{
+	adr = (adr / size) * size;
+	b->current = 0;
+	while (ch && ch->adr < adr) {
+		b->current++;
+		ch = ch->next;
+	}
+	b->start = adr;
+	if (size != BIGSIZE) b->start &= 0xFFFF;
+	if (!ch) b->start = (size == BIGSIZE) ? 0xFFFFFFFF : 0xFFFF;
+	memset (b->mem, 0xFF, size);
+	while (ch && ch->adr < (adr + size)) {
+		memcpy (b->mem + ch->adr - adr, ch->mem, CHUNKSIZE);
+		ch = ch->next;
+	}
+	b->crc16 = blockCRC(oldCRC, b, size);
+}
+
+/*
+ * ==================================================================================================
+ * The new block generator as used in en_bootGetBlock()
+ * ==================================================================================================
+ */
+static void newGetBlock (struct enb_image *img, struct block *b, uint32_t adr, int size)
+{
+	bool data;
+
+	adr = (adr / size) * size;
+	data = enb_getBlock(img, adr, size, b->mem, &b->current);
+	if (data) b->start = (size == BIGSIZE) ? adr : (uint16_t) adr;
+	else b->start = (size == BIGSIZE) ? 0xFFFFFFFF : 0xFFFF;
+	b->crc16 = blockCRC(enb_crc16, b, size);
+}
+
+/*
+ * ==================================================================================================
+ * The tests
+ * ==================================================================================================
+ */
+static void testCRC (void)
+{
+	uint8_t buf[300];
+	int i;
+
+	for (i = 0; i < (int) sizeof(buf); i++) buf[i] = rand();
+	CHECK(enb_crc16(ENB_CRCSTART, (const uint8_t *) "123456789", 9) == 0x4B37);		// CRC-16/MODBUS check value
+	CHECK(enb_crc16(ENB_CRCSTART, buf, sizeof(buf)) == oldCRC(0xFFFF, buf, sizeof(buf)));
+	CHECK(enb_crc16(enb_crc16(ENB_CRCSTART, buf, 100), &buf[100], 200) == oldCRC(0xFFFF, buf, sizeof(buf)));
+}
+
+/**
+ * Build an image from random HEX records with both implementations and
+ * compare every block. The records are mostly ascending with gaps (like a
+ * HEX file with several sections) and may also jump back.
+ *
+ * \param records	the number of HEX records
+ * \param origin	the address of the first record
+ * \return			true, if all blocks are equal
+ */
+static bool compareImage (int records, uint32_t origin)
+{
+	static const int sizes[] = { TINYSIZE, SMALLSIZE, BIGSIZE };
+	struct chunk *chunks = NULL;
+	struct enb_image img;
+	struct block bo, bn;
+	uint8_t data[32];
+	uint32_t adr, end;
+	int i, j, len, s, cnt;
+	bool ok = true;
+
+	enb_init(&img);
+	for (i = 0, adr = origin; i < records; i++) {
+		len = 1 + rand() % 32;
+		for (j = 0; j < len; j++) data[j] = rand();
+		if (rand() % 20 == 0) adr += rand() % 2000;						// a gap
+		if (rand() % 50 == 0) adr = origin + rand() % (adr - origin + 1);	// back to an earlier address
+		if (oldAddData(&chunks, adr, data, len) != 0 || enb_addData(&img, adr, data, len) != 0) return false;
+		adr += len;
+	}
+	cnt = enb_finish(&img);
+	if (cnt != oldCountBlocks(chunks)) {
+		fprintf (stderr, "%d chunks, expected %d\n", cnt, oldCountBlocks(chunks));
+		ok = false;
+	}
+
+	end = img.end + 2 * BIGSIZE;
+	for (s = 0; s < 3 && ok; s++) {
+		for (adr = 0; adr < end && ok; adr += sizes[s]) {
+			oldGetBlock(chunks, &bo, adr, sizes[s]);
+			newGetBlock(&img, &bn, adr, sizes[s]);
+			if (bo.start != bn.start || bo.crc16 != bn.crc16 || bo.current != bn.current || memcmp(bo.mem, bn.mem, sizes[s])) {
+				fprintf (stderr, "block 0x%05x / %d: start 0x%x / 0x%x, CRC 0x%04x / 0x%04x, progress %d / %d\n",
+						adr, sizes[s], bo.start, bn.start, bo.crc16, bn.crc16, bo.current, bn.current);
+				ok = false;
+			}
+		}
+	}
+	oldFreeChunks(chunks);
+	enb_free(&img);
+	return ok;
+}
+
+static void testImage (void)
+{
+	struct enb_image img;
+	struct block b;
+	int i;
+
+	enb_init(&img);
+	CHECK(enb_finish(&img) == 0);
+	newGetBlock(&img, &b, 0, TINYSIZE);
+	CHECK(b.start == 0xFFFF && b.current == 0);							// an empty image only has the end marker
+
+	CHECK(enb_addData(&img, 0, (uint8_t []) { 1 }, 1) == 0);
+	CHECK(enb_addData(&img, ENB_MAXIMAGE, (uint8_t []) { 2 }, 1) < 0);		// the image may not get too big
+	enb_free(&img);
+
+	for (i = 0; i < 20; i++) CHECK(compareImage(50 + rand() % 3000, (i & 1) ? 0 : (rand() % 0x8000) & ~0x0F));
+}
+
+/*
+ * A simulated update: the units of the session report their version after a pass.
+ */
+static void testSession (void)
+{
+	static const uint32_t serno[] = { 1001, 1002, 1003, 1004 };
+	static const uint32_t oldver[] = { 0x010203, 0x010203, 0x010100, 0x010203 };
+	struct enb_session s;
+
+	enb_sessionStart(&s, serno, oldver, 4);
+	CHECK(s.count == 4 && s.pass == 1 && s.version == 0);
+	CHECK(enb_sessionPending(&s, 1001) && !enb_sessionPending(&s, 999));
+
+	// pass 1: unit 1002 registers, but did not yet answer the version request,
+	// unit 1001 reports its old version first and then unit 1003 the new one
+	enb_sessionSeen(&s, 1002, 0);
+	enb_sessionSeen(&s, 1001, 0x010203);
+	CHECK(enb_sessionPending(&s, 1001) && enb_sessionPending(&s, 1002));
+	enb_sessionSeen(&s, 1003, 0x010300);
+	CHECK(s.version == 0x010300 && !enb_sessionPending(&s, 1003));
+	enb_sessionSeen(&s, 1002, 0x010300);
+	CHECK(!enb_sessionPending(&s, 1002));
+	enb_sessionSeen(&s, 1001, 0x010203);								// still the old firmware
+	CHECK(enb_sessionPending(&s, 1001));
+	enb_sessionSeen(&s, 4711, 0x010300);								// a unit that was not known before
+	CHECK(enb_sessionCount(&s, ENB_UNIT_DONE) == 2);
+
+	// pass 2 for 1001 (old firmware) and 1004 (did not come back)
+	CHECK(enb_sessionNextPass(&s));
+	CHECK(s.pass == 2 && s.unit[0].passes == 2 && s.unit[1].passes == 1 && s.unit[3].passes == 2);
+	enb_sessionSeen(&s, 1001, 0x010300);
+	CHECK(!enb_sessionPending(&s, 1001));
+
+	// pass 3 for 1004, then it is failed
+	CHECK(enb_sessionNextPass(&s));
+	CHECK(s.pass == 3 && s.unit[3].passes == 3);
+	CHECK(!enb_sessionNextPass(&s));
+	CHECK(s.unit[3].state == ENB_UNIT_FAILED && s.pass == 3);
+	CHECK(enb_sessionCount(&s, ENB_UNIT_DONE) == 3 && enb_sessionCount(&s, ENB_UNIT_FAILED) == 1);
+	CHECK(enb_sessionCount(&s, ENB_UNIT_PENDING) == 0);
+	enb_sessionSeen(&s, 1004, 0x010300);								// too late
+	CHECK(s.unit[3].state == ENB_UNIT_FAILED);
+
+	// the same firmware is loaded again: no unit changes its version
+	enb_sessionStart(&s, serno, oldver, 3);
+	enb_sessionSeen(&s, 1001, 0x010203);
+	enb_sessionSeen(&s, 1003, 0x010100);
+	CHECK(enb_sessionCount(&s, ENB_UNIT_DONE) == 0);
+	CHECK(enb_sessionNextPass(&s));										// 1002 did not come back
+	CHECK(enb_sessionCount(&s, ENB_UNIT_DONE) == 2 && enb_sessionPending(&s, 1002));
+	enb_sessionSeen(&s, 1002, 0x010203);
+	CHECK(!enb_sessionNextPass(&s));
+	CHECK(enb_sessionCount(&s, ENB_UNIT_DONE) == 3);
+
+	// without known units, only a single pass is done
+	enb_sessionStart(&s, serno, oldver, 0);
+	CHECK(!enb_sessionNextPass(&s) && s.pass == 1);
+}
+
+int main (int argc, char **argv)
+{
+	srand (4711);
+	testCRC();
+	testImage();
+	testSession();
+	return check_result("enboot_test");
+}
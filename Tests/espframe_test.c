@@ -0,0 +1,726 @@
+/*
+ * espframe_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief The framing and flow control of the serial link to the WLAN module (espframe.c)
+ *
+ * Besides the encoder and the decoder, a complete link is simulated: a peer
+ * (the module) sends frames over a line with 2 MBaud into a DMA ring buffer,
+ * which is read by the station with ef_ringReceive() like espnet.c does it.
+ * The DMA and its interrupt are simulated including a pending interrupt and
+ * the reload of NDTR. A slow reader must either pause the peer in time or
+ * detect that the DMA lapped its read position, skip the lost bytes and
+ * resynchronise - a frame glued together from both sides of a gap must never
+ * be delivered. The station sends pbuf-like chains with the padding word in
+ * front back to the module and must stop in time when the module pauses it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "espnet.h"
+#include "esp.h"
+#include "check.h"
+
+#define RING			4096						///< the receive ring of espnet.c
+#define BYTES_PER_MS	200							///< 2 MBaud with 8N1
+#define LINEBUF			(4 * EF_ENCODED_MAX)
+#define ETH_PAD			2							///< ETH_PAD_SIZE of lwIP
+
+static const uint8_t mac[6] = { 0x5C, 0xCF, 0x7F, 0x01, 0x02, 0x03 };
+
+static struct {
+	bool			accept;							///< the station takes the frames
+	int				frames;							///< the number of data frames delivered
+	int				bad;							///< delivered data frames with wrong contents
+	int				len;							///< the length of the last frame
+	uint32_t		seq;							///< the sequence number of the last frame
+	int				outOfOrder;						///< frames with a sequence number that is not higher than the last one
+	int				links;							///< calls of the link callback
+	bool			up;
+	uint8_t			mac[6];
+	char			text[EF_TEXTLEN + 8];
+	int				texts;
+} rx;
+
+static uint8_t pattern (uint32_t seq, int i)
+{
+	return (seq * 31 + i * 7) & 0xFF;				// has all values, so there are a lot of bytes to escape
+}
+
+/**
+ * Build an ethernet frame with a sequence number and contents that can be
+ * checked by the receiver (at least 18 bytes).
+ */
+static int mkframe (uint8_t *buf, uint32_t seq, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) buf[i] = pattern(seq, i);
+	buf[14] = seq;
+	buf[15] = seq >> 8;
+	buf[16] = seq >> 16;
+	buf[17] = seq >> 24;
+	return len;
+}
+
+static bool cb_frame (void *priv, const uint8_t *data, int len)
+{
+	uint32_t seq;
+	int i;
+
+	if (!rx.accept) return false;
+	if (len < 18) {
+		rx.bad++;
+		return true;
+	}
+	seq = data[14] | (data[15] << 8) | (data[16] << 16) | ((uint32_t) data[17] << 24);
+	for (i = 0; i < len; i++) {
+		if (i >= 14 && i < 18) continue;
+		if (data[i] != pattern(seq, i)) {
+			rx.bad++;
+			break;
+		}
+	}
+	if (rx.frames && seq <= rx.seq) rx.outOfOrder++;
+	rx.frames++;
+	rx.seq = seq;
+	rx.len = len;
+	return true;
+}
+
+static void cb_link (void *priv, bool up, const uint8_t *m)
+{
+	rx.links++;
+	rx.up = up;
+	memcpy (rx.mac, m, sizeof(rx.mac));
+}
+
+static void cb_text (void *priv, const char *line)
+{
+	rx.texts++;
+	snprintf (rx.text, sizeof(rx.text), "%s", line);
+}
+
+static const struct ef_ops ops = { cb_frame, cb_link, cb_text };
+
+static void reset (struct ef_link *l)
+{
+	memset (&rx, 0, sizeof(rx));
+	rx.accept = true;
+	ef_linkInit(l, &ops, NULL, RING);
+}
+
+static void input (struct ef_link *l, enum ef_type type, const uint8_t *data, int len, uint32_t now)
+{
+	uint8_t buf[EF_ENCODED_MAX];
+	int n;
+
+	n = ef_encode(buf, sizeof(buf), type, data, len);
+	CHECK(n > 0);
+	ef_input(l, buf, n, now);
+}
+
+static void link (struct ef_link *l, bool up, uint32_t now)
+{
+	uint8_t buf[7];
+
+	buf[0] = up;
+	memcpy (&buf[1], mac, 6);
+	input(l, EF_LINK, buf, sizeof(buf), now);
+}
+
+static void testEncode (void)
+{
+	static const uint8_t data[] = { 0x01, SLIP_BLOCK, 0x02, SLIP_ESCAPE, 0x03 };
+	static const int splits[][3] = { { 0, 0, 0 }, { 2, 0, 100 }, { 1, 1, 100 }, { 1, 0, 1 }, { 0, 1, 1 }, { 1, 2, 0 }, { 100, 0, 50 } };
+	uint8_t buf[EF_ENCODED_MAX + 16], frame[EF_MTU], buf2[EF_ENCODED_MAX], chain[ETH_PAD + EF_MTU];
+	struct ef_encoder e;
+	uint16_t crc;
+	int len, i, j, pos, skip;
+
+	CHECK(ef_crc(0xFFFF, (const uint8_t *) "123456789", 9) == 0x29B1);
+	CHECK(ef_crc(ef_crc(0xFFFF, (const uint8_t *) "1234", 4), (const uint8_t *) "56789", 5) == 0x29B1);
+
+	len = ef_encode(buf, sizeof(buf), EF_DATA, data, sizeof(data));
+	crc = ef_crc(0xFFFF, (const uint8_t *) "\x01", 1);
+	crc = ef_crc(crc, data, sizeof(data));
+	CHECK(len == 1 + 1 + 7 + 2 + 1 && (crc & 0xFF) != SLIP_BLOCK && (crc & 0xFF) != SLIP_ESCAPE);
+	CHECK(buf[0] == SLIP_BLOCK && buf[1] == EF_DATA && buf[len - 1] == SLIP_BLOCK);
+	CHECK(!memcmp(&buf[2], "\x01\xDB\xDC\x02\xDB\xDD\x03", 7));
+	CHECK(buf[9] == (crc & 0xFF) && buf[10] == (crc >> 8));
+
+	// the worst case fits into EF_ENCODED_MAX
+	memset (frame, SLIP_BLOCK, sizeof(frame));
+	CHECK(ef_encode(buf, EF_ENCODED_MAX, SLIP_ESCAPE, frame, EF_MTU) <= EF_ENCODED_MAX);
+	CHECK(ef_encode(buf, 100, EF_DATA, frame, EF_MTU) == -1);
+
+	// the incremental encoder gives the same result
+	for (i = 0; i < EF_MTU; i++) frame[i] = pattern(7, i);
+	len = ef_encode(buf, sizeof(buf), EF_DATA, frame, EF_MTU);
+	ef_encBegin(&e, buf2, sizeof(buf2), EF_DATA);
+	CHECK(ef_encData(&e, frame, 100) && ef_encData(&e, frame + 100, 0) && ef_encData(&e, frame + 100, EF_MTU - 100));
+	CHECK(ef_encEnd(&e) == len && !memcmp(buf, buf2, len));
+	ef_encBegin(&e, buf2, 50, EF_DATA);
+	CHECK(!ef_encData(&e, frame, 100) && ef_encEnd(&e) == -1);
+
+	// a chain with the padding word in front: the padding may be split and pieces may be empty
+	memset (chain, 0xEE, ETH_PAD);
+	memcpy (&chain[ETH_PAD], frame, EF_MTU);
+	for (i = 0; i < (int) (sizeof(splits) / sizeof(splits[0])); i++) {
+		ef_encBegin(&e, buf2, sizeof(buf2), EF_DATA);
+		skip = ETH_PAD;
+		for (pos = j = 0; j < 3; pos += splits[i][j++]) {
+			CHECK(ef_encDataSkip(&e, &chain[pos], splits[i][j], &skip));
+		}
+		CHECK(ef_encDataSkip(&e, &chain[pos], ETH_PAD + EF_MTU - pos, &skip) && skip == 0);
+		CHECK(ef_encEnd(&e) == len && !memcmp(buf, buf2, len));
+	}
+	ef_encBegin(&e, buf2, sizeof(buf2), EF_DATA);
+	skip = 0;
+	CHECK(ef_encDataSkip(&e, frame, EF_MTU, &skip) && skip == 0);
+	CHECK(ef_encEnd(&e) == len && !memcmp(buf, buf2, len));
+}
+
+static void testDecode (void)
+{
+	static uint8_t stream[200 * EF_ENCODED_MAX];
+	uint8_t frame[EF_MTU];
+	struct ef_link l;
+	int len, pos, n, i;
+
+	// random frames in random pieces
+	reset(&l);
+	srand (100);
+	for (i = len = 0; i < 200; i++) {
+		n = mkframe(frame, i, 18 + rand() % (EF_MTU - 17));
+		len += ef_encode(&stream[len], sizeof(stream) - len, EF_DATA, frame, n);
+	}
+	for (pos = 0; pos < len; pos += n) {
+		n = 1 + rand() % 700;
+		if (n > len - pos) n = len - pos;
+		ef_input(&l, &stream[pos], n, 10);
+	}
+	CHECK(rx.frames == 200 && rx.bad == 0 && rx.outOfOrder == 0);
+	CHECK(l.stats.rxFrames == 200 && l.stats.crcErrors == 0 && l.stats.overruns == 0);
+
+	// noise between frames
+	reset(&l);
+	ef_input(&l, (const uint8_t *) "\xC0\xC0\x12\xC0\x12\x34\xC0", 7, 10);
+	CHECK(l.stats.crcErrors == 2 && l.stats.rxFrames == 0);
+
+	// a wrong CRC, an invalid escape sequence and an escape before the end of a frame
+	mkframe(frame, 1, 60);
+	len = ef_encode(stream, sizeof(stream), EF_DATA, frame, 60);
+	stream[30] ^= 0x01;
+	ef_input(&l, stream, len, 10);
+	CHECK(l.stats.crcErrors == 3 && rx.frames == 0);
+	ef_input(&l, (const uint8_t *) "\xC0\x01\xDB\x01\x02\x03\xC0", 7, 10);
+	CHECK(l.stats.crcErrors == 4);
+	ef_input(&l, (const uint8_t *) "\xC0\x01\x02\x03\xDB\xC0", 6, 10);
+	CHECK(l.stats.crcErrors == 5);
+	input(&l, EF_DATA, frame, 60, 10);
+	CHECK(rx.frames == 1 && rx.len == 60 && rx.bad == 0);
+
+	// a frame that is too long
+	memset (stream, 0x55, EF_MAXFRAME + 10);
+	stream[0] = SLIP_BLOCK;
+	stream[EF_MAXFRAME + 9] = SLIP_BLOCK;
+	ef_input(&l, stream, EF_MAXFRAME + 10, 10);
+	CHECK(l.stats.overruns == 1 && l.stats.crcErrors == 5);
+
+	// frames that are too short and unknown frames are ignored
+	input(&l, EF_DATA, frame, 13, 10);
+	input(&l, 0x55, frame, 20, 10);
+	input(&l, EF_LINK, frame, 6, 10);
+	CHECK(l.stats.rxFrames == 4 && rx.frames == 1 && rx.links == 0);
+}
+
+static void testResync (void)
+{
+	uint8_t frame[EF_MTU], buf[EF_ENCODED_MAX];
+	struct ef_link l;
+	int len;
+
+	reset(&l);
+	mkframe(frame, 1, 200);
+	len = ef_encode(buf, sizeof(buf), EF_DATA, frame, 200);
+
+	// the first part of a frame, a gap and the second part of another one
+	ef_input(&l, buf, 100, 10);
+	ef_resync(&l);
+	ef_input(&l, buf + 150, len - 150, 10);
+	CHECK(l.stats.resyncs == 1 && l.stats.crcErrors == 0 && rx.frames == 0);
+	ef_input(&l, buf, len, 10);
+	CHECK(rx.frames == 1 && rx.seq == 1 && l.stats.crcErrors == 0);
+
+	// without the resync, the parts would make up a bad frame
+	ef_input(&l, buf, 100, 10);
+	ef_input(&l, buf + 150, len - 150, 10);
+	CHECK(l.stats.crcErrors == 1 && rx.frames == 1);
+
+	// a gap that ends right before the next frame loses nothing but the interrupted frame
+	ef_input(&l, buf, 100, 10);
+	ef_resync(&l);
+	ef_input(&l, buf, len, 10);
+	CHECK(rx.frames == 2 && l.stats.resyncs == 2 && l.stats.crcErrors == 1);
+
+	// and so does a gap between two frames
+	ef_resync(&l);
+	ef_input(&l, buf, len, 10);
+	CHECK(rx.frames == 3);
+}
+
+static void testLink (void)
+{
+	uint8_t buf[64];
+	struct ef_link l;
+	uint32_t now = 1000;
+
+	reset(&l);
+	CHECK(!ef_mayTransmit(&l));
+	link(&l, true, now);
+	CHECK(rx.links == 1 && rx.up && !memcmp(rx.mac, mac, 6) && l.alive && ef_mayTransmit(&l));
+	link(&l, true, now + 1000);
+	CHECK(rx.links == 1);
+
+	// the peer pauses us
+	buf[0] = EF_FLOW_PAUSE;
+	input(&l, EF_FLOW, buf, 1, now + 1100);
+	CHECK(!ef_mayTransmit(&l) && l.peerPaused);
+	buf[0] = EF_FLOW_RESUME;
+	input(&l, EF_FLOW, buf, 1, now + 1200);
+	CHECK(ef_mayTransmit(&l));
+
+	// the WLAN of the module goes down
+	link(&l, false, now + 1300);
+	CHECK(rx.links == 2 && !rx.up && l.alive && !ef_mayTransmit(&l));
+	link(&l, true, now + 1400);
+	CHECK(rx.links == 3 && rx.up);
+
+	// the module stops talking
+	buf[0] = EF_FLOW_PAUSE;
+	input(&l, EF_FLOW, buf, 1, now + 1500);
+	ef_poll(&l, 0, now + 1500 + EF_LINK_TIMEOUT - 1, buf, sizeof(buf));
+	CHECK(l.alive && rx.links == 3);
+	ef_poll(&l, 0, now + 1500 + EF_LINK_TIMEOUT, buf, sizeof(buf));
+	CHECK(!l.alive && !l.peerPaused && rx.links == 4 && !rx.up && !ef_mayTransmit(&l));
+	CHECK(!memcmp(rx.mac, mac, 6));
+
+	// log lines of the module
+	input(&l, EF_TEXT, (const uint8_t *) "connected\r\n", 11, now);
+	CHECK(rx.texts == 1 && !strcmp(rx.text, "connected"));
+	memset (buf, 'x', sizeof(buf));
+	input(&l, EF_TEXT, buf, sizeof(buf), now);
+	CHECK(rx.texts == 2 && strlen(rx.text) == sizeof(buf));
+	input(&l, EF_TEXT, buf, 0, now);
+	CHECK(rx.texts == 3 && !*rx.text);
+}
+
+/**
+ * Decode the flow frames sent by ef_poll().
+ *
+ * \return			the last flow state found or -1 if there was none
+ */
+static int flowState (const uint8_t *buf, int len)
+{
+	uint8_t frame[] = { SLIP_BLOCK, EF_FLOW, 0, 0, 0, SLIP_BLOCK };
+	uint8_t t = EF_FLOW, state;
+	uint16_t crc;
+
+	if (len == 0) return -1;
+	if (len != sizeof(frame)) return -2;
+	state = buf[2];
+	crc = ef_crc(ef_crc(0xFFFF, &t, 1), &state, 1);
+	frame[2] = state;
+	frame[3] = crc & 0xFF;
+	frame[4] = crc >> 8;
+	return (memcmp(buf, frame, len)) ? -2 : state;
+}
+
+static void testFlow (void)
+{
+	uint8_t buf[64], frame[100];
+	struct ef_link l;
+	uint32_t now = 1000;
+
+	reset(&l);
+	CHECK(l.highwater == RING * 3 / 4 && l.lowwater == RING / 4);
+	CHECK(flowState(buf, ef_poll(&l, 0, now, buf, sizeof(buf))) == EF_FLOW_RESUME);
+	CHECK(ef_poll(&l, 0, now + EF_FLOW_REFRESH - 1, buf, sizeof(buf)) == 0);
+	CHECK(flowState(buf, ef_poll(&l, 0, now + EF_FLOW_REFRESH, buf, sizeof(buf))) == EF_FLOW_RESUME);
+	now += EF_FLOW_REFRESH;
+
+	// the backlog grows and drops again (with hysteresis)
+	CHECK(ef_poll(&l, l.highwater - 1, now + 1, buf, sizeof(buf)) == 0);
+	CHECK(flowState(buf, ef_poll(&l, l.highwater, now + 2, buf, sizeof(buf))) == EF_FLOW_PAUSE && l.stats.pauses == 1);
+	CHECK(ef_poll(&l, l.lowwater + 1, now + 3, buf, sizeof(buf)) == 0 && l.paused);
+	CHECK(flowState(buf, ef_poll(&l, l.lowwater + 1, now + 3 + EF_FLOW_REFRESH, buf, sizeof(buf))) == EF_FLOW_PAUSE);
+	CHECK(l.stats.pauses == 1);
+	now += 3 + EF_FLOW_REFRESH;
+	CHECK(flowState(buf, ef_poll(&l, l.lowwater, now, buf, sizeof(buf))) == EF_FLOW_RESUME && !l.paused);
+
+	// a frame that cannot be delivered pauses the peer for EF_BUSY_TIME
+	rx.accept = false;
+	mkframe(frame, 1, sizeof(frame));
+	input(&l, EF_DATA, frame, sizeof(frame), now + 10);
+	CHECK(l.stats.drops == 1 && l.busy);
+	rx.accept = true;
+	CHECK(flowState(buf, ef_poll(&l, 0, now + 11, buf, sizeof(buf))) == EF_FLOW_PAUSE && l.stats.pauses == 2);
+	CHECK(ef_poll(&l, 0, now + 10 + EF_BUSY_TIME - 1, buf, sizeof(buf)) == 0 && l.paused);
+	CHECK(flowState(buf, ef_poll(&l, 0, now + 10 + EF_BUSY_TIME, buf, sizeof(buf))) == EF_FLOW_RESUME && !l.busy);
+
+	// no room for the frame - try again next time
+	CHECK(ef_poll(&l, l.highwater, now + 100, buf, 3) == 0 && !l.paused);
+	CHECK(flowState(buf, ef_poll(&l, l.highwater, now + 101, buf, sizeof(buf))) == EF_FLOW_PAUSE);
+}
+
+static void testRingWritten (void)
+{
+	uint32_t total, halves;
+	int ndtr;
+
+	for (total = 0; total < 5 * RING; total++) {
+		halves = total / (RING / 2);
+		ndtr = RING - total % RING;
+		CHECK(ef_ringWritten(halves, ndtr, RING) == total);
+		if (total % RING == 0 && total > 0) CHECK(ef_ringWritten(halves, 0, RING) == total);
+		if (total % (RING / 2) < 64 && total >= RING / 2) {
+			CHECK(ef_ringWritten(halves - 1, ndtr, RING) == total);		// the interrupt is still pending
+			if (total % RING == 0) CHECK(ef_ringWritten(halves - 1, 0, RING) == total);
+		}
+	}
+
+	// the count wraps around
+	halves = 0xFFFFFFFFu;
+	CHECK(ef_ringWritten(halves, RING / 2, RING) == 0xFFFFFFFFu * (RING / 2));
+	CHECK(ef_ringWritten(halves, RING / 2 - 10, RING) == 0xFFFFFFFFu * (RING / 2) + 10);
+	CHECK(ef_ringWritten(halves, RING, RING) == 0);
+	CHECK(ef_ringWritten(halves, RING - 10, RING) == 10);
+}
+
+/*
+ * ==================================================================================================
+ * A simulated module on a simulated line
+ * ==================================================================================================
+ */
+struct sim {
+	struct ef_link	station;						///< our side
+	struct ef_link	module;							///< the module side
+	bool			honourFlow;						///< the module stops sending data frames when paused
+	int				concurrent;						///< the DMA keeps writing for this many ms while the station reads the ring
+	uint32_t		now;
+	int				period;							///< the station reads the ring every this many ms
+	uint8_t			line[LINEBUF];					///< the bytes the module is sending
+	int				linelen;
+	int				linepos;
+	uint32_t		sent;							///< the number of data frames sent by the module
+	uint8_t			ring[RING];						///< the receive ring of the DMA
+	uint32_t		dma;							///< the number of bytes written by the DMA
+	struct ef_ring	rxring;							///< the station reads the ring
+	int				laps;							///< how often the station found the DMA ahead by more than a ring
+	int				maxBacklog;
+	bool			stationSends;					///< the station has data frames to send
+	uint8_t			txline[LINEBUF];				///< the bytes the station is sending (the transmitter is busy while txpos < txlen)
+	int				txlen;
+	int				txpos;
+	uint32_t		txSent;							///< the number of data frames sent by the station
+	uint32_t		modBusyFrom;					///< the module cannot take frames from this time on ...
+	uint32_t		modBusyTo;						///< ... up to this time
+	uint32_t		pauseArrives;					///< when the last pause of the module is completely written to the ring of the station
+	int				modFrames;						///< the data frames the module received from the station
+	int				modBad;							///< the data frames with wrong contents or out of order
+	int				modLate;						///< the data frames received long after the module paused the station
+	uint32_t		modSeq;
+};
+
+/**
+ * The module receives a data frame from the station. A frame may still
+ * arrive after a pause until the station has read the pause and the frame
+ * that was on the line has been sent completely.
+ */
+static bool simModFrame (void *priv, const uint8_t *data, int len)
+{
+	struct sim *s = priv;
+	uint32_t seq;
+	int i;
+
+	if (len < 18) {
+		s->modBad++;
+		return true;
+	}
+	seq = data[14] | (data[15] << 8) | (data[16] << 16) | ((uint32_t) data[17] << 24);
+	for (i = 0; i < len; i++) {
+		if (i >= 14 && i < 18) continue;
+		if (data[i] != pattern(seq, i)) s->modBad++;
+	}
+	if (s->modFrames && seq != s->modSeq + 1) s->modBad++;
+	if (s->module.paused && (int32_t) (s->now - s->pauseArrives) > s->period + (EF_ENCODED_MAX + 64) / BYTES_PER_MS + 2) s->modLate++;
+	s->modFrames++;
+	s->modSeq = seq;
+	return true;
+}
+
+static const struct ef_ops modOps = { .frame = simModFrame };
+
+/**
+ * The module: its flow state, a link state every second, data frames as long as it may send.
+ */
+static void simModule (struct sim *s, uint32_t now)
+{
+	uint8_t frame[EF_MTU], buf[7];
+	int len, backlog;
+
+	if (s->linepos == s->linelen) s->linepos = s->linelen = 0;
+	if (s->linelen > LINEBUF - EF_ENCODED_MAX - 64) return;
+
+	backlog = ((int32_t) (now - s->modBusyFrom) >= 0 && (int32_t) (now - s->modBusyTo) < 0) ? RING : 0;
+	len = ef_poll(&s->module, backlog, now, &s->line[s->linelen], LINEBUF - s->linelen);
+	if (len > 0 && s->module.paused) s->pauseArrives = now + (s->linelen + len - s->linepos + BYTES_PER_MS - 1) / BYTES_PER_MS;
+	s->linelen += len;
+
+	if (now % 1000 == 0) {
+		buf[0] = 1;
+		memcpy (&buf[1], mac, 6);
+		s->linelen += ef_encode(&s->line[s->linelen], LINEBUF - s->linelen, EF_LINK, buf, sizeof(buf));
+	}
+	if (s->linelen - s->linepos > 2 * BYTES_PER_MS) return;
+	if (s->honourFlow && s->module.peerPaused) return;
+	len = mkframe(frame, s->sent++, 18 + rand() % (EF_MTU - 17));
+	s->linelen += ef_encode(&s->line[s->linelen], LINEBUF - s->linelen, EF_DATA, frame, len);
+}
+
+/**
+ * The line from the module and the DMA for one ms.
+ */
+static void simDma (struct sim *s)
+{
+	int n;
+
+	for (n = 0; n < BYTES_PER_MS && s->linepos < s->linelen; n++) {
+		s->ring[s->dma % RING] = s->line[s->linepos++];
+		s->dma++;
+	}
+}
+
+/**
+ * The line from the station to the module for one ms.
+ */
+static void simTx (struct sim *s, uint32_t now)
+{
+	int n;
+
+	n = s->txlen - s->txpos;
+	if (n > BYTES_PER_MS) n = BYTES_PER_MS;
+	ef_input(&s->module, &s->txline[s->txpos], n, now);
+	s->txpos += n;
+}
+
+/**
+ * What the station sees of the DMA: the event count of the interrupt (which
+ * may still be pending right after the DMA entered the next half) and NDTR
+ * (which may be 0 for a moment at the end of a round).
+ */
+static uint32_t simWritten (void *priv)
+{
+	struct sim *s = priv;
+	uint32_t halves, written;
+	int ndtr;
+
+	halves = s->dma / (RING / 2);
+	if (halves > 0 && s->dma % (RING / 2) < BYTES_PER_MS && rand() % 2) halves--;
+	ndtr = RING - s->dma % RING;
+	if (ndtr == RING && s->dma > 0 && rand() % 2) ndtr = 0;
+	written = ef_ringWritten(halves, ndtr, RING);
+	CHECK(written == s->dma);
+	if (written - s->rxring.read > RING) s->laps++;
+	return written;
+}
+
+/**
+ * The station is about to read a part of the ring. With a concurrent DMA,
+ * the module goes on sending meanwhile.
+ */
+static void simInvalidate (void *priv, const uint8_t *data, int len)
+{
+	struct sim *s = priv;
+	int i;
+
+	CHECK(data >= s->ring && data + len <= s->ring + RING);
+	for (i = 0; i < s->concurrent; i++) {
+		simModule(s, s->now);
+		simDma(s);
+	}
+}
+
+/**
+ * A data frame from lwIP: a pbuf chain in random pieces, which starts with
+ * the padding word. The pieces may be empty and the padding may be split.
+ */
+static int simChain (struct sim *s, uint8_t *buf, int size)
+{
+	uint8_t chain[ETH_PAD + EF_MTU];
+	struct ef_encoder e;
+	int len, pos, n, skip;
+
+	memset (chain, 0xEE, ETH_PAD);
+	len = ETH_PAD + mkframe(&chain[ETH_PAD], s->txSent, 18 + rand() % (EF_MTU - 17));
+	ef_encBegin(&e, buf, size, EF_DATA);
+	skip = ETH_PAD;
+	for (pos = 0; pos < len; pos += n) {
+		n = rand() % 600;
+		if (n > len - pos) n = len - pos;
+		ef_encDataSkip(&e, &chain[pos], n, &skip);
+	}
+	if ((n = ef_encEnd(&e)) > 0) s->txSent++;
+	return (n > 0) ? n : 0;
+}
+
+/**
+ * The task in espnet.c: read the ring, hand the backlog to the flow control
+ * and send if the transmitter is idle.
+ */
+static void simStation (struct sim *s, uint32_t now)
+{
+	int backlog, len;
+
+	s->now = now;
+	backlog = ef_ringReceive(&s->station, &s->rxring, now);
+	if (backlog > s->maxBacklog) s->maxBacklog = backlog;
+	if (s->txpos < s->txlen) return;
+
+	len = ef_poll(&s->station, backlog, now, s->txline, sizeof(s->txline));
+	if (s->stationSends && ef_mayTransmit(&s->station)) {
+		len += simChain(s, &s->txline[len], sizeof(s->txline) - len);
+	}
+	s->txlen = len;
+	s->txpos = 0;
+}
+
+/**
+ * Run the simulation from where it stopped.
+ *
+ * \param s			the simulation
+ * \param ms		the time to stop
+ * \param period	read the ring every this many ms
+ */
+static void simRun (struct sim *s, uint32_t ms, int period)
+{
+	uint32_t now;
+
+	s->period = period;
+	for (now = s->now + 1; now <= ms; now++) {
+		s->now = now;
+		simModule(s, now);
+		simDma(s);
+		simTx(s, now);
+		if (now % period == 0) simStation(s, now);
+	}
+}
+
+static void simInit (struct sim *s, bool honourFlow)
+{
+	memset (s, 0, sizeof(*s));
+	reset(&s->station);
+	ef_linkInit(&s->module, &modOps, s, RING);
+	ef_ringInit(&s->rxring, s->ring, RING, simWritten, simInvalidate, s);
+	s->honourFlow = honourFlow;
+}
+
+static void testSimulation (void)
+{
+	static struct sim s;
+	int period;
+
+	srand (1000);
+
+	// a fast reader never lets the ring fill up
+	simInit(&s, true);
+	simRun(&s, 10000, 2);
+	CHECK(s.sent > 1000 && rx.frames >= (int) s.sent - 2 && rx.bad == 0 && rx.outOfOrder == 0);
+	CHECK(s.laps == 0 && s.station.stats.resyncs == 0 && s.station.stats.crcErrors == 0 && s.station.stats.pauses == 0);
+	CHECK(rx.up && s.station.alive && ef_mayTransmit(&s.station));
+	CHECK(s.maxBacklog <= 2 * BYTES_PER_MS);
+
+	// a slower reader must pause the module, but does not lose anything
+	simInit(&s, true);
+	simRun(&s, 10000, 16);
+	CHECK(s.station.stats.pauses > 0 && s.laps == 0 && rx.frames >= (int) s.sent - 2);
+	CHECK(rx.bad == 0 && rx.outOfOrder == 0 && s.station.stats.crcErrors == 0);
+
+	// the module ignores the flow control: frames are lost, but no broken frame is delivered
+	for (period = 23; period <= 65; period += 7) {
+		simInit(&s, false);
+		simRun(&s, 10000, period);
+		CHECK(s.laps > 0 && s.station.stats.resyncs == (uint32_t) s.laps && s.maxBacklog == RING);
+		CHECK(rx.frames > 0 && rx.frames < (int) s.sent && rx.bad == 0 && rx.outOfOrder == 0);
+		CHECK(s.station.stats.crcErrors == 0 && s.station.stats.overruns == 0);
+		CHECK(s.station.alive);
+	}
+
+	// the DMA overwrites the data while the station reads it: the station must notice it, too. A newer
+	// frame that was written over the unread data may be delivered ahead of older ones, but never a broken one.
+	simInit(&s, false);
+	s.concurrent = 12;
+	simRun(&s, 10000, 20);
+	CHECK(s.laps > 0 && s.station.stats.resyncs > (uint32_t) s.laps);
+	CHECK(rx.frames > 0 && rx.bad == 0 && s.station.alive);
+
+	// the station sends, too: the chains arrive unchanged
+	simInit(&s, true);
+	s.stationSends = true;
+	simRun(&s, 10000, 5);
+	CHECK(s.txSent > 1000 && s.modFrames >= (int) s.txSent - 1 && s.modBad == 0 && s.modLate == 0);
+	CHECK(s.module.stats.crcErrors == 0 && s.module.stats.drops == 0 && rx.bad == 0);
+
+	// the module is busy for a while: the station stops sending in time and goes on afterwards
+	simInit(&s, true);
+	s.stationSends = true;
+	s.modBusyFrom = 3000;
+	s.modBusyTo = 5000;
+	simRun(&s, 4000, 5);
+	period = s.modFrames;
+	CHECK(s.module.paused && s.station.peerPaused && !ef_mayTransmit(&s.station));
+	simRun(&s, 5000, 5);
+	CHECK(s.modFrames == period && s.modLate == 0);
+	simRun(&s, 10000, 5);
+	CHECK(s.modFrames > period + 500 && s.modBad == 0 && s.modLate == 0 && s.module.stats.pauses == 1);
+	CHECK(rx.frames >= (int) s.sent - 2 && rx.bad == 0 && rx.outOfOrder == 0);
+}
+
+int main (int argc, char **argv)
+{
+	testEncode();
+	testDecode();
+	testResync();
+	testLink();
+	testFlow();
+	testRingWritten();
+	testSimulation();
+	return check_result("espframe_test");
+}
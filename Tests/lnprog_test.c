@@ -0,0 +1,438 @@
+/*
+ * lnprog_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief LocoNet slot, programming, LNCV and transponding messages on a simulated bus (lnprog.c)
+ *
+ * The simulated bus carries the bytes of all devices with the checksum,
+ * like the real line. The receiver splits the byte stream into blocks the
+ * same way as the interrupt in loconet.c: an opcode (MSB set) starts a new
+ * block, the length is coded in the opcode or in the second byte. Collisions
+ * leave a truncated block on the bus that must be skipped.
+ *
+ * The devices on the bus are a throttle using the programming slot, a FRED
+ * that gets a dispatched loco, a transponding detector and a LNCV module
+ * that answers the requests of the command station with its own table.
+ */
+
+#include <string.h>
+#include "lnprog.h"
+#include "check.h"
+
+#define OPC_LONG_ACK		0xB4
+#define OPC_MULTI_SENSE		0xD0
+#define OPC_IMM_PACKET		0xED
+#define OPC_PEER_XFER		0xE5
+#define OPC_SL_RD_DATA		0xE7
+#define OPC_WR_SL_DATA		0xEF
+
+#define BUS_SIZE			4096
+#define MAX_BLOCK			32
+
+/*
+ * ==================================================================================================
+ * The bus and the receiver
+ * ==================================================================================================
+ */
+static struct {
+	uint8_t		data[BUS_SIZE];
+	int			len;
+	int			rd;
+} bus;
+
+static void bus_reset (void)
+{
+	memset (&bus, 0, sizeof(bus));
+}
+
+static int blockLen (const uint8_t *blk)
+{
+	switch (blk[0] & 0x60) {
+		case 0x00: return 2;
+		case 0x20: return 4;
+		case 0x40: return 6;
+		default: return blk[1];
+	}
+}
+
+/**
+ * Put a block with its checksum on the bus.
+ *
+ * \param blk		the block without checksum (the length is taken from the opcode)
+ * \param cut		if > 0, a collision stops the transmission after this many bytes
+ */
+static void bus_send (const uint8_t *blk, int cut)
+{
+	uint8_t chk = 0xFF;
+	int i, len;
+
+	len = blockLen(blk);
+	for (i = 0; i < len - 1; i++) {
+		if (cut > 0 && i >= cut) return;
+		chk ^= blk[i];
+		bus.data[bus.len++] = blk[i];
+	}
+	bus.data[bus.len++] = chk;
+}
+
+/**
+ * Fetch the next complete block with a valid checksum from the bus.
+ *
+ * \param blk		where to store the block (including the checksum)
+ * \return			the length of the block or 0 if there is none
+ */
+static int bus_receive (uint8_t *blk)
+{
+	uint8_t chk;
+	int n, len, i;
+
+	n = len = 0;
+	while (bus.rd < bus.len) {
+		uint8_t c = bus.data[bus.rd++];
+
+		if (c & 0x80) n = 0;						// an opcode always starts a new block
+		else if (n == 0) continue;					// garbage between blocks
+		blk[n++] = c;
+		if (n == 1) {
+			len = ((c & 0x60) == 0x60) ? 0 : blockLen(blk);
+			continue;
+		}
+		if (n == 2 && len == 0) len = blk[1];
+		if (len < 2 || len > MAX_BLOCK) {
+			n = 0;
+			continue;
+		}
+		if (n == len) {
+			for (chk = 0, i = 0; i < len; i++) chk ^= blk[i];
+			if (chk == 0xFF) return len;
+			n = 0;
+		}
+	}
+	return 0;
+}
+
+/*
+ * ==================================================================================================
+ * The devices
+ * ==================================================================================================
+ */
+
+/**
+ * A LNCV module with a small table. It only answers requests with its own
+ * article number and during a session also those for its module address.
+ */
+static struct {
+	uint16_t	article;
+	uint16_t	lncv[16];
+	bool		session;
+	int			requests;
+} module = { .article = 6341, .lncv = { 5, 1, 2, 3 } };
+
+static void module_receive (const uint8_t *blk)
+{
+	struct lnp_lncv rq, rep;
+	uint8_t out[MAX_BLOCK];
+
+	if (blk[0] != OPC_IMM_PACKET || !lnp_decodeLNCV(blk, &rq)) return;
+	if (rq.src != LNCV_SRC_MASTER || rq.article != module.article) return;
+	module.requests++;
+
+	if (rq.cmd == LNCV_CMD_READ) {
+		if (rq.flags & LNCV_FLAG_PRON) {
+			if (rq.value != module.lncv[0] && rq.value != 0xFFFF) return;	// not our module address
+			module.session = true;
+		} else if (rq.flags & LNCV_FLAG_PROFF) {
+			module.session = false;
+			return;
+		}
+		if (!module.session || rq.cv >= 16) return;
+		memset (&rep, 0, sizeof(rep));
+		rep.src = LNCV_SRC_MODULE;
+		rep.dst = LNCV_DST_IK;
+		rep.cmd = LNCV_CMD_READREPLY;
+		rep.article = module.article;
+		rep.cv = rq.cv;
+		rep.value = module.lncv[rq.cv];
+		lnp_encodeLNCV(OPC_PEER_XFER, &rep, out);
+		bus_send(out, 0);
+	} else if (rq.cmd == LNCV_CMD_WRITE && module.session) {
+		out[0] = OPC_LONG_ACK;
+		out[1] = OPC_IMM_PACKET & 0x7F;
+		if (rq.cv < 16) {
+			module.lncv[rq.cv] = rq.value;
+			out[2] = LNCV_WRITE_OK;
+		} else {
+			out[2] = 0x01;
+		}
+		bus_send(out, 0);
+	}
+}
+
+/**
+ * Run the bus: every block is delivered to the devices and the received
+ * blocks are returned one by one.
+ */
+static int bus_run (uint8_t *blk)
+{
+	int len;
+
+	while ((len = bus_receive(blk)) > 0) {
+		module_receive(blk);
+		if (blk[0] != OPC_IMM_PACKET) return len;		// the requests are only seen by the module
+	}
+	return 0;
+}
+
+static void sendMultiSense (bool present, int section, int adr)
+{
+	uint8_t blk[6];
+
+	blk[0] = OPC_MULTI_SENSE;
+	blk[1] = ((present) ? LNP_MS_PRESENT : LNP_MS_ABSENT) | ((section >> 7) & 0x1F);
+	blk[2] = section & 0x7F;
+	blk[3] = (adr < 128) ? LNP_MS_SHORTADR : (adr >> 7) & 0x7F;
+	blk[4] = adr & 0x7F;
+	bus_send(blk, 0);
+}
+
+static void sendSlotData (int slot, int status, int adr, int spd, int dirf, int id)
+{
+	uint8_t blk[LNP_SLOTLEN];
+
+	memset (blk, 0, sizeof(blk));
+	blk[0] = OPC_WR_SL_DATA;
+	blk[1] = LNP_SLOTLEN;
+	blk[2] = slot;
+	blk[3] = (status << LNP_STAT_SHIFT) | 0x03;		// 128 speed steps
+	blk[4] = adr & 0x7F;
+	blk[5] = spd;
+	blk[6] = dirf;
+	blk[7] = 0x05;
+	blk[9] = (adr >> 7) & 0x7F;
+	blk[10] = 0x03;
+	blk[11] = id & 0x7F;
+	blk[12] = (id >> 7) & 0x7F;
+	bus_send(blk, 0);
+}
+
+/*
+ * ==================================================================================================
+ * The tests
+ * ==================================================================================================
+ */
+static void testPacking (void)
+{
+	uint8_t bin[7] = { 0x80, 0x7F, 0xFF, 0x00, 0x55, 0xAA, 0x81 };
+	uint8_t msg[8], back[7];
+	int i;
+
+	lnp_bin2msg(bin, msg, 7);
+	for (i = 0; i < 8; i++) CHECK(!(msg[i] & 0x80));
+	CHECK(msg[0] == 0x65);
+	lnp_msg2bin(back, msg, 7);
+	CHECK(!memcmp(bin, back, 7));
+}
+
+static void testProgSlot (void)
+{
+	struct lnp_progslot ps, rx;
+	uint8_t blk[MAX_BLOCK];
+	int cv, data, errors;
+
+	errors = 0;
+	for (cv = 0; cv < 1024; cv++) {
+		for (data = 0; data < 256; data++) {
+			ps.pcmd = LNP_PCMD_WRITE | LNP_PCMD_BYTE | LNP_PCMD_TY0;
+			ps.pstat = 0;
+			ps.adr = 0;
+			ps.trk = 0;
+			ps.cv = cv;
+			ps.data = data;
+			lnp_encodeProgSlot(OPC_WR_SL_DATA, &ps, blk);
+			if (!lnp_decodeProgSlot(blk, &rx) || rx.cv != cv || rx.data != data) errors++;
+		}
+	}
+	CHECK(errors == 0);
+
+	// ops mode with feedback for a long address over the bus
+	bus_reset();
+	ps.pcmd = LNP_PCMD_WRITE | LNP_PCMD_BYTE | LNP_PCMD_OPS | LNP_PCMD_TY0;
+	ps.adr = 4711;
+	ps.cv = 28;
+	ps.data = 0x83;
+	lnp_encodeProgSlot(OPC_WR_SL_DATA, &ps, blk);
+	bus_send(blk, 0);
+	CHECK(bus_run(blk) == LNP_SLOTLEN);
+	CHECK(lnp_decodeProgSlot(blk, &rx));
+	CHECK(lnp_progMode(rx.pcmd) == LNP_MODE_OPSFEEDBACK);
+	CHECK(rx.adr == 4711 && rx.cv == 28 && rx.data == 0x83);
+
+	CHECK(lnp_progMode(LNP_PCMD_TY0) == LNP_MODE_DIRECT);
+	CHECK(lnp_progMode(LNP_PCMD_TY1) == LNP_MODE_REGISTER);
+	CHECK(lnp_progMode(0) == LNP_MODE_PAGED);
+	CHECK(lnp_progMode(LNP_PCMD_OPS) == LNP_MODE_OPS);
+
+	blk[2] = 3;			// not the programming slot
+	CHECK(!lnp_decodeProgSlot(blk, &rx));
+}
+
+static void testLNCV (void)
+{
+	struct lnp_lncv rq, rep;
+	uint8_t blk[MAX_BLOCK];
+
+	bus_reset();
+	memset (&rq, 0, sizeof(rq));
+	rq.src = LNCV_SRC_MASTER;
+	rq.dst = LNCV_SRC_MODULE;
+	rq.article = module.article;
+
+	// a session for another module address is ignored
+	rq.cmd = LNCV_CMD_READ;
+	rq.value = 9;
+	rq.flags = LNCV_FLAG_PRON;
+	lnp_encodeLNCV(OPC_IMM_PACKET, &rq, blk);
+	bus_send(blk, 0);
+	CHECK(bus_run(blk) == 0);
+	CHECK(!module.session);
+
+	// start the session for module address 5, the module answers with LNCV 0
+	rq.value = 5;
+	lnp_encodeLNCV(OPC_IMM_PACKET, &rq, blk);
+	bus_send(blk, 0);
+	CHECK(bus_run(blk) == LNP_PEERLEN);
+	CHECK(lnp_decodeLNCV(blk, &rep));
+	CHECK(rep.cmd == LNCV_CMD_READREPLY && rep.src == LNCV_SRC_MODULE && rep.dst == LNCV_DST_IK);
+	CHECK(rep.article == 6341 && rep.cv == 0 && rep.value == 5);
+
+	// write LNCV 3 (a value with bit 7 set in both bytes) and read it back
+	rq.cmd = LNCV_CMD_WRITE;
+	rq.cv = 3;
+	rq.value = 0x8180;
+	rq.flags = 0;
+	lnp_encodeLNCV(OPC_IMM_PACKET, &rq, blk);
+	bus_send(blk, 0);
+	CHECK(bus_run(blk) == 4);
+	CHECK(blk[0] == OPC_LONG_ACK && blk[1] == (OPC_IMM_PACKET & 0x7F) && blk[2] == LNCV_WRITE_OK);
+	CHECK(module.lncv[3] == 0x8180);
+
+	rq.cmd = LNCV_CMD_READ;
+	rq.value = 0;
+	lnp_encodeLNCV(OPC_IMM_PACKET, &rq, blk);
+	bus_send(blk, 0);
+	CHECK(bus_run(blk) == LNP_PEERLEN);
+	CHECK(lnp_decodeLNCV(blk, &rep) && rep.cv == 3 && rep.value == 0x8180);
+
+	// a write that collides on the bus is lost and the next one is seen
+	rq.cmd = LNCV_CMD_WRITE;
+	rq.cv = 2;
+	rq.value = 77;
+	lnp_encodeLNCV(OPC_IMM_PACKET, &rq, blk);
+	bus_send(blk, 7);
+	rq.value = 78;
+	lnp_encodeLNCV(OPC_IMM_PACKET, &rq, blk);
+	bus_send(blk, 0);
+	CHECK(bus_run(blk) == 4 && blk[2] == LNCV_WRITE_OK);
+	CHECK(module.lncv[2] == 78);
+
+	// end the session, further requests are not answered
+	rq.cmd = LNCV_CMD_READ;
+	rq.flags = LNCV_FLAG_PROFF;
+	lnp_encodeLNCV(OPC_IMM_PACKET, &rq, blk);
+	bus_send(blk, 0);
+	rq.flags = 0;
+	lnp_encodeLNCV(OPC_IMM_PACKET, &rq, blk);
+	bus_send(blk, 0);
+	CHECK(bus_run(blk) == 0);
+	CHECK(!module.session);
+	CHECK(module.requests == 7);
+}
+
+static void testTransponding (void)
+{
+	struct lnp_transponder tp;
+	uint8_t blk[MAX_BLOCK];
+
+	bus_reset();
+	sendMultiSense(true, 5, 3);
+	sendMultiSense(true, 4095, 10239);
+	sendMultiSense(false, 130, 128);
+	blk[0] = OPC_MULTI_SENSE;		// a power management report shares the opcode
+	blk[1] = 0x60;
+	blk[2] = blk[3] = blk[4] = 0;
+	bus_send(blk, 0);
+	sendMultiSense(true, 7, 0);		// no address
+
+	CHECK(bus_run(blk) == 6 && lnp_decodeMultiSense(blk, &tp));
+	CHECK(tp.present && tp.section == 5 && tp.adr == 3);
+	CHECK(bus_run(blk) == 6 && lnp_decodeMultiSense(blk, &tp));
+	CHECK(tp.present && tp.section == 4095 && tp.adr == 10239);
+	CHECK(bus_run(blk) == 6 && lnp_decodeMultiSense(blk, &tp));
+	CHECK(!tp.present && tp.section == 130 && tp.adr == 128);
+	CHECK(bus_run(blk) == 6 && !lnp_decodeMultiSense(blk, &tp));
+	CHECK(bus_run(blk) == 6 && !lnp_decodeMultiSense(blk, &tp));
+	CHECK(bus_run(blk) == 0);
+}
+
+/**
+ * A FRED got slot 7 with a DISPATCH GET and now writes the slot with its ID
+ * and the slot status IN_USE. When the FRED is switched to another loco, it
+ * writes the slot with the status COMMON.
+ */
+static void testFRED (void)
+{
+	struct lnp_slotdata sd;
+	uint8_t blk[MAX_BLOCK];
+
+	bus_reset();
+	sendSlotData(7, 3, 1234, 40, 0x10, 0x2A5B);
+	sendSlotData(7, 1, 1234, 0, 0x30, 0x2A5B);
+	sendSlotData(0, 3, 3, 0, 0, 1);					// slot #0 is the DISPATCH slot
+	sendSlotData(LNP_PROGSLOT, 3, 3, 0, 0, 1);		// the programming slot is no loco slot
+
+	CHECK(bus_run(blk) == LNP_SLOTLEN && lnp_decodeSlotData(blk, &sd));
+	CHECK(sd.slot == 7 && sd.status == 3 && sd.adr == 1234);
+	CHECK(sd.spd == 40 && sd.dirf == 0x10 && sd.snd == 0x03);
+	CHECK(sd.id == 0x2A5B);
+	CHECK((sd.stat1 & 0x07) == 0x03);
+	CHECK(bus_run(blk) == LNP_SLOTLEN && lnp_decodeSlotData(blk, &sd));
+	CHECK(sd.status == 1 && sd.dirf == 0x30);
+	CHECK(bus_run(blk) == LNP_SLOTLEN && !lnp_decodeSlotData(blk, &sd));
+	CHECK(bus_run(blk) == LNP_SLOTLEN && !lnp_decodeSlotData(blk, &sd));
+	CHECK(bus_run(blk) == 0);
+}
+
+int main (void)
+{
+	testPacking();
+	testProgSlot();
+	testLNCV();
+	testTransponding();
+	testFRED();
+	return check_result("lnprog_test");
+}
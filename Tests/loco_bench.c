@@ -0,0 +1,272 @@
+/*
+ * loco_bench.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Micro-benchmark of the address index of the refresh list (loco.c)
+ *
+ * 200 locos are put into the refresh list with the real loco_call(). Then
+ * the lookup of active locos is timed in two ways:
+ *  - the former implementation: a linear walk of the refresh list
+ *  - the current implementation: loco_call() with the hashed address index
+ * Both are run with addresses spread over all buckets of the index and with
+ * addresses that all fall into the same bucket (the worst case of the index).
+ * A complete pass with loco_iterate() is timed as well.
+ *
+ * After that, the index is checked for plausibility, especially after a loco
+ * changed its address with db_changeAdr() while it is in the refresh list.
+ *
+ * The loco database (decoderdb.c), the ownership (owner.c) and the ramps
+ * (ramp.c) are the real ones, the signal generation, the consists and the
+ * configuration are replaced by simple fakes below.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "rb2.h"
+#include "decoder.h"
+#include "config.h"
+#include "events.h"
+#include "host.h"
+#include "check.h"
+
+#define LOCOS			200
+#define ROUNDS			2000
+
+static struct sysconf config;
+
+/*
+ * ==================================================================================================
+ * Fakes for the configuration, the consists and the signal generation
+ * ==================================================================================================
+ */
+struct sysconf *cnf_getconfig (void)
+{
+	return &config;
+}
+
+struct consist *consist_findConsist (int adr) { return NULL; }
+struct consist *_consist_couple (int adr1, int adr2) { return NULL; }
+bool consist_dissolve (uint16_t adr) { return false; }
+struct consist *consist_getConsists (void) { return NULL; }
+
+int event_fire (enum event evt, int param, void *src) { return 0; }
+int event_fireEx (enum event evt, int param, void *src, uint32_t flags, TickType_t timeout) { return 0; }
+
+struct packet *sigq_genPacket (const ldataT *l, enum fmt format, enum queue_cmd cmd) { return NULL; }
+struct packet *sigq_speedPacket (const ldataT *l, int speed) { return NULL; }
+struct packet *sigq_emergencyStopPacket (const ldataT *l) { return NULL; }
+struct packet *sigq_binStatePacket (const ldataT *l, int state, bool on) { return NULL; }
+void sigq_queuePacket (struct packet *p) { }
+
+TickType_t tim_timeout (int ms) { return host_ticks + ms; }
+bool tim_isover (TickType_t to) { return (int32_t) (host_ticks - to) >= 0; }
+
+int wdog_register (const char *name, uint32_t timeout) { return 0; }
+void wdog_kick (void) { }
+void wdog_idle (void) { }
+
+struct ini_section *ini_add (struct ini_section *ini, const char *name) { return NULL; }
+void ini_free (struct ini_section *ini) { }
+struct ini_section *ini_readFile (const char *fname) { return NULL; }
+int ini_writeFile (const char *fname, struct ini_section *ini) { return 0; }
+struct key_value *kv_add (struct key_value *kv, const char *key, const char *value) { return kv; }
+struct key_value *kv_addIndexed (struct key_value *kv, const char *key, int idx, const char *value) { return kv; }
+int list_len (void *lst) { return 0; }
+uint8_t hex_byte (char *s) { return 0; }
+
+/*
+ * ==================================================================================================
+ * The two implementations
+ * ==================================================================================================
+ */
+
+/**
+ * The former implementation of loco_call() for active locos: walk the refresh list
+ */
+static ldataT *oldLookup (ldataT *list, int adr)
+{
+	ldataT *l;
+
+	if (!loco_lock(__func__)) return NULL;
+	for (l = list; l; l = l->next) {
+		if (l->loco->adr == adr) break;
+	}
+	loco_unlock();
+	return l;
+}
+
+/*
+ * ==================================================================================================
+ * The benchmark
+ * ==================================================================================================
+ */
+static int adrs[LOCOS];
+static volatile uintptr_t sink;		///< keeps the compiler from dropping the lookups
+
+static double seconds (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Fill the refresh list with LOCOS locos.
+ *
+ * \param stride	the distance between two addresses (a multiple of 64 puts all of them into the same bucket)
+ * \return			the first entry of the refresh list
+ */
+static ldataT *fill (int stride)
+{
+	struct loco_cursor cur;
+	int i;
+
+	if (loco_lock(__func__)) {
+		loco_freeRefreshList();
+		loco_unlock();
+	}
+	for (i = 0; i < LOCOS; i++) {
+		adrs[i] = 1 + i * stride;
+		CHECK(loco_call(adrs[i], true) != NULL);
+	}
+	memset (&cur, 0, sizeof(cur));
+	return loco_iterate(&cur);
+}
+
+static void run (const char *title, int stride)
+{
+	struct loco_cursor cur;
+	ldataT *list, *l;
+	double start, told, tnew, titer;
+	int round, i, n, found;
+
+	list = fill(stride);
+
+	found = 0;
+	start = seconds();
+	for (round = 0; round < ROUNDS; round++) {
+		for (i = 0; i < LOCOS; i++) {
+			if ((l = oldLookup(list, adrs[i])) != NULL) found++;
+			sink += (uintptr_t) l;
+		}
+	}
+	told = seconds() - start;
+	CHECK(found == ROUNDS * LOCOS);
+
+	found = 0;
+	start = seconds();
+	for (round = 0; round < ROUNDS; round++) {
+		for (i = 0; i < LOCOS; i++) {
+			if ((l = loco_call(adrs[i], false)) != NULL) found++;
+			sink += (uintptr_t) l;
+		}
+	}
+	tnew = seconds() - start;
+	CHECK(found == ROUNDS * LOCOS);
+
+	n = 0;
+	start = seconds();
+	for (round = 0; round < ROUNDS; round++) {
+		memset (&cur, 0, sizeof(cur));
+		while ((l = loco_iterate(&cur)) != NULL) {
+			CHECK(l->loco->adr == adrs[n % LOCOS]);
+			n++;
+		}
+	}
+	titer = seconds() - start;
+	CHECK(n == ROUNDS * LOCOS);
+
+	printf ("%-28s %12.1f %12.1f %12.1f\n", title, told * 1e9 / (ROUNDS * LOCOS),
+			tnew * 1e9 / (ROUNDS * LOCOS), titer * 1e9 / (ROUNDS * LOCOS));
+}
+
+/**
+ * A loco in the refresh list gets a new address (i.e. by the m3 or DCC-A
+ * registration). The refresh entry must move to the bucket of the new address.
+ */
+static void changeAdr (void)
+{
+	ldataT *l, *other;
+	uint16_t *snap;
+	int oldadr, newadr, count, i;
+
+	fill(64);
+	oldadr = adrs[LOCOS / 2];
+	newadr = LOCOS + 2;			// unused so far and in a different bucket than all the others
+	CHECK((l = loco_call(oldadr, false)) != NULL);
+	if (!l) return;
+	l->loco->vid = 0x7F;
+	l->loco->uid = 0x12345678;
+	CHECK(loco_acquire(oldadr, OWN_TOKEN(OWN_Z21, 1), OWN_ACQUIRE) == 0);
+
+	CHECK(db_changeAdr(newadr, 0x7F, 0x12345678) == l->loco);
+	CHECK(l->loco->adr == newadr);
+	CHECK(loco_call(newadr, false) == l);
+	CHECK(loco_call(oldadr, false) == NULL);
+	CHECK(loco_call(newadr, true) == l);		// no second entry for the same loco
+	CHECK(loco_getOwner(newadr) == OWN_TOKEN(OWN_Z21, 1));
+	CHECK(loco_getOwner(oldadr) == OWN_ANONYMOUS);
+	CHECK(loco_release(newadr, OWN_TOKEN(OWN_Z21, 1)) == 0);
+	CHECK(loco_getOwner(newadr) == OWN_ANONYMOUS);
+
+	snap = loco_snapshot(&count);
+	CHECK(snap != NULL && count == LOCOS);
+	for (i = 0; snap && i < count; i++) {
+		CHECK(snap[i] == ((i == LOCOS / 2) ? newadr : adrs[i]));
+	}
+	free (snap);
+
+	// the other locos in the old bucket are still found
+	for (i = 0; i < LOCOS; i++) {
+		if (i == LOCOS / 2) continue;
+		CHECK((other = loco_call(adrs[i], false)) != NULL && other != l);
+	}
+
+	// the old address is free for a new loco now
+	CHECK((other = loco_call(oldadr, true)) != NULL && other != l);
+	loco_remove(other);
+
+	// removing the loco really removes the entry from the index
+	loco_remove(l);
+	CHECK(loco_call(newadr, false) == NULL);
+	snap = loco_snapshot(&count);
+	CHECK(count == LOCOS - 1);
+	free (snap);
+}
+
+int main (void)
+{
+	printf ("%d active locos, %d rounds\n", LOCOS, ROUNDS);
+	printf ("%-28s %12s %12s %12s\n", "", "walk ns", "index ns", "iterate ns");
+	run("spread addresses", 1);
+	run("same bucket", 64);
+	changeAdr();
+
+	return check_result("loco_bench");
+}
@@ -0,0 +1,312 @@
+/*
+ * locoowner_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief The ownership of locos with competing clients on several interfaces (loco.c, owner.c)
+ *
+ * The clients of the throttle interfaces (Z21 apps, LocoNet, XpressNet,
+ * P50x, EasyNet) are simulated by setting the client of the (only) task
+ * before each command, as the interface tasks do. The refresh list, the loco
+ * database and the ownership rules are the real ones.
+ *
+ * The event fake plays the part of the interface listeners: it checks that
+ * no lock is held while EVENT_LOCO_OWNER is fired (the event may wait for
+ * room in the queue and the listeners look up the loco themselves) and that
+ * the change it reports is already visible in the refresh list.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "rb2.h"
+#include "decoder.h"
+#include "config.h"
+#include "events.h"
+#include "host.h"
+#include "check.h"
+
+#define Z21_1			OWN_TOKEN(OWN_Z21, 1)
+#define Z21_2			OWN_TOKEN(OWN_Z21, 2)
+#define LNET			OWN_TOKEN(OWN_LOCONET, 0)
+#define XNET			OWN_TOKEN(OWN_XPRESSNET, 5)
+#define P50X			OWN_TOKEN(OWN_P50X, 0x81)
+#define ENET			OWN_TOKEN(OWN_EASYNET, 3)
+
+#define MAXEVENTS		64
+#define LOCOS			12
+
+static struct sysconf config;
+static struct own_change events[MAXEVENTS];
+static int nevents;
+
+/*
+ * ==================================================================================================
+ * Fakes for the configuration, the consists, the events and the signal generation
+ * ==================================================================================================
+ */
+struct sysconf *cnf_getconfig (void)
+{
+	return &config;
+}
+
+struct consist *consist_findConsist (int adr) { return NULL; }
+struct consist *_consist_couple (int adr1, int adr2) { return NULL; }
+bool consist_dissolve (uint16_t adr) { return false; }
+struct consist *consist_getConsists (void) { return NULL; }
+
+int event_fire (enum event evt, int param, void *src)
+{
+	return 0;
+}
+
+/**
+ * The listeners of the interfaces: the change must be visible and
+ * the loco can be looked up.
+ */
+int event_fireEx (enum event evt, int param, void *src, uint32_t flags, TickType_t timeout)
+{
+	struct own_change *oc = src;
+
+	if (evt == EVENT_LOCO_OWNER) {
+		CHECK(host_locks == 0);
+		CHECK(oc && oc->adr == param && oc->next == NULL);
+		CHECK(loco_call(param, false) != NULL);
+		CHECK(loco_getOwner(param) == oc->to);
+		if (nevents < MAXEVENTS) events[nevents++] = *oc;
+	}
+	if (flags & EVTFLAG_FREE_SRC) free (src);
+	return 0;
+}
+
+struct packet *sigq_genPacket (const ldataT *l, enum fmt format, enum queue_cmd cmd) { return NULL; }
+struct packet *sigq_speedPacket (const ldataT *l, int speed) { return NULL; }
+struct packet *sigq_emergencyStopPacket (const ldataT *l) { return NULL; }
+struct packet *sigq_binStatePacket (const ldataT *l, int state, bool on) { return NULL; }
+void sigq_queuePacket (struct packet *p) { }
+
+TickType_t tim_timeout (int ms) { return host_ticks + ms; }
+bool tim_isover (TickType_t to) { return (int32_t) (host_ticks - to) >= 0; }
+
+int wdog_register (const char *name, uint32_t timeout) { return 0; }
+void wdog_kick (void) { }
+void wdog_idle (void) { }
+
+struct ini_section *ini_add (struct ini_section *ini, const char *name) { return NULL; }
+void ini_free (struct ini_section *ini) { }
+struct ini_section *ini_readFile (const char *fname) { return NULL; }
+int ini_writeFile (const char *fname, struct ini_section *ini) { return 0; }
+struct key_value *kv_add (struct key_value *kv, const char *key, const char *value) { return kv; }
+struct key_value *kv_addIndexed (struct key_value *kv, const char *key, int idx, const char *value) { return kv; }
+int list_len (void *lst) { return 0; }
+uint8_t hex_byte (char *s) { return 0; }
+
+/*
+ * ==================================================================================================
+ * The simulated clients
+ * ==================================================================================================
+ */
+
+/**
+ * A command (i.e. a speed change) of a client as the interfaces check it.
+ */
+static bool command (uint16_t who, int adr)
+{
+	bool ok;
+
+	loco_setClient(who);
+	ok = loco_checkOwner(adr);
+	loco_setClient(OWN_ANONYMOUS);
+	CHECK(host_locks == 0);
+	return ok;
+}
+
+static bool event (int idx, int adr, uint16_t from, uint16_t to, bool taken)
+{
+	if (idx >= nevents) return false;
+	return events[idx].adr == adr && events[idx].from == from && events[idx].to == to && events[idx].taken == taken;
+}
+
+static void policy (enum own_policy p)
+{
+	config.ownpolicy = p;
+	nevents = 0;
+}
+
+/**
+ * The default policy: a command takes the loco, the former owner is informed.
+ */
+static void testSteal (void)
+{
+	policy(OWN_POLICY_STEAL);
+	CHECK(command(Z21_1, 3));
+	CHECK(nevents == 1 && event(0, 3, OWN_ANONYMOUS, Z21_1, false));
+	CHECK(command(Z21_1, 3));					// no change, no event
+	CHECK(nevents == 1);
+	CHECK(command(XNET, 3));
+	CHECK(nevents == 2 && event(1, 3, Z21_1, XNET, true));
+	CHECK(loco_getOwner(3) == XNET);
+
+	// anonymous (internal) commands are never checked
+	CHECK(command(OWN_ANONYMOUS, 3));
+	CHECK(nevents == 2 && loco_getOwner(3) == XNET);
+}
+
+/**
+ * Exclusive: the commands of others are rejected until the loco is
+ * released, stolen explicitly or the lease of the owner expires.
+ */
+static void testExclusive (void)
+{
+	policy(OWN_POLICY_EXCLUSIVE);
+	CHECK(loco_acquire(4, LNET, OWN_ACQUIRE) == 0);
+	CHECK(nevents == 1 && event(0, 4, OWN_ANONYMOUS, LNET, false));
+	CHECK(!command(Z21_2, 4));
+	CHECK(loco_acquire(4, Z21_2, OWN_ACQUIRE) == -1);
+	CHECK(loco_release(4, Z21_2) == -1);
+	CHECK(nevents == 1 && loco_getOwner(4) == LNET);
+
+	CHECK(loco_acquire(4, Z21_2, OWN_STEAL) == 0);
+	CHECK(nevents == 2 && event(1, 4, LNET, Z21_2, true));
+
+	CHECK(loco_release(4, Z21_2) == 0);
+	CHECK(nevents == 3 && event(2, 4, Z21_2, OWN_ANONYMOUS, false));
+	CHECK(command(LNET, 4));
+	CHECK(nevents == 4 && event(3, 4, OWN_ANONYMOUS, LNET, false));
+
+	// the lease of the LocoNet throttle expires
+	host_ticks += OWN_LEASE;
+	CHECK(command(P50X, 4));
+	CHECK(nevents == 5 && event(4, 4, LNET, P50X, true));
+}
+
+/**
+ * Share: all clients may command the loco, the owner keeps it.
+ */
+static void testShare (void)
+{
+	policy(OWN_POLICY_SHARE);
+	CHECK(loco_acquire(5, ENET, OWN_ACQUIRE) == 0);
+	CHECK(command(P50X, 5));
+	CHECK(command(Z21_1, 5));
+	CHECK(nevents == 1 && loco_getOwner(5) == ENET);
+}
+
+/**
+ * A dispatched loco goes to the next client that asks for it.
+ */
+static void testDispatch (void)
+{
+	policy(OWN_POLICY_EXCLUSIVE);
+	CHECK(loco_acquire(6, LNET, OWN_ACQUIRE) == 0);
+	CHECK(loco_dispatch(6, Z21_1) == -1);
+	CHECK(loco_dispatch(6, LNET) == 0);
+	CHECK(nevents == 2 && event(1, 6, LNET, OWN_ANONYMOUS, false) && events[1].dispatched);
+	CHECK(loco_dispatch(6, LNET) == 0);			// already dispatched, no change
+	CHECK(nevents == 2);
+	CHECK(command(Z21_1, 6));
+	CHECK(nevents == 3 && event(2, 6, OWN_ANONYMOUS, Z21_1, false) && !events[2].dispatched);
+}
+
+/**
+ * A client disconnects: all its locos are released, one event each.
+ */
+static void testReleaseAll (void)
+{
+	int adr;
+
+	policy(OWN_POLICY_STEAL);
+	for (adr = 20; adr < 25; adr++) CHECK(command(Z21_2, adr));
+	CHECK(command(XNET, 22));
+	nevents = 0;
+	loco_releaseAll(Z21_2);
+	CHECK(host_locks == 0);
+	CHECK(nevents == 4);
+	CHECK(event(0, 20, Z21_2, OWN_ANONYMOUS, false) && event(3, 24, Z21_2, OWN_ANONYMOUS, false));
+	CHECK(loco_getOwner(22) == XNET);
+	nevents = 0;
+	loco_releaseAll(Z21_2);
+	loco_releaseAll(OWN_ANONYMOUS);
+	CHECK(nevents == 0);
+}
+
+/**
+ * Random commands of all clients on a few locos with changing policies.
+ * Every change of the owner must be reported exactly once and in order.
+ */
+static void testRandom (void)
+{
+	static const uint16_t clients[] = { Z21_1, Z21_2, LNET, XNET, P50X, ENET };
+	uint16_t shadow[LOCOS];
+	uint32_t rnd = 0x13579BDF;
+	int i, j, adr, op, before;
+	uint16_t who;
+
+	for (i = 0; i < (int) (sizeof(clients) / sizeof(clients[0])); i++) loco_releaseAll(clients[i]);
+	for (i = 0; i < LOCOS; i++) shadow[i] = OWN_ANONYMOUS;
+
+	for (i = 0; i < 20000; i++) {
+		rnd ^= rnd << 13;
+		rnd ^= rnd >> 17;
+		rnd ^= rnd << 5;
+		adr = 100 + rnd % LOCOS;
+		who = clients[(rnd >> 8) % (sizeof(clients) / sizeof(clients[0]))];
+		op = (rnd >> 16) % 8;
+		config.ownpolicy = (rnd >> 24) % 3;
+		if ((rnd >> 28) == 0) host_ticks += OWN_LEASE / 4;
+
+		nevents = 0;
+		switch (op) {
+			case 0: case 1: case 2:	command(who, adr); break;
+			case 3: loco_acquire(adr, who, OWN_ACQUIRE); break;
+			case 4: loco_acquire(adr, who, (rnd & 1) ? OWN_STEAL : OWN_SHARE); break;
+			case 5: loco_release(adr, who); break;
+			case 6: loco_dispatch(adr, who); break;
+			case 7: loco_releaseAll(who); break;
+		}
+		CHECK(host_locks == 0);
+		for (j = 0; j < nevents; j++) {
+			before = shadow[events[j].adr - 100];
+			CHECK(events[j].from == before);
+			CHECK(events[j].to != before || events[j].taken);
+			CHECK(!events[j].taken || events[j].from != OWN_ANONYMOUS);
+			shadow[events[j].adr - 100] = events[j].to;
+		}
+		for (j = 0; j < LOCOS; j++) CHECK(loco_getOwner(100 + j) == shadow[j]);
+	}
+}
+
+int main (void)
+{
+	host_ticks = 1000;
+	testSteal();
+	testExclusive();
+	testShare();
+	testDispatch();
+	testReleaseAll();
+	testRandom();
+
+	return check_result("locoowner_test");
+}
@@ -0,0 +1,326 @@
+/*
+ * m3scan_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief The enumeration of unregistered m3 decoders (m3scan.c) with simulated decoders
+ *
+ * The track is simulated by a FIFO of search packets in flight, driven the
+ * same way as sig_scanM3Locos() does: all queries that m3s_next() hands out
+ * are queued, then the answers come back one by one in the order the packets
+ * were sent. A decoder answers a query, if it has no track address yet and
+ * the first bits of its UID match. A decoder that is found gets its address
+ * at once and is silent from then on.
+ *
+ * Answers can be lost (a decoder answer that is not seen by the receiver)
+ * and the whole pipe can time out, which the driver handles with
+ * m3s_abort().
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "m3scan.h"
+#include "check.h"
+
+#define MAXDECODERS			40
+#define MAXLOOPS			100000		///< a scan that needs more answers is considered stuck
+
+struct decoder {
+	uint32_t		uid;
+	bool			registered;
+};
+
+static struct decoder decoders[MAXDECODERS];
+static int ndecoders;
+static int lossrate;					///< lose an acknowledge with a probability of 1/lossrate (0 = never)
+static int timeoutEvery;				///< let the pipe time out every n answers (0 = never)
+static bool assign = true;				///< the found decoders get their address
+
+static uint32_t rnd = 0x2468ACE;
+
+static uint32_t random32 (void)
+{
+	rnd ^= rnd << 13;
+	rnd ^= rnd >> 17;
+	rnd ^= rnd << 5;
+	return rnd;
+}
+
+static void track (int count, const uint32_t *uids)
+{
+	int i;
+
+	ndecoders = count;
+	for (i = 0; i < count; i++) {
+		decoders[i].uid = (uids) ? uids[i] : random32();
+		decoders[i].registered = false;
+	}
+}
+
+static void randomTrack (int count)
+{
+	track(count, NULL);
+}
+
+/**
+ * The answer of the decoders on the track to a search packet.
+ */
+static bool ack (uint32_t uid, int len)
+{
+	uint32_t mask = (len <= 0) ? 0 : (0xFFFFFFFFu << (32 - len));
+	int i;
+
+	for (i = 0; i < ndecoders; i++) {
+		if (!decoders[i].registered && ((decoders[i].uid ^ uid) & mask) == 0) {
+			return !(lossrate && random32() % lossrate == 0);
+		}
+	}
+	return false;
+}
+
+static struct decoder *lookup (uint32_t uid)
+{
+	int i;
+
+	for (i = 0; i < ndecoders; i++) {
+		if (decoders[i].uid == uid) return &decoders[i];
+	}
+	return NULL;
+}
+
+/**
+ * Run a scan like sig_scanM3Locos() does.
+ *
+ * \param s			the scan
+ * \param max		the maximum number of decoders to find
+ * \return			the number of decoders found (checked against the callback) or -1 if the scan got stuck
+ */
+static int scan (struct m3s_scan *s, int max)
+{
+	struct { int tag; uint32_t uid; int len; } fifo[M3S_INFLIGHT * 2];
+	struct decoder *d;
+	uint32_t uid;
+	int head, cnt, tag, len, found, loops, i;
+
+	m3s_init(s, max);
+	head = cnt = found = 0;
+	for (loops = 0; !m3s_done(s); loops++) {
+		if (loops >= MAXLOOPS) return -1;
+		while ((tag = m3s_next(s, &uid, &len)) >= 0) {
+			CHECK(cnt < (int) (sizeof(fifo) / sizeof(fifo[0])));
+			i = (head + cnt++) % (sizeof(fifo) / sizeof(fifo[0]));
+			fifo[i].tag = tag;
+			fifo[i].uid = uid;
+			fifo[i].len = len;
+		}
+		CHECK(m3s_pending(s) == cnt);
+		if (cnt == 0 || (timeoutEvery && loops % timeoutEvery == timeoutEvery - 1)) {
+			m3s_abort(s);				// no answer within M3SCAN_TIMEOUT
+			head = cnt = 0;
+			continue;
+		}
+		i = head;
+		head = (head + 1) % (sizeof(fifo) / sizeof(fifo[0]));
+		cnt--;
+		if (m3s_answer(s, fifo[i].tag, ack(fifo[i].uid, fifo[i].len), &uid) > 0) {
+			found++;
+			CHECK(s->nfound == found && s->found[found - 1] == uid);
+			CHECK((d = lookup(uid)) != NULL && !d->registered);
+			if (d && assign) d->registered = true;
+		}
+	}
+	return found;
+}
+
+/**
+ * Check that every decoder on the track was found exactly once.
+ */
+static bool complete (const struct m3s_scan *s)
+{
+	int i, j;
+
+	if (s->nfound != ndecoders) return false;
+	for (i = 0; i < ndecoders; i++) {
+		if (!decoders[i].registered) return false;
+		for (j = 0; j < i; j++) if (s->found[i] == s->found[j]) return false;
+	}
+	return true;
+}
+
+static void testEmpty (void)
+{
+	struct m3s_scan s;
+
+	track(0, NULL);
+	CHECK(scan(&s, 0) == 0);
+	CHECK(s.queries == 1 && s.passes == 1 && s.lost == 0);
+}
+
+static void testSingle (void)
+{
+	struct m3s_scan s;
+	int i;
+
+	for (i = 0; i < 50; i++) {
+		randomTrack(1);
+		CHECK(scan(&s, 0) == 1);
+		CHECK(complete(&s));
+		CHECK(s.passes == 2);				// the second pass finds nothing and ends the scan
+		CHECK(s.lost == 0 && !s.overflow);
+	}
+}
+
+static void testMany (void)
+{
+	struct m3s_scan s;
+	int i;
+
+	for (i = 0; i < 20; i++) {
+		randomTrack(30);
+		CHECK(scan(&s, 0) == 30);
+		CHECK(complete(&s));
+		CHECK(s.lost == 0 && !s.overflow);
+	}
+}
+
+/**
+ * Neighbours in the tree: UIDs that only differ in the last bit, the
+ * smallest and the largest UID.
+ */
+static void testNeighbours (void)
+{
+	static const uint32_t uids[] = {
+		0x00000000, 0x00000001, 0xFFFFFFFF, 0xFFFFFFFE, 0x12345678, 0x12345679, 0x1234567A, 0x80000000, 0x7FFFFFFF,
+	};
+	struct m3s_scan s;
+
+	track(sizeof(uids) / sizeof(uids[0]), uids);
+	CHECK(scan(&s, 0) == ndecoders);
+	CHECK(complete(&s));
+}
+
+/**
+ * The scan stops after the requested number of decoders.
+ */
+static void testMaxfound (void)
+{
+	struct m3s_scan s;
+	uint32_t uid;
+	int len, i, n;
+
+	randomTrack(30);
+	CHECK(scan(&s, 5) == 5);
+	CHECK(m3s_done(&s));
+	CHECK(m3s_next(&s, &uid, &len) == -1);
+	for (i = n = 0; i < ndecoders; i++) if (decoders[i].registered) n++;
+	CHECK(n == 5);
+
+	randomTrack(M3S_MAXFOUND + 5);
+	CHECK(scan(&s, 1000) == M3S_MAXFOUND);
+}
+
+/**
+ * Lost answers are recovered by the retries and the further passes.
+ */
+static void testLoss (void)
+{
+	struct m3s_scan s;
+	int i, ok, lost;
+
+	lossrate = 20;
+	for (i = ok = lost = 0; i < 20; i++) {
+		randomTrack(10);
+		CHECK(scan(&s, 0) >= 0);
+		if (complete(&s)) ok++;
+		lost += s.lost;
+		CHECK(s.passes <= M3S_PASSES);
+	}
+	lossrate = 0;
+	CHECK(lost > 0);
+	CHECK(ok >= 18);
+}
+
+/**
+ * A pipe that times out now and then. The queries in flight count as
+ * negative answers, the retries find the decoders anyway.
+ */
+static void testTimeout (void)
+{
+	struct m3s_scan s;
+
+	timeoutEvery = 37;
+	randomTrack(10);
+	CHECK(scan(&s, 0) >= 0);
+	CHECK(complete(&s));
+	timeoutEvery = 0;
+}
+
+/**
+ * A decoder that is found but does not take its address answers again.
+ * It must not be reported twice and the scan must end.
+ */
+static void testUnassigned (void)
+{
+	struct m3s_scan s;
+
+	assign = false;
+	randomTrack(3);
+	CHECK(scan(&s, 0) == 3);
+	CHECK(s.passes == M3S_PASSES);
+	assign = true;
+}
+
+static void testInvalid (void)
+{
+	struct m3s_scan s;
+	uint32_t uid;
+	int len, tag;
+
+	m3s_init(&s, 0);
+	CHECK(m3s_answer(&s, 0, true, NULL) == -1);			// not sent yet
+	CHECK((tag = m3s_next(&s, &uid, &len)) == 0 && uid == 0 && len == 0);
+	CHECK(m3s_next(&s, &uid, &len) == -1);				// nothing known yet
+	CHECK(m3s_answer(&s, -1, true, NULL) == -1);
+	CHECK(m3s_answer(&s, M3S_INFLIGHT, true, NULL) == -1);
+	CHECK(m3s_answer(&s, tag, true, NULL) == 0);
+	CHECK(m3s_answer(&s, tag, true, NULL) == -1);		// answered twice
+	CHECK(m3s_pending(&s) == 0 && !m3s_done(&s));
+}
+
+int main (void)
+{
+	testEmpty();
+	testSingle();
+	testMany();
+	testNeighbours();
+	testMaxfound();
+	testLoss();
+	testTimeout();
+	testUnassigned();
+	testInvalid();
+
+	return check_result("m3scan_test");
+}
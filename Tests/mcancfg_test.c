@@ -0,0 +1,254 @@
+/*
+ * mcancfg_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief The CAN codec for config channels and S88 events (mcancfg.c)
+ *
+ * The replies of a Link S88 are built the way the device sends them: the
+ * block of the status data configuration is cut into data frames with the
+ * packet number in the hash and closed by the final frame. The frames are
+ * fed to the reassembly in order, out of order, with gaps and mixed with the
+ * traffic of another master.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "mcancfg.h"
+#include "check.h"
+
+#define UID_LS88		0x53384711
+#define HASH			0x4B1F			///< a valid hash (bits 7 .. 9 = 0b110)
+
+/**
+ * Build a status data block and cut it into frames.
+ *
+ * \param blk		the contents of the block
+ * \param len		the length of the block
+ * \param frames	the data of the frames (cnt * 8 bytes, padded with zeros)
+ * \return			the number of data frames
+ */
+static int cut (const uint8_t *blk, int len, uint8_t frames[][8])
+{
+	int cnt = (len + 7) / 8;
+
+	memset (frames, 0, cnt * 8);
+	memcpy (frames, blk, len);
+	return cnt;
+}
+
+static int final (uint32_t uid, uint8_t index, int cnt, uint8_t *data)
+{
+	mcc_encodeStatusRequest(uid, index, data);
+	data[5] = cnt;
+	return 6;
+}
+
+static int deviceBlock (uint8_t *blk)
+{
+	static const uint8_t hdr[] = { 0, 7, 0, 0, 0x00, 0x01, 0x23, 0x45, '6', '0', '8', '8', '3', 0, 0, 0 };
+
+	memcpy (blk, hdr, sizeof(hdr));
+	strcpy ((char *) &blk[16], "Link S88");
+	return 16 + strlen("Link S88") + 1;
+}
+
+static int valueBlock (uint8_t *blk, uint8_t index, uint16_t min, uint16_t max, uint16_t val, const char *name, const char *unit)
+{
+	uint8_t *p = blk;
+
+	*p++ = index;
+	*p++ = MCC_CHTYPE_VALUE;
+	*p++ = min >> 8;
+	*p++ = min & 0xFF;
+	*p++ = max >> 8;
+	*p++ = max & 0xFF;
+	*p++ = val >> 8;
+	*p++ = val & 0xFF;
+	p += sprintf ((char *) p, "%s", name) + 1;
+	p += sprintf ((char *) p, "%d", min) + 1;
+	p += sprintf ((char *) p, "%d", max) + 1;
+	p += sprintf ((char *) p, "%s", unit) + 1;
+	return p - blk;
+}
+
+static void testCommands (void)
+{
+	static const uint8_t statreq[] = { 0x53, 0x38, 0x47, 0x11, 0x03 };
+	static const uint8_t chwrite[] = { 0x53, 0x38, 0x47, 0x11, 0x0B, 0x05, 0x00, 0x64 };
+	static const uint8_t range[] = { 0x00, 0x02, 0x03, 0xE9, 0x03, 0xF8, 0x01 };
+	uint8_t data[8], ch;
+	uint32_t uid;
+	uint16_t node, contact;
+	bool ok, state;
+
+	CHECK(MCC_ID(0, MCC_CMD_STATUSCFG, false, HASH) == 0x00744B1F);
+	CHECK(MCC_ID_CMD(0x00754B1F) == MCC_CMD_STATUSCFG && MCC_ID_RESP(0x00754B1F) && MCC_ID_HASH(0x00754B1F) == HASH);
+	CHECK(MCC_ISHASH(HASH) && !MCC_ISHASH(0x0001) && !MCC_ISHASH(0x0020));
+
+	CHECK(mcc_encodeStatusRequest(UID_LS88, 3, data) == 5 && !memcmp(data, statreq, sizeof(statreq)));
+	CHECK(mcc_encodeChannelWrite(UID_LS88, MCC_LS88_CYCLE1, 100, data) == 8 && !memcmp(data, chwrite, sizeof(chwrite)));
+	CHECK(mcc_encodeS88Range(2, 1001, 1016, data) == 7 && !memcmp(data, range, sizeof(range)));
+
+	// the reply to the channel write: UID, 0x0B, channel, result
+	CHECK(mcc_decodeChannelWrite(7, (uint8_t []) { 0x53, 0x38, 0x47, 0x11, 0x0B, 0x05, 0x01 }, &uid, &ch, &ok));
+	CHECK(uid == UID_LS88 && ch == 5 && ok);
+	CHECK(mcc_decodeChannelWrite(7, (uint8_t []) { 0x53, 0x38, 0x47, 0x11, 0x0B, 0x05, 0x00 }, &uid, &ch, &ok) && !ok);
+	CHECK(!mcc_decodeChannelWrite(8, chwrite, &uid, &ch, &ok));				// our own request
+	CHECK(!mcc_decodeChannelWrite(7, (uint8_t []) { 0x53, 0x38, 0x47, 0x11, 0x01, 0x05, 0x01 }, &uid, &ch, &ok));
+
+	// S88 event: node, contact, old state, new state, time
+	CHECK(mcc_decodeS88Event(8, (uint8_t []) { 0x00, 0x02, 0x07, 0xD5, 0x00, 0x01, 0x00, 0x32 }, &node, &contact, &state));
+	CHECK(node == 2 && contact == 2005 && state);
+	CHECK(mcc_decodeS88Event(8, (uint8_t []) { 0x00, 0x02, 0x00, 0x10, 0x01, 0x00, 0x00, 0x00 }, &node, &contact, &state));
+	CHECK(contact == 16 && !state);
+	CHECK(!mcc_decodeS88Event(4, range, &node, &contact, &state));				// a single contact request (the range request is told by the response bit)
+	CHECK(!mcc_decodeS88Event(6, (uint8_t []) { 0x00, 0x02, 0x00, 0x00, 0x00, 0x01 }, &node, &contact, &state));
+}
+
+static void testStream (void)
+{
+	uint8_t blk[MCC_STREAM_MAX], frames[MCC_STREAM_FRAMES][8], fin[8];
+	struct mcc_stream s;
+	struct mcc_device dev;
+	int len, cnt, i;
+
+	len = deviceBlock(blk);
+	cnt = cut(blk, len, frames);
+	CHECK(cnt == 4);
+
+	// in order, with our own request and the request of another master in between
+	mcc_streamStart(&s, UID_LS88, 0);
+	CHECK(mcc_streamFrame(&s, HASH, mcc_encodeStatusRequest(UID_LS88, 0, fin), fin) == MCC_STREAM_MORE);
+	for (i = 0; i < cnt; i++) CHECK(mcc_streamFrame(&s, i + 1, 8, frames[i]) == MCC_STREAM_MORE);
+	CHECK(mcc_streamFrame(&s, 0x7B3E, final(0x12345678, 0, 2, fin), fin) == MCC_STREAM_MORE);		// another device
+	CHECK(mcc_streamFrame(&s, HASH, final(UID_LS88, 1, cnt, fin), fin) == MCC_STREAM_MORE);		// another block
+	CHECK(mcc_streamFrame(&s, HASH, final(UID_LS88, 0, cnt, fin), fin) == MCC_STREAM_DONE);
+	CHECK(s.len == cnt * 8 && !memcmp(s.buf, blk, len));
+
+	memset (&dev, 0, sizeof(dev));
+	CHECK(mcc_parseDevice(s.buf, s.len, &dev));
+	CHECK(dev.measures == 0 && dev.channels == 7 && dev.serial == 0x12345);
+	CHECK(!strcmp(dev.article, "60883") && !strcmp(dev.name, "Link S88"));
+
+	// out of order
+	mcc_streamStart(&s, UID_LS88, 0);
+	for (i = cnt; i > 0; i--) mcc_streamFrame(&s, i, 8, frames[i - 1]);
+	CHECK(mcc_streamFrame(&s, HASH, final(UID_LS88, 0, cnt, fin), fin) == MCC_STREAM_DONE);
+	CHECK(!memcmp(s.buf, blk, len));
+
+	// a lost frame, a wrong frame count and frames that do not fit
+	mcc_streamStart(&s, UID_LS88, 0);
+	for (i = 0; i < cnt; i++) if (i != 2) mcc_streamFrame(&s, i + 1, 8, frames[i]);
+	CHECK(mcc_streamFrame(&s, HASH, final(UID_LS88, 0, cnt, fin), fin) == MCC_STREAM_ERROR);
+	mcc_streamStart(&s, UID_LS88, 0);
+	for (i = 0; i < cnt; i++) mcc_streamFrame(&s, i + 1, 8, frames[i]);
+	CHECK(mcc_streamFrame(&s, HASH, final(UID_LS88, 0, cnt + 1, fin), fin) == MCC_STREAM_ERROR);
+	CHECK(mcc_streamFrame(&s, HASH, final(UID_LS88, 0, 0, fin), fin) == MCC_STREAM_ERROR);
+	CHECK(mcc_streamFrame(&s, MCC_STREAM_FRAMES + 1, 8, frames[0]) == MCC_STREAM_ERROR);
+	CHECK(mcc_streamFrame(&s, 1, 5, frames[0]) == MCC_STREAM_ERROR);
+
+	// a block with the maximum size
+	mcc_streamStart(&s, UID_LS88, 0);
+	for (i = 0; i < MCC_STREAM_FRAMES; i++) mcc_streamFrame(&s, i + 1, 8, frames[i % cnt]);
+	CHECK(mcc_streamFrame(&s, HASH, final(UID_LS88, 0, MCC_STREAM_FRAMES, fin), fin) == MCC_STREAM_DONE);
+	CHECK(s.len == MCC_STREAM_MAX);
+	CHECK(!mcc_parseDevice(s.buf, 15, &dev));
+}
+
+static void testChannels (void)
+{
+	static const uint8_t list[] = { 0x01, MCC_CHTYPE_LIST, 0x03, 0x02, 0, 0, 0, 0, 'M', 'o', 'd', 'e', 0, 'a', 0, 'b', 0, 'c', 0 };
+	uint8_t blk[MCC_STREAM_MAX], frames[MCC_STREAM_FRAMES][8], fin[8];
+	struct mcc_stream s;
+	struct mcc_channel ch;
+	int len, cnt, i;
+
+	CHECK(mcc_parseChannel(list, sizeof(list), &ch));
+	CHECK(ch.index == 1 && ch.type == MCC_CHTYPE_LIST && ch.choices == 3 && ch.value == 2);
+	CHECK(ch.min == 0 && ch.max == 2 && !strcmp(ch.name, "Mode") && !ch.unit[0]);
+
+	len = valueBlock(blk, MCC_LS88_CYCLE1, 10, 1000, 100, "Zykluszeit Bus 1", "ms");
+	cnt = cut(blk, len, frames);
+	mcc_streamStart(&s, UID_LS88, MCC_LS88_CYCLE1);
+	for (i = 0; i < cnt; i++) mcc_streamFrame(&s, i + 1, 8, frames[i]);
+	CHECK(mcc_streamFrame(&s, HASH, final(UID_LS88, MCC_LS88_CYCLE1, cnt, fin), fin) == MCC_STREAM_DONE);
+	CHECK(mcc_parseChannel(s.buf, s.len, &ch));
+	CHECK(ch.index == MCC_LS88_CYCLE1 && ch.type == MCC_CHTYPE_VALUE);
+	CHECK(ch.min == 10 && ch.max == 1000 && ch.value == 100);
+	CHECK(!strcmp(ch.name, "Zykluszeit Bus 1") && !strcmp(ch.unit, "ms"));
+
+	// names that are too long are truncated, strings cut off by the end of the block are terminated
+	len = valueBlock(blk, 2, 0, 31, 4, "Laenge Bus 1 (Anzahl der Module an diesem Bus)", "Module");
+	CHECK(mcc_parseChannel(blk, len, &ch));
+	CHECK(strlen(ch.name) == MCC_NAMELEN - 1 && !strcmp(ch.unit, "Module"));
+	CHECK(mcc_parseChannel(blk, len - 4, &ch));
+	CHECK(!strcmp(ch.unit, "Mod"));
+
+	blk[1] = 7;														// unknown channel type
+	CHECK(!mcc_parseChannel(blk, len, &ch));
+	CHECK(!mcc_parseChannel(blk, 7, &ch));
+}
+
+static void testMapping (void)
+{
+	struct mcc_link links[2];
+
+	memset (links, 0, sizeof(links));
+	links[0].node = 1;
+	links[0].bus[0] = 2;
+	links[0].bus[2] = 1;
+	links[1].node = 2;
+	links[1].bus[1] = 3;
+	CHECK(mcc_layout(links, 2) == 8);
+	CHECK(links[0].base == 0 && links[0].modules == 4);
+	CHECK(links[1].base == 4 && links[1].modules == 4);
+
+	CHECK(mcc_mapContact(links, 2, 1, 1) == 0);					// internal inputs of node 1
+	CHECK(mcc_mapContact(links, 2, 1, 16) == 15);
+	CHECK(mcc_mapContact(links, 2, 1, 17) == -1);
+	CHECK(mcc_mapContact(links, 2, 1, 1001) == 16);				// bus 1
+	CHECK(mcc_mapContact(links, 2, 1, 1032) == 47);
+	CHECK(mcc_mapContact(links, 2, 1, 1033) == -1);
+	CHECK(mcc_mapContact(links, 2, 1, 2001) == -1);				// bus 2 is empty
+	CHECK(mcc_mapContact(links, 2, 1, 3001) == 48);				// bus 3 follows bus 1
+	CHECK(mcc_mapContact(links, 2, 2, 1) == 64);					// node 2
+	CHECK(mcc_mapContact(links, 2, 2, 2048) == 64 + 16 + 47);
+	CHECK(mcc_mapContact(links, 2, 2, 4001) == -1);				// there is no bus 4
+	CHECK(mcc_mapContact(links, 2, 2, 1000) == -1);
+	CHECK(mcc_mapContact(links, 2, 2, 0) == -1);
+	CHECK(mcc_mapContact(links, 2, 3, 1) == -1);					// unknown node
+}
+
+int main (int argc, char **argv)
+{
+	testCommands();
+	testStream();
+	testChannels();
+	testMapping();
+	return check_result("mcancfg_test");
+}
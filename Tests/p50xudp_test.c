@@ -0,0 +1,223 @@
+/*
+ * p50xudp_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief The client table and the shared feedback state of P50Xb over UDP (p50xudp.c)
+ *
+ * The requests of several clients are simulated with their sequence numbers,
+ * lost replies (the request is repeated) and clients that go silent. The
+ * feedback reports are checked for short activations that must reach every
+ * client even if the input is already cleared when the client polls.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "p50xudp.h"
+#include "check.h"
+
+#define MODULES		8
+#define IP(n)		(0x0000A8C0u | ((uint32_t) (n) << 24))		///< 192.168.0.n in network byte order
+#define PORT		0x3A1F
+
+static struct pxu_table tab;
+static struct pxu_fbsnap snap;
+static uint16_t inputs[MODULES];
+static int dropped;
+
+static void drop (struct pxu_client *c)
+{
+	dropped++;
+}
+
+/**
+ * Let a client poll the feedback and compare the report.
+ *
+ * \param c			the client
+ * \param expect	the expected report as module/high/low triples (without the terminating 0)
+ * \param len		the length of the expected report
+ * \param now		the current time
+ * \return			true, if the report is as expected
+ */
+static bool poll (struct pxu_client *c, const uint8_t *expect, int len, uint32_t now)
+{
+	uint8_t buf[3 * MODULES + 1];
+	int rlen, i;
+
+	if (pxu_fbPending(&snap, c, inputs, MODULES) != (len > 0)) {
+		fprintf (stderr, "pending does not match the report\n");
+		return false;
+	}
+	rlen = pxu_fbReport(&snap, &tab, c, inputs, MODULES, buf, now);
+	if (rlen != len + 1 || buf[len] != 0 || memcmp(buf, expect, len)) {
+		fprintf (stderr, "report:");
+		for (i = 0; i < rlen; i++) fprintf (stderr, " %02x", buf[i]);
+		fprintf (stderr, "\n");
+		return false;
+	}
+	return true;
+}
+
+static void input (int module, uint16_t bits)
+{
+	inputs[module] = bits;
+	pxu_fbUpdate(&snap, module, bits);
+}
+
+static void testClients (void)
+{
+	struct pxu_client *c, *c1, *c2;
+	uint32_t now = 1000;
+	int i;
+
+	memset (&tab, 0, sizeof(tab));
+	tab.drop = drop;
+	c1 = pxu_lookup(&tab, IP(10), PORT, now);
+	c2 = pxu_lookup(&tab, IP(10), PORT + 1, now);			// another port is another client
+	CHECK(c1 != c2 && c1->used && c2->used && c1->fball);
+	CHECK(pxu_lookup(&tab, IP(10), PORT, now + 10) == c1 && c1->lastseen == now + 10);
+
+	// the table is full: the client that was idle for the longest time is replaced
+	for (i = 2; i < PXU_MAXCLIENTS; i++) pxu_lookup(&tab, IP(20 + i), PORT, now + 10 + i);
+	CHECK(dropped == 0);
+	c = pxu_lookup(&tab, IP(99), PORT, now + 100);
+	CHECK(c == c2 && dropped == 1 && c->addr == IP(99));
+	CHECK(pxu_lookup(&tab, IP(10), PORT, now + 101) == c1);
+
+	// silent clients are forgotten
+	now += 100 + PXU_IDLE_MS;
+	CHECK(pxu_isActive(c1, now) && !pxu_isActive(&tab.cl[2], now));
+	CHECK(pxu_expire(&tab, now) == PXU_MAXCLIENTS - 1 && dropped == PXU_MAXCLIENTS);
+	CHECK(c1->used && !c->used);
+	now += 2;
+	CHECK(pxu_expire(&tab, now) == 1 && !c1->used);
+}
+
+static void testSequence (void)
+{
+	static const uint8_t ok[] = { 0x00 }, events[PXU_REPLYMAX + 1];
+	struct pxu_client *c;
+	uint8_t seq;
+
+	memset (&tab, 0, sizeof(tab));
+	c = pxu_lookup(&tab, IP(10), PORT, 0);
+	CHECK(pxu_match(c, 0) == PXU_NEW);						// the first request
+	pxu_store(c, 0, ok, sizeof(ok));
+	CHECK(pxu_match(c, 0) == PXU_REPEAT);					// the reply got lost
+	CHECK(c->rlen == 1 && c->reply[0] == 0x00);
+	CHECK(pxu_match(c, 1) == PXU_NEW);
+
+	// a long reply (i.e. the event list) is not cached and executed again
+	pxu_store(c, 1, events, sizeof(events));
+	CHECK(c->rlen == -1 && pxu_match(c, 1) == PXU_REEXEC);
+	pxu_store(c, 2, events, PXU_REPLYMAX);
+	CHECK(pxu_match(c, 2) == PXU_REPEAT && c->rlen == PXU_REPLYMAX);
+
+	// the sequence number wraps
+	for (seq = 3; seq != 2; seq++) {
+		if (pxu_match(c, seq) != PXU_NEW) break;
+		pxu_store(c, seq, ok, sizeof(ok));
+	}
+	CHECK(seq == 2 && c->seq == 1);
+
+	// a client that was forgotten and comes back starts anew
+	c = pxu_lookup(&tab, IP(10), PORT, PXU_IDLE_MS + 10);
+	CHECK(pxu_match(c, 1) == PXU_NEW && c->fball);
+}
+
+static void testFeedback (void)
+{
+	struct pxu_client *a, *b, *n;
+	uint32_t now = 0;
+
+	memset (&tab, 0, sizeof(tab));
+	memset (&snap, 0, sizeof(snap));
+	memset (inputs, 0, sizeof(inputs));
+	a = pxu_lookup(&tab, IP(10), PORT, now);
+	b = pxu_lookup(&tab, IP(11), PORT, now);
+
+	// a new client gets all modules with set inputs
+	input(2, 0x8001);
+	CHECK(poll(a, (uint8_t []) { 3, 0x80, 0x01 }, 3, now));
+	CHECK(poll(a, NULL, 0, now));
+	CHECK(poll(b, (uint8_t []) { 3, 0x80, 0x01 }, 3, now));
+
+	// a short activation is latched until both clients have seen it
+	input(5, 0x0010);
+	input(5, 0x0000);
+	CHECK(poll(a, (uint8_t []) { 6, 0x00, 0x10 }, 3, now));
+	CHECK(snap.latch[5] == 0x0010);							// b has not seen it
+	CHECK(poll(a, NULL, 0, now));
+	CHECK(poll(b, (uint8_t []) { 6, 0x00, 0x10 }, 3, now));
+	CHECK(snap.latch[5] == 0);
+	CHECK(poll(a, (uint8_t []) { 6, 0x00, 0x00 }, 3, now));		// now both learn that it was cleared
+	CHECK(poll(b, (uint8_t []) { 6, 0x00, 0x00 }, 3, now));
+	CHECK(poll(a, NULL, 0, now) && poll(b, NULL, 0, now));
+
+	// an input that stays set is reported once to each client
+	input(0, 0x0100);
+	CHECK(poll(b, (uint8_t []) { 1, 0x01, 0x00 }, 3, now));
+	CHECK(poll(a, (uint8_t []) { 1, 0x01, 0x00 }, 3, now));
+	CHECK(poll(a, NULL, 0, now) && poll(b, NULL, 0, now));
+
+	// a client that joins later sees the current state including latched inputs
+	// (and the modules that were cleared before)
+	input(7, 0x0002);
+	input(7, 0x0000);
+	CHECK(poll(a, (uint8_t []) { 8, 0x00, 0x02 }, 3, now));
+	n = pxu_lookup(&tab, IP(12), PORT, now);
+	CHECK(poll(n, (uint8_t []) { 1, 0x01, 0x00, 3, 0x80, 0x01, 6, 0x00, 0x00, 8, 0x00, 0x02 }, 12, now));
+
+	// a silent client does not hold the latches forever
+	now += PXU_IDLE_MS - 1000;
+	pxu_lookup(&tab, IP(10), PORT, now);
+	pxu_lookup(&tab, IP(12), PORT, now);
+	now += 2000;
+	CHECK(!pxu_isActive(b, now) && pxu_isActive(a, now));
+	input(4, 0x4000);
+	input(4, 0x0000);
+	CHECK(poll(n, (uint8_t []) { 5, 0x40, 0x00 }, 3, now));
+	CHECK(poll(a, (uint8_t []) { 5, 0x40, 0x00, 8, 0x00, 0x00 }, 6, now));		// module 8 was released by the poll of n
+	CHECK(snap.latch[4] == 0 && snap.latch[7] == 0);
+
+	// pxu_fbReset() lets the next poll report all modules again
+	pxu_fbReset(a);
+	CHECK(poll(a, (uint8_t []) { 1, 0x01, 0x00, 3, 0x80, 0x01, 5, 0x00, 0x00, 6, 0x00, 0x00, 8, 0x00, 0x00 }, 15, now));
+
+	// out of range modules are ignored
+	pxu_fbUpdate(&snap, PXU_FBMODULES, 0xFFFF);
+	pxu_fbUpdate(&snap, -1, 0xFFFF);
+	CHECK(poll(n, (uint8_t []) { 5, 0x00, 0x00, 8, 0x00, 0x00 }, 6, now));
+}
+
+int main (int argc, char **argv)
+{
+	testClients();
+	testSequence();
+	testFeedback();
+	return check_result("p50xudp_test");
+}
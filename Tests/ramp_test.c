@@ -0,0 +1,249 @@
+/*
+ * ramp_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief The acceleration and braking curves (ramp.c)
+ *
+ * The ramp engine in loco.c calls ramp_advance() for every loco with a
+ * running ramp in a fixed tick. The simulation here does the same with
+ * different ticks and checks the time a ramp takes, the shape of the curves
+ * and the handling of a change of direction.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ramp.h"
+#include "check.h"
+
+#define FWD(s)			(0x80 | (s))	///< forward with speed step s
+#define REV(s)			(s)				///< reverse with speed step s
+
+static const int maxspeeds[] = { 14, 27, 28, 126 };
+static const uint16_t times[] = { 1, 50, 777, 3000, 10000, 60000 };
+
+/**
+ * Run a ramp like the ramp engine does.
+ *
+ * \param p			the momentum profile
+ * \param maxspeed	the number of speed steps
+ * \param from		the current speed
+ * \param to		the target speed
+ * \param tick		the tick of the ramp engine in ms
+ * \return			the time in ms until the target is reached
+ */
+static uint32_t run (const struct ramp_profile *p, int maxspeed, int from, int to, uint32_t tick)
+{
+	uint32_t acc = 0, elapsed = 0;
+	int cur = from;
+
+	while (ramp_advance(p, maxspeed, &cur, to, &acc, tick)) {
+		elapsed += tick;
+		CHECK(acc < 65536);
+		if (elapsed > 3 * RAMP_MAXTIME) return UINT32_MAX;
+	}
+	return elapsed + tick;
+}
+
+/**
+ * The steps add up to the configured time for every curve and decoder.
+ */
+static void testSum (void)
+{
+	struct ramp_profile p;
+	uint32_t sum, t;
+	int c, m, i, s;
+
+	for (c = RAMP_LINEAR; c <= RAMP_EXPRESS; c++) {
+		for (m = 0; m < (int) (sizeof(maxspeeds) / sizeof(maxspeeds[0])); m++) {
+			for (i = 0; i < (int) (sizeof(times) / sizeof(times[0])); i++) {
+				p.accel = times[i];
+				p.decel = times[i] / 2;
+				p.curve = c;
+				sum = 0;
+				for (s = 0; s < maxspeeds[m]; s++) sum += ramp_stepTime(&p, maxspeeds[m], s, true);
+				CHECK(sum == p.accel);
+				sum = 0;
+				for (s = 0; s < maxspeeds[m]; s++) sum += ramp_stepTime(&p, maxspeeds[m], s, false);
+				CHECK(sum == p.decel);
+			}
+		}
+	}
+
+	// times above the maximum are clipped
+	p.accel = RAMP_MAXTIME + 5000;
+	p.curve = RAMP_LINEAR;
+	for (s = 0, sum = 0; s < 126; s++) sum += ramp_stepTime(&p, 126, s, true);
+	CHECK(sum == RAMP_MAXTIME);
+
+	// invalid arguments
+	CHECK(ramp_stepTime(NULL, 126, 5, true) == 0);
+	CHECK(ramp_stepTime(&p, 0, 5, true) == 0);
+	t = ramp_stepTime(&p, 28, 27, true);
+	CHECK(ramp_stepTime(&p, 28, 40, true) == t);
+	CHECK(ramp_stepTime(&p, 28, -3, true) == ramp_stepTime(&p, 28, 0, true));
+}
+
+/**
+ * The shape of the curves: a soft ramp starts slowly, an express ramp
+ * reaches the top speed slowly, a linear ramp has steps of equal length.
+ */
+static void testShape (void)
+{
+	struct ramp_profile p = { .accel = 12600, .decel = 12600 };
+	uint32_t t0, tmid, tmax;
+
+	p.curve = RAMP_LINEAR;
+	CHECK(ramp_stepTime(&p, 126, 0, true) == 100);
+	CHECK(ramp_stepTime(&p, 126, 60, true) == 100);
+	CHECK(ramp_stepTime(&p, 126, 125, false) == 100);
+
+	p.curve = RAMP_SOFT;
+	t0 = ramp_stepTime(&p, 126, 0, true);
+	tmid = ramp_stepTime(&p, 126, 63, true);
+	tmax = ramp_stepTime(&p, 126, 125, true);
+	CHECK(t0 > tmid && tmid > tmax);
+	CHECK(t0 + 4 >= 2 * tmax && t0 <= 2 * tmax + 4);	// the weights are 2 * max and max + 1 (the steps are rounded to ms)
+
+	p.curve = RAMP_EXPRESS;
+	t0 = ramp_stepTime(&p, 126, 0, true);
+	tmid = ramp_stepTime(&p, 126, 63, true);
+	tmax = ramp_stepTime(&p, 126, 125, true);
+	CHECK(t0 < tmid && tmid < tmax);
+	CHECK(tmax + 4 >= 2 * t0 && tmax <= 2 * t0 + 4);
+}
+
+/**
+ * A full ramp takes the configured time, independent of the tick of the
+ * ramp engine (it is only rounded up to the next tick).
+ */
+static void testDuration (void)
+{
+	static const uint32_t ticks[] = { 1, 7, 20, 50, 333 };
+	struct ramp_profile p;
+	uint32_t t;
+	int c, i;
+
+	for (c = RAMP_LINEAR; c <= RAMP_EXPRESS; c++) {
+		p.accel = 4000;
+		p.decel = 2500;
+		p.curve = c;
+		for (i = 0; i < (int) (sizeof(ticks) / sizeof(ticks[0])); i++) {
+			t = run(&p, 126, FWD(0), FWD(126), ticks[i]);
+			CHECK(t >= p.accel && t < p.accel + ticks[i]);
+			t = run(&p, 28, REV(28), REV(0), ticks[i]);
+			CHECK(t >= p.decel && t < p.decel + ticks[i]);
+			// a change of direction brakes first and then accelerates
+			t = run(&p, 126, FWD(126), REV(126), ticks[i]);
+			CHECK(t >= p.accel + p.decel && t < p.accel + p.decel + ticks[i]);
+		}
+	}
+
+	// half the speed range takes half the time on a linear ramp
+	p.curve = RAMP_LINEAR;
+	t = run(&p, 126, FWD(0), FWD(63), 1);
+	CHECK(t >= 1999 && t <= 2001);
+}
+
+/**
+ * The ramp engine changes the target while a ramp is running.
+ */
+static void testRetarget (void)
+{
+	struct ramp_profile p = { .accel = 2800, .decel = 1400, .curve = RAMP_LINEAR };
+	uint32_t acc = 0;
+	int cur = FWD(0);
+
+	CHECK(ramp_advance(&p, 28, &cur, FWD(28), &acc, 1050));		// 100ms per step
+	CHECK(cur == FWD(10) && acc == 50);
+	CHECK(ramp_advance(&p, 28, &cur, FWD(5), &acc, 100));		// now braking with 50ms per step
+	CHECK(cur == FWD(7) && acc == 0);
+	CHECK(!ramp_advance(&p, 28, &cur, FWD(5), &acc, 100));
+	CHECK(cur == FWD(5) && acc == 0);							// the rest of the time is dropped at the target
+
+	// stopped: the direction changes at once
+	cur = FWD(0);
+	CHECK(!ramp_advance(&p, 28, &cur, REV(0), &acc, 0));
+	CHECK(cur == REV(0));
+
+	// the ramp does not advance without time
+	cur = REV(3);
+	CHECK(ramp_advance(&p, 28, &cur, FWD(3), &acc, 0));
+	CHECK(cur == REV(3));
+	CHECK(ramp_advance(&p, 28, &cur, FWD(3), &acc, 150));		// 3 steps down, the direction change is free
+	CHECK(cur == FWD(0));
+	CHECK(!ramp_advance(&p, 28, &cur, FWD(3), &acc, 300));
+	CHECK(cur == FWD(3));
+}
+
+/**
+ * A profile without momentum.
+ */
+static void testNoMomentum (void)
+{
+	struct ramp_profile p = { 0 };
+	uint32_t acc = 0;
+	int cur = FWD(100);
+
+	CHECK(!ramp_active(&p));
+	CHECK(!ramp_active(NULL));
+	CHECK(!ramp_advance(&p, 126, &cur, REV(20), &acc, 0));
+	CHECK(cur == REV(20));
+
+	// momentum only for braking
+	p.decel = 1260;
+	CHECK(ramp_active(&p));
+	cur = FWD(0);
+	CHECK(!ramp_advance(&p, 126, &cur, FWD(126), &acc, 0));
+	CHECK(ramp_advance(&p, 126, &cur, FWD(0), &acc, 0));
+	CHECK(run(&p, 126, FWD(126), FWD(0), 10) == 1260);
+}
+
+static void testStrings (void)
+{
+	int c;
+
+	for (c = RAMP_LINEAR; c <= RAMP_EXPRESS; c++) {
+		CHECK(ramp_string2curve(ramp_curve2string(c)) == (enum ramp_curve) c);
+	}
+	CHECK(!strcmp(ramp_curve2string(RAMP_SOFT), "soft"));
+	CHECK(ramp_string2curve("Express") == RAMP_EXPRESS);
+	CHECK(ramp_string2curve("bumpy") == RAMP_LINEAR);
+	CHECK(ramp_string2curve(NULL) == RAMP_LINEAR);
+	CHECK(!strcmp(ramp_curve2string((enum ramp_curve) 17), "linear"));
+}
+
+int main (void)
+{
+	testSum();
+	testShape();
+	testDuration();
+	testRetarget();
+	testNoMomentum();
+	testStrings();
+
+	return check_result("ramp_test");
+}
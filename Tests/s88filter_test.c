@@ -0,0 +1,288 @@
+/*
+ * s88filter_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief The debouncing of the s88 inputs (s88filter.c)
+ *
+ * s88.c feeds every scan of the bus through s88f_apply(). The tests here do
+ * the same with made up input sequences: steady edges to measure the delay
+ * of each profile in scans, short bounces that must be suppressed and long
+ * random sequences that are compared with a straight forward model of the
+ * N-of-M rules.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "s88filter.h"
+#include "check.h"
+
+#define MODULES			8					///< the number of modules used in the simulations
+#define INPUTS			(MODULES * 16)		///< the number of inputs used in the simulations
+
+static struct s88f_config cnf;
+static struct s88filter filter;
+
+/**
+ * Run one scan with the given input set to the given state and all other
+ * inputs free.
+ *
+ * \param input		the 0-based input number
+ * \param occupied	the raw state of this input
+ * \return			the filtered state of this input after the scan
+ */
+static bool scan (int input, bool occupied)
+{
+	uint16_t raw[MODULES], out[MODULES];
+
+	memset (raw, 0, sizeof(raw));
+	if (occupied) raw[input >> 4] = 0x8000 >> (input & 15);
+	s88f_apply(&filter, MODULES, raw, out);
+	return !!(out[input >> 4] & (0x8000 >> (input & 15)));
+}
+
+/**
+ * Count the scans from a steady raw edge to the filtered edge. The input is
+ * held in the opposite state for a full window first, so the samples before
+ * the edge do not count for the new state.
+ *
+ * \param input		the 0-based input number
+ * \param occupied	the new raw state of the input
+ * \return			the number of scans until the output follows (1 = at once)
+ */
+static int edge (int input, bool occupied)
+{
+	int n;
+
+	for (n = 0; n < S88F_MAXSAMPLES; n++) scan(input, !occupied);
+	if (scan(input, !occupied) == occupied) return -1;
+	for (n = 1; n <= 2 * S88F_MAXSAMPLES; n++) {
+		if (scan(input, occupied) == occupied) return n;
+	}
+	return -1;
+}
+
+static void test_config (void)
+{
+	int i;
+
+	s88f_defaults(&cnf);
+	CHECK(cnf.profile[0].onN == 1 && cnf.profile[0].onM == 1 && cnf.profile[0].offN == 1 && cnf.profile[0].offM == 1);
+	for (i = 0; i < S88F_MODULES; i++) CHECK(cnf.map[i] == 0);
+
+	CHECK(!s88f_setProfile(&cnf, 0, 1, 2, 1, 1));		// profile 0 is fixed
+	CHECK(s88f_setProfile(&cnf, 0, 1, 1, 1, 1));
+	CHECK(!s88f_setProfile(&cnf, S88F_PROFILES, 1, 1, 1, 1));
+	CHECK(!s88f_setProfile(&cnf, 1, 0, 1, 1, 1));
+	CHECK(!s88f_setProfile(&cnf, 1, 3, 2, 1, 1));
+	CHECK(!s88f_setProfile(&cnf, 1, 1, 1, 1, S88F_MAXSAMPLES + 1));
+	CHECK(s88f_setProfile(&cnf, 1, 1, 1, S88F_MAXSAMPLES, S88F_MAXSAMPLES));
+	CHECK(cnf.profile[1].offN == S88F_MAXSAMPLES);
+
+	CHECK(!s88f_setInputProfile(&cnf, -1, 1));
+	CHECK(!s88f_setInputProfile(&cnf, S88F_MODULES * 16, 1));
+	CHECK(!s88f_setInputProfile(&cnf, 0, S88F_PROFILES));
+	CHECK(s88f_setInputProfile(&cnf, 0, 3));			// input #1 of module 1 is the MSB pair
+	CHECK(cnf.map[0] == 0xC0000000);
+	CHECK(s88f_setInputProfile(&cnf, 31, 2));			// input #16 of module 2 is the LSB pair
+	CHECK(cnf.map[1] == 0x00000002);
+	CHECK(s88f_getInputProfile(&cnf, 0) == 3);
+	CHECK(s88f_getInputProfile(&cnf, 1) == 0);
+	CHECK(s88f_getInputProfile(&cnf, 31) == 2);
+	CHECK(s88f_getInputProfile(&cnf, S88F_MODULES * 16) == 0);
+	CHECK(s88f_setInputProfile(&cnf, 0, 0));
+	CHECK(cnf.map[0] == 0);
+}
+
+/**
+ * The pass thru profile copies the raw data, even if the output is the
+ * same array as the input.
+ */
+static void test_passthru (void)
+{
+	uint16_t raw[S88F_MODULES + 2], out[S88F_MODULES + 2];
+	int i, n;
+
+	s88f_defaults(&cnf);
+	s88f_init(&filter, &cnf);
+	for (n = 0; n < 100; n++) {
+		for (i = 0; i < S88F_MODULES + 2; i++) raw[i] = rand();
+		out[S88F_MODULES] = out[S88F_MODULES + 1] = 0x5555;
+		s88f_apply(&filter, S88F_MODULES + 2, raw, out);	// surplus modules are ignored
+		CHECK(!memcmp(raw, out, S88F_MODULES * sizeof(*out)));
+		CHECK(out[S88F_MODULES] == 0x5555 && out[S88F_MODULES + 1] == 0x5555);
+		memcpy (out, raw, sizeof(out));
+		s88f_apply(&filter, S88F_MODULES, out, out);
+		CHECK(!memcmp(raw, out, S88F_MODULES * sizeof(*out)));
+	}
+}
+
+/**
+ * After a steady signal, an input switches ON after onN and OFF after offN
+ * scans, no matter how large the windows are.
+ */
+static void test_edges (void)
+{
+	static const struct s88f_profile profiles[] = {
+		{ 1, 1, 1, 1 }, { 1, 1, 3, 3 }, { 2, 3, 2, 3 }, { 3, 4, 4, 4 },
+		{ 1, 16, 16, 16 }, { 16, 16, 1, 16 }, { 5, 9, 7, 12 },
+	};
+	const struct s88f_profile *p;
+	int i, input;
+
+	s88f_defaults(&cnf);
+	for (i = 0; i < (int) (sizeof(profiles) / sizeof(profiles[0])); i++) {
+		p = &profiles[i];
+		CHECK(s88f_setProfile(&cnf, 1, p->onN, p->onM, p->offN, p->offM));
+		for (input = 0; input < INPUTS; input += 13) {
+			s88f_setInputProfile(&cnf, input, 1);
+			s88f_init(&filter, &cnf);
+			CHECK(edge(input, true) == p->onN);
+			CHECK(edge(input, false) == p->offN);
+			CHECK(edge(input, true) == p->onN);
+			CHECK(edge(input, false) == p->offN);
+			s88f_setInputProfile(&cnf, input, 0);
+		}
+	}
+}
+
+/**
+ * Short bounces within a window are filtered, the ones that exceed the
+ * rule get through.
+ */
+static void test_bounce (void)
+{
+	int input = 21;
+
+	s88f_defaults(&cnf);
+	s88f_setInputProfile(&cnf, input, 2);				// 2 of 3 in both directions
+	s88f_init(&filter, &cnf);
+
+	// single pulses with at least two free scans in between never switch ON
+	for (int n = 0; n < 10; n++) {
+		CHECK(!scan(input, true));
+		CHECK(!scan(input, false));
+		CHECK(!scan(input, false));
+	}
+	// two pulses within three scans do
+	CHECK(!scan(input, true));
+	CHECK(!scan(input, false));
+	CHECK(scan(input, true));
+	CHECK(scan(input, true));
+	// single drop outs are bridged
+	for (int n = 0; n < 10; n++) {
+		CHECK(scan(input, false));
+		CHECK(scan(input, true));
+		CHECK(scan(input, true));
+	}
+	// two drop outs within three scans switch OFF
+	CHECK(scan(input, false));
+	CHECK(scan(input, true));
+	CHECK(!scan(input, false));
+
+	// profile 1 reports occupancy at once and bridges two free scans
+	s88f_setInputProfile(&cnf, input, 1);
+	s88f_init(&filter, &cnf);
+	CHECK(scan(input, true));
+	CHECK(scan(input, false));
+	CHECK(scan(input, false));
+	CHECK(scan(input, true));
+	CHECK(scan(input, false));
+	CHECK(scan(input, false));
+	CHECK(!scan(input, false));
+}
+
+/**
+ * A straight forward model of the N-of-M rules with the samples of each input
+ * kept in an array. Samples before the start count as free.
+ */
+struct model {
+	bool	samples[S88F_MAXSAMPLES];			///< the most recent samples, [0] is the newest
+	bool	state;								///< the filtered state
+};
+
+static bool model_apply (struct model *m, const struct s88f_profile *p, bool sample)
+{
+	int i, n;
+
+	memmove (&m->samples[1], &m->samples[0], sizeof(m->samples) - sizeof(m->samples[0]));
+	m->samples[0] = sample;
+	if (m->state) {
+		for (i = n = 0; i < p->offM; i++) if (!m->samples[i]) n++;
+		if (n >= p->offN) m->state = false;
+	} else {
+		for (i = n = 0; i < p->onM; i++) if (m->samples[i]) n++;
+		if (n >= p->onN) m->state = true;
+	}
+	return m->state;
+}
+
+static void test_random (void)
+{
+	static struct model models[INPUTS];
+	uint16_t raw[MODULES], out[MODULES];
+	int i, n, onM, offM, scans, density;
+	bool s;
+
+	s88f_defaults(&cnf);
+	for (i = 1; i < S88F_PROFILES; i++) {
+		onM = 1 + rand() % S88F_MAXSAMPLES;
+		offM = 1 + rand() % S88F_MAXSAMPLES;
+		CHECK(s88f_setProfile(&cnf, i, 1 + rand() % onM, onM, 1 + rand() % offM, offM));
+	}
+	for (i = 0; i < INPUTS; i++) s88f_setInputProfile(&cnf, i, (i < 16) ? 0 : rand() % S88F_PROFILES);
+	s88f_init(&filter, &cnf);
+	memset (models, 0, sizeof(models));
+
+	for (scans = 0; scans < 20000; scans++) {
+		memset (raw, 0, sizeof(raw));
+		density = (scans / 1000) % 4;		// phases with mostly free, mixed and mostly occupied inputs
+		for (i = 0; i < INPUTS; i++) {
+			n = rand() % 8;
+			if ((density == 0 && n == 0) || (density == 1 && n < 4) || (density >= 2 && n != 0)) {
+				raw[i >> 4] |= 0x8000 >> (i & 15);
+			}
+		}
+		s88f_apply(&filter, MODULES, raw, out);
+		for (i = 0; i < INPUTS; i++) {
+			s = model_apply(&models[i], &cnf.profile[s88f_getInputProfile(&cnf, i)], !!(raw[i >> 4] & (0x8000 >> (i & 15))));
+			CHECK(s == !!(out[i >> 4] & (0x8000 >> (i & 15))));
+		}
+	}
+}
+
+int main (void)
+{
+	srand(1);
+	test_config();
+	test_passthru();
+	test_edges();
+	test_bounce();
+	test_random();
+	return check_result("s88filter_test");
+}
@@ -0,0 +1,307 @@
+/*
+ * sessrec_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief The records and the playback timing of the session recorder (sessrec.c)
+ *
+ * session.c writes each record with sess_encode() and reads it back with
+ * sess_decode() for the playback, where sess_schedule() decides when it is
+ * executed. The tests here do the same without files: records of all types
+ * go through the codec, values that exceed their field are saturated and
+ * the scheduler is asked right before, at and after the due times, across a
+ * wrap of the ms counter and with feedback triggers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "session.h"
+#include "check.h"
+
+/// the widths of v1 and v2 in bytes, as documented in session.h
+static const int widths[SESS_TYPES][2] = {
+	[SESS_START] = { 4, 0 }, [SESS_SPEED] = { 1, 0 }, [SESS_FUNC] = { 4, 4 }, [SESS_ESTOP] = { 0, 0 },
+	[SESS_TURNOUT] = { 1, 2 }, [SESS_TRACKMODE] = { 1, 0 }, [SESS_FEEDBACK] = { 2, 2 }, [SESS_LOST] = { 2, 0 },
+};
+
+static uint32_t random32 (void)
+{
+	return ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+}
+
+static uint32_t fieldmax (int width)
+{
+	return (width >= 4) ? 0xFFFFFFFF : (1u << (8 * width)) - 1;
+}
+
+static bool same (const struct sess_rec *a, const struct sess_rec *b)
+{
+	return a->ts == b->ts && a->type == b->type && a->src == b->src && a->adr == b->adr && a->v1 == b->v1 && a->v2 == b->v2;
+}
+
+static void test_layout (void)
+{
+	struct sess_rec r = { .ts = 0x12345678, .type = SESS_TURNOUT, .src = 0x0203, .adr = 0x0405, .v1 = 3, .v2 = 0x0607 };
+	static const uint8_t expect[] = { SESS_SYNC, 14, SESS_TURNOUT, 0x78, 0x56, 0x34, 0x12, 0x03, 0x02, 0x05, 0x04, 0x03, 0x07, 0x06 };
+	uint8_t buf[SESS_MAXSIZE];
+
+	CHECK(sess_encode(&r, buf, sizeof(buf)) == (int) sizeof(expect));
+	CHECK(!memcmp(buf, expect, sizeof(expect)));
+}
+
+static void test_roundtrip (void)
+{
+	uint8_t buf[SESS_MAXSIZE + 1], stream[64 * SESS_MAXSIZE];
+	struct sess_rec r, d, recs[64];
+	int i, n, type, len, pos;
+
+	for (n = 0; n < 10000; n++) {
+		type = n % SESS_TYPES;
+		memset (&r, 0, sizeof(r));
+		r.type = type;
+		r.ts = random32();
+		r.src = random32();
+		r.adr = random32();
+		r.v1 = random32() & fieldmax(widths[type][0]);
+		r.v2 = random32() & fieldmax(widths[type][1]);
+		if (!widths[type][0]) r.v1 = 0;
+		if (!widths[type][1]) r.v2 = 0;
+		len = sess_encode(&r, buf, sizeof(buf));
+		CHECK(len == SESS_HEADER + widths[type][0] + widths[type][1]);
+		CHECK(len <= SESS_MAXSIZE);
+		CHECK(sess_encode(&r, buf, len - 1) == 0);			// buffer too small
+		memset (&d, 0x55, sizeof(d));
+		CHECK(sess_decode(buf, len, &d) == len);
+		CHECK(same(&r, &d));
+		for (i = 0; i < len; i++) CHECK(sess_decode(buf, i, &d) == 0);	// incomplete
+	}
+
+	// a stream of records is decoded record by record
+	for (i = pos = 0; i < 64; i++) {
+		memset (&recs[i], 0, sizeof(recs[i]));
+		recs[i].type = random32() % SESS_TYPES;
+		recs[i].ts = i * 100;
+		recs[i].adr = i;
+		recs[i].v1 = random32() & fieldmax(widths[recs[i].type][0]);
+		recs[i].v2 = random32() & fieldmax(widths[recs[i].type][1]);
+		pos += sess_encode(&recs[i], stream + pos, sizeof(stream) - pos);
+	}
+	for (i = 0, n = 0; n < pos && i < 64; i++) {
+		len = sess_decode(stream + n, pos - n, &d);
+		CHECK(len > 0);
+		if (len <= 0) break;
+		CHECK(same(&recs[i], &d));
+		n += len;
+	}
+	CHECK(i == 64 && n == pos);
+}
+
+static void test_invalid (void)
+{
+	struct sess_rec r = { .type = SESS_SPEED, .adr = 3, .v1 = 0x85 };
+	uint8_t buf[SESS_MAXSIZE], bad[SESS_MAXSIZE];
+	int len;
+
+	len = sess_encode(&r, buf, sizeof(buf));
+	CHECK(len == SESS_HEADER + 1);
+
+	r.type = SESS_TYPES;
+	CHECK(sess_encode(&r, bad, sizeof(bad)) == 0);
+	CHECK(sess_encode(NULL, bad, sizeof(bad)) == 0);
+
+	memcpy (bad, buf, len);
+	bad[0] ^= 0xFF;
+	CHECK(sess_decode(bad, len, &r) == -1);				// no sync
+	memcpy (bad, buf, len);
+	bad[1] = len + 1;
+	CHECK(sess_decode(bad, len, &r) == -1);				// length does not match the type
+	memcpy (bad, buf, len);
+	bad[2] = SESS_TYPES;
+	CHECK(sess_decode(bad, len, &r) == -1);				// unknown type
+	CHECK(sess_decode(NULL, len, &r) == -1);
+	CHECK(sess_decode(buf, len, NULL) == -1);
+}
+
+/**
+ * Values that do not fit into their field are saturated. Only the time of
+ * a turnout can exceed its field when coming from trnt_switchTimed().
+ */
+static void test_saturation (void)
+{
+	static const uint32_t times[] = { 0, 1, 65534, 65535, 65536, 70000, 0x7FFFFFFF, 0xFFFFFFFF };
+	struct sess_rec r, d;
+	uint8_t buf[SESS_MAXSIZE];
+	unsigned i;
+
+	for (i = 0; i < sizeof(times) / sizeof(times[0]); i++) {
+		memset (&r, 0, sizeof(r));
+		r.type = SESS_TURNOUT;
+		r.adr = 17;
+		r.v1 = 3;
+		r.v2 = times[i];
+		CHECK(sess_encode(&r, buf, sizeof(buf)) == SESS_HEADER + 3);
+		CHECK(sess_decode(buf, sizeof(buf), &d) == SESS_HEADER + 3);
+		CHECK(d.v2 == ((times[i] > SESS_MAXTIME) ? SESS_MAXTIME : times[i]));
+		CHECK(d.v1 == 3 && d.adr == 17);
+	}
+
+	memset (&r, 0, sizeof(r));
+	r.type = SESS_SPEED;
+	r.v1 = 0x1FF;
+	sess_encode(&r, buf, sizeof(buf));
+	CHECK(sess_decode(buf, sizeof(buf), &d) > 0 && d.v1 == 0xFF);
+	r.type = SESS_FEEDBACK;
+	r.v1 = 0x12345;
+	r.v2 = 0x1234;
+	sess_encode(&r, buf, sizeof(buf));
+	CHECK(sess_decode(buf, sizeof(buf), &d) > 0 && d.v1 == 0xFFFF && d.v2 == 0x1234);
+	r.type = SESS_FUNC;
+	r.v1 = 0xFFFFFFFF;
+	r.v2 = 0x80000001;
+	sess_encode(&r, buf, sizeof(buf));
+	CHECK(sess_decode(buf, sizeof(buf), &d) > 0 && d.v1 == 0xFFFFFFFF && d.v2 == 0x80000001);
+}
+
+/**
+ * A command is executed exactly when its time stamp is reached, measured
+ * from the base time. The result must not change at a wrap of the ms counter.
+ */
+static void test_schedule (void)
+{
+	static const uint32_t starts[] = { 0, 1000, 0xFFFFFF00, 0xFFFFFFFF, 0x7FFFFFF0 };
+	static const uint8_t types[] = { SESS_SPEED, SESS_FUNC, SESS_ESTOP, SESS_TURNOUT, SESS_TRACKMODE };
+	struct sess_player p;
+	struct sess_rec r;
+	uint32_t wait, start;
+	unsigned i, t;
+
+	for (i = 0; i < sizeof(starts) / sizeof(starts[0]); i++) {
+		start = starts[i];
+		for (t = 0; t < sizeof(types); t++) {
+			memset (&r, 0, sizeof(r));
+			r.type = types[t];
+			r.ts = 500;
+			sess_playerStart(&p, start, false);
+			wait = 0;
+			CHECK(sess_schedule(&p, &r, start, 0, &wait) == SESS_WAIT && wait == 500);
+			CHECK(sess_schedule(&p, &r, start + 499, 0, &wait) == SESS_WAIT && wait == 1);
+			CHECK(sess_schedule(&p, &r, start + 500, 0, &wait) == SESS_EXEC);
+			CHECK(sess_schedule(&p, &r, start + 501, 0, &wait) == SESS_EXEC);
+			CHECK(sess_schedule(&p, &r, start + 100000, 0, NULL) == SESS_EXEC);	// late records are executed at once
+			CHECK(sess_schedule(&p, &r, start + 499, 0, NULL) == SESS_WAIT);		// no wait pointer needed
+			r.ts = 0;
+			CHECK(sess_schedule(&p, &r, start, 0, &wait) == SESS_EXEC);
+		}
+	}
+
+	// records without an action
+	sess_playerStart(&p, 1000, true);
+	memset (&r, 0, sizeof(r));
+	r.type = SESS_LOST;
+	CHECK(sess_schedule(&p, &r, 1000, 0, &wait) == SESS_SKIP);
+	r.type = SESS_TYPES;
+	CHECK(sess_schedule(&p, &r, 1000, 0, &wait) == SESS_SKIP);
+	CHECK(sess_schedule(&p, NULL, 1000, 0, &wait) == SESS_SKIP);
+	CHECK(sess_schedule(NULL, &r, 1000, 0, &wait) == SESS_SKIP);
+	CHECK(p.base == 1000);
+
+	// the start of the next file of a rotated recording re-bases the time stamps
+	memset (&r, 0, sizeof(r));
+	r.type = SESS_START;
+	r.ts = 300000;
+	CHECK(sess_schedule(&p, &r, 5000, 0, &wait) == SESS_SKIP);
+	CHECK(p.base == (uint32_t) (5000 - 300000));
+	r.type = SESS_SPEED;
+	r.ts = 300010;
+	CHECK(sess_schedule(&p, &r, 5009, 0, &wait) == SESS_WAIT && wait == 1);
+	CHECK(sess_schedule(&p, &r, 5010, 0, &wait) == SESS_EXEC);
+}
+
+/**
+ * A feedback change is waited for when the triggers are enabled. The
+ * following records keep their distance to the moment it happened again.
+ */
+static void test_triggers (void)
+{
+	struct sess_player p;
+	struct sess_rec fb, cmd;
+	uint32_t wait;
+
+	memset (&fb, 0, sizeof(fb));
+	fb.type = SESS_FEEDBACK;
+	fb.ts = 10000;
+	fb.adr = 2;
+	fb.v1 = 0x8001;						// the new status
+	fb.v2 = 0x0001;						// only this bit changed
+	memset (&cmd, 0, sizeof(cmd));
+	cmd.type = SESS_SPEED;
+	cmd.ts = 12500;
+
+	// without triggers, the feedback is only information
+	sess_playerStart(&p, 0, false);
+	CHECK(sess_schedule(&p, &fb, 3000, 0x0000, &wait) == SESS_SKIP);
+	CHECK(p.base == 0);
+	CHECK(sess_schedule(&p, &cmd, 12499, 0, &wait) == SESS_WAIT && wait == 1);
+
+	// with triggers, the playback waits until the changed bits have the recorded state
+	sess_playerStart(&p, 0, true);
+	wait = 0;
+	CHECK(sess_schedule(&p, &fb, 3000, 0x8000, &wait) == SESS_WAIT && wait == SESS_TRIGGER_POLL);
+	CHECK(sess_schedule(&p, &fb, 20000, 0xFFFE, &wait) == SESS_WAIT);
+	CHECK(p.base == 0);
+	CHECK(sess_schedule(&p, &fb, 25000, 0x0001, &wait) == SESS_SKIP);	// other bits do not matter
+	CHECK(p.base == 25000 - 10000);
+	CHECK(sess_schedule(&p, &cmd, 27499, 0, &wait) == SESS_WAIT && wait == 1);
+	CHECK(sess_schedule(&p, &cmd, 27500, 0, &wait) == SESS_EXEC);
+
+	// an early trigger moves the rest of the timeline forward
+	sess_playerStart(&p, 100, true);
+	CHECK(sess_schedule(&p, &fb, 4100, 0x0001, &wait) == SESS_SKIP);
+	CHECK(p.base == (uint32_t) (4100 - 10000));
+	CHECK(sess_schedule(&p, &cmd, 6599, 0, &wait) == SESS_WAIT && wait == 1);
+	CHECK(sess_schedule(&p, &cmd, 6600, 0, &wait) == SESS_EXEC);
+
+	// the same across a wrap of the ms counter
+	sess_playerStart(&p, 0xFFFFF000, true);
+	CHECK(sess_schedule(&p, &fb, 0xFFFFFFF0, 0x0000, &wait) == SESS_WAIT);
+	CHECK(sess_schedule(&p, &fb, 0x00000010, 0x0001, &wait) == SESS_SKIP);
+	CHECK(sess_schedule(&p, &cmd, 0x00000010 + 2499, 0, &wait) == SESS_WAIT && wait == 1);
+	CHECK(sess_schedule(&p, &cmd, 0x00000010 + 2500, 0, &wait) == SESS_EXEC);
+}
+
+int main (void)
+{
+	srand(1);
+	test_layout();
+	test_roundtrip();
+	test_invalid();
+	test_saturation();
+	test_schedule();
+	test_triggers();
+	return check_result("sessrec_test");
+}
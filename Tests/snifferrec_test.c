@@ -0,0 +1,211 @@
+/*
+ * snifferrec_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief Replay harness for the sniffer records (snifferrec.c)
+ *
+ * A list of DCC packets as captured from the track is replayed through the
+ * same steps the sniffer task and the stream server use: classification,
+ * the ring buffer, the per-client filters and the binary encoding. The
+ * encoded capture is then read back with srec_decode() and compared.
+ *
+ * If a capture file (as written by the file capture mode) is given on the
+ * command line, it is decoded and printed instead.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "snifferrec.h"
+#include "check.h"
+
+static const struct {
+	uint8_t		len;
+	uint8_t		data[6];
+	int			cmd;
+	uint16_t	adr;
+} capture[] = {
+	{ 3, { 0xFF, 0x00, 0xFF },				SREC_CMD_IDLE,		0 },
+	{ 3, { 0x00, 0x41, 0x41 },				SREC_CMD_BROADCAST,	0 },
+	{ 4, { 0x03, 0x3F, 0x85, 0xB9 },		SREC_CMD_SPEED,		3 },
+	{ 3, { 0x03, 0x74, 0x77 },				SREC_CMD_SPEED,		3 },
+	{ 3, { 0x03, 0x90, 0x93 },				SREC_CMD_FUNC,		3 },
+	{ 4, { 0x03, 0xDE, 0x01, 0xDC },		SREC_CMD_FUNC,		3 },
+	{ 5, { 0xC4, 0xD2, 0x3F, 0x80, 0xA9 },	SREC_CMD_SPEED,		1234 },
+	{ 5, { 0x03, 0xEC, 0x00, 0x05, 0xEA },	SREC_CMD_POM,		3 },
+	{ 3, { 0x81, 0xF8, 0x79 },				SREC_CMD_ACC,		1 },
+	{ 3, { 0x82, 0xF9, 0x7B },				SREC_CMD_ACC,		2 },
+	{ 4, { 0x81, 0x71, 0x05, 0xF5 },		SREC_CMD_EXTACC,	0 },
+	{ 2, { 0x03, 0x03 },					SREC_CMD_OTHER,		0 },
+};
+
+#define CAPTURED	((int) (sizeof(capture) / sizeof(capture[0])))
+
+static int replayFile (const char *fname)
+{
+	static uint8_t buf[1 << 20];
+	struct srec r;
+	FILE *fp;
+	int len, pos, rc, i;
+
+	if ((fp = fopen(fname, "rb")) == NULL) {
+		perror (fname);
+		return 1;
+	}
+	len = fread(buf, 1, sizeof(buf), fp);
+	fclose (fp);
+	for (pos = 0; pos < len; pos += rc) {
+		if ((rc = srec_decode(&buf[pos], len - pos, &r)) <= 0) {
+			fprintf (stderr, "%s: %s record at offset %d\n", fname, (rc < 0) ? "invalid" : "truncated", pos);
+			return 1;
+		}
+		printf ("%10u fmt=%u cmd=%u adr=%-5u %s", r.ts, r.fmt, r.cmd, r.adr, (r.flags & SREC_FLAG_VALID) ? "OK " : "ERR");
+		for (i = 0; i < r.len; i++) printf (" %02X", r.data[i]);
+		printf ("\n");
+	}
+	return 0;
+}
+
+static void fillRecord (struct srec *r, int idx, uint32_t ts)
+{
+	memset (r, 0, sizeof(*r));
+	r->ts = ts;
+	r->fmt = SREC_FMT_DCC;
+	r->flags = (idx == CAPTURED - 1) ? 0 : SREC_FLAG_VALID;		// the last one is a damaged packet
+	r->len = capture[idx].len;
+	memcpy (r->data, capture[idx].data, r->len);
+	r->cmd = srec_dccClassify(r->data, r->len, &r->adr);
+}
+
+static void testClassify (void)
+{
+	uint16_t adr;
+	int i;
+
+	for (i = 0; i < CAPTURED; i++) {
+		CHECK(srec_dccClassify(capture[i].data, capture[i].len, &adr) == capture[i].cmd);
+		if (capture[i].cmd != SREC_CMD_OTHER && capture[i].cmd != SREC_CMD_EXTACC) CHECK(adr == capture[i].adr);
+	}
+	CHECK(srec_dccClassify(NULL, 0, &adr) == SREC_CMD_OTHER && adr == 0);
+}
+
+static void testFilters (void)
+{
+	struct srec_filter f;
+
+	srec_filterAll(&f);
+	CHECK(srec_parseFilter(&f, "fmt=dcc adr=3-3 cmd=speed,func"));
+	CHECK(f.adrmin == 3 && f.adrmax == 3);
+	CHECK(!srec_parseFilter(&f, "fmt=dcc,xyz"));			// unknown name - filter unchanged
+	CHECK(f.fmtmask == ((1 << SREC_FMT_DCC) | (1 << SREC_FMT_NONE)));
+	CHECK(!srec_parseFilter(&f, "adr=10-5"));
+	CHECK(!srec_parseFilter(&f, "bogus"));
+	CHECK(srec_parseFilter(&f, "all"));
+	CHECK(f.fmtmask == 0xFF && f.adrmax == 0xFFFF && !f.validonly);
+}
+
+/**
+ * Replay the capture through the ring to three clients with different
+ * filters and write everything to a capture "file" that is read back.
+ */
+static void testReplay (void)
+{
+	static struct srec_ring ring;
+	struct srec_filter fa, fb, fc;
+	struct srec r, d;
+	uint32_t sa, sb, sc;
+	uint8_t file[CAPTURED * SREC_MAXSIZE];
+	int i, na, nb, nc, flen, pos, rc;
+
+	srec_ringInit(&ring);
+	srec_filterAll(&fa);
+	srec_filterAll(&fb);
+	srec_filterAll(&fc);
+	CHECK(srec_parseFilter(&fa, "fmt=dcc adr=3-3 cmd=speed,func"));
+	CHECK(srec_parseFilter(&fb, "cmd=acc valid=1"));
+	sa = sb = sc = ring.head;
+
+	for (i = 0; i < CAPTURED; i++) {
+		fillRecord(&r, i, 1000 + i * 5800);
+		srec_ringPut(&ring, &r);
+	}
+
+	na = nb = nc = flen = 0;
+	while (srec_ringGet(&ring, &sa, &r)) if (srec_match(&fa, &r)) na++;
+	while (srec_ringGet(&ring, &sb, &r)) if (srec_match(&fb, &r)) nb++;
+	while (srec_ringGet(&ring, &sc, &r)) {
+		if (srec_match(&fc, &r)) nc++;
+		flen += srec_encode(&r, &file[flen], sizeof(file) - flen);
+	}
+	CHECK(na == 4);			// speed 128, speed 28, F0-F4, F13-F20 for address 3
+	CHECK(nb == 2);			// the two basic accessory commands
+	CHECK(nc == CAPTURED);
+
+	for (i = pos = 0; pos < flen; i++, pos += rc) {
+		rc = srec_decode(&file[pos], flen - pos, &d);
+		CHECK(rc > 0);
+		if (rc <= 0) break;
+		fillRecord(&r, i, 1000 + i * 5800);
+		CHECK(d.ts == r.ts && d.fmt == r.fmt && d.cmd == r.cmd && d.adr == r.adr && d.flags == r.flags);
+		CHECK(d.len == r.len && !memcmp(d.data, r.data, r.len));
+	}
+	CHECK(i == CAPTURED);
+	CHECK(srec_decode(file, 1, &d) == 0);					// incomplete
+	file[0] = 0;
+	CHECK(srec_decode(file, flen, &d) < 0);					// out of sync
+}
+
+static void testOverrun (void)
+{
+	static struct srec_ring ring;
+	struct srec r;
+	uint32_t seq;
+	int i, n;
+
+	srec_ringInit(&ring);
+	seq = ring.head;
+	for (i = 0; i < SREC_RINGSIZE + 44; i++) {
+		fillRecord(&r, i % CAPTURED, i);
+		srec_ringPut(&ring, &r);
+	}
+	CHECK(srec_ringGet(&ring, &seq, &r) == 1);
+	CHECK(r.cmd == SREC_CMD_LOST && r.adr == 44);
+	CHECK(srec_match(NULL, &r));
+	for (n = 0; srec_ringGet(&ring, &seq, &r); n++) ;
+	CHECK(n == SREC_RINGSIZE);
+}
+
+int main (int argc, char **argv)
+{
+	if (argc > 1) return replayFile(argv[1]);
+
+	testClassify();
+	testFilters();
+	testReplay();
+	testOverrun();
+	return check_result("snifferrec_test");
+}
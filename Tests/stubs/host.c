@@ -0,0 +1,224 @@
+/*
+ * host.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief Host implementations of the few system services used by the firmware modules under test
+ *
+ * There is only one thread, so mutexes always succeed and critical sections
+ * are empty. The tick counter is a plain variable that the tests advance
+ * themselves. Log messages are printed only if host_verbose is set.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "rb2.h"
+#include "timers.h"
+#include "host.h"
+
+#undef malloc
+#undef calloc
+#undef realloc
+
+TickType_t host_ticks;
+bool host_verbose;
+int host_locks;
+USART_TypeDef host_usart1;
+
+TickType_t xTaskGetTickCount (void)
+{
+	return host_ticks;
+}
+
+TickType_t xTaskGetTickCountFromISR (void)
+{
+	return host_ticks;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle (void)
+{
+	return (TaskHandle_t) &host_ticks;
+}
+
+char *pcTaskGetName (TaskHandle_t t)
+{
+	return "host";
+}
+
+void vTaskDelay (TickType_t ticks)
+{
+	host_ticks += ticks;
+}
+
+void vTaskDelayUntil (TickType_t *prev, TickType_t inc)
+{
+	*prev += inc;
+	if ((int32_t) (*prev - host_ticks) > 0) host_ticks = *prev;
+}
+
+/**
+ * Tasks are not started. The handle is set, so the code under test sees a
+ * running task and only notifies it.
+ */
+BaseType_t xTaskCreate (TaskFunction_t func, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle)
+{
+	if (handle) *handle = (TaskHandle_t) func;
+	return pdPASS;
+}
+
+void xTaskNotifyGive (TaskHandle_t t)
+{
+}
+
+static void *host_tls[8];
+
+void vTaskSetThreadLocalStoragePointer (TaskHandle_t t, BaseType_t idx, void *val)
+{
+	if (idx >= 0 && idx < (BaseType_t) DIM(host_tls)) host_tls[idx] = val;
+}
+
+void *pvTaskGetThreadLocalStoragePointer (TaskHandle_t t, BaseType_t idx)
+{
+	return (idx >= 0 && idx < (BaseType_t) DIM(host_tls)) ? host_tls[idx] : NULL;
+}
+
+/**
+ * Software timers never expire, pended functions are called at once.
+ */
+TimerHandle_t xTimerCreate (const char *name, TickType_t period, UBaseType_t reload, void *id, TimerCallbackFunction_t func)
+{
+	return (TimerHandle_t) func;
+}
+
+BaseType_t xTimerReset (TimerHandle_t t, TickType_t wait)
+{
+	return pdPASS;
+}
+
+BaseType_t xTimerStop (TimerHandle_t t, TickType_t wait)
+{
+	return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive (TimerHandle_t t)
+{
+	return pdFALSE;
+}
+
+BaseType_t xTimerPendFunctionCall (PendedFunction_t func, void *p1, uint32_t p2, TickType_t wait)
+{
+	func(p1, p2);
+	return pdPASS;
+}
+
+/**
+ * Waiting for a notification returns at once. The code under test runs to
+ * completion, so the event it waits for has already happened.
+ */
+uint32_t ulTaskNotifyTake (BaseType_t clear, TickType_t wait)
+{
+	return 1;
+}
+
+void vTaskNotifyGiveFromISR (TaskHandle_t t, BaseType_t *woken)
+{
+}
+
+/**
+ * There is only one task, so a mutex is always available. The nesting is
+ * counted, so a test can check that no lock is held at a certain point.
+ */
+bool mutex_lock (SemaphoreHandle_t * volatile mutex, TickType_t tout, const char *fn)
+{
+	host_locks++;
+	return true;
+}
+
+void mutex_unlock (SemaphoreHandle_t *mutex)
+{
+	host_locks--;
+}
+
+void *dbgmalloc (size_t size, const char *file, const char *func, int line)
+{
+	return malloc(size);
+}
+
+void *dbgcalloc (size_t units, size_t size, const char *file, const char *func, int line)
+{
+	return calloc(units, size);
+}
+
+void *dbgrealloc (void *mem, size_t newsize, const char *file, const char *func, int line)
+{
+	return realloc(mem, newsize);
+}
+
+/**
+ * Temporary buffers are taken round robin from a small pool like the
+ * firmware does, so they stay valid for a while.
+ */
+void *tmpbuf (size_t siz)
+{
+	static uint8_t pool[16][512];
+	static int idx;
+
+	if (siz > sizeof(pool[0])) return NULL;
+	idx = (idx + 1) % 16;
+	return pool[idx];
+}
+
+char *tmp64 (void)
+{
+	return tmpbuf(64);
+}
+
+char *tmp256 (void)
+{
+	return tmpbuf(256);
+}
+
+void log_msg (uint32_t level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!host_verbose) return;
+	va_start (ap, fmt);
+	vprintf (fmt, ap);
+	va_end (ap);
+}
+
+void log_error (const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!host_verbose) return;
+	va_start (ap, fmt);
+	vfprintf (stderr, fmt, ap);
+	va_end (ap);
+}
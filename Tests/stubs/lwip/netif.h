@@ -0,0 +1,42 @@
+/*
+ * netif.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Host replacement for lwip/netif.h
+ */
+
+#ifndef __LWIP_NETIF_H__
+#define __LWIP_NETIF_H__
+
+#include <stdint.h>
+
+typedef struct { uint32_t addr; } ip4_addr_t;	///< the real netif.h gets it from ip_addr.h (used in config.h)
+typedef ip4_addr_t ip_addr_t;
+
+struct netif;
+
+#endif /* __LWIP_NETIF_H__ */
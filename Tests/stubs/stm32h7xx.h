@@ -0,0 +1,91 @@
+/*
+ * stm32h7xx.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Host replacement for the CMSIS device header
+ *
+ * Only the types used in prototypes and the registers of the peripherals
+ * that modules under test access directly are provided. The registers are
+ * plain memory (see host.c), so a test can look at what was written and
+ * preset the status bits.
+ */
+
+#ifndef __STM32H7XX_H__
+#define __STM32H7XX_H__
+
+#include <stdint.h>
+
+typedef struct { uint32_t dummy; } I2C_TypeDef;
+
+typedef struct {
+	volatile uint32_t CR1, CR2, CR3, BRR, GTPR, RTOR, RQR, ISR, ICR, RDR, TDR, PRESC;
+} USART_TypeDef;
+
+typedef enum {
+	USART1_IRQn = 37,
+} IRQn_Type;
+
+extern USART_TypeDef host_usart1;
+#define USART1						(&host_usart1)
+
+#define USART_CR1_UE				(1u << 0)
+#define USART_CR1_RE				(1u << 2)
+#define USART_CR1_TE				(1u << 3)
+#define USART_CR1_RXNEIE_RXFNEIE	(1u << 5)
+#define USART_CR1_TCIE				(1u << 6)
+#define USART_CR1_TXEIE_TXFNFIE		(1u << 7)
+#define USART_CR1_M0				(1u << 12)
+#define USART_CR1_DEDT_Pos			16
+#define USART_CR1_DEAT_Pos			21
+#define USART_CR1_RTOIE				(1u << 26)
+#define USART_CR1_FIFOEN			(1u << 29)
+#define USART_CR2_RTOEN				(1u << 23)
+#define USART_CR3_HDSEL				(1u << 3)
+#define USART_CR3_DEM				(1u << 14)
+#define USART_CR3_RXFTCFG_Pos		25
+#define USART_CR3_RXFTIE			(1u << 28)
+#define USART_ISR_FE				(1u << 1)
+#define USART_ISR_NE				(1u << 2)
+#define USART_ISR_ORE				(1u << 3)
+#define USART_ISR_RXNE_RXFNE		(1u << 5)
+#define USART_ISR_TC				(1u << 6)
+#define USART_ISR_TXE_TXFNF			(1u << 7)
+#define USART_ISR_RTOF				(1u << 11)
+#define USART_ICR_ORECF				(1u << 3)
+#define USART_ICR_TXFECF			(1u << 5)
+#define USART_ICR_TCCF				(1u << 6)
+#define USART_ICR_RTOCF				(1u << 11)
+#define USART_RQR_RXFRQ				(1u << 3)
+
+#define SET_BIT(reg, bit)			((reg) |= (bit))
+#define CLEAR_BIT(reg, bit)			((reg) &= ~(bit))
+
+static inline void NVIC_SetPriority (IRQn_Type irq, uint32_t prio) { (void) irq; (void) prio; }
+static inline void NVIC_EnableIRQ (IRQn_Type irq) { (void) irq; }
+static inline void NVIC_ClearPendingIRQ (IRQn_Type irq) { (void) irq; }
+
+#endif /* __STM32H7XX_H__ */
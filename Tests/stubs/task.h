@@ -0,0 +1,53 @@
+/*
+ * task.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Host replacement for the FreeRTOS task API (a single thread with a simulated tick counter)
+ */
+
+#ifndef __TASK_H__
+#define __TASK_H__
+
+#include "FreeRTOS.h"
+
+#define taskENTER_CRITICAL()	do { } while (0)
+#define taskEXIT_CRITICAL()		do { } while (0)
+
+TickType_t xTaskGetTickCount (void);
+TickType_t xTaskGetTickCountFromISR (void);
+TaskHandle_t xTaskGetCurrentTaskHandle (void);
+char *pcTaskGetName (TaskHandle_t t);
+void vTaskDelay (TickType_t ticks);
+void vTaskDelayUntil (TickType_t *prev, TickType_t inc);
+BaseType_t xTaskCreate (TaskFunction_t func, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle);
+void xTaskNotifyGive (TaskHandle_t t);
+void vTaskSetThreadLocalStoragePointer (TaskHandle_t t, BaseType_t idx, void *val);
+void *pvTaskGetThreadLocalStoragePointer (TaskHandle_t t, BaseType_t idx);
+uint32_t ulTaskNotifyTake (BaseType_t clear, TickType_t wait);
+void vTaskNotifyGiveFromISR (TaskHandle_t t, BaseType_t *woken);
+
+#endif /* __TASK_H__ */
@@ -0,0 +1,46 @@
+/*
+ * timers.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief Host replacement for the FreeRTOS software timers
+ */
+
+#ifndef __TIMERS_H__
+#define __TIMERS_H__
+
+#include "FreeRTOS.h"
+
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t t);
+typedef void (*PendedFunction_t)(void *p1, uint32_t p2);
+
+TimerHandle_t xTimerCreate (const char *name, TickType_t period, UBaseType_t reload, void *id, TimerCallbackFunction_t func);
+BaseType_t xTimerReset (TimerHandle_t t, TickType_t wait);
+BaseType_t xTimerStop (TimerHandle_t t, TickType_t wait);
+BaseType_t xTimerIsTimerActive (TimerHandle_t t);
+BaseType_t xTimerPendFunctionCall (PendedFunction_t func, void *p1, uint32_t p2, TickType_t wait);
+
+#endif /* __TIMERS_H__ */
@@ -0,0 +1,299 @@
+/*
+ * swdog_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ * \brief The supervision of task heartbeats (swdog.c) with simulated tasks
+ *
+ * The simulated tasks run in 1ms steps like the tick hook that calls
+ * swd_check(). Each one follows a simple pattern: it works for some time
+ * and sends heartbeats, then it blocks waiting for work (idle), or it waits
+ * for a mutex held by another task. The checks cover the normal operation,
+ * a deadlock with its description, the choice of the worst task, the tick
+ * wrap-around, the shutdown grace period and a full table.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "swdog.h"
+#include "crashrec.h"
+#include "check.h"
+
+#define DIM(x)		((int)(sizeof(x) / sizeof(x[0])))
+
+/**
+ * A simulated task
+ */
+struct simtask {
+	const char			*name;
+	uint32_t			 timeout;		///< the timeout it registers with
+	uint32_t			 kick;			///< the time between two heartbeats while working (0 = never kicks)
+	uint32_t			 work;			///< the time it works before it blocks waiting for work (0 = works all the time)
+	uint32_t			 sleep;			///< the time it sleeps waiting for work
+	const void			*mutex;			///< the mutex it waits for (the task does not kick while waiting)
+	uint32_t			 lockAt;		///< the time (relative to the start) when it starts waiting for the mutex
+	struct swd_task		*entry;
+	uint32_t			 phase;
+};
+
+static struct swd_table table;
+static uint32_t now;
+static uint32_t base;				///< the start of the simulation (the tasks use the time relative to it)
+
+static void reset (uint32_t start)
+{
+	memset (&table, 0, sizeof(table));
+	now = base = start;
+}
+
+static void start (struct simtask *st, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		st[i].entry = swd_register(&table, st[i].name, &st[i], st[i].timeout, now);
+		st[i].phase = 0;
+		CHECK(st[i].entry != NULL);
+	}
+}
+
+/**
+ * Let a simulated task run for one millisecond.
+ */
+static void step (struct simtask *st, uint32_t t)
+{
+	uint32_t cycle, pos;
+
+	if (st->mutex && t == st->lockAt) swd_waitFor(st->entry, st->mutex, st->name, now);
+	if (st->mutex && t >= st->lockAt) return;		// blocked for good
+	if (!st->kick) return;
+
+	cycle = st->work + st->sleep;
+	pos = (st->work) ? t % cycle : t;
+	if (st->work && pos >= st->work) {
+		if (pos == st->work) swd_idle(st->entry);
+		return;
+	}
+	if (pos % st->kick == 0) swd_kick(st->entry, now);
+}
+
+/**
+ * Run the simulated tasks and call swd_check() every millisecond.
+ *
+ * \param st		the tasks
+ * \param count		the number of tasks
+ * \param ms		how long to run
+ * \param when		where to store the time of the first alarm (relative to the start)
+ * \return			the result of the first swd_check() that was not SWD_HEALTHY or SWD_HEALTHY
+ */
+static int run (struct simtask *st, int count, uint32_t ms, uint32_t *when)
+{
+	uint32_t t;
+	int i, rc;
+
+	while (ms-- > 0) {
+		t = now - base;
+		for (i = 0; i < count; i++) step(&st[i], t);
+		if ((rc = swd_check(&table, now)) != SWD_HEALTHY) {
+			if (when) *when = t;
+			return rc;
+		}
+		now++;
+	}
+	return SWD_HEALTHY;
+}
+
+/**
+ * The supervised tasks of the station in normal operation. The event worker
+ * sleeps much longer than its timeout.
+ */
+static void testHealthy (void)
+{
+	struct simtask st[] = {
+		{ .name = "SIGNAL", .timeout = 1000, .kick = 2 },
+		{ .name = "EVENTworker", .timeout = 5000, .kick = 100, .work = 300, .sleep = 20000 },
+		{ .name = "BiDiB-TXPIPE", .timeout = 30000, .kick = 25000, .work = 30000, .sleep = 60000 },
+	};
+
+	reset(1000);
+	start(st, DIM(st));
+	CHECK(run(st, DIM(st), 300000, NULL) == SWD_HEALTHY);
+}
+
+/**
+ * Two tasks wait for each other. The one with the shorter timeout is found
+ * first, and the description names the mutex holder.
+ */
+static void testDeadlock (void)
+{
+	static const int mutexA = 0, mutexB = 0;
+	struct simtask st[] = {
+		{ .name = "SIGNAL", .timeout = 1000, .kick = 2 },
+		{ .name = "EVENTworker", .timeout = 5000, .kick = 10, .mutex = &mutexA, .lockAt = 500 },
+		{ .name = "loco", .timeout = 2000, .kick = 10, .mutex = &mutexB, .lockAt = 700 },
+	};
+	char buf[CRASH_INFOLEN];
+	uint32_t when;
+	int idx, len;
+
+	reset(5000);
+	start(st, DIM(st));
+	idx = run(st, DIM(st), 60000, &when);
+	CHECK(idx == 2);
+	CHECK(when == 690 + 2000 + 1);				// the last heartbeat at 690, 1ms over the timeout
+	CHECK(table.t[idx].waitobj == &mutexB);
+
+	len = swd_describe(&table, idx, now, "EVENTworker", buf, sizeof(buf));
+	CHECK(len == (int) strlen(buf));
+	CHECK(!strcmp(buf, "2001ms without heartbeat (max 2000), waits 1991ms for mutex in loco() held by 'EVENTworker'"));
+
+	// without the first one, the other starving task is reported a bit later
+	swd_unregister(&table.t[2]);
+	idx = run(st, DIM(st) - 1, 60000, &when);
+	CHECK(idx == 1);
+	CHECK(now - table.t[1].last == 5001);
+	len = swd_describe(&table, idx, now, NULL, buf, sizeof(buf));
+	CHECK(strstr(buf, "held by '?'") != NULL);
+}
+
+/**
+ * Of several starved tasks, the one that is overdue the most is reported.
+ */
+static void testWorst (void)
+{
+	struct swd_task *a, *b, *c;
+	static int ha, hb, hc;
+
+	reset(0);
+	a = swd_register(&table, "A", &ha, 100, 0);
+	b = swd_register(&table, "B", &hb, 1000, 0);
+	c = swd_register(&table, "C", &hc, 50, 0);
+	CHECK(a && b && c);
+	CHECK(swd_check(&table, 50) == SWD_HEALTHY);
+	CHECK(swd_check(&table, 51) == c - table.t);
+	swd_kick(c, 40);
+	CHECK(swd_check(&table, 90) == SWD_HEALTHY);
+	CHECK(swd_check(&table, 101) == c - table.t);	// A: 1ms over, C: 11ms over
+	swd_idle(c);
+	CHECK(swd_check(&table, 101) == a - table.t);
+	CHECK(swd_check(&table, 2000) == a - table.t);	// A: 1900ms over, B: 1000ms over
+	swd_kick(a, 1500);
+	CHECK(swd_check(&table, 2000) == b - table.t);	// A: 400ms over
+}
+
+/**
+ * The heartbeats continue across the wrap-around of the tick counter.
+ */
+static void testWrap (void)
+{
+	struct simtask st[] = {
+		{ .name = "SIGNAL", .timeout = 1000, .kick = 5 },
+		{ .name = "stuck", .timeout = 3000, .kick = 10, .mutex = &table, .lockAt = 2000 },
+	};
+	uint32_t when;
+
+	reset(0xFFFFFFFF - 3000);
+	start(st, DIM(st));
+	CHECK(run(st, DIM(st), 4000, &when) == SWD_HEALTHY);
+	CHECK(now < 1000);							// the counter wrapped
+	CHECK(run(st, DIM(st), 60000, &when) == 1);
+	CHECK(now - table.t[1].last == 3001);
+}
+
+/**
+ * A shutdown ends the supervision, but only for SWD_SHUTDOWN_MS.
+ */
+static void testShutdown (void)
+{
+	struct simtask st[] = {
+		{ .name = "SIGNAL", .timeout = 1000, .kick = 0 },
+	};
+	char buf[CRASH_INFOLEN];
+	uint32_t when;
+
+	reset(100);
+	start(st, DIM(st));
+	swd_shutdown(&table, now);
+	CHECK(run(st, DIM(st), 60000, &when) == SWD_EXPIRED);
+	CHECK(when == SWD_SHUTDOWN_MS);
+	swd_shutdown(&table, now);					// a second request does not extend the grace period
+	CHECK(swd_check(&table, now) == SWD_EXPIRED);
+	swd_describe(&table, SWD_EXPIRED, now, NULL, buf, sizeof(buf));
+	CHECK(!strcmp(buf, "shutdown not completed within 10000ms"));
+	CHECK(swd_describe(&table, SWD_HEALTHY, now, NULL, buf, sizeof(buf)) == 0 && buf[0] == 0);
+}
+
+/**
+ * Registration: a full table, re-registration and the reuse of free entries.
+ */
+static void testTable (void)
+{
+	static int handles[SWD_MAXTASKS + 1];
+	struct swd_task *t;
+	char name[SWD_NAMELEN], buf[16];
+	int i;
+
+	reset(0);
+	for (i = 0; i < SWD_MAXTASKS; i++) {
+		sprintf (name, "task%d", i);
+		CHECK(swd_register(&table, name, &handles[i], 100, 0) == &table.t[i]);
+	}
+	CHECK(swd_register(&table, "one too many", &handles[SWD_MAXTASKS], 100, 0) == NULL);
+
+	t = swd_register(&table, "a very long task name", &handles[3], 5000, 50);
+	CHECK(t == &table.t[3] && t->timeout == 5000 && t->last == 50);
+	CHECK(!strcmp(t->name, "a very long tas"));
+	CHECK(swd_find(&table, &handles[3]) == t);
+
+	swd_unregister(&table.t[7]);
+	CHECK(swd_find(&table, &handles[7]) == NULL);
+	CHECK(swd_register(&table, "late", &handles[SWD_MAXTASKS], 100, 0) == &table.t[7]);
+	CHECK(swd_register(&table, NULL, &handles[7], 100, 0) == NULL);
+
+	// all functions accept a task that is not supervised
+	swd_kick(NULL, 0);
+	swd_idle(NULL);
+	swd_setTimeout(NULL, 10, 0);
+	swd_waitFor(NULL, &table, "x", 0);
+	swd_unregister(NULL);
+
+	// a description that does not fit is truncated
+	swd_waitFor(&table.t[0], &table, "function", 0);
+	CHECK(swd_describe(&table, 0, 1000, "holder", buf, sizeof(buf)) == sizeof(buf) - 1);
+	CHECK(strlen(buf) == sizeof(buf) - 1);
+}
+
+int main (void)
+{
+	testHealthy();
+	testDeadlock();
+	testWorst();
+	testWrap();
+	testShutdown();
+	testTable();
+
+	return check_result("swdog_test");
+}
@@ -0,0 +1,446 @@
+/*
+ * xpressnet_test.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: Andi
+ */
+
+/*
+ * RB2, next generation model railroad controller software
+ * Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+/**
+ * \file
+ * \brief The XpressNet interpreter with captured handheld requests (xpressnet.c)
+ *
+ * The source of the interface is included directly, so the static
+ * interpreter xpn_interpret() can be called with the bytes a handheld sent
+ * (as captured from a multiMaus and a LH101). The requests and answers are
+ * noted without the XOR byte, it is added and checked by xn(). The answer is
+ * taken from the transmit buffer and the call byte written to the UART. The loco database and the loco control are replaced by a few fake
+ * locos.
+ *
+ * Start with -v to see the debug output of the interface.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "host.h"
+
+#define printf(...)		(host_verbose ? printf(__VA_ARGS__) : 0)
+#include "../Src/Interfaces/xpressnet.c"
+#undef printf
+
+#include "check.h"
+
+/*
+ * ==================================================================================================
+ * The fake locos and the other services of the firmware
+ * ==================================================================================================
+ */
+struct fakeloco {
+	locoT		loco;
+	ldataT		ld;
+	funcT		fn[LOCO_MAX_FUNCS];
+	uint16_t	owner;						///< a client that does not let others control the loco
+};
+
+static struct fakeloco locos[] = {
+	{ .loco = { .adr = 3, .fmt = FMT_DCC_126 } },
+	{ .loco = { .adr = 100, .fmt = FMT_DCC_28 } },
+	{ .loco = { .adr = 4711, .fmt = FMT_DCC_126 } },
+};
+
+struct runtime rt;
+const flexval fvNULL;
+static uint16_t client;
+static struct { int adr; bool thrown, on; } lastTurnout;
+static struct { int adr, cv, val; } lastPom;
+static int controlEvents;
+
+static struct fakeloco *fake (int adr)
+{
+	unsigned i;
+
+	for (i = 0; i < DIM(locos); i++) {
+		if (locos[i].loco.adr == adr) return &locos[i];
+	}
+	return NULL;
+}
+
+ldataT *loco_call (int adr, bool add)
+{
+	struct fakeloco *f;
+
+	if ((f = fake(adr)) == NULL) return NULL;
+	f->ld.loco = &f->loco;
+	return &f->ld;
+}
+
+locoT *db_getLoco (int adr, bool add)
+{
+	struct fakeloco *f;
+
+	return ((f = fake(adr)) != NULL) ? &f->loco : NULL;
+}
+
+funcT *db_getLocoFunc (locoT *l, int func)
+{
+	struct fakeloco *f = (struct fakeloco *) l;
+
+	f->fn[func].fnum = func;
+	return &f->fn[func];
+}
+
+void db_locoFuncTiming (locoT *l, int func, int tim)
+{
+	db_getLocoFunc(l, func)->timing = tim;
+}
+
+void loco_setClient (uint16_t who)
+{
+	client = who;
+}
+
+static bool mayControl (struct fakeloco *f)
+{
+	return f && (!f->owner || f->owner == client);
+}
+
+int rq_setSpeed (int adr, int speed)
+{
+	struct fakeloco *f = fake(adr);
+
+	if (!mayControl(f)) return -1;
+	f->ld.speed = speed;
+	return 0;
+}
+
+int rq_setFuncMasked (int adr, uint32_t newfuncs, uint32_t mask)
+{
+	struct fakeloco *f = fake(adr);
+
+	if (!mayControl(f)) return -1;
+	f->ld.funcs[0] = (f->ld.funcs[0] & ~mask) | (newfuncs & mask);
+	return 0;
+}
+
+int rq_setFuncGroup (int adr, int first, int count, uint32_t funcs)
+{
+	struct fakeloco *f = fake(adr);
+	int i;
+
+	if (!mayControl(f)) return -1;
+	for (i = 0; i < count; i++) {
+		if (funcs & (1 << i)) f->ld.funcs[(first + i) / 32] |= 1u << ((first + i) % 32);
+		else f->ld.funcs[(first + i) / 32] &= ~(1u << ((first + i) % 32));
+	}
+	return 0;
+}
+
+void loco_releaseAll (uint16_t who) { }
+struct consist *consist_findConsist (int adr) { return NULL; }
+struct consist *consist_couple (int adr1, int adr2) { return NULL; }
+bool consist_remove (uint16_t adr) { return true; }
+turnoutT *db_lookupTurnout (int adr) { return NULL; }
+
+int trnt_switch (int adr, bool thrown, bool on)
+{
+	lastTurnout.adr = adr;
+	lastTurnout.thrown = thrown;
+	lastTurnout.on = on;
+	return 0;
+}
+
+int dccpom_readByte (int adr, dec_type dt, int cv, reply_handler handler, flexval priv)
+{
+	lastPom.adr = adr;
+	lastPom.cv = cv;
+	lastPom.val = -1;
+	return 0;
+}
+
+int dccpom_writeByte (int adr, dec_type dt, int cv, int val, reply_handler handler, flexval priv)
+{
+	lastPom.adr = adr;
+	lastPom.cv = cv;
+	lastPom.val = val;
+	return 0;
+}
+
+int dccpom_writeBit (int adr, dec_type dt, int cv, uint8_t bit, bool val, reply_handler handler, flexval priv) { return 0; }
+int dccpt_cvReadByte (int cv) { return 42; }
+
+enum trackmode sig_setMode (enum trackmode mode)
+{
+	rt.tm = mode;
+	return mode;
+}
+
+void mt_report (void) { }
+void mt_setdatetime (int year, int mon, int mday, int hour, int min) { }
+void mt_speedup (int factor) { }
+void dbg_putc (const char c) { }
+int event_register (enum event evt, ev_handler handler, void *prv, TickType_t timeout) { return 0; }
+
+int event_fireEx (enum event evt, int param, void *src, uint32_t flags, TickType_t timeout)
+{
+	if (evt == EVENT_CONTROLS) controlEvents++;
+	if (flags & EVTFLAG_FREE_SRC) free (src);
+	return 0;
+}
+
+/*
+ * ==================================================================================================
+ * Sending captured requests
+ * ==================================================================================================
+ */
+static int parse (const char *s, uint8_t *buf)
+{
+	char *end;
+	int n = 0;
+
+	while (*s && n < MAX_BLKLEN) {
+		buf[n++] = strtoul(s, &end, 16);
+		if (end == s) return n - 1;
+		s = end;
+	}
+	return n;
+}
+
+static const char *format (const uint8_t *buf, int len)
+{
+	static char line[3 * MAX_BLKLEN + 1];
+	int i;
+
+	line[0] = 0;
+	for (i = 0; i < len; i++) sprintf (line + strlen(line), "%s%02X", (i) ? " " : "", buf[i]);
+	return line;
+}
+
+/**
+ * Hand a request of a node to the interpreter and compare the answer.
+ * The requests and answers are written without the XOR byte, it is added
+ * to the request and checked in the answer here.
+ *
+ * \param node		the bus address of the node
+ * \param request	the request as hex bytes
+ * \param answer	the expected answer as hex bytes or NULL, if no answer is expected
+ * \return			true, if the answer was as expected
+ */
+static bool xn (int node, const char *request, const char *answer)
+{
+	const char *got;
+	uint8_t xor;
+	int i, rc;
+
+	rxbuf.len = parse(request, rxbuf.buf);
+	for (i = 0, xor = 0; i < rxbuf.len; i++) xor ^= rxbuf.buf[i];
+	rxbuf.buf[rxbuf.len++] = xor;
+	if (xpn_checkMessage(&rxbuf) != 0) {
+		fprintf (stderr, "request '%s' is not a valid XpressNet message\n", request);
+		return false;
+	}
+	txbuf.len = 0;
+	USART1->TDR = 0;
+	rc = xpn_interpret(&nodes[node], &rxbuf);
+	if (!answer) return rc == 0 && txbuf.len == 0;
+	if (rc != 1 || USART1->TDR != xpn_parity(XPN_ANSWER | node)) {
+		fprintf (stderr, "request '%s': no answer to node %d (rc %d, callbyte 0x%03X)\n", request, node, rc, (unsigned) USART1->TDR);
+		return false;
+	}
+	if (xpn_checkMessage(&txbuf) != 0) {
+		fprintf (stderr, "request '%s': bad answer '%s'\n", request, format(txbuf.buf, txbuf.len));
+		return false;
+	}
+	got = format(txbuf.buf, txbuf.len - 1);
+	if (strcmp(got, answer)) {
+		fprintf (stderr, "request '%s': answer '%s', expected '%s'\n", request, got, answer);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * ==================================================================================================
+ * The tests
+ * ==================================================================================================
+ */
+static void testSystem (void)
+{
+	CHECK(xpn_parity(0x63) == 0x163);
+	CHECK(xpn_parity(0x61) == 0x1E1);
+
+	CHECK(xn(3, "21 21", "63 21 39 01"));		// software version
+	rt.tm = TM_GO;
+	CHECK(xn(3, "21 24", "62 22 00"));		// command station status
+	CHECK(xn(3, "21 80", "62 22 02"));		// emergency off
+	CHECK(rt.tm == TM_STOP);
+	CHECK(xn(3, "21 81", "62 22 00"));		// resume
+	CHECK(rt.tm == TM_GO);
+	CHECK(xn(3, "21 99", "61 82"));			// unknown request
+	CHECK(controlEvents == 1);						// the node was seen for the first time
+	CHECK(nodes[3].flags & NODEFLG_ACTIVE);
+}
+
+static void testSpeedAndFunctions (void)
+{
+	struct fakeloco *f = fake(3);
+	ldataT *l = &f->ld;
+
+	CHECK(xn(3, "E4 13 00 03 8B", NULL));		// 128 steps, forward, speed step 11
+	CHECK(l->speed == (0x80 | 10));
+	CHECK(nodes[3].loco == 3);
+	CHECK(xn(3, "E4 13 00 03 01", NULL));		// emergency stop keeps the direction bit only
+	CHECK(l->speed == 0x00);
+	CHECK(xn(3, "E4 20 00 03 11", NULL));		// F0 + F1
+	CHECK(l->funcs[0] == 0x03);
+	CHECK(xn(3, "E4 21 00 03 09", NULL));		// F5 + F8
+	CHECK(l->funcs[0] == 0x123);
+	CHECK(xn(3, "E4 23 00 03 81", NULL));		// F13 + F20
+	CHECK(l->funcs[0] == (0x123 | (1 << 13) | (1 << 20)));
+	CHECK(xn(3, "E4 28 00 03 81", NULL));		// F21 + F28
+	CHECK(l->funcs[0] == (0x123 | (1 << 13) | (1 << 20) | (1 << 21) | (1u << 28)));
+	CHECK(xn(3, "E4 29 00 03 81", NULL));		// F29 + F36
+	CHECK(l->funcs[0] & (1u << 29));
+	CHECK(l->funcs[1] == (1 << 4));
+	CHECK(xn(3, "E4 51 00 03 80", NULL));		// F68
+	CHECK(l->funcs[2] == (1 << 4));
+
+	// the state as a handheld asks for it after selecting the loco
+	l->speed = 0x80 | 10;
+	CHECK(xn(3, "E3 00 00 03", "E4 04 8B 11 09"));				// speed, F0 - F12
+	CHECK(xn(3, "E3 09 00 03", "E3 52 81 81"));					// F13 - F28
+	CHECK(xn(3, "E3 0B 00 03", "E6 53 81 00 00 00 80"));			// F29 - F68
+
+	// 28 speed steps and a long address
+	f = fake(100);
+	CHECK(xn(5, "E4 12 C0 64 15", NULL));		// 28 steps, reverse, speed step 8 (0b10101 = 11 incl. stop and emergency stop)
+	CHECK(f->ld.speed == 8);
+	CHECK(nodes[5].loco == 100);
+	CHECK(xn(5, "E3 00 C0 64", "E4 02 15 00 00"));
+}
+
+/**
+ * The switch / momentary attributes are kept in the loco database. Group 5
+ * (F21 - F28) uses the command 0x2C.
+ */
+static void testMomentary (void)
+{
+	struct fakeloco *f = fake(4711);
+	locoT *l = &f->loco;
+
+	CHECK(xn(7, "E4 24 12 67 11", NULL));			// F0 and F1 momentary
+	CHECK(f->fn[0].timing < 0 && f->fn[1].timing < 0 && f->fn[2].timing == 0);
+	CHECK(xn(7, "E4 2C 12 67 83", NULL));			// F21, F22 and F28 momentary
+	CHECK(f->fn[21].timing < 0 && f->fn[22].timing < 0 && f->fn[28].timing < 0);
+	CHECK(f->fn[23].timing == 0);
+	CHECK(xn(7, "E4 2F 12 67 FF", "61 82"));			// 0x2F is no attribute command
+	CHECK(f->fn[27].timing == 0 && f->fn[23].timing == 0);
+
+	db_locoFuncTiming(l, 5, 20);						// a timed function stays timed
+	CHECK(xn(7, "E4 25 12 67 01", NULL));
+	CHECK(f->fn[5].timing == 20);
+
+	CHECK(xn(7, "E3 07 12 67", "E3 50 11 00"));			// F0 - F12
+	CHECK(xn(7, "E3 08 12 67", "E3 51 00 83"));			// F13 - F28
+	CHECK(xn(7, "E4 2C 12 67 00", NULL));					// all switching again
+	CHECK(f->fn[21].timing == 0 && f->fn[28].timing == 0);
+	CHECK(xn(7, "E3 08 12 67", "E3 51 00 00"));
+}
+
+/**
+ * Another handheld takes the loco of node 3: node 3 is informed and sees
+ * the loco as controlled by another device.
+ */
+static void testTakeOver (void)
+{
+	struct own_change oc;
+	uint32_t funcs[MAX_FUNC_WORDS];
+	eventT e;
+
+	memset (&oc, 0, sizeof(oc));
+	oc.adr = 3;
+	oc.from = OWN_TOKEN(OWN_XPRESSNET, 3);
+	oc.to = OWN_TOKEN(OWN_XPRESSNET, 9);
+	oc.taken = true;
+	memset (&e, 0, sizeof(e));
+	e.ev = EVENT_LOCO_OWNER;
+	e.src = &oc;
+	CHECK(xpn_eventhandler(&e, NULL));
+	CHECK((nodes[3].flags & (NODEFLG_LB | NODEFLG_INFORM)) == (NODEFLG_LB | NODEFLG_INFORM));
+
+	txbuf.len = 0;
+	xpn_lostControl(&nodes[3]);
+	CHECK(!strcmp(format(txbuf.buf, txbuf.len - 1), "E3 40 00 03"));
+	nodes[3].flags &= ~NODEFLG_INFORM;
+	CHECK(xn(3, "E3 00 00 03", "E4 0C 8B 11 09"));		// "controlled by another device" in the ID byte
+
+	// the new owner locks the loco, so a speed command of node 3 is rejected
+	fake(3)->owner = OWN_TOKEN(OWN_XPRESSNET, 9);
+	nodes[3].flags &= ~NODEFLG_LB;
+	CHECK(xn(3, "E4 13 00 03 85", NULL));
+	CHECK(fake(3)->ld.speed == (0x80 | 10));
+	CHECK(nodes[3].flags & NODEFLG_INFORM);
+
+	// the upper function groups are checked the same way
+	memcpy (funcs, fake(3)->ld.funcs, sizeof(funcs));
+	nodes[3].flags &= ~(NODEFLG_LB | NODEFLG_INFORM);
+	CHECK(xn(3, "E4 29 00 03 02", NULL));		// F30 (F29 - F36)
+	CHECK((nodes[3].flags & (NODEFLG_LB | NODEFLG_INFORM)) == (NODEFLG_LB | NODEFLG_INFORM));
+	nodes[3].flags &= ~(NODEFLG_LB | NODEFLG_INFORM);
+	CHECK(xn(3, "E4 51 00 03 01", NULL));		// F61 (F61 - F68)
+	CHECK((nodes[3].flags & (NODEFLG_LB | NODEFLG_INFORM)) == (NODEFLG_LB | NODEFLG_INFORM));
+	CHECK(!memcmp(funcs, fake(3)->ld.funcs, sizeof(funcs)));
+	fake(3)->owner = 0;
+	CHECK(xn(3, "E4 29 00 03 02", NULL));
+	CHECK(!(nodes[3].flags & NODEFLG_LB));
+	CHECK(fake(3)->ld.funcs[0] & (1u << 30));
+
+	nodes[5].loco = 100;
+	txbuf.len = 0;
+	xpn_lostControl(&nodes[5]);
+	CHECK(!strcmp(format(txbuf.buf, txbuf.len - 1), "E3 40 C0 64"));
+}
+
+static void testAccessoriesAndPom (void)
+{
+	CHECK(xn(3, "52 00 89", NULL));				// turnout 1, output 0, on
+	CHECK(lastTurnout.adr == 1 && lastTurnout.thrown == false && lastTurnout.on);
+	CHECK(xn(3, "52 01 82", NULL));				// turnout 6, output 0, off
+	CHECK(lastTurnout.adr == 6 && !lastTurnout.on);
+
+	CHECK(xn(3, "E6 30 C0 64 EC 1C 05", NULL));	// POM write CV 29 (index 28) = 5 for loco 100
+	CHECK(lastPom.adr == 100 && lastPom.cv == 28 && lastPom.val == 5);
+}
+
+int main (int argc, char **argv)
+{
+	int i;
+
+	if (argc > 1 && !strcmp(argv[1], "-v")) host_verbose = true;
+	for (i = 0; i < MAX_NODES; i++) nodes[i].adr = i;
+
+	testSystem();
+	testSpeedAndFunctions();
+	testMomentary();
+	testTakeOver();
+	testAccessoriesAndPom();
+	return check_result("xpressnet_test");
+}
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+#
+# RB2, next generation model railroad controller software
+# Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+"""
+Decode a crash record (struct crash_record in Inc/crashrec.h) that was
+downloaded from the station with /cgi/query?crash&idx=n.
+
+    crashdecode.py crash3.bin [firmware.elf]
+
+If the ELF file of the firmware that crashed is given, all code addresses
+are resolved to function, file and line with arm-none-eabi-addr2line.
+"""
+
+import argparse
+import struct
+import subprocess
+import sys
+import zlib
+
+CRASH_MAGIC = 0x48535243
+CRASH_VERSION = 1
+NAMELEN = 16
+INFOLEN = 96
+MAXTASKS = 32
+FRAMES = 20
+LOGSIZE = 1536
+
+HEADER = struct.Struct("<IHHI" + "IIIIII" + "5I" + "IIII" + "%ds%ds" % (NAMELEN, INFOLEN) + "HHHH")
+TASK = struct.Struct("<%dsBBHI" % NAMELEN)
+RECORD_SIZE = HEADER.size + MAXTASKS * TASK.size + FRAMES * 4 + LOGSIZE
+
+REASONS = {1: "fault in task", 2: "fault in exception handler", 3: "failed assertion", 4: "stack overflow", 5: "watchdog (task starved)"}
+STATES = {0: "running", 1: "ready", 2: "blocked", 3: "suspended", 4: "deleted"}
+
+CFSR_BITS = [
+    (0, "MemManage: instruction access violation"),
+    (1, "MemManage: data access violation"),
+    (3, "MemManage: exception return caused stack access violation"),
+    (4, "MemManage: exception entry caused stack access violation"),
+    (5, "MemManage: fault during floating-point lazy state preservation"),
+    (8, "BusFault: instruction bus error"),
+    (9, "BusFault: precise data bus error"),
+    (10, "BusFault: imprecise data bus error"),
+    (11, "BusFault: exception return caused stack access error"),
+    (12, "BusFault: exception entry caused stack access error"),
+    (13, "BusFault: fault during floating-point lazy state preservation"),
+    (16, "UsageFault: undefined instruction"),
+    (17, "UsageFault: illegal use of the EPSR"),
+    (18, "UsageFault: invalid PC load"),
+    (19, "UsageFault: no coprocessor"),
+    (24, "UsageFault: unaligned access"),
+    (25, "UsageFault: division by zero"),
+]
+
+
+def cstr(b):
+    return b.split(b"\0", 1)[0].decode("latin-1")
+
+
+class Symbolizer:
+    def __init__(self, elf, tool):
+        self.elf = elf
+        self.tool = tool
+
+    def __call__(self, addrs):
+        if not self.elf or not addrs:
+            return {a: "" for a in addrs}
+        out = subprocess.run([self.tool, "-f", "-C", "-e", self.elf] + ["0x%08x" % (a & ~1) for a in addrs],
+                             capture_output=True, text=True, check=True).stdout.splitlines()
+        return {a: "%s (%s)" % (out[2 * i], out[2 * i + 1]) for i, a in enumerate(addrs)}
+
+
+def decode(data, sym):
+    if len(data) < RECORD_SIZE:
+        sys.exit("record too short (%d bytes, expected %d)" % (len(data), RECORD_SIZE))
+    h = HEADER.unpack_from(data)
+    magic, version, size, crc = h[0:4]
+    reason, uptime, pc, lr, sp, xpsr = h[4:10]
+    regs = h[10:15]
+    cfsr, hfsr, mmfar, bfar = h[15:19]
+    task, info = cstr(h[19]), cstr(h[20])
+    ntasks, nframes, loglen = h[21:24]
+
+    if magic != CRASH_MAGIC or version != CRASH_VERSION or size != RECORD_SIZE:
+        sys.exit("not a crash record of version %d (magic 0x%08x, version %d, size %d)" % (CRASH_VERSION, magic, version, size))
+    check = bytearray(data[:RECORD_SIZE])
+    check[8:12] = b"\0\0\0\0"
+    if zlib.crc32(check) != crc:
+        print("WARNING: CRC mismatch, the record may be damaged")
+
+    off = HEADER.size
+    tasks = [TASK.unpack_from(data, off + i * TASK.size) for i in range(min(ntasks, MAXTASKS))]
+    off += MAXTASKS * TASK.size
+    frames = list(struct.unpack_from("<%dI" % FRAMES, data, off))[:min(nframes, FRAMES)]
+    off += FRAMES * 4
+    log = data[off:off + min(loglen, LOGSIZE)].decode("latin-1")
+
+    names = sym([a for a in [pc, lr] + frames if a])
+
+    print("Reason:  %s" % REASONS.get(reason, "unknown (%d)" % reason))
+    print("Uptime:  %d.%03d s" % (uptime // 1000, uptime % 1000))
+    print("Task:    %s" % task)
+    if info:
+        print("Info:    %s" % info)
+    if reason in (1, 2):
+        print("PC:      0x%08x %s" % (pc, names.get(pc, "")))
+        print("LR:      0x%08x %s" % (lr, names.get(lr, "")))
+        print("SP:      0x%08x  xPSR 0x%08x" % (sp, xpsr))
+        print("R0-R3:   " + " ".join("0x%08x" % r for r in regs[:4]) + "  R12 0x%08x" % regs[4])
+        print("CFSR:    0x%08x  HFSR 0x%08x" % (cfsr, hfsr))
+        for bit, text in CFSR_BITS:
+            if cfsr & (1 << bit):
+                print("         %s" % text)
+        if cfsr & (1 << 7):
+            print("         MemManage fault address 0x%08x" % mmfar)
+        if cfsr & (1 << 15):
+            print("         BusFault address 0x%08x" % bfar)
+    elif pc:
+        print("Caller:  0x%08x %s" % (pc, names.get(pc, "")))
+
+    if frames:
+        print("\nBacktrace:")
+        for i, a in enumerate(frames):
+            print("  #%-2d 0x%08x %s" % (i, a, names.get(a, "")))
+
+    if tasks:
+        print("\nTasks:")
+        print("  %-16s %-10s %4s %8s  %s" % ("name", "state", "prio", "free", "stack"))
+        for name, state, prio, hwm, stack in tasks:
+            print("  %-16s %-10s %4d %8d  0x%08x" % (cstr(name), STATES.get(state, str(state)), prio, hwm * 4, stack))
+
+    if log:
+        print("\nLog:")
+        print(log.rstrip("\n"))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Decode a crash record of the station")
+    ap.add_argument("record", help="the binary crash record")
+    ap.add_argument("elf", nargs="?", help="the ELF file of the firmware to resolve addresses")
+    ap.add_argument("--addr2line", default="arm-none-eabi-addr2line", help="the addr2line tool to use")
+    args = ap.parse_args()
+    with open(args.record, "rb") as f:
+        data = f.read()
+    decode(data, Symbolizer(args.elf, args.addr2line))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+#
+# RB2, next generation model railroad controller software
+# Copyright (C) 2026 Tams Elektronik GmbH and Andreas Kretzer
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+"""
+Convert a session recording (see Src/System/sessrec.c) that was downloaded
+from the station by FTP (/sessions/sessN.bin) to readable text.
+
+    sessdecode.py sess3.bin [sess4.bin ...]
+
+Several files of a rotated recording can be given in their order, the time
+stamps continue from one file to the next.
+"""
+
+import argparse
+import sys
+
+SYNC = 0x5A
+HEADER = 11
+MAXTIME = 0xFFFF    # the time of a TURNOUT has 2 bytes, longer times are saturated to this value
+
+# type: (name, width of v1, width of v2)
+TYPES = {
+    0: ("START", 4, 0),
+    1: ("SPEED", 1, 0),
+    2: ("FUNC", 4, 4),
+    3: ("ESTOP", 0, 0),
+    4: ("TURNOUT", 1, 2),
+    5: ("TRACKMODE", 1, 0),
+    6: ("FEEDBACK", 2, 2),
+    7: ("LOST", 2, 0),
+}
+
+INTERFACES = ["-", "WEB", "Z21", "P50x", "LocoNet", "XpressNet", "EasyNet", "MCAN", "BiDiB", "Sniffer"]
+
+TRACKMODES = ["STOP", "SHORT", "HALT", "GO", "SIGON", "DCCPROG", "TAMSPROG", "TESTDRIVE", "POWERFAIL", "RESET", "OVERTEMP", "TEMPOK"]
+
+
+def source(src):
+    if src == 0:
+        return "-"
+    ifc, client = src >> 8, src & 0xFF
+    name = INTERFACES[ifc] if ifc < len(INTERFACES) else "IF%d" % ifc
+    return "%s#%d" % (name, client)
+
+
+def describe(typ, adr, v1, v2):
+    if typ == 0:
+        return "version %d, uptime %.3fs" % (adr, v1 / 1000.0)
+    if typ == 1:
+        return "loco %d %s %d" % (adr, "fwd" if v1 & 0x80 else "rev", v1 & 0x7F)
+    if typ == 2:
+        on = [str(f) for f in range(32) if (v2 >> f) & 1 and (v1 >> f) & 1]
+        off = [str(f) for f in range(32) if (v2 >> f) & 1 and not (v1 >> f) & 1]
+        return "loco %d on F%s off F%s" % (adr, ",".join(on) or "-", ",".join(off) or "-")
+    if typ == 3:
+        return "loco %d" % adr
+    if typ == 4:
+        s = "turnout %d %s %s" % (adr, "thrown" if v1 & 1 else "straight", "on" if v1 & 2 else "off")
+        if v2 >= MAXTIME:
+            return s + " for %dms or longer" % v2
+        return s + (" for %dms" % v2 if v2 else "")
+    if typ == 5:
+        return TRACKMODES[v1] if v1 < len(TRACKMODES) else "mode %d" % v1
+    if typ == 6:
+        chg = [str(adr * 16 + 16 - b) for b in range(16) if (v2 >> b) & 1]
+        return "module %d status 0x%04x changed %s" % (adr + 1, v1, ",".join(chg))
+    if typ == 7:
+        return "%d records dropped" % v1
+    return ""
+
+
+def decode(data, out):
+    pos = 0
+    while pos + 3 <= len(data):
+        if data[pos] != SYNC or data[pos + 2] not in TYPES:
+            pos += 1
+            continue
+        name, w1, w2 = TYPES[data[pos + 2]]
+        reclen = HEADER + w1 + w2
+        if data[pos + 1] != reclen:
+            pos += 1
+            continue
+        if pos + reclen > len(data):
+            out.write("# truncated record at offset %d\n" % pos)
+            break
+        rec = data[pos:pos + reclen]
+        ts = int.from_bytes(rec[3:7], "little")
+        src = int.from_bytes(rec[7:9], "little")
+        adr = int.from_bytes(rec[9:11], "little")
+        v1 = int.from_bytes(rec[HEADER:HEADER + w1], "little")
+        v2 = int.from_bytes(rec[HEADER + w1:reclen], "little")
+        out.write("%10.3f  %-12s %-10s %s\n" % (ts / 1000.0, source(src), name, describe(data[pos + 2], adr, v1, v2)))
+        pos += reclen
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Convert a session recording of the station to text")
+    ap.add_argument("files", nargs="+", help="the binary session recordings")
+    args = ap.parse_args()
+    for fname in args.files:
+        with open(fname, "rb") as f:
+            data = f.read()
+        sys.stdout.write("# %s\n" % fname)
+        decode(data, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()